@@ -1,5 +1,8 @@
 //======================================================================================
 /** \file  Go_Home.cpp is a task which finds home (R=0, THETA=0) for our plotter
+ *
+ *  Revisions:
+ *    \li  06-19-11  Homing finishes when a switch is already closed, as between signature lines
  *
  *  License:
  *    This file released under the Lesser GNU Public License. The program is intended
@@ -80,14 +83,19 @@ char Go_Home::run(char state)
 				Home_Request = true;
 				
 				//if cart not already homed, engage cart motor towards home, disable cart's PID
-				if (PORTE && PIN4)
+				Wipe_Master1->Request_Home(true);
+				if (PINE & (1 << PIN4))
 				{
 					// set motor direction towards r=0 and engage motor.
 					Vtec_wins->set_mode (1, 2);
-					Wipe_Master1->Request_Home(true);
 					Vtec_wins->update_duty_cycle (1, 150);
 					
 				}	
+				// the switch is already closed, so no edge will come to tell us
+				else
+				{
+					cart_switch = true;
+				}
 				return(1);
 			}
 			else
@@ -103,13 +111,17 @@ char Go_Home::run(char state)
 				Vtec_wins->update_duty_cycle (1, 0);
 				
 				// if arm not already homed, send it home.
-				if (PORTE && PIN5)
+				Wipe_Master2->Request_Home(true);
+				if (PINE & (1 << PIN5))
 				{
 					// set motor direction towards theta=0 and engage motor.
 					Vtec_wins->set_mode (2, 2);
-					Wipe_Master2->Request_Home(true);
 					Vtec_wins->update_duty_cycle (2, 255);	
 				}
+				else
+				{
+					arm_switch = true;
+				}
 				return(2);
 			}
 			return(STL_NO_TRANSITION);
@@ -140,6 +152,7 @@ char Go_Home::run(char state)
 			return(STL_NO_TRANSITION);
 		break;	
 	}	
+	return(STL_NO_TRANSITION);
 }
 
 /** SET_Home_Request allows homing to be initiated by other tasks
@@ -3,33 +3,133 @@
 	*  Revisions:
 	*            \li  04-26-11  Began tearing and hacking at our lab_4 code.
 	*	         \li  04-29-11  Writing this code feels funny. I'm dubious about what I've written
-	*    		 \li  05-05-11	Finalize code for lab5	
+	*    		 \li  05-05-11	Finalize code for lab5
+	*            \li  06-12-11  Transfers are now run by the SPI interrupt, with Timer 2
+	*                           timing the gaps between bytes instead of delay loops
+	*            \li  06-13-11  One snapshot command with a CRC-8 reads both encoders
+	*            \li  06-15-11  Encoder speeds are copied into the snapshots too
 	*
 	*  License:
 	*    This file released under the Lesser GNU Public License. The program is intended
-	*    for educational use only, but its use is not restricted thereto. 
+	*    for educational use only, but its use is not restricted thereto.
 	*/
 	//======================================================================================
 
 	#include <stdlib.h>							// Include standard library header files
 	#include <avr/io.h>							// You'll need this for SFR and bit names
+	#include <avr/interrupt.h>					// For the SPI and Timer 2 interrupts
 	#include "rs232int.h"						// Include header for serial port class
 	#include "Master.h"							// Include header for SPI driver class
-	
-	#define WAIT 150							/// WAIT is used as a delay to allow proper SPI communication
+
+	// Timer 2 times the gaps between bytes. It counts at the CPU clock over 8 and is
+	// started for one compare match per gap. The ATmega128 keeps its controls in one
+	// register; the ATmega1281 splits them up and renames them
+	#ifdef OCR2A
+		#define GAP_OCR			OCR2A				///< Compare register holding gap length
+		#define GAP_TIMSK		TIMSK2				///< Register holding the interrupt enable
+		#define GAP_IE			OCIE2A				///< Compare match interrupt enable bit
+		#define GAP_TIFR		TIFR2				///< Register holding the match flag
+		#define GAP_FLAG		OCF2A				///< Compare match flag bit
+		#define GAP_CLOCK_REG	TCCR2B				///< Register which starts and stops timer
+		#define GAP_CLOCK_ON	(1 << CS21)			///< Clock select for CPU clock over 8
+		#define GAP_CLOCK_OFF	0					///< No clock, timer stopped
+		#define GAP_vect		TIMER2_COMPA_vect	///< Compare match interrupt vector
+	#else
+		#define GAP_OCR			OCR2
+		#define GAP_TIMSK		TIMSK
+		#define GAP_IE			OCIE2
+		#define GAP_TIFR		TIFR
+		#define GAP_FLAG		OCF2
+		#define GAP_CLOCK_REG	TCCR2
+		#define GAP_CLOCK_ON	((1 << WGM21) | (1 << CS21))
+		#define GAP_CLOCK_OFF	(1 << WGM21)
+		#define GAP_vect		TIMER2_COMP_vect
+	#endif
+
+	/// Number of Timer 2 counts in one gap between bytes
+	#define GAP_TICKS		((F_CPU / 8000000UL) * MASTER_BYTE_GAP_US)
+
+	#if GAP_TICKS > 256 || GAP_TICKS < 1
+		#error MASTER_BYTE_GAP_US is too long for Timer 2
+	#endif
+
+	/// Pointer to the Master object so that the interrupt service routines can reach it
+	static Master* p_the_master = NULL;
+
+
+	//-------------------------------------------------------------------------------------
+	/** start_gap starts Timer 2 counting out one gap between bytes. When it finishes, the
+	*	compare match flag is set and, if its interrupt is enabled, gap_interrupt() runs.
+	*/
+	static inline void start_gap (void)
+	{
+		TCNT2 = 0;
+		GAP_TIFR = (1 << GAP_FLAG);				// Writing a one clears the flag
+		GAP_CLOCK_REG = GAP_CLOCK_ON;
+	}
+
+	/** wait_gap waits for one gap between bytes to pass. It is only used by CLEAR(), with
+	*	the SPI and Timer 2 interrupts masked; the wait is bounded because the timer always
+	*	reaches its match.
+	*/
+	static void wait_gap (void)
+	{
+		start_gap ();
+		while (!(GAP_TIFR & (1 << GAP_FLAG)))	{}
+		GAP_CLOCK_REG = GAP_CLOCK_OFF;
+	}
+
+	/** poll_byte waits out one gap, then sends a byte and waits for the reply, which is
+	*	bounded because the master always clocks out all eight bits.
+	*	@param data The byte to be sent
+	*	@return The byte received from the slave
+	*/
+	static uint8_t poll_byte (uint8_t data)
+	{
+		wait_gap ();
+		SPDR = data;
+		while (!(SPSR & (1 << SPIF)))	{}			// Wait for transfer
+		return (SPDR);
+	}
+
+
 	//-------------------------------------------------------------------------------------
 	/** The constructor takes in a serial pointer and saves it locally and constructs a
-	*	Master object. The object sets up SPI communications as a master.
+	*	Master object. The object sets up SPI communications as a master and sets up
+	*	Timer 2 to time the gaps between bytes.
 	*	@param p_serial_port serial object to allow printing
 	*/
 	Master::Master (base_text_serial* p_serial_port)
 	{
 		ptr_to_serial = p_serial_port;          // Store the serial port pointer locally
-		
+
 		// say hello
 		*ptr_to_serial << "The Master Cometh" << endl;
-		
-		
+
+		// Start with empty snapshots and counters
+		for (uint8_t index = 0; index < 2; index++)
+		{
+			snapshots[index].encoder[0] = 0;
+			snapshots[index].encoder[1] = 0;
+			snapshots[index].velocity[0] = 0;
+			snapshots[index].velocity[1] = 0;
+			snapshots[index].time_us = 0;
+			snapshots[index].fresh = 0;
+		}
+		latest.encoder_1 = 0;
+		latest.encoder_2 = 0;
+		latest.time_us = 0;
+		latest.velocity_1 = 0;
+		latest.velocity_2 = 0;
+		front = 0;
+		sequence = 0;
+		busy = false;
+		crc_errors = 0;
+		retry_failures = 0;
+		timeouts = 0;
+		batches = 0;
+		p_the_master = this;
+
 		DDRA |= (1<<PIN7); 						// configure PORTA PIN7 as Slave Select line
 		PORTA |= (1<<PIN7);						//Drive SS high
 		DDRB |= (1<<DDB2)|(1<<DDB1)|(1<<DDB0);	// set MOSI and SCK as outputs
@@ -39,166 +139,258 @@
 		SPCR |= (1<<SPR1);						//SPR1, SPR0 set the frequency of SCK (prescale by 64)
 		SPCR &= ~(1<<SPR0);
 
-		//DDRA  |= (1<<PIN6)|(1<<PIN5);         // configure PORTA PIN5 and PIN6 as outputs for LED debugging
-		
-		// reset encoder ticks on 164
+		#ifdef TCCR2A
+			TCCR2A = (1 << WGM21);				// Timer 2 in clear on compare match mode
+		#endif
+		GAP_CLOCK_REG = GAP_CLOCK_OFF;			// but stopped until a gap is needed
+		GAP_OCR = GAP_TICKS - 1;
+
+		// reset encoder ticks on 164; this also turns on the SPI and Timer 2 interrupts
 		CLEAR (1);
 		CLEAR (2);
 	}
-	
-	/** Clear is a method to clear a pair of counters located on another chip. Associated values in this class are also cleared
-	*	@param motor_num pass in the value of which motor's encoder you would like to reset. motor_num=1 
+
+	/** Clear is a method to clear a pair of counters located on another chip. Associated values in this class are also cleared.
+	*	The exchange is done by polling, as it's only needed at startup and when homing. A batch transfer which is under
+	*	way is cancelled; a task waiting for it will time out and try again.
+	*	@param motor_num pass in the value of which motor's encoder you would like to reset. motor_num=1
 	*	corresponds to command 3 and motor_num=2  sends command 4.
+	*	@return True if the slave confirmed the reset, false if it didn't after all retries
 	*/
-	void Master::CLEAR (uint8_t motor_num)
+	bool Master::CLEAR (uint8_t motor_num)
 	{
+		if (motor_num != 1 && motor_num != 2)
+		{
+			return (false);
+		}
+		uint8_t command = (motor_num == 1) ? LINK_CMD_CLEAR_1 : LINK_CMD_CLEAR_2;
 		uint8_t confirm = 0;
-		PORTA &= ~(1<<PIN7);									// Activate SS
+
+		// Stop any batch and keep the interrupts from running while we poll
+		uint8_t temp_sreg = SREG;
+		cli ();
+		GAP_CLOCK_REG = GAP_CLOCK_OFF;
+		GAP_TIMSK &= ~(1 << GAP_IE);
+		SPCR &= ~(1 << SPIE);
+		bool was_busy = busy;
+		busy = false;
+		SREG = temp_sreg;
+
+		// A byte of the cancelled batch may still be shifting; let it finish, then
+		// read the status and data registers to clear its transfer complete flag
+		if (was_busy)
+		{
+			wait_gap ();
+			wait_gap ();
+			confirm = SPSR;
+			confirm = SPDR;
+			confirm = 0;
+		}
+
+		for (uint8_t tries = 0; tries <= MASTER_MAX_RETRIES && confirm != command; tries++)
+		{
+			PORTA &= ~(1<<PIN7);							// Activate SS
+			poll_byte (command);							// send reset command
+			confirm = poll_byte (0xFE);						// slave echoes the command
+			PORTA |= (1<<PIN7);								// Drive SS high
+		}
+
+		SPCR |= (1 << SPIE);
+		GAP_TIMSK |= (1 << GAP_IE);
+
+		if (confirm != command)
+		{
+			*ptr_to_serial << "can't reset channel " << motor_num << endl;
+			return (false);
+		}
 		if (motor_num == 1)
 		{
-			while (confirm != 0x03)
-			{
-				PORTA &= ~(1<<PIN7);							// Activate SS
-				SPDR = 0x03;									// send reset command
-				while(!(SPCR && (1<<SPIF)))						//wait for transfer
-				{
-				}
-				while (++dummy < WAIT)		{}	dummy=0;		// hold it up a sec
-				SPDR = 0xFE;
-				while(!(SPCR && (1<<SPIF)))						//wait for transfer
-				{
-				}
-				while (++dummy < WAIT)		{}	dummy=0;		// hold it up a sec
-				confirm = SPDR;
-				encoder = 0; 
-				Checksum_Error = 0;
-				*ptr_to_serial << "reset channel 1" << endl;
-			}
+			latest.encoder_1 = 0;
 		}
-		else if (motor_num == 2)
+		else
 		{
-			while (confirm != 0x04)
+			latest.encoder_2 = 0;
+		}
+		*ptr_to_serial << "reset channel " << motor_num << endl;
+		return (true);
+	}
+
+	/** start_batch begins a transfer which reads both encoder channels from the slave at once, and returns right away. The
+	*	transfer is carried on by the SPI and Timer 2 interrupts; when it's done, a new snapshot is published and the
+	*	sequence number changes.
+	*	@return True if a batch was started, false if one was already under way; either way, the sequence number will
+	*	change when the batch which is now running finishes
+	*/
+	bool Master::start_batch (void)
+	{
+		if (busy)
+		{
+			return (false);
+		}
+		retries = 0;
+		busy = true;
+		start_frame ();
+		return (true);
+	}
+
+	/** abort_batch gives up on a batch which has taken longer than MASTER_TIMEOUT_US, which should only happen if an
+	*	interrupt has been lost. The slave is deselected and the timeout is counted. No snapshot is published.
+	*/
+	void Master::abort_batch (void)
+	{
+		uint8_t temp_sreg = SREG;
+		cli ();
+		if (busy)
+		{
+			GAP_CLOCK_REG = GAP_CLOCK_OFF;
+			PORTA |= (1<<PIN7);							// Drive SS high
+			busy = false;
+			timeouts++;
+		}
+		SREG = temp_sreg;
+	}
+
+	/** get_snapshot copies the newest snapshot. If a batch finishes while the copy is being made, the copy is made
+	*	again, so the counts in it always come from the same batch.
+	*	@param copy A reference to a snapshot structure into which the counts are copied
+	*	@return The sequence number of the snapshot which was copied
+	*/
+	uint8_t Master::get_snapshot (encoder_snapshot& copy)
+	{
+		uint8_t seq;
+		do
+		{
+			seq = sequence;
+			copy = snapshots[front];
+		}
+		while (seq != sequence);
+
+		return (seq);
+	}
+
+	/** start_frame selects the slave and starts the gap after which the snapshot command is sent.
+	*/
+	void Master::start_frame (void)
+	{
+		byte_count = 0;
+		frame_crc = link_crc8_update (0, LINK_CMD_SNAPSHOT);
+		PORTA &= ~(1<<PIN7);							// Activate SS
+		start_gap ();
+	}
+
+	/** gap_interrupt is called by the Timer 2 interrupt when a gap between bytes is over. It stops the timer and sends
+	*	the next byte: the command if the frame is just starting, or a byte which clocks in the next reply.
+	*/
+	void Master::gap_interrupt (void)
+	{
+		GAP_CLOCK_REG = GAP_CLOCK_OFF;
+		if (busy)
+		{
+			SPDR = (byte_count == 0) ? LINK_CMD_SNAPSHOT : LINK_CMD_CONTINUE;
+		}
+	}
+
+	/** spi_interrupt is called by the SPI transfer complete interrupt. It saves the byte which came in and adds data
+	*	bytes to the CRC, spreading that work over the frame; then it starts the gap before the next byte or, if the
+	*	frame is complete, checks it.
+	*/
+	void Master::spi_interrupt (void)
+	{
+		uint8_t data = SPDR;
+
+		if (!busy)
+		{
+			return;
+		}
+		if (byte_count > 0)								// The byte received while the
+		{												// command went out is junk
+			frame.bytes[byte_count - 1] = data;
+			if (byte_count <= LINK_SNAPSHOT_BYTES)
 			{
-				PORTA &= ~(1<<PIN7);							// Activate SS
-				SPDR = 0x04;									// send reset command
-				while(!(SPCR && (1<<SPIF)))						//wait for transfer
-				{
-				}
-				while (++dummy < WAIT)		{}	dummy=0;		// hold it up a sec
-				SPDR = 0xFE;
-				while(!(SPCR && (1<<SPIF)))						//wait for transfer
-				{
-				}
-				while (++dummy < WAIT)		{}	dummy=0;		// hold it up a sec
-				confirm = SPDR;
-				encoder= 0; 
-				Checksum_Error = 0;
-				*ptr_to_serial << "reset channel 2" << endl;
+				frame_crc = link_crc8_update (frame_crc, data);
 			}
 		}
+		if (++byte_count < LINK_SNAPSHOT_FRAME)
+		{
+			start_gap ();
+		}
+		else
+		{
+			end_frame ();
+		}
 	}
-	
-	/** Initiate communicates with another SPI device. Each encoder value is 32 bits or 4 bytes. The data
-	*	transfer across the SPI bus happens one byte at a time. Each byte is stored in the union encoder_data.
-	*	After the complete encoder value has been recieved, one more data transfer occurs to get the checksum
-	*	from the slave device. The checksum for the received data is calculated and then compared to the checksum
-	*	sent by the slave. If the checksums don't match, there has been a transfer error and the pointer to the
-	*	encoder variable in PID_test is not updated. If the checksums match, then the pointer to the encoder
-	*	variable gets updated with the new encoder position.
-	*	@param encoder_select Initiate must be fed which channel (motor) you desire encoder ticks from
-	*/
-	void Master::Initiate (uint8_t encoder_select)
-	{	
-		while (++dummy < WAIT)		{}	dummy=0;		// hold it up a sec
-		encoder_num = encoder_select;
-		PORTA &= ~(1<<PIN7);							// Activate SS
-		if (encoder_num == 1)							// send 01 command if encoder_num = 1
-		{
-			Check_Sum_Master = 0x01;					// put command into check sum 1
-			SPDR = 0x01;								// send transfer request command 1
-			while(!(SPCR && (1<<SPIF)))	{}				// wait for transfer
-			while (++dummy < WAIT)		{}	dummy=0;	// hold it up a sec
-		}
-		else if (encoder_num == 2)						// send 02 command if encoder_num = 2
-		{
-			Check_Sum_Master = 0x02;					// put command into check sum 2
-			SPDR = 0x02;								// send transfer request command 2
-			while(!(SPCR && (1<<SPIF)))	{}				// wait for transfer
-			while (++dummy < WAIT)		{}	dummy=0;	// hold it up a sec
-		}
-		
-		while (++dummy < WAIT)		{}	dummy=0;		// hold it up a sec
-		SPDR = 0xFF;									// send junk, get first byte
-		while(!(SPCR && (1<<SPIF)))	{}					// wait for transfer
-		while (++dummy < WAIT)		{}	dummy=0;		// hold it up a sec
-		encoder_data.parts[0] = SPDR;
-		Check_Sum_Master += encoder_data.parts[0];
-		
-		while (++dummy < WAIT)		{}	dummy=0;		// hold it up a sec
-		SPDR = 0xFF;									// send junk, get second byte
-		while(!(SPCR && (1<<SPIF)))	{}					// wait for transfer
-		while (++dummy < WAIT)		{}	dummy=0;		// hold it up a sec
-		encoder_data.parts[1] = SPDR;
-		Check_Sum_Master += encoder_data.parts[1];
-		
-		while (++dummy < WAIT)		{}	dummy=0;		// hold it up a sec
-		SPDR = 0xFF;									// send junk, get third byte
-		while(!(SPCR && (1<<SPIF)))	{}					// wait for transfer
-		while (++dummy < WAIT)		{}	dummy=0;		// hold it up a sec
-		encoder_data.parts[2] = SPDR;
-		Check_Sum_Master += encoder_data.parts[2];
-		
-		while (++dummy < WAIT)		{}	dummy=0;		// hold it up a sec
-		SPDR = 0xFF;									// send junk, get fourth byte
-		while(!(SPCR && (1<<SPIF)))	{}					// wait for transfer
-		while (++dummy < WAIT)		{}	dummy=0;		// hold it up a sec
-		encoder_data.parts[3] = SPDR;
-		Check_Sum_Master += encoder_data.parts[3];
-		
-		while (++dummy < WAIT)		{}	dummy=0;		// hold it up a sec
-		SPDR = 0xFF;									// send junk, get check sum
-		while(!(SPCR && (1<<SPIF)))	{}					// wait for transfer
-		while (++dummy < WAIT)		{}	dummy=0;		// hold it up a sec
-		Slave_Sum = SPDR;									
-		if (Check_Sum_Master == Slave_Sum)
-		{
-			error_flag = false;							// no error occurred
-			encoder = encoder_data.whole;
+
+	/** end_frame deselects the slave and checks the frame's CRC. A good frame becomes the latest snapshot; a bad frame
+	*	is asked for again until the retries run out, and then the previous counts are published again, marked stale.
+	*	The snapshot buffer which isn't being read is filled in and made the newest.
+	*/
+	void Master::end_frame (void)
+	{
+		PORTA |= (1<<PIN7);								// Drive SS high
+
+		uint8_t fresh_bits = 0;
+		if (frame_crc == frame.bytes[LINK_SNAPSHOT_BYTES])
+		{
+			latest = frame.data;
+			fresh_bits = (1 << MASTER_CHANNELS) - 1;
 		}
 		else
 		{
-			error_flag = true; 							// transmission error occurred!
-			Checksum_Error++;
+			crc_errors++;
+			if (retries < MASTER_MAX_RETRIES)
+			{
+				retries++;
+				start_frame ();
+				return;
+			}
+			retry_failures++;
 		}
-		PORTA |= (1<<PIN7);								// Drive SS high, disableing 
-		Check_Sum_Master = 0;							// Reset Check_Sum_Master before exiting
-		Slave_Sum = 0;									// Reset Slave_Sum before exiting
-		encoder_data.whole = 0;							// Reset the union before exiting
-	}	
-	
-	/** Get_Encoder gets an encoder reading
+
+		uint8_t back = front ^ 1;
+		snapshots[back].encoder[0] = latest.encoder_1;
+		snapshots[back].encoder[1] = latest.encoder_2;
+		snapshots[back].velocity[0] = latest.velocity_1;
+		snapshots[back].velocity[1] = latest.velocity_2;
+		snapshots[back].time_us = latest.time_us;
+		snapshots[back].fresh = fresh_bits;
+		front = back;
+		sequence++;
+		batches++;
+		busy = false;
+	}
+
+	//-------------------------------------------------------------------------------------
+	/** This overloaded shift operator prints the SPI transfer counters: batches finished,
+	*	frames with bad CRC's, batches which used up their retries, and batches which
+	*	timed out.
+	*	@param serial A reference to the serial-type object to which to print
+	*	@param master A reference to the Master whose counters are to be displayed
 	*/
-	int32_t Master::Get_Encoder(void)
+	base_text_serial& operator<< (base_text_serial& serial, Master& master)
 	{
-			return(encoder);
+		serial << "SPI batches: " << master.get_batches ()
+			   << "  bad CRC: " << master.get_crc_errors ()
+			   << "  gave up: " << master.get_retry_failures ()
+			   << "  timeouts: " << master.get_timeouts () << endl;
+		return (serial);
 	}
-	
-	/** Get_Checksum_Error gets the number of encoder transfer errors experienced
+
+	//-------------------------------------------------------------------------------------
+	/** \cond NOT_ENABLED  (These ISRs are not to be documented by Doxygen)
+	*	This interrupt service routine runs when a byte has finished shifting over the SPI
+	*	bus. It hands the byte which came in to the Master object.
 	*/
-	uint8_t Master::Get_Checksum_Error(void)
+	ISR (SPI_STC_vect)
 	{
-			return(Checksum_Error);
+		p_the_master->spi_interrupt ();
 	}
-	
-	/**	Get_Checksum_flag is a method which returns true if the specified channel has experienced SPI transfer error
-	*	and false if the channel's transfer went well.
+
+	/** This interrupt service routine runs when Timer 2 has counted out a gap between
+	*	bytes, and has the Master object send the next byte.
 	*/
-	bool Master::Get_Checksum_flag(void)
+	ISR (GAP_vect)
 	{
-		if (error_flag)
-			return(true);
-		else
-			return(false);
+		p_the_master->gap_interrupt ();
 	}
+	/** \endcond  (End of section which is not to be documented by Doxygen) */
 	//-------------------------------------------------------------------------------------
-
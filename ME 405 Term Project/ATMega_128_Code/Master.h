@@ -1,15 +1,19 @@
 //======================================================================================
 /** \file  Master.h
- *   Master.h contains specifications necessary for the methods herein to be 
+ *   Master.h contains specifications necessary for the methods herein to be
  *   called from within any main program as long as this header file is included.
  *
  *  Revisions:
  *    \li  04-26-11  Began tearing and hacking at our lab_4 code.
  *	  \li  05-05-11  Finalized for lab5
+ *    \li  06-12-11  Replaced the blocking Initiate() with an interrupt driven batch
+ *                   transfer which reads both encoders and publishes a snapshot
+ *    \li  06-13-11  Reads both encoders with the slave's snapshot command
+ *    \li  06-15-11  Snapshots include the encoder speeds measured by the slave
  *
  *  License:
  *    This file released under the Lesser GNU Public License. The program is intended
- *    for educational use only, but its use is not restricted thereto. 
+ *    for educational use only, but its use is not restricted thereto.
  */
 //======================================================================================
 
@@ -17,61 +21,149 @@
 #ifndef _Master_H_
 #define _Master_H_
 
+#include "encoder_link.h"					// Commands and frame shared with the slave
+
+/// Number of encoder channels read by each batch
+#define MASTER_CHANNELS			2
+
+/** Time in microseconds between the end of one byte and the start of the next, which
+ *  gives the slave's SPI interrupt time to load its reply. It must be under 128 us.
+ */
+#ifndef MASTER_BYTE_GAP_US
+	#define MASTER_BYTE_GAP_US	20
+#endif
+
+/// Number of times a frame with a bad CRC is asked for again before giving up
+#ifndef MASTER_MAX_RETRIES
+	#define MASTER_MAX_RETRIES	2
+#endif
+
+/// Time in microseconds taken to shift one byte with SCK at the CPU clock over 64
+#define MASTER_BYTE_US			(8UL * 64UL * 1000000UL / F_CPU)
+
+/// Longest time in microseconds a batch can take if every allowed retry is used
+#define MASTER_BATCH_US			((MASTER_MAX_RETRIES + 1) * LINK_SNAPSHOT_FRAME \
+								* (MASTER_BYTE_US + MASTER_BYTE_GAP_US))
+
+/// Time in microseconds after which a batch which hasn't finished is given up on
+#define MASTER_TIMEOUT_US		(MASTER_BATCH_US + 1000UL)
+
+
+//-------------------------------------------------------------------------------------
+/** This structure holds both encoder counts and speeds as of the end of one batch
+ *  transfer, with the time on the slave's clock at which they were latched. Both counts come from
+ *  the same instant. If every try at the batch failed its CRC, the counts and time
+ *  from the previous batch are kept and the bits in \c fresh are clear.
+ */
+
+typedef struct
+{
+	int32_t encoder[MASTER_CHANNELS];	///< Counts for channels 1 and 2, in that order
+	int32_t velocity[MASTER_CHANNELS];	///< Speeds in counts per second, in that order
+	uint32_t time_us;					///< Slave clock in microseconds at the latch
+	uint8_t fresh;						///< Bit n-1 is set if channel n was read this batch
+} encoder_snapshot;
+
 
 //-------------------------------------------------------------------------------------
 /**  Master.cpp is a class with methods for orchestrating and controlling the flow of
 *	 data transfers on the SPI bus between a master device and a slave device. The data
 *	 being transfered are new encoder positions from the two motors so that the task_PID
-*	 class can keep track of where the motors are. The encoder values used in the PID
-*	 calculations are stored in the main program and are updated in Master via pointers
-*	 so that other objects can use them as well.
+*	 class can keep track of where the motors are.
+*
+*	 A call to start_batch() begins a transfer which reads both encoders with the slave's
+*	 snapshot command (see encoder_link.h), and returns at once. The rest of the transfer
+*	 is run by the SPI transfer complete interrupt, with Timer 2 timing the gaps between
+*	 bytes. A frame whose CRC doesn't match is asked for again up to MASTER_MAX_RETRIES
+*	 times. When the batch is done, the counts are written into whichever of two snapshot
+*	 buffers isn't being read, the buffers are swapped, and a sequence number is bumped. A task
+*	 which wants fresh counts starts a batch, notes the sequence number, and calls
+*	 run_again_ASAP() until the number changes; get_snapshot() then copies the counts.
 */
- 
+
 
 class Master
 {
 	protected:
-		/// The encoder driver class needs a pointer to the serial port used to output to the terminal.  
+		/// The encoder driver class needs a pointer to the serial port used to output to the terminal.
 		base_text_serial* ptr_to_serial;
-		/// flag indicating transfer error on encoder 1
-		bool error_flag;
-		/// encoder value received from Slave_Driver				
-		int32_t encoder;	
-		/// encoder transfer error 1					
-		uint8_t Checksum_Error;	
-		/// check sum computed here in master for encoder 1		
-		uint8_t Check_Sum_Master;
-		/// check sum computed in slave for encoder 1		
-		uint8_t Slave_Sum;	
-		/// counter used to delay  so SPI works			
-		uint8_t dummy;		
-		/// integer to tell Master which encoder reading to get from Slave_Driver			
-		uint8_t encoder_num;			
-		/// encoder_data allows easy partitioning of encoder data
-		union packet1					
+		/// Two snapshot buffers; the interrupt fills one while tasks read the other
+		encoder_snapshot snapshots[2];
+		/// Index of the snapshot buffer which holds the newest complete counts
+		volatile uint8_t front;
+		/// Bumped each time a batch finishes and a new snapshot is published
+		volatile uint8_t sequence;
+		/// True while a batch transfer is under way
+		volatile bool busy;
+		/// Number of bytes of the current frame which have been sent
+		uint8_t byte_count;
+		/// Number of retries used so far on the current frame
+		uint8_t retries;
+		/// CRC-8 of the command and the bytes of the current frame received so far
+		uint8_t frame_crc;
+		/// Bytes of the current frame received from Slave_Driver after the command
+		union
 		{
-			/// whole is a 32 bit encoder count
-			int32_t whole;	
-			/// parts is an array unioned with whole			
-			int8_t parts[4];			
-		} encoder_data;
-		
+			link_snapshot data;						///< The counts and time as numbers
+			uint8_t bytes[LINK_SNAPSHOT_FRAME - 1];	///< The data bytes, then the CRC
+		} frame;
+		/// Most recent good snapshot received from the slave
+		link_snapshot latest;
+		/// Number of frames which failed their CRC checks
+		uint16_t crc_errors;
+		/// Number of batches in which every retry failed
+		uint16_t retry_failures;
+		/// Number of batches which didn't finish in time and were aborted
+		uint16_t timeouts;
+		/// Number of batches which have finished
+		uint32_t batches;
+
+		void start_frame (void);			// Selects the slave and sends a command
+		void end_frame (void);				// Checks a frame and publishes it
 
 	public:
 
 		Master(base_text_serial*);
-			   
-		void CLEAR (uint8_t);
 
-		void Initiate (uint8_t);
-		
-		bool Get_Checksum_flag(void);
+		bool CLEAR (uint8_t);
+
+		bool start_batch (void);
+
+		void abort_batch (void);
+
+		uint8_t get_snapshot (encoder_snapshot&);
+
+		void spi_interrupt (void);
+
+		void gap_interrupt (void);
+
+		/** get_sequence returns the number of the newest snapshot. It changes each time
+		*	a batch finishes, so a task can wait for the batch it started.
+		*/
+		uint8_t get_sequence (void) { return (sequence); }
+
+		/** is_busy tells whether a batch transfer is under way
+		*/
+		bool is_busy (void) { return (busy); }
+
+		/** get_crc_errors returns the number of frames which failed their CRC checks
+		*/
+		uint16_t get_crc_errors (void) { return (crc_errors); }
+
+		/** get_retry_failures returns the number of batches which used up all retries
+		*/
+		uint16_t get_retry_failures (void) { return (retry_failures); }
 
-		uint8_t Get_Checksum_Error(void);
+		/** get_timeouts returns the number of batches aborted for taking too long
+		*/
+		uint16_t get_timeouts (void) { return (timeouts); }
 
-		int32_t Get_Encoder(void); 
-		
+		/** get_batches returns the number of batches which have finished
+		*/
+		uint32_t get_batches (void) { return (batches); }
 };
 
+// This operator prints the SPI transfer counters to a serial device
+base_text_serial& operator<< (base_text_serial&, Master&);
 
-#endif // _Master_H_
\ No newline at end of file
+#endif // _Master_H_
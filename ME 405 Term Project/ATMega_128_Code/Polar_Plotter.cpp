@@ -4,6 +4,14 @@
 	*  Revisions:
 	*    \li  05-10-11  Began tearing and hacking at our lab_4 code.				
 	*	 \li  05-22-11  That was really an ordeal. PID finally working.
+	*    \li  06-18-11  Cascaded position and velocity loops
+	*    \li  06-19-11  Lines follow a trajectory, updated as often as the position loops run
+	*    \li  06-20-11  Look-ahead path planner lets the pen go through corners without stopping
+	*    \li  06-22-11  G-code interpreter, so drawings can be streamed from a PC
+	*    \li  06-23-11  Messages are printed from a catalogue in program memory
+	*    \li  06-24-11  The memory pool's use is shown with the status
+	*    \li  06-25-11  F sends the task profile when compiled with STL_PROFILE
+	*    \li  06-26-11  E sends the state transition trace when compiled with STL_TRACE
 	*  License:
 	*    This file released under the Lesser GNU Public License. The program is intended
 	*    for educational use only, but its use is not restricted thereto. 
@@ -15,22 +23,30 @@
 	#include <avr/io.h>							// Input-output ports, special registers
 	#include <avr/interrupt.h>					// Interrupt handling functions
 	#include "rs232int.h"						// Include header for serial port class
+	#include "mem_pool.h"						// Fixed size blocks for new and delete
 	#include "stl_timer.h"						// Microsecond-resolution timer
 	#include "stl_task.h"						// Base class for all task classes
+	#include "stl_scheduler.h"					// Runs tasks in order of urgency
 
 	// User written headers included with " "
 	#include "Master.h"							// allows SPI communications to operate
 	#include "da_motor.h"						// allows motor control to occur
 	#include "task_PID.h"						// allow PID control
+	#include "task_velocity.h"					// inner, velocity loops of the PID's
 	#include "servo.h"
 	#include "point.h"
 	
-	#include "task_lines.h"						// breaks up a line into small segments
+	#include "path_planner.h"					// look-ahead planning of corner speeds
+	#include "trajectory.h"						// smooth motion along a line
+	#include "task_lines.h"						// draws lines along a trajectory
 	
 	#include "Go_Home.h"
+	#include "gcode.h"							// draws G-code streamed from a PC
 	
-	#include "task_read.h"						// allow user input
+	#include "telemetry.h"						// binary telemetry channel
+	#include "task_telemetry.h"					// sends PID state as telemetry
 	#include "task_print.h"						// allow messages and errors to print to screen
+	#include "task_read.h"						// allow user input
 	
 
 	//--------------------------------------------------------------------------------------
@@ -41,13 +57,17 @@
 
 	int main ()
 	{
-		volatile uint32_t dummy = 0;			// counter to control rate of SPI communication
 		uint8_t print_mode = 0;					// controls what is printed to the terminal window
 		
 		
 		// Create a serial port object.
 		rs232 the_serial_port (9600, 1);
 
+		// If the tasks are traced, a task which stops with an error sends the trace here
+		#ifdef STL_TRACE
+			stl_trace_set_port (&the_serial_port);
+		#endif
+
 		// Create a MASTER object, "request". This object must be given a
 		// pointer to the serial port object so that it can print debugging information.
 		// Pointers to encoder variables and transfer error variables are also given so
@@ -59,58 +79,112 @@
 		// it can print debugging and motor operation information.
 		da_motor my_motor (&the_serial_port);
 				
-		// Create a time stamp which determines the interval at which the motor task runs.
+		// Create a time stamp which determines the interval at which the homing task runs.
 		// The time stamp is initialized with a number of seconds, then microseconds.
-		time_stamp interval_time_1 (0, 25000);		// set PIDS to run at 20 ms intervals
+		time_stamp interval_time_1 (0, 25000);		// Find_Home runs every 25 ms
 		
 		// Create a microsecond-resolution timer.
 		task_timer the_timer;
 		
+		// The motors are run by cascaded loops: a velocity loop every 2 ms for each motor,
+		// and a position loop every 10 ms which tells it how fast to go.
+		time_stamp interval_time_vel (0, 2000);
+		time_stamp interval_time_pos (0, 10000);
+		
+		// Create the velocity loops for motors 1 and 2.
+		task_velocity speed_1 (&the_serial_port, the_timer, interval_time_vel, &request, &my_motor, 1);
+		task_velocity speed_2 (&the_serial_port, the_timer, interval_time_vel, &request, &my_motor, 2);
+		
 		// Create a PID object for motor 1.
-		task_PID motor_1 (&the_serial_port, the_timer, interval_time_1, &request, &my_motor, 1);
+		task_PID motor_1 (&the_serial_port, the_timer, interval_time_pos, &request, &my_motor, 1, &speed_1);
 		
 		// Create a PID object for motor 2.
-		task_PID motor_2 (&the_serial_port, the_timer, interval_time_1, &request, &my_motor, 2); 
+		task_PID motor_2 (&the_serial_port, the_timer, interval_time_pos, &request, &my_motor, 2, &speed_2); 
 		
-		// Create a servo object to control pen height.
+		// Create a servo object to control pen height. Its pulses are timed by Timer 3, so
+		// it must be made after the_timer.
 		servo Pen_and_Teller(&the_serial_port);
 	
 		// Create a point object.
 		point The_Dot_Maker(&the_serial_port, &motor_1, &motor_2, &Pen_and_Teller);
 		
-		// Create an object for breaking up line segments.
-		task_lines The_Line_Maker(&the_serial_port, the_timer, interval_time_1, &motor_1, &motor_2, &The_Dot_Maker, &Pen_and_Teller);
+		// Create a planner which holds the lines waiting to be drawn and works out how fast the
+		// pen can take each corner, keeping each motor within a speed (counts/s), acceleration
+		// (counts/s^2), jerk (counts/s^3) and sudden change of speed at a corner (counts/s).
+		path_planner The_Planner;
+		The_Planner.set_limits(0, 25000, 150000, 1500000, 10000);	// cart (radius)
+		The_Planner.set_limits(1, 25000, 100000, 1000000, 10000);	// arm (angle)
+		
+		// Create a trajectory which times the pen's motion along the planned lines.
+		trajectory The_Path(&The_Planner);
+		
+		// Create an object for drawing lines. It moves the setpoints along the trajectory each
+		// time the position loops run.
+		task_lines The_Line_Maker(&the_serial_port, the_timer, interval_time_pos, &motor_1, &motor_2, &The_Dot_Maker, 
+								  &Pen_and_Teller, &The_Planner, &The_Path);
 		
 		// Create a homing object which can be used to send the plotter back to the home position and reset the encoders.
 		Go_Home Find_Home(&the_serial_port, the_timer, interval_time_1, &my_motor, &request, &motor_1, &motor_2, &The_Line_Maker); 
 		
-		// Create a user interface object which takes in input.
-		task_read keyboard(&the_serial_port, &motor_1, &motor_2, &print_mode, &request, &The_Line_Maker,
-						   &Pen_and_Teller, &Find_Home, &The_Dot_Maker); 
-										
+		// Create a binary telemetry channel which shares the serial port, and a task which
+		// sends the PID states through it every 100 ms once the user turns it on.
+		telemetry the_telemetry (&the_serial_port);
+		time_stamp interval_time_tlm (0, 100000);
+		task_telemetry telemetry_sender(&the_telemetry, the_timer, interval_time_tlm, &motor_1, &motor_2);
+		
+		// Create a G-code interpreter which draws programs sent through the serial port. The
+		// keyboard hands it the port when a % is typed, until the program ends.
+		gcode The_Interpreter(&the_serial_port, &The_Line_Maker, &The_Planner, &The_Dot_Maker, &Find_Home,
+							  &motor_1, &motor_2, &Pen_and_Teller);
+		
 		// Create a user interface object which prints to screen.
 		task_print screen_print(&the_serial_port, &print_mode);
 		
+		// Create a user interface object which takes in input.
+		task_read keyboard(&the_serial_port, &motor_1, &motor_2, &print_mode, &request, &The_Line_Maker,
+						   &Pen_and_Teller, &Find_Home, &The_Dot_Maker, &the_telemetry, &The_Interpreter,
+						   &screen_print); 
+		
+		// Create a scheduler which runs the tasks in order of urgency. The velocity loops get
+		// the highest priority, then the position loops; each must finish within one interval
+		// of being released.
+		task_scheduler scheduler (the_timer, SCHED_EDF);
+		scheduler.add_task (&speed_1, 4, interval_time_vel);
+		scheduler.add_task (&speed_2, 4, interval_time_vel);
+		scheduler.add_task (&motor_1, 3, interval_time_pos);
+		scheduler.add_task (&motor_2, 3, interval_time_pos);
+		scheduler.add_task (&The_Line_Maker, 2, interval_time_pos);
+		scheduler.add_task (&Find_Home, 1, interval_time_1);
+		scheduler.add_task (&telemetry_sender, 0, interval_time_tlm);
+		scheduler.set_tickless (true);			// sleep between task runs when idle
+		
 		// Enable interrupts.
 		sei();
 		// Gains set up to run motors at 12 V.
-		// Set initial gain values (can be changed in program too).
+		// Set initial gain values (the position gains can be changed in program too).
+		// Single loop gains were Kp 950, Ki 450, Kd 0 for the cart and 3750, 3700, 1 for the arm.
 		// Cart:
-		motor_1.set_kp(950); //1000
-		motor_1.set_ki(450); //500
-		motor_1.set_kd(0); //0
+		speed_1.set_kp(2100);
+		speed_1.set_ki(8500);
+		speed_1.set_kd(0);
+		motor_1.set_kp(1500);
+		motor_1.set_ki(0);
+		motor_1.set_kd(0);
 		
 		// Arm:
-		motor_2.set_kp(3750); //4000
-		motor_2.set_ki(3700); //4000
-		motor_2.set_kd(1); //1
+		speed_2.set_kp(3200);
+		speed_2.set_ki(6400);
+		speed_2.set_kd(0);
+		motor_2.set_kp(1500);
+		motor_2.set_ki(0);
+		motor_2.set_kd(0);
 		
 		// Enter infinite main loop.
 		while (true)
 		{
 			
 			keyboard.run();						// Get user input if there is any
-			if (print_mode == 0xFF)				// If the user entered a q, or Q print this stuff uncooperatively
+			if (print_mode == PRINT_STATUS)		// If the user entered a q, or Q print this stuff uncooperatively
 			{	
 				int32_t cart = motor_1.GET_setpoint();
 				int32_t arm = motor_2.GET_setpoint();
@@ -119,16 +193,37 @@
 				the_serial_port << "2)p: "<< motor_2.GET_Kp() <<"  i: "<< motor_2.GET_Ki() <<"   d: "<< motor_2.GET_Kd() <<endl;
 				the_serial_port << "SETPOINTS:  cart="<< cart<<"   theta="<< arm<<endl;			
 				the_serial_port << "enc1="<< motor_1.Get_Encoder()<<"  enc2="<< motor_2.Get_Encoder()<<endl;
-				print_mode = 0;					// reset print_mode
+				the_serial_port << scheduler;	// task runs and deadline misses
+				the_serial_port << request;		// SPI transfers, CRC errors and timeouts
+				mem_pool_report (the_serial_port);	// blocks in use and most ever used
+				print_mode = PRINT_NOTHING;		// reset print_mode
 			}
-			motor_1.schedule ();				// run PID #1 as scheduled
-			motor_2.schedule ();				// run PID #2 as scheduled
+			if (print_mode == PRINT_PROFILE)	// If the user entered an f or F, send the task
+			{									// profiles as a binary block for profile_report
+				#ifdef STL_PROFILE
+					scheduler.write_profile (the_serial_port);
+				#endif
+				print_mode = PRINT_NOTHING;
+			}
+			if (print_mode == PRINT_TRACE)		// If the user entered an e or E, send the
+			{									// recent state transitions for trace_decode
+				#ifdef STL_TRACE
+					stl_trace_dump (the_serial_port);
+				#endif
+				print_mode = PRINT_NOTHING;
+			}
+			bool busy = scheduler.dispatch ();	// run the most urgent ready task
 			screen_print.run();					// print any errors/propmpts/menus necessary
-			The_Line_Maker.schedule();					// break up some lines
-			motor_1.schedule ();				// run PID #1 as scheduled
-			motor_2.schedule ();				// run PID #2 as scheduled
-			Find_Home.schedule();				// home if requested
+			busy |= scheduler.dispatch ();		// PID's, lines and homing as they come due
 			The_Dot_Maker.run();
+			busy |= scheduler.dispatch ();
+			
+			// If no task ran and nothing is being printed or dotted, sleep until the next
+			// task is due or a keypress or other interrupt wakes us up
+			if (!busy && print_mode == PRINT_NOTHING && !The_Dot_Maker.Making_Dot())
+			{
+				scheduler.idle ();
+			}
 			
 		}
 		return (0);
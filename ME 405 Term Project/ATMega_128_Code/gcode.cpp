@@ -0,0 +1,486 @@
+//======================================================================================
+/** \file gcode.cpp is an interpreter which draws a stream of G-code sent through the
+*	serial port.
+*
+*  Revisions:
+*    \li  06-22-11  Original file
+*
+*  License:
+*    This file released under the Lesser GNU Public License. The program is intended
+*    for educational use only, but its use is not restricted thereto.
+*/
+//======================================================================================
+
+	// System headers included with < >
+	#include <stdlib.h>							// Standard C library
+	#include <avr/io.h>							// Input-output ports, special registers
+
+	// User written headers included with " "
+	#include "rs232int.h"						// Include header for serial port class
+	#include "stl_timer.h"						// task_lines and Go_Home are scheduled tasks
+	#include "stl_task.h"						// task_lines and Go_Home are scheduled tasks
+	#include "Master.h"							// so da_motor doesn't get mad
+	#include "da_motor.h"						// so PID objects don't get mad
+	#include "task_PID.h"						// PID's are told when homing takes over
+	#include "servo.h"							// allows pen actuation
+	#include "point.h"							// point moves the pen with the pen up
+	#include "path_planner.h"					// lines waiting to be drawn
+	#include "task_lines.h"						// draws the lines
+	#include "Go_Home.h"						// finds the home position
+	#include "gcode.h"							// include own header file
+
+	// The most digits taken before the decimal point, so a number can't overflow
+	#define MAX_WHOLE_DIGITS 5
+
+//-----------------------------------------------------------------------------------------
+/** The constructor saves object pointers locally and sets up the modes a program starts in.
+*	@param p_serial_port Serial object from which G-code is read and to which answers go
+*	@param a_lines Line drawing task through which lines are queued
+*	@param a_planner Planner in which the lines wait to be drawn
+*	@param a_mover Point object which moves the pen with the pen up
+*	@param a_home Homing task
+*	@param motor_1 PID object for motor 1
+*	@param motor_2 PID object for motor 2
+*	@param a_pen Servo object which raises the pen
+*/
+gcode::gcode(base_text_serial* p_serial_port, task_lines* a_lines, path_planner* a_planner,
+			 point* a_mover, Go_Home* a_home, task_PID* motor_1, task_PID* motor_2,
+			 servo* a_pen)
+{
+	// save object pointers locally
+	ptr_2_serial = p_serial_port;
+	LINES = a_lines;
+	planner = a_planner;
+	Mover = a_mover;
+	Home = a_home;
+	PID_1 = motor_1;
+	PID_2 = motor_2;
+	Pen = a_pen;
+
+	// initialize variables
+	after_return = false;
+	end_line();
+	x_now = 0;
+	y_now = 0;
+	motion = 0;
+	metric = false;
+	relative = false;
+	pen_down = false;
+	drawing = false;
+	commands = 0;
+	errors = 0;
+	underruns = 0;
+}
+
+/** run reads G-code and acts on it, a line at a time. It is called over and over while a
+*	program is being sent, and never waits: if a line can't be acted on yet, because the
+*	planner is full or the lines ahead must be drawn first, it is tried again next time.
+*	@return True while the program goes on, false once it has ended
+*/
+bool gcode::run(void)
+{
+	// read the next line and work out what it asks for
+	if (!line_ready)
+	{
+		if (!read_line())
+		{
+			return (true);
+		}
+		line_ready = true;
+
+		const char* p_error = too_long ? "line too long" : parse_line();
+		if (p_error != NULL)
+		{
+			errors++;
+			*ptr_2_serial << "error: " << p_error << endl;
+			end_line();
+			return (true);
+		}
+	}
+
+	// do it, once the plotter is ready
+	if (!act())
+	{
+		return (true);
+	}
+	if (action == GCODE_END)
+	{
+		*ptr_2_serial << "commands: " << commands << "  errors: " << errors
+					  << "  underruns: " << underruns << endl;
+		*ptr_2_serial << "ok" << endl;
+		end_line();
+		motion = 0;
+		metric = false;
+		relative = false;
+		pen_down = false;
+		drawing = false;
+		commands = 0;
+		errors = 0;
+		underruns = 0;
+		return (false);
+	}
+	*ptr_2_serial << "ok" << endl;
+	end_line();
+	return (true);
+}
+
+/** read_line takes the characters waiting in the serial port into the line buffer, up to
+*	the end of a line. Spaces, comments in parentheses and everything after a semicolon are
+*	left out, and letters are made upper case. A line may end with a carriage return, a
+*	line feed or both.
+*	@return True once a whole line has been read
+*/
+bool gcode::read_line(void)
+{
+	while (ptr_2_serial->check_for_char())
+	{
+		char input_char = ptr_2_serial->getchar();
+
+		if (input_char == '\r' || input_char == '\n')
+		{
+			// a line feed right after a carriage return ends the same line
+			bool same_line = (input_char == '\n' && after_return);
+			after_return = (input_char == '\r');
+			if (!same_line)
+			{
+				line[length] = '\0';
+				return (true);
+			}
+			continue;
+		}
+		after_return = false;
+
+		if (skip_rest)
+		{
+			continue;
+		}
+		if (in_comment)
+		{
+			in_comment = (input_char != ')');
+		}
+		else if (input_char == '(')
+		{
+			in_comment = true;
+		}
+		else if (input_char == ';')
+		{
+			skip_rest = true;
+		}
+		// spaces, tabs and other control characters
+		else if (input_char > ' ')
+		{
+			if (length >= GCODE_LINE_SIZE)
+			{
+				too_long = true;
+				skip_rest = true;
+			}
+			else
+			{
+				if (input_char >= 'a' && input_char <= 'z')
+				{
+					input_char -= 'a' - 'A';
+				}
+				line[length++] = input_char;
+			}
+		}
+	}
+	return (false);
+}
+
+/** parse_line works out what the line in the buffer asks for, and where the pen is to go.
+*	Modes set by the line take effect only if the whole line is good.
+*	@return NULL if the line is good, or else the reason it isn't
+*/
+const char* gcode::parse_line(void)
+{
+	action = GCODE_NOTHING;
+	target_x = x_now;
+	target_y = y_now;
+	if (length == 0)
+	{
+		return (NULL);
+	}
+	commands++;
+	if (line[0] == '%' && length == 1)
+	{
+		action = GCODE_END;
+		return (NULL);
+	}
+
+	uint8_t new_motion = motion;
+	bool new_metric = metric;
+	bool new_relative = relative;
+	bool new_pen_down = pen_down;
+	bool home = false;
+	bool have_x = false;
+	bool have_y = false;
+	int32_t x_value = 0;
+	int32_t y_value = 0;
+
+	const char* p_char = line;
+	while (*p_char)
+	{
+		char letter = *p_char++;
+		int32_t value;
+		const char* p_error = parse_number(p_char, value);
+		if (p_error != NULL)
+		{
+			return (p_error);
+		}
+
+		switch (letter)
+		{
+			case 'G':
+				if (value % GCODE_ONE != 0)
+				{
+					return ("unsupported G code");
+				}
+				switch (value / GCODE_ONE)
+				{
+					case 0:		new_motion = 0;				break;
+					case 1:		new_motion = 1;				break;
+					case 20:	new_metric = false;			break;
+					case 21:	new_metric = true;			break;
+					case 28:	home = true;				break;
+					case 90:	new_relative = false;		break;
+					case 91:	new_relative = true;		break;
+					default:	return ("unsupported G code");
+				}
+			break;
+
+			case 'M':
+				if (value % GCODE_ONE != 0)
+				{
+					return ("unsupported M code");
+				}
+				switch (value / GCODE_ONE)
+				{
+					case 3:		new_pen_down = true;		break;
+					case 2:
+					case 5:
+					case 30:	new_pen_down = false;		break;
+					default:	return ("unsupported M code");
+				}
+			break;
+
+			case 'X':
+				have_x = true;
+				x_value = value;
+			break;
+
+			case 'Y':
+				have_y = true;
+				y_value = value;
+			break;
+
+			case 'Z':
+				new_pen_down = (value <= 0);
+			break;
+
+			// feed rates and line numbers aren't used
+			case 'F':
+			case 'N':
+			break;
+
+			default:
+				return ("unsupported word");
+		}
+	}
+
+	// work out where the pen goes, in the modes this line sets
+	int32_t x = x_now;
+	int32_t y = y_now;
+	if (home)
+	{
+		x = 0;
+		y = 0;
+	}
+	else
+	{
+		if (have_x)
+		{
+			x = to_tenths(x_value, new_metric) + (new_relative ? x_now : 0);
+		}
+		if (have_y)
+		{
+			y = to_tenths(y_value, new_metric) + (new_relative ? y_now : 0);
+		}
+		if (x < 0 || x > GCODE_X_MAX || y < 0 || y > GCODE_Y_MAX)
+		{
+			return ("out of range");
+		}
+	}
+
+	motion = new_motion;
+	metric = new_metric;
+	relative = new_relative;
+	pen_down = new_pen_down;
+	target_x = x;
+	target_y = y;
+	if (home)
+	{
+		action = GCODE_HOME;
+	}
+	else if (x != x_now || y != y_now)
+	{
+		action = (motion == 1 && pen_down) ? GCODE_DRAW : GCODE_MOVE;
+	}
+	return (NULL);
+}
+
+/** act does what the line asks for, if the plotter is ready. Lines to be drawn are queued
+*	as soon as the planner has room, once any move with the pen up or homing is over;
+*	moves with the pen up, homing and the end of the program wait for the lines ahead.
+*	@return True if it has been done, false if it must be tried again later
+*/
+bool gcode::act(void)
+{
+	switch (action)
+	{
+		case GCODE_NOTHING:
+		break;
+
+		case GCODE_DRAW:
+		{
+			if (!Mover->Are_We_There() || !Home->Is_Home())
+			{
+				return (false);
+			}
+			// if all that's left is the line being drawn, the pen is already slowing to a stop
+			bool starved = drawing && (planner->Is_Empty()
+									   || (planner->Get_Count() == 1 && planner->current()->busy));
+			LINES->set_coords(x_now, y_now, target_x, target_y);
+			if (!LINES->go())
+			{
+				return (false);
+			}
+			if (starved)
+			{
+				underruns++;
+			}
+			drawing = true;
+		}
+		break;
+
+		case GCODE_MOVE:
+			if (!machine_idle())
+			{
+				return (false);
+			}
+			Pen->Pen_Up();
+			Mover->Get_There(target_x, target_y);
+			drawing = false;
+		break;
+
+		case GCODE_HOME:
+			if (!machine_idle())
+			{
+				return (false);
+			}
+			// as the 'O' key does
+			Pen->Pen_Up();
+			PID_1->Request_Home(true);
+			PID_2->Request_Home(true);
+			Home->SET_Home_Request();
+			drawing = false;
+		break;
+
+		case GCODE_END:
+			if (!machine_idle())
+			{
+				return (false);
+			}
+		break;
+	}
+	x_now = target_x;
+	y_now = target_y;
+	return (true);
+}
+
+/** machine_idle tells whether the plotter has finished drawing, moving and homing.
+*	@return True if there's nothing left for it to do
+*/
+bool gcode::machine_idle(void)
+{
+	return (LINES->Is_Idle() && Mover->Are_We_There() && Home->Is_Home());
+}
+
+/** end_line empties the line buffer, ready for the next line.
+*/
+void gcode::end_line(void)
+{
+	length = 0;
+	in_comment = false;
+	skip_rest = false;
+	too_long = false;
+	line_ready = false;
+	action = GCODE_NOTHING;
+}
+
+/** parse_number reads a number such as 12, -0.5 or +3. into a fixed point number with
+*	GCODE_ONE parts to one. Digits past the fourth after the decimal point are dropped.
+*	@param p_char Points to the number, and is moved past it
+*	@param value The number, times GCODE_ONE
+*	@return NULL if there was a good number, or else the reason there wasn't
+*/
+const char* gcode::parse_number(const char*& p_char, int32_t& value)
+{
+	bool negative = false;
+	if (*p_char == '-' || *p_char == '+')
+	{
+		negative = (*p_char == '-');
+		p_char++;
+	}
+
+	int32_t whole = 0;
+	int32_t fraction = 0;
+	int32_t place = GCODE_ONE;
+	uint8_t whole_digits = 0;
+	bool any_digits = false;
+	while (*p_char >= '0' && *p_char <= '9')
+	{
+		if (++whole_digits > MAX_WHOLE_DIGITS)
+		{
+			return ("number too big");
+		}
+		whole = whole * 10 + (*p_char++ - '0');
+		any_digits = true;
+	}
+	if (*p_char == '.')
+	{
+		p_char++;
+		while (*p_char >= '0' && *p_char <= '9')
+		{
+			place /= 10;
+			fraction += (*p_char++ - '0') * place;
+			any_digits = true;
+		}
+	}
+	if (!any_digits)
+	{
+		return ("bad number");
+	}
+
+	value = whole * GCODE_ONE + fraction;
+	if (negative)
+	{
+		value = -value;
+	}
+	return (NULL);
+}
+
+/** to_tenths turns a coordinate into tenths of an inch, rounded to the nearest tenth.
+*	@param value The coordinate, times GCODE_ONE
+*	@param in_mm True if the coordinate is in millimetres, false if in inches
+*	@return The coordinate in tenths of an inch
+*/
+int32_t gcode::to_tenths(int32_t value, bool in_mm)
+{
+	// a tenth of an inch is 0.1 inches, or 2.54 millimetres
+	int32_t divisor = in_mm ? (GCODE_ONE * 254L / 100L) : (GCODE_ONE / 10L);
+	if (value < 0)
+	{
+		return (-((-value + divisor / 2) / divisor));
+	}
+	return ((value + divisor / 2) / divisor);
+}
@@ -0,0 +1,159 @@
+//======================================================================================
+/** \file  gcode.h
+ *	gcode.h contains the specifications for an interpreter which draws a stream of G-code
+ *	sent through the serial port, so that a program on a PC can send a whole drawing.
+ *
+ *  Revisions:
+ *    \li  06-22-11  Original file
+ *
+ *  License:
+ *    This file released under the Lesser GNU Public License. The program is intended
+ *    for educational use only, but its use is not restricted thereto.
+ */
+//======================================================================================
+
+// This define prevents this .h file from being included more than once in a .cpp file
+#ifndef _gcode_H_
+#define _gcode_H_
+
+/// The longest line of G-code which can be taken, not counting the end of the line
+#define GCODE_LINE_SIZE			64
+
+/// Numbers in G-code are read as fixed point numbers with this many parts to one unit
+#define GCODE_ONE				10000L
+
+/// The largest x coordinate which may be drawn to, in tenths of an inch
+#define GCODE_X_MAX				340
+
+/// The largest y coordinate which may be drawn to, in tenths of an inch
+#define GCODE_Y_MAX				220
+
+
+/// These are the things a line of G-code can ask the plotter to do
+typedef enum
+{
+	GCODE_NOTHING,								///< Only modes were set; nothing to move
+	GCODE_DRAW,									///< Draw a line with the pen down
+	GCODE_MOVE,									///< Move with the pen up
+	GCODE_HOME,									///< Find the home position
+	GCODE_END									///< The program is over
+} gcode_action;
+
+
+//-------------------------------------------------------------------------------------
+/** gcode reads G-code from the serial port one line at a time and draws it. The codes
+ *	understood are:
+ *		\li G0 X Y - Move with the pen up
+ *		\li G1 X Y - Draw a line, if the pen is down; otherwise the same as G0
+ *		\li G28 - Find the home position, which is then X0 Y0
+ *		\li G20, G21 - Coordinates are in inches (the default) or millimetres
+ *		\li G90, G91 - Coordinates are absolute (the default) or relative
+ *		\li M3, M5 - Put the pen down for G1 moves, or keep it up
+ *		\li Z - Put the pen down for G1 moves if Z is zero or less, or keep it up if more
+ *		\li F, N - Feed rates and line numbers are taken but not used, as the speeds come
+ *			from the motors' limits
+ *		\li M2, M30 - The end of the drawing; the pen is kept up
+ *		\li \% - The end of the program. Once the lines ahead have been drawn, the numbers
+ *			of lines, errors and underruns are written out, then "ok"
+ *
+ *	As in GRBL, each line is answered with "ok", or with "error: " and the reason, once it
+ *	has been taken out of the serial port's buffer and acted on. A sender may keep as
+ *	many lines on their way as will fit in the serial port's receive buffer, counting
+ *	the characters sent but not yet answered, so the buffer never overflows and the
+ *	plotter need never wait for the next line. Lines which draw are queued in the
+ *	path_planner through task_lines, and are answered as soon as there is room for
+ *	them, while the plotter goes on drawing the lines ahead of them; moves with the pen
+ *	up and homing wait until the lines ahead have been drawn.
+ *
+ *	Coordinates are rounded to tenths of an inch, which is what the plotter draws in,
+ *	and must be within GCODE_X_MAX and GCODE_Y_MAX. When a line carries on from the one
+ *	before it but arrives after the planner has run out of lines to plan ahead for, so
+ *	the pen has to slow to a stop, that is counted as an underrun.
+ */
+class gcode
+{
+	protected:
+		/// the serial port from which G-code is read and to which answers are written
+		base_text_serial* ptr_2_serial;
+		/// task_lines draws the lines
+		task_lines* LINES;
+		/// the planner, which is checked to see how far ahead the lines are queued
+		path_planner* planner;
+		/// point moves the pen with the pen up
+		point* Mover;
+		/// Go_Home finds the home position
+		Go_Home* Home;
+		/// PID for motor 1, which must be told to let homing take over
+		task_PID* PID_1;
+		/// PID for motor 2, which must be told to let homing take over
+		task_PID* PID_2;
+		/// servo object which raises the pen
+		servo* Pen;
+
+		/// characters of the line being read
+		char line[GCODE_LINE_SIZE + 1];
+		/// number of characters in the line so far
+		uint8_t length;
+		/// true while skipping a comment in parentheses
+		bool in_comment;
+		/// true while skipping the rest of a line, after a semicolon or once it's too long
+		bool skip_rest;
+		/// true if the line was too long to fit in the buffer
+		bool too_long;
+		/// true if the last character ended a line with a carriage return
+		bool after_return;
+		/// true if a line has been read and is waiting to be acted on
+		bool line_ready;
+
+		/// what the line waiting to be acted on asks for
+		gcode_action action;
+		/// where the pen is to be once the line waiting to be acted on is done, in tenths
+		int16_t target_x;
+		/// where the pen is to be once the line waiting to be acted on is done, in tenths
+		int16_t target_y;
+
+		/// where the pen will be once the lines acted on so far have been drawn, in tenths
+		int16_t x_now;
+		/// where the pen will be once the lines acted on so far have been drawn, in tenths
+		int16_t y_now;
+		/// the motion mode, 0 or 1, used by lines which give coordinates but no G0 or G1
+		uint8_t motion;
+		/// true if coordinates are in millimetres, false for inches
+		bool metric;
+		/// true if coordinates are relative to where the pen is
+		bool relative;
+		/// true if G1 lines are drawn with the pen down
+		bool pen_down;
+		/// true once a line has been queued, until the pen is moved up or sent home
+		bool drawing;
+
+		/// number of lines read in this program, not counting blank ones
+		uint16_t commands;
+		/// number of lines answered with an error
+		uint16_t errors;
+		/// number of lines which arrived after the planner had run out of lines ahead
+		uint16_t underruns;
+
+		bool read_line(void);
+
+		const char* parse_line(void);
+
+		bool act(void);
+
+		bool machine_idle(void);
+
+		void end_line(void);
+
+		static const char* parse_number(const char*& p_char, int32_t& value);
+
+		static int32_t to_tenths(int32_t value, bool in_mm);
+
+	public:
+		gcode(base_text_serial* p_serial_port, task_lines* a_lines, path_planner* a_planner,
+			  point* a_mover, Go_Home* a_home, task_PID* motor_1, task_PID* motor_2,
+			  servo* a_pen);
+
+		bool run(void);
+};
+
+#endif // _gcode_H_
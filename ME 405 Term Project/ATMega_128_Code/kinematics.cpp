@@ -0,0 +1,256 @@
+//======================================================================================
+/** \file kinematics.cpp converts points in x and y to the radius and angle of the plotter
+*	in encoder counts, using only integer arithmetic.
+*
+*  Revisions:
+*    \li  06-21-11  Original file
+*    \li  06-29-11  Speeds are divided by the distance with more of its bits
+*
+*  License:
+*    This file released under the Lesser GNU Public License. The program is intended
+*    for educational use only, but its use is not restricted thereto.
+*/
+//======================================================================================
+
+	// System headers included with < >
+	#include <stdlib.h>							// Standard C library
+	#include <avr/io.h>							// Input-output ports, special registers
+	#include <avr/pgmspace.h>					// Tables kept in program memory
+
+	// User written headers included with " "
+	#include "kinematics.h"						// include own header file
+
+	// Bits added to the distance from the origin by the Newton step after the square root
+	#define NEWTON_BITS 8
+	// Bits of the arctangent table's index; the table has this many segments plus one entry
+	#define ATAN_BITS 8
+	// Bits of the fixed point ratio of the smaller coordinate to the larger
+	#define RATIO_BITS 23
+	// A quarter turn of the arm, in encoder counts
+	#define QUARTER_TURN 925000L
+	// A half turn of the arm, in encoder counts
+	#define HALF_TURN 1849999L
+
+	// The arctangent of i / 256 for i from 0 to 256, in encoder counts of arm angle
+	static const int32_t atan_table[(1 << ATAN_BITS) + 1] PROGMEM =
+	{
+	     0L,   2300L,   4600L,   6901L,   9200L,  11500L,  13799L,  16098L,
+	 18396L,  20694L,  22991L,  25288L,  27583L,  29878L,  32172L,  34465L,
+	 36757L,  39048L,  41337L,  43625L,  45912L,  48198L,  50482L,  52765L,
+	 55046L,  57325L,  59603L,  61879L,  64153L,  66425L,  68695L,  70963L,
+	 73229L,  75493L,  77755L,  80014L,  82271L,  84525L,  86777L,  89027L,
+	 91273L,  93518L,  95759L,  97997L, 100233L, 102466L, 104696L, 106923L,
+	109146L, 111367L, 113584L, 115798L, 118009L, 120217L, 122421L, 124621L,
+	126818L, 129012L, 131202L, 133388L, 135570L, 137749L, 139923L, 142094L,
+	144261L, 146424L, 148583L, 150738L, 152889L, 155035L, 157178L, 159316L,
+	161450L, 163579L, 165704L, 167825L, 169941L, 172053L, 174160L, 176263L,
+	178361L, 180454L, 182543L, 184626L, 186706L, 188780L, 190849L, 192914L,
+	194974L, 197028L, 199078L, 201123L, 203162L, 205197L, 207227L, 209251L,
+	211270L, 213284L, 215293L, 217297L, 219295L, 221289L, 223276L, 225259L,
+	227236L, 229208L, 231174L, 233135L, 235090L, 237040L, 238985L, 240924L,
+	242857L, 244785L, 246708L, 248625L, 250536L, 252441L, 254341L, 256236L,
+	258125L, 260008L, 261885L, 263757L, 265623L, 267483L, 269338L, 271186L,
+	273030L, 274867L, 276699L, 278524L, 280344L, 282159L, 283967L, 285770L,
+	287567L, 289358L, 291143L, 292922L, 294696L, 296464L, 298226L, 299982L,
+	301732L, 303477L, 305215L, 306948L, 308675L, 310396L, 312112L, 313821L,
+	315525L, 317223L, 318915L, 320601L, 322281L, 323955L, 325624L, 327287L,
+	328944L, 330595L, 332241L, 333880L, 335514L, 337142L, 338765L, 340381L,
+	341992L, 343597L, 345196L, 346789L, 348377L, 349959L, 351535L, 353106L,
+	354671L, 356230L, 357783L, 359331L, 360873L, 362410L, 363941L, 365466L,
+	366985L, 368499L, 370008L, 371510L, 373007L, 374499L, 375985L, 377465L,
+	378940L, 380410L, 381874L, 383332L, 384785L, 386233L, 387675L, 389111L,
+	390542L, 391968L, 393388L, 394803L, 396213L, 397617L, 399016L, 400410L,
+	401798L, 403181L, 404558L, 405931L, 407298L, 408660L, 410016L, 411368L,
+	412714L, 414055L, 415391L, 416722L, 418048L, 419368L, 420684L, 421994L,
+	423300L, 424600L, 425895L, 427185L, 428471L, 429751L, 431026L, 432297L,
+	433562L, 434823L, 436078L, 437329L, 438575L, 439816L, 441052L, 442284L,
+	443510L, 444732L, 445949L, 447162L, 448370L, 449573L, 450771L, 451964L,
+	453153L, 454338L, 455517L, 456693L, 457863L, 459029L, 460190L, 461347L,
+	462500L
+	};
+
+//-----------------------------------------------------------------------------------------
+/** isqrt finds the integer square root of a number, rounded down, one bit at a time.
+*	@param value The number whose square root is wanted
+*	@return The largest integer whose square is no more than value
+*/
+uint16_t kinematics::isqrt(uint32_t value)
+{
+	uint32_t root = 0;
+	uint32_t bit = 1UL << 30;
+
+	while (bit > value)
+	{
+		bit >>= 2;
+	}
+	while (bit != 0)
+	{
+		if (value >= root + bit)
+		{
+			value -= root + bit;
+			root = (root >> 1) + bit;
+		}
+		else
+		{
+			root >>= 1;
+		}
+		bit >>= 2;
+	}
+	return ((uint16_t)root);
+}
+
+/** magnitude finds the distance of a point from the origin. The integer square root of
+*	x^2 + y^2 is refined with one step of Newton's method, which gives NEWTON_BITS more bits.
+*	@param x The x coordinate, in fixed point tenths of an inch
+*	@param y The y coordinate, in fixed point tenths of an inch
+*	@return The distance, with KIN_FRAC_BITS + NEWTON_BITS bits after the binary point
+*/
+uint32_t kinematics::magnitude(int32_t x, int32_t y)
+{
+	uint32_t ax = labs(x);
+	uint32_t ay = labs(y);
+	uint32_t squared = ax * ax + ay * ay;
+	uint32_t root = isqrt(squared);
+	if (root == 0)
+	{
+		return (0);
+	}
+	// sqrt(root^2 + rest) is close to root + rest / (2 root), and rest <= 2 root
+	uint32_t rest = squared - root * root;
+	return ((root << NEWTON_BITS) + ((rest << (NEWTON_BITS - 1)) + root / 2) / root);
+}
+
+/** mul_div multiplies a number by a fraction without overflowing in between, by dividing
+*	first and then putting back the part lost in the remainder.
+*	@param value The number to be multiplied
+*	@param multiplier The fraction's numerator
+*	@param divisor The fraction's denominator, which must not be zero
+*	@return value * multiplier / divisor, rounded toward zero
+*/
+int32_t kinematics::mul_div(int32_t value, uint16_t multiplier, uint16_t divisor)
+{
+	uint32_t size = labs(value);
+	uint32_t result = (size / divisor) * multiplier
+					  + ((size % divisor) * multiplier) / divisor;
+	return ((value < 0) ? -(int32_t)result : (int32_t)result);
+}
+
+/** angle finds the angle of a point from the x axis in encoder counts, from minus to plus
+*	a half turn. The smaller coordinate is divided by the larger to give a ratio from 0 to
+*	1 whose arctangent is looked up and interpolated; then the octant sets the angle.
+*	@param x The x coordinate, in fixed point tenths of an inch
+*	@param y The y coordinate, in fixed point tenths of an inch
+*	@return The angle, in encoder counts
+*/
+int32_t kinematics::angle(int32_t x, int32_t y)
+{
+	uint32_t ax = labs(x);
+	uint32_t ay = labs(y);
+	uint32_t small = (ay < ax) ? ay : ax;
+	uint32_t large = (ay < ax) ? ax : ay;
+	if (large == 0)
+	{
+		return (0);
+	}
+
+	// The ratio to 23 bits, in two divisions so nothing overflows
+	uint32_t ratio = (small << 15) / large;
+	uint32_t rest = (small << 15) % large;
+	ratio = (ratio << 8) + (rest << 8) / large;
+
+	uint16_t index = ratio >> (RATIO_BITS - ATAN_BITS);
+	uint32_t fraction = ratio & ((1UL << (RATIO_BITS - ATAN_BITS)) - 1);
+	int32_t result = pgm_read_dword(&atan_table[index]);
+	if (fraction != 0)
+	{
+		int32_t step = (int32_t)pgm_read_dword(&atan_table[index + 1]) - result;
+		result += (step * fraction + (1UL << (RATIO_BITS - ATAN_BITS - 1)))
+				  >> (RATIO_BITS - ATAN_BITS);
+	}
+
+	if (ay > ax)
+	{
+		result = QUARTER_TURN - result;
+	}
+	if (x < 0)
+	{
+		result = HALF_TURN - result;
+	}
+	return ((y < 0) ? -result : result);
+}
+
+/** radius_counts converts a distance from the origin to encoder counts of the radius motor.
+*	@param distance The distance, as given by magnitude()
+*	@return The radius in encoder counts
+*/
+int32_t kinematics::radius_counts(uint32_t distance)
+{
+	// distance * COUNTS_PER_TENTH would overflow, so the whole and fractional parts are
+	// scaled separately, leaving KIN_FRAC_BITS bits to round off
+	uint32_t counts = (distance >> NEWTON_BITS) * COUNTS_PER_TENTH
+					  + (((distance & ((1 << NEWTON_BITS) - 1)) * COUNTS_PER_TENTH) >> NEWTON_BITS);
+	return ((counts + (KIN_ONE / 2)) >> KIN_FRAC_BITS);
+}
+
+/** to_counts converts a point in x and y to the encoder counts of the radius and angle
+*	motors.
+*	@param x The x coordinate, in fixed point tenths of an inch
+*	@param y The y coordinate, in fixed point tenths of an inch
+*	@param radius Set to the radius in encoder counts
+*	@param angle Set to the angle in encoder counts
+*/
+void kinematics::to_counts(int32_t x, int32_t y, int32_t& radius, int32_t& angle)
+{
+	radius = radius_counts(magnitude(x, y));
+	angle = kinematics::angle(x, y);
+}
+
+/** to_counts converts a point and a velocity in x and y to the encoder counts and speeds
+*	of the radius and angle motors. The radius speed is (p . v) / |p| and the angle speed
+*	(p x v) / |p|^2, where p is the point and v the velocity.
+*	@param x The x coordinate, in fixed point tenths of an inch
+*	@param y The y coordinate, in fixed point tenths of an inch
+*	@param x_speed The x speed, in fixed point tenths of an inch per second
+*	@param y_speed The y speed, in fixed point tenths of an inch per second
+*	@param radius Set to the radius in encoder counts
+*	@param angle Set to the angle in encoder counts
+*	@param r_speed Set to the radius speed in encoder counts per second
+*	@param theta_speed Set to the angle speed in encoder counts per second
+*/
+void kinematics::to_counts(int32_t x, int32_t y, int32_t x_speed, int32_t y_speed,
+						   int32_t& radius, int32_t& angle, int32_t& r_speed,
+						   int32_t& theta_speed)
+{
+	uint32_t exact = magnitude(x, y);
+	radius = radius_counts(exact);
+	angle = kinematics::angle(x, y);
+
+	if (exact < (1UL << (NEWTON_BITS - 1)))
+	{
+		r_speed = 0;
+		theta_speed = 0;
+		return;
+	}
+
+	// The divisions take a 16-bit distance, so as many of the Newton step's extra bits
+	// are kept as fit; rounding the distance to whole units would throw away up to half
+	// a unit, which close in is a large part of it
+	uint8_t shift = 0;
+	while (shift < NEWTON_BITS - 1 && (exact >> (NEWTON_BITS - 1 - shift)) < 0xFFFF)
+	{
+		shift++;
+	}
+	uint8_t dropped = NEWTON_BITS - shift;
+	uint32_t rounded = (exact + (1UL << (dropped - 1))) >> dropped;
+	uint16_t distance = (rounded > 0xFFFF) ? 0xFFFF : rounded;
+	int32_t dot = x * x_speed + y * y_speed;
+	int32_t cross = x * y_speed - y * x_speed;
+
+	// Each division by the distance leaves the quotient too small by 2^shift, which is
+	// put back before the KIN_FRAC_BITS bits are rounded off; 36805 * 16 is close enough
+	// to COUNTS_PER_RADIAN, to 12 parts in a million
+	r_speed = (mul_div(dot, COUNTS_PER_TENTH, distance) * (1L << shift) + (KIN_ONE / 2))
+			  >> KIN_FRAC_BITS;
+	theta_speed = (mul_div(mul_div(cross, 36805U, distance), 16 * KIN_ONE, distance)
+				   * (1L << (2 * shift)) + (KIN_ONE / 2)) >> KIN_FRAC_BITS;
+}
@@ -0,0 +1,70 @@
+//======================================================================================
+/** \file  kinematics.h
+ *	kinematics.h contains the specifications for the plotter's inverse kinematics, which
+ *	turn a point in x and y into encoder counts of the radius (cart) and angle (arm)
+ *	motors. Only integer arithmetic is used, so the conversion is quick on a processor
+ *	with no floating point hardware.
+ *
+ *  Revisions:
+ *    \li  06-21-11  Original file
+ *    \li  06-22-11  Seven fractional bits, so the far corner of the paper is in range
+ *    \li  06-29-11  Speeds are divided by the distance with more of its bits
+ *
+ *  License:
+ *    This file released under the Lesser GNU Public License. The program is intended
+ *    for educational use only, but its use is not restricted thereto.
+ */
+//======================================================================================
+
+// This define prevents this .h file from being included more than once in a .cpp file
+#ifndef _kinematics_H_
+#define _kinematics_H_
+
+/// Encoder counts of radius per tenth of an inch
+#define COUNTS_PER_TENTH		2350L
+
+/// Encoder counts of arm angle per radian
+#define COUNTS_PER_RADIAN		588873L
+
+/// Bits after the binary point in the fixed point x and y coordinates and speeds
+#define KIN_FRAC_BITS			7
+
+/// One tenth of an inch in fixed point coordinates
+#define KIN_ONE					(1L << KIN_FRAC_BITS)
+
+
+//-------------------------------------------------------------------------------------
+/** kinematics converts points and velocities in x and y to the radius and angle of the
+ *	plotter in encoder counts. Coordinates are fixed point numbers in tenths of an inch
+ *	with KIN_FRAC_BITS bits after the binary point, and must be within 51.2 inches of
+ *	the origin, which covers the whole drawing area; speeds are in the same units per
+ *	second and must be under 12.8 inches per second. The radius is found with an
+ *	integer square root refined by one step of Newton's method, and the angle by
+ *	looking up the arctangent of the smaller coordinate over the larger in a table of
+ *	encoder counts, then interpolating. Radii come out within 1 count and angles within
+ *	3 counts of the exact values. More than an inch from the origin, radius speeds come
+ *	out within 2 counts per second, and angle speeds within 16 counts per second plus
+ *	40 parts per million.
+ */
+class kinematics
+{
+	protected:
+		static uint32_t magnitude(int32_t x, int32_t y);
+
+		static int32_t mul_div(int32_t value, uint16_t multiplier, uint16_t divisor);
+
+		static int32_t radius_counts(uint32_t distance);
+
+	public:
+		static uint16_t isqrt(uint32_t value);
+
+		static int32_t angle(int32_t x, int32_t y);
+
+		static void to_counts(int32_t x, int32_t y, int32_t& radius, int32_t& angle);
+
+		static void to_counts(int32_t x, int32_t y, int32_t x_speed, int32_t y_speed,
+							  int32_t& radius, int32_t& angle, int32_t& r_speed,
+							  int32_t& theta_speed);
+};
+
+#endif // _kinematics_H_
@@ -21,6 +21,7 @@
  *    \li 01-30-2009 JRR Added class with port setup in constructor
  *    \li 06-02-2009 JRR Changed baud rate divisor formula to work better
  *    \li 12-14-2009 JRR Changed CPU_FREQ_Hz to F_CPU to be compatible with avr-libc
+ *    \li 06-29-2011     Register pointers have a type the simulator can replace
  *
  *  License:
  *    This file is released under the Lesser GNU Public License, version 2. This 
@@ -65,6 +66,17 @@
 #endif
 
 
+//-------------------------------------------------------------------------------------
+/** This is the type of the pointers to the UART's registers which base232 keeps. On
+ *  the AVR the registers are memory locations; the simulator in ../sim defines its own
+ *  type in its avr/io.h, as its registers are objects which must be told when they're
+ *  read or written.
+ */
+#ifndef UART_REG_PTR
+	#define UART_REG_PTR	volatile unsigned char*
+#endif
+
+
 //-------------------------------------------------------------------------------------
 /** This class operates the hardware on an RS232 port in an AVR microcontroller. It
  *  sets up the port, checks for characters, and sends characters one at a time. Its
@@ -76,13 +88,13 @@ class base232
 	protected:
 	#ifdef __AVR
 		/// This is a pointer to the data register used by the UART
-		volatile unsigned char* p_UDR;
+		UART_REG_PTR p_UDR;
 
 		/// This is a pointer to the status register used by the UART
-		volatile unsigned char* p_USR;
+		UART_REG_PTR p_USR;
 
 		/// This is a pointer to the control register used by the UART
-		volatile unsigned char* p_UCR;
+		UART_REG_PTR p_UCR;
 
 		/// This bitmask identifies the bit for data register empty, UDRE
 		unsigned char mask_UDRE;
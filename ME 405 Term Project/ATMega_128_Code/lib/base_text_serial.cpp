@@ -20,6 +20,10 @@
  *    \li 11-24-2009 JRR Changed operation of 'clrscr' to a function to work with LCD
  *    \li 11-26-2009 JRR Integrated floating point support into this file
  *    \li 12-16-2009 JRR Improved support for constant strings in program memory
+ *    \li 06-09-2011     Decimal numbers converted by num_format.h instead of by the
+ *                       library's dividing itoa() functions; added setw(), setfill(),
+ *                       and printing of fixed point numbers with q_fixed()
+ *    \li 06-29-2011     Ints wider than 16 bits are printed whole, as longs
  *
  *  Licenses:
  *    This file released under the Lesser GNU Public License, version 2. This program
@@ -46,6 +50,17 @@
 
 unsigned char bts_glob_prec = 3;
 
+/** This variable passes the width given to setw() to a serial object, in the same way
+ *  that bts_glob_prec passes the precision.
+ */
+
+unsigned char bts_glob_width = 0;
+
+/** This variable passes the fill character given to setfill() to a serial object.
+ */
+
+char bts_glob_fill = ' ';
+
 
 //-------------------------------------------------------------------------------------
 /** This constructor sets up the base serial port object. It sets the default base for
@@ -58,6 +73,8 @@ base_text_serial::base_text_serial (void)
 	print_ascii = false;					// Print 8-bit chars as numbers by default
 	precision = 3;							// Print 3 digits after a decimal point
 	pgm_string = false;						// Print strings from SRAM by default
+	width = 0;								// Don't pad numbers by default
+	fill = ' ';								// If padding is asked for, use spaces
 }
 
 
@@ -123,6 +140,34 @@ void base_text_serial::clear_screen (void)
 }
 
 
+//-------------------------------------------------------------------------------------
+/** This method writes a number which has been converted to text, first writing fill
+ *  characters if the number is shorter than the width set by setw(). If the fill 
+ *  character is '0', the minus sign of a negative number goes in front of the zeros.
+ *  The width only applies to one number, so it's set back to zero afterwards.
+ *  @param str The number as a null terminated string
+ *  @param length The number of characters in the string
+ */
+
+void base_text_serial::put_number (const char* str, unsigned char length)
+{
+	if (fill == '0' && *str == '-' && length < width)
+	{
+		putchar (*str++);
+		width--;
+		length--;
+	}
+	while (length < width)
+	{
+		putchar (fill);
+		width--;
+	}
+	width = 0;
+
+	puts (str);
+}
+
+
 //-------------------------------------------------------------------------------------
 /** This method writes the string whose first character is pointed to by the given
  *  character pointer to the serial device. It acts in about the same way as puts(). 
@@ -199,6 +244,11 @@ base_text_serial& base_text_serial::operator<< (unsigned char num)
 		temp_char = num & 0x0F;
 		putchar ((temp_char > 9) ? temp_char + ('A' - 10) : temp_char + '0');
 	}
+	else if (base == 10)
+	{
+		char out_str[6];
+		put_number (out_str, uint16_to_dec (num, out_str));
+	}
 	else
 	{
 		char out_str[9];
@@ -228,8 +278,7 @@ base_text_serial& base_text_serial::operator<< (char num)
 	{
 		if (base == 10)
 		{
-			itoa ((int)num, out_str, 10);
-			puts (out_str);
+			put_number (out_str, int32_to_dec ((int32_t)num, out_str));
 		}
 		else
 			*this << (unsigned char)num;
@@ -241,12 +290,19 @@ base_text_serial& base_text_serial::operator<< (char num)
 
 //-------------------------------------------------------------------------------------
 /** This method writes an integer to the serial port as a text string showing the 
- *  16-bit unsigned number in that integer. 
+ *  16-bit unsigned number in that integer. Where an int has 32 bits, as on a PC 
+ *  running the simulator, the number is printed as an unsigned long instead; the test
+ *  is worked out by the compiler, so the AVR's code doesn't change. 
  *  @param num The 16-bit number to be sent out
  */
 
 base_text_serial& base_text_serial::operator<< (unsigned int num)
 {
+	if (sizeof (unsigned int) > sizeof (uint16_t))
+	{
+		return (*this << (unsigned long)num);
+	}
+
 	if (base == 16 || base == 8 || base == 2)
 	{
 		union {
@@ -258,9 +314,8 @@ base_text_serial& base_text_serial::operator<< (unsigned int num)
 	}
 	else
 	{
-		char out_str[17];
-		utoa (num, out_str, base);
-		puts (out_str);
+		char out_str[6];
+		put_number (out_str, uint16_to_dec (num, out_str));
 	}
 
 	return (*this);
@@ -269,22 +324,27 @@ base_text_serial& base_text_serial::operator<< (unsigned int num)
 
 //-------------------------------------------------------------------------------------
 /** This method writes an integer to the serial port as a text string showing the 
- *  16-bit signed number in that integer. 
+ *  16-bit signed number in that integer. As for unsigned ints, a 32-bit int is 
+ *  printed as a long. 
  *  @param num The 16-bit number to be sent out
  */
 
 base_text_serial& base_text_serial::operator<< (int num)
 {
+	if (sizeof (int) > sizeof (int16_t))
+	{
+		return (*this << (long)num);
+	}
+
 	if (base != 10)
 	{
 		*this << (unsigned int)num;
 	}
 	else
 	{
-		char out_str[17];
+		char out_str[7];
 
-		itoa (num, out_str, base);
-		puts (out_str);
+		put_number (out_str, int32_to_dec ((int32_t)num, out_str));
 	}
 
 	return (*this);
@@ -310,9 +370,8 @@ base_text_serial& base_text_serial::operator<< (unsigned long num)
 	}
 	else
 	{
-		char out_str[33];
-		ultoa ((long)num, out_str, base);
-		puts (out_str);
+		char out_str[11];
+		put_number (out_str, uint32_to_dec (num, out_str));
 	}
 
 	return (*this);
@@ -333,9 +392,8 @@ base_text_serial& base_text_serial::operator<< (long num)
 	}
 	else
 	{
-		char out_str[34];
-		ltoa ((long)num, out_str, base);
-		puts (out_str);
+		char out_str[12];
+		put_number (out_str, int32_to_dec (num, out_str));
 	}
 
 	return (*this);
@@ -362,6 +420,25 @@ base_text_serial& base_text_serial::operator<< (unsigned long long num)
 	return (*this);
 }
 
+
+//-------------------------------------------------------------------------------------
+/** This method writes a fixed point number to the serial port in decimal, with the 
+ *  number of digits after the decimal point set by setprecision() (but no more than
+ *  NUM_FORMAT_MAX_DECIMALS). The conversion uses only integer arithmetic, so it is
+ *  much quicker than printing a float, and it doesn't use exponential notation.
+ *  @param number The fixed point number, usually made by q_fixed()
+ */
+
+base_text_serial& base_text_serial::operator<< (const q_number& number)
+{
+	char out_str[NUM_FORMAT_BUF_SIZE];
+
+	put_number (out_str, q_to_dec (number.value, number.frac_bits, 
+								   (uint8_t)precision, out_str));
+
+	return (*this);
+}
+
 #ifdef M_SQRT2 // Automatically include this code if <math.h> has been included
 
 //-------------------------------------------------------------------------------------
@@ -402,6 +479,8 @@ base_text_serial& base_text_serial::operator<< (float num)
 	if (exponent > 0)
 		putchar ('+');
 	*this << exponent;
+
+	return (*this);
 }
 
 
@@ -444,6 +523,8 @@ base_text_serial& base_text_serial::operator<< (double num)
 	if (exponent > 0)
 		putchar ('+');
 	*this << exponent;
+
+	return (*this);
 }
 
 #endif // M_SQRT2
@@ -468,6 +549,39 @@ ser_manipulator setprecision (unsigned char digits)
 }
 
 
+//-------------------------------------------------------------------------------------
+/** This function sets the global width value, then returns a manipulator which causes
+ *  a serial object to print the next decimal number in at least that many characters,
+ *  padding it on the left with the fill character. As with std::setw(), the width is
+ *  not sticky; it only applies to the next number printed.
+ *  @param chars The smallest number of characters to be used for the next number
+ *  @return The serial manipulator called "manip_set_width"
+ */
+
+ser_manipulator setw (unsigned char chars)
+{
+	bts_glob_width = chars;
+
+	return (manip_set_width);
+}
+
+
+//-------------------------------------------------------------------------------------
+/** This function sets the global fill character, then returns a manipulator which
+ *  causes a serial object to pad numbers with that character. The fill character is
+ *  sticky; a space is used until this function is called to change it.
+ *  @param new_fill The character with which to pad numbers, usually ' ' or '0'
+ *  @return The serial manipulator called "manip_set_fill"
+ */
+
+ser_manipulator setfill (char new_fill)
+{
+	bts_glob_fill = new_fill;
+
+	return (manip_set_fill);
+}
+
+
 //-------------------------------------------------------------------------------------
 /** This overload allows manipulators to be used to change the base of displayed 
  *  numbers to binary, octal, decimal, or hexadecimal. Also, and endline is provided
@@ -507,6 +621,15 @@ base_text_serial& base_text_serial::operator<< (ser_manipulator new_manip)
 		case (send_now):					// Send whatever's in the send buffer
 			transmit_now ();
 			break;
+		case (manip_set_precision):			// Get precision from setprecision()
+			precision = bts_glob_prec;
+			break;
+		case (manip_set_width):				// Get width from setw()
+			width = bts_glob_width;
+			break;
+		case (manip_set_fill):				// Get fill character from setfill()
+			fill = bts_glob_fill;
+			break;
 		case (_p_str):						// The next string is in program memory
 			pgm_string = true;
 	};
@@ -20,6 +20,9 @@
  *    \li 11-24-2009 JRR Changed operation of 'clrscr' to a function to work with LCD
  *    \li 11-26-2009 JRR Integrated floating point support into this file
  *    \li 12-16-2009 JRR Improved support for constant strings in program memory
+ *    \li 06-09-2011     Decimal numbers converted by num_format.h instead of by the
+ *                       library's dividing itoa() functions; added setw(), setfill(),
+ *                       and printing of fixed point numbers with q_fixed()
  *
  *  Licenses:
  *    This file released under the Lesser GNU Public License, version 2. This program
@@ -63,6 +66,7 @@
 #define _BASE_TEXT_SERIAL_H_
 
 #include <avr/pgmspace.h>					// Header for program-space (Flash) data
+#include "num_format.h"						// Fast conversion of numbers to decimal
 
 // Uncomment this line to enable floating point handling by base_text_serial; comment
 // it out if you don't need floating point and would like to save lots of memory
@@ -132,6 +136,8 @@ typedef enum {
 	clrscr,					///< Send a control-L which clears some terminal screens
 	send_now,				///< Tell some devices to send or save data immediately
 	manip_set_precision,	///< Set the precision for printing floating point numbers
+	manip_set_width,		///< Set the minimum width of the next decimal number
+	manip_set_fill,			///< Set the character used to pad numbers to width
 	_p_str					///< The following string is in program (flash) memory
 } ser_manipulator;
 
@@ -142,6 +148,43 @@ typedef enum {
 
 ser_manipulator setprecision (unsigned char);
 
+// This function sets the smallest number of characters in which the next decimal
+// number will be printed, then tells a serial port to use that width
+
+ser_manipulator setw (unsigned char);
+
+// This function sets the character with which numbers are padded out to their width,
+// then tells a serial port to use that character
+
+ser_manipulator setfill (char);
+
+
+//-------------------------------------------------------------------------------------
+/** This structure holds a signed fixed point number and the number of bits which are
+ *  to the right of its binary point, so that it can be printed in decimal. It is made
+ *  by q_fixed(); for example, "serial << q_fixed (speed, 8)" prints a number which is
+ *  scaled by 256. The number of decimal places is set with setprecision(), though no
+ *  more than NUM_FORMAT_MAX_DECIMALS places are printed.
+ */
+
+typedef struct
+{
+	int32_t value;							///< The number, scaled by 2^frac_bits
+	uint8_t frac_bits;						///< Number of bits right of binary point
+} q_number;
+
+/** This function packages a fixed point number so that it can be printed.
+ *  @param value The fixed point number
+ *  @param frac_bits The number of bits to the right of the binary point, up to 16
+ *  @return A q_number structure which the "<<" operator prints in decimal
+ */
+
+inline q_number q_fixed (int32_t value, uint8_t frac_bits)
+{
+	q_number number = {value, frac_bits};
+	return (number);
+}
+
 
 //-------------------------------------------------------------------------------------
 /** This is a base class for lots of serial devices which send text over some type of
@@ -193,12 +236,22 @@ class base_text_serial
 		 *  floating point number is being converted to text. */
 		char precision;
 
+		/** This is the smallest number of characters in which the next decimal number
+		 *  will be printed; it is set back to zero after each number. */
+		unsigned char width;
+
+		/** This is the character used to pad decimal numbers out to the width. */
+		char fill;
+
+		// This method prints a converted number, padded out to the width
+		void put_number (const char*, unsigned char);
+
 	// Public methods can be called from anywhere in the program where there is a 
 	// pointer or reference to an object of this class
 	public:
 		base_text_serial (void);			// Simple constructor doesn't do much
 		virtual bool ready_to_send (void);  // Virtual and not defined in base class
-		virtual bool putchar (char) {}	 	///< Virtual and not defined in base class
+		virtual bool putchar (char) { return (false); }	///< Not defined in base class
 		virtual void puts (char const*) {}	///< Virtual and not defined in base class
 		virtual bool check_for_char (void); // Check if a character is in the buffer
 		virtual char getchar (void);		// Get a character; wait if none is ready
@@ -216,6 +269,7 @@ class base_text_serial
 		base_text_serial& operator<< (unsigned long);
 		base_text_serial& operator<< (long);
 		base_text_serial& operator<< (unsigned long long);
+		base_text_serial& operator<< (const q_number&);
 		#ifdef M_SQRT2 // Automatically include this code if <math.h> has been included
 			base_text_serial& operator<< (float);
 			base_text_serial& operator<< (double);
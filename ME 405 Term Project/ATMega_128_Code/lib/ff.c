@@ -74,6 +74,9 @@
 /                   Added a configuration option, _LFN_UNICODE.
 /                   Changed f_readdir() to return the SFN with always upper
 /                   case on non-LFN cfg.
+/
+/ Jun 11,'11        Local change: added f_expand() and f_shrink() (option
+/                   _USE_EXPAND) for logging to pre-allocated contiguous files.
 /---------------------------------------------------------------------------*/
 
 #include "ff.h"			/* FatFs configurations and declarations */
@@ -2767,6 +2770,139 @@ FRESULT f_forward (
 
 
 
+
+#if _USE_EXPAND && !_FS_READONLY
+/*-----------------------------------------------------------------------*/
+/* Allocate a Contiguous Block of Clusters to a File                     */
+/*-----------------------------------------------------------------------*/
+
+FRESULT f_expand (
+	FIL *fp,		/* Pointer to the file object, which must be empty */
+	DWORD fsz,		/* Number of bytes to allocate */
+	DWORD *sect		/* Pointer to the variable to return the first data sector */
+)
+{
+	FRESULT res;
+	FATFS *fs;
+	DWORD bcs, tcl, clst, scl, ncl, n;
+
+
+	res = validate(fp->fs, fp->id);		/* Check validity of the object */
+	if (res != FR_OK) LEAVE_FF(fp->fs, res);
+	if (fp->flag & FA__ERROR)			/* Check abort flag */
+		LEAVE_FF(fp->fs, FR_INT_ERR);
+	if (!(fp->flag & FA_WRITE))			/* Check access mode */
+		LEAVE_FF(fp->fs, FR_DENIED);
+	if (fsz == 0 || fp->org_clust != 0)	/* Only an empty file can be expanded */
+		LEAVE_FF(fp->fs, FR_DENIED);
+
+	fs = fp->fs;
+	bcs = (DWORD)fs->csize * SS(fs);	/* Cluster size (byte) */
+	tcl = (fsz + bcs - 1) / bcs;		/* Number of clusters required */
+
+	/* Look for a run of tcl free clusters, starting after the last allocated
+	   cluster. A run cannot wrap around the end of the FAT. */
+	clst = fs->last_clust + 1;
+	if (clst < 2 || clst >= fs->max_clust) clst = 2;
+	scl = clst; ncl = 0;
+	for (n = fs->max_clust + tcl; n; n--) {
+		ncl = get_fat(fs, clst);
+		if (ncl == 0xFFFFFFFF) LEAVE_FF(fs, FR_DISK_ERR);
+		if (ncl == 1) LEAVE_FF(fs, FR_INT_ERR);
+		if (ncl == 0) {					/* Free cluster: extend the run */
+			if (clst - scl + 1 >= tcl) break;
+		} else {						/* Used cluster: start a new run after it */
+			scl = clst + 1;
+		}
+		if (++clst >= fs->max_clust) {	/* Wrap around to the start of the FAT */
+			clst = scl = 2;
+		}
+	}
+	if (!n) LEAVE_FF(fs, FR_DENIED);	/* No run long enough */
+
+	/* Link the clusters into a chain */
+	for (clst = scl; clst < scl + tcl - 1; clst++) {
+		res = put_fat(fs, clst, clst + 1);
+		if (res != FR_OK) ABORT(fs, res);
+	}
+	res = put_fat(fs, clst, 0x0FFFFFFF);
+	if (res != FR_OK) ABORT(fs, res);
+
+	fs->last_clust = clst;				/* Update FSINFO */
+	if (fs->free_clust != 0xFFFFFFFF) {
+		fs->free_clust -= tcl;
+		fs->fsi_flag = 1;
+	}
+
+	fp->org_clust = fp->curr_clust = scl;
+	fp->fsize = fsz;
+	fp->flag |= FA__WRITTEN;
+	*sect = clust2sect(fs, scl);
+
+	LEAVE_FF(fs, FR_OK);
+}
+
+
+
+
+/*-----------------------------------------------------------------------*/
+/* Set the File Size and Free the Clusters Beyond It                     */
+/*-----------------------------------------------------------------------*/
+
+FRESULT f_shrink (
+	FIL *fp,		/* Pointer to the file object */
+	DWORD fsz		/* New file size, no more than the current size */
+)
+{
+	FRESULT res;
+	FATFS *fs;
+	DWORD bcs, tcl, clst, ncl;
+
+
+	res = validate(fp->fs, fp->id);		/* Check validity of the object */
+	if (res != FR_OK) LEAVE_FF(fp->fs, res);
+	if (fp->flag & FA__ERROR)			/* Check abort flag */
+		LEAVE_FF(fp->fs, FR_INT_ERR);
+	if (!(fp->flag & FA_WRITE))			/* Check access mode */
+		LEAVE_FF(fp->fs, FR_DENIED);
+	if (fsz > fp->fsize)
+		LEAVE_FF(fp->fs, FR_DENIED);
+
+	fs = fp->fs;
+	bcs = (DWORD)fs->csize * SS(fs);	/* Cluster size (byte) */
+	tcl = (fsz + bcs - 1) / bcs;		/* Number of clusters to keep */
+
+	if (tcl == 0) {						/* Nothing kept: remove the whole chain */
+		if (fp->org_clust) res = remove_chain(fs, fp->org_clust);
+		fp->org_clust = 0;
+	} else {							/* Find the last cluster to be kept */
+		clst = fp->org_clust;
+		while (--tcl) {
+			clst = get_fat(fs, clst);
+			if (clst == 0xFFFFFFFF) ABORT(fs, FR_DISK_ERR);
+			if (clst <= 1 || clst >= fs->max_clust) ABORT(fs, FR_INT_ERR);
+		}
+		ncl = get_fat(fs, clst);		/* Cut the chain after it */
+		if (ncl == 0xFFFFFFFF) ABORT(fs, FR_DISK_ERR);
+		if (ncl == 1) ABORT(fs, FR_INT_ERR);
+		if (ncl < fs->max_clust) {
+			res = put_fat(fs, clst, 0x0FFFFFFF);
+			if (res == FR_OK) res = remove_chain(fs, ncl);
+		}
+	}
+	if (res != FR_OK) ABORT(fs, res);
+
+	fp->fsize = fsz;					/* Rewind the file pointer */
+	fp->fptr = 0; fp->csect = 255;
+	fp->curr_clust = fp->org_clust;
+	fp->flag |= FA__WRITTEN;
+
+	LEAVE_FF(fs, FR_OK);
+}
+#endif /* _USE_EXPAND */
+
+
+
 #if _USE_MKFS && !_FS_READONLY
 /*-----------------------------------------------------------------------*/
 /* Create File System on the Drive                                       */
@@ -436,6 +436,8 @@ FRESULT f_forward (FIL*, UINT(*)(const BYTE*,UINT), UINT, UINT*);	/* Forward dat
 FRESULT f_mkfs (BYTE, BYTE, WORD);					/* Create a file system on the drive */
 FRESULT f_chdir (const XCHAR*);						/* Change current directory */
 FRESULT f_chdrive (BYTE);							/* Change current drive */
+FRESULT f_expand (FIL*, DWORD, DWORD*);				/* Allocate contiguous clusters to an empty file */
+FRESULT f_shrink (FIL*, DWORD);						/* Set file size and free clusters beyond it */
 
 #if _USE_STRFUNC
 int f_putc (int, FIL*);								/* Put a character to the file */
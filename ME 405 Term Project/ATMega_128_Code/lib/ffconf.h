@@ -48,6 +48,11 @@
 /* To enable f_forward function, set _USE_FORWARD to 1 and set _FS_TINY to 1. */
 
 
+#define	_USE_EXPAND	1		/* 0 or 1 */
+/* To enable f_expand and f_shrink functions, which pre-allocate contiguous
+/  files for logging, set _USE_EXPAND to 1 and set _FS_READONLY to 0. */
+
+
 
 /*---------------------------------------------------------------------------/
 / Locale and Namespace Configurations
@@ -8,33 +8,41 @@
  *
  *  Revisions
  *    \li  04-12-08  JRR  Original file, material from source above
+ *    \li  06-24-11       new and delete use the fixed size block pool in mem_pool.h,
+ *                        and are left out if MEM_POOL_STATIC_ONLY is defined
+ *    \li  06-29-11       With MEM_POOL_STATIC_ONLY, malloc() and free() can't be used
  */
 //*************************************************************************************
  
 #include "mechutil.h"
+#include "mem_pool.h"
 
 //-------------------------------------------------------------------------------------
-// Stuff to make the new and delete operators work. Doxygen comments in mechutil.h
+// Stuff to make the new and delete operators work. Doxygen comments in mechutil.h. With
+// MEM_POOL_STATIC_ONLY they aren't defined, so any use of them fails to link; the C
+// library's malloc() and friends are poisoned by mem_pool.h and wrapped by the Makefile
 
+#ifndef MEM_POOL_STATIC_ONLY
 void* operator new (size_t size) 
     { 
-    return malloc (size); 
+    return mem_pool_alloc (size); 
     } 
  
 void operator delete (void* ptr) 
     { 
-    if (ptr) free (ptr); 
+    mem_pool_free (ptr); 
     } 
       
 void* operator new[] (size_t size)
     {
-    return malloc (size);
+    return mem_pool_alloc (size);
     }
  
 void operator delete[] (void* ptr) 
     { 
-    if (ptr) free (ptr); 
+    mem_pool_free (ptr); 
     }
+#endif // MEM_POOL_STATIC_ONLY
 
 
 //-------------------------------------------------------------------------------------
@@ -8,6 +8,8 @@
  *
  *  Revisions
  *    \li  04-12-08  JRR  Original file, material from source above
+ *    \li  06-24-11       new and delete use the fixed size block pool in mem_pool.h,
+ *                        and are left out if MEM_POOL_STATIC_ONLY is defined
  */
 //*************************************************************************************
 
@@ -18,8 +20,12 @@
 
 // ------------------ Stuff to make the new and delete operators work -----------------
 
+// The operators are declared even if MEM_POOL_STATIC_ONLY is defined, so that using them
+// is an error at link time rather than in some other, more confusing way
+
 /** This is the standard "new" operator, defined here because it's not available in the
- *  standard avr-libc library. 
+ *  standard avr-libc library. Memory comes from the pool in mem_pool.h; if there's no
+ *  block big enough free, NULL is returned. 
  *  @param size The number of bytes of memory which need to be allocated
  */
 void* operator new (size_t size);
@@ -0,0 +1,214 @@
+//*************************************************************************************
+/** \file mem_pool.cpp
+ *    This file contains a memory allocator for the AVR which hands out blocks of a few
+ *    fixed sizes from a static arena, in place of malloc(). Each size class keeps a
+ *    list of its free blocks, linked through the blocks themselves, so that no memory
+ *    is spent on headers. Blocks which have never been used aren't on the list; they
+ *    are taken in order from the class's part of the arena, so the pool needs no setup
+ *    and works even for objects constructed before main() runs. Which class a freed
+ *    block belongs to is found from its address.
+ *
+ *  Revisions:
+ *    \li 06-24-2011 Original file
+ *
+ *  License:
+ *    This file is released under the Lesser GNU Public License, version 2. This
+ *    program is intended for educational use only, but it is not limited thereto.
+ */
+//*************************************************************************************
+
+#include <stdint.h>
+#include <stdlib.h>
+#include "mem_pool.h"
+
+
+#ifndef MEM_POOL_STATIC_ONLY
+
+/// This is where each class's blocks start in the arena
+#define MEM_POOL_START_1	(MEM_POOL_BLOCK_0 * MEM_POOL_COUNT_0)
+#define MEM_POOL_START_2	(MEM_POOL_START_1 + MEM_POOL_BLOCK_1 * MEM_POOL_COUNT_1)
+#define MEM_POOL_START_3	(MEM_POOL_START_2 + MEM_POOL_BLOCK_2 * MEM_POOL_COUNT_2)
+
+/// This is the size of the whole arena, in bytes
+#define MEM_POOL_SIZE		(MEM_POOL_START_3 + MEM_POOL_BLOCK_3 * MEM_POOL_COUNT_3)
+
+/// This typedef causes a compiler error if the block sizes don't go up from class to class
+typedef char mem_pool_sizes_must_go_up[(MEM_POOL_BLOCK_0 < MEM_POOL_BLOCK_1
+	&& MEM_POOL_BLOCK_1 < MEM_POOL_BLOCK_2 && MEM_POOL_BLOCK_2 < MEM_POOL_BLOCK_3) ? 1 : -1];
+
+/// This typedef causes a compiler error if a free block couldn't hold a pointer or could
+/// leave the next block misaligned
+typedef char mem_pool_sizes_must_fit_pointers[(MEM_POOL_BLOCK_0 % sizeof (void*) == 0
+	&& MEM_POOL_BLOCK_1 % sizeof (void*) == 0 && MEM_POOL_BLOCK_2 % sizeof (void*) == 0
+	&& MEM_POOL_BLOCK_3 % sizeof (void*) == 0) ? 1 : -1];
+
+
+/// This is the memory from which blocks are handed out, aligned to hold pointers
+static uint8_t mem_pool_arena[MEM_POOL_SIZE] __attribute__ ((aligned (sizeof (void*))));
+
+/// These are the sizes of the blocks in each class
+static const uint16_t mem_pool_block_size[MEM_POOL_CLASSES]
+	= {MEM_POOL_BLOCK_0, MEM_POOL_BLOCK_1, MEM_POOL_BLOCK_2, MEM_POOL_BLOCK_3};
+
+/// These are the numbers of blocks in each class
+static const uint8_t mem_pool_count[MEM_POOL_CLASSES]
+	= {MEM_POOL_COUNT_0, MEM_POOL_COUNT_1, MEM_POOL_COUNT_2, MEM_POOL_COUNT_3};
+
+/// These are where each class's blocks start in the arena
+static const uint16_t mem_pool_start[MEM_POOL_CLASSES]
+	= {0, MEM_POOL_START_1, MEM_POOL_START_2, MEM_POOL_START_3};
+
+
+//-------------------------------------------------------------------------------------
+/** This structure holds the state of one size class. It starts out all zeros, which
+ *  means that no blocks have been used.
+ */
+
+typedef struct
+{
+	void* p_free;							///< First block on the free list, or NULL
+	uint8_t fresh;							///< Number of blocks ever taken from the arena
+	uint8_t in_use;							///< Number of blocks allocated now
+	uint8_t most_used;						///< Most blocks ever allocated at once
+	uint16_t failures;						///< Requests which found no free block
+} mem_pool_class;
+
+/// This is the state of each size class
+static mem_pool_class mem_pool_classes[MEM_POOL_CLASSES];
+
+
+//-------------------------------------------------------------------------------------
+/** This function allocates a block big enough for the given number of bytes. It takes
+ *  a block from the smallest class whose blocks are big enough, or if all of those are
+ *  in use, from the next larger class which has one free. The time taken doesn't
+ *  depend on how the pool has been used, as there are only MEM_POOL_CLASSES classes
+ *  to look through and taking a block from a class is one step.
+ *  @param size The number of bytes needed
+ *  @return A pointer to the block, or NULL if there's no block free which is big enough
+ */
+
+void* mem_pool_alloc (size_t size)
+{
+	uint8_t index = 0;
+	while (index < MEM_POOL_CLASSES - 1 && size > mem_pool_block_size[index])
+	{
+		index++;
+	}
+	mem_pool_class* p_fit = &mem_pool_classes[index];
+
+	for ( ; index < MEM_POOL_CLASSES && size <= mem_pool_block_size[index]; index++)
+	{
+		mem_pool_class* p_class = &mem_pool_classes[index];
+		void* p_block;
+
+		// Reuse a freed block if there is one, or else take a new one from the arena
+		if (p_class->p_free != NULL)
+		{
+			p_block = p_class->p_free;
+			p_class->p_free = *(void**)p_block;
+		}
+		else if (p_class->fresh < mem_pool_count[index])
+		{
+			p_block = mem_pool_arena + mem_pool_start[index]
+					  + p_class->fresh * mem_pool_block_size[index];
+			p_class->fresh++;
+		}
+		else
+		{
+			continue;
+		}
+
+		if (++(p_class->in_use) > p_class->most_used)
+		{
+			p_class->most_used = p_class->in_use;
+		}
+		return (p_block);
+	}
+
+	// No block was found; the failure is counted against the class which fits best
+	p_fit->failures++;
+	return (NULL);
+}
+
+
+//-------------------------------------------------------------------------------------
+/** This function puts a block back in the pool, at the front of its class's free list.
+ *  Its class is found by comparing its address with where each class starts.
+ *  Pointers which aren't in the arena, such as NULL, are ignored.
+ *  @param p_block A pointer to the block, as returned by mem_pool_alloc()
+ */
+
+void mem_pool_free (void* p_block)
+{
+	uint8_t* p_byte = (uint8_t*)p_block;
+	if (p_byte < mem_pool_arena || p_byte >= mem_pool_arena + MEM_POOL_SIZE)
+	{
+		return;
+	}
+
+	uint8_t index = MEM_POOL_CLASSES - 1;
+	while (p_byte < mem_pool_arena + mem_pool_start[index])
+	{
+		index--;
+	}
+	mem_pool_class* p_class = &mem_pool_classes[index];
+	*(void**)p_block = p_class->p_free;
+	p_class->p_free = p_block;
+	p_class->in_use--;
+}
+
+
+//-------------------------------------------------------------------------------------
+/** This function gets the statistics of one size class.
+ *  @param size_class The number of the class, 0 to MEM_POOL_CLASSES - 1
+ *  @param p_stats A pointer to the structure which is filled in
+ *  @return True if the class exists, false if the number was too big
+ */
+
+bool mem_pool_get_stats (uint8_t size_class, mem_pool_stats* p_stats)
+{
+	if (size_class >= MEM_POOL_CLASSES)
+	{
+		return (false);
+	}
+	mem_pool_class* p_class = &mem_pool_classes[size_class];
+	p_stats->block_size = mem_pool_block_size[size_class];
+	p_stats->blocks = mem_pool_count[size_class];
+	p_stats->in_use = p_class->in_use;
+	p_stats->most_used = p_class->most_used;
+	p_stats->failures = p_class->failures;
+	return (true);
+}
+
+
+//-------------------------------------------------------------------------------------
+/** This function prints the statistics of all the size classes, one line each, with
+ *  the size of the arena.
+ *  @param serial The serial device to which the statistics are printed
+ */
+
+void mem_pool_report (base_text_serial& serial)
+{
+	mem_pool_stats stats;
+
+	serial << "Pool: " << (uint16_t)MEM_POOL_SIZE << " bytes" << endl;
+	for (uint8_t index = 0; mem_pool_get_stats (index, &stats); index++)
+	{
+		serial << "  " << stats.block_size << " B: " << stats.in_use << "/" << stats.blocks
+			   << " used, most " << stats.most_used << ", failed " << stats.failures << endl;
+	}
+}
+
+#else // MEM_POOL_STATIC_ONLY
+
+//-------------------------------------------------------------------------------------
+/** This function says, when the pool has been left out, that all memory is static.
+ *  @param serial The serial device to which the message is printed
+ */
+
+void mem_pool_report (base_text_serial& serial)
+{
+	serial << "Pool: none, memory is allocated statically" << endl;
+}
+
+#endif // MEM_POOL_STATIC_ONLY
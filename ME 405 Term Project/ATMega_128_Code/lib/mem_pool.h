@@ -0,0 +1,115 @@
+//*************************************************************************************
+/** \file mem_pool.h
+ *    This file contains a memory allocator for the AVR which hands out blocks of a few
+ *    fixed sizes from a static arena, in place of malloc(). With only a few kilobytes of
+ *    SRAM, a heap which is fragmented by objects of different sizes being made and
+ *    deleted can fail even though there's plenty of memory free, and malloc() takes
+ *    longer the more fragmented the heap is. Here each size class has its own blocks,
+ *    so freed blocks are always reusable, and allocation and freeing take the same
+ *    short time however the pool has been used. The operator new and delete in
+ *    mechutil.cpp use this pool.
+ *
+ *  Usage:
+ *    There are MEM_POOL_CLASSES size classes. The size and number of blocks in class n
+ *    are set by MEM_POOL_BLOCK_n and MEM_POOL_COUNT_n, which can be defined on the
+ *    compiler's command line (for example in OTHERS in the Makefile) to fit a program's
+ *    needs; the block sizes must go up from class to class and be a multiple of the
+ *    size of a pointer. A class which isn't needed can be given a count of 0, which
+ *    takes no memory; each size and count can be set on its own. The arena is statically allocated, so its size shows up in
+ *    avr-size's count of data memory. A request is served from the smallest class
+ *    whose blocks are big enough, or if those are all in use, from a larger class.
+ *    The pool isn't meant to be used from interrupt service routines.
+ *
+ *    If MEM_POOL_STATIC_ONLY is defined, the pool and operator new are left out, so a
+ *    program which uses new (or calls mem_pool_alloc()) fails to link. The C library's
+ *    malloc(), calloc(), realloc() and free() are poisoned in any file which includes
+ *    this one, so using them there won't compile; the Makefile also links with those
+ *    names wrapped, so that a call from any other file fails to link. That makes sure
+ *    that all memory is allocated statically, where the linker can count it.
+ *
+ *  Revisions:
+ *    \li 06-24-2011 Original file
+ *    \li 06-29-2011 The C library's heap functions are poisoned with the pool left out
+ *    \li 06-30-2011 Block sizes and counts can be set separately
+ *
+ *  License:
+ *    This file is released under the Lesser GNU Public License, version 2. This
+ *    program is intended for educational use only, but it is not limited thereto.
+ */
+//*************************************************************************************
+
+/// This define prevents this .h file from being included more than once in a .cc file
+#ifndef _MEM_POOL_H_
+#define _MEM_POOL_H_
+
+#include <stdint.h>
+#include <stdlib.h>
+#include "base_text_serial.h"				// For printing the pool's statistics
+
+
+/// This is the number of size classes in the pool
+#define MEM_POOL_CLASSES		4
+
+// The default sizes fit small objects and the serial port's 128 byte receive buffer
+// and 130 byte transmit queue. A program which knows what it allocates should set the
+// counts to fit, as the plotter's Makefile does
+#ifndef MEM_POOL_BLOCK_0
+	#define MEM_POOL_BLOCK_0	16			///< Size of blocks in class 0, in bytes
+#endif
+#ifndef MEM_POOL_COUNT_0
+	#define MEM_POOL_COUNT_0	4			///< Number of blocks in class 0
+#endif
+#ifndef MEM_POOL_BLOCK_1
+	#define MEM_POOL_BLOCK_1	32			///< Size of blocks in class 1, in bytes
+#endif
+#ifndef MEM_POOL_COUNT_1
+	#define MEM_POOL_COUNT_1	4			///< Number of blocks in class 1
+#endif
+#ifndef MEM_POOL_BLOCK_2
+	#define MEM_POOL_BLOCK_2	64			///< Size of blocks in class 2, in bytes
+#endif
+#ifndef MEM_POOL_COUNT_2
+	#define MEM_POOL_COUNT_2	2			///< Number of blocks in class 2
+#endif
+#ifndef MEM_POOL_BLOCK_3
+	#define MEM_POOL_BLOCK_3	136			///< Size of blocks in class 3, in bytes
+#endif
+#ifndef MEM_POOL_COUNT_3
+	#define MEM_POOL_COUNT_3	2			///< Number of blocks in class 3
+#endif
+
+
+//-------------------------------------------------------------------------------------
+/** This structure holds the statistics of one size class, as filled in by
+ *  mem_pool_get_stats().
+ */
+
+typedef struct
+{
+	uint16_t block_size;					///< Size of each block, in bytes
+	uint8_t blocks;							///< Number of blocks in the class
+	uint8_t in_use;							///< Number of blocks allocated now
+	uint8_t most_used;						///< Most blocks ever allocated at once
+	uint16_t failures;						///< Requests which found no free block
+} mem_pool_stats;
+
+
+// This function allocates a block big enough for the given number of bytes
+void* mem_pool_alloc (size_t);
+
+// This function puts a block back in the pool
+void mem_pool_free (void*);
+
+// This function gets the statistics of one size class
+bool mem_pool_get_stats (uint8_t, mem_pool_stats*);
+
+// This function prints the statistics of all the size classes
+void mem_pool_report (base_text_serial&);
+
+// With only static memory, the C library's heap functions mustn't be used either.
+// This comes after stdlib.h has declared them, as declaring a poisoned name is an error
+#ifdef MEM_POOL_STATIC_ONLY
+	#pragma GCC poison malloc calloc realloc free
+#endif
+
+#endif // _MEM_POOL_H_
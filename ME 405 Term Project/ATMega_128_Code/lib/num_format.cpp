@@ -0,0 +1,213 @@
+//*************************************************************************************
+/** \file num_format.cpp
+ *    This file contains functions which convert integers and fixed point numbers into
+ *    decimal text without using division. See num_format.h for details. 
+ *
+ *  Revisions:
+ *    \li 06-09-2011 Original file
+ *
+ *  License:
+ *    This file is released under the Lesser GNU Public License, version 2. This
+ *    program is intended for educational use only, but it is not limited thereto.
+ */
+//*************************************************************************************
+
+#include <stdint.h>
+#include "num_format.h"						// Header for this file
+
+
+//-------------------------------------------------------------------------------------
+/** This table holds the powers of ten used to find the digits of 32-bit numbers which
+ *  are too big to be converted with 16-bit arithmetic. It is small enough that it is
+ *  kept in SRAM, which is quicker to read than program memory.
+ */
+
+static const uint32_t powers_of_ten[] =
+{
+	1000000000UL, 100000000UL, 10000000UL, 1000000UL, 100000UL, 10000UL
+};
+
+
+//-------------------------------------------------------------------------------------
+/** This function writes a 16-bit unsigned number into a buffer as decimal text. Each
+ *  digit is found by dividing by ten, which is done by multiplying by 0xCCCD and 
+ *  shifting right by 19 bits; this gives the exact quotient for every 16-bit number.
+ *  @param num The number to be converted
+ *  @param buf A buffer at least 6 characters long in which to put the text; a null
+ *             character is put after the digits
+ *  @return The number of digits written, not counting the null character
+ */
+
+uint8_t uint16_to_dec (uint16_t num, char* buf)
+{
+	char digits[5];							// Digits in reverse order
+	uint8_t count = 0;
+
+	do
+	{
+		uint16_t quotient = (uint16_t)(((uint32_t)num * 0xCCCDUL) >> 19);
+		digits[count++] = (char)(num - quotient * 10) + '0';
+		num = quotient;
+	}
+	while (num != 0);
+
+	for (uint8_t index = 0; index < count; index++)
+	{
+		buf[index] = digits[count - 1 - index];
+	}
+	buf[count] = '\0';
+
+	return (count);
+}
+
+
+//-------------------------------------------------------------------------------------
+/** This function writes a 32-bit unsigned number into a buffer as decimal text. The
+ *  digits above the lowest four are found by counting how many times each power of 
+ *  ten can be subtracted, which takes at most nine subtractions per digit; when what's
+ *  left fits in 16 bits, uint16_to_dec() finishes the job. 
+ *  @param num The number to be converted
+ *  @param buf A buffer at least 11 characters long in which to put the text; a null
+ *             character is put after the digits
+ *  @return The number of digits written, not counting the null character
+ */
+
+uint8_t uint32_to_dec (uint32_t num, char* buf)
+{
+	uint8_t count = 0;						// Number of digits written so far
+	uint8_t power = 0;						// Index into the table of powers of ten
+
+	if (num <= 0xFFFFUL)
+	{
+		return (uint16_to_dec ((uint16_t)num, buf));
+	}
+
+	// Skip powers of ten which are bigger than the number, so there's no leading zero
+	while (num < powers_of_ten[power])
+	{
+		power++;
+	}
+
+	// Find each digit down to the ten thousands place by repeated subtraction
+	for ( ; power < sizeof (powers_of_ten) / sizeof (uint32_t); power++)
+	{
+		char digit = '0';
+		while (num >= powers_of_ten[power])
+		{
+			num -= powers_of_ten[power];
+			digit++;
+		}
+		buf[count++] = digit;
+	}
+
+	// The remainder is less than 10000; write it as exactly four digits
+	char low[6];
+	uint8_t low_count = uint16_to_dec ((uint16_t)num, low);
+	for (uint8_t index = low_count; index < 4; index++)
+	{
+		buf[count++] = '0';
+	}
+	for (uint8_t index = 0; index <= low_count; index++)
+	{
+		buf[count + index] = low[index];
+	}
+
+	return (count + low_count);
+}
+
+
+//-------------------------------------------------------------------------------------
+/** This function writes a 32-bit signed number into a buffer as decimal text, with a
+ *  minus sign in front if the number is negative. 
+ *  @param num The number to be converted
+ *  @param buf A buffer at least 12 characters long in which to put the text; a null
+ *             character is put after the digits
+ *  @return The number of characters written, not counting the null character
+ */
+
+uint8_t int32_to_dec (int32_t num, char* buf)
+{
+	if (num < 0)
+	{
+		*buf = '-';
+		return (uint32_to_dec ((uint32_t)0 - (uint32_t)num, buf + 1) + 1);
+	}
+	return (uint32_to_dec ((uint32_t)num, buf));
+}
+
+
+//-------------------------------------------------------------------------------------
+/** This function writes a signed fixed point number into a buffer as decimal text, 
+ *  such as "-12.375". The number is in Q format, meaning that it holds the real value
+ *  multiplied by two to the power of the number of fraction bits; for example, with
+ *  8 fraction bits the value 0x0180 means 1.5. The fraction is rounded to the given 
+ *  number of decimal places. 
+ *  @param value The fixed point number to be converted
+ *  @param frac_bits The number of fraction bits, up to NUM_FORMAT_MAX_Q_BITS
+ *  @param decimals The number of digits to be printed after the decimal point, up to
+ *                  NUM_FORMAT_MAX_DECIMALS; if zero, no decimal point is printed
+ *  @param buf A buffer NUM_FORMAT_BUF_SIZE characters long in which to put the text
+ *  @return The number of characters written, not counting the null character
+ */
+
+uint8_t q_to_dec (int32_t value, uint8_t frac_bits, uint8_t decimals, char* buf)
+{
+	uint8_t count = 0;						// Number of characters written
+	uint32_t magnitude;						// Absolute value of the number
+	uint32_t whole;							// Part of the number left of the point
+	uint32_t scale = 1;						// Ten to the power of decimals
+	uint32_t fraction;						// Fraction, scaled by ten^decimals
+
+	if (frac_bits > NUM_FORMAT_MAX_Q_BITS)
+	{
+		frac_bits = NUM_FORMAT_MAX_Q_BITS;
+	}
+	if (decimals > NUM_FORMAT_MAX_DECIMALS)
+	{
+		decimals = NUM_FORMAT_MAX_DECIMALS;
+	}
+	for (uint8_t index = 0; index < decimals; index++)
+	{
+		scale *= 10;
+	}
+
+	magnitude = (value < 0) ? (uint32_t)0 - (uint32_t)value : (uint32_t)value;
+	whole = magnitude >> frac_bits;
+
+	// Scale the fraction bits to a whole number of the smallest printed decimal units,
+	// rounding to nearest. The product fits in 32 bits because there are no more than
+	// 16 fraction bits and the scale is no more than 10000
+	fraction = magnitude & (((uint32_t)1 << frac_bits) - 1);
+	fraction = (fraction * scale + (((uint32_t)1 << frac_bits) >> 1)) >> frac_bits;
+	if (fraction >= scale)
+	{
+		fraction -= scale;
+		whole++;
+	}
+
+	// Only show a minus sign if something nonzero will be printed
+	if (value < 0 && (whole != 0 || fraction != 0))
+	{
+		buf[count++] = '-';
+	}
+	count += uint32_to_dec (whole, buf + count);
+
+	if (decimals > 0)
+	{
+		char digits[6];
+		uint8_t num_digits = uint16_to_dec ((uint16_t)fraction, digits);
+
+		buf[count++] = '.';
+		for (uint8_t index = num_digits; index < decimals; index++)
+		{
+			buf[count++] = '0';
+		}
+		for (uint8_t index = 0; index < num_digits; index++)
+		{
+			buf[count++] = digits[index];
+		}
+		buf[count] = '\0';
+	}
+
+	return (count);
+}
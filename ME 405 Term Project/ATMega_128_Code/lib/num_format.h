@@ -0,0 +1,50 @@
+//*************************************************************************************
+/** \file num_format.h
+ *    This file contains functions which convert integers and fixed point numbers into
+ *    decimal text quickly. The AVR has no divide instruction, so the library functions
+ *    such as ltoa() and ultoa(), which divide by the base once for every digit, are
+ *    slow; converting a 32-bit number takes ten 32-bit software divisions. These 
+ *    functions instead find 16-bit digits by multiplying by a scaled reciprocal of ten,
+ *    which the AVR's hardware multiplier does quickly, and find 32-bit digits by 
+ *    subtracting powers of ten from a table. Only standard C types are used, so these
+ *    functions can also be compiled and checked on a PC.
+ *
+ *  Revisions:
+ *    \li 06-09-2011 Original file
+ *
+ *  License:
+ *    This file is released under the Lesser GNU Public License, version 2. This
+ *    program is intended for educational use only, but it is not limited thereto.
+ */
+//*************************************************************************************
+
+/// This define prevents this .h file from being included more than once in a .cc file
+#ifndef _NUM_FORMAT_H_
+#define _NUM_FORMAT_H_
+
+#include <stdint.h>
+
+
+/// This is the size of buffer needed to hold any number these functions produce
+#define NUM_FORMAT_BUF_SIZE		17
+
+/// This is the largest number of digits after the point which q_to_dec() will print
+#define NUM_FORMAT_MAX_DECIMALS	4
+
+/// This is the largest number of fraction bits which q_to_dec() can handle
+#define NUM_FORMAT_MAX_Q_BITS	16
+
+
+// This function writes a 16-bit unsigned number as decimal text
+uint8_t uint16_to_dec (uint16_t, char*);
+
+// This function writes a 32-bit unsigned number as decimal text
+uint8_t uint32_to_dec (uint32_t, char*);
+
+// This function writes a 32-bit signed number as decimal text
+uint8_t int32_to_dec (int32_t, char*);
+
+// This function writes a signed fixed point number as decimal text
+uint8_t q_to_dec (int32_t, uint8_t, uint8_t, char*);
+
+#endif // _NUM_FORMAT_H_
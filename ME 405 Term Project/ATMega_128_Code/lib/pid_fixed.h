@@ -0,0 +1,372 @@
+//*************************************************************************************
+/** \file pid_fixed.h
+ *    This file contains a PID controller which uses fixed point numbers, so that it
+ *    can be run quickly on a processor with no floating point hardware. Gains and the
+ *    controller's internal state are held as signed 32-bit numbers with a fixed number
+ *    of bits after the binary point, set by a template parameter; the default of 16
+ *    gives Q16.16 numbers. Only 16 by 16 bit multiplications, which the AVR does in a
+ *    few instructions with its MUL instruction, and 32-bit additions and shifts are
+ *    used in update(); there are no 64-bit numbers and no divisions.
+ *
+ *    Besides the usual proportional, integral, and derivative terms, the controller
+ *    has these features:
+ *    \li The derivative is taken of the measurement rather than of the error, so that
+ *        a change in setpoint doesn't kick the output, and it is smoothed by a first
+ *        order low pass filter whose time constant is a power of two updates
+ *    \li The integral is kept from winding up by back calculation: whenever the output
+ *        is limited, the difference between the limited and unlimited output is fed
+ *        back into the integral, so it unwinds instead of growing without bound
+ *    \li A velocity feedforward gain multiplies the change in setpoint at each update,
+ *        and another feedforward term (for friction or gravity, say) may be passed in
+ *    \li The output is limited to a range and its rate of change may be limited too
+ *
+ *  Usage:
+ *    A controller for duty cycles from -255 to 255 might be set up with:
+ *    \code
+ *    pid_fixed<16> motor_pid;
+ *    motor_pid.set_kp (pid_fixed<16>::ratio (3750, 10000));	// Kp = 0.375
+ *    motor_pid.set_output_limits (-255, 255);
+ *    ...
+ *    duty = motor_pid.update (setpoint, encoder_count);
+ *    \endcode
+ *    The error and the change in measurement at each update are limited to the range
+ *    of a 16-bit number, -32768 to 32767, before they are multiplied by the gains.
+ *
+ *  Revisions:
+ *    \li 06-16-2011 Original file
+ *    \li 06-29-2011 Back calculation can no longer wind the integral up
+ *
+ *  License:
+ *    This file is released under the Lesser GNU Public License, version 2. This
+ *    program is intended for educational use only, but it is not limited thereto.
+ */
+//*************************************************************************************
+
+/// This define prevents this .h file from being included more than once in a .cc file
+#ifndef _PID_FIXED_H_
+#define _PID_FIXED_H_
+
+#include <stdint.h>
+
+/// The largest 32-bit number; avr-libc only defines INT32_MAX in C++ if asked to
+#define PID_INT32_MAX		((int32_t)0x7FFFFFFFL)
+
+/// The smallest 32-bit number
+#define PID_INT32_MIN		((int32_t)(-0x7FFFFFFFL - 1L))
+
+
+//-------------------------------------------------------------------------------------
+/** This class implements a fixed point PID controller. The template parameter is the
+ *  number of fractional bits in the gains and the internal state, from 1 to 16.
+ *  Gains are in output units per unit of the measurement (per measurement unit per
+ *  update for the integral gain, and per measurement unit change per update for the
+ *  derivative and feedforward gains), times 2 to the power of qFracBits. The ratio()
+ *  method helps make such numbers from a fraction.
+ */
+
+template <uint8_t qFracBits = 16>
+class pid_fixed
+{
+	protected:
+		/// This typedef causes a compiler error if the number of fraction bits is bad
+		typedef char frac_bits_must_be_1_to_16[(qFracBits >= 1 && qFracBits <= 16) ? 1 : -1];
+
+		int32_t kp;							///< Proportional gain
+		int32_t ki;							///< Integral gain, per update
+		int32_t kd;							///< Derivative gain, per update
+		int32_t kff;						///< Feedforward gain on setpoint change
+		int32_t out_min;					///< Lowest output, shifted by qFracBits
+		int32_t out_max;					///< Highest output, shifted by qFracBits
+		int32_t slew;						///< Largest output change per update, or 0
+		int32_t integral;					///< Integral term, shifted by qFracBits
+		int32_t d_filtered;					///< Filtered derivative term, shifted
+		int32_t last_output;				///< Output of the last update, shifted
+		int32_t last_measured;				///< Measurement at the last update
+		int32_t last_setpoint;				///< Setpoint at the last update
+		uint8_t filter_shift;				///< Derivative filter time constant, as 2^n
+		uint8_t windup_shift;				///< Back calculation gain, as 1 / 2^n
+
+		/** This method limits a 32-bit number to the range of a 16-bit number.
+		 *  @param number The number to be limited
+		 *  @return The limited number
+		 */
+		static int16_t limit_16 (int32_t number)
+		{
+			if (number > 32767)
+			{
+				return (32767);
+			}
+			if (number < -32768)
+			{
+				return (-32768);
+			}
+			return ((int16_t)number);
+		}
+
+		/** This method adds two 32-bit numbers, giving the largest or smallest 32-bit
+		 *  number instead of wrapping around if the sum doesn't fit.
+		 *  @param first One of the numbers to be added
+		 *  @param second The other number
+		 *  @return The sum, limited to the range of a 32-bit number
+		 */
+		static int32_t add_sat (int32_t first, int32_t second)
+		{
+			int32_t sum = (int32_t)((uint32_t)first + (uint32_t)second);
+
+			// Overflow has happened if both numbers have the same sign and the sum doesn't
+			if (((first ^ sum) & (second ^ sum)) < 0)
+			{
+				return ((first < 0) ? PID_INT32_MIN : PID_INT32_MAX);
+			}
+			return (sum);
+		}
+
+		/** This method multiplies a 16-bit number by a 32-bit gain, using two 16 by 16
+		 *  bit multiplications: one by the high half of the gain, whose product is
+		 *  worth 2^16 times as much, and one by the low half, treated as unsigned. The
+		 *  product has as many fractional bits as the gain. If it doesn't fit in 32
+		 *  bits, it's limited to the largest or smallest 32-bit number.
+		 *  @param number The number to be multiplied
+		 *  @param gain The gain by which to multiply it
+		 *  @return The product, limited to the range of a 32-bit number
+		 */
+		static int32_t multiply (int16_t number, int32_t gain)
+		{
+			int32_t high = (int32_t)number * (int16_t)(gain >> 16);
+			int32_t low = (int32_t)number * (uint16_t)gain;
+
+			// Carry the high half of the low product into the high product, which then
+			// holds the top half of the answer if the answer fits in 32 bits
+			high += low >> 16;
+			if (high > 32767)
+			{
+				return (PID_INT32_MAX);
+			}
+			if (high < -32768)
+			{
+				return (PID_INT32_MIN);
+			}
+			return ((int32_t)(((uint32_t)high << 16) | (uint16_t)low));
+		}
+
+		/** This method limits a shifted number to the range given by two others.
+		 *  @param number The number to be limited
+		 *  @param lowest The smallest number allowed
+		 *  @param highest The largest number allowed
+		 *  @return The limited number
+		 */
+		static int32_t clamp (int32_t number, int32_t lowest, int32_t highest)
+		{
+			if (number > highest)
+			{
+				return (highest);
+			}
+			if (number < lowest)
+			{
+				return (lowest);
+			}
+			return (number);
+		}
+
+	public:
+		pid_fixed (void);
+
+		int16_t update (int32_t setpoint, int32_t measured, int16_t feedforward = 0);
+
+		void reset (int32_t measured, int32_t setpoint);
+
+		void set_output_limits (int16_t lowest, int16_t highest);
+
+		/** This method sets the proportional gain. @param gain The new gain */
+		void set_kp (int32_t gain) { kp = gain; }
+
+		/** This method sets the integral gain. @param gain The new gain */
+		void set_ki (int32_t gain) { ki = gain; }
+
+		/** This method sets the derivative gain. @param gain The new gain */
+		void set_kd (int32_t gain) { kd = gain; }
+
+		/** This method sets the gain by which the change in setpoint since the last
+		 *  update is multiplied and added to the output.
+		 *  @param gain The new feedforward gain
+		 */
+		void set_kff (int32_t gain) { kff = gain; }
+
+		/** This method sets the largest amount by which the output may change in one
+		 *  update. A limit of zero lets the output change as fast as it likes.
+		 *  @param per_update The largest change in output units, 0 to 32767, or 0 for
+		 *                    no limit
+		 */
+		void set_slew_limit (int16_t per_update)
+		{
+			slew = (int32_t)per_update * (1L << qFracBits);
+		}
+
+		/** This method sets the time constant of the derivative filter. Each update
+		 *  moves the filtered derivative 1 / 2^shift of the way to the new derivative,
+		 *  so the time constant is about 2^shift updates; 0 turns the filter off.
+		 *  @param shift The base 2 logarithm of the time constant, 0 to 7
+		 */
+		void set_derivative_filter (uint8_t shift) { filter_shift = shift; }
+
+		/** This method sets the back calculation gain used to keep the integral from
+		 *  winding up. At each update, 1 / 2^shift of the amount by which the output
+		 *  was limited is taken back out of the integral.
+		 *  @param shift The base 2 logarithm of one over the gain, 0 to 15
+		 */
+		void set_antiwindup (uint8_t shift) { windup_shift = shift; }
+
+		/** This method returns the output of the most recent update.
+		 *  @return The output, in output units
+		 */
+		int16_t get_output (void)
+		{
+			return ((int16_t)((last_output + (1L << (qFracBits - 1))) >> qFracBits));
+		}
+
+		/** This method returns the integral term of the controller.
+		 *  @return The integral term, in output units
+		 */
+		int16_t get_integral (void)
+		{
+			return ((int16_t)((integral + (1L << (qFracBits - 1))) >> qFracBits));
+		}
+
+		/** This method makes a gain from a fraction. It uses a 32-bit division, so it's
+		 *  meant to be used when gains are set, not in a control loop.
+		 *  @param numerator The top of the fraction
+		 *  @param denominator The bottom of the fraction, which must not be zero
+		 *  @return The fraction with qFracBits fractional bits
+		 */
+		static int32_t ratio (uint16_t numerator, uint32_t denominator)
+		{
+			return ((int32_t)((((uint32_t)numerator << qFracBits) + denominator / 2)
+							  / denominator));
+		}
+};
+
+
+//-------------------------------------------------------------------------------------
+/** This constructor creates a controller with all gains zero, output limits of the
+ *  range of a 16-bit number, no slew limit, a derivative filter time constant of four
+ *  updates, and a back calculation gain of one half.
+ */
+
+template <uint8_t qFracBits>
+pid_fixed<qFracBits>::pid_fixed (void)
+{
+	kp = 0;
+	ki = 0;
+	kd = 0;
+	kff = 0;
+	slew = 0;
+	filter_shift = 2;
+	windup_shift = 1;
+	set_output_limits (-32767, 32767);
+	reset (0, 0);
+}
+
+
+//-------------------------------------------------------------------------------------
+/** This method runs the controller once. It should be called at regular intervals,
+ *  as the integral and derivative gains are per update. The output is the sum of the
+ *  proportional, integral, filtered derivative, and feedforward terms, limited to the
+ *  output range and then to the slew limit. The integral is then updated with the
+ *  error, less the part of the output which had to be cut off by the limits.
+ *  @param setpoint The value which the measurement should have
+ *  @param measured The measured value
+ *  @param feedforward An amount, in output units, to be added to the output
+ *  @return The new output, in output units
+ */
+
+template <uint8_t qFracBits>
+int16_t pid_fixed<qFracBits>::update (int32_t setpoint, int32_t measured,
+	int16_t feedforward)
+{
+	int16_t error = limit_16 (setpoint - measured);
+	int16_t d_measured = limit_16 (last_measured - measured);
+	int16_t d_setpoint = limit_16 (setpoint - last_setpoint);
+	last_measured = measured;
+	last_setpoint = setpoint;
+
+	// Filter the derivative of the measurement, which has its sign flipped so that it
+	// acts in the same direction as the error; taking each part's share separately
+	// keeps the sum from overflowing
+	int32_t d_now = multiply (d_measured, kd);
+	d_filtered += (d_now >> filter_shift) - (d_filtered >> filter_shift);
+
+	int32_t unlimited = add_sat (multiply (error, kp), integral);
+	unlimited = add_sat (unlimited, d_filtered);
+	unlimited = add_sat (unlimited, multiply (d_setpoint, kff));
+	unlimited = add_sat (unlimited, (int32_t)feedforward * (1L << qFracBits));
+
+	int32_t output = clamp (unlimited, out_min, out_max);
+	if (slew != 0)
+	{
+		output = clamp (output, add_sat (last_output, -slew), add_sat (last_output, slew));
+	}
+	last_output = output;
+
+	// Back calculation: take whatever the limits cut off back out of the integral. The
+	// output is within the limits, so if the difference overflows it's huge and the
+	// integral should be pulled all the way back
+	int32_t excess = (int32_t)((uint32_t)output - (uint32_t)unlimited);
+	if ((output >= unlimited) != (excess >= 0))
+	{
+		excess = (output >= unlimited) ? PID_INT32_MAX : PID_INT32_MIN;
+	}
+	int32_t wound = add_sat (integral, multiply (error, ki));
+	integral = add_sat (wound, excess >> windup_shift);
+
+	// Back calculation only takes out what has been wound up; if the proportional
+	// term alone is over the limit, it mustn't push the integral past zero, and if the
+	// slew limit holds the output back as it falls, it mustn't wind the integral up
+	if ((wound >= 0) ? (integral < 0) : (integral > 0))
+	{
+		integral = 0;
+	}
+	else if ((wound >= 0) ? (integral > wound) : (integral < wound))
+	{
+		integral = wound;
+	}
+	integral = clamp (integral, out_min, out_max);
+
+	return (get_output ());
+}
+
+
+//-------------------------------------------------------------------------------------
+/** This method clears the integral, the filtered derivative, and the output, and sets
+ *  the previous measurement and setpoint so that the derivative and feedforward terms
+ *  don't jump at the next update. It should be called before a controller which has
+ *  been stopped is started again.
+ *  @param measured The present measurement
+ *  @param setpoint The present setpoint
+ */
+
+template <uint8_t qFracBits>
+void pid_fixed<qFracBits>::reset (int32_t measured, int32_t setpoint)
+{
+	integral = 0;
+	d_filtered = 0;
+	last_output = 0;
+	last_measured = measured;
+	last_setpoint = setpoint;
+}
+
+
+//-------------------------------------------------------------------------------------
+/** This method sets the range of the output. The integral is kept within the same
+ *  range.
+ *  @param lowest The smallest output allowed
+ *  @param highest The largest output allowed
+ */
+
+template <uint8_t qFracBits>
+void pid_fixed<qFracBits>::set_output_limits (int16_t lowest, int16_t highest)
+{
+	out_min = (int32_t)lowest * (1L << qFracBits);
+	out_max = (int32_t)highest * (1L << qFracBits);
+}
+
+#endif // _PID_FIXED_H_
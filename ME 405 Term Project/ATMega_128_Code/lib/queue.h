@@ -23,6 +23,9 @@
  *    \li 12-14-07  JRR  Doxygen comments added
  *    \li 02-17-08  JRR  Changed index type from define to template parameter
  *    \li 08-12-08  JRR  Added overloaded array subscript operator
+ *    \li 06-04-11       Fixed jam() not advancing the write index and off-by-one
+ *                       wrap checks in operator[]; see spsc_queue.h for a version
+ *                       which is safe between an ISR and the main loop
  *
  *  License:
  *    This file copyright 2007-2008 by JR Ridgely. It is released under the Lesser GNU
@@ -147,7 +150,7 @@ bool queue<qType, qIndexType, qSize>::jam (qType data)
 {
 	// Write the data and move the write pointer to the next element
 	buffer[i_put] = data;
-	if (i_put >= qSize) 
+	if (++i_put >= qSize) 
 		i_put = 0;
 
 	// Check if the buffer is already full; if so, the read index has to be moved so
@@ -218,12 +221,12 @@ template <class qType, class qIndexType, qIndexType qSize>
 qType queue<qType, qIndexType, qSize>::operator[] (qIndexType index)
 {
 	// Check if there's data written at the given location
-	if (index > how_full)
+	if (index >= how_full)
 		return ((qType)(-1));
 
 	// Find an index pointing to the correct location in the queue
 	qIndexType getIndex = i_get + index;
-	if (getIndex > qSize)
+	if (getIndex >= qSize)
 		getIndex -= qSize;
 
 	// Get the data at that index location
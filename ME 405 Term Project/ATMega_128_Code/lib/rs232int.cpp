@@ -23,6 +23,9 @@
  *    \li 07-05-2008 JRR Changed from 1 to 2 stop bits to placate finicky receivers
  *    \li 12-22-2008 JRR Split off stuff in base232.h for efficiency
  *    \li 06-30-2009 JRR Received data interrupt and buffer added
+ *    \li 06-05-2011     Transmit buffer emptied by data register empty interrupt
+ *    \li 06-23-2011     ready_to_send() says whether the transmit buffer has room
+ *    \li 06-24-2011     Static buffers if MEM_POOL_STATIC_ONLY leaves out the heap
  *
  *  License:
  *		This file is released under the Lesser GNU Public License, version 2. This 
@@ -46,6 +49,9 @@ uint16_t rcv0_read_index;
 /// This index is used to read from serial character receiver buffer 0. 
 uint16_t rcv0_write_index;
 
+/// This buffer holds characters waiting to be sent through serial port 0.
+rsint_tx_queue* xmt0_buffer = NULL;
+
 // If there's a UCSR0A register, there are 2 serial ports, so enable another buffer
 #ifdef UCSR1A
 	/// This buffer holds characters received through serial port 1 by the ISR. 
@@ -56,6 +62,26 @@ uint16_t rcv0_write_index;
 
 	/// This index is used to read from serial character receiver buffer 1. 
 	uint16_t rcv1_write_index;
+
+	/// This buffer holds characters waiting to be sent through serial port 1.
+	rsint_tx_queue* xmt1_buffer = NULL;
+#endif
+
+// If the heap has been left out (see mem_pool.h), the buffers are allocated statically
+#ifdef MEM_POOL_STATIC_ONLY
+	/// This is the memory for serial port 0's receiver buffer
+	static uint8_t rcv0_storage[RSINT_BUF_SIZE];
+
+	/// This is serial port 0's transmitter buffer
+	static rsint_tx_queue xmt0_storage;
+
+	#ifdef UCSR1A
+		/// This is the memory for serial port 1's receiver buffer
+		static uint8_t rcv1_storage[RSINT_BUF_SIZE];
+
+		/// This is serial port 1's transmitter buffer
+		static rsint_tx_queue xmt1_storage;
+	#endif
 #endif
 
 
@@ -78,6 +104,10 @@ rs232::rs232 (unsigned int baud_rate, unsigned char port_number)
 	// Save the number of the serial port, 0 or 1
 	port_num = port_number;
 
+	// By default, wait for room when the transmit buffer is full
+	tx_policy = RSINT_TX_BLOCK;
+	tx_dropped = 0;
+
 	// If we're compiling for a chip with UCSR0A defined, it has dual serial ports
 	// (examples are ATmega324P and ATmega128). Set up Port 0 or Port 1
 	#if defined UCSR0A // Serial port number 0
@@ -86,9 +116,22 @@ rs232::rs232 (unsigned int baud_rate, unsigned char port_number)
 			UCSR0B |= (1 << RXCIE0);		// Receive complete interrupt enable
 
 			// Allocate some memory for the receiver buffer and reset the indices
-			rcv0_buffer = new uint8_t[RSINT_BUF_SIZE];
+			#ifdef MEM_POOL_STATIC_ONLY
+				rcv0_buffer = rcv0_storage;
+			#else
+				rcv0_buffer = new uint8_t[RSINT_BUF_SIZE];
+			#endif
 			rcv0_read_index = 0;
 			rcv0_write_index = 0;
+
+			// Make a transmitter buffer; its interrupt is enabled when there's data
+			#ifdef MEM_POOL_STATIC_ONLY
+				xmt0_buffer = &xmt0_storage;
+			#else
+				xmt0_buffer = new rsint_tx_queue;
+			#endif
+			p_tx_buffer = xmt0_buffer;
+			mask_UDRIE = (1 << UDRIE0);
 		}
 		else  // Serial port number 1
 		{
@@ -96,9 +139,22 @@ rs232::rs232 (unsigned int baud_rate, unsigned char port_number)
 			UCSR1B |= (1 << RXCIE1);		// Receive complete interrupt enable
 
 			// Allocate some memory for the receiver buffer and reset the indices
-			rcv1_buffer = new uint8_t[RSINT_BUF_SIZE];
+			#ifdef MEM_POOL_STATIC_ONLY
+				rcv1_buffer = rcv1_storage;
+			#else
+				rcv1_buffer = new uint8_t[RSINT_BUF_SIZE];
+			#endif
 			rcv1_read_index = 0;
 			rcv1_write_index = 0;
+
+			// Make a transmitter buffer; its interrupt is enabled when there's data
+			#ifdef MEM_POOL_STATIC_ONLY
+				xmt1_buffer = &xmt1_storage;
+			#else
+				xmt1_buffer = new rsint_tx_queue;
+			#endif
+			p_tx_buffer = xmt1_buffer;
+			mask_UDRIE = (1 << UDRIE1);
 		#endif // UCSR1A
 		}
 	// We're compiling for a chip which doesn't define UCSR0A; assume it has only one
@@ -107,9 +163,22 @@ rs232::rs232 (unsigned int baud_rate, unsigned char port_number)
 		UCSRB |= (1 << RXCIE);				// Receive complete interrupt enable
 
 		// Allocate some memory for the receiver buffer and reset the indices
-		rcv0_buffer = new uint8_t[RSINT_BUF_SIZE];
+		#ifdef MEM_POOL_STATIC_ONLY
+			rcv0_buffer = rcv0_storage;
+		#else
+			rcv0_buffer = new uint8_t[RSINT_BUF_SIZE];
+		#endif
 		rcv0_read_index = 0;
 		rcv0_write_index = 0;
+
+		// Make a transmitter buffer; its interrupt is enabled when there's data
+		#ifdef MEM_POOL_STATIC_ONLY
+			xmt0_buffer = &xmt0_storage;
+		#else
+			xmt0_buffer = new rsint_tx_queue;
+		#endif
+		p_tx_buffer = xmt0_buffer;
+		mask_UDRIE = (1 << UDRIE);
 	#endif
 
 	// The Xiphos 1.0 board may need the pullup activated on the RXD1 line in order to
@@ -122,20 +191,107 @@ rs232::rs232 (unsigned int baud_rate, unsigned char port_number)
 
 
 //-------------------------------------------------------------------------------------
-/** This method sends one character to the serial port.  It waits until the port is
- *  ready, so it can hold up the system for a while.  It times out if it waits too 
- *  long to send the character; you can check the return value to see if the character
- *  was successfully sent, or just cross your fingers and ignore the return value.
- *  Note 1:  It's possible that at slower baud rates and/or higher processor speeds, 
- *  this routine might time out even when the port is working fine.  A solution would
- *  be to change the count variable to an integer and use a larger starting number. 
- *  Note 2:  Fixed!  The count is now an integer and it works at lower baud rates.
+/** This method puts one character into the transmit buffer and enables the data
+ *  register empty interrupt, whose service routine will send it when the port is
+ *  ready. Normally this takes only a few microseconds. If the buffer is full, what
+ *  happens depends on the policy set with set_tx_policy(): the default is to wait
+ *  until the interrupt has made room, timing out if it waits too long; the other
+ *  choices throw away either the oldest character in the buffer or the new one. 
+ *  Characters thrown away or timed out are counted. If interrupts are disabled, the
+ *  character is sent by polling instead, since the interrupt can't run. 
  *  @param chout The character to be sent out
- *  @return True if everything was OK and false if there was a timeout
+ *  @return True if the character was buffered or sent, false if it was thrown away
  */
 
 bool rs232::putchar (char chout)
 {
+	// If interrupts are off, the buffer can't be emptied by the ISR, so poll
+	if ((SREG & (1 << SREG_I)) == 0)
+	{
+		return (putchar_polled (chout));
+	}
+
+	if (p_tx_buffer->is_full ())
+	{
+		switch (tx_policy)
+		{
+			// Throw the new character away
+			case (RSINT_TX_DROP_NEW):
+				tx_dropped++;
+				return (false);
+
+			// Throw away the oldest character. Taking a character out of the buffer
+			// is the ISR's job, so its interrupt is masked while we do it
+			case (RSINT_TX_DROP_OLDEST):
+				*p_UCR &= ~mask_UDRIE;
+				if (p_tx_buffer->is_full ())
+				{
+					p_tx_buffer->get ();
+					tx_dropped++;
+				}
+				break;
+
+			// Wait for the ISR to make room in the buffer, but not forever
+			default:
+				for (unsigned int count = 0; p_tx_buffer->is_full (); count++)
+				{
+					if (count > UART_TX_TOUT)
+					{
+						tx_dropped++;
+						return (false);
+					}
+				}
+				break;
+		};
+	}
+
+	// Put the character in the buffer, then make sure the ISR will send it
+	p_tx_buffer->put ((uint8_t)chout);
+	*p_UCR |= mask_UDRIE;
+
+	return (true);
+}
+
+
+//-------------------------------------------------------------------------------------
+/** This method checks whether a character can be written right now without waiting.
+ *  As characters are sent from the transmit buffer by its interrupt, that's so if the
+ *  buffer has room; a task which prints a little at a time can check this first and 
+ *  come back later rather than wait in putchar() for the port to catch up. 
+ *  @return True if putchar() can take a character without waiting
+ */
+
+bool rs232::ready_to_send (void)
+{
+	return (!p_tx_buffer->is_full ());
+}
+
+
+//-------------------------------------------------------------------------------------
+/** This method sends one character to the serial port by waiting until the port is
+ *  ready, as this driver did before it had a transmit buffer. It is used when 
+ *  interrupts are disabled. Any characters still in the transmit buffer are sent 
+ *  first so that the order of the characters isn't mixed up. It times out if it
+ *  waits too long to send a character. 
+ *  @param chout The character to be sent out
+ *  @return True if everything was OK and false if there was a timeout
+ */
+
+bool rs232::putchar_polled (char chout)
+{
+	// Send out whatever is waiting in the buffer. With interrupts off, the ISR can't
+	// take characters out of the buffer, so it's safe to do so here
+	while (!p_tx_buffer->is_empty ())
+	{
+		for (unsigned int count = 0; ((*p_USR & mask_UDRE) == 0); count++)
+		{
+			if (count > UART_TX_TOUT)
+				return (false);
+		}
+		*p_USR |= mask_TXC;
+		*p_UDR = p_tx_buffer->get ();
+	}
+
 	// Now wait for the serial port transmitter buffer to be empty	 
 	for (unsigned int count = 0; ((*p_USR & mask_UDRE) == 0); count++)
 	{
@@ -269,6 +425,34 @@ ISR (RSI_CHAR_RECV_INT_0)
 }
 
 
+//-------------------------------------------------------------------------------------
+/** This interrupt service routine runs whenever the data register of the first serial
+ *  port (number 0) is empty and its interrupt is enabled. It sends the next character
+ *  from the transmitter buffer, or disables its interrupt if the buffer is empty. 
+ */
+
+ISR (RSI_XMIT_EMPTY_INT_0)
+{
+	#if defined UCSR0A
+		if (xmt0_buffer->is_empty ())
+		{
+			UCSR0B &= ~(1 << UDRIE0);
+			return;
+		}
+		UCSR0A |= (1 << TXC0);				// Clear TXC so is_sending() works
+		UDR0 = xmt0_buffer->get ();
+	#else
+		if (xmt0_buffer->is_empty ())
+		{
+			UCSRB &= ~(1 << UDRIE);
+			return;
+		}
+		UCSRA |= (1 << TXC);
+		UDR = xmt0_buffer->get ();
+	#endif
+}
+
+
 #ifdef UCSR1A // The second ISR is only compiled for processors with dual serial ports
 	//-------------------------------------------------------------------------------------
 	/** This interrupt service routine runs whenever a character has been received by the
@@ -291,5 +475,23 @@ ISR (RSI_CHAR_RECV_INT_0)
 			if (++rcv1_read_index >= RSINT_BUF_SIZE)
 				rcv1_read_index = 0;
 	}
+
+
+	//-------------------------------------------------------------------------------------
+	/** This interrupt service routine runs whenever the data register of the second 
+	*  serial port (number 1) is empty and its interrupt is enabled. It sends the next 
+	*  character from the transmitter buffer, or disables its interrupt if there's none.
+	*/
+
+	ISR (RSI_XMIT_EMPTY_INT_1)
+	{
+		if (xmt1_buffer->is_empty ())
+		{
+			UCSR1B &= ~(1 << UDRIE1);
+			return;
+		}
+		UCSR1A |= (1 << TXC1);				// Clear TXC so is_sending() works
+		UDR1 = xmt1_buffer->get ();
+	}
 #endif // Dual serial ports
 /** \endcond  (End of section which is not to be documented by Doxygen) */
@@ -23,6 +23,9 @@
  *    \li 07-05-2008 JRR Changed from 1 to 2 stop bits to placate finicky receivers
  *    \li 12-22-2008 JRR Split off stuff in base232.h for efficiency
  *    \li 06-30-2009 JRR Received data interrupt and buffer added
+ *    \li 06-05-2011     Transmit buffer emptied by data register empty interrupt
+ *    \li 06-23-2011     ready_to_send() says whether the transmit buffer has room
+ *    \li 06-24-2011     Static buffers if MEM_POOL_STATIC_ONLY leaves out the heap
  *
  *  License:
  *		This file is released under the Lesser GNU Public License, version 2. This 
@@ -37,6 +40,7 @@
 #include <avr/interrupt.h>					// Header for AVR interrupt programming
 #include "base232.h"						// Grab the base RS232-style header file
 #include "base_text_serial.h"				// Pull in the base class header file
+#include "spsc_queue.h"						// Lock-free buffer for transmitted data
 
 
 // If the chip for which we are compiling has dual serial ports, define two character
@@ -45,17 +49,41 @@
 #if defined UCSR0A
 	#define RSI_CHAR_RECV_INT_0 USART0_RX_vect 
 	#define RSI_CHAR_RECV_INT_1 USART1_RX_vect 
+	#define RSI_XMIT_EMPTY_INT_0 USART0_UDRE_vect
+	#define RSI_XMIT_EMPTY_INT_1 USART1_UDRE_vect
 // There's no second serial port, so define one port's interrupt. This is for ATmega8
 // and ATmega32 and similar chips. This section will need to be expanded if other
 // single-UART/USART chips are used, as the vector may have a different name
 #else
 	#define RSI_CHAR_RECV_INT_0 USART_RXC_vect
+	#define RSI_XMIT_EMPTY_INT_0 USART_UDRE_vect
 #endif
 
 
 /// This is the size of the buffer which holds characters received by the serial port.
 #define RSINT_BUF_SIZE		128
 
+/** This is the size of the buffer which holds characters waiting to be transmitted.
+ *  It must be a power of two no larger than 128. 
+ */
+#define RSINT_TX_BUF_SIZE	128
+
+/// This is the type of buffer which holds characters waiting to be transmitted.
+typedef spsc_queue<uint8_t, uint8_t, RSINT_TX_BUF_SIZE> rsint_tx_queue;
+
+
+//-------------------------------------------------------------------------------------
+/** This enumeration lists the things putchar() can do when the transmit buffer is 
+ *  full because characters are being written faster than the port can send them.
+ */
+
+enum rsint_tx_policy
+{
+	RSINT_TX_BLOCK,			///< Wait for room in the buffer (with a timeout)
+	RSINT_TX_DROP_OLDEST,	///< Throw away the oldest unsent character
+	RSINT_TX_DROP_NEW		///< Throw away the character being written
+};
+
 
 //-------------------------------------------------------------------------------------
 /** This class controls a UART (Universal Asynchronous Receiver Transmitter), a common 
@@ -63,6 +91,14 @@
  *  converter chip such as a MAX232) or through a USB to serial converter such as a
  *  FT232RL chip. The UART is also sometimes used to communicate directly with other
  *  microcontrollers, sensors, or wireless modems. 
+ *
+ *  Characters are received by an interrupt service routine into a buffer, from which
+ *  getchar() reads them. Characters written with putchar() go into a transmit buffer
+ *  which is emptied by the data register empty interrupt, so writing to the port 
+ *  doesn't hold up the program unless the transmit buffer fills up; what happens then
+ *  is chosen with set_tx_policy(). If putchar() is called while interrupts are
+ *  disabled, it empties the buffer and sends the character by polling, so that 
+ *  messages written from interrupt service routines or after cli() still get out. 
  */
 
 class rs232 : public base_text_serial, public base232
@@ -71,6 +107,21 @@ class rs232 : public base_text_serial, public base232
 	protected:
 		uint8_t port_num;					///< The USART number, 0 or 1
 
+		/// This is a pointer to the buffer holding characters waiting to be sent
+		rsint_tx_queue* p_tx_buffer;
+
+		/// This bitmask identifies the data register empty interrupt enable bit
+		uint8_t mask_UDRIE;
+
+		/// This is what putchar() does when the transmit buffer is full
+		rsint_tx_policy tx_policy;
+
+		/// This is the number of characters thrown away because the buffer was full
+		uint16_t tx_dropped;
+
+		// This method sends a character by polling, emptying the buffer first
+		bool putchar_polled (char);
+
 	// Public methods can be called from anywhere in the program where there is a 
 	// pointer or reference to an object of this class
 	public:
@@ -80,10 +131,30 @@ class rs232 : public base_text_serial, public base232
 		/// This method writes one character to the serial port.
 		bool putchar (char);
 
+		// Check if a character can be written without waiting for room
+		bool ready_to_send (void);
+
 		void puts (char const*);			// Write a string constant to serial port
 		bool check_for_char (void);			// Check if a character is in the buffer
 		char getchar (void);				// Get a character; wait if none is ready
 		void clear_screen (void);			// Send the 'clear display screen' code
+
+		/** This method chooses what putchar() does when the transmit buffer is full.
+		 *  @param new_policy The new policy for a full transmit buffer
+		 */
+		void set_tx_policy (rsint_tx_policy new_policy) { tx_policy = new_policy; }
+
+		/** This method returns the number of characters which have been thrown away
+		 *  because the transmit buffer was full, or because putchar() timed out.
+		 *  @return The number of characters which weren't sent
+		 */
+		uint16_t get_tx_dropped (void) { return (tx_dropped); }
+
+		/** This method returns the number of characters which can be written right
+		 *  now without filling up the transmit buffer.
+		 *  @return The number of free spaces in the transmit buffer
+		 */
+		uint8_t tx_space (void) { return (p_tx_buffer->num_free ()); }
 // 		char getch_tout (unsigned int);		// Try a given number of times to get char
 };
 
@@ -20,6 +20,10 @@
  *    \li 11-21-2009 JRR The DOSFS code is still buggy; trying ELM-FAT-FS version from
  *                       http://elm-chan.org/fsw/ff/00index_e.html
  *    \li 12-16-2009 JRR The ELM-FAT-FS version seems reasonably debugged and usable
+ *    \li 06-10-2011     Added streaming mode, which writes double buffered sectors to
+ *                       a range of the card with one multiple block write command
+ *    \li 06-11-2011     Added open_stream_file(), which pre-allocates a contiguous
+ *                       file to be written in streaming mode
  *
  *  License:
  *    This file is free software released under the Lesser GNU Public License, version
@@ -712,6 +716,11 @@ sd_card::sd_card (void) : base_text_serial ()
 	// any attempts at writing until a file has been opened
 	Stat = STA_NOINIT;
 	dir_file_result = FR_NOT_READY;
+
+	// Streaming mode isn't used until someone calls start_stream()
+	stream_state = SD_STREAM_OFF;
+	stream_full[0] = false;
+	stream_full[1] = false;
 }
 
 
@@ -740,6 +749,36 @@ bool sd_card::ready_to_send (void)
 
 bool sd_card::putchar (char to_put)
 {
+	// In streaming mode, characters go into the stream buffers, not the line buffer
+	if (stream_state != SD_STREAM_OFF)
+	{
+		if (stream_state != SD_STREAM_RUN || stream_blocks_left == 0)
+			return (false);
+
+		stream_buffers[stream_in][stream_fill++] = to_put;
+		stream_bytes++;
+
+		// If this buffer is full, hand it to the card and begin filling the other one;
+		// if the other one hasn't been sent yet, we have no choice but to wait for it
+		if (stream_fill >= SD_BLOCK_SIZE)
+		{
+			stream_full[stream_in] = true;
+			stream_in ^= 1;
+			stream_fill = 0;
+			stream_blocks_left--;
+
+			if (stream_full[stream_in])
+			{
+				stream_stalls++;
+				while (stream_full[stream_in] && stream_state == SD_STREAM_RUN)
+				{
+					service_stream ();
+				}
+			}
+		}
+		return (true);
+	}
+
  	if (!ready_to_send ()) return (false);
 
 	line_buffer.put (to_put);
@@ -779,11 +818,18 @@ void sd_card::puts (char const* str)
 
 void sd_card::transmit_now (void)
 {
+	// In streaming mode only whole blocks can be written, so just send what's ready
+	if (stream_state != SD_STREAM_OFF)
+	{
+		service_stream ();
+		return;
+	}
+
 	// If there's not a mounted card present, we can't transmit anything
 	if (Stat || dir_file_result)
 		return;
 
-	uint16_t bytes_written = 0;				// Number of bytes acutally written
+	UINT bytes_written = 0;					// Number of bytes acutally written
 
 	// Write the data which is in the output buffer to the file
 	f_write (&the_file, p_line_buffer, line_buffer.num_items (), &bytes_written);
@@ -937,8 +983,9 @@ FRESULT sd_card::open_file_append (const char* path_name)
 
 //-------------------------------------------------------------------------------------
 /** This method closes a file. If there is any data left in the buffer, it is written
- *  to the card. Then further writing to this file is prevented unless the file is
- *  opened again.
+ *  to the card. If the file was being written in streaming mode, the stream is 
+ *  stopped, and the file is cut down to the size of the data which was written. Then
+ *  further writing to this file is prevented unless the file is opened again.
  *  @return The result code from calling f_close() to close the file
  */
 
@@ -951,6 +998,18 @@ FRESULT sd_card::close_file (void)
 		return (FR_INT_ERR);
 	}
 
+	// A streamed file was allocated at its largest size; free the unused part
+	if (stream_state != SD_STREAM_OFF)
+	{
+		uint32_t bytes = stop_stream ();
+		FRESULT result = f_shrink (&the_file, bytes);
+		if (result != FR_OK)
+		{
+			GLOB_DEBUG (PMS ("close_file(): error ") << result 
+				<< PMS (" setting size") << endl);
+		}
+	}
+
 	// Any data left in the buffer is written now
 	if (line_buffer.num_items () > 0)
 	{
@@ -1040,3 +1099,240 @@ uint16_t sd_card::open_new_data_file (char const* base_name, char const* extensi
 	// If we get here, no file name was usable (there were 1000 files?!?!)
 	return (0xFFFF);
 }
+
+
+//--------------------------------------------------------------------------------------
+/** This method opens a new data file, named as by open_new_data_file(), for logging 
+ *  in streaming mode. A contiguous block of clusters big enough for the given number
+ *  of bytes is allocated to the file and saved to the card's FAT right away; then 
+ *  streaming mode is started at the file's first sector, so that data can be written
+ *  at full speed with no filesystem activity. The file must be closed with 
+ *  close_file(), which frees whatever space wasn't used. If the file gets full, 
+ *  putchar() returns false and further data is discarded. 
+ *  @param base_name The base name, including path, such as "/data/log_"
+ *  @param extension The 3-character file name extension, such as "txt" or "csv"
+ *  @param max_size The largest number of bytes which will be written to the file;
+ *                  it is rounded up to a whole number of sectors
+ *  @return The number used to make the new data file's name, or 0xFFFF for failure
+ */
+
+uint16_t sd_card::open_stream_file (char const* base_name, char const* extension,
+									uint32_t max_size)
+{
+	DWORD first_sector;						// First data sector of the new file
+
+	uint16_t number = open_new_data_file (base_name, extension);
+	if (number == 0xFFFF || dir_file_result != FR_OK)
+	{
+		return (0xFFFF);
+	}
+
+	// Allocate the space and write the FAT and directory entry to the card now, so 
+	// that the card won't be written to by the filesystem during the run. Streaming
+	// fills whole sectors, so the size is rounded up to a whole number of them
+	uint32_t num_sectors = (max_size + SD_BLOCK_SIZE - 1) / SD_BLOCK_SIZE;
+	max_size = num_sectors * SD_BLOCK_SIZE;
+	dir_file_result = f_expand (&the_file, max_size, &first_sector);
+	if (dir_file_result == FR_OK)
+	{
+		dir_file_result = f_sync (&the_file);
+	}
+	if (dir_file_result != FR_OK)
+	{
+		GLOB_DEBUG (PMS ("Can't allocate ") << max_size << PMS (" bytes, code ") 
+			<< dir_file_result << endl);
+		f_close (&the_file);
+		dir_file_result = FR_DENIED;
+		return (0xFFFF);
+	}
+
+	if (!start_stream (first_sector, num_sectors))
+	{
+		f_shrink (&the_file, 0L);
+		f_close (&the_file);
+		dir_file_result = FR_DISK_ERR;
+		return (0xFFFF);
+	}
+
+	return (number);
+}
+
+
+//-------------------------------------------------------------------------------------
+/** This method puts the card into streaming mode. It tells the card how many blocks
+ *  are coming, so that the card can erase them ahead of time, then starts a multiple
+ *  block write at the given sector. Data written with putchar() or "<<" from now on
+ *  goes into the stream buffers until stop_stream() is called. The filesystem must
+ *  not be used while streaming, as the card only accepts data blocks until the stream
+ *  has been stopped. 
+ *  @param first_sector The number of the first sector (LBA) to be written
+ *  @param num_sectors The number of sectors in the range which may be written
+ *  @return True if the card accepted the write command, false if not
+ */
+
+bool sd_card::start_stream (uint32_t first_sector, uint32_t num_sectors)
+{
+	if (Stat || stream_state == SD_STREAM_RUN || num_sectors == 0)
+	{
+		return (false);
+	}
+
+	// Convert the sector number to a byte address if the card needs one
+	if (!(CardType & CT_BLOCK))
+	{
+		first_sector *= SD_BLOCK_SIZE;
+	}
+
+	// Pre-erasing is only a hint to SD cards, so an error from it doesn't matter. The
+	// count is only 23 bits long
+	if (CardType & CT_SDC)
+	{
+		MM_send_cmd (ACMD23, (num_sectors > 0x007FFFFFUL) ? 0x007FFFFFUL : num_sectors);
+	}
+	if (MM_send_cmd (CMD25, first_sector) != 0)
+	{
+		MM_release_spi ();
+		GLOB_DEBUG (PMS ("Card refused multiple block write") << endl);
+		return (false);
+	}
+	MM_release_spi ();
+
+	stream_full[0] = false;
+	stream_full[1] = false;
+	stream_in = 0;
+	stream_out = 0;
+	stream_fill = 0;
+	stream_sent = 0;
+	stream_blocks_left = num_sectors;
+	stream_bytes = 0L;
+	stream_stalls = 0;
+	stream_state = SD_STREAM_RUN;
+
+	return (true);
+}
+
+
+//-------------------------------------------------------------------------------------
+/** This method sends data from a full stream buffer to the card. It never waits for 
+ *  the card: if the card is still busy programming the last block, it returns at once,
+ *  and otherwise it sends at most SD_STREAM_CHUNK bytes of the block. When the whole
+ *  block has been sent, the card's response is checked and the buffer is freed for
+ *  more data. This method should be called often while streaming, for example from a
+ *  task which runs every millisecond or so. 
+ *  @return True if there is still data waiting to be sent to the card, false if not
+ */
+
+bool sd_card::service_stream (void)
+{
+	if (stream_state != SD_STREAM_RUN || !stream_full[stream_out])
+	{
+		return (false);
+	}
+
+	uint8_t* p_block = stream_buffers[stream_out];
+
+	// At the start of a block, the card must have finished with the previous one; a
+	// busy card holds its data output low. Once the data token has been sent, the card
+	// stays selected until the whole block has been sent
+	if (stream_sent == 0)
+	{
+		SELECT ();
+		if (MM_rcvr_spi () != 0xFF)
+		{
+			MM_release_spi ();
+			return (true);
+		}
+		MM_xmit_spi (0xFC);					// Data token for multiple block write
+	}
+
+	uint16_t chunk_end = stream_sent + SD_STREAM_CHUNK;
+	if (chunk_end > SD_BLOCK_SIZE)
+	{
+		chunk_end = SD_BLOCK_SIZE;
+	}
+	while (stream_sent < chunk_end)
+	{
+		MM_xmit_spi (p_block[stream_sent++]);
+	}
+	if (stream_sent < SD_BLOCK_SIZE)
+	{
+		return (true);
+	}
+
+	// The whole block is out; send a dummy CRC and check that the card accepted it
+	MM_xmit_spi (0xFF);
+	MM_xmit_spi (0xFF);
+	uint8_t response = MM_rcvr_spi ();
+	MM_release_spi ();
+
+	stream_sent = 0;
+	if ((response & 0x1F) != 0x05)
+	{
+		GLOB_DEBUG (PMS ("Card rejected stream block, response ") << hex << response
+			<< dec << endl);
+		stream_state = SD_STREAM_ERROR;
+		return (false);
+	}
+
+	stream_full[stream_out] = false;
+	stream_out ^= 1;
+
+	return (stream_full[stream_out]);
+}
+
+
+//-------------------------------------------------------------------------------------
+/** This method ends streaming mode. Any data in the buffer being filled is padded with
+ *  zeros to make a whole block, all the full buffers are sent to the card, and the
+ *  stop token is sent to end the multiple block write. This method waits until the
+ *  card has finished, which may take several milliseconds. 
+ *  @return The number of bytes of data written during the stream, not counting the
+ *          padding at the end
+ */
+
+uint32_t sd_card::stop_stream (void)
+{
+	if (stream_state == SD_STREAM_OFF)
+	{
+		return (0L);
+	}
+
+	// Pad out the partly filled buffer and hand it over to be sent
+	if (stream_state == SD_STREAM_RUN && stream_fill > 0 && stream_blocks_left > 0)
+	{
+		memset (stream_buffers[stream_in] + stream_fill, 0, SD_BLOCK_SIZE - stream_fill);
+		stream_full[stream_in] = true;
+		stream_in ^= 1;
+		stream_fill = 0;
+		stream_blocks_left--;
+	}
+
+	// Send everything which is left, giving up if the card stays busy too long
+	while (stream_state == SD_STREAM_RUN && stream_full[stream_out])
+	{
+		if (stream_sent == 0)
+		{
+			SELECT ();
+			uint8_t ready = MM_wait_ready ();
+			MM_release_spi ();
+			if (ready != 0xFF)
+			{
+				stream_state = SD_STREAM_ERROR;
+				break;
+			}
+		}
+		service_stream ();
+	}
+
+	// The stop token ends the multiple block write; then wait for the card to finish
+	SELECT ();
+	MM_xmit_datablock (0, 0xFD);
+	MM_wait_ready ();
+	MM_release_spi ();
+
+	stream_full[0] = false;
+	stream_full[1] = false;
+	stream_state = SD_STREAM_OFF;
+
+	return (stream_bytes);
+}
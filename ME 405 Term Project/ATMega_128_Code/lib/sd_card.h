@@ -20,6 +20,10 @@
  *    \li 11-21-2009 JRR The DOSFS code is still buggy; trying ELM-FAT-FS version from
  *                       http://elm-chan.org/fsw/ff/00index_e.html
  *    \li 12-16-2009 JRR The ELM-FAT-FS version seems reasonably debugged and usable
+ *    \li 06-10-2011     Added streaming mode, which writes double buffered sectors to
+ *                       a range of the card with one multiple block write command
+ *    \li 06-11-2011     Added open_stream_file(), which pre-allocates a contiguous
+ *                       file to be written in streaming mode
  *
  *  License:
  *    This file is free software released under the Lesser GNU Public License, version
@@ -110,6 +114,26 @@ extern "C"
 #undef SD_SEND_NOW_CHAR
 
 
+/** This is the number of bytes of a block which service_stream() sends to the card in
+ *  one call when in streaming mode. Smaller numbers make each call quicker, so other
+ *  tasks are delayed less, but more calls are needed to keep up with the data. 
+ */
+
+#define SD_STREAM_CHUNK		128
+
+
+//-------------------------------------------------------------------------------------
+/** This enumeration lists the states of the SD card's streaming mode.
+ */
+
+enum sd_stream_state
+{
+	SD_STREAM_OFF,				///< Not streaming; data goes through the filesystem
+	SD_STREAM_RUN,				///< A multiple block write is in progress
+	SD_STREAM_ERROR				///< The card rejected a block; the stream has stopped
+};
+
+
 //-------------------------------------------------------------------------------------
 /** This definition enables the correct port pins for the SPI port. The MISO pin is set
  *  as an input; MOSI, SCK, and SS are outputs. Note that even though SS is often not
@@ -124,7 +148,8 @@ extern "C"
  *      version; the no-filesystem version might be usable on chips with RAM >= 1KB
  *  \li ATmega32, ATmega324(P), ATmega644(P): These work, but only very small programs
  *      can fit on the 32 and 324(P); chips such as the 644, with 4KB RAM, are best
- *  \li ATmega128: Not supported yet but should work well
+ *  \li ATmega128, ATmega1281, ATmega2561: Not supported yet but should work well;
+ *      these chips have their SPI pins in the same places on port B
  */
 
 #if (defined __AVR_AT90S2313__ || defined __AVR_ATmega8__ \
@@ -137,7 +162,8 @@ extern "C"
 	|| defined __AVR_ATmega32__ || defined __AVR_ATmega164P__)
 	#define MM_SETUP_PORT() DDRB &= ~0x40; DDRB |= 0xB0; PORTB |= 0x40
 #endif
-#if (defined __AVR_ATmega128__)
+#if (defined __AVR_ATmega128__ || defined __AVR_ATmega1281__ \
+	|| defined __AVR_ATmega2561__)
 	#warning "SPI pins for SD card not yet tested for this processor"
 	#define MM_SETUP_PORT() DDRB &= ~0x08; DDRB |= 0x07; PORTB |= 0x08
 #endif
@@ -282,6 +308,33 @@ typedef union
  *        saved to the file. If a file is not closed properly, some data may be left 
  *        in the memory buffer and not written to the disk. 
  *
+ *  \section sd_stream Streaming Mode
+ *    Writing data through the filesystem is slow for logging because every line is
+ *    written with a read-modify-write of a whole sector, and the processor waits while
+ *    the card programs its flash. For high rate logging, streaming mode writes data
+ *    to a range of consecutive sectors with a single multiple block write command 
+ *    (CMD25), with no filesystem activity. The range must already belong to a file 
+ *    whose clusters are contiguous, or be otherwise unused. 
+ *    \li Call start_stream() with the first sector and number of sectors in the range.
+ *    \li Write data with "<<" or putchar() as usual. Characters are put into one of two
+ *        sector sized buffers; when a buffer fills up, it is handed to the card and
+ *        the other buffer is filled. 
+ *    \li Call service_stream() often, such as from a task. Each call sends up to
+ *        SD_STREAM_CHUNK bytes of a full buffer to the card, or returns at once if the
+ *        card is still busy programming the previous block. Only when both buffers are
+ *        full does putchar() wait for the card. 
+ *    \li Call stop_stream() to write the last partial sector, padded with zeros, and 
+ *        end the multiple block write.
+ *    The easiest way to get a range of sectors is open_stream_file(), which makes a
+ *    new data file and allocates a contiguous block of clusters to it before the run
+ *    begins, so that no FAT updates are needed while logging. When close_file() is
+ *    called, the stream is stopped, the clusters which weren't used are freed, and 
+ *    the file's size is set to the number of bytes actually written. 
+ *
+ *    While streaming, the filesystem must not be used. The card stays selected while
+ *    a block is partly sent, so other devices on the SPI bus must not be used until
+ *    service_stream() returns false. 
+ *
  *  \section sd_tested Functions tested and working
  *  \li Opening an SD card formatted without a partition
  *  \li Automatically creating data files in the root directory and writing to them
@@ -325,8 +378,20 @@ typedef union
 class sd_card : public base_text_serial
 {
 	protected:
-		/// This buffer holds data which is to be saved into a block on the SD card.
-		uint8_t sector_buffer[SD_BLOCK_SIZE];
+		/// These buffers hold blocks of data for the card in streaming mode.
+		uint8_t stream_buffers[2][SD_BLOCK_SIZE];
+
+		/// These flags are true when a stream buffer is full and waiting to be sent
+		bool stream_full[2];
+
+		sd_stream_state stream_state;		///< Whether streaming mode is running
+		uint8_t stream_in;					///< Number of the buffer being filled
+		uint8_t stream_out;					///< Number of the buffer being sent
+		uint16_t stream_fill;				///< Bytes in the buffer being filled
+		uint16_t stream_sent;				///< Bytes of the block sent to the card
+		uint32_t stream_blocks_left;		///< Blocks in the range not yet filled
+		uint32_t stream_bytes;				///< Bytes of data written in this stream
+		uint16_t stream_stalls;				///< Times putchar() had to wait for card
 
 		/// This buffer holds one line of text to be written to the card.
 		queue<char,SD_L_BUF_IDX_T,SD_LINE_BUF_SIZE> line_buffer;
@@ -380,6 +445,30 @@ class sd_card : public base_text_serial
 
 		// Method to open a data file, automatically making a new name for it
 		uint16_t open_new_data_file (/* char*, */ char const*, char const*);
+
+		// Open a new data file with contiguous space and start streaming to it
+		uint16_t open_stream_file (char const*, char const*, uint32_t);
+
+		// Start a multiple block write to a range of sectors on the card
+		bool start_stream (uint32_t, uint32_t);
+
+		// Send part of a full stream buffer to the card if the card is ready
+		bool service_stream (void);
+
+		// Write the last partial sector and end the multiple block write
+		uint32_t stop_stream (void);
+
+		/** This method returns the state of streaming mode.
+		 *  @return SD_STREAM_OFF, SD_STREAM_RUN, or SD_STREAM_ERROR
+		 */
+		sd_stream_state get_stream_state (void) { return (stream_state); }
+
+		/** This method returns the number of times putchar() had to wait for the card
+		 *  because both stream buffers were full. If this isn't zero, service_stream()
+		 *  isn't being called often enough for the rate at which data is written.
+		 *  @return The number of stalls since start_stream() was called
+		 */
+		uint16_t get_stream_stalls (void) { return (stream_stalls); }
 };
 
 #endif // _SD_CARD_H_
@@ -0,0 +1,339 @@
+//*************************************************************************************
+/** \file spsc_queue.h
+ *    This file implements a circular buffer which can safely be used to pass data
+ *    from an interrupt service routine to the main loop or from the main loop to an
+ *    interrupt service routine without disabling interrupts. It is a variant of the
+ *    queue in queue.h for the case in which there is exactly one producer, which only
+ *    puts data in, and exactly one consumer, which only takes data out.
+ *
+ *  Usage:
+ *    The template parameters are the same as those of the queue in queue.h, except
+ *    that qSize must be a power of two and qIndexType must be an unsigned type which
+ *    the processor can read and write in one instruction. On an AVR that means
+ *    uint8_t, which allows sizes up to 128 items; any other index type is an error
+ *    when compiling for the AVR. On a PC, as in the simulator, wider indices may be
+ *    used. For example, a transmit buffer for a serial port could be declared as
+ *    "spsc_queue<char, uint8_t, 64> tx_buf".
+ *
+ *  Revisions:
+ *    \li 06-04-2011 Original file
+ *    \li 06-29-2011 Each side reads the other's index before touching the data, and
+ *                   the index type is checked on the AVR
+ *
+ *  License:
+ *    This file is released under the Lesser GNU public license, version 2. It is
+ *    intended for educational use only, but the user is free to use it for any
+ *    purpose permissible under the LGPL.
+ */
+//*************************************************************************************
+
+/// These defines prevent this file from being included more than once in a *.cc file
+#ifndef _SPSC_QUEUE_H_
+#define _SPSC_QUEUE_H_
+
+
+/** This macro keeps the compiler from moving memory accesses across it. It is used to
+ *  make sure that data is in the buffer before the index which publishes it to the
+ *  other side is written, and that data is read out before the index which frees its
+ *  space is written. It is also put after each side reads the other side's index, as
+ *  the compiler may otherwise move the data accesses, which aren't volatile, ahead of
+ *  that read; the consumer could then read a slot before it had seen that the slot
+ *  was filled. Only one processor core is involved, so no hardware memory barrier is
+ *  needed.
+ */
+#define SPSC_BARRIER()	__asm__ __volatile__ ("" ::: "memory")
+
+
+//-------------------------------------------------------------------------------------
+/** This class implements a single producer, single consumer circular buffer. Unlike
+ *  the queue in queue.h, there is no count of items which both sides modify. Instead
+ *  the producer alone writes the head index and the consumer alone writes the tail
+ *  index. Both indices run freely, wrapping only when the index type overflows, and
+ *  are masked to find a location in the buffer; the number of items in the buffer is
+ *  the difference between them. Because each side only reads the other side's index
+ *  and each index is written in a single instruction, neither side needs to disable
+ *  interrupts, so long as the producer methods are only called by the producer and
+ *  the consumer methods only by the consumer.
+ *
+ *  Besides single item put() and get(), there are bulk put_n() and get_n() methods,
+ *  and peek_span() and consume() methods which allow the consumer to work directly on
+ *  the data in the buffer (for example, to hand a block of bytes to a device driver)
+ *  without copying it. write_span() and commit() do the same for the producer.
+ */
+
+template <class qType, class qIndexType, qIndexType qSize>
+class spsc_queue
+{
+	protected:
+		/// This typedef causes a compiler error if the size isn't a power of two
+		typedef char size_must_be_power_of_two[((qSize & (qSize - 1)) == 0) ? 1 : -1];
+
+		#ifdef __AVR__
+			/// This typedef causes a compiler error if the AVR can't read or write an
+			/// index in a single instruction, as it can only do so with 8-bit numbers
+			typedef char index_must_be_one_byte[(sizeof (qIndexType) == 1) ? 1 : -1];
+		#endif
+
+		/// This mask turns a free-running index into a location in the buffer
+		static const qIndexType mask = qSize - 1;
+
+		qType buffer[qSize];				///< This memory buffer holds the contents
+		volatile qIndexType head;			///< Count of items put, written by producer
+		volatile qIndexType tail;			///< Count of items got, written by consumer
+
+	public:
+		spsc_queue (void);					// Constructor
+
+		// Producer side methods
+		bool put (qType);					// Adds one item into the queue
+		qIndexType put_n (const qType*, qIndexType);	// Adds several items
+		qIndexType write_span (qType**);	// Finds contiguous free space
+		void commit (qIndexType);			// Publishes items written into the space
+
+		// Consumer side methods
+		qType get (void);					// Gets an item from the queue
+		qIndexType get_n (qType*, qIndexType);			// Gets several items
+		qIndexType peek_span (qType**);		// Finds contiguous readable data
+		void consume (qIndexType);			// Frees items which have been read
+		void flush (void);					// Empty out the whole buffer
+
+		/** This method returns the number of items in the queue. It may be called
+		 *  from either side; the answer may be out of date by the time it's used, but
+		 *  only in the safe direction for the side which asked.
+		 *  @return The number of items in the queue
+		 */
+		qIndexType num_items (void) { return ((qIndexType)(head - tail)); }
+
+		/** This method returns the number of empty spaces in the queue.
+		 *  @return The number of items which could be put in the queue right now
+		 */
+		qIndexType num_free (void) { return ((qIndexType)(qSize - num_items ())); }
+
+		/** This method tells whether the queue is empty.
+		 *  @return True if the queue has no unread data, false if it has some
+		 */
+		bool is_empty (void) { return (head == tail); }
+
+		/** This method tells whether the queue is full.
+		 *  @return True if there's no room for another item, false otherwise
+		 */
+		bool is_full (void) { return (num_items () >= qSize); }
+};
+
+
+//-------------------------------------------------------------------------------------
+/** This constructor creates an empty queue. The memory is allocated statically by
+ *  the template mechanism at compile time.
+ */
+
+template <class qType, class qIndexType, qIndexType qSize>
+spsc_queue<qType, qIndexType, qSize>::spsc_queue (void)
+{
+	head = 0;
+	tail = 0;
+}
+
+
+//-------------------------------------------------------------------------------------
+/** This method adds an item into the queue. If the buffer is full then nothing is
+ *  written and true (meaning buffer is full) is returned, just as in queue::put().
+ *  This method must only be called by the producer.
+ *  @param data The data to be written into the queue
+ *  @return True if the buffer was full and data was not written, false otherwise
+ */
+
+template <class qType, class qIndexType, qIndexType qSize>
+bool spsc_queue<qType, qIndexType, qSize>::put (qType data)
+{
+	qIndexType i_put = head;
+
+	if ((qIndexType)(i_put - tail) >= qSize)
+	{
+		return (true);
+	}
+	SPSC_BARRIER ();
+
+	buffer[i_put & mask] = data;
+	SPSC_BARRIER ();
+	head = i_put + 1;
+
+	return (false);
+}
+
+
+//-------------------------------------------------------------------------------------
+/** This method adds as many of the given items into the queue as will fit. This
+ *  method must only be called by the producer.
+ *  @param p_data A pointer to the items to be written into the queue
+ *  @param count The number of items to be written
+ *  @return The number of items which were actually written
+ */
+
+template <class qType, class qIndexType, qIndexType qSize>
+qIndexType spsc_queue<qType, qIndexType, qSize>::put_n (const qType* p_data,
+	qIndexType count)
+{
+	qIndexType i_put = head;
+	qIndexType room = (qIndexType)(qSize - (qIndexType)(i_put - tail));
+
+	if (count > room)
+	{
+		count = room;
+	}
+	SPSC_BARRIER ();
+	for (qIndexType index = 0; index < count; index++)
+	{
+		buffer[(i_put + index) & mask] = *p_data++;
+	}
+	SPSC_BARRIER ();
+	head = i_put + count;
+
+	return (count);
+}
+
+
+//-------------------------------------------------------------------------------------
+/** This method finds the largest block of contiguous free space in the buffer at the
+ *  location where the next item will be put. The producer may write items directly
+ *  into this space, then call commit() to make them visible to the consumer. This
+ *  method must only be called by the producer.
+ *  @param p_p_start A pointer to a pointer which will be set to the start of space
+ *  @return The number of items which can be written at that location
+ */
+
+template <class qType, class qIndexType, qIndexType qSize>
+qIndexType spsc_queue<qType, qIndexType, qSize>::write_span (qType** p_p_start)
+{
+	qIndexType i_put = head;
+	qIndexType room = (qIndexType)(qSize - (qIndexType)(i_put - tail));
+	qIndexType to_end = (qIndexType)(qSize - (i_put & mask));
+
+	SPSC_BARRIER ();
+	*p_p_start = &buffer[i_put & mask];
+	return ((room < to_end) ? room : to_end);
+}
+
+
+//-------------------------------------------------------------------------------------
+/** This method publishes items which the producer has written into the space found
+ *  by write_span(). This method must only be called by the producer.
+ *  @param count The number of items which were written; it must not be more than the
+ *               number returned by write_span()
+ */
+
+template <class qType, class qIndexType, qIndexType qSize>
+void spsc_queue<qType, qIndexType, qSize>::commit (qIndexType count)
+{
+	SPSC_BARRIER ();
+	head = head + count;
+}
+
+
+//-------------------------------------------------------------------------------------
+/** This method returns the oldest item in the queue. As with queue::get(), if the
+ *  queue was empty, the returned data is stale and the queue isn't changed, so
+ *  somebody should have checked if there was new data using is_empty(). This method
+ *  must only be called by the consumer.
+ *  @return The data which is pulled out from the queue at the current location
+ */
+
+template <class qType, class qIndexType, qIndexType qSize>
+qType spsc_queue<qType, qIndexType, qSize>::get (void)
+{
+	qIndexType i_get = tail;
+	qIndexType i_put = head;
+	SPSC_BARRIER ();
+	qType whatIgot = buffer[i_get & mask];
+
+	if (i_get != i_put)
+	{
+		SPSC_BARRIER ();
+		tail = i_get + 1;
+	}
+
+	return (whatIgot);
+}
+
+
+//-------------------------------------------------------------------------------------
+/** This method gets up to the given number of items from the queue. This method must
+ *  only be called by the consumer.
+ *  @param p_data A pointer to a place where the items will be copied
+ *  @param count The largest number of items to be gotten
+ *  @return The number of items which were actually gotten
+ */
+
+template <class qType, class qIndexType, qIndexType qSize>
+qIndexType spsc_queue<qType, qIndexType, qSize>::get_n (qType* p_data,
+	qIndexType count)
+{
+	qIndexType i_get = tail;
+	qIndexType avail = (qIndexType)(head - i_get);
+
+	if (count > avail)
+	{
+		count = avail;
+	}
+	SPSC_BARRIER ();
+	for (qIndexType index = 0; index < count; index++)
+	{
+		*p_data++ = buffer[(i_get + index) & mask];
+	}
+	SPSC_BARRIER ();
+	tail = i_get + count;
+
+	return (count);
+}
+
+
+//-------------------------------------------------------------------------------------
+/** This method finds the largest block of contiguous unread data in the buffer,
+ *  starting with the oldest item. The data isn't removed from the queue until
+ *  consume() is called. If the data wraps around the end of the buffer, only the
+ *  part up to the end is returned; after it is consumed, another call will find the
+ *  rest. This method must only be called by the consumer.
+ *  @param p_p_start A pointer to a pointer which will be set to the oldest item
+ *  @return The number of items which can be read at that location
+ */
+
+template <class qType, class qIndexType, qIndexType qSize>
+qIndexType spsc_queue<qType, qIndexType, qSize>::peek_span (qType** p_p_start)
+{
+	qIndexType i_get = tail;
+	qIndexType avail = (qIndexType)(head - i_get);
+	qIndexType to_end = (qIndexType)(qSize - (i_get & mask));
+
+	SPSC_BARRIER ();
+	*p_p_start = &buffer[i_get & mask];
+	return ((avail < to_end) ? avail : to_end);
+}
+
+
+//-------------------------------------------------------------------------------------
+/** This method removes items which the consumer has finished with from the queue,
+ *  making room for the producer to put more. This method must only be called by the
+ *  consumer.
+ *  @param count The number of items to remove; it must not be more than the number
+ *               of items in the queue
+ */
+
+template <class qType, class qIndexType, qIndexType qSize>
+void spsc_queue<qType, qIndexType, qSize>::consume (qIndexType count)
+{
+	SPSC_BARRIER ();
+	tail = tail + count;
+}
+
+
+//-------------------------------------------------------------------------------------
+/** This method empties the buffer by discarding everything which hasn't been read.
+ *  Since it moves the tail index, it must only be called by the consumer.
+ */
+
+template <class qType, class qIndexType, qIndexType qSize>
+void spsc_queue<qType, qIndexType, qSize>::flush (void)
+{
+	tail = head;
+}
+
+#endif // _SPSC_QUEUE_H_
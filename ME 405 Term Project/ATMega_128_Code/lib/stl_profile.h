@@ -0,0 +1,126 @@
+//*************************************************************************************
+/** \file stl_profile.h
+ *    This file defines the records kept by the task profiler which is compiled into
+ *    stl_task when STL_PROFILE is defined, and the binary block in which
+ *    task_scheduler::write_profile() sends them. It uses only standard C types so that
+ *    it can be included both by the AVR program and by the report program which runs
+ *    on a PC (see tools/profile_report.cpp).
+ *
+ *    Times are counted in raw ticks of the task timer's 16-bit hardware counter, which
+ *    runs at F_CPU / 8. Execution times and jitter are put into histograms with one bin
+ *    for each power of two: bin 0 counts times of 0 or 1 tick, and bin n counts times
+ *    from 2^n up to 2^(n+1) - 1 ticks. When a bin is about to overflow, every bin of
+ *    both of the task's histograms is halved, so the shape is kept, and the number of
+ *    halvings is counted.
+ *
+ *  Block format:
+ *    The block is a stl_prof_header, one stl_prof_rec for each task, and a 16-bit CRC
+ *    of everything before it, computed as for telemetry frames (see
+ *    telemetry_records.h) and sent low byte first. It isn't encoded in any way, so it
+ *    can be written to an SD card file or a serial port as it is; the report program
+ *    finds it in a stream of other text by its header. All multi-byte numbers are
+ *    little endian, which is the native byte order of both the AVR and PC processors.
+ *
+ *  Revisions:
+ *    \li 06-25-2011 Original file
+ *
+ *  License:
+ *    This file is released under the Lesser GNU Public License, version 2. This
+ *    program is intended for educational use only, but it is not limited thereto.
+ */
+//*************************************************************************************
+
+/// This define prevents this .h file from being included more than once in a .cc file
+#ifndef _STL_PROFILE_H_
+#define _STL_PROFILE_H_
+
+#include <stdint.h>
+
+
+/// This macro packs a structure so that it has the same layout on the AVR and the PC
+#define STL_PROF_PACKED __attribute__ ((packed))
+
+/// This is the number of bins in each histogram, one for each bit of a 16-bit count
+#define STL_PROF_BINS		16
+
+/// These are the first bytes of a profile block, which the report program looks for
+#define STL_PROF_MAGIC_0	'P'
+#define STL_PROF_MAGIC_1	'f'
+
+/// This is the version of the block layout, which changes if the records change
+#define STL_PROF_VERSION	1
+
+
+//-------------------------------------------------------------------------------------
+/** This structure is the start of a profile block.
+ */
+
+typedef struct
+{
+	uint8_t magic[2];				///< STL_PROF_MAGIC_0 and STL_PROF_MAGIC_1
+	uint8_t version;				///< STL_PROF_VERSION
+	uint8_t tasks;					///< Number of task records which follow
+	uint32_t ticks_per_sec;			///< Number of timer ticks per second
+} STL_PROF_PACKED stl_prof_header;
+
+
+//-------------------------------------------------------------------------------------
+/** This structure holds the profile of one task. The run time is measured from just
+ *  before the task's run() method is called to just after it returns. The jitter is
+ *  how much the time from one periodic release of the task to the next differs from
+ *  the task's interval; runs caused by run_again_ASAP() aren't periodic releases. An
+ *  overrun is a run which took longer than the task's interval.
+ */
+
+typedef struct
+{
+	uint8_t task;					///< The task's serial number
+	uint8_t halvings;				///< Times the histograms have been halved
+	uint16_t interval;				///< The task's interval in ticks, at most 65535
+	uint32_t runs;					///< Number of runs which were measured
+	uint32_t run_sum;				///< Sum of the run times, for finding the average
+	uint16_t min_run;				///< Shortest run time
+	uint16_t max_run;				///< Longest run time
+	uint16_t max_jitter;			///< Largest jitter
+	uint16_t overruns;				///< Runs which took longer than the interval
+	uint16_t run_hist[STL_PROF_BINS];		///< Histogram of run times
+	uint16_t jitter_hist[STL_PROF_BINS];	///< Histogram of jitter
+} STL_PROF_PACKED stl_prof_rec;
+
+
+//-------------------------------------------------------------------------------------
+/** This function finds the histogram bin for a time, which is the number of the
+ *  highest bit which is set in it. A few tests and shifts are used rather than a loop,
+ *  so the time taken is short and about the same for any count.
+ *  @param ticks The time, in timer ticks
+ *  @return The bin, from 0 to STL_PROF_BINS - 1
+ */
+
+static inline uint8_t stl_prof_bin (uint16_t ticks)
+{
+	uint8_t bin = 0;
+	uint8_t bits = (uint8_t)ticks;
+
+	if (ticks & 0xFF00)
+	{
+		bin = 8;
+		bits = (uint8_t)(ticks >> 8);
+	}
+	if (bits & 0xF0)
+	{
+		bin += 4;
+		bits >>= 4;
+	}
+	if (bits & 0x0C)
+	{
+		bin += 2;
+		bits >>= 2;
+	}
+	if (bits & 0x02)
+	{
+		bin += 1;
+	}
+	return (bin);
+}
+
+#endif // _STL_PROFILE_H_
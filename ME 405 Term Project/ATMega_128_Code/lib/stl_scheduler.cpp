@@ -0,0 +1,388 @@
+//*************************************************************************************
+/** \file stl_scheduler.cpp
+ *    This file contains a scheduler class which runs a set of stl_task objects in
+ *    order of urgency. Each task is registered with a priority and a relative
+ *    deadline, and each call to dispatch() runs the most urgent task which is ready.
+ *
+ *  Revisions
+ *    \li 06-01-2011 Original file, to replace the hand-ordered schedule() calls
+ *                   in the main loop
+ *    \li 06-02-2011 Added tickless idle mode and idle time statistics
+ *    \li 06-25-2011 Task profiles can be written as one binary block
+ *    \li 06-27-2011 Statistics are kept in 64-bit tick counts, so they stay right
+ *                   in runs longer than a time stamp can measure
+ *
+ *  License:
+ *    This file released under the Lesser GNU Public License, version 2. This program
+ *    is intended for educational use only, but it is not limited thereto.
+ */
+//*************************************************************************************
+
+#include <stdlib.h>
+#include <avr/io.h>
+#include <avr/interrupt.h>
+#include <avr/sleep.h>						// For putting the processor to sleep
+#include "base_text_serial.h"				// Base class for various serial devices
+#include "global_debug.h"					// Class for serial port debugging
+#include "stl_timer.h"						// Timer measures real time
+#include "stl_task.h"						// The state transition logic header
+#include "stl_scheduler.h"					// Header for this file
+#ifdef STL_PROFILE
+	#include "telemetry_records.h"			// For the CRC which protects profiles
+#endif
+
+
+//--------------------------------------------------------------------------------------
+/** This function finds the time at which a ready task was released. A task which is
+ *  waiting was released at its next run time; a task which called run_again_ASAP() is
+ *  treated as if it had been released just now.
+ *  @param p_task A pointer to the task whose release time is needed
+ *  @param time_now The current time, as measured by the task timer
+ *  @return The time at which the task became ready to run
+ */
+
+static time_stamp release_time (stl_task* p_task, const time_stamp& time_now)
+{
+	if (p_task->get_op_state () == TASK_PENDING)
+	{
+		return (time_now);
+	}
+	return (p_task->get_next_run_time ());
+}
+
+
+//--------------------------------------------------------------------------------------
+/** This constructor creates a scheduler with no tasks in it.
+ *  @param a_timer A reference to the timer which measures real time
+ *  @param a_policy The rule used to choose between ready tasks (default SCHED_EDF)
+ */
+
+task_scheduler::task_scheduler (task_timer& a_timer, sched_policy a_policy)
+	: the_timer (a_timer), policy (a_policy)
+{
+	num_tasks = 0;
+	tickless = false;
+	sleep_ticks = 0L;
+
+	// Idle sleep stops only the CPU clock, so the timers, serial ports, and SPI port
+	// keep running and any of their interrupts can wake the processor up
+	set_sleep_mode (SLEEP_MODE_IDLE);
+}
+
+
+//--------------------------------------------------------------------------------------
+/** This method registers a task with the scheduler. The task will from now on be run
+ *  by dispatch(), so its schedule() method should not also be called elsewhere.
+ *  @param p_task A pointer to the task to be scheduled
+ *  @param priority The task's priority; larger numbers are more important. Priority
+ *                  is used to break ties between tasks which are equally urgent
+ *  @param deadline The time after its release by which each run of the task should
+ *                  be finished; this is usually the same as the task's interval
+ *  @return True if the task was added, false if the task table is full
+ */
+
+bool task_scheduler::add_task (stl_task* p_task, uint8_t priority,
+							   const time_stamp& deadline)
+{
+	if (num_tasks >= STL_SCHED_MAX_TASKS)
+	{
+		GLOB_DEBUG (PMS ("Scheduler full, can't add task ")
+			<< p_task->get_serial_number () << endl);
+		return (false);
+	}
+
+	entries[num_tasks].p_task = p_task;
+	entries[num_tasks].priority = priority;
+	entries[num_tasks].deadline = deadline;
+	num_tasks++;
+
+	clear_stats ();
+	return (true);
+}
+
+
+//--------------------------------------------------------------------------------------
+/** This method chooses the most urgent of the tasks which are ready to run and runs
+ *  it by calling its schedule() method. It should be called from the main loop as
+ *  often as possible. The time from each task's release to the start of its run is
+ *  recorded, and if the run finishes after the task's absolute deadline, a deadline
+ *  miss is counted.
+ *  @return True if a task was run, false if no task was ready
+ */
+
+bool task_scheduler::dispatch (void)
+{
+	time_stamp time_now = the_timer.get_time_now ();
+	uint8_t best = STL_SCHED_MAX_TASKS;		// Index of the most urgent ready task
+	time_stamp best_key;					// Urgency of that task; earlier is more
+	time_stamp key;							// Urgency of the task being checked
+
+	for (uint8_t index = 0; index < num_tasks; index++)
+	{
+		stl_task* p_task = entries[index].p_task;
+		if (!p_task->is_due (time_now))
+		{
+			continue;
+		}
+
+		// Under EDF the key is the absolute deadline; under rate monotonic
+		// scheduling it's the interval, as shorter intervals have higher priority
+		if (policy == SCHED_EDF)
+		{
+			key = release_time (p_task, time_now) + entries[index].deadline;
+		}
+		else
+		{
+			key = p_task->get_interval ();
+		}
+
+		if (best == STL_SCHED_MAX_TASKS || key < best_key
+			|| (key == best_key && entries[index].priority > entries[best].priority))
+		{
+			best = index;
+			best_key = key;
+		}
+	}
+
+	// If nothing is ready, there's nothing to do
+	if (best == STL_SCHED_MAX_TASKS)
+	{
+		return (false);
+	}
+
+	// Record how late the task is starting, then run it and check its deadline
+	sched_entry& entry = entries[best];
+	time_stamp release = release_time (entry.p_task, time_now);
+	time_stamp lateness = time_now - release;
+	if (lateness > entry.max_late)
+	{
+		entry.max_late = lateness;
+	}
+	entry.late_sum += lateness.get_raw_time ();
+
+	entry.p_task->schedule ();
+	entry.runs++;
+
+	time_stamp finished = the_timer.get_time_now () - release;
+	if (finished > entry.deadline)
+	{
+		entry.misses++;
+	}
+
+	return (true);
+}
+
+
+//--------------------------------------------------------------------------------------
+/** This method puts the processor to sleep until the next time at which one of the
+ *  tasks is due to run, if tickless mode is on and no task is ready right now. The
+ *  check for ready tasks and the arming of the wake-up alarm are done with interrupts
+ *  disabled; interrupts are re-enabled by the instruction just before the one which
+ *  puts the processor to sleep, which guarantees that an interrupt arriving in the 
+ *  meantime will wake the processor rather than being missed. 
+ *  @return True if the processor slept, false if it didn't
+ */
+
+bool task_scheduler::idle (void)
+{
+	time_stamp time_now;					// The time when we checked the tasks
+	time_stamp wake_time;					// Earliest time at which a task is due
+	bool have_wake_time = false;			// True if any task is waiting to run
+
+	if (!tickless)
+	{
+		return (false);
+	}
+
+	cli ();
+	time_now = the_timer.get_time_now ();
+	for (uint8_t index = 0; index < num_tasks; index++)
+	{
+		stl_task* p_task = entries[index].p_task;
+		if (p_task->is_due (time_now))
+		{
+			sei ();
+			return (false);
+		}
+		time_stamp next_time = p_task->get_next_run_time ();
+		if (p_task->get_op_state () == TASK_WAITING
+			&& (!have_wake_time || next_time < wake_time))
+		{
+			wake_time = next_time;
+			have_wake_time = true;
+		}
+	}
+
+	// Arm the alarm, then make sure the wake-up time didn't pass while doing so. If
+	// no task is waiting, the timer overflow interrupt will wake us up soon enough
+	if (have_wake_time)
+	{
+		the_timer.set_wake_up (wake_time);
+		if (!(wake_time > the_timer.get_time_now ()))
+		{
+			sei ();
+			return (false);
+		}
+	}
+
+	sleep_enable ();
+	sei ();
+	sleep_cpu ();
+	sleep_disable ();
+
+	sleep_ticks += (the_timer.get_time_now () - time_now).get_raw_time ();
+
+	return (true);
+}
+
+
+//--------------------------------------------------------------------------------------
+/** This method clears the run counts, deadline miss counts, lateness records, and 
+ *  idle time records for all the tasks in the scheduler. If the tasks are being 
+ *  profiled, their profiles are cleared too.
+ */
+
+void task_scheduler::clear_stats (void)
+{
+	for (uint8_t index = 0; index < num_tasks; index++)
+	{
+		entries[index].misses = 0;
+		entries[index].runs = 0L;
+		entries[index].max_late.set_time (0L);
+		entries[index].late_sum = 0L;
+		#ifdef STL_PROFILE
+			entries[index].p_task->clear_profiler ();
+		#endif
+	}
+	sleep_ticks = 0L;
+	stats_start = the_timer.get_ticks ();
+}
+
+
+//--------------------------------------------------------------------------------------
+/** This function divides one 64-bit count by another, as 32-bit numbers. Both counts
+ *  are shifted right until they fit in 32 bits, which keeps 64-bit division and its
+ *  library code out of the program. The quotient loses a little precision, which 
+ *  doesn't matter for averages and percentages. 
+ *  @param dividend The number to be divided
+ *  @param divisor The number by which to divide, which must not be zero
+ *  @return The quotient, or 0xFFFFFFFF if it's too large to find this way
+ */
+
+static uint32_t scaled_divide (uint64_t dividend, uint64_t divisor)
+{
+	while (dividend > 0xFFFFFFFFULL || divisor > 0xFFFFFFFFULL)
+	{
+		dividend >>= 1;
+		divisor >>= 1;
+	}
+	if (divisor == 0)
+	{
+		return (0xFFFFFFFFUL);
+	}
+	return ((uint32_t)dividend / (uint32_t)divisor);
+}
+
+
+//--------------------------------------------------------------------------------------
+/** This method computes the fraction of time which the processor has spent asleep in
+ *  idle() since the statistics were last cleared. The times are measured with the 
+ *  timer's whole tick count, so the percentage is right however long ago that was. 
+ *  @return The idle time as a percentage of the elapsed time
+ */
+
+uint8_t task_scheduler::get_idle_percent (void)
+{
+	uint64_t elapsed = the_timer.get_ticks () - stats_start;
+
+	if (elapsed < 100L)
+	{
+		return (0);
+	}
+	return ((uint8_t)scaled_divide (sleep_ticks * 100L, elapsed));
+}
+
+
+#ifdef STL_PROFILE
+//-------------------------------------------------------------------------------------
+/** This function writes some bytes to a serial device without changing them, and adds
+ *  them to a CRC.
+ *  @param serial A reference to the serial-type object to which to write
+ *  @param p_data A pointer to the bytes
+ *  @param size The number of bytes
+ *  @param crc The CRC of the bytes written before these
+ *  @return The CRC including these bytes
+ */
+
+static uint16_t write_bytes (base_text_serial& serial, const void* p_data, uint8_t size,
+							 uint16_t crc)
+{
+	for (uint8_t index = 0; index < size; index++)
+	{
+		uint8_t data = ((const uint8_t*)p_data)[index];
+		serial.putchar ((char)data);
+		crc = tlm_crc16_update (crc, data);
+	}
+	return (crc);
+}
+
+
+//-------------------------------------------------------------------------------------
+/** This method writes the profiles of all the tasks as one binary block, laid out as
+ *  described in stl_profile.h, which tools/profile_report.cpp turns into a report. The
+ *  block can be written to a serial port or to a file on an SD card. No tasks run
+ *  while it's being written, so the profiles in it are all from the same moment.
+ *  @param serial A reference to the serial-type object to which to write
+ */
+
+void task_scheduler::write_profile (base_text_serial& serial)
+{
+	stl_prof_header header;
+	header.magic[0] = STL_PROF_MAGIC_0;
+	header.magic[1] = STL_PROF_MAGIC_1;
+	header.version = STL_PROF_VERSION;
+	header.tasks = num_tasks;
+	header.ticks_per_sec = F_CPU / 8UL;
+
+	uint16_t crc = write_bytes (serial, &header, sizeof (header), 0xFFFF);
+	for (uint8_t index = 0; index < num_tasks; index++)
+	{
+		crc = write_bytes (serial, &(entries[index].p_task->get_profile ()),
+						   sizeof (stl_prof_rec), crc);
+	}
+	serial.putchar ((char)(crc & 0xFF));
+	serial.putchar ((char)(crc >> 8));
+}
+
+#endif  // STL_PROFILE
+
+
+//-------------------------------------------------------------------------------------
+/** This overloaded shift operator writes the scheduler's statistics to a serial
+ *  device, one line per task, showing the number of runs, the number of deadline
+ *  misses, and the longest and average times from a task's release to the start of
+ *  its run (for a task woken from idle sleep, this is its wake-up latency). A last
+ *  line shows the percentage of time spent asleep.
+ *  @param serial A reference to the serial-type object to which to print
+ *  @param sched A reference to the scheduler whose information is to be displayed
+ */
+
+base_text_serial& operator<< (base_text_serial& serial, task_scheduler& sched)
+{
+	for (uint8_t index = 0; index < sched.get_num_tasks (); index++)
+	{
+		sched_entry& entry = sched.get_entry (index);
+		serial << PMS ("Task: ") << entry.p_task->get_serial_number ()
+			<< PMS (" runs: ") << entry.runs << PMS (" misses: ") << entry.misses
+			<< PMS (" max late: ") << entry.max_late;
+		if (entry.runs > 0L)
+		{
+			time_stamp avg_late (scaled_divide (entry.late_sum, entry.runs));
+			serial << PMS (" avg late: ") << avg_late;
+		}
+		serial << endl;
+	}
+	serial << PMS ("Idle: ") << sched.get_idle_percent () << PMS ("%") << endl;
+
+	return (serial);
+}
@@ -0,0 +1,170 @@
+//*************************************************************************************
+/** \file stl_scheduler.h
+ *  This file contains a scheduler class which runs a set of stl_task objects in order
+ *  of urgency rather than in the fixed order in which a main loop happens to call
+ *  their schedule() methods. Each task is registered with a priority and a relative
+ *  deadline; whenever the scheduler is asked to dispatch, it runs the single most
+ *  urgent task which is ready, chosen by earliest deadline first or rate monotonic
+ *  selection. Deadline misses and release lateness are recorded for each task.
+ *  In tickless mode the scheduler can also put the processor to sleep until the
+ *  next task is due. 
+ *
+ *  Revisions
+ *    \li 06-01-2011 Original file, to replace the hand-ordered schedule() calls
+ *                   in the main loop
+ *    \li 06-02-2011 Added tickless idle mode and idle time statistics
+ *    \li 06-25-2011 Task profiles can be written as one binary block
+ *    \li 06-27-2011 Statistics are kept in 64-bit tick counts, so they stay right
+ *                   in runs longer than a time stamp can measure
+ *
+ *  License:
+ *    This file released under the Lesser GNU Public License, version 2. This program
+ *    is intended for educational use only, but it is not limited thereto.
+ */
+//*************************************************************************************
+
+/// This define prevents this .h file from being included more than once in a .cc file
+#ifndef _STL_SCHEDULER_H_
+#define _STL_SCHEDULER_H_
+
+#include "stl_timer.h"						// Include the header for the task timer
+#include "stl_task.h"						// Header for the tasks being scheduled
+
+
+/** This is the largest number of tasks which can be registered with one scheduler.
+ *  The task table is a fixed array so that no dynamic memory is used; each entry
+ *  costs about 20 bytes of SRAM.
+ */
+#ifndef STL_SCHED_MAX_TASKS
+	#define STL_SCHED_MAX_TASKS		8
+#endif
+
+
+//--------------------------------------------------------------------------------------
+/** This enumeration lists the ways in which the scheduler can choose which of several
+ *  ready tasks to run first.
+ */
+
+enum sched_policy
+{
+	SCHED_EDF,				///< Earliest absolute deadline runs first
+	SCHED_RATE_MONOTONIC	///< Shortest run interval runs first
+};
+
+
+//--------------------------------------------------------------------------------------
+/** This structure holds the scheduler's bookkeeping for one registered task.
+ */
+
+typedef struct
+{
+	stl_task* p_task;						///< Pointer to the task being scheduled
+	uint8_t priority;						///< Larger numbers are more important
+	time_stamp deadline;					///< Deadline relative to release time
+	uint16_t misses;						///< Number of runs which missed deadline
+	uint32_t runs;							///< Number of runs dispatched
+	time_stamp max_late;					///< Longest delay from release to start
+	uint64_t late_sum;						///< Sum of delays, for finding average
+} sched_entry;
+
+
+//--------------------------------------------------------------------------------------
+/** This class runs a group of stl_task objects according to their urgency. Tasks are
+ *  registered with add_task() and are then run by calling dispatch() from the main
+ *  loop as often as possible, in place of calling each task's schedule() directly.
+ *  Each call to dispatch() runs at most one task, the most urgent of those which are
+ *  ready at that time, so that code which isn't a task (such as user interface
+ *  polling) can be interleaved between dispatches without delaying the tasks by more
+ *  than one run.
+ *
+ *  A task is ready when it has called run_again_ASAP() or when its next run time has
+ *  arrived. A task's release time is the run time at which it became ready, and its
+ *  absolute deadline is its release time plus the relative deadline given when it was
+ *  registered. If the task finishes its run later than that, a deadline miss is
+ *  counted for it. Under SCHED_EDF the ready task with the earliest absolute deadline
+ *  runs; under SCHED_RATE_MONOTONIC the ready task with the shortest run interval
+ *  runs. In either case ties are broken by priority, then by order of registration.
+ *
+ *  In tickless mode, idle() finds the earliest time at which any task will next be
+ *  due, arms the task timer's wake-up alarm for that time, and puts the processor
+ *  into idle sleep. The processor wakes up when the alarm goes off or when any other
+ *  interrupt (serial port, SPI, pin change, timer overflow) occurs. The main loop
+ *  must only call idle() when the code outside the scheduler has nothing to do, as 
+ *  that code won't run again until something wakes the processor. 
+ */
+
+class task_scheduler
+{
+	protected:
+		/// This is a reference to the timer which measures real time
+		task_timer& the_timer;
+
+		/// This is the rule used to choose between several ready tasks
+		sched_policy policy;
+
+		/// This is the table holding all the registered tasks' information
+		sched_entry entries[STL_SCHED_MAX_TASKS];
+
+		/// This is the number of tasks which have been registered
+		uint8_t num_tasks;
+
+		/// This flag is true if idle() is allowed to put the processor to sleep
+		bool tickless;
+
+		/// This is the total number of timer ticks spent asleep in idle()
+		uint64_t sleep_ticks;
+
+		/// This is the timer's tick count when the statistics were last cleared
+		uint64_t stats_start;
+
+	public:
+		// The constructor makes an empty scheduler which uses the given policy
+		task_scheduler (task_timer&, sched_policy = SCHED_EDF);
+
+		// This method registers a task with its priority and relative deadline
+		bool add_task (stl_task*, uint8_t, const time_stamp&);
+
+		// This method runs the most urgent ready task, if there is one
+		bool dispatch (void);
+
+		// This method sleeps until the next task is due, if in tickless mode
+		bool idle (void);
+
+		// This method clears the run and deadline miss counters for all tasks
+		void clear_stats (void);
+
+		// This method returns the percentage of time spent asleep since clear_stats()
+		uint8_t get_idle_percent (void);
+
+		#ifdef STL_PROFILE
+			// This method writes all the tasks' profiles as one binary block
+			void write_profile (base_text_serial&);
+		#endif
+
+		/** This method turns tickless idle mode on or off. When it's off, idle() 
+		 *  returns immediately and the processor never sleeps.
+		 *  @param on_or_off True to allow the processor to sleep in idle()
+		 */
+		void set_tickless (bool on_or_off) { tickless = on_or_off; }
+
+		/** This method changes the policy used to choose which ready task runs first.
+		 *  @param new_policy The new scheduling policy
+		 */
+		void set_policy (sched_policy new_policy) { policy = new_policy; }
+
+		/** This method returns the number of tasks which have been registered.
+		 *  @return The number of tasks in the scheduler's table
+		 */
+		uint8_t get_num_tasks (void) { return (num_tasks); }
+
+		/** This method returns the scheduler's table entry for the given task.
+		 *  @param index The task's index, in the order in which tasks were added
+		 *  @return A reference to the task's scheduler table entry
+		 */
+		sched_entry& get_entry (uint8_t index) { return (entries[index]); }
+};
+
+// This overloaded operator prints the scheduler's statistics to a serial device
+base_text_serial& operator<< (base_text_serial&, task_scheduler&);
+
+#endif // _STL_SCHEDULER_H_
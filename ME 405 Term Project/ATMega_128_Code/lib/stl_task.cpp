@@ -13,6 +13,13 @@
  *    \li 06-03-2008 JRR Cleaned up comments, got rid of Doxygen warnings
  *    \li 12-19-2009 JRR Integrated simple execution time profiling into file, changed
  *                       from *.cc to *.cpp, and set up for global serial debugging
+ *    \li 06-25-2011     The profiler reads the timer's hardware counter directly and
+ *                       keeps histograms of run time and jitter, and overrun counts
+ *    \li 06-26-2011     Tracing records transitions in a RAM ring instead of printing
+ *                       them, and error_stop() dumps the ring
+ *    \li 06-27-2011     A suspended task keeps the time left until its next run, so
+ *                       it can be suspended for longer than time stamps can compare
+ *    \li 06-28-2011     schedule() reads the timer once, not twice, for a waiting task
  *
  *  License:
  *    This file released under the Lesser GNU Public License, version 2. This program
@@ -21,6 +28,7 @@
 //*************************************************************************************
 
 #include <stdlib.h>
+#include <string.h>							// For clearing the profile
 #include <avr/io.h>
 #include <avr/interrupt.h>
 #include "base_text_serial.h"				// Base class for various serial devices
@@ -72,17 +80,27 @@ stl_task::stl_task (task_timer& a_timer, const time_stamp& time_interval)
 		// Clear the profile data arrays
 		clear_profiler ();
 	#endif
+
+	#ifdef STL_TRACE
+		trace_payload = 0;
+	#endif
 }
 
 
 //--------------------------------------------------------------------------------------
-/** This method sets or changes the time interval between runs of this task. 
+/** This method sets or changes the time interval between runs of this task. If the
+ *  task is being profiled, the profile is cleared. 
  *  @param time_interval The time between runs of the task's run() method
  */
 
 void stl_task::set_interval (const time_stamp& time_interval)
 {
 	interval = time_interval;
+
+	#ifdef STL_PROFILE
+		// Jitter and overruns measured with the old interval would be meaningless
+		clear_profiler ();
+	#endif
 }
 
 
@@ -129,8 +147,9 @@ task_op_state stl_task::schedule (time_stamp* til_next_time)
 			// Find out what the current real time is from the system timer
 			the_time = the_timer.get_time_now ();
 
-			// If it's not time to run the task yet, exit without running it
-			if (next_run_time > the_timer.get_time_now ())
+			// If it's not time to run the task yet, exit without running it. The
+			// comparison is modular, so it's right when the time stamps wrap around
+			if (next_run_time > the_time)
 			{
 				if (til_next_time != NULL)
 				{
@@ -142,13 +161,14 @@ task_op_state stl_task::schedule (time_stamp* til_next_time)
 			// task_pending section below, which will cause the task to run right now
 
 		case (TASK_PENDING):
+			#ifdef STL_PROFILE						// If execution time profiling is
+				start_profiler ();					// activated, start timing
+			#endif
+
 			// Set the state to waiting for the next time interval. If the task needs
 			// to run again immediately, run_again_ASAP() will be called within the
 			// run() method, causing the state to be set to TASK_PENDING instead
 			op_state = TASK_WAITING;
-			#ifdef STL_PROFILE						// If execution time profiling is
-				start_profiler ();					// activated, start timing
-			#endif
 			next_state = run (current_state);		// Call the run() method
 			#ifdef STL_PROFILE
 				end_profiler ();					// End execution time measurement
@@ -156,8 +176,8 @@ task_op_state stl_task::schedule (time_stamp* til_next_time)
 			if (next_state != STL_NO_TRANSITION)	// Detect state transition if any
 			{										// has occurred
 				#ifdef STL_TRACE
-					GLOB_DEBUG ("T" << serial_number << ":" << current_state << "-" 
-						<< next_state << endl);
+					stl_trace_record (serial_number, current_state, next_state,
+									  trace_payload);
 				#endif
 				current_state = next_state;			// Go to next state next time
 			}
@@ -186,6 +206,8 @@ task_op_state stl_task::schedule (time_stamp* til_next_time)
 //	 else if (op_state == blocked)					// Blocked tasks are not currently 
 //		 return (false);							// implemented
 
+	// error_stop() doesn't return, but the compiler can't tell
+	return (op_state);
 }
 
 
@@ -211,23 +233,41 @@ char stl_task::run (char a_state)
 //--------------------------------------------------------------------------------------
 /** This method suspends the task so that it won't run again until after somebody calls 
  *  the resume() method. The state of the task before suspension is saved so that it 
- *  can be restored after suspension.
+ *  can be restored after suspension. A task may stay suspended for longer than two
+ *  time stamps can be compared (see time_stamp), so while it's suspended its next run
+ *  time holds the time which was left until then, rather than a time on the clock. 
  */
 
 void stl_task::suspend (void)
 {
+	if (op_state == TASK_SUSPENDED)
+	{
+		return;
+	}
 	save_op_state = op_state;
 	op_state = TASK_SUSPENDED;
+	next_run_time -= the_timer.get_time_now ();
 }
 
 
 //--------------------------------------------------------------------------------------
 /** This method resumes the task from suspension, so that the task can run again. The
- *  operational state which was saved at the time of suspension is restored. 
+ *  operational state which was saved at the time of suspension is restored. If the
+ *  task's next run time came while it was suspended, it runs as soon as it can, once,
+ *  and then at its usual interval from then on. 
  */
 
 void stl_task::resume (void)
 {
+	if (op_state != TASK_SUSPENDED)
+	{
+		return;
+	}
+	if (next_run_time < zero_time)
+	{
+		next_run_time = zero_time;
+	}
+	next_run_time += the_timer.get_time_now ();
 	op_state = save_op_state;
 }
 
@@ -247,7 +287,9 @@ void stl_task::set_initial_state (char init_state)
 
 //--------------------------------------------------------------------------------------
 /** This method displays a message (if the program was compiled with serial debugging
- *  enabled) and then causes the processor to freeze in an infinite loop. It should be
+ *  enabled), dumps the trace ring (if it was compiled with STL_TRACE and a port has
+ *  been given to stl_trace_set_port()), and then causes the processor to freeze in an
+ *  infinite loop. It should be
  *  used if something awful happened and the safest thing to do is to just stop. Only
  *  use this function if there isn't a reasonable way to write an error state which 
  *  handles exceptions in a more useful manner, such as by turning motors and other
@@ -262,110 +304,142 @@ void stl_task::error_stop (char const* message)
 		<< endl);
 
 	cli ();									// Disable interrupts
+	#ifdef STL_TRACE
+		stl_trace_post_mortem ();			// Show what led up to the error
+	#endif
 	while (1);								// Bang...you're dead (until reset)
 }
 
 
 #ifdef STL_PROFILE
 //-------------------------------------------------------------------------------------
-/** This method clears the statistical counters so that the profiler is ready to save
- *  some new data. 
+/** This function reads the task timer's hardware counter. Interrupts are held off
+ *  while it's read, because an interrupt which used another 16-bit register of the
+ *  same timer between the reads of the low and high bytes would spoil the high byte.
+ *  @return The hardware count, in ticks of the task timer
  */
 
-void stl_task::clear_profiler (void)
+static inline uint16_t profile_count (void)
 {
-	time_stamp zero (0, 0);
-	max_time = zero;
-	min_time = zero;
-	avg_time = zero;
-	run_time_sum = zero;
-	runs = 0L;
+	uint8_t temp_sreg = SREG;				// Store interrupt flag status
+	cli ();									// Prevent interruption
+	uint16_t count = TMR_TCNT_REG;			// Get hardware count
+	SREG = temp_sreg;						// Re-enable interrupts if they were on
+	return (count);
 }
 
 
 //-------------------------------------------------------------------------------------
-/** This method begins a measurement run. It simply saves the time at which this 
- *  method is called. A subsequent call to end() will cause the duration between the
- *  calls to start() and end() to be measured and recorded. 
+/** This method clears the statistical counters so that the profiler is ready to save
+ *  some new data. The task's interval is saved in the profile as a number of timer
+ *  ticks, so that it can be used for finding jitter and overruns.
  */
 
-void stl_task::start_profiler (void)
+void stl_task::clear_profiler (void)
 {
-	start_time = the_timer.get_time_now ();
+	memset (&profile, 0, sizeof (profile));
+	profile.task = serial_number;
+
+	uint32_t ticks = interval.get_raw_time ();
+	profile.interval = (ticks > 0xFFFFUL) ? 0xFFFF : (uint16_t)ticks;
+	prof_interval = (uint16_t)ticks;
+	prof_released = false;
 }
 
 
 //-------------------------------------------------------------------------------------
-/** This method ends a measurement run, computing the duration of the run and saving
- *  that duration in the statistical counters as necessary. 
+/** This method adds a time to one of the histograms in the profile. If the time's bin
+ *  is about to overflow, all the bins in both histograms are halved.
+ *  @param jitter True to count the time as jitter, false to count it as a run time
+ *  @param ticks The time, in timer ticks
  */
 
-void stl_task::end_profiler (void)
+void stl_task::count_in (bool jitter, uint16_t ticks)
 {
-	// Compute the duration measured for this run
-	time_stamp duration = the_timer.get_time_now () - start_time;
+	uint8_t bin = stl_prof_bin (ticks);
+	uint16_t count;
 
-	// A duration less than zero is impossible, so it must be wrong
-	if (duration < 0)
+	if (jitter)
 	{
-		return;
+		count = ++profile.jitter_hist[bin];
 	}
-
-	// If we have a maximum record, save it
-	if (duration > max_time)
-		max_time = duration;
-
-	// If this is the first run, it's the minimum; otherwise, check it
-	if (runs == 0L)
-		min_time = duration;
 	else
-		if (duration < min_time)
-			min_time = duration;
-
-	// Add to the counters which are used to find the average
-	run_time_sum += duration;
-	runs++;
+	{
+		count = ++profile.run_hist[bin];
+	}
+	if (count == 0xFFFF)
+	{
+		for (uint8_t index = 0; index < STL_PROF_BINS; index++)
+		{
+			profile.run_hist[index] >>= 1;
+			profile.jitter_hist[index] >>= 1;
+		}
+		profile.halvings++;
+	}
 }
 
 
 //-------------------------------------------------------------------------------------
-/** This method returns the duration of the longest recorded run of the code
- *  which is being profiled. 
- *  @return The maximum measured run duration
+/** This method begins a measurement run. It saves the hardware count at which the 
+ *  run starts. If the task is waiting rather than pending, this run is a periodic 
+ *  release, and the time since the last release is compared with the interval to 
+ *  find the jitter. The arithmetic is done on 16-bit counts, which wrap around, so
+ *  the jitter is right as long as it's less than half the counter's range. The 
+ *  counter is read only once, so the few instructions which record the jitter are
+ *  counted as part of the run. 
  */
 
-const time_stamp& stl_task::get_max_run_time (void) 
-{ 
-	return (max_time); 
-}
-
-
-//-------------------------------------------------------------------------------------
-/** This method returns the duration of the shortest recorded run of the code
- *  which is being profiled. 
- *  @return The minimum measured run duration
- */
+void stl_task::start_profiler (void)
+{
+	uint16_t now = profile_count ();
 
-const time_stamp& stl_task::get_min_run_time (void) 
-{ 
-	return (min_time); 
+	if (op_state == TASK_WAITING)
+	{
+		if (prof_released)
+		{
+			int16_t late = (int16_t)(uint16_t)(now - prof_release - prof_interval);
+			uint16_t jitter = (late < 0) ? (uint16_t)(0U - (uint16_t)late) : (uint16_t)late;
+			if (jitter > profile.max_jitter)
+			{
+				profile.max_jitter = jitter;
+			}
+			count_in (true, jitter);
+		}
+		prof_release = now;
+		prof_released = true;
+	}
+	prof_start = now;
 }
 
 
 //-------------------------------------------------------------------------------------
-/** This method returns the average duration of all the runs of the code which
- *  is being profiled. 
- *  @return The average measured run duration
+/** This method ends a measurement run, computing the duration of the run and saving
+ *  that duration in the statistical counters as necessary. A run which took longer 
+ *  than the task's interval is counted as an overrun.
  */
 
-const time_stamp& stl_task::get_avg_run_time (void) 
-{ 
-	if (runs > 0L)
+void stl_task::end_profiler (void)
+{
+	// Compute the duration measured for this run
+	uint16_t ticks = profile_count () - prof_start;
+
+	count_in (false, ticks);
+	if (ticks > profile.max_run)
+	{
+		profile.max_run = ticks;
+	}
+	if (profile.runs == 0L || ticks < profile.min_run)
 	{
-		avg_time = run_time_sum;
-		avg_time /= runs;
+		profile.min_run = ticks;
 	}
-	return (avg_time);
+	if (profile.interval != 0 && ticks > profile.interval)
+	{
+		profile.overruns++;
+	}
+
+	// Add to the counters which are used to find the average
+	profile.run_sum += ticks;
+	profile.runs++;
 }
 
 #endif  // STL_PROFILE
@@ -384,13 +458,20 @@ base_text_serial& operator<< (base_text_serial& serial, stl_task& task)
 	serial << PMS ("Task: ") << task.get_serial_number ();
 
 	#ifdef STL_PROFILE
-		serial << PMS (" runs: ") << task.get_num_runs ();
-		time_stamp fred = task.get_avg_run_time ();
-		serial << PMS (" avg: ") << fred;
-		fred = task.get_max_run_time ();
-		serial << PMS (" max: ") << fred;
-		fred = task.get_min_run_time ();
-		serial << PMS (" min: ") << fred;
+		const stl_prof_rec& profile = task.get_profile ();
+		serial << PMS (" runs: ") << profile.runs;
+		if (profile.runs > 0L)
+		{
+			time_stamp fred (profile.run_sum / profile.runs);
+			serial << PMS (" avg: ") << fred;
+			fred.set_time ((uint32_t)profile.max_run);
+			serial << PMS (" max: ") << fred;
+			fred.set_time ((uint32_t)profile.min_run);
+			serial << PMS (" min: ") << fred;
+			fred.set_time ((uint32_t)profile.max_jitter);
+			serial << PMS (" jitter: ") << fred;
+		}
+		serial << PMS (" overruns: ") << profile.overruns;
 	#endif
 
 	return (serial);
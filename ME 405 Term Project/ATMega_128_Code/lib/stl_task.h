@@ -11,6 +11,10 @@
  *    \li 05-07-07 JRR Small bug fixes
  *    \li 06-01-08 JRR Changed debugging/trace to take advantage of base_text_serial
  *    \li 06-03-08 JRR Cleaned up comments, got rid of Doxygen warnings
+ *    \li 06-01-11     Added run time accessors for use by task_scheduler
+ *    \li 06-25-11     Profiling keeps histograms of run time and jitter in raw
+ *                     timer counts, and counts overruns
+ *    \li 06-26-11     STL_TRACE records state transitions in a RAM trace ring
  *
  *  License:
  *    This file released under the Lesser GNU Public License, version 2. This program
@@ -23,6 +27,12 @@
 #define _STL_TASK_H_
 
 #include "stl_timer.h"						// Include the header for the task timer
+#ifdef STL_PROFILE
+	#include "stl_profile.h"				// Records kept by the profiler
+#endif
+#ifdef STL_TRACE
+	#include "stl_trace.h"					// Ring in which transitions are recorded
+#endif
 
 
 //--------------------------------------------------------------------------------------
@@ -78,9 +88,19 @@ enum task_op_state
  *        and of course it requires a serial device to be present and connected.
  *    \li Execution time profiling can be enabled by defining STL_PROFILE.  This
  *        option causes the execution times of the state functions to be measured
- *        and a simple set of performance data to be kept. Performance data can be
- *        written to a serial port at a convenient time, generally after the system
- *        has been run in test for a while. 
+ *        by reading the task timer's hardware counter, and a histogram of run times,
+ *        a histogram of the jitter in the times between runs, and a count of runs
+ *        which overran the task's interval to be kept (see stl_profile.h). Only
+ *        16-bit arithmetic is used, so measuring takes little time, but run times 
+ *        and jitter longer than 32 ms (at 16 MHz) aren't measured correctly. The
+ *        profile can be printed to a serial port at a convenient time, generally
+ *        after the system has been run in test for a while, or written as a binary
+ *        block by the task_scheduler. 
+ *    \li State transition tracing can be enabled by defining STL_TRACE. Each state
+ *        transition is recorded in a trace ring in RAM, with the time, the states
+ *        and a payload set by set_trace_payload() (see stl_trace.h). Recording takes
+ *        a few microseconds, so a machine can be traced while it runs normally; the
+ *        ring is dumped on request or by error_stop(). 
  * 
  *  \section task_intrn Internal Organization
  *    At any time, a task is in both a <i>user state</i> and an <i>operational 
@@ -196,42 +216,75 @@ class stl_task
 		inline bool ready (void) 
 			{ return (op_state == TASK_PENDING  || op_state == TASK_RUNNING); }
 
+		/** This method returns the time at which the task is next due to run. If the
+		 *  task has called run_again_ASAP(), it is due now regardless of this time.
+		 *  @return A reference to the task's next run time
+		 */
+		const time_stamp& get_next_run_time (void) { return (next_run_time); }
+
+		/** This method returns the time interval between runs of the task. 
+		 *  @return A reference to the task's run interval
+		 */
+		const time_stamp& get_interval (void) { return (interval); }
+
+		/** This method tells whether the task would run if its schedule() method
+		 *  were called at the given time. It is used by schedulers which need to 
+		 *  choose between several tasks which are ready at the same time.
+		 *  @param time_now The current time, as measured by the task timer
+		 *  @return True if the task is pending or its next run time has arrived
+		 */
+		inline bool is_due (const time_stamp& time_now)
+			{ return (op_state == TASK_PENDING 
+				|| (op_state == TASK_WAITING && !(next_run_time > time_now))); }
+
 		void error_stop (char const*);	 	// Complain and stop the processor
 
 	// The following block is only compiled if execution time profiling has been 
 	// enabled for this project by setting -DSTL_PROFILE in the Makefile
 	#ifdef STL_PROFILE
 		protected:
-			time_stamp max_time;			///< Maximum time function took to run
-			time_stamp min_time;			///< Time for the quickest function run
-			time_stamp avg_time;			///< Stamp holds recently computed average
-			time_stamp run_time_sum;		///< Sum of measured function run times
-			uint32_t runs;					///< Number of runs that have been measured
-			time_stamp start_time;			///< Time at which measurement was started
+			stl_prof_rec profile;			///< Run times, jitter and overruns so far
+			uint16_t prof_start;			///< Timer count when this run started
+			uint16_t prof_release;			///< Timer count at the last periodic release
+			uint16_t prof_interval;			///< Interval in timer counts, low 16 bits
+			bool prof_released;				///< True once there has been a release
+
+			void count_in (bool, uint16_t);	// Add a time to a histogram
 
 		public:
 			void clear_profiler (void);		// Clear statistical data items
 			void start_profiler (void);		// Begin a measurement run
 			void end_profiler (void);		// End a measurement and record times
 
-			// This method returns the duration of the longest recorded run of the
-			// code which is being profiled. 
-			const time_stamp& get_max_run_time (void);
-
-			// This method returns the duration of the shortest recorded run of the 
-			// code which is being profiled. 
-			const time_stamp& get_min_run_time (void);
-
-			// This method returns the average duration of all the runs of the code
-			// which is being profiled. 
-			const time_stamp& get_avg_run_time (void);
+			/** This method returns the profile of the task, which holds the run time
+			 *  and jitter histograms and statistics measured since the profiler was
+			 *  last cleared. 
+			 *  @return A reference to the task's profile record
+			 */
+			const stl_prof_rec& get_profile (void) { return (profile); }
 
 			/** This method returns the number of runs of run() whose execution time
 			 *  has been measured in the current sample set.
 			*  @return The number of runs which have been measured
 			*/
-			uint32_t get_num_runs (void) { return (runs); }
+			uint32_t get_num_runs (void) { return (profile.runs); }
 	#endif  // STL_PROFILE
+
+	// The following block is only compiled if state transition tracing has been
+	// enabled for this project by setting -DSTL_TRACE in the Makefile
+	#ifdef STL_TRACE
+		protected:
+			uint16_t trace_payload;			///< Number recorded with each transition
+
+		public:
+			/** This method sets the number which is recorded in the trace ring with
+			 *  the task's state transitions, such as a count or a reading which
+			 *  helps to explain why the transitions happened. It stays the same
+			 *  until it's set again. 
+			 *  @param payload The number to be recorded
+			 */
+			void set_trace_payload (uint16_t payload) { trace_payload = payload; }
+	#endif  // STL_TRACE
 };
 
 // This overloaded operator prints information about a task to a serial device
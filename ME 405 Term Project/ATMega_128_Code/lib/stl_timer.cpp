@@ -18,6 +18,11 @@
  *    \li 05-31-2008 JRR Changed time calculations to use CPU_FREQ_MHz from Makefile
  *    \li 01-04-2009 JRR Now uses CPU_FREQ_Hz (rather than MHz) for better precision
  *    \li 11-24-2009 JRR Changed CPU_FREQ_Hz to F_CPU to match AVR-LibC's name
+ *    \li 06-02-2011     Added a compare match wake-up alarm for tickless idle
+ *    \li 06-18-2011     Reading the time counts an overflow whose interrupt is pending
+ *    \li 06-27-2011     32-bit overflow count, giving a 48-bit tick count which lasts
+ *                       for years; comparisons of time stamps are modular
+ *    \li 06-28-2011     The time stamp's methods moved into the header, inline
  *
  *  License:
  *    This file copyright 2007 by JR Ridgely. It is released under the Lesser GNU
@@ -39,285 +44,34 @@
 // the time. The user should not have any reason to read or write it.
 
 /** This variable holds the number of times the hardware timer has overflowed. This
- *  number is equivalent to the upper 16 bits of a 32-bit timer, and is so used. */
+ *  number is equivalent to the upper 32 bits of a 48-bit timer, and is so used. */
 
-uint16_t ust_overflows = 0;
+uint32_t ust_overflows = 0;
 
 
 //--------------------------------------------------------------------------------------
-/** This constructor creates a time stamp object, with the time set to zero. 
+/** This function reads the hardware counter and the overflow counter together. It must
+ *  be called with interrupts disabled, so that the overflow interrupt can't change the
+ *  overflow count between the two reads. If the hardware counter has overflowed but 
+ *  the interrupt hasn't run yet, the overflow flag is set; if so, and the count was 
+ *  read after the overflow (it's small, not just under 0xFFFF), the overflow which the
+ *  interrupt hasn't counted yet is added in. 
+ *  @param count A reference to a variable which receives the hardware count
+ *  @return The overflow count, including any overflow which is pending
  */
 
-time_stamp::time_stamp (void)
+static inline uint32_t capture_ticks (uint16_t& count)
 {
-	set_time (0L);
-}
-
-
-//--------------------------------------------------------------------------------------
-/** This constructor creates a time stamp object and fills the time stamp's variables
- *  with the given values.
- *  @param a_time A 32-bit time number with which the time stamp is filled
- */
-
-time_stamp::time_stamp (uint32_t a_time)
-{
-	set_time (a_time);
-}
-
-
-//--------------------------------------------------------------------------------------
-/** This constructor creates a time stamp object and fills the time stamp's variables
- *  with the number of seconds and microseconds given. 
- *  @param sec A 16-bit number of seconds to preload into the time stamp
- *  @param microsec A 32-bit number of microseconds to preload into the time stamp
- */
-
-time_stamp::time_stamp (uint16_t sec, uint32_t microsec)
-{
-	set_time (sec, microsec);
-}
-
-
-//--------------------------------------------------------------------------------------
-/** This method fills the time stamp with the given value.
- *  @param a_time A 32-bit time number with which the time stamp is filled
- */
-
-void time_stamp::set_time (uint32_t a_time)
-{
-	data.whole = a_time;
-}
-
-
-//--------------------------------------------------------------------------------------
-/** This method fills the time stamp with the given numbers of seconds and microseconds.
- *  @param sec A 16-bit number of seconds to preload into the time stamp
- *  @param microsec A 32-bit number of microseconds to preload into the time stamp
- */
-
-void time_stamp::set_time (uint16_t sec, uint32_t microsec)
-{
-	data.whole = (microsec * (F_CPU / 1000000UL)) / 8UL;
-	data.whole += (uint16_t)sec * (F_CPU / 8UL);
-}
-
-
-//--------------------------------------------------------------------------------------
-/** This method allows one to get the time reading from this time stamp as a long 
- *  integer containing the number of time ticks. 
- *  @return The time stamp's raw data
- */
-
-uint32_t time_stamp::get_raw_time (void)
-{
-	return (data.whole);
-}
-
-
-//--------------------------------------------------------------------------------------
-/** This method returns the number of seconds in the time stamp.
- *  @return The number of whole seconds in the time stamp
- */
-
-uint16_t time_stamp::get_seconds (void)
-{
-	return ((uint16_t)(data.whole / (F_CPU / 8)));
-}
-
-
-//--------------------------------------------------------------------------------------
-/** This method returns the number of microseconds in the time stamp, after the seconds
- *  are subtracted out. 
- *  @return The number of microseconds, that is, the fractional part of the time stamp
- */
-
-uint32_t time_stamp::get_microsec (void)
-{
-	return ((data.whole % (F_CPU / 8UL)) * 8 / (F_CPU / 1000000UL));
-}
-
-
-//--------------------------------------------------------------------------------------
-/** This overloaded addition operator adds another time stamp's time to this one.  It 
- *  can be used to find the time in the future at which some event is to be caused to 
- *  happen, such as the next time a task is supposed to run. 
- *  @param addend The other time stamp which is to be added to this one
- *  @return The newly created time stamp
- */
-
-time_stamp time_stamp::operator + (const time_stamp& addend)
-{
-	time_stamp ret_stamp;
-	ret_stamp.data.whole = this->data.whole + addend.data.whole;
-
-	return ret_stamp;
-}
-
-
-//--------------------------------------------------------------------------------------
-/** This overloaded subtraction operator finds the duration between this time stamp's 
- *  recorded time and a previous one. 
- *  @param previous An earlier time stamp to be compared to the current one 
- *  @return The newly created time stamp
- */
-
-time_stamp time_stamp::operator - (const time_stamp& previous)
-{
-	time_stamp ret_stamp;
-	ret_stamp.data.whole = this->data.whole - previous.data.whole;
-
-	return ret_stamp;
-}
-
-
-//--------------------------------------------------------------------------------------
-/** This overloaded addition operator adds another time stamp's time to this one.  It 
- *  can be used to find the time in the future at which some event is to be caused to 
- *  happen, such as the next time a task is supposed to run. 
- *  @param addend The other time stamp which is to be added to this one
- */
-
-void time_stamp::operator += (const time_stamp& addend)
-{
-	data.whole += addend.data.whole;
-}
-
-
-//--------------------------------------------------------------------------------------
-/** This overloaded subtraction operator finds the duration between this time stamp's 
- *  recorded time and a previous one. Note that the data in this timestamp is 
- *  replaced with that duration. 
- *  @param previous An earlier time stamp to be compared to the current one 
- */
-
-void time_stamp::operator -= (const time_stamp& previous)
-{
-	data.whole -= previous.data.whole;
-}
-
-
-//--------------------------------------------------------------------------------------
-/** This overloaded division operator divides a time stamp by the given integer. Note 
- *  that the data in this timestamp is replaced by the quotient. 
- *  @param divisor The number by which the time stamp is to be divided
- */
-
-void time_stamp::operator /= (const uint32_t& divisor)
-{
-	data.whole /= divisor;
-}
-
-
-//--------------------------------------------------------------------------------------
-/** This overloaded equality test operator checks if all the time measurements in some
- *  other time stamp are equal to those in this one. 
- *  @param other A time stamp to be compared to this one 
- *  @return True if the time stamps contain equal data, false if they don't
- */
-
-bool time_stamp::operator == (const time_stamp& other)
-{
-	if (other.data.whole == data.whole)
+	uint32_t overflows = ust_overflows;
+	count = TMR_TCNT_REG;
+	if ((TMR_OVF_TIFR & (1 << TMR_OVF_FLAG)) && !(count & 0x8000))
 	{
-		return (true);
-	}
-	else
-	{
-		return (false);
+		overflows++;						// Overflowed, but the ISR hasn't run yet
 	}
+	return (overflows);
 }
 
 
-//--------------------------------------------------------------------------------------
-/** This overloaded inequality operator checks if this time stamp is greater than or
- *  equal to another. The method used to check greater-than-ness needs to work across 
- *  timer overflows, so the following technique is used: subtract the other time stamp 
- *  from this one as unsigned 32-bit numbers, then check if the result is positive (in 
- *  which case this time is greater) or not. 
- *  @param other A time stamp to be compared to this one 
- *  @return True if this time stamp is greater than or equal to the other one
- */
-
-bool time_stamp::operator >= (const time_stamp& other)
-{
-	int32_t difference = (int32_t)(data.whole - other.data.whole);
-	if (difference >= 0L)
-	{
-		return (true);
-	}
-	else
-	{
-		return (false);
-	}
-}
-
-
-//--------------------------------------------------------------------------------------
-/** This operator tests if a time stamp is greater than this one. It subtracts the 
- *  other time stamp from this time stamp, then checks if the result is positive. 
- *  @param other A time stamp to be compared to this one 
- *  @return True if this time stamp is greater than the other one
- */
-
-bool time_stamp::operator > (const time_stamp& other)
-{
-	int32_t difference = (int32_t)(data.whole - other.data.whole);
-	if (difference > 0L)
-	{
-		return (true);
-	}
-	else
-	{
-		return (false);
-	}
-}
-
-
-//--------------------------------------------------------------------------------------
-/** This operator tests if a time stamp is less than or equal to this one. It subtracts 
- *  the other time stamp from this time stamp, then checks if the result is not
- *  positive. 
- *  @param other A time stamp to be compared to this one 
- *  @return True if this time stamp is less than or equal to the other one
- */
-
-bool time_stamp::operator <= (const time_stamp& other)
-{
-	int32_t difference = (int32_t)(data.whole - other.data.whole);
-	if (difference <= 0L)
-	{
-		return (true);
-	}
-	else
-	{
-		return (false);
-	}
-}
-
-
-//--------------------------------------------------------------------------------------
-/** This operator tests if a time stamp is greater than this one. It subtracts the 
- *  other time stamp from this time stamp, then checks if the result is negative. 
- *  @param other A time stamp to be compared to this one 
- *  @return True if this time stamp is less than the other one
- */
-
-bool time_stamp::operator < (const time_stamp& other)
-{
-	int32_t difference = (int32_t)(data.whole - other.data.whole);
-	if (difference < 0L)
-	{
-		return (true);
-	}
-	else
-	{
-		return (false);
-	}
-}
-
-
-
 //--------------------------------------------------------------------------------------
 /** This constructor creates a daytime task timer object.  It sets up the hardware timer
  *  to count at ~1 MHz and interrupt on overflow. Note that this method does not enable
@@ -358,10 +112,12 @@ task_timer::task_timer (void)
 
 void task_timer::save_time_stamp (time_stamp& the_stamp)
 {
+	uint16_t count;							// Hardware count
+
 	uint8_t temp_sreg = SREG;				// Store interrupt flag status
-	the_stamp.data.half[0] = TMR_TCNT_REG;	// Get hardware count
 	cli ();									// Prevent interruption
-	the_stamp.data.half[1] = ust_overflows;	// Get overflow counter data
+	uint32_t overflows = capture_ticks (count);
+	the_stamp.ticks = ((uint32_t)(uint16_t)overflows << 16) | count;
 	SREG = temp_sreg;						// Re-enable interrupts if they were on
 }
 
@@ -374,48 +130,100 @@ void task_timer::save_time_stamp (time_stamp& the_stamp)
 
 time_stamp& task_timer::get_time_now (void)
 {
+	uint16_t count;							// Hardware count
+
 	uint8_t temp_sreg = SREG;				// Store interrupt flag status
-	now_time.data.half[0] = TMR_TCNT_REG;	// Get hardware count
 	cli ();									// Prevent interruption
-	now_time.data.half[1] = ust_overflows;	// Get overflow counter data
+	uint32_t overflows = capture_ticks (count);
+	now_time.ticks = ((uint32_t)(uint16_t)overflows << 16) | count;
 	SREG = temp_sreg;						// Re-enable interrupts if they were on
 
 	return (now_time);						// Return a reference to the current time
 }
 
 
+//--------------------------------------------------------------------------------------
+/** This method reads the whole 48-bit count of timer ticks since the timer was started,
+ *  the hardware count and all 32 bits of the overflow count. It doesn't wrap around 
+ *  for 2^48 ticks, which is 4.4 years at 16 MHz, so it can be used for measuring times
+ *  too long for a time stamp. The low 32 bits are the same as those which 
+ *  get_time_now() puts in a time stamp. 
+ *  @return The number of timer ticks since the timer was started
+ */
+
+uint64_t task_timer::get_ticks (void)
+{
+	uint16_t count;							// Hardware count
+
+	uint8_t temp_sreg = SREG;				// Store interrupt flag status
+	cli ();									// Prevent interruption
+	uint32_t overflows = capture_ticks (count);
+	SREG = temp_sreg;						// Re-enable interrupts if they were on
+
+	return (((uint64_t)overflows << 16) | count);
+}
+
+
 //--------------------------------------------------------------------------------------
 /** This method sets the timer to a given value. It's not likely that this method will
  *  be used, but it is provided for compatibility with other task timer implementations
  *  that measure times of day (in hours, minutes, and seconds) and do need to be set by
  *  user programs. 
+ *  The bits of the overflow count above those in a time stamp are cleared. 
  *  @param t_stamp A reference to a time stamp containing the time to be set
+ *  @return True, as the time can always be set
  */
 
 bool task_timer::set_time (time_stamp& t_stamp)
 {
 	uint8_t temp_sreg = SREG;				// Store interrupt flag status
 	cli ();									// Prevent interruption
-	ust_overflows = t_stamp.data.half[1];
-	TMR_TCNT_REG = t_stamp.data.half[0];
+	ust_overflows = (uint16_t)(t_stamp.ticks >> 16);
+	TMR_TCNT_REG = (uint16_t)t_stamp.ticks;
 	SREG = temp_sreg;						// Re-enable interrupts if they were on
+
+	return (true);
 }
 
 
 //--------------------------------------------------------------------------------------
-/** This overloaded operator allows a time stamp to be printed on a serial device such
- *  as a regular serial port or radio module in text mode. This allows lines to be set
- *  up in the style of 'cout.' The timestamp is always printed as a decimal number. 
- *  @param serial A reference to the serial-type object to which to print
- *  @param stamp A reference to the time stamp to be displayed
+/** This method arms the timer's compare match interrupt so that it will wake up the
+ *  processor from sleep at the given time. The compare register only holds the low 16
+ *  bits of the time, so the alarm is only armed if the wake-up time falls before the
+ *  next overflow of the hardware counter; otherwise the overflow interrupt, which
+ *  always runs, wakes the processor first and the caller can arm the alarm again. The
+ *  alarm disarms itself when it goes off. On chips without a spare compare register
+ *  this method does nothing, and sleep is ended by the overflow interrupt. 
+ *  @param wake_time The time at which the processor should be woken up
  */
 
-base_text_serial& operator<< (base_text_serial& serial, time_stamp& stamp)
+void task_timer::set_wake_up (const time_stamp& wake_time)
 {
-	// Get the time in seconds and microseconds
-	uint16_t seconds = stamp.get_seconds ();
-	uint32_t microseconds = stamp.get_microsec ();
+	#ifdef TMR_WAKE_OCR
+		uint8_t temp_sreg = SREG;			// Store interrupt flag status
+		cli ();								// Prevent interruption
+		if ((uint16_t)(wake_time.ticks >> 16) == (uint16_t)ust_overflows)
+		{
+			TMR_WAKE_OCR = (uint16_t)wake_time.ticks;
+			TMR_WAKE_TIFR = (1 << TMR_WAKE_FLAG);	// Clear any stale match
+			TMR_WAKE_TIMSK |= (1 << TMR_WAKE_IE);
+		}
+		SREG = temp_sreg;					// Re-enable interrupts if they were on
+	#endif
+}
+
+
+//--------------------------------------------------------------------------------------
+/** This function prints a time as a number of seconds with six decimal places.
+ *  @param serial A reference to the serial-type object to which to print
+ *  @param seconds The number of whole seconds
+ *  @param microseconds The number of microseconds after the whole seconds
+ *  @return A reference to the serial object
+ */
 
+static base_text_serial& print_time (base_text_serial& serial, uint32_t seconds,
+									 uint32_t microseconds)
+{
 	serial << seconds;
 	serial.putchar ('.');
 
@@ -431,20 +239,35 @@ base_text_serial& operator<< (base_text_serial& serial, time_stamp& stamp)
 }
 
 
+//--------------------------------------------------------------------------------------
+/** This overloaded operator allows a time stamp to be printed on a serial device such
+ *  as a regular serial port or radio module in text mode. This allows lines to be set
+ *  up in the style of 'cout.' The timestamp is always printed as a decimal number. 
+ *  @param serial A reference to the serial-type object to which to print
+ *  @param stamp A reference to the time stamp to be displayed
+ */
+
+base_text_serial& operator<< (base_text_serial& serial, time_stamp& stamp)
+{
+	return (print_time (serial, stamp.get_seconds (), stamp.get_microsec ()));
+}
+
+
 //--------------------------------------------------------------------------------------
 /** This overloaded operator allows the task timer to print the current time on a serial 
  *  device such as a regular serial port or radio module in text mode. This allows lines 
- *  to be set up in the style of 'cout.' The printing is done by the time_stamp class;
- *  this method just calls the timer's get_time_now() method to get a time stamp, then 
- *  has the time stamp print itself. 
+ *  to be set up in the style of 'cout.' The whole 48-bit count is printed, so the time
+ *  printed doesn't go back to zero when a time stamp would wrap around. 
  *  @param serial A reference to the serial-type object to which to print
  *  @param tmr A reference to the timer whose time is to be displayed
  */
 
 base_text_serial& operator<< (base_text_serial& serial, task_timer& tmr)
 {
-	serial << tmr.get_time_now ();
-	return (serial);
+	uint64_t ticks = tmr.get_ticks ();
+
+	return (print_time (serial, (uint32_t)(ticks / (F_CPU / 8UL)),
+		(uint32_t)(ticks % (F_CPU / 8UL)) * 8UL / (F_CPU / 1000000UL)));
 }
 
 
@@ -458,3 +281,17 @@ ISR (TMR_intr_vect)
 {
 	ust_overflows++;
 }
+
+
+#ifdef TMR_WAKE_vect
+//--------------------------------------------------------------------------------------
+/** This is the interrupt service routine for the wake-up alarm which is armed by 
+ *  set_wake_up(). Its only job is to end the processor's sleep, so it just disarms 
+ *  itself so that it won't go off again when the counter next comes around. 
+ */
+
+ISR (TMR_WAKE_vect)
+{
+	TMR_WAKE_TIMSK &= ~(1 << TMR_WAKE_IE);
+}
+#endif // TMR_WAKE_vect
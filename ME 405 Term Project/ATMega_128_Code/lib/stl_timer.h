@@ -18,6 +18,12 @@
  *    \li 05-31-2008 JRR Changed time calculations to use CPU_FREQ_MHz from Makefile
  *    \li 01-04-2009 JRR Now uses CPU_FREQ_Hz (rather than MHz) for better precision
  *    \li 11-24-2009 JRR Changed CPU_FREQ_Hz to F_CPU to match AVR-LibC's name
+ *    \li 06-02-2011     Added a compare match wake-up alarm for tickless idle
+ *    \li 06-18-2011     Reading the time counts an overflow whose interrupt is pending
+ *    \li 06-27-2011     32-bit overflow count, giving a 48-bit tick count which lasts
+ *                       for years; comparisons of time stamps are modular
+ *    \li 06-28-2011     Time stamps are a raw tick count with inline methods, and can
+ *                       be made from constants with time_ms() etc. or 10_ms suffixes
  *
  *  License:
  *    This file copyright 2007 by JR Ridgely. It is released under the Lesser GNU
@@ -40,101 +46,197 @@
 #ifdef TCNT3
 	#define TMR_TCNT_REG	TCNT3			///< Register that holds the time count
 	#define TMR_intr_vect   TIMER3_OVF_vect	///< The timer overflow interrupt vector 
+	#define TMR_OVF_FLAG	TOV3			///< Overflow flag bit
+	#ifdef ETIFR							// The ATmega128 keeps Timer 3's flags in
+		#define TMR_OVF_TIFR	ETIFR		// ETIFR, the ATmega1281 in TIFR3
+	#else
+		#define TMR_OVF_TIFR	TIFR3		///< Register holding the overflow flag
+	#endif
 #else
 	#define TMR_TCNT_REG	TCNT1			///< Register that holds the time count
 	#define TMR_intr_vect   TIMER1_OVF_vect	///< The timer overflow interrupt vector 
+	#define TMR_OVF_FLAG	TOV1			///< Overflow flag bit
+	#ifdef TIFR1
+		#define TMR_OVF_TIFR	TIFR1		///< Register holding the overflow flag
+	#else
+		#define TMR_OVF_TIFR	TIFR
+	#endif
 #endif // __AVR_ATmega128__
 
-
-//--------------------------------------------------------------------------------------
-/** This union holds a 32-bit time count. The count can be accessed as a single 32-bit
- *  number, as two 16-bit integers placed together, or as an array of 8-bit characters. 
- *  This is helpful because the time measurement we use consists of the number in a 
- *  16-bit hardware counter and a 16-bit overflow count which should be put together 
- *  into one time number. The characters are handy for looking at individual bits. 
- */
-
-typedef union
-{
-	uint32_t whole;							///< All the data as one 32-bit number
-	uint16_t half[2];						///< The data as an array of 16-bit ints
-	uint8_t quarters[4];					///< The data as an array of 8-bit chars
-} time_data_32;
+// The wake-up alarm used for tickless idle is Timer 3's compare match C; compare match
+// A makes the servo's pulses (see servo.cpp). Chips without Timer 3 have no alarm and
+// are woken only by the timer overflow and other interrupts
+#ifdef OCR3C
+	#define TMR_WAKE_OCR	OCR3C			///< Compare register for the wake-up alarm
+	#define TMR_WAKE_vect	TIMER3_COMPC_vect	///< Wake-up alarm interrupt vector
+	#define TMR_WAKE_FLAG	OCF3C			///< Flag bit set by the wake-up alarm
+	#define TMR_WAKE_IE		OCIE3C			///< Wake-up alarm interrupt enable bit
+	#ifdef ETIFR							// The ATmega128 keeps Timer 3's flags in
+		#define TMR_WAKE_TIFR	ETIFR		// ETIFR, the ATmega1281 in TIFR3
+	#else
+		#define TMR_WAKE_TIFR	TIFR3		///< Register holding the alarm flag
+	#endif
+	#ifdef ETIMSK							// The ATmega128 keeps Timer 3's interrupt
+		#define TMR_WAKE_TIMSK	ETIMSK		// enables in ETIMSK, the ATmega1281 in
+	#else									// TIMSK3
+		#define TMR_WAKE_TIMSK	TIMSK3		///< Register holding the alarm enable
+	#endif
+#endif // OCR3C
+
+
+/** This is the number of times the hardware timer has overflowed, which is counted by
+ *  the timer's overflow interrupt. Its low 16 bits are the upper half of a time stamp,
+ *  and all 32 bits are the upper part of the 48-bit count from get_ticks(). It should
+ *  only be read with interrupts disabled. */
+extern uint32_t ust_overflows;
+
+
+/** This is the number of task timer ticks in one second. The timer counts the CPU
+ *  clock divided by 8, so at 16 MHz there are two ticks in a microsecond. */
+#define STL_TICKS_PER_SEC	(F_CPU / 8UL)
+
+/** This macro converts a number of microseconds to timer ticks. It only multiplies
+ *  and divides by constants, and the division is by 8, so it's a shift; when the
+ *  number of microseconds is a constant, the whole thing is done by the compiler. */
+#define STL_US_TO_TICKS(us)	(((uint32_t)(us) * (F_CPU / 1000000UL)) / 8UL)
+
+/** This macro converts a number of milliseconds to timer ticks. */
+#define STL_MS_TO_TICKS(ms)	((uint32_t)(ms) * (F_CPU / 8000UL))
+
+/** This macro converts a number of seconds to timer ticks. */
+#define STL_SEC_TO_TICKS(s)	((uint32_t)(s) * STL_TICKS_PER_SEC)
+
+// Compilers which know C++11 can work out time stamps made from constants while
+// compiling, even where a constant expression is needed; older ones, such as the
+// avr-gcc this Makefile was written for, get the same inline code without the keyword
+#if (__cplusplus >= 201103L)
+	#define STL_CONSTEXPR	constexpr
+#else
+	#define STL_CONSTEXPR
+#endif
 
 
 //--------------------------------------------------------------------------------------
 /** This class holds a time stamp which is used to measure the passage of real time in
  *  the world around an AVR processor. This version of the time stamp implements a 
- *  32-bit time counter that runs at one megahertz. There's a 16-bit number which is
- *  copied directly from a 16-bit hardware counter and another 16-bit number which is 
+ *  32-bit time counter that runs at F_CPU / 8. The low 16 bits are copied directly 
+ *  from a 16-bit hardware counter and the high 16 bits from a count which is 
  *  incremented every time the hardware counter overflows; the combination of the two 
  *  is a 32-bit time measurement. The time stamp is to be interpreted and printed as 
  *  containing a whole number of seconds and a number of microseconds. The conversion
  *  between seconds and microseconds is determined by the CPU clock frequency, which 
  *  is specified in the macro F_CPU. 
+ *
+ *  The 32-bit count wraps around every 2^32 ticks, which is 35.8 minutes at 16 MHz. A
+ *  time stamp is therefore a point on a circle, and the comparison operators are
+ *  modular: one time is later than another if subtracting the other from it gives a
+ *  positive number when the difference is taken as a signed 32-bit number. This gives
+ *  the right answer across the wrap as long as the two times are less than 2^31 ticks
+ *  (17.9 minutes) apart, which is true of the run times and deadlines of tasks. Longer
+ *  times, such as how long the machine has been running, should be measured with 
+ *  task_timer::get_ticks(). 
+ *
+ *  The scheduler adds and compares time stamps many times for each task it runs, so
+ *  all the methods are inline and work on the raw tick count; a comparison is a 32-bit
+ *  subtraction and a test of the sign. Only get_seconds() and get_microsec(), which
+ *  are used for printing, divide. Time stamps can be made from constants with 
+ *  time_us(), time_ms() and time_sec(), or with the _us, _ms and _s suffixes where 
+ *  the compiler knows C++11, for example \c 2_ms; either way no arithmetic is left to
+ *  be done at run time. 
  */
 
 class time_stamp
 {
 	protected:
-		/// This union holds the time stamp's data and allows it to be accessed as two
-		/// 16-bit halves or one 32-bit whole as required by the application
-		time_data_32 data;
+		/// This is the time as a number of timer ticks
+		uint32_t ticks;
 
 	public:
 		/// This constructor creates an empty time stamp
-		time_stamp (void);
+		STL_CONSTEXPR time_stamp (void) : ticks (0) { }
 
-		/// This constructor creates a time stamp and initializes all its data
-		time_stamp (uint32_t);
+		/// This constructor creates a time stamp holding the given number of ticks
+		STL_CONSTEXPR time_stamp (uint32_t a_time) : ticks (a_time) { }
 
 		/// This constructor creates a time stamp with the given seconds and microsec.
-		time_stamp (uint16_t, uint32_t);
+		STL_CONSTEXPR time_stamp (uint16_t sec, uint32_t microsec)
+			: ticks (STL_US_TO_TICKS (microsec) + STL_SEC_TO_TICKS (sec)) { }
 
 		/// This method fills the timestamp with the given value
-		void set_time (uint32_t);
+		void set_time (uint32_t a_time) { ticks = a_time; }
 
 		/// This method fills the timestamp with the given seconds and microseconds
-		void set_time (uint16_t, uint32_t);
+		void set_time (uint16_t sec, uint32_t microsec)
+		{
+			ticks = STL_US_TO_TICKS (microsec) + STL_SEC_TO_TICKS (sec);
+		}
 
 		/// This method reads out all the timestamp's data as one 32-bit number
-		uint32_t get_raw_time (void);
+		STL_CONSTEXPR uint32_t get_raw_time (void) const { return (ticks); }
 
 		/// This method returns the number of seconds in the time stamp
-		uint16_t get_seconds (void);
+		uint16_t get_seconds (void) const
+		{
+			return ((uint16_t)(ticks / STL_TICKS_PER_SEC));
+		}
 
-		/// This method returns the number of microseconds in the time stamp
-		uint32_t get_microsec (void);
+		/// This method returns the number of microseconds after the whole seconds
+		uint32_t get_microsec (void) const
+		{
+			return ((ticks % STL_TICKS_PER_SEC) * 8UL / (F_CPU / 1000000UL));
+		}
 
 		/// This overloaded addition operator adds two time stamps together
-		time_stamp operator + (const time_stamp&);
+		STL_CONSTEXPR time_stamp operator + (const time_stamp& addend) const
+		{
+			return (time_stamp (ticks + addend.ticks));
+		}
 
 		/// This overloaded subtraction operator finds the time between two time stamps
-		time_stamp operator - (const time_stamp&);
+		STL_CONSTEXPR time_stamp operator - (const time_stamp& previous) const
+		{
+			return (time_stamp (ticks - previous.ticks));
+		}
 
-		/// This overloaded addition operator adds two time stamps together
-		void operator += (const time_stamp&);
+		/// This overloaded addition operator adds another time stamp to this one
+		void operator += (const time_stamp& addend) { ticks += addend.ticks; }
 
-		/// This overloaded subtraction operator finds the time between two time stamps
-		void operator -= (const time_stamp&);
+		/// This overloaded subtraction operator replaces this time with the time since
+		/// an earlier one
+		void operator -= (const time_stamp& previous) { ticks -= previous.ticks; }
 
 		/// This overloaded operator divides a time stamp by the given divisor
-		void operator /= (const uint32_t&);
-		
-		/// This overloaded equality operator tests if all time fields are the same
-		bool operator == (const time_stamp&);
-
-		/// This operator tests if a time stamp is greater (later) or equal to this one
-		bool operator >= (const time_stamp&);
-
-		/// This overloaded operator tests if a time stamp is greater (later) than this
-		bool operator > (const time_stamp&);
-
-		/// This operator tests if a time stamp is less (earlier) than this one
-		bool operator <= (const time_stamp&);
-
-		/// This operator tests if a time stamp is less (earlier) or equal to this one
-		bool operator < (const time_stamp&);
+		void operator /= (const uint32_t& divisor) { ticks /= divisor; }
+
+		/// This overloaded equality operator tests if the times are the same
+		STL_CONSTEXPR bool operator == (const time_stamp& other) const
+		{
+			return (ticks == other.ticks);
+		}
+
+		/// This operator tests if this time stamp is later than or the same as another
+		STL_CONSTEXPR bool operator >= (const time_stamp& other) const
+		{
+			return ((int32_t)(ticks - other.ticks) >= 0L);
+		}
+
+		/// This operator tests if this time stamp is later than another
+		STL_CONSTEXPR bool operator > (const time_stamp& other) const
+		{
+			return ((int32_t)(ticks - other.ticks) > 0L);
+		}
+
+		/// This operator tests if this time stamp is earlier than or the same as another
+		STL_CONSTEXPR bool operator <= (const time_stamp& other) const
+		{
+			return ((int32_t)(ticks - other.ticks) <= 0L);
+		}
+
+		/// This operator tests if this time stamp is earlier than another
+		STL_CONSTEXPR bool operator < (const time_stamp& other) const
+		{
+			return ((int32_t)(ticks - other.ticks) < 0L);
+		}
 
 		// This declaration gives permission for objects of class task_timer to access
 		// the private and/or protected data belonging to objects of this class
@@ -142,14 +244,75 @@ class time_stamp
 };
 
 
+//--------------------------------------------------------------------------------------
+/** This function makes a time stamp holding the given number of microseconds.
+ *  @param microsec The number of microseconds
+ *  @return A time stamp holding that time
+ */
+
+inline STL_CONSTEXPR time_stamp time_us (uint32_t microsec)
+{
+	return (time_stamp (STL_US_TO_TICKS (microsec)));
+}
+
+
+//--------------------------------------------------------------------------------------
+/** This function makes a time stamp holding the given number of milliseconds.
+ *  @param millisec The number of milliseconds
+ *  @return A time stamp holding that time
+ */
+
+inline STL_CONSTEXPR time_stamp time_ms (uint32_t millisec)
+{
+	return (time_stamp (STL_MS_TO_TICKS (millisec)));
+}
+
+
+//--------------------------------------------------------------------------------------
+/** This function makes a time stamp holding the given number of seconds.
+ *  @param sec The number of seconds
+ *  @return A time stamp holding that time
+ */
+
+inline STL_CONSTEXPR time_stamp time_sec (uint16_t sec)
+{
+	return (time_stamp (STL_SEC_TO_TICKS (sec)));
+}
+
+
+#if (__cplusplus >= 201103L)
+//--------------------------------------------------------------------------------------
+// These suffixes make time stamps from constants, as in 'time_stamp interval = 10_ms;'
+
+/// This suffix makes a time stamp holding a number of microseconds
+constexpr time_stamp operator"" _us (unsigned long long microsec)
+{
+	return (time_us ((uint32_t)microsec));
+}
+
+/// This suffix makes a time stamp holding a number of milliseconds
+constexpr time_stamp operator"" _ms (unsigned long long millisec)
+{
+	return (time_ms ((uint32_t)millisec));
+}
+
+/// This suffix makes a time stamp holding a number of seconds
+constexpr time_stamp operator"" _s (unsigned long long sec)
+{
+	return (time_sec ((uint16_t)sec));
+}
+#endif // C++11
+
+
 //--------------------------------------------------------------------------------------
 /** This class implements a timer to synchronize the operation of tasks on an AVR. The
- *  timer is implemented as a combination of a 16-bit hardware timer (Timer 1 is the 
- *  usual choice) and a 16-bit overflow counter. The two timers' data is combined to
- *  produce a 32-bit time count which is used to decide when tasks run. WARNING: This
- *  timer does not keep track of the time of day, and it overflows after a little more
- *  than an hour of use. Another version of the stl_timer can be used when longer time
- *  periods need to be kept track of, to lower precision. 
+ *  timer is implemented as a combination of a 16-bit hardware timer (Timer 3, or Timer
+ *  1 if there's no Timer 3) and a 32-bit overflow counter. The low 32 bits of the 
+ *  combined count are put into time stamps, which are used to decide when tasks run
+ *  and wrap around every 35.8 minutes at 16 MHz (see time_stamp). The whole 48-bit 
+ *  count, from get_ticks(), doesn't wrap for 4.4 years, so it can be used to measure
+ *  long times such as the length of a plot or a data logging run. This timer does not
+ *  keep track of the time of day. 
  */
 
 class task_timer
@@ -162,9 +325,13 @@ class task_timer
 		task_timer (void);					/// Constructor creates an empty timer
 		void save_time_stamp (time_stamp&);	/// Save current time in a timestamp
 		time_stamp& get_time_now (void);	/// Get the current time
+		uint64_t get_ticks (void);			/// Get the whole 48-bit tick count
 
 		/// This method sets the current time to the time in the given time stamp
 		bool set_time (time_stamp&);
+
+		// This method arms an interrupt which wakes the processor at the given time
+		void set_wake_up (const time_stamp&);
 };
 
 //--------------------------------------------------------------------------------------
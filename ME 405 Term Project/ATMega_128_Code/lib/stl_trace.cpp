@@ -0,0 +1,140 @@
+//*************************************************************************************
+/** \file stl_trace.cpp
+ *    This file contains the trace ring which is declared in stl_trace.h, and the
+ *    functions which empty it and dump it as a binary block.
+ *
+ *  Revisions:
+ *    \li 06-26-2011 Original file
+ *
+ *  License:
+ *    This file is released under the Lesser GNU Public License, version 2. This
+ *    program is intended for educational use only, but it is not limited thereto.
+ */
+//*************************************************************************************
+
+#include <stdlib.h>
+#include <avr/io.h>
+#include <avr/interrupt.h>
+#include "base_text_serial.h"				// Base class for various serial devices
+#include "telemetry_records.h"				// For the CRC which protects the dump
+#include "stl_trace.h"						// Header for this file
+
+
+/// This is the ring of events, the oldest of which are written over by the newest
+stl_trace_event stl_trace_ring[STL_TRACE_EVENTS];
+
+/// This is the index in the ring at which the next event will be put
+uint8_t stl_trace_next = 0;
+
+/// This flag is set when the ring has filled up and old events are being written over
+bool stl_trace_wrapped = false;
+
+/// This is the serial port to which the ring is dumped when the program stops
+static base_text_serial* p_post_mortem_port = NULL;
+
+
+//-------------------------------------------------------------------------------------
+/** This function writes some bytes to a serial device without changing them, and adds
+ *  them to a CRC.
+ *  @param serial A reference to the serial-type object to which to write
+ *  @param p_data A pointer to the bytes
+ *  @param size The number of bytes
+ *  @param crc The CRC of the bytes written before these
+ *  @return The CRC including these bytes
+ */
+
+static uint16_t write_bytes (base_text_serial& serial, const void* p_data, uint8_t size,
+							 uint16_t crc)
+{
+	for (uint8_t index = 0; index < size; index++)
+	{
+		uint8_t data = ((const uint8_t*)p_data)[index];
+		serial.putchar ((char)data);
+		crc = tlm_crc16_update (crc, data);
+	}
+	return (crc);
+}
+
+
+//-------------------------------------------------------------------------------------
+/** This function empties the trace ring, so that the next dump holds only the events
+ *  recorded after now.
+ */
+
+void stl_trace_clear (void)
+{
+	uint8_t temp_sreg = SREG;				// Store interrupt flag status
+	cli ();									// Prevent interruption
+	stl_trace_next = 0;
+	stl_trace_wrapped = false;
+	SREG = temp_sreg;						// Re-enable interrupts if they were on
+}
+
+
+//-------------------------------------------------------------------------------------
+/** This function writes the events in the trace ring as one binary block, laid out as
+ *  described in stl_trace_records.h, oldest event first. The tasks don't run while it
+ *  is being written, so they can't add events to it; an interrupt service routine
+ *  which records events while the block is written may cause the oldest ones sent to
+ *  be newer than they should be.
+ *  @param serial A reference to the serial-type object to which to write
+ */
+
+void stl_trace_dump (base_text_serial& serial)
+{
+	uint8_t temp_sreg = SREG;				// Store interrupt flag status
+	cli ();									// Prevent interruption
+	uint8_t next = stl_trace_next;
+	bool wrapped = stl_trace_wrapped;
+	SREG = temp_sreg;						// Re-enable interrupts if they were on
+
+	stl_trace_header header;
+	header.magic[0] = STL_TRACE_MAGIC_0;
+	header.magic[1] = STL_TRACE_MAGIC_1;
+	header.version = STL_TRACE_VERSION;
+	header.events = wrapped ? STL_TRACE_EVENTS : next;
+	header.wrapped = wrapped ? 1 : 0;
+	header.ticks_per_sec = F_CPU / 8UL;
+
+	// When the ring has wrapped, the oldest event is the one which will be written over
+	uint8_t index = wrapped ? next : 0;
+	uint16_t crc = write_bytes (serial, &header, sizeof (header), 0xFFFF);
+	for (uint8_t count = 0; count < header.events; count++)
+	{
+		crc = write_bytes (serial, &stl_trace_ring[index], sizeof (stl_trace_event), crc);
+		if (++index >= STL_TRACE_EVENTS)
+		{
+			index = 0;
+		}
+	}
+	serial.putchar ((char)(crc & 0xFF));
+	serial.putchar ((char)(crc >> 8));
+}
+
+
+//-------------------------------------------------------------------------------------
+/** This function sets the serial port to which the trace ring is dumped by
+ *  stl_trace_post_mortem(). The port must be one which can send with interrupts
+ *  turned off, as rs232 does.
+ *  @param p_serial A pointer to the serial port, or NULL for no post mortem dump
+ */
+
+void stl_trace_set_port (base_text_serial* p_serial)
+{
+	p_post_mortem_port = p_serial;
+}
+
+
+//-------------------------------------------------------------------------------------
+/** This function dumps the trace ring to the port given to stl_trace_set_port(), if
+ *  any. It's called by stl_task::error_stop() after interrupts have been turned off,
+ *  so the dump shows the events which led up to the error.
+ */
+
+void stl_trace_post_mortem (void)
+{
+	if (p_post_mortem_port != NULL)
+	{
+		stl_trace_dump (*p_post_mortem_port);
+	}
+}
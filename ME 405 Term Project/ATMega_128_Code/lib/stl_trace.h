@@ -0,0 +1,117 @@
+//*************************************************************************************
+/** \file stl_trace.h
+ *    This file contains a trace ring which records events, such as the state
+ *    transitions of tasks, in RAM as they happen. Printing each transition to a serial
+ *    port at 9600 baud takes about a millisecond per character, which changes the
+ *    timing of everything being traced; recording an event here only copies a few
+ *    bytes, so a machine can be traced while it's running normally. The ring holds
+ *    the most recent STL_TRACE_EVENTS events, older ones being written over. It can be
+ *    dumped as a binary block whenever it's wanted, and stl_task::error_stop() dumps
+ *    it before stopping the processor, so the events which led to the error can be
+ *    seen. The block layout is in stl_trace_records.h, and tools/trace_decode.cpp
+ *    turns it into a time line for each task.
+ *
+ *  Usage:
+ *    Define STL_TRACE in the Makefile, and each stl_task records its state transitions
+ *    with a payload set by set_trace_payload(). Other code can record events of its
+ *    own with stl_trace_record(). Call stl_trace_set_port() to choose the serial port
+ *    to which error_stop() dumps the ring, and stl_trace_dump() to dump it at any
+ *    other time. Events may be recorded by interrupt service routines too.
+ *
+ *  Revisions:
+ *    \li 06-26-2011 Original file
+ *    \li 06-27-2011 The overflow counter is declared by stl_timer.h
+ *
+ *  License:
+ *    This file is released under the Lesser GNU Public License, version 2. This
+ *    program is intended for educational use only, but it is not limited thereto.
+ */
+//*************************************************************************************
+
+/// This define prevents this .h file from being included more than once in a .cc file
+#ifndef _STL_TRACE_H_
+#define _STL_TRACE_H_
+
+#include <stdint.h>
+#include <avr/io.h>
+#include <avr/interrupt.h>
+#include "base_text_serial.h"				// For dumping the ring
+#include "stl_timer.h"						// For the timer's registers
+#include "stl_trace_records.h"				// Layout of the events and the dump
+
+
+/** This is the number of events kept in the ring. Each costs 8 bytes of SRAM, and
+ *  there can't be more than 255.
+ */
+#ifndef STL_TRACE_EVENTS
+	#define STL_TRACE_EVENTS		32
+#endif
+
+#if (STL_TRACE_EVENTS > 255)
+	#error STL_TRACE_EVENTS must be 255 or less
+#endif
+
+
+/// This is the ring of events, declared in stl_trace.cpp
+extern stl_trace_event stl_trace_ring[STL_TRACE_EVENTS];
+
+/// This is the index in the ring at which the next event will be put
+extern uint8_t stl_trace_next;
+
+/// This flag is set when the ring has filled up and old events are being written over
+extern bool stl_trace_wrapped;
+
+
+//-------------------------------------------------------------------------------------
+/** This function records one event in the trace ring. The time is taken from the task
+ *  timer's hardware counter and overflow counter, as task_timer::get_time_now() does,
+ *  but without making a time stamp of it. Interrupts are held off while the time is
+ *  read and a place in the ring is claimed, so events may be recorded from interrupt
+ *  service routines as well.
+ *  @param task The serial number of the task, or another number for other events
+ *  @param from The state the task was in
+ *  @param to The state the task is going to
+ *  @param payload A number to be kept with the event
+ */
+
+static inline void stl_trace_record (uint8_t task, uint8_t from, uint8_t to,
+									 uint16_t payload)
+{
+	uint8_t temp_sreg = SREG;				// Store interrupt flag status
+	cli ();									// Prevent interruption
+	stl_trace_event* p_event = &stl_trace_ring[stl_trace_next];
+	uint16_t ticks = TMR_TCNT_REG;
+	uint8_t overflows = (uint8_t)ust_overflows;
+	if ((TMR_OVF_TIFR & (1 << TMR_OVF_FLAG)) && !(ticks & 0x8000))
+	{
+		overflows++;						// Overflowed, but the ISR hasn't run yet
+	}
+	if (++stl_trace_next >= STL_TRACE_EVENTS)
+	{
+		stl_trace_next = 0;
+		stl_trace_wrapped = true;
+	}
+	SREG = temp_sreg;						// Re-enable interrupts if they were on
+
+	p_event->ticks = ticks;
+	p_event->overflows = overflows;
+	p_event->task = task;
+	p_event->from = from;
+	p_event->to = to;
+	p_event->payload = payload;
+}
+
+
+// This function empties the trace ring
+void stl_trace_clear (void);
+
+// This function writes the trace ring as a binary block
+void stl_trace_dump (base_text_serial&);
+
+// This function sets the serial port to which the ring is dumped after an error
+void stl_trace_set_port (base_text_serial*);
+
+// This function dumps the ring to the port set by stl_trace_set_port(), if any
+void stl_trace_post_mortem (void);
+
+#endif // _STL_TRACE_H_
@@ -0,0 +1,78 @@
+//*************************************************************************************
+/** \file stl_trace_records.h
+ *    This file defines the events which are kept in the trace ring of stl_trace.h and
+ *    the binary block in which the ring is dumped. It uses only standard C types so
+ *    that it can be included both by the AVR program and by the decoder program which
+ *    runs on a PC (see tools/trace_decode.cpp).
+ *
+ *    Each event's time is the task timer's 16-bit hardware count and the low byte of
+ *    its overflow count, so it wraps around every 8.4 seconds (at 16 MHz); the decoder
+ *    puts the events on one time line by assuming that less than that passes between
+ *    one event and the next.
+ *
+ *  Block format:
+ *    The block is a stl_trace_header, the events in the order in which they happened,
+ *    oldest first, and a 16-bit CRC of everything before it, computed as for
+ *    telemetry frames (see telemetry_records.h) and sent low byte first. It isn't
+ *    encoded in any way; the decoder finds it in a stream of other text by its
+ *    header. All multi-byte numbers are little endian, which is the native byte order
+ *    of both the AVR and PC processors.
+ *
+ *  Revisions:
+ *    \li 06-26-2011 Original file
+ *
+ *  License:
+ *    This file is released under the Lesser GNU Public License, version 2. This
+ *    program is intended for educational use only, but it is not limited thereto.
+ */
+//*************************************************************************************
+
+/// This define prevents this .h file from being included more than once in a .cc file
+#ifndef _STL_TRACE_RECORDS_H_
+#define _STL_TRACE_RECORDS_H_
+
+#include <stdint.h>
+
+
+/// This macro packs a structure so that it has the same layout on the AVR and the PC
+#define STL_TRACE_PACKED __attribute__ ((packed))
+
+/// These are the first bytes of a trace block, which the decoder looks for
+#define STL_TRACE_MAGIC_0	'T'
+#define STL_TRACE_MAGIC_1	'r'
+
+/// This is the version of the block layout, which changes if the events change
+#define STL_TRACE_VERSION	1
+
+
+//-------------------------------------------------------------------------------------
+/** This structure is the start of a trace block.
+ */
+
+typedef struct
+{
+	uint8_t magic[2];				///< STL_TRACE_MAGIC_0 and STL_TRACE_MAGIC_1
+	uint8_t version;				///< STL_TRACE_VERSION
+	uint8_t events;					///< Number of events which follow
+	uint8_t wrapped;				///< Nonzero if older events were written over
+	uint32_t ticks_per_sec;			///< Number of timer ticks per second
+} STL_TRACE_PACKED stl_trace_header;
+
+
+//-------------------------------------------------------------------------------------
+/** This structure holds one event. Events recorded by stl_task are state transitions,
+ *  from one state of a task to another; a program can record events of its own with
+ *  any states and payload it likes.
+ */
+
+typedef struct
+{
+	uint16_t ticks;					///< Timer hardware count when the event happened
+	uint8_t overflows;				///< Low byte of the timer's overflow count
+	uint8_t task;					///< Serial number of the task
+	uint8_t from;					///< State the task was in
+	uint8_t to;						///< State the task went to
+	uint16_t payload;				///< Number given by the task, or 0
+} STL_TRACE_PACKED stl_trace_event;
+
+#endif // _STL_TRACE_RECORDS_H_
@@ -0,0 +1,107 @@
+//*************************************************************************************
+/** \file telemetry.cpp
+ *    This file contains a class which sends binary telemetry records through a serial
+ *    port. The records are CRC-checked and COBS-framed so that they can share the port
+ *    with ordinary text output. 
+ *
+ *  Revisions:
+ *    \li 06-07-2011 Original file
+ *    \li 06-30-2011 Dropped frames use up a sequence number, so the decoder sees them
+ *
+ *  License:
+ *    This file is released under the Lesser GNU Public License, version 2. This
+ *    program is intended for educational use only, but it is not limited thereto.
+ */
+//*************************************************************************************
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <avr/io.h>
+#include "rs232int.h"						// Header for the serial port being used
+#include "telemetry_records.h"				// Layouts of the records which are sent
+#include "telemetry.h"						// Header for this file
+
+
+//-------------------------------------------------------------------------------------
+/** This constructor creates a telemetry channel which uses the given serial port. 
+ *  Telemetry is disabled until enable() is called. 
+ *  @param a_serial A pointer to the serial port through which records will be sent
+ */
+
+telemetry::telemetry (rs232* a_serial)
+{
+	p_serial = a_serial;
+	enabled = false;
+	sequence = 0;
+	frames_sent = 0;
+	frames_dropped = 0;
+}
+
+
+//-------------------------------------------------------------------------------------
+/** This method sends one record as a frame. The frame, holding the record type, a 
+ *  sequence number, the data, and a CRC, is COBS encoded and sent between two zero 
+ *  bytes. A frame of n bytes is encoded as n + 1 bytes, since frames are too short to
+ *  need more than one COBS block. A frame which is dropped still uses up a sequence
+ *  number, so that the decoder sees a gap in the sequence for each one. 
+ *  @param type The type of record being sent, from enum tlm_record_type
+ *  @param p_data A pointer to the record's data
+ *  @param length The number of bytes of data, no more than TLM_MAX_PAYLOAD
+ *  @return True if the frame was sent, false if it was dropped or telemetry is off
+ */
+
+bool telemetry::send (uint8_t type, const void* p_data, uint8_t length)
+{
+	uint8_t frame[TLM_MAX_FRAME];			// The frame before it's encoded
+	uint8_t frame_size;						// Number of bytes in the frame
+	uint16_t crc = 0xFFFF;					// CRC of the frame so far
+
+	if (!enabled || length > TLM_MAX_PAYLOAD)
+	{
+		return (false);
+	}
+
+	// Make sure the whole encoded frame and its delimiters will fit in the buffer
+	frame_size = length + 4;
+	if (p_serial->tx_space () < frame_size + 3)
+	{
+		sequence++;
+		frames_dropped++;
+		return (false);
+	}
+
+	// Put together the frame and compute its CRC
+	frame[0] = type;
+	frame[1] = sequence++;
+	for (uint8_t index = 0; index < length; index++)
+	{
+		frame[index + 2] = ((const uint8_t*)p_data)[index];
+	}
+	for (uint8_t index = 0; index < length + 2; index++)
+	{
+		crc = tlm_crc16_update (crc, frame[index]);
+	}
+	frame[length + 2] = (uint8_t)(crc & 0xFF);
+	frame[length + 3] = (uint8_t)(crc >> 8);
+
+	// Send the frame, COBS encoded. Each zero byte is replaced by a code byte giving
+	// the distance to the next zero, and a code byte is put in front of the data
+	p_serial->putchar (0);
+	uint8_t block_start = 0;
+	for (uint8_t index = 0; index <= frame_size; index++)
+	{
+		if (index == frame_size || frame[index] == 0)
+		{
+			p_serial->putchar (index - block_start + 1);
+			while (block_start < index)
+			{
+				p_serial->putchar (frame[block_start++]);
+			}
+			block_start = index + 1;
+		}
+	}
+	p_serial->putchar (0);
+
+	frames_sent++;
+	return (true);
+}
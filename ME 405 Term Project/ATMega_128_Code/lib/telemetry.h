@@ -0,0 +1,82 @@
+//*************************************************************************************
+/** \file telemetry.h
+ *    This file contains a class which sends binary telemetry records through a serial
+ *    port. Binary records are much shorter than the same numbers written as text with
+ *    the "<<" operators, so many more samples per second fit through a slow serial
+ *    link. The records are framed so that they can share the port with ordinary text
+ *    output; the record layouts and framing are described in telemetry_records.h.
+ *
+ *  Revisions:
+ *    \li 06-07-2011 Original file
+ *
+ *  License:
+ *    This file is released under the Lesser GNU Public License, version 2. This
+ *    program is intended for educational use only, but it is not limited thereto.
+ */
+//*************************************************************************************
+
+/// This define prevents this .h file from being included more than once in a .cc file
+#ifndef _TELEMETRY_H_
+#define _TELEMETRY_H_
+
+#include "rs232int.h"						// Header for the serial port being used
+#include "telemetry_records.h"				// Layouts of the records which are sent
+
+
+//-------------------------------------------------------------------------------------
+/** This class sends framed, CRC-checked binary records through an rs232 port. Each
+ *  call to send() puts one complete frame into the port's transmit buffer. If there
+ *  isn't room in the buffer for the whole frame, the frame is dropped and counted 
+ *  rather than being sent in pieces or holding up the caller, so telemetry can never
+ *  stall the control tasks. Telemetry starts out disabled, and send() does nothing
+ *  until enable() is called. 
+ */
+
+class telemetry
+{
+	protected:
+		/// This is a pointer to the serial port through which records are sent
+		rs232* p_serial;
+
+		/// This flag is true when records are to be sent
+		bool enabled;
+
+		/// This counts the frames sent or dropped, so the decoder can detect lost ones
+		uint8_t sequence;
+
+		/// This is the number of frames which have been sent
+		uint16_t frames_sent;
+
+		/// This is the number of frames dropped because the port was too busy
+		uint16_t frames_dropped;
+
+	public:
+		// The constructor saves the serial port to be used
+		telemetry (rs232*);
+
+		// This method sends one record, if telemetry is enabled
+		bool send (uint8_t, const void*, uint8_t);
+
+		/** This method turns the sending of records on or off.
+		 *  @param on_or_off True to send records, false to ignore calls to send()
+		 */
+		void enable (bool on_or_off) { enabled = on_or_off; }
+
+		/** This method tells whether records are being sent.
+		 *  @return True if telemetry is enabled
+		 */
+		bool is_enabled (void) { return (enabled); }
+
+		/** This method returns the number of frames which have been sent.
+		 *  @return The number of frames sent
+		 */
+		uint16_t get_frames_sent (void) { return (frames_sent); }
+
+		/** This method returns the number of frames which were dropped because there
+		 *  wasn't room for them in the serial port's transmit buffer.
+		 *  @return The number of frames dropped
+		 */
+		uint16_t get_frames_dropped (void) { return (frames_dropped); }
+};
+
+#endif // _TELEMETRY_H_
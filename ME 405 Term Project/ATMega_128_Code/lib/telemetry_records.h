@@ -0,0 +1,127 @@
+//*************************************************************************************
+/** \file telemetry_records.h
+ *    This file defines the binary records which are sent by the telemetry channel in
+ *    telemetry.h, and the checksum used to protect them. It uses only standard C
+ *    types so that it can be included both by the AVR program and by the decoder
+ *    program which runs on a PC (see tools/telemetry_decode.cpp).
+ *
+ *  Frame format:
+ *    Each record is sent as one frame. The frame holds a record type byte, a sequence
+ *    number byte which counts up by one for each frame, the record's data, and a 16-bit
+ *    CRC of all the preceding bytes, low byte first. A frame which the sender has to
+ *    drop because its serial port is busy uses up a sequence number too, so each one
+ *    shows up at the decoder as a gap in the sequence. The frame is then encoded
+ *    with Consistent Overhead Byte Stuffing (COBS) so that it contains no zero bytes,
+ *    and a zero byte is sent before and after it. Because ASCII text never contains
+ *    zero bytes either, text written to the same serial port lands between frames,
+ *    where the decoder can print it as text. All multi-byte numbers are little endian,
+ *    which is the native byte order of both the AVR and PC processors.
+ *
+ *  Revisions:
+ *    \li 06-07-2011 Original file
+ *    \li 06-16-2011 The PID record holds the integral term rather than an error sum
+ *    \li 06-30-2011 Dropped frames use up sequence numbers
+ *
+ *  License:
+ *    This file is released under the Lesser GNU Public License, version 2. This
+ *    program is intended for educational use only, but it is not limited thereto.
+ */
+//*************************************************************************************
+
+/// This define prevents this .h file from being included more than once in a .cc file
+#ifndef _TELEMETRY_RECORDS_H_
+#define _TELEMETRY_RECORDS_H_
+
+#include <stdint.h>
+
+
+/// This macro packs a structure so that it has the same layout on the AVR and the PC
+#define TLM_PACKED __attribute__ ((packed))
+
+/// This is the largest number of data bytes which any record may hold
+#define TLM_MAX_PAYLOAD		32
+
+/// This is the size of a frame before COBS encoding: type, sequence, data, and CRC
+#define TLM_MAX_FRAME		(TLM_MAX_PAYLOAD + 4)
+
+
+//-------------------------------------------------------------------------------------
+/** This enumeration lists the types of record which can be sent. The type number is
+ *  the first byte of each frame.
+ */
+
+enum tlm_record_type
+{
+	TLM_REC_TIME = 1,			///< Time stamp and clock rate, sent when telemetry starts
+	TLM_REC_ENCODERS = 2,		///< Both encoder counts at one instant
+	TLM_REC_PID_STATE = 3		///< The state of one PID controller
+};
+
+
+//-------------------------------------------------------------------------------------
+/** This record holds a raw time stamp and the number of timer ticks per second, so
+ *  that the decoder can convert the raw times in other records into seconds.
+ */
+
+typedef struct
+{
+	uint32_t time;					///< Raw time from time_stamp::get_raw_time()
+	uint32_t ticks_per_sec;			///< Number of time stamp ticks per second
+} TLM_PACKED tlm_time_rec;
+
+
+//-------------------------------------------------------------------------------------
+/** This record holds the readings of both encoders, taken at the same time.
+ */
+
+typedef struct
+{
+	uint32_t time;					///< Raw time at which the counts were read
+	int32_t encoder_1;				///< Count from the first (radius) encoder
+	int32_t encoder_2;				///< Count from the second (angle) encoder
+} TLM_PACKED tlm_encoders_rec;
+
+
+//-------------------------------------------------------------------------------------
+/** This record holds the state of one PID controller after its latest run.
+ */
+
+typedef struct
+{
+	uint32_t time;					///< Raw time at which the record was made
+	uint8_t motor;					///< Which motor the controller runs, 1 or 2
+	uint8_t running;				///< Nonzero if the controller is driving the motor
+	int32_t setpoint;				///< The position the controller is aiming for
+	int32_t encoder;				///< The most recently measured position
+	int32_t error_sum;				///< The integral term, in duty cycle units
+	int16_t output;					///< Signed duty cycle sent to the motor driver
+} TLM_PACKED tlm_pid_rec;
+
+
+//-------------------------------------------------------------------------------------
+/** This function updates a 16-bit CRC with one byte of data. It computes the CRC-16
+ *  used by XMODEM and CCITT, with the polynomial 0x1021; the CRC should be started
+ *  at 0xFFFF. A bitwise loop is used rather than a table to save program memory.
+ *  @param crc The CRC of the bytes before this one
+ *  @param data The next byte of data
+ *  @return The CRC including the new byte
+ */
+
+static inline uint16_t tlm_crc16_update (uint16_t crc, uint8_t data)
+{
+	crc ^= (uint16_t)data << 8;
+	for (uint8_t bit = 0; bit < 8; bit++)
+	{
+		if (crc & 0x8000)
+		{
+			crc = (crc << 1) ^ 0x1021;
+		}
+		else
+		{
+			crc <<= 1;
+		}
+	}
+	return (crc);
+}
+
+#endif // _TELEMETRY_RECORDS_H_
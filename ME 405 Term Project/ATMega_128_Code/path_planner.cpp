@@ -0,0 +1,435 @@
+//======================================================================================
+/** \file path_planner.cpp is a buffer of lines waiting to be drawn, with a look-ahead
+*	planner which lets the pen go through corners without stopping.
+*
+*  Revisions:
+*    \li  06-20-11  Original file, with the path limits moved here from trajectory
+*
+*  License:
+*    This file released under the Lesser GNU Public License. The program is intended
+*    for educational use only, but its use is not restricted thereto.
+*/
+//======================================================================================
+
+	// System headers included with < >
+	#include <stdlib.h>							// Standard C library
+	#include <avr/io.h>							// Input-output ports, special registers
+	#include <math.h>							// Contains Math Functions
+
+	// User written headers included with " "
+	#include "path_planner.h"					// include own header file
+
+	// The closest the origin is taken to be to a line, in tenths, to keep the limits finite
+	#define MIN_RADIUS 1.0
+	// The fraction of each acceleration and jerk limit kept for speeding up along the line;
+	// the rest is left for the way radius and angle curve away from straight lines
+	#define CURVE_RESERVE 0.5
+	// Bisection steps used to find the fastest speed which can be reached in a distance
+	#define REACH_STEPS 16
+
+//-----------------------------------------------------------------------------------------
+/** The constructor makes an empty planner. The limits must be set before lines are added.
+*/
+path_planner::path_planner(void)
+{
+	for (uint8_t axis = 0; axis < 2; axis++)
+	{
+		limits[axis].speed = 0.0;
+		limits[axis].accel = 0.0;
+		limits[axis].jerk = 0.0;
+		limits[axis].corner = 0.0;
+	}
+	tail = 0;
+	count = 0;
+}
+
+/** set_limits sets the limits on one motor's motion.
+*	@param axis 0 for the radius (motor 1) or 1 for the angle (motor 2)
+*	@param speed The fastest speed, in encoder counts per second
+*	@param accel The largest acceleration, in counts per second squared
+*	@param jerk The largest jerk, in counts per second cubed
+*	@param corner The largest sudden change of speed when the pen turns a corner, in counts
+*	per second; zero makes the pen stop at every corner
+*/
+void path_planner::set_limits(uint8_t axis, float speed, float accel, float jerk, float corner)
+{
+	limits[axis].speed = speed;
+	limits[axis].accel = accel;
+	limits[axis].jerk = jerk;
+	limits[axis].corner = corner;
+}
+
+/** add_line puts a line at the end of the buffer and plans the speeds of all the lines
+*	which haven't been started yet.
+*	@param x0 The x coordinate of the start of the line, in tenths of an inch
+*	@param y0 The y coordinate of the start of the line
+*	@param x1 The x coordinate of the end of the line
+*	@param y1 The y coordinate of the end of the line
+*	@return True if the line was added, false if the buffer is full
+*/
+bool path_planner::add_line(int16_t x0, int16_t y0, int16_t x1, int16_t y1)
+{
+	if (Is_Full())
+	{
+		return (false);
+	}
+
+	uint8_t index = (tail + count) % PLANNER_BLOCKS;
+	path_block& block = blocks[index];
+	block.x_start = x0;
+	block.y_start = y0;
+	block.x_end = x1;
+	block.y_end = y1;
+	float dx = x1 - x0;
+	float dy = y1 - y0;
+	block.length = sqrt(dx * dx + dy * dy);
+	if (block.length > 0.0)
+	{
+		block.x_unit = dx / block.length;
+		block.y_unit = dy / block.length;
+	}
+	else
+	{
+		block.x_unit = 0.0;
+		block.y_unit = 0.0;
+	}
+	path_limits(block);
+	block.entry = 0.0;
+	block.exit = 0.0;
+	block.busy = false;
+	block.max_entry = 0.0;
+	block.connected = false;
+
+	// A line which carries on from the last one can be started without stopping
+	if (count > 0)
+	{
+		path_block& before = blocks[(index + PLANNER_BLOCKS - 1) % PLANNER_BLOCKS];
+		if (before.x_end == x0 && before.y_end == y0)
+		{
+			block.connected = true;
+			block.max_entry = junction_speed(before, block);
+		}
+	}
+	count++;
+	recalculate();
+	return (true);
+}
+
+/** current returns the oldest line in the buffer, the one being drawn or to be drawn next.
+*	@return A pointer to the line, or NULL if the buffer is empty
+*/
+path_block* path_planner::current(void)
+{
+	return ((count > 0) ? &blocks[tail] : NULL);
+}
+
+/** start_current marks the oldest line as being drawn, so its speeds won't be changed any
+*	more, and fixes the speed at which it ends: the entry speed of the line after it, if
+*	that one carries on from it, or else zero.
+*	@return The speed at the end of the line, in tenths per second
+*/
+float path_planner::start_current(void)
+{
+	path_block& block = blocks[tail];
+	block.busy = true;
+	block.exit = 0.0;
+	if (count > 1)
+	{
+		path_block& after = blocks[next_index(tail)];
+		if (after.connected)
+		{
+			block.exit = after.entry;
+		}
+	}
+	return (block.exit);
+}
+
+/** finish_current removes the oldest line from the buffer once it has been drawn.
+*/
+void path_planner::finish_current(void)
+{
+	if (count > 0)
+	{
+		tail = next_index(tail);
+		count--;
+	}
+}
+
+/** clear throws away all the lines in the buffer, as when drawing is stopped.
+*/
+void path_planner::clear(void)
+{
+	tail = 0;
+	count = 0;
+}
+
+/** path_limits turns the motors' limits into limits on the pen's motion along a line.
+*	Along a straight line at a distance h from the origin, the derivatives of radius and
+*	angle with respect to distance along the line are largest where the line comes
+*	closest to the origin, so bounds on them there bound the motors' speed, acceleration
+*	and jerk everywhere on the line. Because the angle and radius curve, fast motion uses
+*	up some of the acceleration and jerk limits even at a steady speed along the line;
+*	the speed is cut until at least CURVE_RESERVE of each limit is left for speeding up
+*	and slowing down.
+*	@param block The line, with its start, unit vector and length filled in
+*/
+void path_planner::path_limits(path_block& block)
+{
+	// Closest approach of the line segment, and of the whole line, to the origin
+	float along = -(block.x_start * block.x_unit + block.y_start * block.y_unit);
+	along = (along < 0.0) ? 0.0 : ((along > block.length) ? block.length : along);
+	float r_min = hypot(block.x_start + block.x_unit * along, block.y_start + block.y_unit * along);
+	float h = fabs(block.x_start * block.y_unit - block.y_start * block.x_unit);
+	if (r_min < MIN_RADIUS)
+	{
+		r_min = MIN_RADIUS;
+	}
+	if (h > r_min)
+	{
+		h = r_min;
+	}
+
+	// Bounds on the first three derivatives of angle (g) and radius (q) along the line
+	float r_2 = r_min * r_min;
+	float g_1 = h / r_2;
+	float g_2 = 2.0 * h / (r_2 * r_min);
+	if (g_2 > 1.0 / r_2)
+	{
+		g_2 = 1.0 / r_2;
+	}
+	float g_3 = 6.0 * h / (r_2 * r_2);
+	float q_2 = h * h / (r_2 * r_min);
+	float q_3 = 3.0 * h * h / (r_2 * r_2);
+
+	// The limits in tenths of an inch, as if the line were straight in radius and angle
+	float r_speed_max = limits[0].speed / COUNTS_PER_TENTH;
+	float r_accel_max = limits[0].accel / COUNTS_PER_TENTH;
+	float r_jerk_max = limits[0].jerk / COUNTS_PER_TENTH;
+	float t_speed_max = limits[1].speed / COUNTS_PER_RADIAN;
+	float t_accel_max = limits[1].accel / COUNTS_PER_RADIAN;
+	float t_jerk_max = limits[1].jerk / COUNTS_PER_RADIAN;
+
+	float speed = r_speed_max;
+	float accel_budget = r_accel_max;
+	float jerk_budget = r_jerk_max;
+	if (g_1 > 0.0)
+	{
+		if (g_1 * speed > t_speed_max)
+		{
+			speed = t_speed_max / g_1;
+		}
+		if (g_1 * accel_budget > t_accel_max)
+		{
+			accel_budget = t_accel_max / g_1;
+		}
+		if (g_1 * jerk_budget > t_jerk_max)
+		{
+			jerk_budget = t_jerk_max / g_1;
+		}
+	}
+
+	// Slow down until the curvature leaves enough acceleration and jerk to work with
+	float accel = accel_budget;
+	float jerk = jerk_budget;
+	for (uint8_t tries = 0; tries < 20; tries++)
+	{
+		float speed_2 = speed * speed;
+		accel = r_accel_max - q_2 * speed_2;
+		jerk = r_jerk_max - 3.0 * q_2 * speed * accel - q_3 * speed_2 * speed;
+		if (g_1 > 0.0)
+		{
+			float t_accel = (t_accel_max - g_2 * speed_2) / g_1;
+			if (t_accel < accel)
+			{
+				accel = t_accel;
+			}
+			float t_jerk = (t_jerk_max - 3.0 * g_2 * speed * accel - g_3 * speed_2 * speed) / g_1;
+			if (t_jerk < jerk)
+			{
+				jerk = t_jerk;
+			}
+		}
+		if (accel >= CURVE_RESERVE * accel_budget && jerk >= CURVE_RESERVE * jerk_budget)
+		{
+			break;
+		}
+		speed *= 0.8;
+	}
+	block.speed = speed;
+	block.accel = accel;
+	block.jerk = jerk;
+}
+
+/** junction_speed works out the fastest the pen may go through the corner between two
+*	lines. Turning the corner changes the pen's direction suddenly, so the radius speed
+*	jumps by (p . du) / |p| and the angle speed by (p x du) / |p|^2 for each tenth per
+*	second of pen speed, where p is the corner and du is the change in the unit vector.
+*	The pen speed is cut until neither jump is more than the motor's corner limit. A
+*	corner with no turn in it is limited only by the speeds of the two lines.
+*	@param before The line coming into the corner
+*	@param after The line leaving it
+*	@return The largest speed through the corner, in tenths per second
+*/
+float path_planner::junction_speed(const path_block& before, const path_block& after)
+{
+	float speed = (before.speed < after.speed) ? before.speed : after.speed;
+	if (before.length <= 0.0 || after.length <= 0.0)
+	{
+		return (0.0);
+	}
+
+	float x = after.x_start;
+	float y = after.y_start;
+	float r_squared = x * x + y * y;
+	if (r_squared < MIN_RADIUS * MIN_RADIUS)
+	{
+		return (0.0);
+	}
+	float dx = after.x_unit - before.x_unit;
+	float dy = after.y_unit - before.y_unit;
+	float r_jump = COUNTS_PER_TENTH * fabs(x * dx + y * dy) / sqrt(r_squared);
+	float t_jump = COUNTS_PER_RADIAN * fabs(x * dy - y * dx) / r_squared;
+
+	if (r_jump * speed > limits[0].corner)
+	{
+		speed = limits[0].corner / r_jump;
+	}
+	if (t_jump * speed > limits[1].corner)
+	{
+		speed = limits[1].corner / t_jump;
+	}
+	return (speed);
+}
+
+/** recalculate plans the entry speeds of the lines which haven't been started. The reverse
+*	pass goes from the last line back, making sure each can slow from its entry speed to
+*	the next one's in its length, with the last line stopping at its end. The forward pass
+*	then makes sure each line can speed up from its entry speed to the next one's. The line
+*	being drawn can't be changed, so the one after it starts at the speed it ends with;
+*	if none is being drawn, the pen starts from rest.
+*/
+void path_planner::recalculate(void)
+{
+	uint8_t first = tail;
+	uint8_t lines = count;
+	if (lines > 0 && blocks[tail].busy)
+	{
+		first = next_index(tail);
+		lines--;
+	}
+	if (lines == 0)
+	{
+		return;
+	}
+
+	// Reverse pass
+	float next_entry = 0.0;
+	for (uint8_t step = lines; step-- > 0; )
+	{
+		path_block& block = blocks[(first + step) % PLANNER_BLOCKS];
+		block.entry = reachable(next_entry, block.length, block.accel, block.jerk,
+								block.max_entry);
+		next_entry = block.connected ? block.entry : 0.0;
+	}
+
+	// Forward pass, starting from the end of the line being drawn, or from rest
+	path_block* p_before = NULL;
+	for (uint8_t step = 0; step < lines; step++)
+	{
+		path_block& block = blocks[(first + step) % PLANNER_BLOCKS];
+		if (step == 0)
+		{
+			block.entry = (blocks[tail].busy && block.connected) ? blocks[tail].exit : 0.0;
+		}
+		else if (block.connected)
+		{
+			float reach = reachable(p_before->entry, p_before->length, p_before->accel,
+									p_before->jerk, block.entry);
+			if (reach < block.entry)
+			{
+				block.entry = reach;
+			}
+		}
+		p_before = &block;
+	}
+}
+
+/** change_time works out how an S curve changes speed: the jerk phases either ramp the
+*	acceleration up to its limit, with a phase at that limit between them, or are cut
+*	short if the new speed is reached first.
+*	@param change The change in speed, positive
+*	@param accel The largest acceleration
+*	@param jerk The largest jerk
+*	@param t_jerk Set to the time spent in each of the two jerk phases
+*	@param t_accel Set to the time spent at the largest acceleration
+*	@return The time the change takes
+*/
+float path_planner::change_time(float change, float accel, float jerk, float& t_jerk,
+								float& t_accel)
+{
+	if (change <= 0.0)
+	{
+		t_jerk = 0.0;
+		t_accel = 0.0;
+	}
+	else if (change * jerk >= accel * accel)
+	{
+		t_jerk = accel / jerk;
+		t_accel = change / accel - t_jerk;
+	}
+	else
+	{
+		t_jerk = sqrt(change / jerk);
+		t_accel = 0.0;
+	}
+	return (2.0 * t_jerk + t_accel);
+}
+
+/** change_distance works out how far the pen goes while changing speed along an S curve.
+*	The speed changes symmetrically about the middle, so the average speed is halfway
+*	between the two, whether speeding up or slowing down.
+*	@param from The speed at the start
+*	@param to The speed at the end
+*	@param accel The largest acceleration
+*	@param jerk The largest jerk
+*	@return The distance
+*/
+float path_planner::change_distance(float from, float to, float accel, float jerk)
+{
+	float t_jerk, t_accel;
+	float change = (to > from) ? (to - from) : (from - to);
+	return ((from + to) / 2.0 * change_time(change, accel, jerk, t_jerk, t_accel));
+}
+
+/** reachable finds the fastest speed, up to a cap, which can be reached from a given speed
+*	within a distance. Since slowing down takes the same distance as speeding up, this is
+*	also the fastest speed from which the pen can slow to the given speed.
+*	@param from The speed at one end
+*	@param length The distance available
+*	@param accel The largest acceleration
+*	@param jerk The largest jerk
+*	@param cap The speed not to go over
+*	@return The speed at the other end
+*/
+float path_planner::reachable(float from, float length, float accel, float jerk, float cap)
+{
+	if (cap <= from || change_distance(from, cap, accel, jerk) <= length)
+	{
+		return (cap);
+	}
+	float low = from;
+	float high = cap;
+	for (uint8_t step = 0; step < REACH_STEPS; step++)
+	{
+		float middle = (low + high) / 2.0;
+		if (change_distance(from, middle, accel, jerk) <= length)
+		{
+			low = middle;
+		}
+		else
+		{
+			high = middle;
+		}
+	}
+	return (low);
+}
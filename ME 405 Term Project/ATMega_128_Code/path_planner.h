@@ -0,0 +1,124 @@
+//======================================================================================
+/** \file  path_planner.h
+ *	path_planner.h contains the specifications for a buffer of lines waiting to be drawn
+ *	and the look-ahead planner which works out how fast the pen can go through the
+ *	corners between them.
+ *
+ *  Revisions:
+ *    \li  06-20-11  Original file
+ *
+ *  License:
+ *    This file released under the Lesser GNU Public License. The program is intended
+ *    for educational use only, but its use is not restricted thereto.
+ */
+//======================================================================================
+
+// This define prevents this .h file from being included more than once in a .cpp file
+#ifndef _path_planner_H_
+#define _path_planner_H_
+
+#include "kinematics.h"					// Encoder counts per tenth and per radian
+
+/// How many lines the planner can hold, including the one being drawn
+#define PLANNER_BLOCKS			16
+
+
+/// This structure holds the limits on one motor's motion, in encoder counts per second
+/// and its first two derivatives
+typedef struct
+{
+	float speed;								///< Fastest speed, counts/s
+	float accel;								///< Largest acceleration, counts/s^2
+	float jerk;									///< Largest jerk, counts/s^3
+	float corner;								///< Largest sudden change of speed at a corner, counts/s
+} axis_limits;
+
+
+/// This structure holds one line in the planner, with the speeds planned for it. Lengths
+/// are in tenths of an inch and speeds in tenths per second.
+typedef struct
+{
+	int16_t x_start;							///< Start of the line, x
+	int16_t y_start;							///< Start of the line, y
+	int16_t x_end;								///< End of the line, x
+	int16_t y_end;								///< End of the line, y
+	float x_unit;								///< Unit vector along the line, x part
+	float y_unit;								///< Unit vector along the line, y part
+	float length;								///< Length of the line
+	float speed;								///< Fastest speed along this line
+	float accel;								///< Largest acceleration along this line, per second
+	float jerk;									///< Largest jerk along this line, per second squared
+	float max_entry;							///< Fastest the pen may cross the corner into this line
+	float entry;								///< Speed planned at the start of the line
+	float exit;									///< Speed at the end, fixed when the line is started
+	bool connected;								///< True if it starts where the line before it ends
+	bool busy;									///< True while the line is being drawn
+} path_block;
+
+
+//-------------------------------------------------------------------------------------
+/** path_planner keeps a ring buffer of the lines waiting to be drawn. A line which starts
+ *	where the one before it ends is drawn without lifting the pen, and the pen needn't
+ *	stop at the corner: as in GRBL, each corner gets a largest speed, and each time a line
+ *	is added a reverse pass makes sure the pen can always slow down in time for the
+ *	corners ahead and stop at the end of the last line, then a forward pass makes sure it
+ *	can speed up as planned. The corner speeds come from the r-theta kinematics of the
+ *	plotter rather than from x and y: when the pen turns a corner its radius and angle
+ *	speeds jump, by amounts which depend on where the corner is as well as how sharp it
+ *	is, and each jump is kept within that motor's corner limit. The speed, acceleration
+ *	and jerk limits along each line are worked out from the motors' limits in the same
+ *	way, allowing for how radius and angle curve along a straight line.
+ */
+class path_planner
+{
+	protected:
+		/// limits on the radius (motor 1) and angle (motor 2) axes
+		axis_limits limits[2];
+		/// the lines, oldest first from tail
+		path_block blocks[PLANNER_BLOCKS];
+		/// index of the oldest line, the one being drawn or about to be
+		uint8_t tail;
+		/// number of lines in the buffer
+		uint8_t count;
+
+		void path_limits(path_block& block);
+
+		float junction_speed(const path_block& before, const path_block& after);
+
+		void recalculate(void);
+
+		/// next_index returns the index of the buffer slot after the given one
+		uint8_t next_index(uint8_t index) { return ((index + 1) % PLANNER_BLOCKS); }
+
+	public:
+		path_planner(void);
+
+		void set_limits(uint8_t axis, float speed, float accel, float jerk, float corner);
+
+		bool add_line(int16_t x0, int16_t y0, int16_t x1, int16_t y1);
+
+		path_block* current(void);
+
+		float start_current(void);
+
+		void finish_current(void);
+
+		void clear(void);
+
+		/// Is_Empty tells whether there are no lines left to draw
+		bool Is_Empty(void) { return (count == 0); }
+
+		/// Is_Full tells whether the buffer can't take another line
+		bool Is_Full(void) { return (count >= PLANNER_BLOCKS); }
+
+		/// Get_Count returns the number of lines in the buffer
+		uint8_t Get_Count(void) { return (count); }
+
+		static float change_time(float change, float accel, float jerk, float& t_jerk, float& t_accel);
+
+		static float change_distance(float from, float to, float accel, float jerk);
+
+		static float reachable(float from, float length, float accel, float jerk, float cap);
+};
+
+#endif // _path_planner_H_
@@ -1,6 +1,10 @@
 	/** \file point.cpp is a task which moves a R-THETA plotter to a specific location.
 	*	it can then make a dot or not as specified.
 	*
+	*  Revisions:
+	*    \li  06-19-11  Encoder counts are worked out by trajectory::to_counts
+	*    \li  06-21-11  Encoder counts come from the fixed point kinematics
+	*
 	*  License:
 	*    This file released under the Lesser GNU Public License. The program is intended
 	*    for educational use only, but its use is not restricted thereto. 
@@ -11,7 +15,6 @@
 	#include <stdlib.h>							// Standard C library
 	#include <avr/io.h>							// Input-output ports, special registers
 	#include <avr/interrupt.h>					// Interrupt handling functions
-	#include <math.h>							// Contains Math Functions
 	
 	// User written headers included with " "
 	#include "rs232int.h"						// Include header for serial port class
@@ -21,6 +24,7 @@
 	#include "da_motor.h"						// so PID objects don't get mad
 	#include "task_PID.h"						// allows task_lines to call methods belonging to task_PID
 	#include "servo.h"							// allows pen actuation
+	#include "kinematics.h"						// converts x and y to encoder counts
 	#include "point.h"							// include own header file
 	
 //-----------------------------------------------------------------------------------------
@@ -61,24 +65,10 @@ void point::run()
 		case 0:
 			if (Make_Point || Go_To)
 			{
-				x_squared = pow((float)X, 2L);
-				y_squared = pow((float)Y, 2L);
-				encoder_goal_r  = (int32_t)sqrt(x_squared + y_squared);
-				encoder_goal_r = encoder_goal_r*2350; //took this step out of the sqrt() function to minimize chance for math errors
-				
-				// calculate theta position, including oddballs THETA = 0 or 90 degrees
-				if ((X == 0) && Y)
-				{
-					encoder_goal_theta = 925000;   
-				}
-				else if (Y == 0)
-				{
-					encoder_goal_theta = 0;
-				}
-				else
-				{
-					encoder_goal_theta = (int32_t)( atan(((float)Y)/((float)X)) * 588873);
-				}
+				// calculate r and theta positions the same way trajectory does, so lines
+				// start right where the pen was sent
+				kinematics::to_counts((int32_t)X << KIN_FRAC_BITS, (int32_t)Y << KIN_FRAC_BITS,
+									  encoder_goal_r, encoder_goal_theta);
 				
 				// set setpoints and engage motors
 				PID_1->set_setpoint(encoder_goal_r);
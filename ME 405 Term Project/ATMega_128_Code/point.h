@@ -37,10 +37,6 @@ class point
 		int32_t encoder_now_r;	
 		/// desired R value in ticks						
 		int32_t encoder_goal_r;	
-		/// allow pythagorean theorum without data loss						
-		float x_squared;				
-		/// allow pythagorean theorum without data loss				
-		float y_squared;								
 		
 		
 	public:
@@ -54,6 +50,9 @@ class point
 		bool Are_We_There(void);
 
 		void Go_Make_A_Dot(uint16_t Xcoord, uint16_t Ycoord);
+
+		/// this method tells if the pen is down making a dot, which is timed by counting calls to run()
+		bool Making_Dot(void) { return (point_state == 2); }
 };
 
 #endif // _point_H_
@@ -6,10 +6,27 @@
 	#include "servo.h"							// include own header file
 
 
+	// Timer 3 counts at the CPU clock over 8 for the task timer. The servo shares it by
+	// making its pulses with compare match A: the OC3A pin is set at one match and
+	// cleared at the next, and the interrupt moves the match along each time
+	#define SERVO_TICKS_PER_US	(F_CPU / 8000000UL)	///< Timer 3 counts per microsecond
+	#define SERVO_FRAME_US		20000				///< Time from one pulse to the next
+	#define SERVO_UNIT_US		64					///< Pulse length per unit of pen height
+
+	#ifdef ETIMSK									// The ATmega128 keeps Timer 3's
+		#define SERVO_TIMSK		ETIMSK				// interrupt enables in ETIMSK, the
+	#else											// ATmega1281 in TIMSK3
+		#define SERVO_TIMSK		TIMSK3
+	#endif
+
+	/// Length of the pulse, in Timer 3 counts, read by the compare match interrupt
+	static volatile uint16_t pulse_ticks = (5 + 1) * SERVO_UNIT_US * SERVO_TICKS_PER_US;
+
 //-------------------------------------------------------------------------------------
 
 /** CONSTRUCTOR initializes PWM output for a RC servo motor. and sets pen height to a safe
-*	value. Servo output pins are A0 & A1
+*	value. The pulses come out of pin E3 (OC3A). Timer 3 is left counting as the task
+*	timer set it up, so the task timer must be made first.
 *	@param p_serial_port Serial object so we can write to screen
 */
 servo::servo(base_text_serial* p_serial_port)
@@ -23,25 +40,30 @@ servo::servo(base_text_serial* p_serial_port)
 	// set PWM output pin
 	DDRE |= (1<<PIN3);
 	
-	// Set timer3 to operate in non-inverting fast PWM mode 
-	TCCR3A |= (1<<COM3A1)|(1<<COM3B1);
-	TCCR3A &= ~(1<<COM3A0); // Set to 0 to operate in non-inverting mode
-	TCCR3A &= ~(1<<COM3B0); // Set to 0 to operate in non-inverting mode
-	
-	// set up fast PWM and initialize timer
-	//8 bit
-	TCCR3A |= (1<<WGM30);  // set timer1 to 8 bit fast PWM [step 1]
-	TCCR3A &= ~(1<<WGM31); // set timer1 to 8 bit fast PWM [step 2]
-	TCCR3B |= (1<<WGM32);
-	TCCR3B &= ~(1<<WGM33); // set timer1 for 8 bit fast PWM 
-	
-	// prescalar settings clk/64
-	TCCR3B |= (1<<CS30); // controls the prescaler bit 0
-	TCCR3B &= ~(1<<CS31); // controls the prescaler bit 1
-	TCCR3B |= (1<<CS32); // controls the prescaler bit 2
-	
 	// initialize variables
-	OCR3AL = 5;			// initialize servo duty cycle
+	Set_Pulse(5);		// initialize servo pulse width
+	
+	// Start the first pulse soon: set OC3A at the next compare match, then let the
+	// interrupt take over
+	uint8_t temp_sreg = SREG;
+	cli ();
+	OCR3A = TCNT3 + SERVO_TICKS_PER_US * 100;
+	TCCR3A |= (1<<COM3A1)|(1<<COM3A0);
+	SERVO_TIMSK |= (1<<OCIE3A);
+	SREG = temp_sreg;
+}
+
+void servo::Set_Pulse(uint8_t width)
+{
+	// The fast PWM mode Timer 3 ran in before held OC3A high from BOTTOM through the match
+	// with OCR3AL, one count more than the number, so the pulse is one unit longer than
+	// the width as it was then. A width of 0 still gives a 64 us pulse; a step of no
+	// counts would leave the pin high for a whole wrap of the timer
+	uint16_t ticks = ((uint16_t)width + 1) * (SERVO_UNIT_US * SERVO_TICKS_PER_US);
+	uint8_t temp_sreg = SREG;
+	cli ();
+	pulse_ticks = ticks;
+	SREG = temp_sreg;
 }
 
 void servo::Set_Angle(uint16_t angle)
@@ -49,14 +71,27 @@ void servo::Set_Angle(uint16_t angle)
 	if (angle <= 360)
 	{
 		ServoSet = (uint8_t)angle*255/720;
-		OCR3AL = ServoSet;
+		Set_Pulse(ServoSet);
 	}
 }
 
 
-	
-	
-	
-	
-	
-	
\ No newline at end of file
+/** \cond NOT_ENABLED  (This ISR is not to be documented by Doxygen)
+*	This interrupt service routine runs at each Timer 3 compare match A. If the match
+*	just set the OC3A pin, a pulse has begun, so the next match is put at its end and
+*	will clear the pin; otherwise the next match is put at the start of the next pulse.
+*/
+ISR (TIMER3_COMPA_vect)
+{
+	if (TCCR3A & (1<<COM3A0))
+	{
+		OCR3A += pulse_ticks;
+		TCCR3A &= ~(1<<COM3A0);					// clear OC3A at the next match
+	}
+	else
+	{
+		OCR3A += (uint16_t)(SERVO_FRAME_US * SERVO_TICKS_PER_US) - pulse_ticks;
+		TCCR3A |= (1<<COM3A0);					// set OC3A at the next match
+	}
+}
+/** \endcond */
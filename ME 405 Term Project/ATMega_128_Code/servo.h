@@ -4,8 +4,8 @@
 //-------------------------------------------------------------------------------------
 /** Servo.cpp is a class with methods and inline methods for controlling a hobby servo
 *	to raise and lower the pen for making points and lines. The servo is connected to
-*	a PWM output pin on the microcontroller and the angle is related to the duty cycle
-*	of the PWM signal.
+*	a PWM output pin on the microcontroller and the angle is related to the length
+*	of the pulses, which are timed by Timer 3 alongside the task timer.
 */
 class servo
 {
@@ -13,7 +13,7 @@ class servo
 		/// This servo driver class needs a pointer to the serial port so it can talk 
 		base_text_serial* ptr_2_serial;	
 		
-		/// buffer for converting angle to PWM duty cycle
+		/// buffer for converting angle to pulse width
 		uint8_t ServoSet;
 		
 	public:
@@ -28,17 +28,23 @@ class servo
 		*/
 		void Set_Angle(uint16_t angle);
 		
+		/** Set_Pulse sets the length of the pulses sent to the servo, which sets its angle.
+		*	@param width: the pulse length as the OCR3AL numbers were when the servo had Timer 3
+		*	to itself in 8-bit fast PWM at clk/1024; the pulse is (width + 1) * 64 us long
+		*/
+		void Set_Pulse(uint8_t width);
+		
 		/// Pen_Up raises the pen
-		void Pen_Up(void) { OCR3AL = 7; }
+		void Pen_Up(void) { Set_Pulse(7); }
 		
 		/// Fine_Line touches pen to paper softly
-		void Fine_Line(void) { OCR3AL = 20; }
+		void Fine_Line(void) { Set_Pulse(20); }
 		
 		/// Heavy_Line plants the pen hard
-		void Heavy_Line(void) { OCR3AL = 11; }
+		void Heavy_Line(void) { Set_Pulse(11); }
 		
 		/// Change_Pen raises the pen extra high to change it easier
-		void Change_Pen(void) { OCR3AL = 5; }
+		void Change_Pen(void) { Set_Pulse(5); }
 };
 
 
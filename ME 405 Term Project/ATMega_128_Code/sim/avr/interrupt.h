@@ -0,0 +1,32 @@
+//*************************************************************************************
+/** \file sim/avr/interrupt.h
+ *    This file takes the place of avr-libc's avr/interrupt.h when the plotter's code
+ *    is built for simulation. An interrupt service routine becomes an ordinary C
+ *    function named after its vector, which the simulator calls when the interrupt's
+ *    flag and enable bits are set and interrupts are enabled.
+ *
+ *  Revisions:
+ *    \li 06-17-2011 Original file
+ *
+ *  License:
+ *    This file is released under the Lesser GNU Public License, version 2. This
+ *    program is intended for educational use only, but it is not limited thereto.
+ */
+//*************************************************************************************
+
+/// This define prevents this .h file from being included more than once in a .cc file
+#ifndef _SIM_AVR_INTERRUPT_H_
+#define _SIM_AVR_INTERRUPT_H_
+
+#include <avr/io.h>
+
+/// This macro makes an interrupt service routine into a function the simulator calls
+#define ISR(vector)		extern "C" void vector (void); extern "C" void vector (void)
+
+/// Enables interrupts; any which are pending run after the next register access
+#define sei()			sim_sei ()
+
+/// Disables interrupts
+#define cli()			sim_cli ()
+
+#endif // _SIM_AVR_INTERRUPT_H_
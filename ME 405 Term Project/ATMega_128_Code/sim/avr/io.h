@@ -0,0 +1,346 @@
+//*************************************************************************************
+/** \file sim/avr/io.h
+ *    This file takes the place of avr-libc's avr/io.h when the plotter's code is built
+ *    for simulation on a PC. It makes the names of the ATmega1281's registers refer to
+ *    the simulated registers in sim_avr.h, and defines the names of their bits and of
+ *    the interrupt vectors. Only the registers used by the simulated code are here;
+ *    using any other is a compile error, which shows what needs to be modelled next.
+ *
+ *  Revisions:
+ *    \li 06-17-2011 Original file
+ *    \li 06-29-2011 The USARTs' registers, and a type for pointers to registers
+ *    \li 06-29-2011 Timer 1's count, overflow flag and interrupt enable
+ *    \li 06-29-2011 Pin change interrupts on ports A and C, as on the encoder slave
+ *    \li 06-29-2011 Bit test macros, which the SD card driver waits on the SPI port with
+ *
+ *  License:
+ *    This file is released under the Lesser GNU Public License, version 2. This
+ *    program is intended for educational use only, but it is not limited thereto.
+ */
+//*************************************************************************************
+
+/// This define prevents this .h file from being included more than once in a .cc file
+#ifndef _SIM_AVR_IO_H_
+#define _SIM_AVR_IO_H_
+
+#include <stdint.h>
+#include "sim_avr.h"
+
+/// The simulated processor is an ATmega1281, as on the plotter's master board
+#define __AVR_ATmega1281__	1
+
+/// Some code checks this to see if it's being compiled for an AVR
+#define __AVR				1
+
+// The simulated registers, each declared in sim_avr.cpp
+extern sim_register<uint8_t> sim_reg_SREG;
+extern sim_register<uint8_t> sim_reg_SPCR;
+extern sim_register<uint8_t> sim_reg_SPSR;
+extern sim_register<uint8_t> sim_reg_SPDR;
+extern sim_register<uint8_t> sim_reg_DDRA;
+extern sim_register<uint8_t> sim_reg_DDRB;
+extern sim_register<uint8_t> sim_reg_DDRC;
+extern sim_register<uint8_t> sim_reg_DDRD;
+extern sim_register<uint8_t> sim_reg_DDRE;
+extern sim_register<uint8_t> sim_reg_PORTA;
+extern sim_register<uint8_t> sim_reg_PORTB;
+extern sim_register<uint8_t> sim_reg_PORTC;
+extern sim_register<uint8_t> sim_reg_PORTD;
+extern sim_register<uint8_t> sim_reg_PORTE;
+extern sim_register<uint8_t> sim_reg_PINA;
+extern sim_register<uint8_t> sim_reg_PINB;
+extern sim_register<uint8_t> sim_reg_PINC;
+extern sim_register<uint8_t> sim_reg_PIND;
+extern sim_register<uint8_t> sim_reg_PINE;
+extern sim_register<uint8_t> sim_reg_TCCR1A;
+extern sim_register<uint8_t> sim_reg_TCCR1B;
+extern sim_register<uint16_t> sim_reg_TCNT1;
+extern sim_register<uint8_t> sim_reg_OCR1AL;
+extern sim_register<uint8_t> sim_reg_OCR1BL;
+extern sim_register<uint8_t> sim_reg_TIMSK1;
+extern sim_register<uint8_t> sim_reg_TIFR1;
+extern sim_register<uint8_t> sim_reg_TCCR2A;
+extern sim_register<uint8_t> sim_reg_TCCR2B;
+extern sim_register<uint8_t> sim_reg_TCNT2;
+extern sim_register<uint8_t> sim_reg_OCR2A;
+extern sim_register<uint8_t> sim_reg_TIMSK2;
+extern sim_register<uint8_t> sim_reg_TIFR2;
+extern sim_register<uint8_t> sim_reg_TCCR3A;
+extern sim_register<uint8_t> sim_reg_TCCR3B;
+extern sim_register<uint16_t> sim_reg_TCNT3;
+extern sim_register<uint16_t> sim_reg_OCR3A;
+extern sim_register<uint16_t> sim_reg_OCR3C;
+extern sim_register<uint8_t> sim_reg_TIMSK3;
+extern sim_register<uint8_t> sim_reg_TIFR3;
+extern sim_register<uint8_t> sim_reg_EIMSK;
+extern sim_register<uint8_t> sim_reg_EICRB;
+extern sim_register<uint8_t> sim_reg_EIFR;
+extern sim_register<uint8_t> sim_reg_PCICR;
+extern sim_register<uint8_t> sim_reg_PCIFR;
+extern sim_register<uint8_t> sim_reg_PCMSK0;
+extern sim_register<uint8_t> sim_reg_PCMSK2;
+extern sim_register<uint8_t> sim_reg_SMCR;
+extern sim_register<uint8_t> sim_reg_UCSR0A;
+extern sim_register<uint8_t> sim_reg_UCSR0B;
+extern sim_register<uint8_t> sim_reg_UCSR0C;
+extern sim_register<uint8_t> sim_reg_UBRR0L;
+extern sim_register<uint8_t> sim_reg_UBRR0H;
+extern sim_register<uint8_t> sim_reg_UDR0;
+extern sim_register<uint8_t> sim_reg_UCSR1A;
+extern sim_register<uint8_t> sim_reg_UCSR1B;
+extern sim_register<uint8_t> sim_reg_UCSR1C;
+extern sim_register<uint8_t> sim_reg_UBRR1L;
+extern sim_register<uint8_t> sim_reg_UBRR1H;
+extern sim_register<uint8_t> sim_reg_UDR1;
+
+#define SREG		sim_reg_SREG
+#define SPCR		sim_reg_SPCR
+#define SPSR		sim_reg_SPSR
+#define SPDR		sim_reg_SPDR
+#define DDRA		sim_reg_DDRA
+#define DDRB		sim_reg_DDRB
+#define DDRC		sim_reg_DDRC
+#define DDRD		sim_reg_DDRD
+#define DDRE		sim_reg_DDRE
+#define PORTA		sim_reg_PORTA
+#define PORTB		sim_reg_PORTB
+#define PORTC		sim_reg_PORTC
+#define PORTD		sim_reg_PORTD
+#define PORTE		sim_reg_PORTE
+#define PINA		sim_reg_PINA
+#define PINB		sim_reg_PINB
+#define PINC		sim_reg_PINC
+#define PIND		sim_reg_PIND
+#define PINE		sim_reg_PINE
+#define TCCR1A		sim_reg_TCCR1A
+#define TCCR1B		sim_reg_TCCR1B
+#define TCNT1		sim_reg_TCNT1
+#define OCR1AL		sim_reg_OCR1AL
+#define OCR1BL		sim_reg_OCR1BL
+#define TIMSK1		sim_reg_TIMSK1
+#define TIFR1		sim_reg_TIFR1
+#define TCCR2A		sim_reg_TCCR2A
+#define TCCR2B		sim_reg_TCCR2B
+#define TCNT2		sim_reg_TCNT2
+#define OCR2A		sim_reg_OCR2A
+#define TIMSK2		sim_reg_TIMSK2
+#define TIFR2		sim_reg_TIFR2
+#define TCCR3A		sim_reg_TCCR3A
+#define TCCR3B		sim_reg_TCCR3B
+#define TCNT3		sim_reg_TCNT3
+#define OCR3A		sim_reg_OCR3A
+#define OCR3C		sim_reg_OCR3C
+#define TIMSK3		sim_reg_TIMSK3
+#define TIFR3		sim_reg_TIFR3
+#define EIMSK		sim_reg_EIMSK
+#define EICRB		sim_reg_EICRB
+#define EIFR		sim_reg_EIFR
+#define PCICR		sim_reg_PCICR
+#define PCIFR		sim_reg_PCIFR
+#define PCMSK0		sim_reg_PCMSK0
+#define PCMSK2		sim_reg_PCMSK2
+#define SMCR		sim_reg_SMCR
+#define UCSR0A		sim_reg_UCSR0A
+#define UCSR0B		sim_reg_UCSR0B
+#define UCSR0C		sim_reg_UCSR0C
+#define UBRR0L		sim_reg_UBRR0L
+#define UBRR0H		sim_reg_UBRR0H
+#define UDR0		sim_reg_UDR0
+#define UCSR1A		sim_reg_UCSR1A
+#define UCSR1B		sim_reg_UCSR1B
+#define UCSR1C		sim_reg_UCSR1C
+#define UBRR1L		sim_reg_UBRR1L
+#define UBRR1H		sim_reg_UBRR1H
+#define UDR1		sim_reg_UDR1
+
+/// Drivers such as base232 which keep pointers to registers keep pointers to these
+/// objects, as reading or writing a register must go through the simulator
+#define UART_REG_PTR	sim_register<uint8_t>*
+
+// Port pin numbers
+#define PIN0		0
+#define PIN1		1
+#define PIN2		2
+#define PIN3		3
+#define PIN4		4
+#define PIN5		5
+#define PIN6		6
+#define PIN7		7
+#define DDB0		0
+#define DDB1		1
+#define DDB2		2
+
+// Status register
+#define SREG_I		7
+
+// SPI control and status registers
+#define SPIE		7
+#define SPE			6
+#define DORD		5
+#define MSTR		4
+#define CPOL		3
+#define CPHA		2
+#define SPR1		1
+#define SPR0		0
+#define SPIF		7
+#define WCOL		6
+#define SPI2X		0
+
+// Timer 1, which makes the motor PWM, or on the encoder slave runs its clock
+#define COM1A1		7
+#define COM1A0		6
+#define COM1B1		5
+#define COM1B0		4
+#define WGM11		1
+#define WGM10		0
+#define ICNC1		7
+#define ICES1		6
+#define WGM13		4
+#define WGM12		3
+#define CS12		2
+#define CS11		1
+#define CS10		0
+#define TOIE1		0
+#define TOV1		0
+
+// Timer 2, which times the gaps between SPI bytes
+#define WGM21		1
+#define WGM20		0
+#define CS22		2
+#define CS21		1
+#define CS20		0
+#define OCIE2A		1
+#define OCF2A		1
+
+// Timer 3, the task timer, which also times the servo's pulses
+#define COM3A1		7
+#define COM3A0		6
+#define COM3B1		5
+#define COM3B0		4
+#define WGM31		1
+#define WGM30		0
+#define WGM33		4
+#define WGM32		3
+#define CS32		2
+#define CS31		1
+#define CS30		0
+#define OCIE3C		3
+#define OCIE3B		2
+#define OCIE3A		1
+#define TOIE3		0
+#define OCF3C		3
+#define OCF3A		1
+#define TOV3		0
+
+// External interrupts on port E
+#define INT5		5
+#define INT4		4
+#define ISC51		3
+#define ISC50		2
+#define ISC41		1
+#define ISC40		0
+#define INTF5		5
+#define INTF4		4
+
+// Pin change interrupts 0 and 2, which watch ports A and C as on the encoder slave's
+// ATmega164P; the ATmega1281's watch other pins, which the plotter doesn't use
+#define PCIE2		2
+#define PCIE0		0
+#define PCIF2		2
+#define PCIF0		0
+#define PCINT0		0
+#define PCINT1		1
+#define PCINT16		0
+#define PCINT17		1
+
+// The USARTs; the bits are numbered the same in both
+#define RXC0		7
+#define TXC0		6
+#define UDRE0		5
+#define FE0			4
+#define DOR0		3
+#define UPE0		2
+#define U2X0		1
+#define MPCM0		0
+#define RXCIE0		7
+#define TXCIE0		6
+#define UDRIE0		5
+#define RXEN0		4
+#define TXEN0		3
+#define UCSZ02		2
+#define RXB80		1
+#define TXB80		0
+#define UMSEL01		7
+#define UMSEL00		6
+#define UPM01		5
+#define UPM00		4
+#define USBS0		3
+#define UCSZ01		2
+#define UCSZ00		1
+#define UCPOL0		0
+
+#define RXC1		7
+#define TXC1		6
+#define UDRE1		5
+#define FE1			4
+#define DOR1		3
+#define UPE1		2
+#define U2X1		1
+#define MPCM1		0
+#define RXCIE1		7
+#define TXCIE1		6
+#define UDRIE1		5
+#define RXEN1		4
+#define TXEN1		3
+#define UCSZ12		2
+#define RXB81		1
+#define TXB81		0
+#define UMSEL11		7
+#define UMSEL10		6
+#define UPM11		5
+#define UPM10		4
+#define USBS1		3
+#define UCSZ11		2
+#define UCSZ10		1
+#define UCPOL1		0
+
+// Sleep mode control
+#define SM2			3
+#define SM1			2
+#define SM0			1
+#define SE			0
+
+// Interrupt vectors; each is a function which the simulator calls
+#define INT4_vect			sim_vector_INT4
+#define INT5_vect			sim_vector_INT5
+#define PCINT0_vect			sim_vector_PCINT0
+#define PCINT2_vect			sim_vector_PCINT2
+#define TIMER2_COMPA_vect	sim_vector_TIMER2_COMPA
+#define TIMER1_OVF_vect		sim_vector_TIMER1_OVF
+#define SPI_STC_vect		sim_vector_SPI_STC
+#define TIMER3_COMPA_vect	sim_vector_TIMER3_COMPA
+#define TIMER3_COMPC_vect	sim_vector_TIMER3_COMPC
+#define TIMER3_OVF_vect		sim_vector_TIMER3_OVF
+#define USART0_RX_vect		sim_vector_USART0_RX
+#define USART0_UDRE_vect	sim_vector_USART0_UDRE
+#define USART1_RX_vect		sim_vector_USART1_RX
+#define USART1_UDRE_vect	sim_vector_USART1_UDRE
+
+/// This macro makes a bit mask from a bit number, as in avr-libc
+#define _BV(bit)	(1 << (bit))
+
+/// These macros test a bit in a register, as in avr-libc's avr/sfr_defs.h
+#define bit_is_set(sfr, bit)	((sfr) & _BV (bit))
+#define bit_is_clear(sfr, bit)	(!((sfr) & _BV (bit)))
+
+/// This macro waits until a bit in a register is set, as in avr-libc
+#define loop_until_bit_is_set(sfr, bit)		do { } while (bit_is_clear (sfr, bit))
+
+// These number conversions are in avr-libc's stdlib.h but not in the PC's; they're
+// written out in sim_avr.cpp
+extern "C" char* utoa (unsigned int number, char* p_str, int base);
+extern "C" char* itoa (int number, char* p_str, int base);
+extern "C" char* ltoa (long number, char* p_str, int base);
+extern "C" char* ultoa (unsigned long number, char* p_str, int base);
+
+#endif // _SIM_AVR_IO_H_
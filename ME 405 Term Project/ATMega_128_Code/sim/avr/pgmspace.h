@@ -0,0 +1,33 @@
+//*************************************************************************************
+/** \file sim/avr/pgmspace.h
+ *    This file takes the place of avr-libc's avr/pgmspace.h when the plotter's code
+ *    is built for simulation. A PC has only one address space, so data which would be
+ *    in program memory is ordinary constant data, read through ordinary pointers.
+ *
+ *  Revisions:
+ *    \li 06-17-2011 Original file
+ *    \li 06-23-2011 pgm_read_ptr(), as pointers on a PC are bigger than a word
+ *
+ *  License:
+ *    This file is released under the Lesser GNU Public License, version 2. This
+ *    program is intended for educational use only, but it is not limited thereto.
+ */
+//*************************************************************************************
+
+/// This define prevents this .h file from being included more than once in a .cc file
+#ifndef _SIM_AVR_PGMSPACE_H_
+#define _SIM_AVR_PGMSPACE_H_
+
+#include <stdint.h>
+
+#define PROGMEM
+#define PGM_P					const char*
+#define PSTR(str)				(str)
+#define pgm_read_byte(addr)		(*(const uint8_t*)(addr))
+#define pgm_read_byte_near(addr)	(*(const uint8_t*)(addr))
+#define pgm_read_word(addr)		(*(const uint16_t*)(addr))
+#define pgm_read_word_near(addr)	(*(const uint16_t*)(addr))
+#define pgm_read_dword(addr)	(*(const uint32_t*)(addr))
+#define pgm_read_ptr(addr)		(*(const void* const*)(addr))
+
+#endif // _SIM_AVR_PGMSPACE_H_
@@ -0,0 +1,29 @@
+//*************************************************************************************
+/** \file sim/avr/sleep.h
+ *    This file takes the place of avr-libc's avr/sleep.h when the plotter's code is
+ *    built for simulation. Going to sleep makes simulated time skip ahead to the next
+ *    interrupt. Only idle mode is simulated, so the sleep mode setting is ignored.
+ *
+ *  Revisions:
+ *    \li 06-17-2011 Original file
+ *
+ *  License:
+ *    This file is released under the Lesser GNU Public License, version 2. This
+ *    program is intended for educational use only, but it is not limited thereto.
+ */
+//*************************************************************************************
+
+/// This define prevents this .h file from being included more than once in a .cc file
+#ifndef _SIM_AVR_SLEEP_H_
+#define _SIM_AVR_SLEEP_H_
+
+#include <avr/io.h>
+
+#define SLEEP_MODE_IDLE		0					///< The only sleep mode simulated
+
+#define set_sleep_mode(mode)	do { } while (0)
+#define sleep_enable()			(SMCR |= (1 << SE))
+#define sleep_disable()			(SMCR &= ~(1 << SE))
+#define sleep_cpu()				sim_sleep ()
+
+#endif // _SIM_AVR_SLEEP_H_
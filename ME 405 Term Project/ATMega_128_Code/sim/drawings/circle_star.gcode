@@ -0,0 +1,67 @@
+%
+(A circle of 48 chords and a five pointed star, in inches)
+G20 G90
+G28
+G0 X8.500 Y4.000
+M3
+G1 X8.487 Y4.196
+G1 X8.449 Y4.388
+G1 X8.386 Y4.574
+G1 X8.299 Y4.750
+G1 X8.190 Y4.913
+G1 X8.061 Y5.061
+G1 X7.913 Y5.190
+G1 X7.750 Y5.299
+G1 X7.574 Y5.386
+G1 X7.388 Y5.449
+G1 X7.196 Y5.487
+G1 X7.000 Y5.500
+G1 X6.804 Y5.487
+G1 X6.612 Y5.449
+G1 X6.426 Y5.386
+G1 X6.250 Y5.299
+G1 X6.087 Y5.190
+G1 X5.939 Y5.061
+G1 X5.810 Y4.913
+G1 X5.701 Y4.750
+G1 X5.614 Y4.574
+G1 X5.551 Y4.388
+G1 X5.513 Y4.196
+G1 X5.500 Y4.000
+G1 X5.513 Y3.804
+G1 X5.551 Y3.612
+G1 X5.614 Y3.426
+G1 X5.701 Y3.250
+G1 X5.810 Y3.087
+G1 X5.939 Y2.939
+G1 X6.087 Y2.810
+G1 X6.250 Y2.701
+G1 X6.426 Y2.614
+G1 X6.612 Y2.551
+G1 X6.804 Y2.513
+G1 X7.000 Y2.500
+G1 X7.196 Y2.513
+G1 X7.388 Y2.551
+G1 X7.574 Y2.614
+G1 X7.750 Y2.701
+G1 X7.913 Y2.810
+G1 X8.061 Y2.939
+G1 X8.190 Y3.087
+G1 X8.299 Y3.250
+G1 X8.386 Y3.426
+G1 X8.449 Y3.612
+G1 X8.487 Y3.804
+G1 X8.500 Y4.000
+M5
+; the star is drawn with relative moves
+G0 X4.000 Y7.200
+G91 M3
+G1 X0.705 Y-2.171
+G1 X-1.847 Y1.342
+G1 X2.283 Y0.000
+G1 X-1.847 Y-1.342
+G1 X0.705 Y2.171
+G90 M5
+G0 X1 Y1
+M2
+%
@@ -0,0 +1,801 @@
+//*************************************************************************************
+/** \file encoder_bench.cpp
+ *    This program checks the encoder slave's quadrature decoding. The pin change
+ *    interrupts in ../../ATMega_164_Code/da_encoder.cpp are built unchanged and run on
+ *    the simulated processor in sim_avr.cpp, with the bench driving the A and B lines
+ *    of both encoders on ports A and C:
+ *    \li Every entry of the 32-entry decoding table is tried, by bringing the decoder
+ *        to each state with real steps and then changing the levels. A single step
+ *        must count as the decoder used before the table did, a change of both levels
+ *        (a missed step) must count two in the direction last moved and be counted as
+ *        an error, and a glitch which leaves the levels as they were must count
+ *        nothing. After each, a missed step shows which way the decoder thinks it was
+ *        last moving.
+ *    \li Edges are replayed from a model of both motors moving at changing speeds and
+ *        reversing, as a plant stepped by the simulator, so that edges come while the
+ *        main loop and the other interrupt are running. Now and then two edges come
+ *        at once; the counts must match the motors' true positions, and the error
+ *        counts the number of those double steps. The decoder used before is fed the
+ *        same levels to show how far off it would have been.
+ *    \li Both motors are run at a steady speed with edges ever closer together, to
+ *        show how fast the interrupts can keep up before they see double steps and
+ *        then lose count.
+ *    \li Both motors follow a profile of ramps, steady speeds, reversals, a slow creep
+ *        and stops, while the main loop calls update_velocity() as the slave's does.
+ *        Every millisecond the speeds which da_encoder serves over SPI are compared
+ *        with the true speeds, and so is the difference in counts over the last
+ *        velocity window, as the master would have had to work it out before. At a
+ *        steady speed the estimate must be within a fraction of a percent; when
+ *        creeping it must still see the speed; and a stopped motor must read zero
+ *        once VEL_STOP_US has passed.
+ *
+ *    Usage: encoder_bench
+ *
+ *  Revisions:
+ *    \li 06-29-2011 Original file
+ *
+ *  License:
+ *    This file is released under the Lesser GNU Public License, version 2. This
+ *    program is intended for educational use only, but it is not limited thereto.
+ */
+//*************************************************************************************
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <string.h>
+#include <time.h>
+#include <avr/io.h>
+#include <avr/interrupt.h>
+#include "sim_avr.h"
+#include "sim_serial.h"
+#include "slave_clock.h"
+#include "da_encoder.h"
+
+
+/// Cycles given to the interrupt after the bench changes the levels in the table check
+#define BENCH_SETTLE		200
+
+/// Cycles between steps of the motor model while replaying edges
+#define BENCH_REPLAY_STEP	400
+
+/// Number of edges replayed on each axis
+#define BENCH_REPLAY_EDGES	2000000L
+
+/// One edge in this many comes together with the next, as if the interrupt were late
+#define BENCH_DOUBLE_ODDS	1000
+
+/// Cycles the main loop runs between looks at how the replay is going
+#define BENCH_MAIN_LOOP		5000
+
+/// Number of edges given to each axis at each speed when finding how fast they can go
+#define BENCH_SWEEP_EDGES	20000L
+
+/// Cycles between steps of the motor profile
+#define BENCH_PROFILE_STEP	32
+
+/// Cycles the main loop takes between calls to update_velocity()
+#define BENCH_VEL_LOOP		800
+
+/// Microseconds between comparisons of the speed estimates with the true speeds
+#define BENCH_SAMPLE_US		1000
+
+/// The decoder used before was compiled in da_encoder.cpp; this keeps the copy here
+/// from being inlined, as for the former methods in other benches
+#define FORMER_METHOD		__attribute__ ((noinline))
+
+
+/// The A and B levels, with A in bit 1 and B in bit 0, at each quarter of a cycle of
+/// forward motion
+static const uint8_t forward_levels[4] = { 0x00, 0x02, 0x03, 0x01 };
+
+/// Where each combination of levels comes in forward_levels
+static const uint8_t level_place[4] = { 0, 3, 1, 2 };
+
+/// The PIN register of each axis' port
+static const uint8_t axis_pins[2] = { SIM_PINA, SIM_PINC };
+
+/// The counts, errors and speeds which da_encoder is given pointers to
+static int32_t encoder_counts[2];
+static uint16_t encoder_errors[2];
+static int32_t velocities[2];
+
+/// The levels being driven on each axis
+static uint8_t levels[2] = { 0, 0 };
+
+
+//-------------------------------------------------------------------------------------
+/** This function is the decoder which the interrupts used before the table did, given
+ *  the old and new levels rather than reading them from the port.
+ *  @param old_levels The levels the interrupt saw last time, A in bit 1 and B in bit 0
+ *  @param new_levels The levels it sees now
+ *  @return The change in count
+ */
+
+static int8_t FORMER_METHOD former_step (uint8_t old_levels, uint8_t new_levels)
+{
+	uint8_t crap_var = new_levels + old_levels + old_levels;
+	if (new_levels + old_levels == 3)
+	{
+		return (1);
+	}
+	else if ((crap_var == 2) || (crap_var == 7))
+	{
+		return (1);
+	}
+	return (-1);
+}
+
+
+//-------------------------------------------------------------------------------------
+/** This function drives an axis' A and B lines. The interrupt doesn't run until the
+ *  simulation next lets time pass.
+ *  @param axis The axis, 0 or 1
+ *  @param new_levels The levels, A in bit 1 and B in bit 0
+ */
+
+static void set_levels (uint8_t axis, uint8_t new_levels)
+{
+	sim_set_pin (axis_pins[axis], 1, new_levels & 0x02);
+	sim_set_pin (axis_pins[axis], 0, new_levels & 0x01);
+	levels[axis] = new_levels;
+}
+
+
+//-------------------------------------------------------------------------------------
+/** This function changes an axis' levels and lets the interrupt run.
+ *  @param axis The axis, 0 or 1
+ *  @param new_levels The levels, A in bit 1 and B in bit 0
+ *  @return The change in the axis' count
+ */
+
+static int32_t step_to (uint8_t axis, uint8_t new_levels)
+{
+	int32_t before = encoder_counts[axis];
+	set_levels (axis, new_levels);
+	sim_spend (BENCH_SETTLE);
+	return (encoder_counts[axis] - before);
+}
+
+
+//-------------------------------------------------------------------------------------
+/** This function brings an axis' decoder to a state by taking real steps: it walks
+ *  forward to the levels next to the ones wanted, then steps onto them in the
+ *  direction wanted.
+ *  @param axis The axis, 0 or 1
+ *  @param forward True if the decoder is to have last moved forward
+ *  @param wanted The levels the decoder is to have last seen
+ */
+
+static void prepare (uint8_t axis, bool forward, uint8_t wanted)
+{
+	uint8_t from = forward_levels[(level_place[wanted] + (forward ? 3 : 1)) & 3];
+	while (levels[axis] != from)
+	{
+		step_to (axis, forward_levels[(level_place[levels[axis]] + 1) & 3]);
+	}
+	step_to (axis, wanted);
+}
+
+
+//-------------------------------------------------------------------------------------
+/** This structure holds the state of one motor in the model which makes the edges.
+ */
+
+typedef struct
+{
+	int64_t position;						///< True position, in counts
+	double speed;							///< Edges per model step, from -1 to 1
+	double fraction;						///< Part of an edge moved but not yet made
+	uint32_t hold;							///< Model steps until the speed changes
+	int8_t last_move;						///< Direction of the last edge, 1 or -1
+	uint32_t doubles;						///< Number of double steps made
+	int64_t former_count;					///< The count the former decoder would have
+	bool varied;							///< True if the speed changes at random
+} bench_motor;
+
+/// The two motors being modelled
+static bench_motor motors[2];
+
+/// Number of edges the model has made on each axis
+static int64_t edges_made[2];
+
+/// The model stops making edges on an axis once it has made this many, so that the
+/// bench gets control back even when the interrupts leave no time for the main loop
+static int64_t edge_limit;
+
+
+//-------------------------------------------------------------------------------------
+/** This function steps the motor model; the simulator calls it every model step. Each
+ *  motor moves by its speed, making at most one edge per step, except that now and
+ *  then, when it's moving the same way as last time, two edges come together. A motor
+ *  stops once it has made edge_limit edges.
+ *  @param dt The time step, which isn't needed as speeds are in edges per step
+ */
+
+static void motor_step (double dt)
+{
+	(void)dt;
+	for (uint8_t axis = 0; axis < 2; axis++)
+	{
+		bench_motor& motor = motors[axis];
+		if (edges_made[axis] >= edge_limit)
+		{
+			continue;
+		}
+		if (motor.varied && motor.hold-- == 0)
+		{
+			motor.speed = (rand () % 2001 - 1000) / 1000.0;
+			motor.hold = 200 + rand () % 5000;
+		}
+		motor.fraction += motor.speed;
+		if (motor.fraction < 1.0 && motor.fraction > -1.0)
+		{
+			continue;
+		}
+		int8_t move = (motor.fraction > 0.0) ? 1 : -1;
+		motor.fraction -= move;
+		uint8_t edges = 1;
+		if (motor.varied && move == motor.last_move && rand () % BENCH_DOUBLE_ODDS == 0)
+		{
+			edges = 2;
+			motor.doubles++;
+		}
+		for (uint8_t count = 0; count < edges; count++)
+		{
+			motor.position += move;
+		}
+		uint8_t new_levels = forward_levels[motor.position & 3];
+		motor.former_count += former_step (levels[axis], new_levels);
+		set_levels (axis, new_levels);
+		motor.last_move = move;
+		edges_made[axis] += edges;
+	}
+}
+
+
+//-------------------------------------------------------------------------------------
+/** This function starts the motor model with both motors where the encoders are now.
+ *  The levels are first driven to those which go with the counts, in case a check
+ *  before left them otherwise.
+ *  @param varied True to change the speeds at random, with double steps now and then
+ *  @param speed The steady speed, in edges per model step, if not varied
+ *  @param edges The number of edges to make on each axis
+ */
+
+static void start_motors (bool varied, double speed, int64_t edges)
+{
+	edge_limit = edges;
+	for (uint8_t axis = 0; axis < 2; axis++)
+	{
+		bench_motor& motor = motors[axis];
+		step_to (axis, forward_levels[encoder_counts[axis] & 3]);
+		motor.position = encoder_counts[axis];
+		motor.speed = speed;
+		motor.fraction = 0.0;
+		motor.hold = 0;
+		motor.last_move = 1;
+		motor.doubles = 0;
+		motor.former_count = encoder_counts[axis];
+		motor.varied = varied;
+		encoder_errors[axis] = 0;
+		edges_made[axis] = 0;
+	}
+}
+
+
+//-------------------------------------------------------------------------------------
+/** This enumeration gives the kinds of part of the motor profile, each of which is
+ *  checked in its own way.
+ */
+
+enum bench_kind
+{
+	KIND_RAMP,								///< Speed changing steadily
+	KIND_STEADY,							///< Speed not changing
+	KIND_CREEP,								///< Steady, with many milliseconds per edge
+	KIND_STOP,								///< Not moving
+	NUM_KINDS
+};
+
+/// The name of each kind of part of the profile
+static const char* kind_names[NUM_KINDS] = { "ramps", "steady speeds", "creeping",
+											 "stopped" };
+
+/** This structure holds one part of the motor profile, in which the speed changes in
+ *  a straight line.
+ */
+
+typedef struct
+{
+	double seconds;							///< How long the part lasts
+	double start;							///< Speed at the start, in counts per second
+	double end;								///< Speed at the end, in counts per second
+	bench_kind kind;						///< What kind of part this is
+} bench_segment;
+
+/// Number of parts in each motor's profile
+#define BENCH_SEGMENTS		8
+
+/// Each motor's profile: up to speed, reversing through zero, back to a stop, creeping
+/// along and stopping again
+static const bench_segment profiles[2][BENCH_SEGMENTS] =
+{
+	{
+		{ 0.2,      0.0,  20000.0, KIND_RAMP },
+		{ 0.3,  20000.0,  20000.0, KIND_STEADY },
+		{ 0.4,  20000.0, -20000.0, KIND_RAMP },
+		{ 0.2, -20000.0, -20000.0, KIND_STEADY },
+		{ 0.2, -20000.0,      0.0, KIND_RAMP },
+		{ 0.4,      0.0,      0.0, KIND_STOP },
+		{ 0.6,     60.0,     60.0, KIND_CREEP },
+		{ 0.6,      0.0,      0.0, KIND_STOP }
+	},
+	{
+		{ 0.1,      0.0,   5150.0, KIND_RAMP },
+		{ 0.5,   5150.0,   5150.0, KIND_STEADY },
+		{ 0.3,   5150.0,  -8230.0, KIND_RAMP },
+		{ 0.3,  -8230.0,  -8230.0, KIND_STEADY },
+		{ 0.3,  -8230.0,      0.0, KIND_RAMP },
+		{ 0.4,      0.0,      0.0, KIND_STOP },
+		{ 0.6,    -25.0,    -25.0, KIND_CREEP },
+		{ 0.4,      0.0,      0.0, KIND_STOP }
+	}
+};
+
+/// Seconds since the profile started
+static double profile_time;
+
+/// Each motor's true position in counts, with the part of a count not yet reached
+static double true_position[2];
+
+
+//-------------------------------------------------------------------------------------
+/** This function finds where a motor is in its profile.
+ *  @param axis The axis, 0 or 1
+ *  @param time Seconds since the profile started
+ *  @param p_into Where to put the seconds since the part of the profile began, or NULL
+ *  @return The part of the profile, or NULL once the profile is over
+ */
+
+static const bench_segment* profile_at (uint8_t axis, double time, double* p_into)
+{
+	for (uint8_t index = 0; index < BENCH_SEGMENTS; index++)
+	{
+		const bench_segment* p_seg = &profiles[axis][index];
+		if (time < p_seg->seconds)
+		{
+			if (p_into != NULL)
+			{
+				*p_into = time;
+			}
+			return (p_seg);
+		}
+		time -= p_seg->seconds;
+	}
+	return (NULL);
+}
+
+
+//-------------------------------------------------------------------------------------
+/** This function gives a motor's true speed.
+ *  @param axis The axis, 0 or 1
+ *  @param time Seconds since the profile started
+ *  @return The speed in counts per second
+ */
+
+static double profile_speed (uint8_t axis, double time)
+{
+	double into;
+	const bench_segment* p_seg = profile_at (axis, time, &into);
+	if (p_seg == NULL)
+	{
+		return (0.0);
+	}
+	return (p_seg->start + (p_seg->end - p_seg->start) * into / p_seg->seconds);
+}
+
+
+//-------------------------------------------------------------------------------------
+/** This function finds the fastest a motor's speed changes in its profile.
+ *  @param axis The axis, 0 or 1
+ *  @return The largest acceleration in counts per second per second
+ */
+
+static double profile_accel (uint8_t axis)
+{
+	double most = 0.0;
+	for (uint8_t index = 0; index < BENCH_SEGMENTS; index++)
+	{
+		const bench_segment* p_seg = &profiles[axis][index];
+		double accel = fabs (p_seg->end - p_seg->start) / p_seg->seconds;
+		most = (accel > most) ? accel : most;
+	}
+	return (most);
+}
+
+
+//-------------------------------------------------------------------------------------
+/** This function steps the motors along their profiles; the simulator calls it every
+ *  profile step. The speeds are low enough that no more than one edge comes in a step.
+ *  @param dt The time step in seconds
+ */
+
+static void profile_step (double dt)
+{
+	for (uint8_t axis = 0; axis < 2; axis++)
+	{
+		true_position[axis] += profile_speed (axis, profile_time + dt / 2.0) * dt;
+		int64_t reached = (int64_t)floor (true_position[axis]);
+		bench_motor& motor = motors[axis];
+		if (reached != motor.position)
+		{
+			motor.position += (reached > motor.position) ? 1 : -1;
+			set_levels (axis, forward_levels[motor.position & 3]);
+		}
+	}
+	profile_time += dt;
+}
+
+
+//-------------------------------------------------------------------------------------
+/** This structure adds up the differences between estimated and true speeds.
+ */
+
+typedef struct
+{
+	uint32_t samples;						///< Number of differences added up
+	double squares;							///< Sum of the squared differences
+	double worst;							///< Largest difference, in counts per second
+	double worst_percent;					///< Largest difference as a percent of speed
+} bench_error;
+
+
+//-------------------------------------------------------------------------------------
+/** This function adds a difference between an estimated and a true speed.
+ *  @param error Where the differences are added up
+ *  @param estimate The estimated speed in counts per second
+ *  @param truth The true speed in counts per second
+ */
+
+static void add_error (bench_error& error, double estimate, double truth)
+{
+	double difference = fabs (estimate - truth);
+	error.samples++;
+	error.squares += difference * difference;
+	if (difference > error.worst)
+	{
+		error.worst = difference;
+	}
+	if (truth != 0.0 && difference * 100.0 / fabs (truth) > error.worst_percent)
+	{
+		error.worst_percent = difference * 100.0 / fabs (truth);
+	}
+}
+
+
+//-------------------------------------------------------------------------------------
+/** This function gives the RMS of the differences added up.
+ *  @param error The differences
+ *  @return The RMS difference in counts per second
+ */
+
+static double rms_of (const bench_error& error)
+{
+	return (error.samples ? sqrt (error.squares / error.samples) : 0.0);
+}
+
+
+//-------------------------------------------------------------------------------------
+/** This function reads a clock in nanoseconds.
+ *  @return The time in nanoseconds
+ */
+
+static double bench_ns (void)
+{
+	struct timespec now;
+	clock_gettime (CLOCK_MONOTONIC, &now);
+	return (now.tv_sec * 1.0E9 + now.tv_nsec);
+}
+
+
+//-------------------------------------------------------------------------------------
+/** This function prints one line of results.
+ *  @param label What was checked
+ *  @param detail A number or two to show, or an empty string
+ *  @param good True if the check passed
+ *  @return The same as good
+ */
+
+static bool show (const char* label, const char* detail, bool good)
+{
+	printf ("%-48s %-26s %s\n", label, detail, good ? "ok" : "FAILED");
+	return (good);
+}
+
+
+//-------------------------------------------------------------------------------------
+/** The main function sets up the encoder driver and runs the checks.
+ */
+
+int main (void)
+{
+	sim_serial quiet (NULL);
+	char detail[64];
+	bool good = true;
+	bool ok;
+
+	// Both encoders start with both lines low
+	for (uint8_t axis = 0; axis < 2; axis++)
+	{
+		set_levels (axis, 0x00);
+	}
+	slave_clock_init ();
+	da_encoder encoders (&quiet, &encoder_counts[0], &encoder_counts[1], &encoder_errors[0],
+						 &encoder_errors[1], &velocities[0], &velocities[1]);
+	srand (405);
+
+	// Every entry of the table, on both axes. The state is the direction last moved and
+	// the levels last seen; the levels then change to each of the four combinations
+	uint16_t singles = 0, singles_ok = 0, doubles = 0, doubles_ok = 0;
+	uint16_t glitches = 0, glitches_ok = 0, glitches_former = 0;
+	for (uint8_t axis = 0; axis < 2; axis++)
+	{
+		for (uint8_t entry = 0; entry < 32; entry++)
+		{
+			bool forward = !(entry & 0x10);
+			uint8_t old_levels = (entry >> 2) & 0x03;
+			uint8_t new_levels = entry & 0x03;
+			prepare (axis, forward, old_levels);
+
+			uint16_t errors = encoder_errors[axis];
+			int32_t step;
+			bool still_forward = forward;
+			if (new_levels == old_levels)			// A glitch: a line changes and back
+			{
+				int32_t before = encoder_counts[axis];
+				sim_set_pin (axis_pins[axis], 0, !(old_levels & 0x01));
+				sim_set_pin (axis_pins[axis], 0, old_levels & 0x01);
+				sim_spend (BENCH_SETTLE);
+				step = encoder_counts[axis] - before;
+			}
+			else
+			{
+				step = step_to (axis, new_levels);
+			}
+			bool counted_error = (encoder_errors[axis] != errors);
+
+			uint8_t changed = old_levels ^ new_levels;
+			if (changed == 0x00)
+			{
+				glitches++;
+				glitches_ok += (step == 0 && !counted_error);
+				glitches_former += (former_step (old_levels, new_levels) != 0);
+			}
+			else if (changed == 0x03)
+			{
+				doubles++;
+				doubles_ok += (step == (forward ? 2 : -2) && counted_error);
+			}
+			else
+			{
+				singles++;
+				singles_ok += (step == former_step (old_levels, new_levels) && !counted_error);
+				still_forward = (step > 0);
+			}
+
+			// A missed step now shows which way the decoder thinks it was moving
+			int32_t probe = step_to (axis, levels[axis] ^ 0x03);
+			if (probe != (still_forward ? 2 : -2))
+			{
+				if (changed == 0x00)		glitches_ok--;
+				else if (changed == 0x03)	doubles_ok--;
+				else						singles_ok--;
+			}
+		}
+	}
+	snprintf (detail, sizeof (detail), "%u of %u", singles_ok, singles);
+	good &= show ("Single steps count as the former decoder's", detail, singles_ok == singles);
+	snprintf (detail, sizeof (detail), "%u of %u", doubles_ok, doubles);
+	good &= show ("Double steps count 2 the last way, as errors", detail, doubles_ok == doubles);
+	snprintf (detail, sizeof (detail), "%u of %u; former: %u counted",
+			  glitches_ok, glitches, glitches_former);
+	good &= show ("Glitches count nothing", detail, glitches_ok == glitches);
+
+	// The time one edge's interrupt takes, in simulated cycles
+	uint64_t before = sim_cycles;
+	set_levels (0, levels[0] ^ 0x01);
+	sim_spend (0);
+	uint32_t isr_cycles = sim_cycles - before;
+
+	// Edges from both motors at changing speeds, with double steps now and then
+	printf ("\n%-34s %12s %12s %12s %9s\n", "Replay at changing speeds", "edges",
+			"double steps", "errors seen", "off by");
+	start_motors (true, 0.0, BENCH_REPLAY_EDGES);
+	sim_set_plant (motor_step, (double)BENCH_REPLAY_STEP / F_CPU);
+	double start_ns = bench_ns ();
+	while (edges_made[0] < BENCH_REPLAY_EDGES || edges_made[1] < BENCH_REPLAY_EDGES)
+	{
+		sim_spend (BENCH_MAIN_LOOP);
+	}
+	sim_set_plant (NULL, 1.0);
+	sim_spend (BENCH_SETTLE);
+	double replay_ns = bench_ns () - start_ns;
+	for (uint8_t axis = 0; axis < 2; axis++)
+	{
+		const bench_motor& motor = motors[axis];
+		ok = (encoder_counts[axis] == motor.position && encoder_errors[axis] == motor.doubles);
+		printf ("%-34s %12lld %12lu %12u %9lld  %s\n", axis ? "Encoder 2" : "Encoder 1",
+				(long long)edges_made[axis], (unsigned long)motor.doubles,
+				encoder_errors[axis], (long long)(encoder_counts[axis] - motor.position),
+				ok ? "ok" : "FAILED");
+		printf ("%-34s %12s %12s %12s %9lld\n", "  former decoder", "", "", "",
+				(long long)(motor.former_count - motor.position));
+		good &= ok;
+	}
+	printf ("%-34s %12.0f\n", "Edges replayed per second on the PC",
+			(edges_made[0] + edges_made[1]) * 1.0E9 / replay_ns);
+
+	// Both motors at a steady speed, one edge every so many cycles; the interrupts keep
+	// up so long as both of them fit in the time between edges
+	printf ("\n%-34s %12s %12s %12s %9s\n", "Edges every so many cycles", "edges/s", "",
+			"errors seen", "off by");
+	static const uint16_t periods[] = { 1600, 800, 400, 200, 160, 120, 100, 80, 64, 48, 32 };
+	uint16_t fastest_clean = 0;
+	ok = true;
+	for (uint8_t index = 0; index < sizeof (periods) / sizeof (periods[0]); index++)
+	{
+		start_motors (false, 1.0, BENCH_SWEEP_EDGES);
+		sim_set_plant (motor_step, (double)periods[index] / F_CPU);
+		while (edges_made[0] < BENCH_SWEEP_EDGES)
+		{
+			sim_spend (BENCH_MAIN_LOOP);
+		}
+		sim_set_plant (NULL, 1.0);
+		sim_spend (BENCH_SETTLE);
+
+		uint16_t worst_errors = 0;
+		int64_t worst_off = 0;
+		for (uint8_t axis = 0; axis < 2; axis++)
+		{
+			int64_t off = encoder_counts[axis] - motors[axis].position;
+			worst_off = (llabs (off) > llabs (worst_off)) ? off : worst_off;
+			worst_errors = (encoder_errors[axis] > worst_errors) ? encoder_errors[axis]
+																 : worst_errors;
+		}
+		bool clean = (worst_errors == 0 && worst_off == 0);
+		if (clean)
+		{
+			fastest_clean = periods[index];
+		}
+
+		// While both interrupts fit between edges, nothing may be missed
+		bool fits = (periods[index] >= 2 * isr_cycles);
+		snprintf (detail, sizeof (detail), "%u", periods[index]);
+		printf ("%-34s %12.0f %12s %12u %9lld  %s\n", detail, (double)F_CPU / periods[index],
+				"", worst_errors, (long long)worst_off, (!fits || clean) ? "ok" : "FAILED");
+		ok &= (!fits || clean);
+	}
+	good &= ok;
+	snprintf (detail, sizeof (detail), "%lu cycles per edge", (unsigned long)isr_cycles);
+	printf ("\n%-48s %s\n", "Interrupt time in the simulator", detail);
+	snprintf (detail, sizeof (detail), "%.0f edges/s on each axis", (double)F_CPU / fastest_clean);
+	printf ("%-48s %s\n", "Fastest steady speed counted exactly", detail);
+
+	// Both motors follow their profiles while the main loop makes speed estimates. They
+	// first stand still long enough for the estimates to settle at zero
+	start_motors (false, 0.0, 0);
+	for (uint32_t waited = 0; waited < VEL_STOP_US + 2 * VEL_WINDOW_US; waited += 50)
+	{
+		encoders.update_velocity ();
+		sim_spend (50 * (F_CPU / 1000000UL));
+	}
+	good &= show ("Speeds read zero when standing still", "",
+				  velocities[0] == 0 && velocities[1] == 0);
+
+	bench_error estimated[2][NUM_KINDS], differenced[2][NUM_KINDS];
+	memset (estimated, 0, sizeof (estimated));
+	memset (differenced, 0, sizeof (differenced));
+	int32_t window_counts[2][VEL_WINDOW_US / BENCH_SAMPLE_US];
+	uint8_t window_index = 0;
+	uint32_t samples = 0;
+	for (uint8_t axis = 0; axis < 2; axis++)
+	{
+		true_position[axis] = encoder_counts[axis] + 0.5;
+		for (uint8_t index = 0; index < VEL_WINDOW_US / BENCH_SAMPLE_US; index++)
+		{
+			window_counts[axis][index] = encoder_counts[axis];
+		}
+	}
+	profile_time = 0.0;
+	sim_set_plant (profile_step, (double)BENCH_PROFILE_STEP / F_CPU);
+	double next_sample = BENCH_SAMPLE_US * 1.0E-6;
+	while (profile_at (0, profile_time, NULL) != NULL || profile_at (1, profile_time, NULL) != NULL)
+	{
+		encoders.update_velocity ();
+		sim_spend (BENCH_VEL_LOOP);
+		if (profile_time < next_sample)
+		{
+			continue;
+		}
+		next_sample += BENCH_SAMPLE_US * 1.0E-6;
+		samples++;
+
+		// The counts over the last window, as the master would have differenced them
+		window_index = (window_index + 1) % (VEL_WINDOW_US / BENCH_SAMPLE_US);
+		for (uint8_t axis = 0; axis < 2; axis++)
+		{
+			double into;
+			const bench_segment* p_seg = profile_at (axis, profile_time, &into);
+			double truth = profile_speed (axis, profile_time);
+			int32_t count = encoder_counts[axis];
+			double difference = (count - window_counts[axis][window_index]) * 1.0E6
+								/ VEL_WINDOW_US;
+			window_counts[axis][window_index] = count;
+			if (p_seg == NULL || samples <= VEL_WINDOW_US / BENCH_SAMPLE_US)
+			{
+				continue;
+			}
+
+			// Each kind of part is checked once the estimate has had time to catch up:
+			// a window at a steady speed, two edges when creeping, or long enough to
+			// decide a motor has stopped
+			double skip = 0.0;
+			if (p_seg->kind == KIND_STEADY)		skip = 2.0 * VEL_WINDOW_US * 1.0E-6;
+			else if (p_seg->kind == KIND_CREEP)	skip = 2.0 / fabs (p_seg->start);
+			else if (p_seg->kind == KIND_STOP)	skip = (VEL_STOP_US + VEL_WINDOW_US) * 1.0E-6;
+			if (into >= skip)
+			{
+				add_error (estimated[axis][p_seg->kind], velocities[axis], truth);
+				add_error (differenced[axis][p_seg->kind], difference, truth);
+			}
+		}
+	}
+	sim_set_plant (NULL, 1.0);
+
+	printf ("\n%-34s %9s %10s %10s %9s %10s\n", "Speed estimates against the truth",
+			"samples", "RMS cts/s", "worst", "worst %", "diff. RMS");
+	ok = true;
+	for (uint8_t axis = 0; axis < 2; axis++)
+	{
+		for (uint8_t kind = 0; kind < NUM_KINDS; kind++)
+		{
+			const bench_error& error = estimated[axis][kind];
+			double diff_rms = rms_of (differenced[axis][kind]);
+
+			// In a ramp the estimate lags, as it's made from edges up to a window old
+			// and then kept for a window, so it's only held to that; through zero the
+			// percent means nothing. Where the speed is steady or creeping, the estimate
+			// must beat differencing the counts, which can only see whole counts
+			char percent[16];
+			snprintf (percent, sizeof (percent), "%.2f", error.worst_percent);
+			bool kind_ok = (error.samples > 0);
+			if (kind == KIND_STEADY)
+			{
+				kind_ok &= (error.worst_percent < 0.5 && rms_of (error) < diff_rms);
+			}
+			else if (kind == KIND_CREEP)
+			{
+				kind_ok &= (error.worst_percent < 5.0 && rms_of (error) < diff_rms);
+			}
+			else if (kind == KIND_STOP)
+			{
+				kind_ok &= (error.worst == 0.0);
+			}
+			else
+			{
+				kind_ok &= (rms_of (error) < profile_accel (axis) * 2.0 * VEL_WINDOW_US * 1.0E-6);
+				snprintf (percent, sizeof (percent), "-");
+			}
+			snprintf (detail, sizeof (detail), "Encoder %u, %s", axis + 1, kind_names[kind]);
+			printf ("%-34s %9lu %10.1f %10.1f %9s %10.1f  %s\n", detail,
+					(unsigned long)error.samples, rms_of (error), error.worst, percent,
+					diff_rms, kind_ok ? "ok" : "FAILED");
+			ok &= kind_ok;
+		}
+	}
+	good &= ok;
+
+	printf ("\n%s\n", good ? "All checks passed" : "Some checks FAILED");
+	return (good ? 0 : 1);
+}
@@ -0,0 +1,354 @@
+//*************************************************************************************
+/** \file fat_bench.cpp
+ *    This program checks what the SD card driver in sd_card.cpp and FatFs leave in a
+ *    disk image, and where the time goes while they log. A data logger's lines are
+ *    written at a fixed sample rate to the model card in sd_model.h two ways:
+ *      \li through the line buffer and f_write(), to a file made by
+ *          open_new_data_file(), which FatFs makes longer a cluster at a time
+ *      \li in streaming mode, to a file made by open_stream_file(), which is made
+ *          longer than it needs to be before logging starts and is cut back to the
+ *          data's size when it's closed
+ *    The model card counts each write to the FATs, so each sample's time can be put
+ *    beside whether the FAT was written during it. The time each sample took is shown
+ *    as a histogram for each way of writing.
+ *
+ *    Before and after logging, the image is checked with fat_check(), as fsck would
+ *    check it: the FAT copies must match, each file's chain must be just long enough
+ *    for its size, and no cluster may be cross-linked or lost. The clusters a stream
+ *    file didn't use must have been given back. Last, a FAT entry is changed in one
+ *    copy of the FAT to be sure that the check finds it.
+ *
+ *    Usage: fat_bench [image]
+ *    The disk image is made in fat.img unless another name is given, and is left
+ *    there to be looked at.
+ *
+ *  Revisions:
+ *    \li 06-30-2011 Original file
+ *
+ *  License:
+ *    This file is released under the Lesser GNU Public License, version 2. This
+ *    program is intended for educational use only, but it is not limited thereto.
+ */
+//*************************************************************************************
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <avr/io.h>
+#include "sd_card.h"
+#include "sd_model.h"
+#include "fat_check.h"
+
+
+/// The size of the disk image, in sectors; 65536 of them make a 32 MB FAT16 volume
+#define BENCH_SECTORS		65536UL
+
+/// How many samples are written in each way
+#define BENCH_SAMPLES		10000
+
+/// The time between samples, in microseconds
+#define BENCH_PERIOD_US		2000
+
+/// The size a stream file is made before logging, which is more than it will need
+#define BENCH_STREAM_SIZE	524288UL
+
+/// The number of buckets in the histograms
+#define BENCH_BUCKETS		9
+
+
+/// The model card, which the SPI port talks to
+static sd_card_model card;
+
+/// The upper limit of each histogram bucket but the last, in microseconds
+static const uint32_t bucket_top[BENCH_BUCKETS - 1]
+	= {100, 200, 500, 1000, 2000, 5000, 10000, 20000};
+
+
+//-------------------------------------------------------------------------------------
+/** This structure holds the results of logging one file.
+ */
+
+typedef struct
+{
+	const char* label;						///< A name for the way of writing
+	bool stream;							///< True for streaming mode
+	uint32_t bytes;							///< Bytes of data written
+	uint32_t histogram[BENCH_BUCKETS];		///< Samples which took each range of times
+	uint32_t fat_samples;					///< Samples during which the FAT was written
+	uint32_t fat_writes;					///< Writes to the FATs before closing
+	double worst_fat;						///< Longest sample which wrote the FAT, us
+	double worst_other;						///< Longest of the other samples, us
+	uint16_t stalls;						///< Times putchar() waited in streaming mode
+} bench_run;
+
+
+//-------------------------------------------------------------------------------------
+/** This function plays the part of the SD card for one byte of an SPI transfer. The
+ *  card reads its own select pin, B0, rather than the encoder slave's.
+ *  @param mosi The byte sent by the master
+ *  @param selected Whether the encoder slave is selected, which is ignored
+ *  @return The byte which the master receives
+ */
+
+static uint8_t card_byte (uint8_t mosi, bool selected)
+{
+	return (card.spi_byte (mosi));
+}
+
+
+//-------------------------------------------------------------------------------------
+/** This function writes one line of data like a logger's, with a sample number and two
+ *  positions.
+ *  @param sd The SD card
+ *  @param index The sample number
+ *  @return The number of characters in the line
+ */
+
+static uint32_t log_sample (sd_card& sd, uint32_t index)
+{
+	long x = (long)((index * 7919UL) % 200000UL) - 100000L;
+	long y = (long)((index * 104729UL) % 60000UL);
+	char line[40];
+
+	sd << (long)index << "," << x << "," << y << endl;
+	return (snprintf (line, sizeof (line), "%ld,%ld,%ld\r\n", (long)index, x, y));
+}
+
+
+//-------------------------------------------------------------------------------------
+/** This function logs a file at the sample rate, keeping a histogram of the time each
+ *  sample took and counting the samples during which the FATs were written.
+ *  @param sd The SD card
+ *  @param run The results, which say which way to write
+ *  @param fat_first The first sector of the FATs
+ *  @param fat_count The number of sectors in all the FATs
+ *  @return True if the file was written and closed without an error
+ */
+
+static bool run_paced (sd_card& sd, bench_run& run, uint32_t fat_first,
+					   uint32_t fat_count)
+{
+	const uint64_t period = (uint64_t)BENCH_PERIOD_US * (F_CPU / 1000000UL);
+	const double us_per_cycle = 1.0E6 / F_CPU;
+
+	uint16_t number = run.stream ? sd.open_stream_file ("/strm_", "csv", BENCH_STREAM_SIZE)
+								 : sd.open_new_data_file ("/line_", "csv");
+	if (number == 0xFFFF)
+	{
+		return (false);
+	}
+
+	// Writes made while opening the file don't count; only those made while logging
+	card.watch_sectors (fat_first, fat_count);
+	for (uint32_t index = 0; index < BENCH_SAMPLES; index++)
+	{
+		uint64_t sample_start = sim_cycles;
+		uint32_t writes_before = card.get_watched_writes ();
+		run.bytes += log_sample (sd, index);
+		if (run.stream)
+		{
+			sd.service_stream ();
+		}
+		uint64_t taken = sim_cycles - sample_start;
+		double us = taken * us_per_cycle;
+
+		uint8_t bucket = 0;
+		while (bucket < BENCH_BUCKETS - 1 && us >= bucket_top[bucket])
+		{
+			bucket++;
+		}
+		run.histogram[bucket]++;
+		if (card.get_watched_writes () != writes_before)
+		{
+			run.fat_samples++;
+			run.worst_fat = (us > run.worst_fat) ? us : run.worst_fat;
+		}
+		else
+		{
+			run.worst_other = (us > run.worst_other) ? us : run.worst_other;
+		}
+		if (taken < period)
+		{
+			sim_spend ((uint32_t)(period - taken));
+		}
+	}
+	run.fat_writes = card.get_watched_writes ();
+	card.watch_sectors (0, 0);
+
+	run.stalls = run.stream ? sd.get_stream_stalls () : 0;
+	bool good = (sd.get_stream_state () != SD_STREAM_ERROR);
+	return ((sd.close_file () == FR_OK) && good);
+}
+
+
+//-------------------------------------------------------------------------------------
+/** This function checks the image and prints what was found.
+ *  @param title What is being checked
+ *  @param result The results of the check
+ *  @param verbose True to list the files
+ *  @return True if the volume has no errors
+ */
+
+static bool check_image (const char* title, fat_check_result& result, bool verbose)
+{
+	printf ("%s\n", title);
+	bool clean = fat_check (card, result, verbose);
+	printf ("  %lu files, %lu clusters used, %lu free, %lu fragmented\n",
+			(unsigned long)result.files, (unsigned long)result.clusters_used,
+			(unsigned long)result.clusters_free, (unsigned long)result.fragmented);
+	printf ("  FAT mismatches %lu, bad chains %lu, cross-linked %lu, lost %lu: %s\n",
+			(unsigned long)result.fat_mismatches, (unsigned long)result.bad_chains,
+			(unsigned long)result.cross_linked, (unsigned long)result.lost,
+			clean ? "clean" : "ERRORS");
+	return (clean);
+}
+
+
+//-------------------------------------------------------------------------------------
+/** This function changes a free cluster's entry in the first FAT only, as if a write
+ *  to the card had been cut off between the two copies, and checks that fat_check()
+ *  finds it. The entry is then put back and the volume must be clean again.
+ *  @param layout The results of an earlier check, which give the FAT's place
+ *  @return True if the change was found and the volume was clean once it was undone
+ */
+
+static bool corrupt_and_check (const fat_check_result& layout)
+{
+	uint8_t data[SD_MODEL_SECTOR];
+	uint8_t original[SD_MODEL_SECTOR];
+	fat_check_result result;
+
+	// Find the last FAT sector with a free entry, which is past both files
+	uint32_t sector = layout.fat_first + layout.fat_sectors;
+	uint16_t entry = 0;
+	bool found = false;
+	while (!found && sector > layout.fat_first)
+	{
+		sector--;
+		if (!card.read_sector (sector, data))
+		{
+			return (false);
+		}
+		for (entry = 0; entry < SD_MODEL_SECTOR / 2; entry++)
+		{
+			uint32_t cluster = (sector - layout.fat_first) * (SD_MODEL_SECTOR / 2) + entry;
+			if (cluster >= 2 && cluster < layout.clusters + 2
+				&& data[2 * entry] == 0 && data[2 * entry + 1] == 0)
+			{
+				found = true;
+				break;
+			}
+		}
+	}
+	if (!found)
+	{
+		return (false);
+	}
+
+	memcpy (original, data, SD_MODEL_SECTOR);
+	data[2 * entry] = 0xFF;
+	data[2 * entry + 1] = 0xFF;
+	card.write_sector (sector, data);
+	bool clean = check_image ("\nWith a cluster marked used in the first FAT only:",
+							  result, false);
+	bool caught = !clean && result.fat_mismatches == 1 && result.lost == 1;
+
+	card.write_sector (sector, original);
+	clean = check_image ("With the FAT put back:", result, false);
+	return (caught && clean);
+}
+
+
+//-------------------------------------------------------------------------------------
+/** The main function makes the disk image, checks it, logs the files, prints the
+ *  histograms, and checks the image again.
+ */
+
+int main (int argc, char** argv)
+{
+	const char* image = (argc > 1) ? argv[1] : "fat.img";
+	static bench_run runs[2];
+	fat_check_result layout;
+	bool good = true;
+
+	if (!sd_card_model::format_image (image, BENCH_SECTORS) || !card.open_image (image))
+	{
+		printf ("Can't make the disk image %s\n", image);
+		return (1);
+	}
+	sim_set_spi_slave (card_byte);
+
+	bool blank = check_image ("Blank image:", layout, false) && layout.files == 0;
+	good &= blank;
+
+	sd_card sd;
+	FRESULT mounted = sd.mount (0);
+	printf ("\nMounting a %lu MB FAT16 image: %s\n\n",
+			(unsigned long)(BENCH_SECTORS / 2048), mounted == FR_OK ? "ok" : "FAILED");
+	if (!blank || mounted != FR_OK)
+	{
+		return (1);
+	}
+
+	runs[0].label = "line buffer";
+	runs[1].label = "streaming";
+	bool written[2];
+	for (uint8_t which = 0; which < 2; which++)
+	{
+		runs[which].stream = (which == 1);
+		written[which] = run_paced (sd, runs[which], layout.fat_first,
+									layout.num_fats * layout.fat_sectors);
+		good &= written[which];
+	}
+
+	printf ("%u samples at %u samples/s   %12s  %12s\n", BENCH_SAMPLES,
+			1000000 / BENCH_PERIOD_US, runs[0].label, runs[1].label);
+	for (uint8_t bucket = 0; bucket < BENCH_BUCKETS; bucket++)
+	{
+		char range[24];
+		if (bucket < BENCH_BUCKETS - 1)
+		{
+			snprintf (range, sizeof (range), "under %lu us", (unsigned long)bucket_top[bucket]);
+		}
+		else
+		{
+			snprintf (range, sizeof (range), "%lu us or more",
+					  (unsigned long)bucket_top[BENCH_BUCKETS - 2]);
+		}
+		printf ("  %-28s  %12lu  %12lu\n", range, (unsigned long)runs[0].histogram[bucket],
+				(unsigned long)runs[1].histogram[bucket]);
+	}
+	printf ("  %-28s  %12lu  %12lu\n", "FAT sectors written",
+			(unsigned long)runs[0].fat_writes, (unsigned long)runs[1].fat_writes);
+	printf ("  %-28s  %12lu  %12lu\n", "samples which wrote the FAT",
+			(unsigned long)runs[0].fat_samples, (unsigned long)runs[1].fat_samples);
+	printf ("  %-28s  %12.1f  %12.1f\n", "worst of those, us",
+			runs[0].worst_fat, runs[1].worst_fat);
+	printf ("  %-28s  %12.1f  %12.1f\n", "worst of the others, us",
+			runs[0].worst_other, runs[1].worst_other);
+	printf ("  %-28s  %12lu  %12lu\n", "bytes", (unsigned long)runs[0].bytes,
+			(unsigned long)runs[1].bytes);
+
+	bool quiet = written[1] && runs[1].fat_writes == 0 && runs[1].stalls == 0
+				 && runs[1].worst_other < 1000.0;
+	printf ("streaming wrote no FAT sectors and no sample took 1 ms: %s\n\n",
+			quiet ? "ok" : "FAILED");
+	good &= quiet;
+
+	fat_check_result result;
+	bool clean = check_image ("After logging, closing and cutting back the stream file:",
+							  result, true);
+	bool tidy = clean && result.files == 2 && result.fragmented == 0;
+	printf ("two whole files, each contiguous, no clusters left over: %s\n",
+			tidy ? "ok" : "FAILED");
+	good &= tidy;
+
+	bool caught = corrupt_and_check (result);
+	printf ("the check finds a FAT entry changed in one copy: %s\n",
+			caught ? "ok" : "FAILED");
+	good &= caught;
+
+	card.close_image ();
+	printf ("\n%s\n", good ? "All checks passed" : "Some checks FAILED");
+	return (good ? 0 : 1);
+}
@@ -0,0 +1,364 @@
+//*************************************************************************************
+/** \file fat_check.cpp
+ *    This file contains the check of a FAT16 volume in a model SD card's disk image
+ *    which is declared in fat_check.h. The whole FAT is read into memory first; as a
+ *    FAT16 volume can't have more than 65524 clusters, the tables here are of a fixed
+ *    size which will hold any of them.
+ *
+ *  Revisions:
+ *    \li 06-30-2011 Original file
+ *
+ *  License:
+ *    This file is released under the Lesser GNU Public License, version 2. This
+ *    program is intended for educational use only, but it is not limited thereto.
+ */
+//*************************************************************************************
+
+#include <string.h>
+#include "fat_check.h"
+
+
+/// The most entries a FAT16 table can have, counting the two reserved ones
+#define FAT_CHECK_ENTRIES		65536UL
+
+/// FAT16 entries this value and above mark the end of a chain
+#define FAT_CHECK_END			0xFFF8
+
+/// The FAT16 entry which marks a bad cluster
+#define FAT_CHECK_BAD			0xFFF7
+
+/// The size of a directory entry, in bytes
+#define FAT_CHECK_ENTRY_SIZE	32
+
+/// The attribute bit of a subdirectory
+#define FAT_CHECK_DIRECTORY		0x10
+
+/// The attribute bit of a volume label
+#define FAT_CHECK_VOLUME		0x08
+
+/// The attribute bits which are all set in a long file name entry
+#define FAT_CHECK_LONG_NAME		0x0F
+
+/// How deep subdirectories are followed, which stops a looped tree
+#define FAT_CHECK_DEPTH			16
+
+
+/// The first FAT, as read from the image
+static uint16_t fat[FAT_CHECK_ENTRIES];
+
+/// How many chains each cluster was found in, up to 255
+static uint8_t references[FAT_CHECK_ENTRIES];
+
+/// The number of the chain which last went through each cluster, to find loops
+static uint32_t chain_mark[FAT_CHECK_ENTRIES];
+
+/// The number of chains followed so far
+static uint32_t chain_count;
+
+/// The first sector of the data area, which holds cluster 2
+static uint32_t data_first;
+
+/// Sectors in a cluster
+static uint8_t cluster_sectors;
+
+
+//-------------------------------------------------------------------------------------
+/** This function gets a little endian number of two bytes from a buffer.
+ *  @param p_bytes A pointer to the first byte
+ *  @return The number
+ */
+
+static uint16_t get_16 (const uint8_t* p_bytes)
+{
+	return ((uint16_t)(p_bytes[0] | (p_bytes[1] << 8)));
+}
+
+
+//-------------------------------------------------------------------------------------
+/** This function gets a little endian number of four bytes from a buffer.
+ *  @param p_bytes A pointer to the first byte
+ *  @return The number
+ */
+
+static uint32_t get_32 (const uint8_t* p_bytes)
+{
+	return ((uint32_t)get_16 (p_bytes) | ((uint32_t)get_16 (p_bytes + 2) << 16));
+}
+
+
+//-------------------------------------------------------------------------------------
+/** This function follows a chain of clusters from its start, counting each cluster
+ *  as used by it. A chain which leads out of the volume, to a free or bad cluster, or
+ *  back into itself is counted as bad and is followed no further.
+ *  @param start The first cluster of the chain
+ *  @param result The results, whose counts of bad chains and cross links are kept
+ *  @param p_contiguous Set to true if each cluster follows the one before it
+ *  @return The number of clusters in the chain, up to where it went wrong
+ */
+
+static uint32_t follow_chain (uint16_t start, fat_check_result& result,
+							  bool* p_contiguous)
+{
+	uint32_t length = 0;
+	uint32_t cluster = start;
+
+	chain_count++;
+	*p_contiguous = true;
+	while (true)
+	{
+		if (cluster < 2 || cluster >= result.clusters + 2 || fat[cluster] == 0
+			|| fat[cluster] == FAT_CHECK_BAD || chain_mark[cluster] == chain_count)
+		{
+			result.bad_chains++;
+			return (length);
+		}
+		chain_mark[cluster] = chain_count;
+		if (references[cluster] != 0)
+		{
+			result.cross_linked++;
+		}
+		if (references[cluster] < 255)
+		{
+			references[cluster]++;
+		}
+		length++;
+
+		if (fat[cluster] >= FAT_CHECK_END)
+		{
+			return (length);
+		}
+		if (fat[cluster] != cluster + 1)
+		{
+			*p_contiguous = false;
+		}
+		cluster = fat[cluster];
+	}
+}
+
+
+// Subdirectories and the sectors which list them are checked by calling each other
+static bool check_directory_sector (sd_card_model& card, uint32_t sector, uint8_t depth,
+									fat_check_result& result, bool verbose);
+
+
+//-------------------------------------------------------------------------------------
+/** This function checks a subdirectory, whose entries are in a chain of clusters.
+ *  @param card The model card holding the image
+ *  @param start The first cluster of the subdirectory
+ *  @param depth How many directories down this one is
+ *  @param result The results
+ *  @param verbose True to list each file
+ */
+
+static void check_subdirectory (sd_card_model& card, uint16_t start, uint8_t depth,
+								fat_check_result& result, bool verbose)
+{
+	bool contiguous;
+
+	result.directories++;
+	uint32_t length = follow_chain (start, result, &contiguous);
+	if (depth >= FAT_CHECK_DEPTH)
+	{
+		result.bad_chains++;
+		return;
+	}
+
+	// The chain has been checked, so only the clusters it was found to hold are read
+	uint32_t cluster = start;
+	for (uint32_t count = 0; count < length; count++)
+	{
+		uint32_t first = data_first + (cluster - 2) * cluster_sectors;
+		for (uint8_t index = 0; index < cluster_sectors; index++)
+		{
+			if (!check_directory_sector (card, first + index, depth, result, verbose))
+			{
+				return;
+			}
+		}
+		cluster = fat[cluster];
+	}
+}
+
+
+//-------------------------------------------------------------------------------------
+/** This function checks one sector of directory entries, following the chain of each
+ *  file and subdirectory in it.
+ *  @param card The model card holding the image
+ *  @param sector The sector of the directory to be checked
+ *  @param depth How many directories down this one is, starting at 0 for the root
+ *  @param result The results
+ *  @param verbose True to list each file
+ *  @return False once the end of the directory has been found
+ */
+
+static bool check_directory_sector (sd_card_model& card, uint32_t sector, uint8_t depth,
+									fat_check_result& result, bool verbose)
+{
+	uint8_t data[SD_MODEL_SECTOR];
+
+	if (!card.read_sector (sector, data))
+	{
+		result.bad_chains++;
+		return (false);
+	}
+	for (uint16_t offset = 0; offset < SD_MODEL_SECTOR; offset += FAT_CHECK_ENTRY_SIZE)
+	{
+		const uint8_t* p_entry = data + offset;
+		uint8_t attributes = p_entry[11];
+
+		if (p_entry[0] == 0x00)
+		{
+			return (false);
+		}
+		if (p_entry[0] == 0xE5 || p_entry[0] == '.'
+			|| (attributes & FAT_CHECK_LONG_NAME) == FAT_CHECK_LONG_NAME
+			|| (attributes & FAT_CHECK_VOLUME))
+		{
+			continue;
+		}
+
+		uint16_t start = get_16 (p_entry + 26);
+		uint32_t size = get_32 (p_entry + 28);
+		if (attributes & FAT_CHECK_DIRECTORY)
+		{
+			check_subdirectory (card, start, depth + 1, result, verbose);
+			continue;
+		}
+
+		// An empty file has no clusters; any other has just enough to hold its size
+		result.files++;
+		uint32_t needed = (size + result.cluster_bytes - 1) / result.cluster_bytes;
+		uint32_t length = 0;
+		bool contiguous = true;
+		if (start != 0)
+		{
+			length = follow_chain (start, result, &contiguous);
+		}
+		if (length != needed)
+		{
+			result.bad_chains++;
+		}
+		if (!contiguous)
+		{
+			result.fragmented++;
+		}
+		if (verbose)
+		{
+			printf ("  %*s%.8s.%.3s %9lu bytes, cluster %5u, %5lu clusters%s%s\n",
+					2 * depth, "", p_entry, p_entry + 8, (unsigned long)size, start,
+					(unsigned long)length, contiguous ? "" : ", fragmented",
+					length == needed ? "" : ", WRONG LENGTH");
+		}
+	}
+	return (true);
+}
+
+
+//-------------------------------------------------------------------------------------
+/** This function checks the FAT16 volume in a model card's image, as fsck would. It
+ *  reads the boot sector and the FATs, checks that each copy of the FAT is the same,
+ *  follows the chain of every file and subdirectory, and looks for clusters which
+ *  are marked as used but belong to nothing.
+ *  @param card The model card holding the image
+ *  @param result The results, which are all set
+ *  @param verbose True to list each file and where it is
+ *  @return True if the volume has no errors; fragmented files aren't errors
+ */
+
+bool fat_check (sd_card_model& card, fat_check_result& result, bool verbose)
+{
+	uint8_t data[SD_MODEL_SECTOR];
+	uint8_t copy[SD_MODEL_SECTOR];
+
+	memset (&result, 0, sizeof (result));
+	if (!card.read_sector (0, data) || data[510] != 0x55 || data[511] != 0xAA
+		|| get_16 (data + 11) != SD_MODEL_SECTOR || data[13] == 0 || data[16] == 0)
+	{
+		return (false);
+	}
+
+	// The layout of the volume, from the BIOS parameter block
+	cluster_sectors = data[13];
+	result.cluster_bytes = (uint32_t)cluster_sectors * SD_MODEL_SECTOR;
+	result.fat_first = get_16 (data + 14);
+	result.num_fats = data[16];
+	uint32_t root_sectors = (get_16 (data + 17) * FAT_CHECK_ENTRY_SIZE
+							 + SD_MODEL_SECTOR - 1) / SD_MODEL_SECTOR;
+	uint32_t total = get_16 (data + 19);
+	if (total == 0)
+	{
+		total = get_32 (data + 32);
+	}
+	result.fat_sectors = get_16 (data + 22);
+	uint32_t root_first = result.fat_first + result.num_fats * result.fat_sectors;
+	data_first = root_first + root_sectors;
+	if (total > card.get_sectors () || data_first >= total)
+	{
+		return (false);
+	}
+	result.clusters = (total - data_first) / cluster_sectors;
+	result.boot_ok = (result.clusters >= 4085 && result.clusters <= 65524
+					  && result.fat_sectors * SD_MODEL_SECTOR / 2 >= result.clusters + 2);
+	if (!result.boot_ok)
+	{
+		return (false);
+	}
+
+	// Read the first FAT, and compare each other copy with it
+	for (uint32_t index = 0; index < result.fat_sectors; index++)
+	{
+		if (!card.read_sector (result.fat_first + index, data))
+		{
+			return (false);
+		}
+		for (uint16_t entry = 0; entry < SD_MODEL_SECTOR / 2; entry++)
+		{
+			uint32_t cluster = index * (SD_MODEL_SECTOR / 2) + entry;
+			if (cluster < FAT_CHECK_ENTRIES)
+			{
+				fat[cluster] = get_16 (data + 2 * entry);
+			}
+		}
+		for (uint8_t which = 1; which < result.num_fats; which++)
+		{
+			if (!card.read_sector (result.fat_first + which * result.fat_sectors + index,
+								   copy)
+				|| memcmp (data, copy, SD_MODEL_SECTOR) != 0)
+			{
+				result.fat_mismatches++;
+			}
+		}
+	}
+
+	// Follow every chain from the root directory down
+	memset (references, 0, sizeof (references));
+	memset (chain_mark, 0, sizeof (chain_mark));
+	chain_count = 0;
+	for (uint32_t index = 0; index < root_sectors; index++)
+	{
+		if (!check_directory_sector (card, root_first + index, 0, result, verbose))
+		{
+			break;
+		}
+	}
+
+	// Every cluster is free, in a chain, or lost; a bad cluster counts as none of these
+	for (uint32_t cluster = 2; cluster < result.clusters + 2; cluster++)
+	{
+		if (fat[cluster] == 0)
+		{
+			result.clusters_free++;
+		}
+		else if (references[cluster] != 0)
+		{
+			result.clusters_used++;
+		}
+		else if (fat[cluster] != FAT_CHECK_BAD)
+		{
+			result.lost++;
+		}
+	}
+
+	return (result.fat_mismatches == 0 && result.bad_chains == 0
+			&& result.cross_linked == 0 && result.lost == 0);
+}
@@ -0,0 +1,58 @@
+//*************************************************************************************
+/** \file fat_check.h
+ *    This file declares a consistency check of the FAT16 volume in a model SD card's
+ *    disk image, like the one which fsck does on Linux, so that the benches can check
+ *    what FatFs and the SD card driver leave on the card without needing dosfstools.
+ *    The boot sector is checked, the FAT copies are compared, and every file's chain
+ *    of clusters is followed from the root directory down through subdirectories. It
+ *    finds chains which leave the volume, loop, end early or run on past their file's
+ *    size, clusters in more than one chain (cross-linked), and clusters which are
+ *    marked as used but belong to no file (lost). The image isn't changed.
+ *
+ *  Revisions:
+ *    \li 06-30-2011 Original file
+ *
+ *  License:
+ *    This file is released under the Lesser GNU Public License, version 2. This
+ *    program is intended for educational use only, but it is not limited thereto.
+ */
+//*************************************************************************************
+
+/// This define prevents this .h file from being included more than once in a .cc file
+#ifndef _FAT_CHECK_H_
+#define _FAT_CHECK_H_
+
+#include <stdint.h>
+#include "sd_model.h"
+
+
+//-------------------------------------------------------------------------------------
+/** This structure holds what the check found. The layout of the volume is kept too,
+ *  so that a bench can watch writes to the FATs.
+ */
+
+typedef struct
+{
+	bool boot_ok;							///< True if the boot sector is a FAT16 one
+	uint32_t fat_first;						///< First sector of the first FAT
+	uint32_t fat_sectors;					///< Sectors in each FAT
+	uint8_t num_fats;						///< Number of FAT copies
+	uint32_t clusters;						///< Number of data clusters
+	uint32_t cluster_bytes;					///< Bytes in a cluster
+
+	uint32_t files;							///< Files found
+	uint32_t directories;					///< Subdirectories found
+	uint32_t clusters_used;					///< Clusters in files' and folders' chains
+	uint32_t clusters_free;					///< Clusters marked free in the FAT
+	uint32_t fragmented;					///< Files whose clusters aren't contiguous
+	uint32_t fat_mismatches;				///< FAT sectors which differ between copies
+	uint32_t bad_chains;					///< Chains which are broken or the wrong size
+	uint32_t cross_linked;					///< Clusters in more than one chain
+	uint32_t lost;							///< Used clusters which are in no chain
+} fat_check_result;
+
+
+// This function checks the volume in a card's image, optionally listing the files
+bool fat_check (sd_card_model& card, fat_check_result& result, bool verbose = false);
+
+#endif // _FAT_CHECK_H_
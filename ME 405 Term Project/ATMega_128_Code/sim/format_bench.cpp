@@ -0,0 +1,538 @@
+//*************************************************************************************
+/** \file format_bench.cpp
+ *    This program checks and measures the decimal conversions in num_format.cpp on a
+ *    PC. Each conversion's text is compared byte for byte with what the C library's
+ *    snprintf() makes of the same number:
+ *      \li uint16_to_dec() with "%u" for every 16-bit number
+ *      \li uint32_to_dec() with "%lu" and int32_to_dec() with "%ld" for the edge cases
+ *          and millions of random numbers of every length
+ *      \li q_to_dec() with "%.*f" for every number of fraction bits from 0 to 16 and
+ *          of decimal places from 0 to 4, at the edge cases and random numbers
+ *      \li a base_text_serial port's setw(), setfill() and setprecision() with "%*ld",
+ *          "%0*ld", "%*lu", "%*.*f" and "%0*.*f", and that the width only applies to
+ *          the next number
+ *    q_to_dec() differs from printf() in two ways, on purpose: it rounds a fraction
+ *    which is exactly half way up away from zero, where printf() rounds it to an even
+ *    digit, and it never prints "-0". Those numbers are compared with printf()'s text
+ *    for the number moved a tiny amount (2^-20 of its smallest step) away from zero,
+ *    and with the minus sign taken off, and how many there were is shown.
+ *
+ *    Then the number of conversions per second is shown for each function, beside
+ *    copies of the divide-per-digit conversions (utoa(), ultoa() and ltoa()) which
+ *    base_text_serial used before and beside snprintf(). The PC divides in hardware,
+ *    so the former conversions are quick here; the AVR has no divide instruction, and
+ *    each of their digits costs a call to a library division routine there.
+ *
+ *    Usage: format_bench
+ *
+ *  Revisions:
+ *    \li 06-29-2011 Original file
+ *
+ *  License:
+ *    This file is released under the Lesser GNU Public License, version 2. This
+ *    program is intended for educational use only, but it is not limited thereto.
+ */
+//*************************************************************************************
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include "base_text_serial.h"
+#include "num_format.h"
+
+
+/// How many random numbers are checked for each 32-bit conversion
+#define BENCH_RANDOM		4000000L
+
+/// How many random numbers are checked for each fixed point format
+#define BENCH_Q_RANDOM		20000L
+
+/// How many random numbers are checked through the port's manipulators
+#define BENCH_PORT_RANDOM	200000L
+
+/// How many numbers are in the table which is converted while being timed
+#define BENCH_TABLE			4096
+
+/// How many times the table is converted while being timed
+#define BENCH_PASSES		500
+
+/// This marks the copies of the former conversions, which must not be inlined
+#define FORMER_METHOD		__attribute__ ((noinline))
+
+
+/** The base passed to the former conversions. It is volatile so that the compiler
+ *  can't turn their division by it into a multiplication, just as it couldn't in the
+ *  library, where the base is an argument.
+ */
+static volatile uint8_t former_base = 10;
+
+/// The sum of the lengths of the converted text, so the conversions aren't optimized out
+static volatile uint32_t sink;
+
+
+//-------------------------------------------------------------------------------------
+/** This is a copy of the conversion done by utoa() and ultoa(), which base_text_serial
+ *  used before num_format.cpp was written; it divides by the base once per digit.
+ *  @param num The number to be converted
+ *  @param buf A buffer at least 11 characters long
+ *  @param base The base, from 2 to 36
+ *  @return The number of digits written
+ */
+
+FORMER_METHOD static uint8_t former_ultoa (uint32_t num, char* buf, uint8_t base)
+{
+	char digits[32];
+	uint8_t count = 0;
+	do
+	{
+		uint8_t digit = (uint8_t)(num % base);
+		digits[count++] = (char)(digit < 10 ? '0' + digit : 'a' + digit - 10);
+		num /= base;
+	}
+	while (num != 0);
+
+	for (uint8_t index = 0; index < count; index++)
+	{
+		buf[index] = digits[count - 1 - index];
+	}
+	buf[count] = '\0';
+	return (count);
+}
+
+
+//-------------------------------------------------------------------------------------
+/** This is a copy of the conversion done by ltoa(), which base_text_serial used for
+ *  signed numbers before num_format.cpp was written.
+ *  @param num The number to be converted
+ *  @param buf A buffer at least 12 characters long
+ *  @param base The base, from 2 to 36
+ *  @return The number of characters written
+ */
+
+FORMER_METHOD static uint8_t former_ltoa (int32_t num, char* buf, uint8_t base)
+{
+	if (num < 0 && base == 10)
+	{
+		*buf = '-';
+		return (former_ultoa ((uint32_t)0 - (uint32_t)num, buf + 1, base) + 1);
+	}
+	return (former_ultoa ((uint32_t)num, buf, base));
+}
+
+
+//-------------------------------------------------------------------------------------
+/** This class is a port which keeps what is printed to it, so that the text can be
+ *  compared with printf()'s.
+ */
+
+class capture_port : public base_text_serial
+{
+	public:
+		char text[64];						///< The text printed since clear()
+		uint8_t length;						///< The number of characters in text
+
+		/// The constructor makes an empty port
+		capture_port (void) : base_text_serial () { clear (); }
+
+		/// This method empties the text
+		void clear (void) { length = 0; text[0] = '\0'; }
+
+		/// This method says the port is ready, as it never fills up
+		bool ready_to_send (void) { return (true); }
+
+		/** This method keeps one character.
+		 *  @param chout The character
+		 *  @return True unless the text is full
+		 */
+		bool putchar (char chout)
+		{
+			if (length >= sizeof (text) - 1)
+			{
+				return (false);
+			}
+			text[length++] = chout;
+			text[length] = '\0';
+			return (true);
+		}
+
+		/** This method keeps a string.
+		 *  @param p_str The string
+		 */
+		void puts (char const* p_str)
+		{
+			while (*p_str)
+			{
+				putchar (*p_str++);
+			}
+		}
+};
+
+
+//-------------------------------------------------------------------------------------
+/** This structure counts the numbers checked against printf() and the mismatches.
+ */
+
+typedef struct
+{
+	uint32_t checked;						///< How many numbers were compared
+	uint32_t wrong;							///< How many didn't match
+	uint32_t ties;							///< Fractions exactly half way, rounded up
+	uint32_t minus_zero;					///< Numbers printf() writes as "-0"
+} bench_count;
+
+
+//-------------------------------------------------------------------------------------
+/** This function compares a conversion with printf()'s text, counting it and showing
+ *  the first few which don't match.
+ *  @param count The counts to which this comparison is added
+ *  @param mine The text made by the conversion
+ *  @param length The length the conversion returned
+ *  @param reference The text made by printf()
+ */
+
+static void compare (bench_count& count, const char* mine, uint8_t length,
+					 const char* reference)
+{
+	count.checked++;
+	if (strcmp (mine, reference) != 0 || length != strlen (reference))
+	{
+		if (count.wrong < 5)
+		{
+			printf ("  \"%s\" (%u characters) should be \"%s\"\n", mine,
+					(unsigned)length, reference);
+		}
+		count.wrong++;
+	}
+}
+
+
+//-------------------------------------------------------------------------------------
+/** This function shows the result of one check.
+ *  @param label A name for the line printed
+ *  @param count The counts for the check
+ *  @return True if every number matched
+ */
+
+static bool show (const char* label, const bench_count& count)
+{
+	bool good = (count.wrong == 0 && count.checked > 0);
+	printf ("%-34s  %9lu  %7lu  %7lu  %6lu  %s\n", label,
+			(unsigned long)count.checked, (unsigned long)count.wrong,
+			(unsigned long)count.ties, (unsigned long)count.minus_zero,
+			good ? "ok" : "FAILED");
+	return (good);
+}
+
+
+//-------------------------------------------------------------------------------------
+/** This function picks a random 32-bit number with a random number of significant
+ *  bits, so that short numbers are checked as often as long ones.
+ *  @return The number
+ */
+
+static uint32_t random_bits (void)
+{
+	uint32_t num = ((uint32_t)rand () << 16) ^ (uint32_t)rand ();
+	uint8_t bits = (uint8_t)(rand () % 33);
+	return (bits == 32 ? num : num & (((uint32_t)1 << bits) - 1));
+}
+
+
+//-------------------------------------------------------------------------------------
+/** This function writes what q_to_dec() should make of a fixed point number, using
+ *  printf(). A fraction exactly half way between two printed digits is moved 2^-20 of
+ *  a fixed point step away from zero, far less than a printed digit, so that printf() rounds it away from zero as q_to_dec()
+ *  does, and a minus sign in front of nothing but zeros is taken off.
+ *  @param count The counts to which ties and minus zeros are added
+ *  @param value The fixed point number
+ *  @param frac_bits The number of fraction bits
+ *  @param decimals The number of decimal places
+ *  @param width The width, as for "%*.*f", or a negative number to pad with zeros
+ *  @param buf A buffer at least 40 characters long
+ */
+
+static void q_reference (bench_count& count, int32_t value, uint8_t frac_bits,
+						 uint8_t decimals, int width, char* buf)
+{
+	uint32_t magnitude = (value < 0) ? (uint32_t)0 - (uint32_t)value : (uint32_t)value;
+	uint32_t scale = 1;
+	for (uint8_t index = 0; index < decimals; index++)
+	{
+		scale *= 10;
+	}
+	uint32_t fraction = magnitude & (((uint32_t)1 << frac_bits) - 1);
+	double real = ldexp ((double)value, -frac_bits);
+	if (frac_bits > 0 && ((fraction * scale) & (((uint32_t)1 << frac_bits) - 1))
+						 == ((uint32_t)1 << (frac_bits - 1)))
+	{
+		count.ties++;
+		real += ldexp (value < 0 ? -1.0 : 1.0, -(frac_bits + 20));
+	}
+
+	char text[40];
+	snprintf (text, sizeof (text), "%.*f", decimals, real);
+	if (text[0] == '-' && strspn (text + 1, "0.") == strlen (text + 1))
+	{
+		count.minus_zero++;
+		real = 0.0;
+	}
+	if (width < 0)
+	{
+		snprintf (buf, 40, "%0*.*f", -width, decimals, real);
+	}
+	else
+	{
+		snprintf (buf, 40, "%*.*f", width, decimals, real);
+	}
+}
+
+
+//-------------------------------------------------------------------------------------
+/** This function prints how many times per second a conversion runs.
+ *  @param label A name for the line printed
+ *  @param start_ns The time at which the conversions started, in nanoseconds
+ *  @param end_ns The time at which they ended
+ */
+
+static void show_rate (const char* label, double start_ns, double end_ns)
+{
+	double calls = (double)BENCH_TABLE * BENCH_PASSES;
+	printf ("%-34s  %8.2f  %10.1f\n", label, calls / (end_ns - start_ns) * 1.0E3,
+			(end_ns - start_ns) / calls);
+}
+
+
+//-------------------------------------------------------------------------------------
+/** This function reads a clock in nanoseconds.
+ *  @return The time in nanoseconds
+ */
+
+static double bench_ns (void)
+{
+	struct timespec now;
+	clock_gettime (CLOCK_MONOTONIC, &now);
+	return (now.tv_sec * 1.0E9 + now.tv_nsec);
+}
+
+
+//-------------------------------------------------------------------------------------
+/** The main function runs the checks and the timing and shows the results.
+ */
+
+int main (void)
+{
+	char mine[NUM_FORMAT_BUF_SIZE + 8];
+	char reference[40];
+	bool good = true;
+	srand (405);
+
+	printf ("%-34s  %9s  %7s  %7s  %6s\n", "check", "numbers", "wrong", "ties", "minus0");
+
+	// Every 16-bit number
+	bench_count count16 = {0, 0, 0, 0};
+	for (uint32_t num = 0; num <= 0xFFFFUL; num++)
+	{
+		uint8_t length = uint16_to_dec ((uint16_t)num, mine);
+		snprintf (reference, sizeof (reference), "%u", (unsigned)num);
+		compare (count16, mine, length, reference);
+	}
+	good &= show ("uint16_to_dec, every number", count16);
+
+	// The 32-bit edge cases, every power of ten and its neighbours, and random numbers
+	static const int32_t edges[] = {0, 1, -1, 9, -9, 10, -10, 65535, 65536, -65535,
+		-65536, INT32_MAX, INT32_MIN, INT32_MAX - 1, INT32_MIN + 1};
+	bench_count count_u32 = {0, 0, 0, 0};
+	bench_count count_i32 = {0, 0, 0, 0};
+	for (uint8_t index = 0; index < sizeof (edges) / sizeof (edges[0]) + 10 * 3; index++)
+	{
+		uint32_t num;
+		if (index < sizeof (edges) / sizeof (edges[0]))
+		{
+			num = (uint32_t)edges[index];
+		}
+		else
+		{
+			uint8_t which = index - sizeof (edges) / sizeof (edges[0]);
+			uint32_t power = 1;
+			for (uint8_t digit = 0; digit < which / 3; digit++)
+			{
+				power *= 10;
+			}
+			num = power + which % 3 - 1;
+		}
+		uint8_t length = uint32_to_dec (num, mine);
+		snprintf (reference, sizeof (reference), "%lu", (unsigned long)num);
+		compare (count_u32, mine, length, reference);
+		length = int32_to_dec ((int32_t)num, mine);
+		snprintf (reference, sizeof (reference), "%ld", (long)(int32_t)num);
+		compare (count_i32, mine, length, reference);
+	}
+	for (long index = 0; index < BENCH_RANDOM; index++)
+	{
+		uint32_t num = random_bits ();
+		uint8_t length = uint32_to_dec (num, mine);
+		snprintf (reference, sizeof (reference), "%lu", (unsigned long)num);
+		compare (count_u32, mine, length, reference);
+		int32_t signed_num = (rand () & 1) ? -(int32_t)(num >> 1) : (int32_t)(num >> 1);
+		length = int32_to_dec (signed_num, mine);
+		snprintf (reference, sizeof (reference), "%ld", (long)signed_num);
+		compare (count_i32, mine, length, reference);
+	}
+	good &= show ("uint32_to_dec, edges and random", count_u32);
+	good &= show ("int32_to_dec, edges and random", count_i32);
+
+	// Fixed point numbers with each number of fraction bits and decimal places
+	bench_count count_q = {0, 0, 0, 0};
+	for (uint8_t frac_bits = 0; frac_bits <= NUM_FORMAT_MAX_Q_BITS; frac_bits++)
+	{
+		for (uint8_t decimals = 0; decimals <= NUM_FORMAT_MAX_DECIMALS; decimals++)
+		{
+			for (long index = 0; index < BENCH_Q_RANDOM; index++)
+			{
+				int32_t value;
+				if (index < (long)(sizeof (edges) / sizeof (edges[0])))
+				{
+					value = edges[index];
+				}
+				else if (index < (long)(sizeof (edges) / sizeof (edges[0])) + 2)
+				{
+					// The largest fractions, which round up into the whole number
+					value = ((int32_t)1 << frac_bits) - 1;
+					value = (index & 1) ? value : -value;
+				}
+				else
+				{
+					value = (int32_t)random_bits ();
+				}
+				uint8_t length = q_to_dec (value, frac_bits, decimals, mine);
+				q_reference (count_q, value, frac_bits, decimals, 0, reference);
+				compare (count_q, mine, length, reference);
+			}
+		}
+	}
+	good &= show ("q_to_dec, 0-16 bits, 0-4 places", count_q);
+
+	// Numbers printed through a port with a width and fill character
+	capture_port port;
+	bench_count count_long = {0, 0, 0, 0};
+	bench_count count_ulong = {0, 0, 0, 0};
+	bench_count count_port_q = {0, 0, 0, 0};
+	for (long index = 0; index < BENCH_PORT_RANDOM; index++)
+	{
+		uint8_t width = (uint8_t)(rand () % 16);
+		bool zeros = (rand () & 1) != 0;
+		int32_t num = (int32_t)random_bits ();
+
+		port.clear ();
+		port << setfill (zeros ? '0' : ' ') << setw (width) << (long)num;
+		snprintf (reference, sizeof (reference), zeros ? "%0*ld" : "%*ld", width,
+				  (long)num);
+		compare (count_long, port.text, port.length, reference);
+
+		port.clear ();
+		port << setfill (' ') << setw (width) << (unsigned long)(uint32_t)num;
+		snprintf (reference, sizeof (reference), "%*lu", width % 16,
+				  (unsigned long)(uint32_t)num);
+		compare (count_ulong, port.text, port.length, reference);
+
+		uint8_t frac_bits = (uint8_t)(rand () % (NUM_FORMAT_MAX_Q_BITS + 1));
+		uint8_t decimals = (uint8_t)(rand () % (NUM_FORMAT_MAX_DECIMALS + 1));
+		port.clear ();
+		port << setfill (zeros ? '0' : ' ') << setprecision (decimals) << setw (width)
+			 << q_fixed (num, frac_bits);
+		q_reference (count_port_q, num, frac_bits, decimals, zeros ? -width : width,
+					 reference);
+		compare (count_port_q, port.text, port.length, reference);
+	}
+	good &= show ("port, setw/setfill and long", count_long);
+	good &= show ("port, setw and unsigned long", count_ulong);
+	good &= show ("port, setw/setprecision and q_fixed", count_port_q);
+
+	// The width is used up by one number; the fill character stays
+	bench_count count_once = {0, 0, 0, 0};
+	port.clear ();
+	port << setfill (' ') << setw (6) << 1L << 2L << setw (3) << -4L << 5L;
+	compare (count_once, port.text, port.length, "     12 -45");
+	port.clear ();
+	port << setfill ('0') << setw (4) << 7L << setw (4) << -7L << setfill (' ');
+	compare (count_once, port.text, port.length, "0007-007");
+	good &= show ("port, width only for the next number", count_once);
+
+	// Time each conversion on the same table of numbers of every length
+	static uint32_t table[BENCH_TABLE];
+	for (uint16_t index = 0; index < BENCH_TABLE; index++)
+	{
+		table[index] = random_bits ();
+	}
+
+	printf ("\n%-34s  %8s  %10s\n", "conversion", "Mconv/s", "ns/conv");
+	uint32_t total = 0;
+	double start_ns = bench_ns ();
+	for (uint16_t pass = 0; pass < BENCH_PASSES; pass++)
+		for (uint16_t index = 0; index < BENCH_TABLE; index++)
+			total += uint16_to_dec ((uint16_t)table[index], mine);
+	show_rate ("uint16_to_dec", start_ns, bench_ns ());
+	start_ns = bench_ns ();
+	for (uint16_t pass = 0; pass < BENCH_PASSES; pass++)
+		for (uint16_t index = 0; index < BENCH_TABLE; index++)
+			total += former_ultoa ((uint16_t)table[index], mine, former_base);
+	show_rate ("former utoa, 16 bits", start_ns, bench_ns ());
+	start_ns = bench_ns ();
+	for (uint16_t pass = 0; pass < BENCH_PASSES; pass++)
+		for (uint16_t index = 0; index < BENCH_TABLE; index++)
+			total += snprintf (mine, sizeof (mine), "%u", (unsigned)(uint16_t)table[index]);
+	show_rate ("snprintf %u", start_ns, bench_ns ());
+
+	start_ns = bench_ns ();
+	for (uint16_t pass = 0; pass < BENCH_PASSES; pass++)
+		for (uint16_t index = 0; index < BENCH_TABLE; index++)
+			total += uint32_to_dec (table[index], mine);
+	show_rate ("uint32_to_dec", start_ns, bench_ns ());
+	start_ns = bench_ns ();
+	for (uint16_t pass = 0; pass < BENCH_PASSES; pass++)
+		for (uint16_t index = 0; index < BENCH_TABLE; index++)
+			total += former_ultoa (table[index], mine, former_base);
+	show_rate ("former ultoa", start_ns, bench_ns ());
+	start_ns = bench_ns ();
+	for (uint16_t pass = 0; pass < BENCH_PASSES; pass++)
+		for (uint16_t index = 0; index < BENCH_TABLE; index++)
+			total += snprintf (mine, sizeof (mine), "%lu", (unsigned long)table[index]);
+	show_rate ("snprintf %lu", start_ns, bench_ns ());
+
+	start_ns = bench_ns ();
+	for (uint16_t pass = 0; pass < BENCH_PASSES; pass++)
+		for (uint16_t index = 0; index < BENCH_TABLE; index++)
+			total += int32_to_dec ((int32_t)table[index], mine);
+	show_rate ("int32_to_dec", start_ns, bench_ns ());
+	start_ns = bench_ns ();
+	for (uint16_t pass = 0; pass < BENCH_PASSES; pass++)
+		for (uint16_t index = 0; index < BENCH_TABLE; index++)
+			total += former_ltoa ((int32_t)table[index], mine, former_base);
+	show_rate ("former ltoa", start_ns, bench_ns ());
+	start_ns = bench_ns ();
+	for (uint16_t pass = 0; pass < BENCH_PASSES; pass++)
+		for (uint16_t index = 0; index < BENCH_TABLE; index++)
+			total += snprintf (mine, sizeof (mine), "%ld", (long)(int32_t)table[index]);
+	show_rate ("snprintf %ld", start_ns, bench_ns ());
+
+	start_ns = bench_ns ();
+	for (uint16_t pass = 0; pass < BENCH_PASSES; pass++)
+		for (uint16_t index = 0; index < BENCH_TABLE; index++)
+			total += q_to_dec ((int32_t)table[index], 16, 3, mine);
+	show_rate ("q_to_dec, Q16 to 3 places", start_ns, bench_ns ());
+	start_ns = bench_ns ();
+	for (uint16_t pass = 0; pass < BENCH_PASSES; pass++)
+		for (uint16_t index = 0; index < BENCH_TABLE; index++)
+			total += snprintf (mine, sizeof (mine), "%.3f",
+							   ldexp ((double)(int32_t)table[index], -16));
+	show_rate ("snprintf %.3f of a double", start_ns, bench_ns ());
+	sink = total;
+	printf ("(the PC divides in hardware; on the AVR each digit of the former "
+			"conversions calls a division routine)\n");
+
+	printf ("\n%s\n", good ? "All checks passed" : "Some checks FAILED");
+	return (good ? 0 : 1);
+}
@@ -0,0 +1,438 @@
+//*************************************************************************************
+/** \file jitter_bench.cpp
+ *    This program measures how late the plotter's 25 ms PID tasks start and how often
+ *    they miss their deadlines, under the main loop which called each task's
+ *    schedule() in a fixed order and under task_scheduler, using the simulated
+ *    processor and task timer in sim_avr.cpp. The tasks are those the plotter had
+ *    when all of them ran every 25 ms: two PIDs, the line drawing task and the homing
+ *    task, all released together, with the keyboard, screen and dot making code
+ *    polled between them. Each task's run() lets as much time pass as the real one
+ *    takes, with the line task now and then taking much longer to break up a line,
+ *    and the screen now and then printing a menu.
+ *
+ *    Three main loops are run for the same simulated time:
+ *    \li The former loop, as in Polar_Plotter.cpp before the scheduler, which calls
+ *        the PIDs' schedule() twice around the loop to keep them from waiting long.
+ *    \li The loop in Polar_Plotter.cpp now, which calls dispatch() between the other
+ *        calls and sleeps in idle() when nothing is ready, with earliest deadline
+ *        first selection.
+ *    \li The same loop with rate monotonic selection.
+ *
+ *    Each task measures in its run() method how long after its release it started,
+ *    and whether it finished within its deadline. For each task the runs, average and
+ *    worst lateness, jitter (the standard deviation of the lateness) and misses are
+ *    shown. The scheduler's own counts of runs, misses and worst lateness must agree
+ *    with the tasks' measurements, and no run may be lost. Under the scheduler a PID
+ *    must never wait longer than the other PID's run and one pass of the polled code,
+ *    as it's always picked first when it's released with the others, and the PIDs
+ *    must miss no more deadlines and have no more jitter than under the former loop.
+ *
+ *    Usage: jitter_bench
+ *
+ *  Revisions:
+ *    \li 06-29-2011 Original file
+ *
+ *  License:
+ *    This file is released under the Lesser GNU Public License, version 2. This
+ *    program is intended for educational use only, but it is not limited thereto.
+ */
+//*************************************************************************************
+
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <avr/io.h>
+#include <avr/interrupt.h>
+#include "sim_avr.h"
+#include "base_text_serial.h"
+#include "stl_timer.h"
+#include "stl_task.h"
+#include "stl_scheduler.h"
+
+
+/// Timer ticks in one second
+#define TICKS_PER_SEC		(F_CPU / 8UL)
+
+/// Clock cycles in one microsecond of simulated time
+#define CYCLES_PER_US		(F_CPU / 1000000UL)
+
+/// Seconds of simulated time each main loop is run for
+#define BENCH_SECONDS		60.0
+
+/// Time between runs of all the tasks, in microseconds
+#define BENCH_INTERVAL_US	25000UL
+
+/// A PID must have finished this long after its release, in microseconds
+#define PID_DEADLINE_US		1000UL
+
+/// Time each PID run takes, reading the encoders and setting the duty cycle
+#define PID_WORK_US			300UL
+
+/// Time the line task usually takes, moving the set points along
+#define LINES_WORK_US		100UL
+
+/// Time the line task takes when it breaks up the next line, every so many runs
+#define LINES_LONG_US		2000UL
+
+/// The line task breaks up a line once in this many runs
+#define LINES_LONG_EVERY	8
+
+/// Time the homing task takes when there's nothing to do
+#define HOME_WORK_US		20UL
+
+/// Time the keyboard, screen and dot making code each take when polled
+#define POLL_WORK_US		5UL
+
+/// Time the screen takes to put a menu into the transmit buffer
+#define SCREEN_MENU_US		800UL
+
+/// The screen prints a menu once in this many polls
+#define SCREEN_MENU_EVERY	20000UL
+
+
+//-------------------------------------------------------------------------------------
+/** This class is a task which works for a given time in each run, as one of the
+ *  plotter's tasks would, and measures how late each run started and whether it
+ *  finished by its deadline.
+ */
+
+class bench_task : public stl_task
+{
+	protected:
+		uint32_t work;						///< Clock cycles spent in a usual run
+		uint32_t long_work;					///< Clock cycles spent in a long run
+		uint16_t long_every;				///< A run is long once in this many, or 0
+		uint32_t deadline;					///< Relative deadline in timer ticks
+
+	public:
+		uint32_t runs;						///< Number of runs
+		uint32_t misses;					///< Runs which finished after the deadline
+		uint32_t max_late;					///< Latest start after release, in ticks
+		double late_sum;					///< Sum of the lateness, for the average
+		double late_squares;				///< Sum of the squared lateness, for jitter
+
+		/** The constructor makes a task which hasn't run yet.
+		 *  @param a_timer The task timer
+		 *  @param work_us The time spent in a usual run, in microseconds
+		 *  @param long_us The time spent in a long run, in microseconds
+		 *  @param every A run is long once in this many runs, or never if 0
+		 *  @param deadline_us The relative deadline, in microseconds
+		 */
+		bench_task (task_timer& a_timer, uint32_t work_us, uint32_t long_us, uint16_t every,
+					uint32_t deadline_us)
+			: stl_task (a_timer, time_stamp (0, BENCH_INTERVAL_US))
+		{
+			work = work_us * CYCLES_PER_US;
+			long_work = long_us * CYCLES_PER_US;
+			long_every = every;
+			deadline = deadline_us * (TICKS_PER_SEC / 1000000UL);
+			clear ();
+		}
+
+		/// This method clears the measurements and makes the task due now
+		void clear (void)
+		{
+			runs = 0;
+			misses = 0;
+			max_late = 0;
+			late_sum = 0.0;
+			late_squares = 0.0;
+			set_next_run_time (the_timer.get_time_now ());
+		}
+
+		/** This method measures the lateness of this run, then works for a while. The
+		 *  release time is the next run time, which schedule() only moves on after
+		 *  run() returns.
+		 *  @param state The task's state, which isn't used
+		 *  @return STL_NO_TRANSITION, as the task has only one state
+		 */
+		char run (char state)
+		{
+			(void)state;
+			time_stamp release = get_next_run_time ();
+			uint32_t late = (the_timer.get_time_now () - release).get_raw_time ();
+			if (late > max_late)
+			{
+				max_late = late;
+			}
+			late_sum += late;
+			late_squares += (double)late * late;
+
+			runs++;
+			sim_spend ((long_every && runs % long_every == 0) ? long_work : work);
+			if ((the_timer.get_time_now () - release).get_raw_time () > deadline)
+			{
+				misses++;
+			}
+			return (STL_NO_TRANSITION);
+		}
+};
+
+
+/// Number of times the screen has been polled
+static uint32_t screen_polls = 0;
+
+
+//-------------------------------------------------------------------------------------
+/** This function stands for the code which the main loop polls between the tasks:
+ *  the keyboard, the screen or the dot maker. Now and then the screen prints a menu.
+ *  @param screen True if this is the screen's poll
+ */
+
+static void poll (bool screen)
+{
+	if (screen && ++screen_polls % SCREEN_MENU_EVERY == 0)
+	{
+		sim_spend (SCREEN_MENU_US * CYCLES_PER_US);
+	}
+	else
+	{
+		sim_spend (POLL_WORK_US * CYCLES_PER_US);
+	}
+}
+
+
+/// The tasks, in the order of the scheduler's table: PID 1, PID 2, lines and homing
+static bench_task* p_tasks[4];
+
+/// The names of the tasks
+static const char* task_names[4] = { "PID 1", "PID 2", "lines", "homing" };
+
+
+//-------------------------------------------------------------------------------------
+/** This function runs the main loop which the plotter had before the scheduler, with
+ *  the PIDs' schedule() methods called twice around the loop.
+ *  @param seconds How many seconds of simulated time to run for
+ */
+
+static void run_former (double seconds)
+{
+	double start_seconds = sim_seconds ();
+	while (sim_seconds () - start_seconds < seconds)
+	{
+		poll (false);						// keyboard.run()
+		p_tasks[0]->schedule ();
+		p_tasks[1]->schedule ();
+		poll (true);						// screen_print.run()
+		p_tasks[2]->schedule ();
+		p_tasks[0]->schedule ();
+		p_tasks[1]->schedule ();
+		p_tasks[3]->schedule ();
+		poll (false);						// The_Dot_Maker.run()
+	}
+}
+
+
+//-------------------------------------------------------------------------------------
+/** This function runs the main loop of Polar_Plotter.cpp, which dispatches the most
+ *  urgent ready task between the polled code and sleeps when nothing is ready.
+ *  @param scheduler The scheduler
+ *  @param seconds How many seconds of simulated time to run for
+ */
+
+static void run_scheduler (task_scheduler& scheduler, double seconds)
+{
+	double start_seconds = sim_seconds ();
+	while (sim_seconds () - start_seconds < seconds)
+	{
+		poll (false);						// keyboard.run()
+		bool busy = scheduler.dispatch ();
+		poll (true);						// screen_print.run()
+		busy |= scheduler.dispatch ();
+		poll (false);						// The_Dot_Maker.run()
+		busy |= scheduler.dispatch ();
+		if (!busy)
+		{
+			scheduler.idle ();
+		}
+	}
+}
+
+
+//-------------------------------------------------------------------------------------
+/** This function starts the tasks afresh, all released at once.
+ *  @param scheduler The scheduler, whose statistics are cleared too
+ */
+
+static void start_tasks (task_scheduler& scheduler)
+{
+	for (uint8_t index = 0; index < 4; index++)
+	{
+		p_tasks[index]->clear ();
+	}
+	screen_polls = 0;
+	scheduler.clear_stats ();
+}
+
+
+//-------------------------------------------------------------------------------------
+/** This function prints a table line for each task, and checks that none lost runs.
+ *  @param title What main loop ran the tasks
+ *  @param seconds How long the tasks ran for, in seconds
+ *  @return True if every task ran as many times as it should have
+ */
+
+static bool show_tasks (const char* title, double seconds)
+{
+	bool good = true;
+	uint32_t expected = (uint32_t)(seconds * 1.0E6 / BENCH_INTERVAL_US + 0.5);
+
+	printf ("\n%-30s %7s %9s %9s %9s %7s %7s\n", title, "runs", "avg us", "worst us",
+			"jitter", "misses", "miss %");
+	for (uint8_t index = 0; index < 4; index++)
+	{
+		bench_task& task = *p_tasks[index];
+		double average = task.late_sum / task.runs;
+		double jitter = sqrt (task.late_squares / task.runs - average * average);
+		bool ok = (task.runs + 1 >= expected && task.runs <= expected + 1);
+		printf ("  %-28s %7lu %9.1f %9.1f %9.1f %7lu %7.2f  %s\n", task_names[index],
+				(unsigned long)task.runs, average * 1.0E6 / TICKS_PER_SEC,
+				task.max_late * 1.0E6 / TICKS_PER_SEC, jitter * 1.0E6 / TICKS_PER_SEC,
+				(unsigned long)task.misses, task.misses * 100.0 / task.runs,
+				ok ? "ok" : "FAILED");
+		good &= ok;
+	}
+	return (good);
+}
+
+
+//-------------------------------------------------------------------------------------
+/** This function checks that the scheduler's statistics agree with what the tasks
+ *  measured. The scheduler measures lateness just before calling schedule(), so it
+ *  may be a few register accesses less than the task's own measurement.
+ *  @param scheduler The scheduler
+ *  @return True if the statistics agree
+ */
+
+static bool stats_agree (task_scheduler& scheduler)
+{
+	bool good = true;
+	for (uint8_t index = 0; index < 4; index++)
+	{
+		sched_entry& entry = scheduler.get_entry (index);
+		bench_task& task = *p_tasks[index];
+		uint32_t sched_late = entry.max_late.get_raw_time ();
+		good &= (entry.runs == task.runs && entry.misses == task.misses);
+		good &= (sched_late <= task.max_late && task.max_late - sched_late < 20);
+	}
+	printf ("  %-75s %s\n", "scheduler's runs, misses and worst lateness agree",
+			good ? "ok" : "FAILED");
+	return (good);
+}
+
+
+//-------------------------------------------------------------------------------------
+/** This function finds the worst lateness of the two PIDs.
+ *  @return The worst lateness in microseconds
+ */
+
+static double pid_worst (void)
+{
+	uint32_t worst = p_tasks[0]->max_late;
+	if (p_tasks[1]->max_late > worst)
+	{
+		worst = p_tasks[1]->max_late;
+	}
+	return (worst * 1.0E6 / TICKS_PER_SEC);
+}
+
+
+//-------------------------------------------------------------------------------------
+/** This function finds the larger jitter of the two PIDs.
+ *  @return The standard deviation of the lateness, in microseconds
+ */
+
+static double pid_jitter (void)
+{
+	double worst = 0.0;
+	for (uint8_t index = 0; index < 2; index++)
+	{
+		bench_task& task = *p_tasks[index];
+		double average = task.late_sum / task.runs;
+		double jitter = sqrt (task.late_squares / task.runs - average * average);
+		worst = (jitter > worst) ? jitter : worst;
+	}
+	return (worst * 1.0E6 / TICKS_PER_SEC);
+}
+
+
+//-------------------------------------------------------------------------------------
+/** The main function runs the tasks under each main loop and prints the results.
+ */
+
+int main (void)
+{
+	task_timer the_timer;
+	sei ();
+
+	bench_task pid_1 (the_timer, PID_WORK_US, 0, 0, PID_DEADLINE_US);
+	bench_task pid_2 (the_timer, PID_WORK_US, 0, 0, PID_DEADLINE_US);
+	bench_task lines (the_timer, LINES_WORK_US, LINES_LONG_US, LINES_LONG_EVERY,
+					  BENCH_INTERVAL_US);
+	bench_task home (the_timer, HOME_WORK_US, 0, 0, BENCH_INTERVAL_US);
+	p_tasks[0] = &pid_1;
+	p_tasks[1] = &pid_2;
+	p_tasks[2] = &lines;
+	p_tasks[3] = &home;
+
+	// The tasks are registered with the priorities Polar_Plotter.cpp gives them; the
+	// PIDs' deadlines are much shorter than their interval
+	task_scheduler scheduler (the_timer, SCHED_EDF);
+	scheduler.add_task (&pid_1, 3, time_stamp (0, PID_DEADLINE_US));
+	scheduler.add_task (&pid_2, 3, time_stamp (0, PID_DEADLINE_US));
+	scheduler.add_task (&lines, 2, time_stamp (0, BENCH_INTERVAL_US));
+	scheduler.add_task (&home, 1, time_stamp (0, BENCH_INTERVAL_US));
+	scheduler.set_tickless (true);
+
+	printf ("Lateness of each run from its release, over %.0f s; a PID must finish "
+			"within %lu us\n", BENCH_SECONDS, (unsigned long)PID_DEADLINE_US);
+	bool good = true;
+
+	start_tasks (scheduler);
+	run_former (BENCH_SECONDS);
+	good &= show_tasks ("Former loop, fixed order", BENCH_SECONDS);
+	double former_worst = pid_worst ();
+	double former_jitter = pid_jitter ();
+	uint32_t former_misses = pid_1.misses + pid_2.misses;
+
+	start_tasks (scheduler);
+	run_scheduler (scheduler, BENCH_SECONDS);
+	good &= show_tasks ("Scheduler, EDF", BENCH_SECONDS);
+	good &= stats_agree (scheduler);
+	double edf_worst = pid_worst ();
+	double edf_jitter = pid_jitter ();
+	uint32_t edf_misses = pid_1.misses + pid_2.misses;
+	uint8_t edf_idle = scheduler.get_idle_percent ();
+
+	scheduler.set_policy (SCHED_RATE_MONOTONIC);
+	start_tasks (scheduler);
+	run_scheduler (scheduler, BENCH_SECONDS);
+	good &= show_tasks ("Scheduler, rate monotonic", BENCH_SECONDS);
+	good &= stats_agree (scheduler);
+	double rm_worst = pid_worst ();
+	double rm_jitter = pid_jitter ();
+	uint32_t rm_misses = pid_1.misses + pid_2.misses;
+
+	// A PID released with the others goes first, so it can only wait for the other PID
+	// and for the code polled between dispatches, which may be printing a menu
+	double bound = PID_WORK_US + SCREEN_MENU_US + 2 * POLL_WORK_US + 50.0;
+	bool ok = (edf_worst <= bound && rm_worst <= bound);
+	printf ("\n%-28s %8s %8s %8s %8s\n", "For the PIDs", "former", "EDF", "RM", "bound");
+	printf ("%-28s %8.0f %8.0f %8.0f %8.0f  %s\n", "  worst lateness, us", former_worst,
+			edf_worst, rm_worst, bound, ok ? "ok" : "FAILED");
+	good &= ok;
+
+	ok = (edf_jitter <= former_jitter && rm_jitter <= former_jitter);
+	printf ("%-28s %8.1f %8.1f %8.1f %8s  %s\n", "  jitter, us", former_jitter, edf_jitter,
+			rm_jitter, "", ok ? "ok" : "FAILED");
+	good &= ok;
+
+	ok = (edf_misses <= former_misses && rm_misses <= former_misses);
+	printf ("%-28s %8lu %8lu %8lu %8s  %s\n", "  deadline misses", (unsigned long)former_misses,
+			(unsigned long)edf_misses, (unsigned long)rm_misses, "", ok ? "ok" : "FAILED");
+	good &= ok;
+	printf ("\n%-28s %8u%%\n", "Idle under the scheduler", edf_idle);
+
+	printf ("\n%s\n", good ? "All checks passed" : "Some checks FAILED");
+	return (good ? 0 : 1);
+}
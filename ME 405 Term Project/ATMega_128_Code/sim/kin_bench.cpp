@@ -0,0 +1,339 @@
+//*************************************************************************************
+/** \file kin_bench.cpp
+ *    This program checks and measures the fixed point kinematics in kinematics.cpp on a
+ *    PC. Points on a grid covering the whole drawing area, 0 to 34.0 inches in x and 0
+ *    to 22.0 in y, every eighth of a tenth of an inch and including the edges, and many
+ *    random points with every bit of their fractions used, are turned into encoder
+ *    counts, and the radius and angle compared with the same conversion worked out in
+ *    double precision. The worst and RMS errors are shown, beside those of the floating
+ *    point conversion which point and trajectory used before, and must be within the
+ *    bounds promised in kinematics.h. Speeds are checked the same way, at random points
+ *    more than an inch from the origin (closer in, the angle's speed grows without
+ *    bound) with random velocities up to the cart's top speed. The angle's speed is
+ *    divided twice by a 16-bit distance and scaled by a constant which is 12 parts per
+ *    million off, so its bound grows with the speed, which is over a million counts
+ *    per second close in. The integer square root is checked against the exact one on
+ *    a sweep of 32-bit numbers.
+ *
+ *    Last, the time taken by each call is shown in CPU cycles (time stamp counter ticks
+ *    on an x86 PC, nanoseconds on others). The PC does floating point in hardware, so
+ *    the former conversion is quick here; the AVR has to do it with library routines.
+ *
+ *    Usage: kin_bench
+ *
+ *  Revisions:
+ *    \li 06-29-2011 Original file
+ *
+ *  License:
+ *    This file is released under the Lesser GNU Public License, version 2. This
+ *    program is intended for educational use only, but it is not limited thereto.
+ */
+//*************************************************************************************
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <math.h>
+#include <time.h>
+#include "kinematics.h"
+
+#if defined (__x86_64__) || defined (__i386__)
+	#include <x86intrin.h>
+#endif
+
+
+/// The largest x coordinate on the paper, in tenths of an inch
+#define BENCH_X_MAX			340
+
+/// The largest y coordinate on the paper, in tenths of an inch
+#define BENCH_Y_MAX			220
+
+/// The grid's spacing, in fixed point units; KIN_ONE / 8 is an eighth of a tenth
+#define BENCH_GRID			(KIN_ONE / 8)
+
+/// The number of random points and of random points with speeds
+#define BENCH_RANDOM		2000000L
+
+/// The top speed of the cart, 60000 counts/s, in tenths of an inch per second
+#define BENCH_TOP_SPEED		25.0
+
+/// How many calls are timed
+#define BENCH_CALLS			1000000L
+
+/// The former conversion was compiled in trajectory.cpp; this keeps the copy here from
+/// being inlined into the timing loop
+#define FORMER_METHOD		__attribute__ ((noinline))
+
+
+/// Results are put here so that the compiler can't leave out the work done for them
+static volatile uint32_t bench_sink;
+
+
+//-------------------------------------------------------------------------------------
+/** This function reads a free-running clock.
+ *  @return The time stamp counter on an x86 PC, or the time in nanoseconds on others
+ */
+
+static inline uint64_t bench_clock (void)
+{
+#if defined (__x86_64__) || defined (__i386__)
+	return (__rdtsc ());
+#else
+	struct timespec now;
+	clock_gettime (CLOCK_MONOTONIC, &now);
+	return ((uint64_t)now.tv_sec * 1000000000ULL + now.tv_nsec);
+#endif
+}
+
+
+//-------------------------------------------------------------------------------------
+/** This function is the conversion which trajectory::to_counts() did before, with
+ *  floating point numbers, as point and trajectory both used it.
+ *  @param x The x coordinate, in tenths of an inch
+ *  @param y The y coordinate, in tenths of an inch
+ *  @param radius Set to the radius in encoder counts
+ *  @param angle Set to the angle in encoder counts
+ */
+
+FORMER_METHOD static void former_to_counts (float x, float y, int32_t& radius,
+											int32_t& angle)
+{
+	radius = (int32_t)(sqrt (x * x + y * y) * COUNTS_PER_TENTH);
+	angle = (int32_t)(atan2 (y, x) * COUNTS_PER_RADIAN);
+}
+
+
+//-------------------------------------------------------------------------------------
+/** This structure keeps the worst and RMS errors of a set of conversions.
+ */
+
+typedef struct
+{
+	double worst;							///< The largest error
+	double square_sum;						///< The sum of the squares of the errors
+	long count;								///< The number of errors
+} bench_error;
+
+
+//-------------------------------------------------------------------------------------
+/** This function adds one error to a set.
+ *  @param set The set of errors
+ *  @param error The error
+ */
+
+static void add_error (bench_error& set, double error)
+{
+	set.worst = (fabs (error) > set.worst) ? fabs (error) : set.worst;
+	set.square_sum += error * error;
+	set.count++;
+}
+
+
+//-------------------------------------------------------------------------------------
+/** This function prints one line of the error table.
+ *  @param label A name for the line
+ *  @param set The errors
+ *  @param bound The largest error allowed, or a negative number for no check
+ *  @return True if the worst error was within the bound
+ */
+
+static bool show (const char* label, const bench_error& set, double bound)
+{
+	bool good = (bound < 0.0 || set.worst <= bound);
+	printf ("%-36s %9ld %8.3f %8.4f", label, set.count, set.worst,
+			sqrt (set.square_sum / set.count));
+	if (bound < 0.0)
+	{
+		printf ("\n");
+	}
+	else
+	{
+		printf ("  %5.1f  %s\n", bound, good ? "ok" : "FAILED");
+	}
+	return (good);
+}
+
+
+//-------------------------------------------------------------------------------------
+/** This function converts a point with both the fixed point kinematics and the former
+ *  floating point conversion, and adds their errors from the exact radius and angle to
+ *  the sets.
+ *  @param x The x coordinate, in fixed point tenths of an inch
+ *  @param y The y coordinate, in fixed point tenths of an inch
+ *  @param errors The radius and angle errors of the fixed point and former conversions
+ */
+
+static void check_point (int32_t x, int32_t y, bench_error errors[4])
+{
+	double exact_x = (double)x / KIN_ONE;
+	double exact_y = (double)y / KIN_ONE;
+	double radius = sqrt (exact_x * exact_x + exact_y * exact_y) * COUNTS_PER_TENTH;
+	double angle = atan2 (exact_y, exact_x) * COUNTS_PER_RADIAN;
+
+	int32_t r_count, theta_count;
+	kinematics::to_counts (x, y, r_count, theta_count);
+	add_error (errors[0], r_count - radius);
+	add_error (errors[1], theta_count - angle);
+
+	former_to_counts ((float)exact_x, (float)exact_y, r_count, theta_count);
+	add_error (errors[2], r_count - radius);
+	add_error (errors[3], theta_count - angle);
+}
+
+
+//-------------------------------------------------------------------------------------
+/** This function picks a random number.
+ *  @param highest The largest number wanted
+ *  @return A number from 0 to highest
+ */
+
+static int32_t random_up_to (int32_t highest)
+{
+	return ((int32_t)(((uint64_t)rand () * (highest + 1)) / ((uint64_t)RAND_MAX + 1)));
+}
+
+
+//-------------------------------------------------------------------------------------
+/** The main function checks the conversions, times them, and prints the results.
+ */
+
+int main (void)
+{
+	bool good = true;
+	bench_error errors[4] = {{0.0, 0.0, 0}, {0.0, 0.0, 0}, {0.0, 0.0, 0}, {0.0, 0.0, 0}};
+	int32_t x_max = BENCH_X_MAX * KIN_ONE;
+	int32_t y_max = BENCH_Y_MAX * KIN_ONE;
+
+	// The grid, then random points, over the whole drawing area
+	for (int32_t x = 0; x <= x_max; x += BENCH_GRID)
+	{
+		for (int32_t y = 0; y <= y_max; y += BENCH_GRID)
+		{
+			check_point (x, y, errors);
+		}
+	}
+	srand (405);
+	for (long count = 0; count < BENCH_RANDOM; count++)
+	{
+		check_point (random_up_to (x_max), random_up_to (y_max), errors);
+	}
+
+	printf ("%-36s %9s %8s %8s  %5s\n", "Error from double precision, counts", "points",
+			"worst", "RMS", "bound");
+	good &= show ("radius, fixed point", errors[0], 1.0);
+	good &= show ("angle, fixed point", errors[1], 3.0);
+	show ("radius, former floating point", errors[2], -1.0);
+	show ("angle, former floating point", errors[3], -1.0);
+
+	// Speeds at random points over an inch from the origin, in random directions; the
+	// points are spread evenly over radius, so that the short radii, at which the angle
+	// moves fastest, are well covered
+	bench_error speed_errors[2] = {{0.0, 0.0, 0}, {0.0, 0.0, 0}};
+	bool within = true;
+	double r_max = sqrt ((double)x_max * x_max + (double)y_max * y_max);
+	for (long count = 0; count < BENCH_RANDOM; count++)
+	{
+		double r_point = 10.0 * KIN_ONE + rand () * (r_max - 10.0 * KIN_ONE) / RAND_MAX;
+		double theta_point = rand () * (M_PI / 2.0) / RAND_MAX;
+		int32_t x = (int32_t)(r_point * cos (theta_point));
+		int32_t y = (int32_t)(r_point * sin (theta_point));
+		if (x > x_max || y > y_max)
+		{
+			continue;
+		}
+		double direction = rand () * 2.0 * M_PI / RAND_MAX;
+		double speed = rand () * BENCH_TOP_SPEED / RAND_MAX;
+		int32_t x_speed = (int32_t)(cos (direction) * speed * KIN_ONE);
+		int32_t y_speed = (int32_t)(sin (direction) * speed * KIN_ONE);
+
+		int32_t r_count, theta_count, r_speed, theta_speed;
+		kinematics::to_counts (x, y, x_speed, y_speed, r_count, theta_count, r_speed,
+							   theta_speed);
+		double squared = (double)x * x + (double)y * y;
+		double dot = (double)x * x_speed + (double)y * y_speed;
+		double cross = (double)x * y_speed - (double)y * x_speed;
+		add_error (speed_errors[0], r_speed - dot / sqrt (squared) / KIN_ONE
+										  * COUNTS_PER_TENTH);
+		double exact_theta = cross / squared * COUNTS_PER_RADIAN;
+		add_error (speed_errors[1], theta_speed - exact_theta);
+		within &= (fabs (theta_speed - exact_theta) <= 16.0 + 40.0E-6 * fabs (exact_theta));
+	}
+	printf ("\n%-36s %9s %8s %8s  %5s\n", "Speed error, counts/s", "points", "worst",
+			"RMS", "bound");
+	good &= show ("radius speed, fixed point", speed_errors[0], 2.0);
+	show ("angle speed, fixed point", speed_errors[1], -1.0);
+	printf ("%-64s %s\n", "angle speeds are within 16 counts/s plus 40 parts per million",
+			within ? "ok" : "FAILED");
+	good &= within;
+
+	// The integer square root is exact, on a sweep which reaches the top of its range
+	bool exact = true;
+	for (uint64_t value = 0; value <= 0xFFFFFFFFULL; value += (value >> 12) + 1)
+	{
+		uint16_t root = kinematics::isqrt ((uint32_t)value);
+		exact &= ((uint64_t)root * root <= value
+				  && ((uint64_t)root + 1) * ((uint64_t)root + 1) > value);
+	}
+	printf ("\n%-64s %s\n", "isqrt() is exact on a sweep of 32-bit numbers",
+			exact ? "ok" : "FAILED");
+	good &= exact;
+
+	// The time taken by each call, at points spread over the paper
+	printf ("\n%-36s %10s\n", "Cost per call", "CPU cycles");
+	int32_t xs[1024], ys[1024];
+	for (uint16_t index = 0; index < 1024; index++)
+	{
+		xs[index] = random_up_to (x_max);
+		ys[index] = random_up_to (y_max);
+	}
+	int32_t r_count, theta_count, r_speed, theta_speed;
+	uint32_t sum = 0;
+	uint64_t start = bench_clock ();
+	for (long count = 0; count < BENCH_CALLS; count++)
+	{
+		kinematics::to_counts (xs[count & 1023], ys[count & 1023], r_count, theta_count);
+		sum += r_count + theta_count;
+	}
+	printf ("%-36s %10.1f\n", "to_counts()", (double)(bench_clock () - start) / BENCH_CALLS);
+
+	start = bench_clock ();
+	for (long count = 0; count < BENCH_CALLS; count++)
+	{
+		kinematics::to_counts (xs[count & 1023], ys[count & 1023], 1000, -700, r_count,
+							   theta_count, r_speed, theta_speed);
+		sum += r_count + theta_count + r_speed + theta_speed;
+	}
+	printf ("%-36s %10.1f\n", "to_counts(), with speeds",
+			(double)(bench_clock () - start) / BENCH_CALLS);
+
+	start = bench_clock ();
+	for (long count = 0; count < BENCH_CALLS; count++)
+	{
+		sum += kinematics::isqrt ((uint32_t)xs[count & 1023] * (uint32_t)ys[count & 1023]);
+	}
+	printf ("%-36s %10.1f\n", "isqrt()", (double)(bench_clock () - start) / BENCH_CALLS);
+
+	start = bench_clock ();
+	for (long count = 0; count < BENCH_CALLS; count++)
+	{
+		sum += kinematics::angle (xs[count & 1023], ys[count & 1023]);
+	}
+	printf ("%-36s %10.1f\n", "angle()", (double)(bench_clock () - start) / BENCH_CALLS);
+
+	start = bench_clock ();
+	for (long count = 0; count < BENCH_CALLS; count++)
+	{
+		former_to_counts ((float)xs[count & 1023] / KIN_ONE,
+						  (float)ys[count & 1023] / KIN_ONE, r_count, theta_count);
+		sum += r_count + theta_count;
+	}
+	printf ("%-36s %10.1f\n", "former floating point to_counts()",
+			(double)(bench_clock () - start) / BENCH_CALLS);
+	printf ("(the PC has floating point hardware; the AVR doesn't, so there the former "
+			"conversion\n calls library routines for the square root and arctangent, "
+			"each thousands of cycles)\n");
+	bench_sink = sum;
+
+	printf ("\n%s\n", good ? "All checks passed" : "Some checks FAILED");
+	return (good ? 0 : 1);
+}
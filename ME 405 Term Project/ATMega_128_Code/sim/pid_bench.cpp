@@ -0,0 +1,594 @@
+//*************************************************************************************
+/** \file pid_bench.cpp
+ *    This program checks and measures the fixed point PID controller in pid_fixed.h.
+ *    The controller drives the model of the cart's motor in plant.cpp through da_motor,
+ *    as task_velocity and task_PID do, on the simulated processor in sim_avr.cpp:
+ *    \li A step in speed is given to a velocity loop run every 2 ms with the gains
+ *        which Polar_Plotter.cpp gives speed_1, and one in position to a position loop
+ *        run every 10 ms whose output is the duty cycle, with motor_1's gain. The
+ *        rise time (10% to 90%), overshoot, settling time (to within 2% of the step)
+ *        and steady state error are shown for each. The velocity loop is given the
+ *        change in count since its last update, as the slave's speed estimate would
+ *        be, but its response is measured on the model's own speed.
+ *    \li The output must stay within its limits at every update, and within the slew
+ *        limit of the one before when one is set, and the integral must stay within
+ *        the output limits.
+ *    \li A speed which the motor can't reach is asked for, winding the integral up,
+ *        then a reachable one; with back calculation the loop must settle sooner than
+ *        with it all but turned off.
+ *
+ *    The controller is then fed a long run of random setpoints and measurements, with
+ *    and without limits, and its output compared with that of the same control law
+ *    worked out with double precision numbers. Last, the time taken by update() is
+ *    shown in CPU cycles (time stamp counter ticks on an x86 PC, nanoseconds on
+ *    others), beside the law which task_PID used before, with its 64-bit divisions.
+ *
+ *    Usage: pid_bench
+ *
+ *  Revisions:
+ *    \li 06-29-2011 Original file
+ *
+ *  License:
+ *    This file is released under the Lesser GNU Public License, version 2. This
+ *    program is intended for educational use only, but it is not limited thereto.
+ */
+//*************************************************************************************
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <time.h>
+#include <avr/io.h>
+#include <avr/interrupt.h>
+#include "sim_avr.h"
+#include "sim_serial.h"
+#include "plant.h"
+#include "da_motor.h"
+#include "pid_fixed.h"
+
+#if defined (__x86_64__) || defined (__i386__)
+	#include <x86intrin.h>
+#endif
+
+
+/// The time step of the motor model, as plotter_sim uses
+#define BENCH_PLANT_STEP	100.0E-6
+
+/// The largest duty cycle, as task_velocity and task_PID use
+#define BENCH_SATURATE		255
+
+/// The number of random inputs given to the controller and its double precision copy
+#define BENCH_RANDOM_STEPS	200000L
+
+/// How many updates are timed
+#define BENCH_CALLS			2000000L
+
+/// The former law was compiled in task_PID.cpp; this keeps the copy here from being
+/// inlined into the timing loop
+#define FORMER_METHOD		__attribute__ ((noinline))
+
+
+/// Results are put here so that the compiler can't leave out the work done for them
+static volatile uint32_t bench_sink;
+
+/// The model of the plotter, of which only the cart is used
+static plotter_plant the_plant;
+
+
+//-------------------------------------------------------------------------------------
+/** This function moves the model along by a time step; the simulator calls it as time
+ *  passes.
+ *  @param dt The time step in seconds
+ */
+
+static void step_plant (double dt)
+{
+	the_plant.step (dt);
+}
+
+
+//-------------------------------------------------------------------------------------
+/** This function reads a free-running clock.
+ *  @return The time stamp counter on an x86 PC, or the time in nanoseconds on others
+ */
+
+static inline uint64_t bench_clock (void)
+{
+#if defined (__x86_64__) || defined (__i386__)
+	return (__rdtsc ());
+#else
+	struct timespec now;
+	clock_gettime (CLOCK_MONOTONIC, &now);
+	return ((uint64_t)now.tv_sec * 1000000000ULL + now.tv_nsec);
+#endif
+}
+
+
+//-------------------------------------------------------------------------------------
+/** This structure holds the measurements of one step response.
+ */
+
+typedef struct
+{
+	double rise;							///< Time from 10% to 90% of the step, s
+	double overshoot;						///< Largest overshoot, percent of the step
+	double settle;							///< Time to stay within 2% of the step, s
+	double ss_error;						///< Mean error over the last 10%, percent
+	int16_t out_lo, out_hi;					///< Lowest and highest outputs
+	int16_t worst_slew;						///< Largest change in output in one update
+	int16_t int_lo, int_hi;					///< Lowest and highest integral terms
+} step_result;
+
+
+//-------------------------------------------------------------------------------------
+/** This function runs a loop on the cart's motor for a while, as task_velocity or
+ *  task_PID would: at each update the count is read, the controller works out a duty
+ *  cycle, and da_motor sets the direction and duty cycle; then time passes until the
+ *  next update. The loop is started at rest with a setpoint of zero, which steps to
+ *  the given setpoint after a tenth of the run; if a second setpoint is given, it
+ *  steps to that half way through and the response to that step is measured instead.
+ *  @param pid The controller, set up with its gains and limits
+ *  @param motor The motor driver
+ *  @param speed True to control speed in counts per second, false for position
+ *  @param period The time between updates, in seconds
+ *  @param run The length of the run, in seconds
+ *  @param setpoint The setpoint of the first step
+ *  @param second The setpoint of the second step, or the same as the first for none
+ *  @param result The measurements of the step response
+ */
+
+static void run_step (pid_fixed<16>& pid, da_motor& motor, bool speed, double period,
+					  double run, int32_t setpoint, int32_t second, step_result& result)
+{
+	uint32_t updates = (uint32_t)(run / period + 0.5);
+	uint32_t step_at = updates / 10;
+	uint32_t measure_at = step_at;
+	uint32_t cycles = (uint32_t)(period * F_CPU + 0.5);
+
+	the_plant.set_position (0, 30000.0);
+	int32_t last_count = the_plant.get_count (0);
+	int32_t start = speed ? 0 : last_count;
+	int32_t from = start;
+	int32_t to = start + setpoint;
+	if (second != setpoint)
+	{
+		measure_at = updates / 2;
+		from = to;
+		to = start + second;
+	}
+	pid.reset (start, start);
+
+	double step = to - from;
+	double t_10 = -1.0, t_90 = -1.0, settled = 0.0, peak = 0.0, error_sum = 0.0;
+	uint32_t error_count = 0;
+	int16_t last_output = 0;
+	result.out_lo = result.out_hi = 0;
+	result.worst_slew = 0;
+	result.int_lo = result.int_hi = 0;
+
+	for (uint32_t update = 0; update < updates; update++)
+	{
+		int32_t count = the_plant.get_count (0);
+		int32_t measured = speed ? (int32_t)((count - last_count) / period) : count;
+		last_count = count;
+
+		int32_t target = start;
+		if (update >= step_at)
+		{
+			target = start + setpoint;
+		}
+		if (update >= measure_at)
+		{
+			target = to;
+		}
+		int16_t output = pid.update (target, measured);
+		if (output < 0)
+		{
+			motor.set_mode (1, 2);
+			motor.update_duty_cycle (1, (uint8_t)(-output));
+		}
+		else
+		{
+			motor.set_mode (1, 1);
+			motor.update_duty_cycle (1, (uint8_t)output);
+		}
+
+		// Limits are checked at every update, from the start
+		result.out_lo = (output < result.out_lo) ? output : result.out_lo;
+		result.out_hi = (output > result.out_hi) ? output : result.out_hi;
+		int16_t change = abs (output - last_output);
+		result.worst_slew = (change > result.worst_slew) ? change : result.worst_slew;
+		last_output = output;
+		int16_t integral = pid.get_integral ();
+		result.int_lo = (integral < result.int_lo) ? integral : result.int_lo;
+		result.int_hi = (integral > result.int_hi) ? integral : result.int_hi;
+
+		// The step response is measured from the step being looked at
+		if (update >= measure_at)
+		{
+			double time = (update - measure_at) * period;
+			double done = ((speed ? the_plant.get_axis (0).velocity : count) - from) / step;
+			if (t_10 < 0.0 && done >= 0.1)
+			{
+				t_10 = time;
+			}
+			if (t_90 < 0.0 && done >= 0.9)
+			{
+				t_90 = time;
+			}
+			if (done - 1.0 > peak)
+			{
+				peak = done - 1.0;
+			}
+			if (fabs (done - 1.0) > 0.02)
+			{
+				settled = time + period;
+			}
+			if (update >= updates - updates / 10)
+			{
+				error_sum += 1.0 - done;
+				error_count++;
+			}
+		}
+		sim_spend (cycles);
+	}
+
+	result.rise = (t_10 >= 0.0 && t_90 >= 0.0) ? t_90 - t_10 : INFINITY;
+	result.overshoot = peak * 100.0;
+	result.settle = settled;
+	result.ss_error = fabs (error_sum / error_count) * 100.0;
+	motor.update_duty_cycle (1, 0);
+}
+
+
+//-------------------------------------------------------------------------------------
+/** This function prints one line of the step response table.
+ *  @param label A name for the line
+ *  @param result The measurements
+ *  @param good True if the checks for this case passed
+ */
+
+static void show (const char* label, const step_result& result, bool good)
+{
+	printf ("%-28s %6.1f %6.1f %6.1f %6.2f %5d %4d %5d %4d %4d  %s\n", label,
+			result.rise * 1000.0, result.overshoot, result.settle * 1000.0,
+			result.ss_error, result.out_lo, result.out_hi, result.worst_slew,
+			result.int_lo, result.int_hi, good ? "ok" : "FAILED");
+}
+
+
+//-------------------------------------------------------------------------------------
+/** This class works out the control law in pid_fixed::update() with double precision
+ *  numbers. Gains are given as pid_fixed holds them, so that the two differ only in
+ *  the arithmetic.
+ */
+
+class pid_double
+{
+	protected:
+		double kp, ki, kd, kff;				///< Gains, as in pid_fixed
+		double out_min, out_max, slew;		///< Output limits and slew limit
+		double integral, d_filtered;		///< Integral and filtered derivative terms
+		double last_output;					///< Output of the last update
+		double last_measured;				///< Measurement at the last update
+		double last_setpoint;				///< Setpoint at the last update
+		double filter;						///< Share of a new derivative taken
+		double windup;						///< Back calculation gain
+
+		/** This method limits a number to the range of a 16-bit number, as the fixed
+		 *  point controller does with its error and changes.
+		 *  @param number The number to be limited
+		 *  @return The limited number
+		 */
+		static double limit_16 (double number)
+		{
+			return (number > 32767.0 ? 32767.0 : (number < -32768.0 ? -32768.0 : number));
+		}
+
+		/** This method limits a number to a range.
+		 *  @param number The number to be limited
+		 *  @param lowest The smallest number allowed
+		 *  @param highest The largest number allowed
+		 *  @return The limited number
+		 */
+		static double clamp (double number, double lowest, double highest)
+		{
+			return (number > highest ? highest : (number < lowest ? lowest : number));
+		}
+
+	public:
+		/** The constructor sets the controller up from the settings of a fixed point
+		 *  controller.
+		 *  @param p, i, d, ff The gains, as given to pid_fixed<16>
+		 *  @param lowest, highest The output limits
+		 *  @param per_update The slew limit, or 0 for none
+		 *  @param filter_shift The derivative filter setting
+		 *  @param windup_shift The back calculation setting
+		 */
+		pid_double (int32_t p, int32_t i, int32_t d, int32_t ff, int16_t lowest,
+					int16_t highest, int16_t per_update, uint8_t filter_shift,
+					uint8_t windup_shift)
+		{
+			kp = p / 65536.0;
+			ki = i / 65536.0;
+			kd = d / 65536.0;
+			kff = ff / 65536.0;
+			out_min = lowest;
+			out_max = highest;
+			slew = per_update;
+			filter = 1.0 / (1 << filter_shift);
+			windup = 1.0 / (1L << windup_shift);
+			integral = d_filtered = last_output = last_measured = last_setpoint = 0.0;
+		}
+
+		/** This method runs the controller once, as pid_fixed::update() does.
+		 *  @param setpoint The value which the measurement should have
+		 *  @param measured The measured value
+		 *  @return The new output, not rounded
+		 */
+		double update (int32_t setpoint, int32_t measured)
+		{
+			double error = limit_16 ((double)setpoint - measured);
+			double d_measured = limit_16 (last_measured - measured);
+			double d_setpoint = limit_16 ((double)setpoint - last_setpoint);
+			last_measured = measured;
+			last_setpoint = setpoint;
+
+			d_filtered += (kd * d_measured - d_filtered) * filter;
+			double unlimited = kp * error + integral + d_filtered + kff * d_setpoint;
+			double output = clamp (unlimited, out_min, out_max);
+			if (slew != 0.0)
+			{
+				output = clamp (output, last_output - slew, last_output + slew);
+			}
+			last_output = output;
+
+			double wound = integral + ki * error;
+			integral = wound + (output - unlimited) * windup;
+			if ((wound >= 0.0) ? (integral < 0.0) : (integral > 0.0))
+			{
+				integral = 0.0;
+			}
+			else if ((wound >= 0.0) ? (integral > wound) : (integral < wound))
+			{
+				integral = wound;
+			}
+			integral = clamp (integral, out_min, out_max);
+			return (output);
+		}
+};
+
+
+//-------------------------------------------------------------------------------------
+/** This class gives the bench the output of pid_fixed before it's rounded to whole
+ *  output units, so that it can be compared closely with double precision.
+ */
+
+class bench_pid : public pid_fixed<16>
+{
+	public:
+		/// This method returns the output of the last update, not rounded
+		double exact_output (void) { return (last_output / 65536.0); }
+};
+
+
+//-------------------------------------------------------------------------------------
+/** This function feeds the fixed point controller and its double precision copy the
+ *  same random setpoints and measurements, which wander about and sometimes jump, and
+ *  finds how far apart their outputs get. Nothing is done with the outputs, so the
+ *  loop is open.
+ *  @param label A name for the line printed
+ *  @param p, i, d, ff The gains
+ *  @param limit The output limit, used as both the highest and minus the lowest
+ *  @param per_update The slew limit, or 0 for none
+ *  @param tolerance The largest difference allowed, in output units
+ *  @return True if the outputs stayed within the tolerance
+ */
+
+static bool compare (const char* label, int32_t p, int32_t i, int32_t d, int32_t ff,
+					 int16_t limit, int16_t per_update, double tolerance)
+{
+	bench_pid fixed;
+	fixed.set_kp (p);
+	fixed.set_ki (i);
+	fixed.set_kd (d);
+	fixed.set_kff (ff);
+	fixed.set_output_limits (-limit, limit);
+	fixed.set_slew_limit (per_update);
+	fixed.set_derivative_filter (2);
+	fixed.set_antiwindup (1);
+	pid_double reference (p, i, d, ff, -limit, limit, per_update, 2, 1);
+
+	srand (405);
+	int32_t setpoint = 0, measured = 0;
+	double worst = 0.0, square_sum = 0.0;
+	for (long count = 0; count < BENCH_RANDOM_STEPS; count++)
+	{
+		setpoint += rand () % 41 - 20;
+		measured += rand () % 41 - 20;
+		if (rand () % 500 == 0)
+		{
+			setpoint += rand () % 4001 - 2000;
+		}
+		measured += (setpoint - measured) / 16;
+		fixed.update (setpoint, measured);
+		double difference = fixed.exact_output () - reference.update (setpoint, measured);
+		worst = (fabs (difference) > worst) ? fabs (difference) : worst;
+		square_sum += difference * difference;
+	}
+
+	bool good = (worst <= tolerance);
+	printf ("%-40s %10.3f %10.4f  %s\n", label, worst,
+			sqrt (square_sum / BENCH_RANDOM_STEPS), good ? "ok" : "FAILED");
+	return (good);
+}
+
+
+//-------------------------------------------------------------------------------------
+/** This class holds the position law which task_PID used before pid_fixed: P and I
+ *  with gains divided by constants, using 64-bit multiplications and divisions, and
+ *  the sum of errors held within a fixed range.
+ */
+
+class former_pid
+{
+	protected:
+		int32_t K_p, K_i;					///< Gains, divided by the divisors below
+		int32_t E_sum_old;					///< Sum of errors
+
+	public:
+		/** The constructor sets the gains.
+		 *  @param p The proportional gain, in ten thousandths
+		 *  @param i The integral gain, in millionths
+		 */
+		former_pid (int32_t p, int32_t i) { K_p = p; K_i = i; E_sum_old = 0; }
+
+		/** This method works out the output as task_PID did.
+		 *  @param Set_Point The setpoint
+		 *  @param encoder The measurement
+		 *  @return The output, limited to the duty cycle's range
+		 */
+		FORMER_METHOD int32_t update (int32_t Set_Point, int32_t encoder)
+		{
+			int32_t error_now = (Set_Point - encoder);
+			int32_t proportional_error = (int32_t)(((int64_t)error_now * (int64_t)K_p)
+												   / 10000L);
+			int32_t E_sum_now = error_now + E_sum_old;
+			if (E_sum_now > 1000)
+				E_sum_now = 1000;
+			else if (E_sum_now < -1000)
+				E_sum_now = -1000;
+			int32_t integral_error = (int32_t)(((int64_t)E_sum_now * (int64_t)K_i)
+											   / 1000000L);
+			E_sum_old = E_sum_now;
+			int32_t OUTPUT = proportional_error + integral_error;
+			if (OUTPUT > BENCH_SATURATE)
+				OUTPUT = BENCH_SATURATE;
+			else if (OUTPUT < -BENCH_SATURATE)
+				OUTPUT = -BENCH_SATURATE;
+			return (OUTPUT);
+		}
+};
+
+
+//-------------------------------------------------------------------------------------
+/** This function calls a controller's update() method many times with measurements
+ *  which wander about the setpoint, and prints the time taken per call.
+ *  @param label A name for the line printed
+ *  @param p_pid A pointer to the controller
+ */
+
+template <class pid_type>
+static void time_update (const char* label, pid_type* p_pid)
+{
+	volatile int32_t setpoint = 5000;		// Kept in memory so the loop isn't folded
+	int32_t sum = 0;
+
+	uint64_t start = bench_clock ();
+	for (long count = 0; count < BENCH_CALLS; count++)
+	{
+		sum += p_pid->update (setpoint, setpoint - 600 + (int32_t)(count & 1023));
+	}
+	uint64_t taken = bench_clock () - start;
+	printf ("%-40s %10.1f\n", label, (double)taken / BENCH_CALLS);
+	bench_sink = sum;
+}
+
+
+//-------------------------------------------------------------------------------------
+/** The main function runs the step responses, the comparison with double precision,
+ *  and the timing, and prints the results.
+ */
+
+int main (void)
+{
+	sim_serial quiet (NULL);
+	da_motor motor (&quiet);
+	sim_set_plant (step_plant, BENCH_PLANT_STEP);
+	sei ();
+
+	step_result result;
+	bool good = true;
+	bool ok;
+
+	printf ("%-28s %6s %6s %6s %6s %5s %4s %5s %4s %4s\n", "Step response on the cart",
+			"rise", "over", "settle", "error", "out", "", "slew", "int", "");
+	printf ("%-28s %6s %6s %6s %6s %5s %4s %5s %4s %4s\n", "", "ms", "%", "ms", "%",
+			"low", "high", "", "low", "high");
+
+	// The velocity loop, with speed_1's gains, stepping to a third of full speed
+	pid_fixed<16> velocity;
+	velocity.set_kp (pid_fixed<16>::ratio (2100, 100000L));
+	velocity.set_ki (pid_fixed<16>::ratio (8500, 10000000L));
+	velocity.set_output_limits (-BENCH_SATURATE, BENCH_SATURATE);
+	velocity.set_derivative_filter (3);
+	velocity.set_antiwindup (1);
+	run_step (velocity, motor, true, 0.002, 1.0, 20000, 20000, result);
+	ok = (result.rise < 0.05 && result.overshoot < 10.0 && result.settle < 0.2);
+	ok &= (result.ss_error < 1.0 && result.out_hi <= BENCH_SATURATE);
+	ok &= (result.int_lo >= -BENCH_SATURATE && result.int_hi <= BENCH_SATURATE);
+	show ("speed, 20000 counts/s", result, ok);
+	good &= ok;
+
+	// The position loop, with motor_1's gain, which saturates the duty cycle at first
+	pid_fixed<16> position;
+	position.set_kp (pid_fixed<16>::ratio (1500, 10000L));
+	position.set_output_limits (-BENCH_SATURATE, BENCH_SATURATE);
+	position.set_derivative_filter (2);
+	position.set_antiwindup (1);
+	run_step (position, motor, false, 0.010, 2.0, 5000, 5000, result);
+	ok = (result.out_hi == BENCH_SATURATE && result.out_lo >= -BENCH_SATURATE);
+	ok &= (result.overshoot < 20.0 && result.settle < 1.0 && result.ss_error < 2.0);
+	show ("position, 5000 counts", result, ok);
+	good &= ok;
+
+	// The same with a slew limit, which no change in output may exceed
+	position.set_slew_limit (50);
+	run_step (position, motor, false, 0.010, 2.0, 5000, 5000, result);
+	ok = (result.worst_slew <= 50 && result.out_hi <= BENCH_SATURATE);
+	ok &= (result.settle < 1.5 && result.ss_error < 2.0);
+	show ("position, slew limit 50", result, ok);
+	good &= ok;
+	position.set_slew_limit (0);
+
+	// A speed the motor can't reach, then one it can; back calculation should keep
+	// the integral from winding up and so let the loop settle sooner
+	velocity.set_ki (pid_fixed<16>::ratio (40000, 10000000L));
+	run_step (velocity, motor, true, 0.002, 1.0, 70000, 20000, result);
+	double settle_with = result.settle;
+	ok = (result.out_hi <= BENCH_SATURATE && result.int_hi <= BENCH_SATURATE);
+	show ("speed, windup, back calc", result, ok);
+	good &= ok;
+
+	velocity.set_antiwindup (15);
+	run_step (velocity, motor, true, 0.002, 1.0, 70000, 20000, result);
+	ok = (result.out_hi <= BENCH_SATURATE && result.int_hi <= BENCH_SATURATE);
+	ok &= (result.settle > settle_with);
+	show ("speed, windup, none", result, ok);
+	good &= ok;
+
+	// The fixed point law against the same law in double precision
+	printf ("\n%-40s %10s %10s\n", "Fixed point output - double precision", "worst", "RMS");
+	good &= compare ("P, I and D, limited to 255", 0x3000, 0x200, 0x8000, 0, 255, 0, 0.01);
+	good &= compare ("P, I, D and feedforward, slew limit 8", 0x3000, 0x200, 0x8000, 0x4000,
+					 255, 8, 0.01);
+	good &= compare ("P and I, limits of 30000", 0x40000, 0x1000, 0, 0, 30000, 0, 0.01);
+
+	// The time taken by each update
+	printf ("\n%-40s %10s\n", "Cost per update", "CPU cycles");
+	former_pid former (1500, 2000);
+	time_update ("former law, 64-bit divisions", &former);
+	pid_fixed<16> timed;
+	timed.set_kp (pid_fixed<16>::ratio (1500, 10000L));
+	timed.set_ki (pid_fixed<16>::ratio (2000, 1000000L));
+	timed.set_kd (pid_fixed<16>::ratio (10, 100L));
+	timed.set_output_limits (-BENCH_SATURATE, BENCH_SATURATE);
+	time_update ("pid_fixed<16>::update()", &timed);
+	printf ("(on the PC, which divides in hardware; update() does more, with its "
+			"derivative,\n limits and back calculation, but the AVR has no divide "
+			"instruction, so there the\n former law calls a 64-bit division routine "
+			"twice)\n");
+
+	printf ("\n%s\n", good ? "All checks passed" : "Some checks FAILED");
+	return (good ? 0 : 1);
+}
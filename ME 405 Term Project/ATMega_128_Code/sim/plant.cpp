@@ -0,0 +1,281 @@
+//*************************************************************************************
+/** \file plant.cpp
+ *    This file contains the model of the polar plotter's motors, encoder slave, pen
+ *    servo, and limit switches which is declared in plant.h.
+ *
+ *  Revisions:
+ *    \li 06-17-2011 Original file
+ *
+ *  License:
+ *    This file is released under the Lesser GNU Public License, version 2. This
+ *    program is intended for educational use only, but it is not limited thereto.
+ */
+//*************************************************************************************
+
+#include <string.h>
+#include <avr/io.h>
+#include "plant.h"
+
+
+//-------------------------------------------------------------------------------------
+/** This constructor sets up the model with the cart and arm part way along their
+ *  travel, away from the limit switches, so that homing has something to do. The motor
+ *  constants are rough guesses for the plotter's gearmotors at 12 V; they can be
+ *  changed with set_axis().
+ */
+
+plotter_plant::plotter_plant (void)
+{
+	// The cart, driven by motor 1: PWM on OCR1B, direction on C0 and C1, switch on E4
+	axes[0].free_speed = 60000.0;
+	axes[0].time_constant = 0.05;
+	axes[0].friction = 0.05;
+	axes[0].stop_low = -1500.0;
+	axes[0].stop_high = 300000.0;
+	axes[0].position = 30000.0;
+	axes[0].duty_reg = SIM_OCR1BL;
+	axes[0].direction_reg = SIM_PORTC;
+	axes[0].forward_bit = PIN0;
+	axes[0].reverse_bit = PIN1;
+	axes[0].switch_bit = PIN4;
+
+	// The arm, driven by motor 2: PWM on OCR1A, direction on D5 and D6, switch on E5
+	axes[1].free_speed = 40000.0;
+	axes[1].time_constant = 0.1;
+	axes[1].friction = 0.08;
+	axes[1].stop_low = -20000.0;
+	axes[1].stop_high = 1000000.0;
+	axes[1].position = 200000.0;
+	axes[1].duty_reg = SIM_OCR1AL;
+	axes[1].direction_reg = SIM_PORTD;
+	axes[1].forward_bit = PIN5;
+	axes[1].reverse_bit = PIN6;
+	axes[1].switch_bit = PIN5;
+
+	for (uint8_t index = 0; index < 2; index++)
+	{
+		axes[index].velocity = 0.0;
+		axes[index].duty = 0.0;
+		axes[index].zero = 0;
+	}
+
+	pen_position = 5.0;
+	pen_slew = 60.0;
+	seconds = 0.0;
+
+	reply = 0;
+	frame_index = 0;
+	in_frame = false;
+	error_period = 0;
+	byte_count = 0;
+	errors_injected = 0;
+}
+
+
+//-------------------------------------------------------------------------------------
+/** This method changes the motor constants of one axis.
+ *  @param axis 0 for the cart or 1 for the arm
+ *  @param free_speed The speed at full duty cycle, in counts per second
+ *  @param time_constant The mechanical time constant in seconds
+ *  @param friction The fraction of full duty cycle needed to start the axis moving
+ */
+
+void plotter_plant::set_axis (uint8_t axis, double free_speed, double time_constant,
+							  double friction)
+{
+	axes[axis].free_speed = free_speed;
+	axes[axis].time_constant = time_constant;
+	axes[axis].friction = friction;
+}
+
+
+/** This method moves an axis to a new position, as if it had been pushed by hand.
+ *  @param axis 0 for the cart or 1 for the arm
+ *  @param position The new position in counts from the home switch
+ */
+
+void plotter_plant::set_position (uint8_t axis, double position)
+{
+	axes[axis].position = position;
+	axes[axis].velocity = 0.0;
+}
+
+
+//-------------------------------------------------------------------------------------
+/** This method moves one axis along by a time step. The H-bridge shorts the motor when
+ *  the PWM output is low, so the motor's speed follows the duty cycle times its free
+ *  speed with a first order lag. Coulomb friction holds a stopped axis until the duty
+ *  cycle is more than the friction, and stops one which is slowing down.
+ *  @param axis The axis to be moved
+ *  @param dt The time step in seconds
+ */
+
+void plotter_plant::step_axis (plant_axis& axis, double dt)
+{
+	uint8_t direction = sim_peek (axis.direction_reg);
+	bool forward = direction & (1 << axis.forward_bit);
+	bool reverse = direction & (1 << axis.reverse_bit);
+	double pwm = sim_peek (axis.duty_reg) / 255.0;
+
+	if (forward && !reverse)
+	{
+		axis.duty = pwm;
+	}
+	else if (reverse && !forward)
+	{
+		axis.duty = -pwm;
+	}
+	else
+	{
+		axis.duty = 0.0;						// Braking, or no direction set yet
+	}
+
+	if (axis.velocity == 0.0 && fabs (axis.duty) <= axis.friction)
+	{
+		return;									// Stuck by friction
+	}
+	double friction = (axis.velocity > 0.0 || (axis.velocity == 0.0 && axis.duty > 0.0))
+					  ? axis.friction : -axis.friction;
+	double drive = (axis.duty - friction) * axis.free_speed;
+	double new_velocity = axis.velocity + dt * (drive - axis.velocity) / axis.time_constant;
+
+	// If friction has brought the axis to a stop, it stays stopped
+	if (fabs (axis.duty) <= axis.friction && new_velocity * axis.velocity < 0.0)
+	{
+		new_velocity = 0.0;
+	}
+	axis.velocity = new_velocity;
+	axis.position += axis.velocity * dt;
+
+	if (axis.position < axis.stop_low)
+	{
+		axis.position = axis.stop_low;
+		axis.velocity = 0.0;
+	}
+	else if (axis.position > axis.stop_high)
+	{
+		axis.position = axis.stop_high;
+		axis.velocity = 0.0;
+	}
+}
+
+
+/** This method moves the model along by a time step: both axes move, the limit switches
+ *  close if their axes are at or past home, and the pen servo moves toward the position
+ *  commanded by the pulses on the OC3A pin. The servo only moves while it's getting
+ *  pulses.
+ *  @param dt The time step in seconds
+ */
+
+void plotter_plant::step (double dt)
+{
+	seconds += dt;
+	for (uint8_t index = 0; index < 2; index++)
+	{
+		step_axis (axes[index], dt);
+
+		// The switches pull their pins low when closed
+		sim_set_pin (SIM_PINE, axes[index].switch_bit, axes[index].position > 0.0);
+	}
+
+	// The servo's command is its pulse length, in the 64 us units the pen heights use
+	double pulse = sim_oc3a_pulse ();
+	if (pulse > 0.0)
+	{
+		double target = pulse / 64.0E-6;
+		double step = pen_slew * dt;
+		if (pen_position < target - step)
+		{
+			pen_position += step;
+		}
+		else if (pen_position > target + step)
+		{
+			pen_position -= step;
+		}
+		else
+		{
+			pen_position = target;
+		}
+	}
+}
+
+
+//-------------------------------------------------------------------------------------
+/** This method plays the part of the encoder slave for one byte of an SPI transfer.
+ *  Like Slave_Driver, the slave gives back the byte it loaded after the previous one,
+ *  then acts on the command it just got and loads the next reply. A snapshot command
+ *  latches both counts, both speeds, and the time, and the frame is sent one byte per
+ *  continue command; a clear command zeroes a count and is echoed.
+ *  @param mosi The byte sent by the master
+ *  @param selected True if the slave select line is low
+ *  @return The byte which the master receives
+ */
+
+uint8_t plotter_plant::spi_byte (uint8_t mosi, bool selected)
+{
+	if (!selected)
+	{
+		in_frame = false;
+		reply = 0;
+		return (0xFF);							// MISO is pulled up when not driven
+	}
+
+	uint8_t sent = reply;
+	byte_count++;
+	if (error_period != 0 && byte_count % error_period == 0)
+	{
+		sent ^= (1 << (byte_count % 8));
+		errors_injected++;
+	}
+
+	switch (mosi)
+	{
+		case LINK_CMD_SNAPSHOT:
+		{
+			link_snapshot latched;
+			latched.encoder_1 = get_count (0);
+			latched.encoder_2 = get_count (1);
+			latched.time_us = (uint32_t)(sim_seconds () * 1.0E6);
+			latched.velocity_1 = (int32_t)axes[0].velocity;
+			latched.velocity_2 = (int32_t)axes[1].velocity;
+			memcpy (frame, &latched, LINK_SNAPSHOT_BYTES);
+
+			uint8_t crc = link_crc8_update (0, LINK_CMD_SNAPSHOT);
+			for (uint8_t index = 0; index < LINK_SNAPSHOT_BYTES; index++)
+			{
+				crc = link_crc8_update (crc, frame[index]);
+			}
+			frame[LINK_SNAPSHOT_BYTES] = crc;
+
+			reply = frame[0];
+			frame_index = 1;
+			in_frame = true;
+			break;
+		}
+		case LINK_CMD_CONTINUE:
+			if (in_frame && frame_index < sizeof (frame))
+			{
+				reply = frame[frame_index++];
+			}
+			else
+			{
+				in_frame = false;
+				reply = 0;
+			}
+			break;
+		case LINK_CMD_CLEAR_1:
+		case LINK_CMD_CLEAR_2:
+		{
+			plant_axis& axis = axes[mosi - LINK_CMD_CLEAR_1];
+			axis.zero = (int32_t)floor (axis.position);
+			reply = mosi;
+			in_frame = false;
+			break;
+		}
+		default:
+			reply = 0;
+			in_frame = false;
+			break;
+	}
+	return (sent);
+}
@@ -0,0 +1,112 @@
+//*************************************************************************************
+/** \file plant.h
+ *    This file declares a model of the polar plotter's hardware outside the master
+ *    processor: the two DC motors and gearboxes which move the cart (radius) and arm
+ *    (angle), the encoder slave which counts their encoders and answers the master's
+ *    SPI commands, the pen servo, and the homing limit switches on pins E4 and E5. The
+ *    model reads the master's outputs through sim_peek() and drives its inputs through
+ *    sim_set_pin(), so the control code sees it just as it would see the real plotter.
+ *
+ *  Revisions:
+ *    \li 06-17-2011 Original file
+ *
+ *  License:
+ *    This file is released under the Lesser GNU Public License, version 2. This
+ *    program is intended for educational use only, but it is not limited thereto.
+ */
+//*************************************************************************************
+
+/// This define prevents this .h file from being included more than once in a .cc file
+#ifndef _PLANT_H_
+#define _PLANT_H_
+
+#include <stdint.h>
+#include <math.h>
+#include "encoder_link.h"					// Commands and frame of the encoder link
+
+
+//-------------------------------------------------------------------------------------
+/** This structure describes one axis: a DC motor driving a load through a gearbox, with
+ *  an encoder, hard stops at each end of travel, and a limit switch at its home end.
+ *  Positions and speeds are in encoder counts. The motor is modelled as a first order
+ *  lag from the applied voltage to speed, with Coulomb friction which must be overcome
+ *  before the axis starts to move.
+ */
+
+typedef struct
+{
+	double free_speed;						///< Speed at full duty cycle, counts/s
+	double time_constant;					///< Mechanical time constant, seconds
+	double friction;						///< Duty cycle (0 - 1) needed to break away
+	double stop_low;						///< Position of the hard stop at the home end
+	double stop_high;						///< Position of the far hard stop
+	double position;						///< Position in counts from the home switch
+	double velocity;						///< Speed in counts per second
+	double duty;							///< Duty cycle applied, -1 to 1
+	int32_t zero;							///< Position at which the slave's count is 0
+	uint8_t duty_reg;						///< Register holding the PWM duty cycle
+	uint8_t direction_reg;					///< Port register with the direction bits
+	uint8_t forward_bit;					///< Direction bit which makes the count go up
+	uint8_t reverse_bit;					///< Direction bit which makes it go down
+	uint8_t switch_bit;						///< Bit in PINE of the home limit switch
+} plant_axis;
+
+
+//-------------------------------------------------------------------------------------
+/** This class models the plotter. The step() method moves the motors and pen along by
+ *  one time step and updates the limit switches; spi_byte() plays the part of the
+ *  encoder slave for one byte of an SPI transfer. Axis 0 is the cart, driven by motor 1,
+ *  and axis 1 is the arm, driven by motor 2.
+ */
+
+class plotter_plant
+{
+	protected:
+		plant_axis axes[2];					///< The cart and the arm
+		double pen_position;				///< Where the pen servo is, in 64 us of pulse
+		double pen_slew;					///< Pen servo speed, 64 us units per second
+		double seconds;						///< Time since the model was started
+
+		uint8_t reply;						///< Byte the slave loaded for the next transfer
+		uint8_t frame[LINK_SNAPSHOT_FRAME - 1];	///< Snapshot data and CRC being sent
+		uint8_t frame_index;				///< Index of the next frame byte to be loaded
+		bool in_frame;						///< True while a snapshot is being sent
+
+		uint32_t error_period;				///< A bit is flipped in every this many bytes
+		uint32_t byte_count;				///< Number of bytes the slave has sent
+		uint32_t errors_injected;			///< Number of bytes which were corrupted
+
+		void step_axis (plant_axis& axis, double dt);
+
+	public:
+		plotter_plant (void);
+		void step (double dt);
+		uint8_t spi_byte (uint8_t mosi, bool selected);
+
+		void set_axis (uint8_t axis, double free_speed, double time_constant,
+					   double friction);
+		void set_position (uint8_t axis, double position);
+
+		/** This method sets how often the slave corrupts a byte it sends, to test the
+		 *  link's CRC and retries.
+		 *  @param period One byte in this many has a bit flipped, or 0 for none
+		 */
+		void set_error_period (uint32_t period) { error_period = period; }
+
+		/// This method returns the number of bytes which were corrupted on purpose
+		uint32_t get_errors_injected (void) { return (errors_injected); }
+
+		/// This method returns an axis, for the simulation's records @param axis 0 or 1
+		const plant_axis& get_axis (uint8_t axis) { return (axes[axis]); }
+
+		/// This method returns the count which the slave would report @param axis 0 or 1
+		int32_t get_count (uint8_t axis)
+		{
+			return ((int32_t)floor (axes[axis].position) - axes[axis].zero);
+		}
+
+		/// This method tells whether the pen is touching the paper
+		bool pen_down (void) { return (pen_position >= 10.0); }
+};
+
+#endif // _PLANT_H_
@@ -0,0 +1,1023 @@
+//*************************************************************************************
+/** \file plotter_sim.cpp
+ *    This program runs the polar plotter's control code on a Linux PC against a model
+ *    of the plotter. The same Master, da_motor, task_velocity, task_PID, servo, point,
+ *    path_planner, trajectory, task_lines, Go_Home and gcode objects are made, in the
+ *    same order and with the same settings as in Polar_Plotter.cpp, and run by the same
+ *    main loop, but their registers are the simulated ones in sim_avr.h and the motors,
+ *    encoder slave, pen, and limit switches are modelled by plotter_plant. The keyboard
+ *    and screen tasks aren't made; instead a script of drawing commands is read, one per
+ *    line:
+ *
+ *    \li \c home - Find the home position and zero the encoders
+ *    \li \c line x0 y0 x1 y1 - Draw a line; coordinates are in tenths of an inch. Lines
+ *           which follow one another in the script are fed to the planner as it has
+ *           room, as a sender would, and are shown as one command, which is given the
+ *           timeout once for each line
+ *    \li \c dot x y - Make a dot
+ *    \li \c move x y - Move to a point with the pen up
+ *    \li \c signature - Draw the signature
+ *    \li \c stream file [baud] - Send a G-code file to the gcode interpreter as a sender
+ *           on a PC would, through a simulated serial line at the given baud rate
+ *           (9600 if none is given), keeping as many characters on their way as fit in
+ *           the plotter's receive buffer. The number of lines the plotter acted on per
+ *           second, and the number of times the planner ran out of lines ahead, are
+ *           shown. The timeout is given once for each line sent
+ *    \li \c wait s - Let the plotter run for s seconds
+ *    \li \c gains m kp ki kd - Set motor m's gains, as with the keyboard
+ *    \li \c vgains m kp ki kd - Set the gains of motor m's velocity loop
+ *    \li \c plant m speed tau friction - Set motor m's free speed in counts/s, time
+ *           constant in seconds, and breakaway duty cycle (0 - 1)
+ *    \li \c errors n - Have the slave corrupt one byte in every n it sends
+ *    \li \c timeout s - Give up on a command which takes longer than s seconds
+ *    \li \c expect what limit - Fail if, at the end, \c rms or \c max tracking error
+ *           (inches), longest \c settle time (seconds), largest \c overshoot
+ *           (counts), or total \c time is over limit
+ *    \li \c # - The rest of the line is a comment
+ *
+ *    As the plotter runs, a trace of setpoints, encoder counts, duty cycles and pen
+ *    position can be written to a CSV file. When the script is done, a summary shows
+ *    how long each command took, how long the motors took to settle after each change
+ *    of setpoint, how far the pen strayed from the lines it was told to draw, and how
+ *    fast the lines were drawn.
+ *
+ *    The motors are run by cascaded position and velocity loops, as in Polar_Plotter.cpp;
+ *    the -1 option runs them with the single loop PIDs instead, for comparison. The -s
+ *    option sets the planner's corner limits to zero, so the pen stops at every corner.
+ *
+ *    Usage: plotter_sim [-1] [-s] [-o trace.csv] [-p period] [-v] [script]
+ *
+ *  Revisions:
+ *    \li 06-17-2011 Original file
+ *    \li 06-18-2011 Cascaded loops by default, with -1 for the single loop; overshoot
+ *    \li 06-19-2011 Lines follow a trajectory; drawing throughput in the summary
+ *    \li 06-20-2011 Runs of lines go through the look-ahead planner; -s to stop at corners
+ *    \li 06-22-2011 G-code streamed through a simulated serial line with 'stream'
+ *
+ *  License:
+ *    This file is released under the Lesser GNU Public License, version 2. This
+ *    program is intended for educational use only, but it is not limited thereto.
+ */
+//*************************************************************************************
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include <avr/io.h>
+#include <avr/interrupt.h>
+#include "sim_serial.h"
+#include "plant.h"
+#include "stl_timer.h"
+#include "stl_task.h"
+#include "stl_scheduler.h"
+#include "Master.h"
+#include "da_motor.h"
+#include "task_PID.h"
+#include "servo.h"
+#include "point.h"
+#include "path_planner.h"
+#include "trajectory.h"
+#include "task_lines.h"
+#include "Go_Home.h"
+#include "task_velocity.h"
+#include "gcode.h"
+#include "sim_link.h"
+
+/// Time between steps of the plant model, in seconds
+#define PLANT_STEP			100.0E-6
+
+/// Error in counts within which an axis counts as settled, as task_PID uses
+#define SETTLE_BAND			400
+
+// Gains of the cascaded loops, as set in Polar_Plotter.cpp
+#define KP_SPEED_1			2100		///< Cart velocity loop Kp, 1/100000 duty per count/s
+#define KI_SPEED_1			8500		///< Cart velocity loop Ki, 1/10000000 per run
+#define KP_POSITION_1		1500		///< Cart position loop Kp, 1/100 count/s per count
+#define KP_SPEED_2			3200		///< Arm velocity loop Kp
+#define KI_SPEED_2			6400		///< Arm velocity loop Ki
+#define KP_POSITION_2		1500		///< Arm position loop Kp
+
+// Limits on the motors' motion along lines, as set in Polar_Plotter.cpp
+#define CART_SPEED			25000		///< Cart speed limit, counts/s
+#define CART_ACCEL			150000		///< Cart acceleration limit, counts/s^2
+#define CART_JERK			1500000		///< Cart jerk limit, counts/s^3
+#define ARM_SPEED			25000		///< Arm speed limit, counts/s
+#define ARM_ACCEL			100000		///< Arm acceleration limit, counts/s^2
+#define ARM_JERK			1000000		///< Arm jerk limit, counts/s^3
+#define CART_CORNER			10000		///< Cart speed change allowed at a corner, counts/s
+#define ARM_CORNER			10000		///< Arm speed change allowed at a corner, counts/s
+
+/// Characters a G-code sender may have on their way, as many as the receive buffer holds
+#define STREAM_WINDOW		(RSINT_BUF_SIZE - 1)
+
+
+//-------------------------------------------------------------------------------------
+/** This class lets the simulation see how far task_lines has got, which it keeps in
+ *  protected data. It behaves exactly as a task_lines does.
+ */
+
+class sim_lines : public task_lines
+{
+	public:
+		/// This constructor just makes a task_lines with the same parameters
+		sim_lines (base_text_serial* p_serial_port, task_timer& a_timer, time_stamp& t_stamp,
+				   task_PID* motor_1, task_PID* motor_2, point* get_there, servo* PEN,
+				   path_planner* a_planner, trajectory* a_path)
+			: task_lines (p_serial_port, a_timer, t_stamp, motor_1, motor_2, get_there, PEN,
+						  a_planner, a_path)
+		{ }
+
+		/// This method tells whether the task is at or on the line it's drawing
+		bool is_drawing (void)
+		{
+			return (get_current_state () >= 3 && get_current_state () <= 4);
+		}
+
+		/** This method gets the ends of the line being drawn, or about to be, in tenths of
+		 *  an inch.
+		 *  @param p_ends An array into which x0, y0, x1, y1 are written
+		 */
+		void get_line (double* p_ends)
+		{
+			const path_block* p_block = &(path->Get_Block ());
+			if (get_current_state () != 4 && planner->current () != NULL)
+			{
+				p_block = planner->current ();
+			}
+			p_ends[0] = p_block->x_start;
+			p_ends[1] = p_block->y_start;
+			p_ends[2] = p_block->x_end;
+			p_ends[3] = p_block->y_end;
+		}
+};
+
+
+/** This class lets the simulation see what the point object is doing. It behaves
+ *  exactly as a point does.
+ */
+
+class sim_point : public point
+{
+	public:
+		/// This constructor just makes a point with the same parameters
+		sim_point (base_text_serial* p_serial_port, task_PID* motor_1, task_PID* motor_2,
+				   servo* Penny_Thingy)
+			: point (p_serial_port, motor_1, motor_2, Penny_Thingy)
+		{ }
+
+		/// This method tells whether the point has finished moving or making a dot
+		bool is_idle (void) { return (point_state == 0 && !Make_Point && !Go_To); }
+
+		/// This method tells whether a dot is being made
+		bool is_dotting (void) { return (Make_Point); }
+
+		/** This method gets the point being moved to, in tenths of an inch.
+		 *  @param p_xy An array into which x and y are written
+		 */
+		void get_point (double* p_xy) { p_xy[0] = X; p_xy[1] = Y; }
+};
+
+
+//-------------------------------------------------------------------------------------
+/** This structure keeps track of how long one axis takes to settle after each change
+ *  of its setpoint, and how far it goes past the new setpoint. The settling time is
+ *  measured from the change to the last time the error was outside SETTLE_BAND before
+ *  the next change; the overshoot is the furthest the axis gets beyond the setpoint, in
+ *  the direction it was moving, before the next change.
+ */
+
+typedef struct
+{
+	int32_t setpoint;						///< The setpoint being settled to
+	double change_time;						///< When the setpoint was changed
+	double last_outside;					///< Last time the error was outside the band
+	int8_t direction;						///< 1 if the axis must move up, -1 if down
+	int32_t peak;							///< Furthest past the setpoint so far, counts
+	bool active;							///< True once a setpoint has been given
+	uint32_t moves;							///< Number of setpoint changes which settled
+	uint32_t unsettled;						///< Number which didn't settle before the next
+	double total;							///< Sum of the settling times
+	double longest;							///< Longest settling time
+	double overshoot_total;					///< Sum of the overshoots, counts
+	int32_t overshoot_largest;				///< Largest overshoot, counts
+} settle_record;
+
+/** This structure keeps track of a G-code file being sent to the plotter. As a sender
+ *  counting characters does, it remembers the length of each line which hasn't been
+ *  answered yet, and sends the next line only if the characters on their way will all
+ *  still fit in the plotter's receive buffer.
+ */
+
+typedef struct
+{
+	FILE* p_file;							///< The file, or NULL if it's all been read
+	char next[SIM_LINK_LINE_SIZE];			///< The next line to be sent, with its end
+	bool have_next;							///< True if next holds a line
+	bool end_sent;							///< True once the closing % has been sent
+	uint8_t lengths[STREAM_WINDOW];			///< Lengths of the lines on their way
+	uint8_t oldest;							///< Index in lengths of the oldest of them
+	uint8_t waiting;						///< Number of lines on their way
+	uint16_t characters;					///< Number of characters on their way
+	uint32_t sent;							///< Number of lines sent
+	uint32_t errors;						///< Number of lines answered with an error
+	long commands;							///< Lines acted on, from the plotter's count
+	long underruns;							///< Underruns, from the plotter's count
+} stream_record;
+
+/** This structure adds up the tracking error, the distance of the pen from the line or
+ *  dot it's supposed to be drawing while it's touching the paper.
+ */
+
+typedef struct
+{
+	double sum_squares;						///< Integral of error squared, in^2 s
+	double time;							///< Time the pen was down on a line or dot
+	double largest;							///< Largest error, inches
+	double stray_time;						///< Time the pen was down with nothing to draw
+} track_record;
+
+
+//-------------------------------------------------------------------------------------
+// The simulated plotter and the objects which control it, which are made in main()
+
+static plotter_plant the_plant;				///< The model of the plotter
+static task_PID* p_motor_1;					///< PID for the cart
+static task_PID* p_motor_2;					///< PID for the arm
+static sim_point* p_dot_maker;				///< The point object
+static sim_lines* p_line_maker;				///< The line drawing task
+static sim_link* p_link;					///< The serial line to the G-code sender
+
+static settle_record settling[2];			///< Settling of the cart and arm
+static track_record tracking;				///< Tracking error over the whole script
+static track_record command_tracking;		///< Tracking error of the present command
+static stream_record streaming;				///< The G-code file being sent, if any
+
+static FILE* p_trace = NULL;				///< File to which the trace is written
+static double trace_period = 0.01;			///< Time between lines of the trace
+static double trace_countdown = 0.0;		///< Time until the next line of the trace
+
+static char pending[128];					///< A command read ahead but not yet run
+static bool have_pending = false;			///< True if pending holds a command
+
+
+/** This function works out the distance from a point to a line segment.
+ *  @param px The point's x coordinate
+ *  @param py The point's y coordinate
+ *  @param p_ends The segment's ends as x0, y0, x1, y1
+ *  @return The distance, in the same units
+ */
+static double segment_distance (double px, double py, const double* p_ends)
+{
+	double dx = p_ends[2] - p_ends[0];
+	double dy = p_ends[3] - p_ends[1];
+	double length_sq = dx * dx + dy * dy;
+	double along = 0.0;
+	if (length_sq > 0.0)
+	{
+		along = ((px - p_ends[0]) * dx + (py - p_ends[1]) * dy) / length_sq;
+		along = (along < 0.0) ? 0.0 : ((along > 1.0) ? 1.0 : along);
+	}
+	return (hypot (px - (p_ends[0] + along * dx), py - (p_ends[1] + along * dy)));
+}
+
+
+/** This function updates the settling record of one axis.
+ *  @param record The axis's record
+ *  @param setpoint The axis's setpoint now
+ *  @param count The axis's encoder count now
+ */
+static void update_settling (settle_record& record, int32_t setpoint, int32_t count)
+{
+	double now = sim_seconds ();
+	bool inside = labs ((long)(setpoint - count)) <= SETTLE_BAND;
+
+	if (!record.active || setpoint != record.setpoint)
+	{
+		// Whether the last move settled depends on the error from its own setpoint
+		if (record.active && record.change_time != record.last_outside)
+		{
+			if (labs ((long)(record.setpoint - count)) <= SETTLE_BAND)
+			{
+				double settle = record.last_outside - record.change_time;
+				record.moves++;
+				record.total += settle;
+				if (settle > record.longest)
+				{
+					record.longest = settle;
+				}
+				record.overshoot_total += record.peak;
+				if (record.peak > record.overshoot_largest)
+				{
+					record.overshoot_largest = record.peak;
+				}
+			}
+			else
+			{
+				record.unsettled++;
+			}
+		}
+		record.active = true;
+		record.setpoint = setpoint;
+		record.change_time = now;
+		record.last_outside = now;
+		record.direction = (setpoint >= count) ? 1 : -1;
+		record.peak = 0;
+	}
+	else
+	{
+		if (!inside)
+		{
+			record.last_outside = now;
+		}
+		int32_t past = record.direction * (count - setpoint);
+		if (past > record.peak)
+		{
+			record.peak = past;
+		}
+	}
+}
+
+
+/** This function adds a time step's tracking error to a record.
+ *  @param record The record
+ *  @param error The distance of the pen from where it should be, in inches, or a
+ *               negative number if the pen is down with nothing to draw
+ *  @param dt The time step
+ */
+static void add_tracking (track_record& record, double error, double dt)
+{
+	if (error < 0.0)
+	{
+		record.stray_time += dt;
+		return;
+	}
+	record.sum_squares += error * error * dt;
+	record.time += dt;
+	if (error > record.largest)
+	{
+		record.largest = error;
+	}
+}
+
+
+/** This function reads the next command from the script, or the one read ahead. Comments,
+ *  trailing white space and blank lines are skipped.
+ *  @param p_script The script file
+ *  @param p_line Where the command is put; it must hold 128 characters
+ *  @return True if a command was read, false at the end of the script
+ */
+static bool read_command (FILE* p_script, char* p_line)
+{
+	if (have_pending)
+	{
+		strcpy (p_line, pending);
+		have_pending = false;
+		return (true);
+	}
+	while (fgets (p_line, sizeof (pending), p_script) != NULL)
+	{
+		char* p_hash = strchr (p_line, '#');
+		if (p_hash != NULL)
+		{
+			*p_hash = '\0';
+		}
+		char* p_end = p_line + strlen (p_line);
+		while (p_end > p_line && (p_end[-1] == '\n' || p_end[-1] == '\r' || p_end[-1] == ' '
+								  || p_end[-1] == '\t'))
+		{
+			*--p_end = '\0';
+		}
+		char word[16];
+		if (sscanf (p_line, "%15s", word) == 1)
+		{
+			return (true);
+		}
+	}
+	return (false);
+}
+
+
+/** This function does a G-code sender's part in sending a file to the plotter: it takes
+ *  the plotter's answers, then sends as many lines as will fit in the plotter's receive
+ *  buffer with the ones still on their way. Lines which are just a % are left out, as the
+ *  plotter takes % to end the program; one is sent once the file has all been sent.
+ *  @param link The serial line to the plotter
+ *  @return True once every line, and the closing %, has been answered
+ */
+static bool stream_step (sim_link& link)
+{
+	char reply[SIM_LINK_LINE_SIZE];
+	while (link.get_line (reply))
+	{
+		if (strncmp (reply, "ok", 2) == 0 || strncmp (reply, "error", 5) == 0)
+		{
+			if (reply[0] == 'e')
+			{
+				streaming.errors++;
+				printf ("          line %lu sent: %s\n",
+						(unsigned long)(streaming.sent - streaming.waiting + 1), reply);
+			}
+			if (streaming.waiting > 0)
+			{
+				streaming.characters -= streaming.lengths[streaming.oldest];
+				streaming.oldest = (streaming.oldest + 1) % STREAM_WINDOW;
+				streaming.waiting--;
+			}
+		}
+		else
+		{
+			sscanf (reply, "commands: %ld errors: %*d underruns: %ld", &streaming.commands,
+					&streaming.underruns);
+		}
+	}
+
+	while (true)
+	{
+		if (!streaming.have_next)
+		{
+			if (streaming.p_file != NULL
+				&& fgets (streaming.next, SIM_LINK_LINE_SIZE - 1, streaming.p_file) != NULL)
+			{
+				char* p_end = streaming.next + strlen (streaming.next);
+				while (p_end > streaming.next && (p_end[-1] == '\n' || p_end[-1] == '\r'
+												  || p_end[-1] == ' ' || p_end[-1] == '\t'))
+				{
+					*--p_end = '\0';
+				}
+				if (strcmp (streaming.next, "%") == 0)
+				{
+					continue;
+				}
+				strcat (streaming.next, "\n");
+			}
+			else
+			{
+				if (streaming.p_file != NULL)
+				{
+					fclose (streaming.p_file);
+					streaming.p_file = NULL;
+				}
+				if (streaming.end_sent)
+				{
+					break;
+				}
+				strcpy (streaming.next, "%\n");
+				streaming.end_sent = true;
+			}
+			streaming.have_next = true;
+		}
+
+		uint8_t length = strlen (streaming.next);
+		if (streaming.characters + length > STREAM_WINDOW)
+		{
+			break;
+		}
+		link.send (streaming.next);
+		streaming.lengths[(streaming.oldest + streaming.waiting) % STREAM_WINDOW] = length;
+		streaming.waiting++;
+		streaming.characters += length;
+		streaming.sent++;
+		streaming.have_next = false;
+	}
+	return (streaming.end_sent && !streaming.have_next && streaming.waiting == 0);
+}
+
+
+/** This function is called by the simulator at each time step. It steps the plant,
+ *  then measures settling and tracking error and writes the trace.
+ *  @param dt The time step in seconds
+ */
+static void step_world (double dt)
+{
+	the_plant.step (dt);
+	if (p_link != NULL)
+	{
+		p_link->step (dt);
+	}
+	if (p_motor_1 == NULL)
+	{
+		return;									// The objects aren't all made yet
+	}
+
+	int32_t count_r = the_plant.get_count (0);
+	int32_t count_theta = the_plant.get_count (1);
+	update_settling (settling[0], p_motor_1->GET_setpoint (), count_r);
+	update_settling (settling[1], p_motor_2->GET_setpoint (), count_theta);
+
+	// The pen's position as the encoders see it, in tenths of an inch
+	double radius = count_r / (double)COUNTS_PER_TENTH;
+	double angle = count_theta / (double)COUNTS_PER_RADIAN;
+	double x = radius * cos (angle);
+	double y = radius * sin (angle);
+
+	if (the_plant.pen_down ())
+	{
+		double error = -1.0;
+		double where[4];
+		if (p_line_maker->is_drawing ())
+		{
+			p_line_maker->get_line (where);
+			error = segment_distance (x, y, where) / 10.0;
+		}
+		else if (p_dot_maker->is_dotting ())
+		{
+			p_dot_maker->get_point (where);
+			error = hypot (x - where[0], y - where[1]) / 10.0;
+		}
+		add_tracking (tracking, error, dt);
+		add_tracking (command_tracking, error, dt);
+	}
+
+	trace_countdown -= dt;
+	if (p_trace != NULL && trace_countdown <= 0.0)
+	{
+		trace_countdown += trace_period;
+		fprintf (p_trace, "%.4f,%ld,%ld,%ld,%ld,%.3f,%.3f,%.3f,%.3f,%d\n", sim_seconds (),
+				 (long)p_motor_1->GET_setpoint (), (long)count_r,
+				 (long)p_motor_2->GET_setpoint (), (long)count_theta,
+				 the_plant.get_axis (0).duty, the_plant.get_axis (1).duty,
+				 x / 10.0, y / 10.0, the_plant.pen_down () ? 1 : 0);
+	}
+}
+
+
+/** This function plays the encoder slave's part in an SPI transfer.
+ *  @param mosi The byte sent by the master
+ *  @param selected True if the slave is selected
+ *  @return The byte the master receives
+ */
+static uint8_t slave_byte (uint8_t mosi, bool selected)
+{
+	return (the_plant.spi_byte (mosi, selected));
+}
+
+
+//-------------------------------------------------------------------------------------
+/** The main function makes the plotter's objects, then reads and runs the script.
+ *  @param argc The number of command line arguments
+ *  @param argv The command line arguments
+ *  @return Zero if every command finished and every expectation was met, one if not
+ */
+
+int main (int argc, char** argv)
+{
+	bool verbose = false;
+	bool cascade = true;
+	bool stop_at_corners = false;
+	const char* p_script_name = NULL;
+
+	for (int arg = 1; arg < argc; arg++)
+	{
+		if (strcmp (argv[arg], "-o") == 0 && arg + 1 < argc)
+		{
+			p_trace = fopen (argv[++arg], "w");
+			if (p_trace == NULL)
+			{
+				perror (argv[arg]);
+				return (1);
+			}
+		}
+		else if (strcmp (argv[arg], "-p") == 0 && arg + 1 < argc)
+		{
+			trace_period = atof (argv[++arg]);
+		}
+		else if (strcmp (argv[arg], "-v") == 0)
+		{
+			verbose = true;
+		}
+		else if (strcmp (argv[arg], "-1") == 0)
+		{
+			cascade = false;
+		}
+		else if (strcmp (argv[arg], "-s") == 0)
+		{
+			stop_at_corners = true;
+		}
+		else if (argv[arg][0] != '-' && p_script_name == NULL)
+		{
+			p_script_name = argv[arg];
+		}
+		else
+		{
+			fprintf (stderr, "Usage: %s [-1] [-s] [-o trace.csv] [-p period] [-v] [script]\n",
+					 argv[0]);
+			return (1);
+		}
+	}
+
+	FILE* p_script = stdin;
+	if (p_script_name != NULL && (p_script = fopen (p_script_name, "r")) == NULL)
+	{
+		perror (p_script_name);
+		return (1);
+	}
+	if (p_trace != NULL)
+	{
+		fprintf (p_trace, "time,setpoint_r,count_r,setpoint_theta,count_theta,"
+				 "duty_r,duty_theta,x_in,y_in,pen\n");
+	}
+
+	// The plotter's text goes to the screen only if asked for
+	sim_serial the_serial_port (verbose ? stdout : NULL);
+	sim_serial the_screen (stdout);
+
+	sim_set_spi_slave (slave_byte);
+	sim_set_plant (step_world, PLANT_STEP);
+
+	// The objects are made in the same order as in Polar_Plotter.cpp, as each of their
+	// constructors sets up hardware which the others may change
+	Master request (&the_serial_port);
+	da_motor my_motor (&the_serial_port);
+	time_stamp interval_time_1 (0, 25000);
+	time_stamp interval_time_pos (0, 10000);
+	time_stamp interval_time_vel (0, 2000);
+	task_timer the_timer;
+	task_velocity speed_1 (&the_serial_port, the_timer, interval_time_vel, &request, &my_motor, 1);
+	task_velocity speed_2 (&the_serial_port, the_timer, interval_time_vel, &request, &my_motor, 2);
+	task_PID motor_1 (&the_serial_port, the_timer, cascade ? interval_time_pos : interval_time_1,
+					  &request, &my_motor, 1, cascade ? &speed_1 : NULL);
+	task_PID motor_2 (&the_serial_port, the_timer, cascade ? interval_time_pos : interval_time_1,
+					  &request, &my_motor, 2, cascade ? &speed_2 : NULL);
+	servo Pen_and_Teller (&the_serial_port);
+	sim_point The_Dot_Maker (&the_serial_port, &motor_1, &motor_2, &Pen_and_Teller);
+	path_planner The_Planner;
+	The_Planner.set_limits (0, CART_SPEED, CART_ACCEL, CART_JERK,
+							stop_at_corners ? 0 : CART_CORNER);
+	The_Planner.set_limits (1, ARM_SPEED, ARM_ACCEL, ARM_JERK,
+							stop_at_corners ? 0 : ARM_CORNER);
+	trajectory The_Path (&The_Planner);
+	time_stamp& interval_lines = cascade ? interval_time_pos : interval_time_1;
+	sim_lines The_Line_Maker (&the_serial_port, the_timer, interval_lines, &motor_1,
+							  &motor_2, &The_Dot_Maker, &Pen_and_Teller, &The_Planner,
+							  &The_Path);
+	Go_Home Find_Home (&the_serial_port, the_timer, interval_time_1, &my_motor, &request,
+					   &motor_1, &motor_2, &The_Line_Maker);
+	sim_link the_link (9600);
+	gcode The_Interpreter (&the_link, &The_Line_Maker, &The_Planner, &The_Dot_Maker, &Find_Home,
+						   &motor_1, &motor_2, &Pen_and_Teller);
+
+	p_motor_1 = &motor_1;
+	p_motor_2 = &motor_2;
+	p_dot_maker = &The_Dot_Maker;
+	p_line_maker = &The_Line_Maker;
+	p_link = &the_link;
+
+	task_scheduler scheduler (the_timer, SCHED_EDF);
+	if (cascade)
+	{
+		scheduler.add_task (&speed_1, 4, interval_time_vel);
+		scheduler.add_task (&speed_2, 4, interval_time_vel);
+		scheduler.add_task (&motor_1, 3, interval_time_pos);
+		scheduler.add_task (&motor_2, 3, interval_time_pos);
+	}
+	else
+	{
+		scheduler.add_task (&motor_1, 3, interval_time_1);
+		scheduler.add_task (&motor_2, 3, interval_time_1);
+	}
+	scheduler.add_task (&The_Line_Maker, 2, interval_lines);
+	scheduler.add_task (&Find_Home, 1, interval_time_1);
+	scheduler.set_tickless (true);
+
+	sei ();
+	if (cascade)
+	{
+		speed_1.set_kp (KP_SPEED_1);
+		speed_1.set_ki (KI_SPEED_1);
+		speed_1.set_kd (0);
+		motor_1.set_kp (KP_POSITION_1);
+		motor_1.set_ki (0);
+		motor_1.set_kd (0);
+		speed_2.set_kp (KP_SPEED_2);
+		speed_2.set_ki (KI_SPEED_2);
+		speed_2.set_kd (0);
+		motor_2.set_kp (KP_POSITION_2);
+		motor_2.set_ki (0);
+		motor_2.set_kd (0);
+	}
+	else
+	{
+		motor_1.set_kp (950);
+		motor_1.set_ki (450);
+		motor_1.set_kd (0);
+		motor_2.set_kp (3750);
+		motor_2.set_ki (3700);
+		motor_2.set_kd (1);
+	}
+
+	double timeout = 60.0;
+	double expect_rms = -1.0, expect_max = -1.0, expect_settle = -1.0, expect_time = -1.0;
+	double expect_overshoot = -1.0;
+	bool failed = false;
+	uint16_t lines_drawn = 0;
+	double line_length = 0.0, line_time = 0.0;
+	clock_t host_start = clock ();
+	char line[128];
+	char stream_name[128];
+	uint32_t stream_baud = 9600;
+
+	printf ("    start   took  rms in  max in  command\n");
+	while (read_command (p_script, line))
+	{
+		char word[16];
+		double a[4];
+		int fields = sscanf (line, "%15s %lf %lf %lf %lf", word, &a[0], &a[1], &a[2], &a[3]);
+		uint16_t batch_lines = 0;
+		double batch_length = 0.0;
+		uint32_t overruns = the_link.get_overruns ();
+
+		// Start the command; 'done' says which condition ends it
+		enum { DONE_NOW, DONE_HOME, DONE_LINES, DONE_POINT, DONE_WAIT, DONE_STREAM } done
+			= DONE_NOW;
+		double wait_until = 0.0;
+		if (strcmp (word, "home") == 0)
+		{
+			motor_1.Request_Home (true);		// As the 'O' key does in task_read
+			motor_2.Request_Home (true);
+			Find_Home.SET_Home_Request ();
+			done = DONE_HOME;
+		}
+		else if (strcmp (word, "line") == 0 && fields == 5)
+		{
+			The_Line_Maker.set_coords ((int16_t)a[0], (int16_t)a[1], (int16_t)a[2],
+									   (int16_t)a[3]);
+			The_Line_Maker.go ();
+			batch_lines = 1;
+			batch_length = hypot (a[2] - a[0], a[3] - a[1]) / 10.0;
+			done = DONE_LINES;
+		}
+		else if (strcmp (word, "dot") == 0 && fields == 3)
+		{
+			The_Dot_Maker.Go_Make_A_Dot ((uint16_t)a[0], (uint16_t)a[1]);
+			done = DONE_POINT;
+		}
+		else if (strcmp (word, "move") == 0 && fields == 3)
+		{
+			The_Dot_Maker.Get_There ((uint16_t)a[0], (uint16_t)a[1]);
+			done = DONE_POINT;
+		}
+		else if (strcmp (word, "signature") == 0)
+		{
+			The_Line_Maker.draw_signature ();
+			done = DONE_LINES;
+		}
+		else if (strcmp (word, "stream") == 0 && sscanf (line, "%*s %127s %lf", stream_name,
+															   &a[0]) >= 1)
+		{
+			memset (&streaming, 0, sizeof (streaming));
+			streaming.p_file = fopen (stream_name, "r");
+			if (streaming.p_file == NULL)
+			{
+				perror (stream_name);
+				failed = true;
+				continue;
+			}
+			stream_baud = (sscanf (line, "%*s %*s %lf", &a[0]) == 1) ? (uint32_t)a[0] : 9600;
+			the_link.set_baud (stream_baud);
+			done = DONE_STREAM;
+		}
+		else if (strcmp (word, "wait") == 0 && fields == 2)
+		{
+			wait_until = sim_seconds () + a[0];
+			done = DONE_WAIT;
+		}
+		else if (strcmp (word, "gains") == 0 && fields == 5)
+		{
+			task_PID* p_motor = (a[0] == 1) ? &motor_1 : &motor_2;
+			p_motor->set_kp ((uint16_t)a[1]);
+			p_motor->set_ki ((uint16_t)a[2]);
+			p_motor->set_kd ((uint16_t)a[3]);
+		}
+		else if (strcmp (word, "vgains") == 0 && fields == 5)
+		{
+			task_velocity* p_speed = (a[0] == 1) ? &speed_1 : &speed_2;
+			p_speed->set_kp ((uint16_t)a[1]);
+			p_speed->set_ki ((uint16_t)a[2]);
+			p_speed->set_kd ((uint16_t)a[3]);
+		}
+		else if (strcmp (word, "plant") == 0 && fields == 5)
+		{
+			the_plant.set_axis ((a[0] == 1) ? 0 : 1, a[1], a[2], a[3]);
+		}
+		else if (strcmp (word, "errors") == 0 && fields == 2)
+		{
+			the_plant.set_error_period ((uint32_t)a[0]);
+		}
+		else if (strcmp (word, "timeout") == 0 && fields == 2)
+		{
+			timeout = a[0];
+		}
+		else if (strcmp (word, "expect") == 0
+				 && sscanf (line, "%*s %15s %lf", word, &a[0]) == 2)
+		{
+			if (strcmp (word, "rms") == 0)			expect_rms = a[0];
+			else if (strcmp (word, "max") == 0)		expect_max = a[0];
+			else if (strcmp (word, "settle") == 0)	expect_settle = a[0];
+			else if (strcmp (word, "overshoot") == 0)	expect_overshoot = a[0];
+			else if (strcmp (word, "time") == 0)	expect_time = a[0];
+			else
+			{
+				fprintf (stderr, "Unknown expectation: %s\n", line);
+				failed = true;
+			}
+		}
+		else
+		{
+			fprintf (stderr, "Can't understand: %s\n", line);
+			failed = true;
+			continue;
+		}
+		if (done == DONE_NOW)
+		{
+			continue;
+		}
+
+		// Run the plotter's main loop, as in Polar_Plotter.cpp, until the command is done
+		double start = sim_seconds ();
+		memset (&command_tracking, 0, sizeof (command_tracking));
+		bool finished = false;
+		while (true)
+		{
+			uint32_t commands = (done == DONE_STREAM) ? streaming.sent : batch_lines;
+			if (sim_seconds () - start >= timeout * (commands > 1 ? commands : 1))
+			{
+				break;
+			}
+
+			// Send G-code for the interpreter to read, as task_read has it do while a
+			// program is being sent
+			bool stream_done = false;
+			if (done == DONE_STREAM)
+			{
+				stream_done = stream_step (the_link);
+				The_Interpreter.run ();
+			}
+
+			bool busy = scheduler.dispatch ();
+			busy |= scheduler.dispatch ();
+			The_Dot_Maker.run ();
+			busy |= scheduler.dispatch ();
+			if (!busy && !The_Dot_Maker.Making_Dot ())
+			{
+				scheduler.idle ();
+			}
+
+			// Feed the lines which follow to the planner as it makes room for them
+			if (batch_lines > 0 && !have_pending && !The_Planner.Is_Full ()
+				&& read_command (p_script, pending))
+			{
+				char next_word[16];
+				double b[4];
+				if (sscanf (pending, "%15s %lf %lf %lf %lf", next_word, &b[0], &b[1], &b[2],
+							&b[3]) == 5 && strcmp (next_word, "line") == 0)
+				{
+					The_Line_Maker.set_coords ((int16_t)b[0], (int16_t)b[1], (int16_t)b[2],
+											   (int16_t)b[3]);
+					The_Line_Maker.go ();
+					batch_lines++;
+					batch_length += hypot (b[2] - b[0], b[3] - b[1]) / 10.0;
+				}
+				else
+				{
+					have_pending = true;
+				}
+			}
+
+			if ((done == DONE_HOME && Find_Home.Is_Home ())
+				|| (done == DONE_LINES && The_Line_Maker.Is_Idle ())
+				|| (done == DONE_POINT && The_Dot_Maker.is_idle ())
+				|| (done == DONE_WAIT && sim_seconds () >= wait_until)
+				|| (done == DONE_STREAM && stream_done))
+			{
+				finished = true;
+				break;
+			}
+		}
+
+		printf ("%9.3f %6.2f ", start, sim_seconds () - start);
+		if (command_tracking.time > 0.0)
+		{
+			printf ("%7.4f %7.4f  ", sqrt (command_tracking.sum_squares / command_tracking.time),
+					command_tracking.largest);
+		}
+		else
+		{
+			printf ("      -       -  ");
+		}
+		printf ("%s", line);
+		if (batch_lines > 1)
+		{
+			printf (" and %u more lines", batch_lines - 1);
+		}
+		printf ("%s\n", finished ? "" : "  ** timed out **");
+		failed |= !finished;
+		if (done == DONE_STREAM)
+		{
+			if (streaming.p_file != NULL)
+			{
+				fclose (streaming.p_file);
+			}
+			printf ("          %ld commands at %lu baud: %.1f commands/s, %lu errors, "
+					"%ld underruns, %lu characters lost\n", streaming.commands,
+					(unsigned long)stream_baud, streaming.commands / (sim_seconds () - start),
+					(unsigned long)streaming.errors, streaming.underruns,
+					(unsigned long)(the_link.get_overruns () - overruns));
+			failed |= (streaming.errors > 0);
+		}
+		if (finished && batch_lines > 0)
+		{
+			lines_drawn += batch_lines;
+			line_length += batch_length;
+			line_time += sim_seconds () - start;
+		}
+	}
+	double host_seconds = (double)(clock () - host_start) / CLOCKS_PER_SEC;
+
+	// Finish the settling records by pretending the setpoints change now
+	update_settling (settling[0], settling[0].setpoint + 1, the_plant.get_count (0));
+	update_settling (settling[1], settling[1].setpoint + 1, the_plant.get_count (1));
+
+	printf ("\nSimulated %.2f s in %.2f s of host time", sim_seconds (), host_seconds);
+	if (host_seconds > 0.0)
+	{
+		printf (" (%.0f times real time)", sim_seconds () / host_seconds);
+	}
+	printf ("\n\n%s loops; settling to within %d counts\n", cascade ? "Cascaded" : "Single",
+			SETTLE_BAND);
+	printf ("                            moves  mean s  longest s  unsettled  overshoot mean"
+			"  max\n");
+	double longest_settle = 0.0;
+	int32_t largest_overshoot = 0;
+	for (uint8_t axis = 0; axis < 2; axis++)
+	{
+		const settle_record& record = settling[axis];
+		printf ("  %-24s %6lu  %6.3f  %9.3f  %9lu  %14.0f  %4ld\n",
+				axis == 0 ? "motor 1 (cart, radius)" : "motor 2 (arm, angle)",
+				(unsigned long)record.moves, record.moves ? record.total / record.moves : 0.0,
+				record.longest, (unsigned long)record.unsettled,
+				record.moves ? record.overshoot_total / record.moves : 0.0,
+				(long)record.overshoot_largest);
+		if (record.longest > longest_settle)
+		{
+			longest_settle = record.longest;
+		}
+		if (record.overshoot_largest > largest_overshoot)
+		{
+			largest_overshoot = record.overshoot_largest;
+		}
+	}
+
+	double rms = (tracking.time > 0.0) ? sqrt (tracking.sum_squares / tracking.time) : 0.0;
+	printf ("\nTracking error with the pen down: rms %.4f in, max %.4f in over %.2f s\n",
+			rms, tracking.largest, tracking.time);
+	printf ("Pen down with nothing to draw for %.2f s\n", tracking.stray_time);
+	if (lines_drawn > 0)
+	{
+		printf ("Drew %u lines, %.2f in long, in %.2f s: %.3f in/s including the moves to "
+				"their starts\n", lines_drawn, line_length, line_time, line_length / line_time);
+	}
+	if (the_plant.get_errors_injected () > 0)
+	{
+		printf ("Bytes corrupted by the slave: %lu\n",
+				(unsigned long)the_plant.get_errors_injected ());
+	}
+	printf ("\n");
+	the_screen << scheduler << request;
+
+	if (expect_rms >= 0.0 && rms > expect_rms)
+	{
+		printf ("FAILED: rms tracking error %.4f in is over %.4f in\n", rms, expect_rms);
+		failed = true;
+	}
+	if (expect_max >= 0.0 && tracking.largest > expect_max)
+	{
+		printf ("FAILED: max tracking error %.4f in is over %.4f in\n", tracking.largest,
+				expect_max);
+		failed = true;
+	}
+	if (expect_settle >= 0.0 && longest_settle > expect_settle)
+	{
+		printf ("FAILED: longest settling time %.3f s is over %.3f s\n", longest_settle,
+				expect_settle);
+		failed = true;
+	}
+	if (expect_overshoot >= 0.0 && largest_overshoot > expect_overshoot)
+	{
+		printf ("FAILED: largest overshoot %ld counts is over %.0f\n", (long)largest_overshoot,
+				expect_overshoot);
+		failed = true;
+	}
+	if (expect_time >= 0.0 && sim_seconds () > expect_time)
+	{
+		printf ("FAILED: the script took %.2f s, over %.2f s\n", sim_seconds (), expect_time);
+		failed = true;
+	}
+
+	if (p_trace != NULL)
+	{
+		fclose (p_trace);
+	}
+	return (failed ? 1 : 0);
+}
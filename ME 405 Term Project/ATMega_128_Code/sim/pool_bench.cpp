@@ -0,0 +1,325 @@
+//*************************************************************************************
+/** \file pool_bench.cpp
+ *    This program checks and measures the memory pool in mem_pool.cpp on a PC. First it
+ *    checks that every block in the pool can be allocated, that no two blocks overlap,
+ *    that a full pool fails cleanly and counts the failure, and that freed blocks are
+ *    used again. Then the pool and the PC's malloc() are given the same long run of
+ *    allocations and frees of objects of mixed sizes, as a program which makes and
+ *    deletes objects as it goes might do, and for each the time per allocation or
+ *    free, the most bytes in use at once, and the span of addresses used (the memory
+ *    the heap would need, free holes included) are shown, along with the time to
+ *    allocate and free one small object over and over. The PC's malloc() is much
+ *    cleverer than avr-libc's, so its fragmentation here is a best case for malloc().
+ *
+ *    Usage: pool_bench
+ *    The program returns 1 if a check fails.
+ *
+ *  Revisions:
+ *    \li 06-24-2011 Original file
+ *
+ *  License:
+ *    This file is released under the Lesser GNU Public License, version 2. This
+ *    program is intended for educational use only, but it is not limited thereto.
+ */
+//*************************************************************************************
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "mem_pool.h"
+
+
+/// How many allocations and frees are made in the mixed run
+#define BENCH_STEPS			2000000L
+
+/// The most objects which are in use at once in the mixed run
+#define BENCH_LIVE			6
+
+/// The most blocks there can be in the pool
+#define BENCH_MAX_BLOCKS	(4 * 255)
+
+
+//-------------------------------------------------------------------------------------
+/** This structure holds what a run of allocations and frees measured.
+ */
+
+typedef struct
+{
+	double ns_per_step;						///< Time per allocation or free
+	size_t most_live;						///< Most bytes in use at once
+	size_t span;							///< Distance from the lowest to highest byte used
+	long failures;							///< Allocations which returned NULL
+} bench_result;
+
+
+//-------------------------------------------------------------------------------------
+/** This function reads a clock in nanoseconds.
+ *  @return The time in nanoseconds
+ */
+
+static double bench_ns (void)
+{
+	struct timespec now;
+	clock_gettime (CLOCK_MONOTONIC, &now);
+	return (now.tv_sec * 1.0E9 + now.tv_nsec);
+}
+
+
+//-------------------------------------------------------------------------------------
+/** This function checks the pool: fills every class, checks that the blocks don't
+ *  overlap and that the next allocation fails, and frees and allocates them again.
+ *  @return True if the checks passed
+ */
+
+static bool check_pool (void)
+{
+	static uint8_t* blocks[BENCH_MAX_BLOCKS];
+	static uint16_t sizes[BENCH_MAX_BLOCKS];
+	uint16_t count = 0;
+	mem_pool_stats stats;
+	bool ok = true;
+
+	// Allocate every block, smallest class first, asking for the whole block each time
+	for (uint8_t index = 0; mem_pool_get_stats (index, &stats); index++)
+	{
+		for (uint8_t block = 0; block < stats.blocks; block++)
+		{
+			blocks[count] = (uint8_t*)mem_pool_alloc (stats.block_size);
+			sizes[count] = stats.block_size;
+			if (blocks[count] == NULL)
+			{
+				printf ("Block %u of %u bytes wasn't allocated\n", block, stats.block_size);
+				return (false);
+			}
+			memset (blocks[count], index + 1, stats.block_size);
+			count++;
+		}
+		mem_pool_get_stats (index, &stats);
+		if (stats.in_use != stats.blocks || stats.most_used != stats.blocks)
+		{
+			printf ("Class %u counts %u in use of %u\n", index, stats.in_use, stats.blocks);
+			ok = false;
+		}
+	}
+	for (uint16_t first = 0; first < count; first++)
+	{
+		for (uint16_t second = first + 1; second < count; second++)
+		{
+			if (blocks[first] < blocks[second] + sizes[second]
+				&& blocks[second] < blocks[first] + sizes[first])
+			{
+				printf ("Blocks %u and %u overlap\n", first, second);
+				ok = false;
+			}
+		}
+	}
+
+	// A full pool fails, and the failure is counted against the class which fits
+	if (mem_pool_alloc (1) != NULL || mem_pool_alloc (10000) != NULL)
+	{
+		printf ("A full pool allocated a block\n");
+		ok = false;
+	}
+	mem_pool_get_stats (0, &stats);
+	uint16_t failures = stats.failures;
+	mem_pool_get_stats (MEM_POOL_CLASSES - 1, &stats);
+	if (failures != 1 || stats.failures != 1)
+	{
+		printf ("Failures weren't counted\n");
+		ok = false;
+	}
+
+	// A small request takes a bigger block when its own class is used up
+	mem_pool_free (blocks[count - 1]);
+	if (mem_pool_alloc (1) != blocks[count - 1])
+	{
+		printf ("A small request didn't get the free big block\n");
+		ok = false;
+	}
+
+	// Everything freed can be allocated again, and the contents were left alone
+	for (uint16_t block = 0; block < count - 1; block++)
+	{
+		for (uint16_t byte = sizeof (void*); byte < sizes[block]; byte++)
+		{
+			if (blocks[block][byte] == 0)
+			{
+				printf ("Block %u was written over\n", block);
+				ok = false;
+				break;
+			}
+		}
+	}
+	for (uint16_t block = 0; block < count; block++)
+	{
+		mem_pool_free (blocks[block]);
+	}
+	mem_pool_free (NULL);
+	for (uint16_t block = 0; block < count; block++)
+	{
+		if (mem_pool_alloc (sizes[block]) == NULL)
+		{
+			printf ("Freed block %u couldn't be allocated again\n", block);
+			ok = false;
+		}
+	}
+	for (uint16_t block = 0; block < count; block++)
+	{
+		mem_pool_free (blocks[block]);
+	}
+	for (uint8_t index = 0; mem_pool_get_stats (index, &stats); index++)
+	{
+		if (stats.in_use != 0)
+		{
+			printf ("Class %u has %u blocks in use after all were freed\n", index,
+					stats.in_use);
+			ok = false;
+		}
+	}
+	return (ok);
+}
+
+
+//-------------------------------------------------------------------------------------
+/** This function picks the size of the next object in the mixed run. Most objects are
+ *  small, a few are the size of a serial port buffer.
+ *  @param p_seed The state of the random number generator, which is advanced
+ *  @return The size in bytes
+ */
+
+static size_t pick_size (uint32_t* p_seed)
+{
+	*p_seed = *p_seed * 1103515245UL + 12345UL;
+	uint16_t random = (*p_seed >> 16) & 0x7FFF;
+	uint16_t kind = random % 100;
+	if (kind < 50)
+	{
+		return (4 + random % 13);			// 4 to 16 bytes
+	}
+	if (kind < 80)
+	{
+		return (17 + random % 16);			// 17 to 32 bytes
+	}
+	if (kind < 95)
+	{
+		return (33 + random % 32);			// 33 to 64 bytes
+	}
+	return (65 + random % 66);				// 65 to 130 bytes
+}
+
+
+//-------------------------------------------------------------------------------------
+/** This function runs a long series of allocations and frees through the given pair
+ *  of functions. At each step an object is made if there are fewer than a randomly
+ *  chosen number in use, otherwise a random one is freed.
+ *  @param allocate The allocation function
+ *  @param release The free function
+ *  @return What was measured
+ */
+
+static bench_result run_mixed (void* (*allocate)(size_t), void (*release)(void*))
+{
+	void* live[BENCH_LIVE];
+	size_t live_size[BENCH_LIVE];
+	uint8_t count = 0;
+	size_t bytes = 0;
+	uint8_t* p_low = NULL;
+	uint8_t* p_high = NULL;
+	uint32_t seed = 1;
+	bench_result result = {0.0, 0, 0, 0};
+
+	double start = bench_ns ();
+	for (long step = 0; step < BENCH_STEPS; step++)
+	{
+		seed = seed * 1103515245UL + 12345UL;
+		uint8_t target = ((seed >> 16) & 0x7FFF) % (BENCH_LIVE + 1);
+		if (count < target)
+		{
+			size_t size = pick_size (&seed);
+			uint8_t* p_new = (uint8_t*)allocate (size);
+			if (p_new == NULL)
+			{
+				result.failures++;
+				continue;
+			}
+			live[count] = p_new;
+			live_size[count++] = size;
+			bytes += size;
+			if (bytes > result.most_live)
+			{
+				result.most_live = bytes;
+			}
+			if (p_low == NULL || p_new < p_low)
+			{
+				p_low = p_new;
+			}
+			if (p_new + size > p_high)
+			{
+				p_high = p_new + size;
+			}
+		}
+		else if (count > 0)
+		{
+			uint8_t which = ((seed >> 8) & 0xFF) % count;
+			release (live[which]);
+			bytes -= live_size[which];
+			live[which] = live[--count];
+			live_size[which] = live_size[count];
+		}
+	}
+	result.ns_per_step = (bench_ns () - start) / BENCH_STEPS;
+	result.span = p_high - p_low;
+
+	while (count > 0)
+	{
+		release (live[--count]);
+	}
+	return (result);
+}
+
+
+//-------------------------------------------------------------------------------------
+/** This function times allocating and freeing a small object over and over, which is
+ *  the fastest either allocator can go.
+ *  @param allocate The allocation function
+ *  @param release The free function
+ *  @return The time for one allocation and free, in nanoseconds
+ */
+
+static double time_pairs (void* (*allocate)(size_t), void (*release)(void*))
+{
+	double start = bench_ns ();
+	for (long step = 0; step < BENCH_STEPS; step++)
+	{
+		void* p_block = allocate (24);
+		__asm__ __volatile__ ("" : : "r" (p_block) : "memory");
+		release (p_block);
+	}
+	return ((bench_ns () - start) / BENCH_STEPS);
+}
+
+
+//-------------------------------------------------------------------------------------
+/** The main function checks the pool, then compares it with malloc().
+ */
+
+int main (void)
+{
+	bool ok = check_pool ();
+	printf ("Pool checks %s\n", ok ? "passed" : "FAILED");
+
+	// Run malloc() first so its time isn't helped by a warm cache from the pool
+	bench_result heap = run_mixed (malloc, free);
+	bench_result pool = run_mixed (mem_pool_alloc, mem_pool_free);
+
+	double heap_pair = time_pairs (malloc, free);
+	double pool_pair = time_pairs (mem_pool_alloc, mem_pool_free);
+
+	printf ("          ns/pair  ns/step  most live B  span B  failures\n");
+	printf ("mem_pool  %7.1f  %7.1f  %11zu  %6zu  %8ld\n", pool_pair, pool.ns_per_step,
+			pool.most_live, pool.span, pool.failures);
+	printf ("malloc    %7.1f  %7.1f  %11zu  %6zu  %8ld\n", heap_pair, heap.ns_per_step,
+			heap.most_live, heap.span, heap.failures);
+	return (ok ? 0 : 1);
+}
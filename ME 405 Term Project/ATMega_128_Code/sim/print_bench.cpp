@@ -0,0 +1,160 @@
+//*************************************************************************************
+/** \file print_bench.cpp
+ *    This program measures task_print on a PC. Each message in the catalogue is printed
+ *    many times to a port which can take TASK_PRINT_BURST characters each time the task
+ *    runs, as the rs232 port can when its transmit buffer has room, and the time taken
+ *    is shown in CPU cycles (time stamp counter ticks on an x86 PC, nanoseconds on
+ *    others) per message and per character, with the number of times the task had to
+ *    run. The SRAM used by a task_print object is shown too; 'make bench' also shows
+ *    the sizes of task_print.o's sections, whose .data and .bss would be in SRAM on the
+ *    AVR. The messages themselves are in program memory there, so they aren't counted.
+ *
+ *    Usage: print_bench [-v]
+ *    The -v option prints each message once, to check what it looks like.
+ *
+ *  Revisions:
+ *    \li 06-23-2011 Original file
+ *
+ *  License:
+ *    This file is released under the Lesser GNU Public License, version 2. This
+ *    program is intended for educational use only, but it is not limited thereto.
+ */
+//*************************************************************************************
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "base_text_serial.h"
+#include "task_print.h"
+
+#if defined (__x86_64__) || defined (__i386__)
+	#include <x86intrin.h>
+#endif
+
+
+/// How many times each message is printed while it's timed
+#define BENCH_REPEATS		20000
+
+
+//-------------------------------------------------------------------------------------
+/** This class is a port whose transmit buffer is emptied each time the task has run, so
+ *  it's always ready to send. It counts the characters sent, and can echo them.
+ */
+
+class bench_port : public base_text_serial
+{
+	public:
+		uint32_t sent;						///< Characters sent so far
+		bool echo;							///< True to write the characters to stdout
+
+		/// The constructor makes a quiet port
+		bench_port (void) : base_text_serial () { sent = 0; echo = false; }
+
+		/// This method says the port is ready, as its buffer is emptied between runs
+		bool ready_to_send (void) { return (true); }
+
+		/** This method sends one character.
+		 *  @param chout The character
+		 *  @return True, as the character is always sent
+		 */
+		bool putchar (char chout)
+		{
+			sent++;
+			if (echo && chout != '\r')
+			{
+				fputc (chout, stdout);
+			}
+			return (true);
+		}
+
+		/** This method sends a string.
+		 *  @param p_str The string
+		 */
+		void puts (char const* p_str)
+		{
+			while (*p_str)
+			{
+				putchar (*p_str++);
+			}
+		}
+};
+
+
+//-------------------------------------------------------------------------------------
+/** This function reads a free-running clock.
+ *  @return The time stamp counter on an x86 PC, or the time in nanoseconds on others
+ */
+
+static inline uint64_t bench_clock (void)
+{
+#if defined (__x86_64__) || defined (__i386__)
+	return (__rdtsc ());
+#else
+	struct timespec now;
+	clock_gettime (CLOCK_MONOTONIC, &now);
+	return ((uint64_t)now.tv_sec * 1000000000ULL + now.tv_nsec);
+#endif
+}
+
+
+//-------------------------------------------------------------------------------------
+/** This function prints one message to completion.
+ *  @param printer The task_print object
+ *  @param print_mode The variable the task reads its requests from
+ *  @param which The message
+ *  @return The number of times the task ran
+ */
+
+static uint32_t print_one (task_print& printer, uint8_t& print_mode, uint8_t which)
+{
+	uint32_t runs = 0;
+	printer.print (which, 2, 1500);
+	while (print_mode != PRINT_NOTHING)
+	{
+		printer.run ();
+		runs++;
+	}
+	return (runs);
+}
+
+
+//-------------------------------------------------------------------------------------
+/** The main function times each message in the catalogue and shows the results.
+ */
+
+int main (int argc, char** argv)
+{
+	bool verbose = (argc > 1 && strcmp (argv[1], "-v") == 0);
+	bench_port port;
+	uint8_t print_mode = PRINT_NOTHING;
+	task_print printer (&port, &print_mode);
+
+	printf ("message  chars  runs  cycles/message  cycles/char\n");
+	uint64_t all_cycles = 0;
+	uint32_t all_chars = 0;
+	for (uint8_t which = PRINT_NOTHING + 1; which < PRINT_MESSAGES; which++)
+	{
+		port.echo = verbose;
+		port.sent = 0;
+		uint32_t runs = print_one (printer, print_mode, which);
+		uint32_t chars = port.sent;
+		port.echo = false;
+
+		uint64_t start = bench_clock ();
+		for (uint16_t count = 0; count < BENCH_REPEATS; count++)
+		{
+			print_one (printer, print_mode, which);
+		}
+		uint64_t cycles = (bench_clock () - start) / BENCH_REPEATS;
+		all_cycles += cycles;
+		all_chars += chars;
+		printf ("%7u  %5u  %4u  %14llu  %11.1f\n", which, chars, runs,
+				(unsigned long long)cycles, (double)cycles / chars);
+	}
+	printf ("    all  %5u        %14llu  %11.1f\n", all_chars,
+			(unsigned long long)all_cycles, (double)all_cycles / all_chars);
+	printf ("task_print object: %u bytes of SRAM on this PC\n",
+			(unsigned)sizeof (task_print));
+	return (0);
+}
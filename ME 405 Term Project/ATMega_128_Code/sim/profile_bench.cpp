@@ -0,0 +1,302 @@
+//*************************************************************************************
+/** \file profile_bench.cpp
+ *    This program measures the task profiler which STL_PROFILE compiles into stl_task,
+ *    using the simulated processor in sim_avr.cpp. First the profiler's own overhead
+ *    is measured: a measurement is started and ended many times, and the time taken
+ *    on the PC and the simulated clock cycles charged for register accesses are shown
+ *    per measurement, beside the same figures for the time_stamp arithmetic which the
+ *    profiler used before, copied into this program. Then a few tasks with made-up
+ *    run times, including some which overrun their intervals and one which sometimes
+ *    asks to run again at once, are run by a task_scheduler for some seconds of
+ *    simulated time. Their profiles are printed as text, and the binary profile block
+ *    is written to a file which tools/profile_report can turn into a report.
+ *
+ *    Usage: profile_bench [block_file]
+ *    The block is written to profile.bin if no file is given.
+ *
+ *  Revisions:
+ *    \li 06-25-2011 Original file
+ *
+ *  License:
+ *    This file is released under the Lesser GNU Public License, version 2. This
+ *    program is intended for educational use only, but it is not limited thereto.
+ */
+//*************************************************************************************
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <avr/io.h>
+#include <avr/interrupt.h>
+#include "sim_avr.h"
+#include "sim_serial.h"
+#include "stl_timer.h"
+#include "stl_task.h"
+#include "stl_scheduler.h"
+
+#ifndef STL_PROFILE
+	#error profile_bench must be compiled with STL_PROFILE defined, as in the Makefile
+#endif
+
+
+/// How many measurements are timed for the overhead
+#define BENCH_MEASUREMENTS	1000000L
+
+/// How many seconds of simulated time the tasks are run
+#define BENCH_SECONDS		20
+
+/// Clock cycles in one microsecond of simulated time
+#define CYCLES_PER_US		(F_CPU / 1000000UL)
+
+
+//-------------------------------------------------------------------------------------
+/** This class does what the profiler did before it used raw timer counts: it takes
+ *  the time with the task timer and keeps the shortest, longest and total run times
+ *  in time stamps. It's here so that its overhead can be compared with the new one.
+ */
+
+class former_profiler
+{
+	protected:
+		task_timer& the_timer;				///< The timer which measures the runs
+		time_stamp max_time;				///< Longest run time
+		time_stamp min_time;				///< Shortest run time
+		time_stamp run_time_sum;			///< Sum of run times
+		time_stamp start_time;				///< When the run being measured started
+		uint32_t runs;						///< Number of runs measured
+
+	public:
+		/** The constructor makes a cleared profiler.
+		 *  @param a_timer The timer which measures the runs
+		 */
+		former_profiler (task_timer& a_timer) : the_timer (a_timer) { runs = 0; }
+
+		/// This method starts a measurement
+		void start (void) { start_time = the_timer.get_time_now (); }
+
+		/// This method ends a measurement and records it
+		void end (void)
+		{
+			time_stamp duration = the_timer.get_time_now () - start_time;
+			if (duration < 0)
+			{
+				return;
+			}
+			if (duration > max_time)
+				max_time = duration;
+			if (runs == 0L)
+				min_time = duration;
+			else
+				if (duration < min_time)
+					min_time = duration;
+			run_time_sum += duration;
+			runs++;
+		}
+};
+
+
+//-------------------------------------------------------------------------------------
+/** This class is a task which pretends to work for a random time each run, by letting
+ *  simulated time pass. Now and then a run takes much longer, and a task can be made
+ *  to ask to run again at once every so many runs.
+ */
+
+class bench_task : public stl_task
+{
+	protected:
+		uint32_t work_min;					///< Shortest run, in clock cycles
+		uint32_t work_spread;				///< Range of run times above the shortest
+		uint32_t spike;						///< Length of the occasional long run
+		uint16_t spike_every;				///< Runs between long runs, or 0 for none
+		uint16_t asap_every;				///< Runs between run_again_ASAP()'s, or 0
+		uint32_t count;						///< Number of runs so far
+		uint32_t seed;						///< State of the random number generator
+
+	public:
+		/** The constructor makes a task with the given run times, in microseconds.
+		 *  @param a_timer The task timer
+		 *  @param interval The time between runs
+		 *  @param shortest The shortest run time
+		 *  @param longest The longest normal run time
+		 *  @param spike_us The length of the occasional long run
+		 *  @param spike_runs The number of runs from one long run to the next, or 0
+		 *  @param asap_runs The number of runs between calls to run_again_ASAP(), or 0
+		 */
+		bench_task (task_timer& a_timer, const time_stamp& interval, uint32_t shortest,
+					uint32_t longest, uint32_t spike_us, uint16_t spike_runs,
+					uint16_t asap_runs)
+			: stl_task (a_timer, interval)
+		{
+			work_min = shortest * CYCLES_PER_US;
+			work_spread = (longest - shortest) * CYCLES_PER_US + 1;
+			spike = spike_us * CYCLES_PER_US;
+			spike_every = spike_runs;
+			asap_every = asap_runs;
+			count = 0;
+			seed = 12345 + get_serial_number ();
+		}
+
+		/** This method works for a while, then goes back to the scheduler.
+		 *  @param state The task's state, which isn't used
+		 *  @return STL_NO_TRANSITION, as the task has only one state
+		 */
+		char run (char state)
+		{
+			count++;
+			seed = seed * 1103515245UL + 12345UL;
+			uint32_t cycles = work_min + ((seed >> 8) % work_spread);
+			if (spike_every != 0 && count % spike_every == 0)
+			{
+				cycles = spike;
+			}
+			sim_spend (cycles);
+			if (asap_every != 0 && count % asap_every == 0)
+			{
+				run_again_ASAP ();
+			}
+			return (STL_NO_TRANSITION);
+		}
+};
+
+
+//-------------------------------------------------------------------------------------
+/** This class writes bytes to a file without changing them, for the binary profile.
+ */
+
+class binary_file : public base_text_serial
+{
+	protected:
+		FILE* p_file;						///< The file written to
+
+	public:
+		/** This constructor sets up a device which writes to the given file.
+		 *  @param p_out The file
+		 */
+		binary_file (FILE* p_out) : base_text_serial () { p_file = p_out; }
+
+		/// This method says that the device is always ready to send
+		bool ready_to_send (void) { return (true); }
+
+		/** This method writes one byte.
+		 *  @param chout The byte
+		 *  @return True, as the byte is always written
+		 */
+		bool putchar (char chout) { fputc (chout, p_file); return (true); }
+
+		/** This method writes a string.
+		 *  @param p_str The string
+		 */
+		void puts (char const* p_str) { fputs (p_str, p_file); }
+};
+
+
+//-------------------------------------------------------------------------------------
+/** This function reads a clock in nanoseconds.
+ *  @return The time in nanoseconds
+ */
+
+static double bench_ns (void)
+{
+	struct timespec now;
+	clock_gettime (CLOCK_MONOTONIC, &now);
+	return (now.tv_sec * 1.0E9 + now.tv_nsec);
+}
+
+
+//-------------------------------------------------------------------------------------
+/** The main function measures the profiler's overhead, then runs and profiles some
+ *  tasks and writes their profiles.
+ */
+
+int main (int argc, char** argv)
+{
+	const char* block_name = (argc > 1) ? argv[1] : "profile.bin";
+	sim_serial screen (stdout);
+	task_timer the_timer;
+	sei ();
+
+	// Time many empty measurements with each profiler. The task does nothing, so its
+	// run time and jitter don't matter here
+	time_stamp interval_overhead (0, 1000);
+	bench_task idle_task (the_timer, interval_overhead, 0, 0, 0, 0, 0);
+	former_profiler former (the_timer);
+
+	double start_ns = bench_ns ();
+	uint64_t start_cycles = sim_cycles;
+	for (long count = 0; count < BENCH_MEASUREMENTS; count++)
+	{
+		former.start ();
+		former.end ();
+	}
+	double former_ns = (bench_ns () - start_ns) / BENCH_MEASUREMENTS;
+	double former_cycles = (double)(sim_cycles - start_cycles) / BENCH_MEASUREMENTS;
+
+	start_ns = bench_ns ();
+	start_cycles = sim_cycles;
+	for (long count = 0; count < BENCH_MEASUREMENTS; count++)
+	{
+		idle_task.start_profiler ();
+		idle_task.end_profiler ();
+	}
+	double new_ns = (bench_ns () - start_ns) / BENCH_MEASUREMENTS;
+	double new_cycles = (double)(sim_cycles - start_cycles) / BENCH_MEASUREMENTS;
+
+	printf ("Overhead per measurement  PC ns  register access cycles  SRAM per task\n");
+	printf ("time_stamp profiler      %6.1f  %22.1f  %13u\n", former_ns, former_cycles,
+			(unsigned)(5 * sizeof (time_stamp) + sizeof (uint32_t)));
+	printf ("raw count profiler       %6.1f  %22.1f  %13u\n", new_ns, new_cycles,
+			(unsigned)(sizeof (stl_prof_rec) + 3 * sizeof (uint16_t) + sizeof (bool)));
+	printf ("(each register access is charged %u cycles)\n\n", sim_access_cycles);
+
+	// Run some tasks like the plotter's: fast loops which sometimes overrun, slower
+	// ones, one which asks to run again now and then, and a slow one
+	time_stamp interval_fast (0, 2000);
+	time_stamp interval_mid (0, 10000);
+	time_stamp interval_slow (0, 100000);
+	bench_task fast (the_timer, interval_fast, 150, 350, 2500, 500, 0);
+	bench_task mid (the_timer, interval_mid, 800, 1600, 0, 0, 0);
+	bench_task lines (the_timer, interval_mid, 50, 2000, 0, 0, 7);
+	bench_task slow (the_timer, interval_slow, 2500, 3500, 0, 0, 0);
+
+	task_scheduler scheduler (the_timer, SCHED_EDF);
+	scheduler.add_task (&fast, 4, interval_fast);
+	scheduler.add_task (&mid, 3, interval_mid);
+	scheduler.add_task (&lines, 2, interval_mid);
+	scheduler.add_task (&slow, 0, interval_slow);
+	scheduler.set_tickless (true);
+
+	// The overhead measurement took some simulated time, so start the tasks from now
+	for (uint8_t index = 0; index < scheduler.get_num_tasks (); index++)
+	{
+		scheduler.get_entry (index).p_task->set_next_run_time (the_timer.get_time_now ());
+	}
+	scheduler.clear_stats ();
+
+	double start_seconds = sim_seconds ();
+	while (sim_seconds () - start_seconds < BENCH_SECONDS)
+	{
+		if (!scheduler.dispatch ())
+		{
+			scheduler.idle ();
+		}
+	}
+
+	for (uint8_t index = 0; index < scheduler.get_num_tasks (); index++)
+	{
+		screen << *(scheduler.get_entry (index).p_task) << endl;
+	}
+	screen << scheduler;
+
+	FILE* p_block = fopen (block_name, "wb");
+	if (p_block == NULL)
+	{
+		perror (block_name);
+		return (1);
+	}
+	binary_file block_file (p_block);
+	scheduler.write_profile (block_file);
+	fclose (p_block);
+	printf ("Profile block written to %s\n", block_name);
+
+	return (0);
+}
@@ -0,0 +1,352 @@
+//*************************************************************************************
+/** \file rs232_bench.cpp
+ *    This program runs the rs232 driver in rs232int.cpp on the simulated processor in
+ *    sim_avr.cpp, whose USART sends each character in the time it would take at the
+ *    port's baud rate, and checks and measures its transmit buffer. Messages are
+ *    written with each of the policies for a full buffer, and what comes out of the
+ *    USART is compared with what was written: with the blocking policy it must be the
+ *    same, and with the others the characters which got out must be in order and,
+ *    with those thrown away, add up to what was written. After each message the data
+ *    register empty interrupt must have turned itself off, and the port must say that
+ *    it's done sending. Characters written with interrupts disabled must come out after
+ *    those already in the buffer.
+ *
+ *    The time each putchar() call takes, including any time the interrupt steals from
+ *    it, is measured in simulated clock cycles, and the longest is shown. A status
+ *    message written at the pace of a task whose messages fit in the buffer shows what
+ *    the control loop sees; writing with interrupts disabled, which sends by polling
+ *    as the driver always did before it had a transmit buffer, is shown beside it.
+ *    The blocking policy's wait loop doesn't touch any registers, so the simulator
+ *    couldn't let time pass in it; instead, while the buffer is full, the bench lets
+ *    time pass in small steps until there's room, and counts that time as part of the
+ *    putchar() call, as it would be on the AVR.
+ *
+ *    Usage: rs232_bench
+ *
+ *  Revisions:
+ *    \li 06-29-2011 Original file
+ *
+ *  License:
+ *    This file is released under the Lesser GNU Public License, version 2. This
+ *    program is intended for educational use only, but it is not limited thereto.
+ */
+//*************************************************************************************
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <avr/io.h>
+#include <avr/interrupt.h>
+#include "sim_avr.h"
+#include "rs232int.h"
+
+
+/// The baud rate, as the plotter's port runs at
+#define BENCH_BAUD			9600
+
+/// The serial port used, as in Polar_Plotter.cpp; bench_rs232 looks at its registers
+#define BENCH_PORT			1
+
+/// Cycles which pass in each step while the blocking policy waits for room
+#define BENCH_WAIT_STEP		8
+
+/// Cycles of work the status message's task does between characters
+#define BENCH_TASK_WORK		2000
+
+/// The most characters the bench keeps of what the USART sends
+#define BENCH_MAX_SENT		4096
+
+/// A status message such as the plotter's main loop writes, 90 characters long
+static const char status_message[] =
+	"Pos r: 12.345 in, theta: 1.2345 rad; PID err: 12, -3; "
+	"PWM: 187, -42; tasks: 7, idle: 40%\r\n";
+
+
+/// The characters which the USART has sent
+static char sent[BENCH_MAX_SENT];
+
+/// How many characters the USART has sent
+static uint16_t num_sent = 0;
+
+/// When the first and last characters of a message finished being sent
+static uint64_t first_sent_at, last_sent_at;
+
+
+//-------------------------------------------------------------------------------------
+/** This function receives the characters sent by the simulated USARTs, keeping those
+ *  from the port being tested.
+ *  @param port The USART's number
+ *  @param data The character
+ */
+
+static void bench_uart_sink (uint8_t port, uint8_t data)
+{
+	if (port != BENCH_PORT)
+	{
+		return;
+	}
+	if (num_sent == 0)
+	{
+		first_sent_at = sim_cycles;
+	}
+	last_sent_at = sim_cycles;
+	if (num_sent < BENCH_MAX_SENT)
+	{
+		sent[num_sent++] = (char)data;
+	}
+}
+
+
+//-------------------------------------------------------------------------------------
+/** This function reads a clock in nanoseconds.
+ *  @return The time in nanoseconds
+ */
+
+static double bench_ns (void)
+{
+	struct timespec now;
+	clock_gettime (CLOCK_MONOTONIC, &now);
+	return (now.tv_sec * 1.0E9 + now.tv_nsec);
+}
+
+
+//-------------------------------------------------------------------------------------
+/** This class gives the bench a look at the parts of rs232 which are kept from other
+ *  code, as the interrupt enable bit and the buffer are.
+ */
+
+class bench_rs232 : public rs232
+{
+	public:
+		/** The constructor sets up the port as rs232's does.
+		 *  @param baud_rate The baud rate
+		 *  @param port_number The USART's number
+		 */
+		bench_rs232 (unsigned int baud_rate, unsigned char port_number)
+			: rs232 (baud_rate, port_number) { }
+
+		/// This method tells whether the data register empty interrupt is enabled
+		bool udrie_on (void) { return ((sim_peek (SIM_UCSR1B) & mask_UDRIE) != 0); }
+
+		/// This method returns the number of characters waiting in the buffer
+		uint8_t buffered (void) { return (p_tx_buffer->num_items ()); }
+};
+
+
+//-------------------------------------------------------------------------------------
+/** This structure holds the measurements of one message written to the port.
+ */
+
+typedef struct
+{
+	uint16_t calls;							///< Number of calls to putchar()
+	uint64_t cycles;						///< Total simulated cycles in putchar()
+	uint64_t worst;							///< Longest single call, in cycles
+	double pc_ns;							///< Total time on the PC
+	uint16_t dropped;						///< Characters the driver threw away
+} bench_result;
+
+
+//-------------------------------------------------------------------------------------
+/** This function lets the simulation run until the port has sent everything in its
+ *  buffer and the last character has gone out.
+ *  @param port The port
+ *  @return True if the port finished sending and turned its interrupt off
+ */
+
+static bool drain (bench_rs232& port)
+{
+	for (uint32_t waited = 0; port.buffered () > 0 || port.is_sending (); waited++)
+	{
+		if (waited > 100000UL)
+		{
+			return (false);
+		}
+		sim_spend (100);
+	}
+	return (!port.udrie_on ());
+}
+
+
+//-------------------------------------------------------------------------------------
+/** This function writes a message to the port one character at a time, timing each
+ *  putchar() call, then lets the simulation run until the port has sent everything.
+ *  @param port The port
+ *  @param policy What putchar() does when the transmit buffer is full
+ *  @param p_msg The message
+ *  @param length The number of characters in the message
+ *  @param work Cycles which pass between characters, as if a task were working
+ *  @param result The measurements
+ *  @return True if the port finished sending and turned its interrupt off
+ */
+
+static bool write_message (bench_rs232& port, rsint_tx_policy policy, const char* p_msg,
+						   uint16_t length, uint32_t work, bench_result& result)
+{
+	uint16_t dropped_before = port.get_tx_dropped ();
+	bool blocking = (policy == RSINT_TX_BLOCK) && (sim_peek (SIM_SREG) & (1 << SREG_I));
+
+	port.set_tx_policy (policy);
+	num_sent = 0;
+	memset (&result, 0, sizeof (result));
+	for (uint16_t index = 0; index < length; index++)
+	{
+		double start_ns = bench_ns ();
+		uint64_t before = sim_cycles;
+		while (blocking && !port.ready_to_send ())
+		{
+			sim_spend (BENCH_WAIT_STEP);		// As putchar()'s wait loop would
+		}
+		port.putchar (p_msg[index]);
+		uint64_t cycles = sim_cycles - before;
+		result.pc_ns += bench_ns () - start_ns;
+		result.cycles += cycles;
+		if (cycles > result.worst)
+		{
+			result.worst = cycles;
+		}
+		result.calls++;
+		sim_spend (work);
+	}
+
+	bool done = drain (port);
+	result.dropped = port.get_tx_dropped () - dropped_before;
+	return (done);
+}
+
+
+//-------------------------------------------------------------------------------------
+/** This function checks that the characters the USART sent are all from a message and
+ *  in the same order, with none sent twice, though some may be missing.
+ *  @param p_msg The message
+ *  @param length The number of characters in the message
+ *  @return True if the characters sent are in order
+ */
+
+static bool sent_in_order (const char* p_msg, uint16_t length)
+{
+	uint16_t index = 0;
+	for (uint16_t count = 0; count < num_sent; count++)
+	{
+		while (index < length && p_msg[index] != sent[count])
+		{
+			index++;
+		}
+		if (index >= length)
+		{
+			return (false);
+		}
+		index++;
+	}
+	return (true);
+}
+
+
+//-------------------------------------------------------------------------------------
+/** This function prints one line of the results table.
+ *  @param label A name for the line
+ *  @param result The measurements
+ *  @param good True if the checks for this case passed
+ */
+
+static void show (const char* label, const bench_result& result, bool good)
+{
+	printf ("%-32s %5u %7.1f %7lu %8.1f %8.1f %7u  %s\n", label, result.calls,
+			(double)result.cycles / result.calls, (unsigned long)result.worst,
+			result.worst * 1.0E6 / F_CPU, result.pc_ns / result.calls, result.dropped,
+			good ? "ok" : "FAILED");
+}
+
+
+//-------------------------------------------------------------------------------------
+/** The main function writes messages to the port in each way and prints the results.
+ */
+
+int main (void)
+{
+	bench_result result;
+	bool good = true;
+	bool ok;
+
+	sim_set_uart (bench_uart_sink);
+	bench_rs232 port (BENCH_BAUD, BENCH_PORT);
+	sei ();
+
+	// A dump of three status messages at once is more than the buffer holds
+	char dump[3 * sizeof (status_message)];
+	strcpy (dump, status_message);
+	strcat (dump, status_message);
+	strcat (dump, status_message);
+	uint16_t status_length = strlen (status_message);
+	uint16_t dump_length = strlen (dump);
+
+	// A character takes 10 bits, each 16 clocks times the baud rate divisor
+	uint32_t frame_cycles = 16UL * (calc_baud_div (BENCH_BAUD) + 1) * 10UL;
+
+	printf ("%-32s %5s %7s %7s %8s %8s %7s\n", "Cycles in each putchar() call",
+			"calls", "avg", "worst", "worst us", "PC ns", "dropped");
+
+	// A message written by a task between bits of work, and one written all at once;
+	// either fits in the buffer, so putchar() should never wait
+	ok = write_message (port, RSINT_TX_BLOCK, status_message, status_length,
+						BENCH_TASK_WORK, result);
+	ok &= (num_sent == status_length && memcmp (sent, status_message, num_sent) == 0);
+	ok &= (result.worst < 200);
+	show ("status message, from a task", result, ok);
+	good &= ok;
+
+	ok = write_message (port, RSINT_TX_BLOCK, status_message, status_length, 0, result);
+	ok &= (num_sent == status_length && memcmp (sent, status_message, num_sent) == 0);
+	ok &= (result.worst < 200);
+	show ("status message, all at once", result, ok);
+	good &= ok;
+
+	// Messages which overfill the buffer, with each policy
+	ok = write_message (port, RSINT_TX_BLOCK, dump, dump_length, 0, result);
+	ok &= (num_sent == dump_length && memcmp (sent, dump, num_sent) == 0);
+	ok &= (result.dropped == 0 && result.worst <= frame_cycles + 200);
+	show ("3 messages at once, block", result, ok);
+	good &= ok;
+	double rate = (num_sent - 1) * (double)F_CPU / (last_sent_at - first_sent_at);
+
+	ok = write_message (port, RSINT_TX_DROP_NEW, dump, dump_length, 0, result);
+	ok &= (sent_in_order (dump, dump_length) && num_sent + result.dropped == dump_length);
+	ok &= (result.dropped > 0 && sent[0] == dump[0]);
+	show ("3 messages at once, drop new", result, ok);
+	good &= ok;
+
+	ok = write_message (port, RSINT_TX_DROP_OLDEST, dump, dump_length, 0, result);
+	ok &= (sent_in_order (dump, dump_length) && num_sent + result.dropped == dump_length);
+	ok &= (result.dropped > 0 && sent[num_sent - 1] == dump[dump_length - 1]);
+	show ("3 messages at once, drop oldest", result, ok);
+	good &= ok;
+
+	// With interrupts disabled, each character is sent by polling, as before
+	cli ();
+	ok = write_message (port, RSINT_TX_BLOCK, status_message, status_length, 0, result);
+	sei ();
+	ok &= (num_sent == status_length && memcmp (sent, status_message, num_sent) == 0);
+	show ("status message, interrupts off", result, ok);
+	good &= ok;
+
+	// Characters written with interrupts off go out after those in the buffer
+	num_sent = 0;
+	port << "abcdef";
+	cli ();
+	port.putchar ('X');
+	sei ();
+	ok = drain (port);
+	ok &= (num_sent == 7 && memcmp (sent, "abcdefX", 7) == 0);
+	printf ("\n%-81s %s\n", "Buffered then polled characters come out in order",
+			ok ? "ok" : "FAILED");
+	good &= ok;
+
+	// The characters come out as fast as the baud rate allows
+	double expected = (double)F_CPU / frame_cycles;
+	ok = (rate > expected * 0.999 && rate < expected * 1.001);
+	printf ("Characters per second sent: %-53.1f %s\n", rate, ok ? "ok" : "FAILED");
+	good &= ok;
+
+	printf ("\n%s\n", good ? "All checks passed" : "Some checks FAILED");
+	return (good ? 0 : 1);
+}
@@ -0,0 +1,359 @@
+//*************************************************************************************
+/** \file sched_bench.cpp
+ *    This program measures how long a task's schedule() method takes, using the
+ *    simulated processor in sim_avr.cpp. The scheduler calls schedule(), or is_due(),
+ *    for every task each time around its loop, so this is the overhead which each task
+ *    adds whether it runs or not. Two cases are timed: a task which isn't due yet, for
+ *    which schedule() only reads the time and compares it with the task's next run
+ *    time, and a task which is due every time and whose run() method does nothing, so
+ *    that only the bookkeeping around run() is measured. The time taken on the PC and
+ *    the simulated clock cycles charged for register accesses are shown per call.
+ *
+ *    Beside them are the same figures for schedule() as it was before time stamps
+ *    became a raw tick count with inline methods: the union-based time stamp, whose
+ *    methods were compiled in stl_timer.cpp and so were called rather than inlined,
+ *    and the schedule() method which read the timer twice for a waiting task, are
+ *    copied into this program. The time stamp arithmetic is timed on its own too, and
+ *    a few time stamps made from constants are checked.
+ *
+ *  Revisions:
+ *    \li 06-28-2011 Original file
+ *
+ *  License:
+ *    This file is released under the Lesser GNU Public License, version 2. This
+ *    program is intended for educational use only, but it is not limited thereto.
+ */
+//*************************************************************************************
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <avr/io.h>
+#include <avr/interrupt.h>
+#include "sim_avr.h"
+#include "base_text_serial.h"
+#include "stl_timer.h"
+#include "stl_task.h"
+
+
+/// How many calls are timed in each case
+#define BENCH_CALLS			2000000L
+
+/// The former methods were compiled in another file, so the compiler couldn't inline
+/// them; this keeps it from inlining the copies here
+#define FORMER_METHOD		__attribute__ ((noinline))
+
+
+/// Results are put here so that the compiler can't leave out the work done for them
+static volatile uint32_t bench_sink;
+
+
+//-------------------------------------------------------------------------------------
+/** This union is the one in which time stamps kept their data before.
+ */
+
+typedef union
+{
+	uint32_t whole;							///< All the data as one 32-bit number
+	uint16_t half[2];						///< The data as an array of 16-bit ints
+	uint8_t quarters[4];					///< The data as an array of 8-bit chars
+} former_data_32;
+
+
+//-------------------------------------------------------------------------------------
+/** This class is the time stamp as it was before, with the methods which schedule()
+ *  used. They are written as they were in stl_timer.cpp.
+ */
+
+class former_stamp
+{
+	public:
+		former_data_32 data;				///< The time, which the timer fills in
+
+		/// This constructor makes a time stamp holding the given number of ticks
+		FORMER_METHOD former_stamp (uint32_t a_time = 0) { data.whole = a_time; }
+
+		/** This operator adds another time stamp to this one.
+		 *  @param addend The other time stamp
+		 */
+		FORMER_METHOD void operator += (const former_stamp& addend)
+		{
+			data.whole += addend.data.whole;
+		}
+
+		/** This operator tests if this time stamp is later than another.
+		 *  @param other The other time stamp
+		 *  @return True if this time stamp is later
+		 */
+		FORMER_METHOD bool operator > (const former_stamp& other)
+		{
+			int32_t difference = (int32_t)(data.whole - other.data.whole);
+			if (difference > 0L)
+			{
+				return (true);
+			}
+			else
+			{
+				return (false);
+			}
+		}
+
+		/** This operator adds two time stamps together.
+		 *  @param addend The other time stamp
+		 *  @return The sum
+		 */
+		FORMER_METHOD former_stamp operator + (const former_stamp& addend)
+		{
+			former_stamp ret_stamp;
+			ret_stamp.data.whole = this->data.whole + addend.data.whole;
+
+			return ret_stamp;
+		}
+
+		/** This operator tests if this time stamp is earlier than another.
+		 *  @param other The other time stamp
+		 *  @return True if this time stamp is earlier
+		 */
+		FORMER_METHOD bool operator < (const former_stamp& other)
+		{
+			int32_t difference = (int32_t)(data.whole - other.data.whole);
+			if (difference < 0L)
+			{
+				return (true);
+			}
+			else
+			{
+				return (false);
+			}
+		}
+};
+
+
+//-------------------------------------------------------------------------------------
+/** This class is a task whose schedule() method is the one used before, reading the
+ *  time into a union-based time stamp as task_timer::get_time_now() did. Its run()
+ *  method does nothing.
+ */
+
+class former_task
+{
+	protected:
+		former_stamp now_time;				///< The time most recently read
+		former_stamp next_run_time;			///< When the task is next to run
+		former_stamp interval;				///< Time between runs
+		task_op_state op_state;				///< Waiting or pending
+		char current_state;					///< State of the task's state machine
+
+	public:
+		/** The constructor makes a task which first runs at the given time.
+		 *  @param first_run The time of the first run
+		 *  @param a_interval The time between runs
+		 */
+		former_task (uint32_t first_run, uint32_t a_interval)
+			: next_run_time (first_run), interval (a_interval)
+		{
+			op_state = TASK_WAITING;
+			current_state = 0;
+		}
+
+		/** This method reads the time as the former task_timer::get_time_now() did.
+		 *  @return A reference to the time stamp holding the time
+		 */
+		FORMER_METHOD former_stamp& get_time_now (void)
+		{
+			uint8_t temp_sreg = SREG;
+			cli ();
+			now_time.data.half[0] = TMR_TCNT_REG;
+			now_time.data.half[1] = (uint16_t)ust_overflows;
+			if ((TMR_OVF_TIFR & (1 << TMR_OVF_FLAG)) && !(now_time.data.half[0] & 0x8000))
+			{
+				now_time.data.half[1]++;
+			}
+			SREG = temp_sreg;
+
+			return (now_time);
+		}
+
+		/// This run method does nothing and never makes a transition
+		virtual char run (char) { return (STL_NO_TRANSITION); }
+
+		/** This method is schedule() as it was, without the profiler and trace.
+		 *  @param til_next_time A place to put the next run time, or NULL
+		 *  @return The task's operational state
+		 */
+		virtual task_op_state schedule (former_stamp* til_next_time = NULL)
+		{
+			char next_state;
+			former_stamp the_time;
+
+			switch (op_state)
+			{
+				case (TASK_WAITING):
+					the_time = get_time_now ();
+					if (next_run_time > get_time_now ())
+					{
+						if (til_next_time != NULL)
+						{
+							*til_next_time = next_run_time;
+						}
+						return (TASK_WAITING);
+					}
+
+				case (TASK_PENDING):
+					op_state = TASK_WAITING;
+					next_state = run (current_state);
+					if (next_state != STL_NO_TRANSITION)
+					{
+						current_state = next_state;
+					}
+					if (op_state == TASK_WAITING)
+					{
+						next_run_time += interval;
+						if (til_next_time != NULL)
+						{
+							*til_next_time = next_run_time;
+						}
+					}
+					return (op_state);
+
+				default:
+					return (op_state);
+			}
+		}
+};
+
+
+//-------------------------------------------------------------------------------------
+/** This class is a task whose run() method does nothing, scheduled by stl_task.
+ */
+
+class idle_task : public stl_task
+{
+	public:
+		/** The constructor makes a task with the given interval.
+		 *  @param a_timer The task timer
+		 *  @param interval The time between runs
+		 */
+		idle_task (task_timer& a_timer, const time_stamp& interval)
+			: stl_task (a_timer, interval) { }
+
+		/// This run method does nothing and never makes a transition
+		char run (char) { return (STL_NO_TRANSITION); }
+};
+
+
+//-------------------------------------------------------------------------------------
+/** This function reads a clock in nanoseconds.
+ *  @return The time in nanoseconds
+ */
+
+static double bench_ns (void)
+{
+	struct timespec now;
+	clock_gettime (CLOCK_MONOTONIC, &now);
+	return (now.tv_sec * 1.0E9 + now.tv_nsec);
+}
+
+
+//-------------------------------------------------------------------------------------
+/** This function calls a task's schedule() method many times and prints the time
+ *  taken on the PC and the register access cycles per call.
+ *  @param label A name for the line printed
+ *  @param p_task A pointer to the task, a former_task or an stl_task
+ */
+
+template <class task_type, class stamp_type>
+static void time_schedule (const char* label, task_type* p_task)
+{
+	stamp_type next_time;
+
+	double start_ns = bench_ns ();
+	uint64_t start_cycles = sim_cycles;
+	for (long count = 0; count < BENCH_CALLS; count++)
+	{
+		p_task->schedule (&next_time);
+	}
+	printf ("%-30s  %6.1f  %22.1f\n", label, (bench_ns () - start_ns) / BENCH_CALLS,
+			(double)(sim_cycles - start_cycles) / BENCH_CALLS);
+}
+
+
+//-------------------------------------------------------------------------------------
+/** This function does the arithmetic with which the scheduler picks the most urgent
+ *  task, adding a deadline to a release time and keeping the earliest, many times,
+ *  and prints the time taken on the PC per step.
+ *  @param label A name for the line printed
+ */
+
+template <class stamp_type>
+static void time_arithmetic (const char* label)
+{
+	volatile uint32_t step = 2000;			// Kept in memory so the loop isn't folded
+	stamp_type release (0UL);
+	stamp_type deadline (20000UL);
+	stamp_type best (0xFFFFFFUL);
+	stamp_type interval (step);
+	uint32_t earlier = 0;
+
+	double start_ns = bench_ns ();
+	for (long count = 0; count < BENCH_CALLS; count++)
+	{
+		release += interval;
+		stamp_type key = release + deadline;
+		if (key < best)
+		{
+			earlier++;
+		}
+	}
+	printf ("%-30s  %6.1f  %22s\n", label, (bench_ns () - start_ns) / BENCH_CALLS, "-");
+	bench_sink = earlier;
+}
+
+
+//-------------------------------------------------------------------------------------
+/** The main function times the former and the present schedule() in each case, then
+ *  checks some time stamps made from constants.
+ */
+
+int main (void)
+{
+	task_timer the_timer;
+	sei ();
+
+	// Tasks which won't be due for a long time, so schedule() only checks the time
+	uint32_t far_away = the_timer.get_time_now ().get_raw_time () + 0x40000000UL;
+	former_task former_waiting (far_away, STL_MS_TO_TICKS (10));
+	idle_task waiting (the_timer, time_ms (10));
+	waiting.set_next_run_time (time_stamp (far_away));
+
+	// Tasks with no interval, which are due and run every time they're scheduled
+	former_task former_running (0, 0);
+	idle_task running (the_timer, time_stamp (0UL));
+
+	printf ("Cost per call                    PC ns  register access cycles\n");
+	time_schedule<former_task, former_stamp> ("former schedule(), waiting", &former_waiting);
+	time_schedule<idle_task, time_stamp> ("schedule(), waiting", &waiting);
+	time_schedule<former_task, former_stamp> ("former schedule(), running", &former_running);
+	time_schedule<idle_task, time_stamp> ("schedule(), running", &running);
+	time_arithmetic<former_stamp> ("former stamp add and compare");
+	time_arithmetic<time_stamp> ("time_stamp add and compare");
+	printf ("(each register access is charged %u cycles; a waiting task now reads the "
+			"timer once,\n and the time stamp arithmetic is inline instead of being "
+			"called)\n\n", sim_access_cycles);
+
+	// Time stamps made from constants are worked out by the compiler
+	static_assert ((2_ms).get_raw_time () == 2 * STL_TICKS_PER_SEC / 1000,
+				   "2_ms isn't worked out while compiling");
+	static const time_stamp two_ms = 2_ms;
+	bool good = true;
+	good &= (two_ms.get_raw_time () == 2000UL * (F_CPU / 8000000UL));
+	good &= (250_us == time_stamp (0, 250));
+	good &= (1500_ms == time_stamp (1, 500000));
+	good &= (3_s == time_sec (3));
+	good &= (time_us (1000000UL) == 1_s);
+	good &= ((1_s).get_seconds () == 1 && (1_s + 20_us).get_microsec () == 20);
+	printf ("Time stamps from constants, 2_ms = %lu ticks                  %s\n",
+			(unsigned long)two_ms.get_raw_time (), good ? "ok" : "FAILED");
+
+	return (good ? 0 : 1);
+}
@@ -0,0 +1,389 @@
+//*************************************************************************************
+/** \file sd_bench.cpp
+ *    This program runs the SD card driver in sd_card.cpp, with FatFs, against the model
+ *    card in sd_model.h, which keeps its sectors in a disk image file. Lines of data
+ *    like a logger's are written two ways, and each is timed in simulated time:
+ *      \li through the line buffer and f_write(), as sd_card has always written them,
+ *          in a file made by open_new_data_file()
+ *      \li in streaming mode, to a file made by open_stream_file(), with
+ *          service_stream() called after each line as a logging task would call it
+ *    First the lines are written as fast as the driver will take them, which shows
+ *    the sustained bytes per second of each way. Then they're written at a fixed
+ *    sample rate, and the time each sample took to log is kept, which shows the
+ *    latency which logging adds to the task doing it. Every file is then read back
+ *    through FatFs and compared with what was written, byte for byte.
+ *
+ *    The SPI port runs at F_CPU / 8, 2 MHz, so no way of writing can go faster than
+ *    250,000 bytes per second. How long the model card takes to program blocks is set
+ *    in sd_model.cpp; a real card's times vary, and so will its results. Only the time
+ *    spent on the SPI port and waiting for the card is simulated, not the time taken
+ *    to format the numbers, so most samples which only fill a buffer take no time.
+ *
+ *    Usage: sd_bench [image]
+ *    The disk image is made in sd.img unless another name is given, and is left there
+ *    to be looked at.
+ *
+ *  Revisions:
+ *    \li 06-29-2011 Original file
+ *
+ *  License:
+ *    This file is released under the Lesser GNU Public License, version 2. This
+ *    program is intended for educational use only, but it is not limited thereto.
+ */
+//*************************************************************************************
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <avr/io.h>
+#include "sd_card.h"
+#include "sd_model.h"
+
+
+/// The size of the disk image, in sectors; 65536 of them make a 32 MB FAT16 volume
+#define BENCH_SECTORS		65536UL
+
+/// How many bytes are written as fast as they can be, in each way
+#define BENCH_FAST_BYTES	131072UL
+
+/// How many samples are written at the sample rate
+#define BENCH_SAMPLES		2000
+
+/// The time between samples at the sample rate, in microseconds
+#define BENCH_PERIOD_US		2000
+
+/// The most bytes which are written to one file
+#define BENCH_MAX_BYTES		(BENCH_FAST_BYTES + 1024)
+
+
+/// The model card, which the SPI port talks to
+static sd_card_model card;
+
+/// The text written to the file being written, kept to be checked against the file
+static char expected[BENCH_MAX_BYTES];
+
+/// The number of bytes in expected[]
+static uint32_t expected_length;
+
+
+//-------------------------------------------------------------------------------------
+/** This structure holds the results of writing one file.
+ */
+
+typedef struct
+{
+	const char* label;						///< A name for the way of writing
+	bool stream;							///< True for streaming mode
+	char name[16];							///< The file's name
+	uint32_t bytes;							///< Bytes of data written
+	double seconds;							///< Simulated time taken, including closing
+	uint32_t blocks_read;					///< Sectors the card sent
+	uint32_t blocks_written;				///< Sectors the card programmed
+	uint32_t commands;						///< Commands the card got
+	uint16_t stalls;						///< Times putchar() waited in streaming mode
+	uint32_t latency[BENCH_SAMPLES];		///< Time each sample took, in cycles
+	uint16_t samples;						///< Number of latencies kept
+} bench_run;
+
+
+//-------------------------------------------------------------------------------------
+/** This function plays the part of the SD card for one byte of an SPI transfer. The
+ *  card reads its own select pin, B0, rather than the encoder slave's.
+ *  @param mosi The byte sent by the master
+ *  @param selected Whether the encoder slave is selected, which is ignored
+ *  @return The byte which the master receives
+ */
+
+static uint8_t card_byte (uint8_t mosi, bool selected)
+{
+	return (card.spi_byte (mosi));
+}
+
+
+//-------------------------------------------------------------------------------------
+/** This function writes one line of data like a logger's, with a sample number and two
+ *  positions, and keeps a copy of the text.
+ *  @param sd The SD card
+ *  @param index The sample number
+ */
+
+static void log_sample (sd_card& sd, uint32_t index)
+{
+	long x = (long)((index * 7919UL) % 200000UL) - 100000L;
+	long y = (long)((index * 104729UL) % 60000UL);
+
+	sd << (long)index << "," << x << "," << y << endl;
+
+	int length = snprintf (expected + expected_length, BENCH_MAX_BYTES - expected_length,
+						   "%ld,%ld,%ld\r\n", (long)index, x, y);
+	expected_length += length;
+}
+
+
+//-------------------------------------------------------------------------------------
+/** This function opens a new file to be written one of the two ways.
+ *  @param sd The SD card
+ *  @param run The results, which say which way, and into which the name goes
+ *  @return True if the file was opened
+ */
+
+static bool open_run (sd_card& sd, bench_run& run)
+{
+	uint16_t number;
+	if (run.stream)
+	{
+		number = sd.open_stream_file ("/strm_", "csv", BENCH_MAX_BYTES);
+		snprintf (run.name, sizeof (run.name), "/strm_%03u.csv", number);
+	}
+	else
+	{
+		number = sd.open_new_data_file ("/line_", "csv");
+		snprintf (run.name, sizeof (run.name), "/line_%03u.csv", number);
+	}
+	expected_length = 0;
+	run.samples = 0;
+	card.clear_counts ();
+	return (number != 0xFFFF);
+}
+
+
+//-------------------------------------------------------------------------------------
+/** This function closes the file and keeps the counts from the card.
+ *  @param sd The SD card
+ *  @param run The results
+ *  @param start The time at which writing began, in cycles
+ *  @return True if the file was closed without an error
+ */
+
+static bool close_run (sd_card& sd, bench_run& run, uint64_t start)
+{
+	run.stalls = run.stream ? sd.get_stream_stalls () : 0;
+	bool good = (sd.get_stream_state () != SD_STREAM_ERROR);
+	good = (sd.close_file () == FR_OK) && good;
+	run.seconds = (double)(sim_cycles - start) / F_CPU;
+	run.bytes = expected_length;
+	run.blocks_read = card.get_blocks_read ();
+	run.blocks_written = card.get_blocks_written ();
+	run.commands = card.get_commands ();
+	return (good);
+}
+
+
+//-------------------------------------------------------------------------------------
+/** This function writes lines as fast as the driver takes them.
+ *  @param sd The SD card
+ *  @param run The results, which say which way to write
+ *  @return True if the file was written and closed without an error
+ */
+
+static bool run_flat_out (sd_card& sd, bench_run& run)
+{
+	if (!open_run (sd, run))
+	{
+		return (false);
+	}
+	uint64_t start = sim_cycles;
+	for (uint32_t index = 0; expected_length < BENCH_FAST_BYTES; index++)
+	{
+		log_sample (sd, index);
+		if (run.stream)
+		{
+			sd.service_stream ();
+		}
+	}
+	return (close_run (sd, run, start));
+}
+
+
+//-------------------------------------------------------------------------------------
+/** This function writes lines at the sample rate, keeping the time each one took.
+ *  @param sd The SD card
+ *  @param run The results, which say which way to write
+ *  @return True if the file was written and closed without an error
+ */
+
+static bool run_paced (sd_card& sd, bench_run& run)
+{
+	const uint64_t period = (uint64_t)BENCH_PERIOD_US * (F_CPU / 1000000UL);
+
+	if (!open_run (sd, run))
+	{
+		return (false);
+	}
+	uint64_t start = sim_cycles;
+	for (uint16_t index = 0; index < BENCH_SAMPLES; index++)
+	{
+		uint64_t sample_start = sim_cycles;
+		log_sample (sd, index);
+		if (run.stream)
+		{
+			sd.service_stream ();
+		}
+		uint64_t taken = sim_cycles - sample_start;
+		run.latency[run.samples++] = (uint32_t)taken;
+		if (taken < period)
+		{
+			sim_spend ((uint32_t)(period - taken));
+		}
+	}
+	return (close_run (sd, run, start));
+}
+
+
+//-------------------------------------------------------------------------------------
+/** This function reads a file back through FatFs and compares it with the text which
+ *  was written to it.
+ *  @param run The results, which hold the file's name
+ *  @return True if the file holds exactly the text which was written
+ */
+
+static bool check_file (bench_run& run)
+{
+	static char contents[BENCH_MAX_BYTES + 512];
+	FIL file;
+	UINT got = 0;
+
+	if (f_open (&file, run.name, FA_READ | FA_OPEN_EXISTING) != FR_OK)
+	{
+		return (false);
+	}
+	FRESULT result = f_read (&file, contents, sizeof (contents), &got);
+	f_close (&file);
+
+	return (result == FR_OK && got == expected_length
+			&& memcmp (contents, expected, expected_length) == 0);
+}
+
+
+//-------------------------------------------------------------------------------------
+/** This function compares two latencies, for qsort().
+ *  @param p_one A pointer to one latency
+ *  @param p_two A pointer to the other
+ *  @return Less than, equal to, or more than zero as the first is less, equal or more
+ */
+
+static int compare_latency (const void* p_one, const void* p_two)
+{
+	uint32_t one = *(const uint32_t*)p_one;
+	uint32_t two = *(const uint32_t*)p_two;
+	return ((one > two) - (one < two));
+}
+
+
+//-------------------------------------------------------------------------------------
+/** This function prints the latencies of a paced run.
+ *  @param run The results
+ *  @return The longest latency, in microseconds
+ */
+
+static double show_latency (bench_run& run)
+{
+	static uint32_t sorted[BENCH_SAMPLES];
+	const double us_per_cycle = 1.0E6 / F_CPU;
+
+	double sum = 0.0;
+	uint16_t over = 0;
+	for (uint16_t index = 0; index < run.samples; index++)
+	{
+		sorted[index] = run.latency[index];
+		sum += run.latency[index];
+		if (run.latency[index] * us_per_cycle > BENCH_PERIOD_US)
+		{
+			over++;
+		}
+	}
+	qsort (sorted, run.samples, sizeof (uint32_t), compare_latency);
+	double worst = sorted[run.samples - 1] * us_per_cycle;
+
+	printf ("%-22s  %8.1f  %8.1f  %8.1f  %8.1f  %6u  %6u\n", run.label,
+			sum / run.samples * us_per_cycle, sorted[run.samples / 2] * us_per_cycle,
+			sorted[run.samples * 99 / 100] * us_per_cycle, worst, over, run.stalls);
+	return (worst);
+}
+
+
+//-------------------------------------------------------------------------------------
+/** This function prints the throughput of a run.
+ *  @param run The results
+ */
+
+static void show_rate (bench_run& run)
+{
+	printf ("%-22s  %8lu  %7.3f  %8.0f  %6lu  %7lu  %8lu\n", run.label,
+			(unsigned long)run.bytes, run.seconds, run.bytes / run.seconds,
+			(unsigned long)run.blocks_read, (unsigned long)run.blocks_written,
+			(unsigned long)run.commands);
+}
+
+
+//-------------------------------------------------------------------------------------
+/** The main function makes the disk image, mounts it, writes the files, and shows and
+ *  checks the results.
+ */
+
+int main (int argc, char** argv)
+{
+	const char* image = (argc > 1) ? argv[1] : "sd.img";
+	static bench_run runs[4];
+	bool good = true;
+
+	if (!sd_card_model::format_image (image, BENCH_SECTORS) || !card.open_image (image))
+	{
+		printf ("Can't make the disk image %s\n", image);
+		return (1);
+	}
+	sim_set_spi_slave (card_byte);
+
+	sd_card sd;
+	FRESULT mounted = sd.mount (0);
+	printf ("Mounting a %lu MB FAT16 image: %s\n\n",
+			(unsigned long)(BENCH_SECTORS / 2048), mounted == FR_OK ? "ok" : "FAILED");
+	if (mounted != FR_OK)
+	{
+		return (1);
+	}
+
+	runs[0].label = "line buffer";
+	runs[1].label = "streaming";
+	runs[2].label = "line buffer";
+	runs[3].label = "streaming";
+	bool checked[4];
+	for (uint8_t which = 0; which < 4; which++)
+	{
+		runs[which].stream = (which & 1) != 0;
+		bool written = (which < 2) ? run_flat_out (sd, runs[which])
+								   : run_paced (sd, runs[which]);
+		checked[which] = written && check_file (runs[which]);
+		good &= checked[which];
+	}
+
+	printf ("flat out                   bytes  seconds   bytes/s    read  written  "
+			"commands\n");
+	show_rate (runs[0]);
+	show_rate (runs[1]);
+	bool faster = runs[1].bytes / runs[1].seconds > runs[0].bytes / runs[0].seconds;
+	printf ("streaming is faster: %s\n\n", faster ? "ok" : "FAILED");
+	good &= faster;
+
+	printf ("%u samples/s, us per sample  mean    median       99%%     worst    over"
+			"  stalls\n", 1000000 / BENCH_PERIOD_US);
+	double line_worst = show_latency (runs[2]);
+	double stream_worst = show_latency (runs[3]);
+	bool quicker = stream_worst < line_worst && stream_worst < BENCH_PERIOD_US
+				   && runs[3].stalls == 0;
+	printf ("streaming's worst sample is shorter and within the period: %s\n\n",
+			quicker ? "ok" : "FAILED");
+	good &= quicker;
+
+	printf ("Files read back and compared:\n");
+	for (uint8_t which = 0; which < 4; which++)
+	{
+		printf ("  %-14s %-12s %7lu bytes  %s\n", runs[which].name, runs[which].label,
+				(unsigned long)runs[which].bytes, checked[which] ? "ok" : "FAILED");
+	}
+
+	card.close_image ();
+	printf ("\n%s\n", good ? "All checks passed" : "Some checks FAILED");
+	return (good ? 0 : 1);
+}
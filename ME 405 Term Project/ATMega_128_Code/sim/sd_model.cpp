@@ -0,0 +1,663 @@
+//*************************************************************************************
+/** \file sd_model.cpp
+ *    This file contains the model of an SD card on the simulated SPI port which is
+ *    declared in sd_model.h.
+ *
+ *  Revisions:
+ *    \li 06-29-2011 Original file
+ *    \li 06-30-2011 Writes to a range of sectors, such as the FATs, can be counted
+ *
+ *  License:
+ *    This file is released under the Lesser GNU Public License, version 2. This
+ *    program is intended for educational use only, but it is not limited thereto.
+ */
+//*************************************************************************************
+
+#include <string.h>
+#include <unistd.h>
+#include <avr/io.h>
+#include "sd_model.h"
+
+
+/// The first byte of a command has these two bits set to 01
+#define SD_MODEL_START_MASK		0xC0
+
+/// An R1 response bit: the card is in the idle state
+#define SD_R1_IDLE				0x01
+
+/// An R1 response bit: the command isn't one the card knows
+#define SD_R1_ILLEGAL			0x04
+
+/// An R1 response bit: the argument, such as an address, is out of range
+#define SD_R1_PARAMETER			0x40
+
+/// The data response token for a block which was accepted
+#define SD_DATA_ACCEPTED		0x05
+
+/// The data response token for a block which couldn't be written
+#define SD_DATA_WRITE_ERROR		0x0D
+
+
+//-------------------------------------------------------------------------------------
+/** This constructor makes a card with no image; open_image() must be called before the
+ *  card can be used. The card starts in the state it's in just after power up.
+ */
+
+sd_card_model::sd_card_model (void)
+{
+	p_image = NULL;
+	sectors = 0;
+
+	timing.read_access = 250.0;
+	timing.write_single = 1500.0;
+	timing.write_multiple = 300.0;
+	timing.write_pause = 4000.0;
+	timing.pause_blocks = 64;
+	timing.stop = 500.0;
+
+	state = SD_MODEL_IDLE;
+	idle = true;
+	init_polls = 3;
+	app_command = false;
+	multiple = false;
+	address = 0;
+	blocks_in_write = 0;
+	command_count = 0;
+	reply_length = 0;
+	reply_index = 0;
+	busy_after_reply = 0;
+	block_length = 0;
+	block_index = 0;
+	ready_time = 0;
+	busy_until = 0;
+	watch_sectors (0, 0);
+	clear_counts ();
+}
+
+
+//-------------------------------------------------------------------------------------
+/** The destructor closes the image file, if one is open.
+ */
+
+sd_card_model::~sd_card_model (void)
+{
+	close_image ();
+}
+
+
+//-------------------------------------------------------------------------------------
+/** This method opens a disk image file to be the card's contents. The number of
+ *  sectors is worked out from the file's size.
+ *  @param path The name of the image file
+ *  @return True if the file was opened, false if it couldn't be or is too small
+ */
+
+bool sd_card_model::open_image (const char* path)
+{
+	close_image ();
+	p_image = fopen (path, "r+b");
+	if (p_image == NULL)
+	{
+		return (false);
+	}
+	fseek (p_image, 0L, SEEK_END);
+	sectors = (uint32_t)(ftell (p_image) / SD_MODEL_SECTOR);
+	if (sectors < 1024)
+	{
+		close_image ();
+		return (false);
+	}
+	return (true);
+}
+
+
+//-------------------------------------------------------------------------------------
+/** This method closes the image file, so that everything written to it is saved.
+ */
+
+void sd_card_model::close_image (void)
+{
+	if (p_image != NULL)
+	{
+		fclose (p_image);
+		p_image = NULL;
+	}
+	sectors = 0;
+}
+
+
+//-------------------------------------------------------------------------------------
+/** This function makes a disk image holding a blank FAT16 volume with no partition
+ *  table, as sd_card.h says cards should be formatted. There are two FATs and room for
+ *  512 entries in the root directory, and the clusters are as small as they can be
+ *  with no more than 65524 of them. The file is made sparse where it's all zeros.
+ *  @param path The name of the image file, which is replaced if it exists
+ *  @param num_sectors The size of the volume, which must be 8 MB to 1 GB
+ *  @return True if the image was made, false if not
+ */
+
+bool sd_card_model::format_image (const char* path, uint32_t num_sectors)
+{
+	const uint16_t root_entries = 512;
+	const uint16_t root_sectors = root_entries * 32 / SD_MODEL_SECTOR;
+	const uint16_t reserved = 1;
+
+	if (num_sectors < 16384UL || num_sectors > 2097152UL)
+	{
+		return (false);
+	}
+
+	// Find the smallest clusters which keep the count within FAT16's limit, then the
+	// size of a FAT holding two bytes for each cluster and the two reserved entries
+	uint8_t cluster_size = 1;
+	while ((num_sectors - reserved - root_sectors) / cluster_size > 65524UL)
+	{
+		cluster_size *= 2;
+	}
+	uint32_t fat_sectors = 1;
+	for (uint8_t pass = 0; pass < 4; pass++)
+	{
+		uint32_t clusters = (num_sectors - reserved - root_sectors - 2 * fat_sectors)
+							/ cluster_size;
+		fat_sectors = ((clusters + 2) * 2 + SD_MODEL_SECTOR - 1) / SD_MODEL_SECTOR;
+	}
+
+	FILE* p_file = fopen (path, "w+b");
+	if (p_file == NULL)
+	{
+		return (false);
+	}
+	bool good = (ftruncate (fileno (p_file), (off_t)num_sectors * SD_MODEL_SECTOR) == 0);
+
+	// The boot sector, with the BIOS parameter block which describes the volume
+	uint8_t sector[SD_MODEL_SECTOR];
+	memset (sector, 0, sizeof (sector));
+	const uint8_t jump[3] = {0xEB, 0x3C, 0x90};
+	memcpy (sector, jump, 3);
+	memcpy (sector + 3, "MSDOS5.0", 8);
+	sector[11] = (uint8_t)SD_MODEL_SECTOR;
+	sector[12] = (uint8_t)(SD_MODEL_SECTOR >> 8);
+	sector[13] = cluster_size;
+	sector[14] = (uint8_t)reserved;
+	sector[16] = 2;								// Number of FATs
+	sector[17] = (uint8_t)root_entries;
+	sector[18] = (uint8_t)(root_entries >> 8);
+	if (num_sectors < 0x10000UL)
+	{
+		sector[19] = (uint8_t)num_sectors;
+		sector[20] = (uint8_t)(num_sectors >> 8);
+	}
+	else
+	{
+		for (uint8_t index = 0; index < 4; index++)
+		{
+			sector[32 + index] = (uint8_t)(num_sectors >> (8 * index));
+		}
+	}
+	sector[21] = 0xF8;							// Media descriptor, fixed disk
+	sector[22] = (uint8_t)fat_sectors;
+	sector[23] = (uint8_t)(fat_sectors >> 8);
+	sector[24] = 63;							// Sectors per track, unused
+	sector[26] = 255;							// Heads, unused
+	sector[36] = 0x80;							// Drive number
+	sector[38] = 0x29;							// Extended boot signature
+	sector[39] = 0x05;							// Volume serial number
+	sector[40] = 0x04;
+	sector[41] = 0x29;
+	sector[42] = 0x11;
+	memcpy (sector + 43, "NO NAME    ", 11);
+	memcpy (sector + 54, "FAT16   ", 8);
+	sector[510] = 0x55;
+	sector[511] = 0xAA;
+	good = good && fwrite (sector, SD_MODEL_SECTOR, 1, p_file) == 1;
+
+	// Each FAT starts with the media descriptor and an end of chain mark
+	memset (sector, 0, sizeof (sector));
+	sector[0] = 0xF8;
+	sector[1] = 0xFF;
+	sector[2] = 0xFF;
+	sector[3] = 0xFF;
+	for (uint8_t fat = 0; fat < 2 && good; fat++)
+	{
+		good = fseek (p_file, (long)(reserved + fat * fat_sectors) * SD_MODEL_SECTOR,
+					  SEEK_SET) == 0
+			   && fwrite (sector, SD_MODEL_SECTOR, 1, p_file) == 1;
+	}
+
+	return (fclose (p_file) == 0 && good);
+}
+
+
+//-------------------------------------------------------------------------------------
+/** This method reads a sector from the image, without going through the SPI port.
+ *  @param sector The number of the sector
+ *  @param p_data A buffer of SD_MODEL_SECTOR bytes for the data
+ *  @return True if the sector was read, false if it's out of range or can't be read
+ */
+
+bool sd_card_model::read_sector (uint32_t sector, uint8_t* p_data)
+{
+	if (p_image == NULL || sector >= sectors)
+	{
+		return (false);
+	}
+	return (fseek (p_image, (long)sector * SD_MODEL_SECTOR, SEEK_SET) == 0
+			&& fread (p_data, SD_MODEL_SECTOR, 1, p_image) == 1);
+}
+
+
+//-------------------------------------------------------------------------------------
+/** This method writes a sector to the image, without going through the SPI port.
+ *  @param sector The number of the sector
+ *  @param p_data The SD_MODEL_SECTOR bytes to be written
+ *  @return True if the sector was written, false if it's out of range or can't be
+ */
+
+bool sd_card_model::write_sector (uint32_t sector, const uint8_t* p_data)
+{
+	if (p_image == NULL || sector >= sectors)
+	{
+		return (false);
+	}
+	return (fseek (p_image, (long)sector * SD_MODEL_SECTOR, SEEK_SET) == 0
+			&& fwrite (p_data, SD_MODEL_SECTOR, 1, p_image) == 1);
+}
+
+
+//-------------------------------------------------------------------------------------
+/** This method converts a time into CPU clock cycles.
+ *  @param microseconds The time in microseconds
+ *  @return The number of cycles
+ */
+
+uint64_t sd_card_model::cycles (double microseconds)
+{
+	return ((uint64_t)(microseconds * (F_CPU / 1.0E6)));
+}
+
+
+//-------------------------------------------------------------------------------------
+/** This method sets up a response to a command. The card waits one byte, as it may,
+ *  then sends the R1 byte and any more bytes of the response.
+ *  @param r1 The R1 response; the idle bit is put in if the card is still idle
+ *  @param p_extra A pointer to the bytes which follow R1, or NULL if there are none
+ *  @param extra The number of those bytes, up to 6
+ */
+
+void sd_card_model::respond (uint8_t r1, const uint8_t* p_extra, uint8_t extra)
+{
+	reply[0] = 0xFF;
+	reply[1] = r1 | (idle ? SD_R1_IDLE : 0);
+	if (p_extra != NULL)
+	{
+		memcpy (reply + 2, p_extra, extra);
+	}
+	reply_length = 2 + extra;
+	reply_index = 0;
+}
+
+
+//-------------------------------------------------------------------------------------
+/** This method gets a data block ready to be sent, with its start token in front and
+ *  a dummy CRC after it.
+ *  @param p_data The data
+ *  @param length The number of bytes, up to SD_MODEL_SECTOR
+ */
+
+void sd_card_model::load_block (const uint8_t* p_data, uint16_t length)
+{
+	block[0] = 0xFE;
+	memcpy (block + 1, p_data, length);
+	block[length + 1] = 0xFF;
+	block[length + 2] = 0xFF;
+	block_length = length + 3;
+	block_index = 0;
+	state = SD_MODEL_SEND;
+}
+
+
+//-------------------------------------------------------------------------------------
+/** This method reads the next sector to be sent from the image. The data token isn't
+ *  sent until the card has had time to find the sector.
+ *  @param sector The sector to be read
+ *  @return True if it was read, false if it's out of range
+ */
+
+bool sd_card_model::load_sector (uint32_t sector)
+{
+	uint8_t data[SD_MODEL_SECTOR];
+	if (!read_sector (sector, data))
+	{
+		return (false);
+	}
+	load_block (data, SD_MODEL_SECTOR);
+	ready_time = sim_cycles + cycles (timing.read_access);
+	blocks_read++;
+	return (true);
+}
+
+
+//-------------------------------------------------------------------------------------
+/** This method acts on a command once all six of its bytes have arrived. A command
+ *  which comes during a read stops it; CMD12 is the proper way to stop a multiple
+ *  block read, and it is answered after a stuff byte, as the driver expects.
+ */
+
+void sd_card_model::do_command (void)
+{
+	uint8_t index = command[0] & 0x3F;
+	uint32_t argument = ((uint32_t)command[1] << 24) | ((uint32_t)command[2] << 16)
+						| ((uint32_t)command[3] << 8) | command[4];
+	bool application = app_command;
+	app_command = false;
+	commands++;
+
+	if (state == SD_MODEL_SEND)
+	{
+		state = SD_MODEL_IDLE;
+		multiple = false;
+	}
+
+	switch (index)
+	{
+		case 0:								// GO_IDLE_STATE
+			idle = true;
+			init_polls = 3;
+			multiple = false;
+			state = SD_MODEL_IDLE;
+			respond (0);
+			break;
+
+		case 8:								// SEND_IF_COND, echoing voltage and check
+		{
+			uint8_t r7[4] = {0x00, 0x00, (uint8_t)((argument >> 8) & 0x0F),
+							 (uint8_t)argument};
+			respond (0, r7, 4);
+			break;
+		}
+
+		case 9:								// SEND_CSD, version 2.0 for high capacity
+		{
+			uint8_t csd[16];
+			memset (csd, 0, sizeof (csd));
+			uint32_t c_size = sectors / 1024 - 1;
+			csd[0] = 0x40;
+			csd[5] = 0x59;					// Classes of commands, 512 byte blocks
+			csd[7] = (uint8_t)((c_size >> 16) & 0x3F);
+			csd[8] = (uint8_t)(c_size >> 8);
+			csd[9] = (uint8_t)c_size;
+			csd[10] = 0x7F;					// Erase sector size
+			csd[15] = 0x01;
+			respond (0);
+			load_block (csd, 16);
+			ready_time = sim_cycles;
+			break;
+		}
+
+		case 10:							// SEND_CID
+		{
+			uint8_t cid[16] = {0x03, 'S', 'M', 'S', 'I', 'M', 'S', 'D', 0x10,
+							   0x12, 0x34, 0x56, 0x78, 0x00, 0xB6, 0x01};
+			respond (0);
+			load_block (cid, 16);
+			ready_time = sim_cycles;
+			break;
+		}
+
+		case 12:							// STOP_TRANSMISSION
+			multiple = false;
+			state = SD_MODEL_IDLE;
+			respond (0);
+			break;
+
+		case 13:							// SD_STATUS, as ACMD13
+			if (application)
+			{
+				uint8_t status[64];
+				memset (status, 0, sizeof (status));
+				status[10] = 0x90;			// Allocation unit of 4 MB
+				uint8_t r2 = 0x00;
+				respond (0, &r2, 1);
+				load_block (status, sizeof (status));
+				ready_time = sim_cycles;
+			}
+			else
+			{
+				respond (SD_R1_ILLEGAL);
+			}
+			break;
+
+		case 16:							// SET_BLOCKLEN, which must be a sector
+			respond (argument == SD_MODEL_SECTOR ? 0 : SD_R1_PARAMETER);
+			break;
+
+		case 17:							// READ_SINGLE_BLOCK
+		case 18:							// READ_MULTIPLE_BLOCK
+			if (idle || !load_sector (argument))
+			{
+				respond (idle ? SD_R1_ILLEGAL : SD_R1_PARAMETER);
+				break;
+			}
+			respond (0);
+			address = argument + 1;
+			multiple = (index == 18);
+			break;
+
+		case 23:							// SET_WR_BLK_ERASE_COUNT, as ACMD23
+			respond (application ? 0 : SD_R1_ILLEGAL);
+			break;
+
+		case 24:							// WRITE_BLOCK
+		case 25:							// WRITE_MULTIPLE_BLOCK
+			if (idle || argument >= sectors)
+			{
+				respond (idle ? SD_R1_ILLEGAL : SD_R1_PARAMETER);
+				break;
+			}
+			respond (0);
+			address = argument;
+			multiple = (index == 25);
+			blocks_in_write = 0;
+			state = SD_MODEL_TOKEN;
+			break;
+
+		case 41:							// SD_SEND_OP_COND, as ACMD41
+			if (!application)
+			{
+				respond (SD_R1_ILLEGAL);
+			}
+			else if (init_polls > 0)
+			{
+				init_polls--;
+				respond (0);
+			}
+			else
+			{
+				idle = false;
+				respond (0);
+			}
+			break;
+
+		case 55:							// APP_CMD
+			app_command = true;
+			respond (0);
+			break;
+
+		case 58:							// READ_OCR: powered up, high capacity
+		{
+			uint8_t ocr[4] = {0xC0, 0xFF, 0x80, 0x00};
+			respond (0, ocr, 4);
+			break;
+		}
+
+		default:
+			respond (SD_R1_ILLEGAL);
+			break;
+	}
+}
+
+
+//-------------------------------------------------------------------------------------
+/** This method takes one byte of a data block being written. When the block and its
+ *  CRC have arrived, the sector is written to the image and the card answers with a
+ *  data response, after which it's busy programming for a while.
+ *  @param mosi The byte from the master
+ */
+
+void sd_card_model::take_block_byte (uint8_t mosi)
+{
+	block[block_index++] = mosi;
+	if (block_index < SD_MODEL_SECTOR + 2)
+	{
+		return;
+	}
+
+	bool written = write_sector (address, block);
+	reply[0] = written ? SD_DATA_ACCEPTED : SD_DATA_WRITE_ERROR;
+	reply_length = 1;
+	reply_index = 0;
+	if (written)
+	{
+		if (address - watch_first < watch_count)
+		{
+			watched_writes++;
+		}
+		blocks_written++;
+		address++;
+	}
+
+	double program_time = timing.write_single;
+	if (multiple)
+	{
+		program_time = timing.write_multiple;
+		if (timing.pause_blocks != 0 && ++blocks_in_write % timing.pause_blocks == 0)
+		{
+			program_time += timing.write_pause;
+		}
+	}
+	busy_after_reply = cycles (program_time);
+
+	// A multiple block write goes on until the stop token, unless a block is refused
+	state = (multiple && written) ? SD_MODEL_TOKEN : SD_MODEL_IDLE;
+	if (!written)
+	{
+		multiple = false;
+	}
+}
+
+
+//-------------------------------------------------------------------------------------
+/** This method plays the part of the card for one byte shifted by the SPI port. While
+ *  the card isn't selected it ignores the bus, though it goes on programming, and a
+ *  multiple block write stays open so that other devices can use the bus between
+ *  blocks. While it's busy, it holds its output low.
+ *  @param mosi The byte sent by the master
+ *  @return The byte which the master receives
+ */
+
+uint8_t sd_card_model::spi_byte (uint8_t mosi)
+{
+	if (sim_peek (SIM_PORTB) & (1 << SD_MODEL_CS))
+	{
+		// A reply which was cut short is dropped, but not the programming after it; a
+		// read stops, and a block being written is lost
+		command_count = 0;
+		reply_length = 0;
+		reply_index = 0;
+		if (busy_after_reply != 0)
+		{
+			busy_until = sim_cycles + busy_after_reply;
+			busy_cycles += busy_after_reply;
+			busy_after_reply = 0;
+		}
+		if (state == SD_MODEL_SEND)
+		{
+			state = SD_MODEL_IDLE;
+			multiple = false;
+		}
+		else if (state == SD_MODEL_RECEIVE)
+		{
+			state = multiple ? SD_MODEL_TOKEN : SD_MODEL_IDLE;
+		}
+		return (0xFF);						// MISO is pulled up when not driven
+	}
+
+	// A command's bytes may start whenever the card isn't taking a data block
+	if (command_count > 0
+		|| (state != SD_MODEL_RECEIVE && (mosi & SD_MODEL_START_MASK) == 0x40
+			&& reply_index >= reply_length && sim_cycles >= busy_until))
+	{
+		command[command_count++] = mosi;
+		if (command_count == 6)
+		{
+			command_count = 0;
+			do_command ();
+		}
+		return (0xFF);
+	}
+
+	// Answer a command or a data block; when a data response has gone, start the busy
+	// time of programming the block
+	if (reply_index < reply_length)
+	{
+		uint8_t sent = reply[reply_index++];
+		if (reply_index == reply_length && busy_after_reply != 0)
+		{
+			busy_until = sim_cycles + busy_after_reply;
+			busy_cycles += busy_after_reply;
+			busy_after_reply = 0;
+		}
+		return (sent);
+	}
+
+	if (sim_cycles < busy_until)
+	{
+		return (0x00);
+	}
+
+	switch (state)
+	{
+		case SD_MODEL_SEND:
+			if (sim_cycles < ready_time)
+			{
+				return (0xFF);
+			}
+			if (block_index < block_length)
+			{
+				uint8_t sent = block[block_index++];
+				if (block_index == block_length)
+				{
+					state = SD_MODEL_IDLE;
+					if (multiple && !load_sector (address++))
+					{
+						multiple = false;
+					}
+				}
+				return (sent);
+			}
+			state = SD_MODEL_IDLE;
+			return (0xFF);
+
+		case SD_MODEL_TOKEN:
+			if ((mosi == 0xFE && !multiple) || (mosi == 0xFC && multiple))
+			{
+				block_index = 0;
+				state = SD_MODEL_RECEIVE;
+			}
+			else if (mosi == 0xFD && multiple)
+			{
+				multiple = false;
+				state = SD_MODEL_IDLE;
+				busy_until = sim_cycles + cycles (timing.stop);
+				busy_cycles += cycles (timing.stop);
+			}
+			return (0xFF);
+
+		case SD_MODEL_RECEIVE:
+			take_block_byte (mosi);
+			return (0xFF);
+
+		default:
+			return (0xFF);
+	}
+}
@@ -0,0 +1,172 @@
+//*************************************************************************************
+/** \file sd_model.h
+ *    This file declares a model of an SD card on the simulated SPI port, so that the
+ *    SD card driver in sd_card.cpp and the FatFs code in ff.c can be run on a PC. The
+ *    card's sectors are kept in a disk image file, which can be made with a blank FAT16
+ *    volume and looked at afterwards. The model speaks the SPI mode protocol as far as
+ *    the driver uses it: the commands which set up a version 2 high capacity card,
+ *    single and multiple block reads and writes, the stop token and CMD12, and the CSD,
+ *    CID, OCR and SD status registers.
+ *
+ *    The card is selected by pin B0, as set by SD_CS_PORT and SD_CS_MASK in sd_card.h.
+ *    While it programs a block it holds its data output low, and it takes time to find
+ *    a block to be read; these times are set with set_timing(). The defaults are made
+ *    up to be like those of an ordinary class 4 card; a real card may take far longer
+ *    now and then, as the SD specification allows up to 250 ms for a write.
+ *
+ *  Revisions:
+ *    \li 06-29-2011 Original file
+ *    \li 06-30-2011 Writes to a range of sectors, such as the FATs, can be counted
+ *
+ *  License:
+ *    This file is released under the Lesser GNU Public License, version 2. This
+ *    program is intended for educational use only, but it is not limited thereto.
+ */
+//*************************************************************************************
+
+/// This define prevents this .h file from being included more than once in a .cc file
+#ifndef _SD_MODEL_H_
+#define _SD_MODEL_H_
+
+#include <stdio.h>
+#include <stdint.h>
+
+
+/// The size of a sector of the card, in bytes
+#define SD_MODEL_SECTOR		512
+
+/// The bit in PORTB which selects the card when it's low
+#define SD_MODEL_CS			0
+
+
+//-------------------------------------------------------------------------------------
+/** This structure holds the times the model card takes to do things, in microseconds.
+ */
+
+typedef struct
+{
+	double read_access;						///< From a read command to the data
+	double write_single;					///< Programming a block written with CMD24
+	double write_multiple;					///< Programming a block of a multiple write
+	double write_pause;						///< Extra time every pause_blocks blocks
+	uint16_t pause_blocks;					///< How often a multiple write pauses
+	double stop;							///< Finishing after a stop token
+} sd_timing;
+
+
+//-------------------------------------------------------------------------------------
+/** This class models an SD card. spi_byte() is called for each byte the SPI port
+ *  shifts; it reads the card select pin, takes the byte the master sent, and returns
+ *  the byte the card sends back. Counts of the sectors read and written and of the
+ *  time spent busy are kept, so that the benches can show what the driver asked for.
+ */
+
+class sd_card_model
+{
+	protected:
+		/// The states of a transfer between commands
+		enum sd_model_state
+		{
+			SD_MODEL_IDLE,					///< Waiting for a command
+			SD_MODEL_SEND,					///< Sending a data block to the master
+			SD_MODEL_TOKEN,					///< Waiting for a write's data token
+			SD_MODEL_RECEIVE				///< Taking a data block from the master
+		};
+
+		FILE* p_image;						///< The disk image file
+		uint32_t sectors;					///< Number of sectors in the image
+		sd_timing timing;					///< How long things take
+
+		sd_model_state state;				///< What the card is doing
+		bool idle;							///< True until ACMD41 has finished
+		uint8_t init_polls;					///< Times ACMD41 answers "still idle"
+		bool app_command;					///< True if CMD55 came just before
+		bool multiple;						///< True in a multiple block read or write
+		uint32_t address;					///< The next sector to be read or written
+		uint32_t blocks_in_write;			///< Blocks so far in this multiple write
+
+		uint8_t command[6];					///< The command being received
+		uint8_t command_count;				///< Bytes of the command received
+		uint8_t reply[8];					///< Response bytes waiting to be sent
+		uint8_t reply_length;				///< Number of bytes in reply
+		uint8_t reply_index;				///< The next reply byte to be sent
+		uint64_t busy_after_reply;			///< Busy time to start after the reply
+
+		uint8_t block[SD_MODEL_SECTOR + 3];	///< A data block with its token and CRC
+		uint16_t block_length;				///< Bytes in the block being sent
+		uint16_t block_index;				///< The next byte of the block
+		uint64_t ready_time;				///< When the block to be read is found
+		uint64_t busy_until;				///< When programming will have finished
+
+		uint32_t blocks_read;				///< Sectors sent to the master
+		uint32_t blocks_written;			///< Sectors written by the master
+		uint32_t commands;					///< Commands received
+		uint64_t busy_cycles;				///< Total time spent programming
+		uint32_t watch_first;				///< First sector whose writes are counted
+		uint32_t watch_count;				///< Number of sectors watched
+		uint32_t watched_writes;			///< Writes to the watched sectors
+
+		void respond (uint8_t r1, const uint8_t* p_extra = NULL, uint8_t extra = 0);
+		void load_block (const uint8_t* p_data, uint16_t length);
+		bool load_sector (uint32_t sector);
+		void do_command (void);
+		void take_block_byte (uint8_t mosi);
+		uint64_t cycles (double microseconds);
+
+	public:
+		sd_card_model (void);
+		~sd_card_model (void);
+
+		bool open_image (const char* path);
+		void close_image (void);
+		static bool format_image (const char* path, uint32_t num_sectors);
+
+		bool read_sector (uint32_t sector, uint8_t* p_data);
+		bool write_sector (uint32_t sector, const uint8_t* p_data);
+
+		uint8_t spi_byte (uint8_t mosi);
+
+		/// This method sets the times the card takes @param new_timing The times
+		void set_timing (const sd_timing& new_timing) { timing = new_timing; }
+
+		/// This method returns the number of sectors in the image
+		uint32_t get_sectors (void) { return (sectors); }
+
+		/// This method returns the number of sectors the master has read
+		uint32_t get_blocks_read (void) { return (blocks_read); }
+
+		/// This method returns the number of sectors the master has written
+		uint32_t get_blocks_written (void) { return (blocks_written); }
+
+		/// This method returns the number of commands the master has sent
+		uint32_t get_commands (void) { return (commands); }
+
+		/// This method returns the total time the card was busy, in CPU cycles
+		uint64_t get_busy_cycles (void) { return (busy_cycles); }
+
+		/** This method sets a range of sectors whose writes are counted, such as the
+		 *  FATs, so that a bench can see when the filesystem writes to them.
+		 *  @param first The first sector in the range
+		 *  @param count The number of sectors, or 0 to watch none
+		 */
+		void watch_sectors (uint32_t first, uint32_t count)
+		{
+			watch_first = first;
+			watch_count = count;
+			watched_writes = 0;
+		}
+
+		/// This method returns the number of writes to the watched sectors
+		uint32_t get_watched_writes (void) { return (watched_writes); }
+
+		/// This method sets the counts of sectors, commands and busy time to zero
+		void clear_counts (void)
+		{
+			blocks_read = 0;
+			blocks_written = 0;
+			commands = 0;
+			busy_cycles = 0;
+		}
+};
+
+#endif // _SD_MODEL_H_
@@ -0,0 +1,105 @@
+//*************************************************************************************
+/** \file servo_bench.cpp
+ *    This program checks the length of the pen servo's pulses on pin OC3A, using the
+ *    simulated processor in sim_avr.cpp. The servo in servo.cpp shares Timer 3 with the
+ *    task timer and makes each pulse with two compare matches. Before that, Timer 3 ran
+ *    in 8-bit fast PWM at clk/1024 for the servo alone, which held the pin high for
+ *    (OCR3AL + 1) * 64 us, and the pen heights were chosen with that timing; so each
+ *    height, and each of the widths and angles the servo can be given, must still make
+ *    a pulse of that length. Each pulse is measured after the servo has had time to
+ *    pick up the new length. A line is printed for each check, and the program exits
+ *    with status 1 if any check fails.
+ *
+ *  Revisions:
+ *    \li 06-30-2011 Original file
+ *
+ *  License:
+ *    This file is released under the Lesser GNU Public License, version 2. This
+ *    program is intended for educational use only, but it is not limited thereto.
+ */
+//*************************************************************************************
+
+#include <stdio.h>
+#include <avr/io.h>
+#include <avr/interrupt.h>
+#include "sim_avr.h"
+#include "sim_serial.h"
+#include "stl_timer.h"
+#include "servo.h"
+
+
+/// Clock cycles in one microsecond of simulated time
+#define CYCLES_PER_US		(F_CPU / 1000000UL)
+
+/// How long the servo is given to pick up a new length, two frames, in microseconds
+#define BENCH_SETTLE_US		40000UL
+
+
+/// This counts the checks which have failed
+static int failures = 0;
+
+
+//-------------------------------------------------------------------------------------
+/** This function lets two frames go by and checks the length of the last pulse
+ *  against the one the former fast PWM mode made for the same number in OCR3AL.
+ *  @param p_what A description of what the servo was told
+ *  @param ocr3al The number the former code would have put in OCR3AL
+ */
+
+static void check_pulse (const char* p_what, uint8_t ocr3al)
+{
+	sim_spend (BENCH_SETTLE_US * CYCLES_PER_US);
+	double measured = sim_oc3a_pulse () * 1.0E6;
+	double expected = (ocr3al + 1) * 64.0;
+
+	// The pulse is timed in counts of half a microsecond
+	bool passed = (measured > expected - 0.25 && measured < expected + 0.25);
+	printf ("  %-24s %3u  %8.1f  %8.1f  %s\n", p_what, ocr3al, expected, measured,
+			passed ? "ok" : "FAILED");
+	if (!passed)
+	{
+		failures++;
+	}
+}
+
+
+//-------------------------------------------------------------------------------------
+/** The main function sets up the task timer and the servo, then gives the servo each
+ *  pen height, some widths and some angles, checking each pulse.
+ */
+
+int main (void)
+{
+	sim_serial quiet (NULL);
+	task_timer the_timer;
+	servo pen (&quiet);
+	sei ();
+
+	printf ("OC3A pulses, us          OCR3AL  expected  measured\n");
+	check_pulse ("after the constructor", 5);
+	pen.Pen_Up ();
+	check_pulse ("Pen_Up ()", 7);
+	pen.Heavy_Line ();
+	check_pulse ("Heavy_Line ()", 11);
+	pen.Fine_Line ();
+	check_pulse ("Fine_Line ()", 20);
+	pen.Change_Pen ();
+	check_pulse ("Change_Pen ()", 5);
+	pen.Set_Pulse (0);
+	check_pulse ("Set_Pulse (0)", 0);
+	pen.Set_Pulse (255);
+	check_pulse ("Set_Pulse (255)", 255);
+
+	// The former Set_Angle() put the same number in OCR3AL as it gives Set_Pulse()
+	const uint16_t angles[] = {0, 2, 90, 180, 360};
+	for (uint8_t index = 0; index < sizeof (angles) / sizeof (angles[0]); index++)
+	{
+		char what[32];
+		snprintf (what, sizeof (what), "Set_Angle (%u)", angles[index]);
+		pen.Set_Angle (angles[index]);
+		check_pulse (what, (uint8_t)angles[index] * 255 / 720);
+	}
+
+	printf ("\n%s\n", failures == 0 ? "All checks passed" : "Some checks FAILED");
+	return (failures == 0 ? 0 : 1);
+}
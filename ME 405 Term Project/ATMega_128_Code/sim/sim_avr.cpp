@@ -0,0 +1,1271 @@
+//*************************************************************************************
+/** \file sim_avr.cpp
+ *    This file contains the simulated ATmega1281 register layer declared in sim_avr.h.
+ *    Register values are kept in an array. Each access first lets time pass by
+ *    sim_access_cycles, running any timer, SPI, and plant events which fall due, then
+ *    reads or writes the register and acts on it, and then calls the service routines
+ *    of any interrupts which are pending and enabled, in the AVR's order of priority.
+ *
+ *    The timers are worked out from the clock rather than counted tick by tick: each
+ *    remembers the cycle and count at which it was last set up, so its count at any time
+ *    and the time of its next overflow or compare match can be calculated. That keeps
+ *    the simulator fast enough to run a plot many times faster than real time.
+ *
+ *  Revisions:
+ *    \li 06-17-2011 Original file
+ *    \li 06-25-2011 sim_spend() charges time for code which doesn't touch registers
+ *    \li 06-29-2011 The USARTs send and receive characters at their baud rates
+ *    \li 06-29-2011 Timer 1 counts, and the SPI port can be a slave
+ *    \li 06-29-2011 Pin changes on ports A and C flag pin change interrupts
+ *
+ *  License:
+ *    This file is released under the Lesser GNU Public License, version 2. This
+ *    program is intended for educational use only, but it is not limited thereto.
+ */
+//*************************************************************************************
+
+#include <stdio.h>
+#include <stdarg.h>
+#include <stdlib.h>
+#include <math.h>
+#include <avr/io.h>
+#include <avr/interrupt.h>
+
+#ifndef F_CPU
+	#error F_CPU must be set to the simulated clock rate, as in the Makefile
+#endif
+
+/// A time so far in the future that it means an event won't happen
+#define SIM_NEVER			0xFFFFFFFFFFFFFFFFULL
+
+/// The interrupt enable bit in the status register
+#define SIM_SREG_I			(1 << SREG_I)
+
+
+//-------------------------------------------------------------------------------------
+// The registers
+
+uint64_t sim_cycles = 0;
+uint16_t sim_access_cycles = 16;
+
+/// The stored values of the registers; some are worked out when they're read instead
+static uint16_t reg_values[SIM_NUM_REGS];
+
+sim_register<uint8_t> sim_reg_SREG (SIM_SREG);
+sim_register<uint8_t> sim_reg_SPCR (SIM_SPCR);
+sim_register<uint8_t> sim_reg_SPSR (SIM_SPSR);
+sim_register<uint8_t> sim_reg_SPDR (SIM_SPDR);
+sim_register<uint8_t> sim_reg_DDRA (SIM_DDRA);
+sim_register<uint8_t> sim_reg_DDRB (SIM_DDRB);
+sim_register<uint8_t> sim_reg_DDRC (SIM_DDRC);
+sim_register<uint8_t> sim_reg_DDRD (SIM_DDRD);
+sim_register<uint8_t> sim_reg_DDRE (SIM_DDRE);
+sim_register<uint8_t> sim_reg_PORTA (SIM_PORTA);
+sim_register<uint8_t> sim_reg_PORTB (SIM_PORTB);
+sim_register<uint8_t> sim_reg_PORTC (SIM_PORTC);
+sim_register<uint8_t> sim_reg_PORTD (SIM_PORTD);
+sim_register<uint8_t> sim_reg_PORTE (SIM_PORTE);
+sim_register<uint8_t> sim_reg_PINA (SIM_PINA);
+sim_register<uint8_t> sim_reg_PINB (SIM_PINB);
+sim_register<uint8_t> sim_reg_PINC (SIM_PINC);
+sim_register<uint8_t> sim_reg_PIND (SIM_PIND);
+sim_register<uint8_t> sim_reg_PINE (SIM_PINE);
+sim_register<uint8_t> sim_reg_TCCR1A (SIM_TCCR1A);
+sim_register<uint8_t> sim_reg_TCCR1B (SIM_TCCR1B);
+sim_register<uint16_t> sim_reg_TCNT1 (SIM_TCNT1);
+sim_register<uint8_t> sim_reg_OCR1AL (SIM_OCR1AL);
+sim_register<uint8_t> sim_reg_OCR1BL (SIM_OCR1BL);
+sim_register<uint8_t> sim_reg_TIMSK1 (SIM_TIMSK1);
+sim_register<uint8_t> sim_reg_TIFR1 (SIM_TIFR1);
+sim_register<uint8_t> sim_reg_TCCR2A (SIM_TCCR2A);
+sim_register<uint8_t> sim_reg_TCCR2B (SIM_TCCR2B);
+sim_register<uint8_t> sim_reg_TCNT2 (SIM_TCNT2);
+sim_register<uint8_t> sim_reg_OCR2A (SIM_OCR2A);
+sim_register<uint8_t> sim_reg_TIMSK2 (SIM_TIMSK2);
+sim_register<uint8_t> sim_reg_TIFR2 (SIM_TIFR2);
+sim_register<uint8_t> sim_reg_TCCR3A (SIM_TCCR3A);
+sim_register<uint8_t> sim_reg_TCCR3B (SIM_TCCR3B);
+sim_register<uint16_t> sim_reg_TCNT3 (SIM_TCNT3);
+sim_register<uint16_t> sim_reg_OCR3A (SIM_OCR3A);
+sim_register<uint16_t> sim_reg_OCR3C (SIM_OCR3C);
+sim_register<uint8_t> sim_reg_TIMSK3 (SIM_TIMSK3);
+sim_register<uint8_t> sim_reg_TIFR3 (SIM_TIFR3);
+sim_register<uint8_t> sim_reg_EIMSK (SIM_EIMSK);
+sim_register<uint8_t> sim_reg_EICRB (SIM_EICRB);
+sim_register<uint8_t> sim_reg_EIFR (SIM_EIFR);
+sim_register<uint8_t> sim_reg_PCICR (SIM_PCICR);
+sim_register<uint8_t> sim_reg_PCIFR (SIM_PCIFR);
+sim_register<uint8_t> sim_reg_PCMSK0 (SIM_PCMSK0);
+sim_register<uint8_t> sim_reg_PCMSK2 (SIM_PCMSK2);
+sim_register<uint8_t> sim_reg_SMCR (SIM_SMCR);
+sim_register<uint8_t> sim_reg_UCSR0A (SIM_UCSR0A);
+sim_register<uint8_t> sim_reg_UCSR0B (SIM_UCSR0B);
+sim_register<uint8_t> sim_reg_UCSR0C (SIM_UCSR0C);
+sim_register<uint8_t> sim_reg_UBRR0L (SIM_UBRR0L);
+sim_register<uint8_t> sim_reg_UBRR0H (SIM_UBRR0H);
+sim_register<uint8_t> sim_reg_UDR0 (SIM_UDR0);
+sim_register<uint8_t> sim_reg_UCSR1A (SIM_UCSR1A);
+sim_register<uint8_t> sim_reg_UCSR1B (SIM_UCSR1B);
+sim_register<uint8_t> sim_reg_UCSR1C (SIM_UCSR1C);
+sim_register<uint8_t> sim_reg_UBRR1L (SIM_UBRR1L);
+sim_register<uint8_t> sim_reg_UBRR1H (SIM_UBRR1H);
+sim_register<uint8_t> sim_reg_UDR1 (SIM_UDR1);
+
+/** This function sets the registers which aren't zero when the AVR is reset. It's run
+ *  when the program starts, as the registers are constructed.
+ *  @return True, so that it can set up a static variable
+ */
+static bool reset_registers (void)
+{
+	reg_values[SIM_UCSR0A] = (1 << UDRE0);
+	reg_values[SIM_UCSR0C] = (1 << UCSZ01) | (1 << UCSZ00);
+	reg_values[SIM_UCSR1A] = (1 << UDRE1);
+	reg_values[SIM_UCSR1C] = (1 << UCSZ11) | (1 << UCSZ10);
+	return (true);
+}
+
+/// This is set up by calling reset_registers() before main() runs
+static bool registers_reset = reset_registers ();
+
+
+//-------------------------------------------------------------------------------------
+// Interrupt vectors which the program doesn't supply do nothing, as a bad interrupt
+// would on the AVR if it were enabled, except that there's no reset
+
+extern "C" void __attribute__ ((weak)) sim_vector_INT4 (void) { }
+extern "C" void __attribute__ ((weak)) sim_vector_INT5 (void) { }
+extern "C" void __attribute__ ((weak)) sim_vector_PCINT0 (void) { }
+extern "C" void __attribute__ ((weak)) sim_vector_PCINT2 (void) { }
+extern "C" void __attribute__ ((weak)) sim_vector_TIMER2_COMPA (void) { }
+extern "C" void __attribute__ ((weak)) sim_vector_TIMER1_OVF (void) { }
+extern "C" void __attribute__ ((weak)) sim_vector_SPI_STC (void) { }
+extern "C" void __attribute__ ((weak)) sim_vector_TIMER3_COMPA (void) { }
+extern "C" void __attribute__ ((weak)) sim_vector_TIMER3_COMPC (void) { }
+extern "C" void __attribute__ ((weak)) sim_vector_TIMER3_OVF (void) { }
+extern "C" void __attribute__ ((weak)) sim_vector_USART0_RX (void) { }
+extern "C" void __attribute__ ((weak)) sim_vector_USART0_UDRE (void) { }
+extern "C" void __attribute__ ((weak)) sim_vector_USART1_RX (void) { }
+extern "C" void __attribute__ ((weak)) sim_vector_USART1_UDRE (void) { }
+
+/** This structure describes one interrupt: the register and bit holding its flag, the
+ *  register and bit which enable it, and the service routine. Most flags are cleared
+ *  when the service routine is called; the USARTs' flags instead stay set until the
+ *  routine has read or filled the data register.
+ */
+typedef struct
+{
+	uint8_t flag_reg;						///< Register holding the interrupt flag
+	uint8_t flag_bit;						///< Bit number of the flag
+	uint8_t enable_reg;						///< Register holding the enable bit
+	uint8_t enable_bit;						///< Bit number of the enable
+	void (*p_vector)(void);					///< The interrupt service routine
+	bool cleared;							///< True if calling the routine clears the flag
+} sim_interrupt;
+
+/// The modelled interrupts, in the ATmega1281's order of priority
+static const sim_interrupt interrupts[] =
+{
+	{ SIM_EIFR, INTF4, SIM_EIMSK, INT4, sim_vector_INT4, true },
+	{ SIM_EIFR, INTF5, SIM_EIMSK, INT5, sim_vector_INT5, true },
+	{ SIM_PCIFR, PCIF0, SIM_PCICR, PCIE0, sim_vector_PCINT0, true },
+	{ SIM_PCIFR, PCIF2, SIM_PCICR, PCIE2, sim_vector_PCINT2, true },
+	{ SIM_TIFR2, OCF2A, SIM_TIMSK2, OCIE2A, sim_vector_TIMER2_COMPA, true },
+	{ SIM_TIFR1, TOV1, SIM_TIMSK1, TOIE1, sim_vector_TIMER1_OVF, true },
+	{ SIM_SPSR, SPIF, SIM_SPCR, SPIE, sim_vector_SPI_STC, true },
+	{ SIM_UCSR0A, RXC0, SIM_UCSR0B, RXCIE0, sim_vector_USART0_RX, false },
+	{ SIM_UCSR0A, UDRE0, SIM_UCSR0B, UDRIE0, sim_vector_USART0_UDRE, false },
+	{ SIM_TIFR3, OCF3A, SIM_TIMSK3, OCIE3A, sim_vector_TIMER3_COMPA, true },
+	{ SIM_TIFR3, OCF3C, SIM_TIMSK3, OCIE3C, sim_vector_TIMER3_COMPC, true },
+	{ SIM_TIFR3, TOV3, SIM_TIMSK3, TOIE3, sim_vector_TIMER3_OVF, true },
+	{ SIM_UCSR1A, RXC1, SIM_UCSR1B, RXCIE1, sim_vector_USART1_RX, false },
+	{ SIM_UCSR1A, UDRE1, SIM_UCSR1B, UDRIE1, sim_vector_USART1_UDRE, false },
+};
+
+/// Number of entries in the interrupt table
+#define SIM_NUM_INTERRUPTS	(sizeof (interrupts) / sizeof (interrupts[0]))
+
+
+//-------------------------------------------------------------------------------------
+/** This structure holds what's needed to work out a timer's count at any time. The
+ *  timer counts from zero up to its top value, then starts again at zero.
+ */
+typedef struct
+{
+	uint32_t prescale;						///< CPU cycles per count, or 0 if stopped
+	uint32_t top;							///< Highest count before it wraps to zero
+	uint64_t base_cycle;					///< The time at which it was last set up
+	uint64_t base_count;					///< The number of counts at base_cycle
+} sim_timer;
+
+static sim_timer timer_1;					///< Timer 1, the PWM or the slave's clock
+static sim_timer timer_2;					///< Timer 2, which times the SPI gaps
+static sim_timer timer_3;					///< Timer 3, the task timer
+
+/// Prescale and top value of Timer 3 last reported, so changes can be pointed out
+static uint32_t timer_3_shown_prescale = 0;
+static uint32_t timer_3_shown_top = 0;
+
+/** This function works out how many counts a timer has made since the simulation
+ *  began, which doesn't wrap.
+ *  @param timer The timer
+ *  @return The number of counts
+ */
+static uint64_t timer_total (const sim_timer& timer)
+{
+	if (timer.prescale == 0)
+	{
+		return (timer.base_count);
+	}
+	return (timer.base_count + (sim_cycles - timer.base_cycle) / timer.prescale);
+}
+
+/** This function works out the value in a timer's count register now.
+ *  @param timer The timer
+ *  @return The count
+ */
+static uint16_t timer_count (const sim_timer& timer)
+{
+	return ((uint16_t)(timer_total (timer) % ((uint64_t)timer.top + 1)));
+}
+
+/** This function restarts a timer's bookkeeping from the present time, with a given
+ *  count, clock prescaler, and top value.
+ *  @param timer The timer
+ *  @param count The count it has now
+ *  @param prescale The number of CPU cycles per count, or 0 if it's stopped
+ *  @param top The count after which it wraps to zero
+ */
+static void timer_restart (sim_timer& timer, uint16_t count, uint32_t prescale,
+						   uint32_t top)
+{
+	timer.base_cycle = sim_cycles;
+	timer.base_count = (count > top) ? 0 : count;
+	timer.prescale = prescale;
+	timer.top = top;
+}
+
+/** This function finds the time at which a timer's count next becomes a given value,
+ *  as it does when it overflows to zero or reaches a compare match.
+ *  @param timer The timer
+ *  @param match The count being waited for
+ *  @return The cycle at which the count changes to that value, or SIM_NEVER
+ */
+static uint64_t timer_next (const sim_timer& timer, uint32_t match)
+{
+	if (timer.prescale == 0 || match > timer.top)
+	{
+		return (SIM_NEVER);
+	}
+	uint64_t period = (uint64_t)timer.top + 1;
+	uint64_t total = timer_total (timer);
+	uint64_t when = total - (total % period) + match;
+	if (when <= total)
+	{
+		when += period;
+	}
+	return (timer.base_cycle + (when - timer.base_count) * timer.prescale);
+}
+
+/** This function tells whether a timer's count has just changed to a given value, at
+ *  the present cycle, so that the overflow or compare match event is due now.
+ *  @param timer The timer
+ *  @param match The count which makes the event happen
+ *  @return True if the count became that value at this cycle
+ */
+static bool timer_due (const sim_timer& timer, uint32_t match)
+{
+	return (timer.prescale != 0 && sim_cycles != timer.base_cycle
+			&& (sim_cycles - timer.base_cycle) % timer.prescale == 0
+			&& timer_count (timer) == match);
+}
+
+/** This function sets up Timer 1 from its control registers. As with Timer 3, its top
+ *  value is 0xFFFF in normal mode and 0xFF in the 8-bit PWM modes used for the motors;
+ *  the PWM outputs themselves are read from the compare registers by the plant model.
+ *  @param count The count the timer has now
+ */
+static void timer_1_setup (uint16_t count)
+{
+	static const uint16_t prescales[8] = { 0, 1, 8, 64, 256, 1024, 0, 0 };
+
+	uint8_t mode = (reg_values[SIM_TCCR1A] & 0x03) | ((reg_values[SIM_TCCR1B] & 0x18) >> 1);
+	uint32_t top = 0xFFFF;
+	if (mode == 1 || mode == 5)
+	{
+		top = 0xFF;
+	}
+	else if (mode != 0)
+	{
+		sim_warn ("Timer 1 mode %u isn't simulated; counting to 65535\n", mode);
+	}
+	uint8_t clock = reg_values[SIM_TCCR1B] & 0x07;
+	if (clock >= 6)
+	{
+		sim_warn ("Timer 1 is clocked from pin T1, which isn't simulated; it's stopped\n");
+	}
+	if (prescales[clock] != timer_1.prescale || top != timer_1.top
+		|| count != timer_count (timer_1))
+	{
+		timer_restart (timer_1, count, prescales[clock], top);
+	}
+}
+
+/** This function sets up Timer 2 from its control registers. Only normal and clear on
+ *  compare match modes are modelled.
+ */
+static void timer_2_setup (void)
+{
+	static const uint16_t prescales[8] = { 0, 1, 8, 32, 64, 128, 256, 1024 };
+
+	uint8_t mode = (reg_values[SIM_TCCR2A] & 0x03) | ((reg_values[SIM_TCCR2B] & 0x08) >> 1);
+	uint32_t top = 0xFF;
+	if (mode == 2)
+	{
+		top = reg_values[SIM_OCR2A];
+	}
+	else if (mode != 0)
+	{
+		sim_warn ("Timer 2 mode %u isn't simulated; counting to 255\n", mode);
+	}
+	timer_restart (timer_2, timer_count (timer_2), prescales[reg_values[SIM_TCCR2B] & 0x07],
+				   top);
+}
+
+/** This function sets up Timer 3 from its control registers. Its top value is 0xFFFF
+ *  in normal mode and 0xFF in the 8-bit PWM modes; the other modes aren't modelled.
+ *  @param count The count the timer has now
+ */
+static void timer_3_setup (uint16_t count)
+{
+	static const uint16_t prescales[8] = { 0, 1, 8, 64, 256, 1024, 0, 0 };
+
+	uint8_t mode = (reg_values[SIM_TCCR3A] & 0x03) | ((reg_values[SIM_TCCR3B] & 0x18) >> 1);
+	uint32_t top = 0xFFFF;
+	if (mode == 1 || mode == 5)
+	{
+		top = 0xFF;
+	}
+	else if (mode != 0)
+	{
+		sim_warn ("Timer 3 mode %u isn't simulated; counting to 65535\n", mode);
+	}
+	uint8_t clock = reg_values[SIM_TCCR3B] & 0x07;
+	if (clock >= 6)
+	{
+		sim_warn ("Timer 3 is clocked from pin T3, which isn't simulated; it's stopped\n");
+	}
+	// Changing only the compare output bits, as the servo's interrupt does, mustn't
+	// disturb the count
+	if (prescales[clock] != timer_3.prescale || top != timer_3.top
+		|| count != timer_count (timer_3))
+	{
+		timer_restart (timer_3, count, prescales[clock], top);
+	}
+}
+
+/** This function prints a note when Timer 3's rate or range has changed since it was
+ *  last reported. It's called when some other register is used, so the steps of a
+ *  change made one bit at a time aren't each reported.
+ */
+static void timer_3_report (void)
+{
+	if (timer_3.prescale != timer_3_shown_prescale || timer_3.top != timer_3_shown_top)
+	{
+		timer_3_shown_prescale = timer_3.prescale;
+		timer_3_shown_top = timer_3.top;
+		if (timer_3.prescale == 0)
+		{
+			fprintf (stderr, "sim: %.6f s: Timer 3 stopped\n", sim_seconds ());
+		}
+		else
+		{
+			fprintf (stderr, "sim: %.6f s: Timer 3 counts 0 to %lu at F_CPU / %lu, "
+					 "overflowing every %.3f ms\n", sim_seconds (),
+					 (unsigned long)timer_3.top, (unsigned long)timer_3.prescale,
+					 1000.0 * (timer_3.top + 1.0) * timer_3.prescale / F_CPU);
+		}
+	}
+}
+
+
+//-------------------------------------------------------------------------------------
+// The SPI port. As a master it shifts bytes to a slave model at the rate set by its
+// clock divider; as a slave, the simulation program plays the master and shifts each
+// byte in with sim_spi_transfer()
+
+/// The function which plays the part of the slave, or NULL if there's none
+static uint8_t (*p_spi_slave)(uint8_t mosi, bool selected) = NULL;
+
+static bool spi_busy = false;				///< True while a byte is being shifted
+static uint64_t spi_done = SIM_NEVER;		///< When the byte being shifted will be done
+static uint8_t spi_sent = 0;				///< The byte being sent
+static uint8_t spi_received = 0;			///< The last byte received
+static uint8_t spi_reply = 0;				///< The byte a slave shifts out next
+static bool spif_seen = false;				///< True if SPSR was read with SPIF set
+
+/** This function starts shifting a byte out of the SPI port, if it's set up as master.
+ *  A slave only loads the byte, which goes out when the master next shifts one in.
+ *  @param data The byte to send
+ */
+static void spi_start (uint8_t data)
+{
+	static const uint8_t dividers[4] = { 4, 16, 64, 128 };
+
+	uint8_t control = reg_values[SIM_SPCR];
+	if (!(control & (1 << SPE)))
+	{
+		sim_warn ("SPDR written while the SPI port isn't enabled; ignored\n");
+		return;
+	}
+	if (!(control & (1 << MSTR)))
+	{
+		spi_reply = data;
+		return;
+	}
+	if (spi_busy)
+	{
+		reg_values[SIM_SPSR] |= (1 << WCOL);
+		return;
+	}
+	uint32_t divider = dividers[control & 0x03];
+	if (reg_values[SIM_SPSR] & (1 << SPI2X))
+	{
+		divider /= 2;
+	}
+	spi_busy = true;
+	spi_sent = data;
+	spi_done = sim_cycles + 8 * divider;
+}
+
+/** This function finishes shifting a byte: the slave gets the byte sent and gives one
+ *  back, and the transfer complete flag is set.
+ */
+static void spi_finish (void)
+{
+	bool selected = !(reg_values[SIM_PORTA] & (1 << PIN7));
+	spi_received = (p_spi_slave != NULL) ? p_spi_slave (spi_sent, selected) : 0xFF;
+	reg_values[SIM_SPSR] |= (1 << SPIF);
+	spi_busy = false;
+	spi_done = SIM_NEVER;
+}
+
+
+//-------------------------------------------------------------------------------------
+// Timer 3's compare output A, which drives the pen servo from pin E3
+
+static bool oc3a_high = false;				///< Level of the OC3A output
+static uint64_t oc3a_rose = 0;				///< When OC3A last went high
+static uint64_t oc3a_fell = 0;				///< When OC3A last went low
+static uint64_t oc3a_width = 0;				///< Length of the last pulse, in cycles
+
+/** This function acts on a compare match A in Timer 3's normal mode: as the COM3A bits
+ *  say, the OC3A output is set, cleared, or toggled. The length of each high pulse is
+ *  kept for the servo model. The PWM modes' use of the pin isn't simulated.
+ */
+static void oc3a_match (void)
+{
+	uint8_t com = (reg_values[SIM_TCCR3A] >> COM3A0) & 0x03;
+	bool was_high = oc3a_high;
+	if (com == 0)
+	{
+		return;
+	}
+	if ((reg_values[SIM_TCCR3A] & ((1 << WGM31) | (1 << WGM30)))
+		|| (reg_values[SIM_TCCR3B] & ((1 << WGM33) | (1 << WGM32))))
+	{
+		sim_warn ("OC3A output in Timer 3's PWM modes isn't simulated\n");
+		return;
+	}
+	oc3a_high = (com == 1) ? !oc3a_high : (com == 3);
+	if (oc3a_high && !was_high)
+	{
+		oc3a_rose = sim_cycles;
+	}
+	else if (was_high && !oc3a_high)
+	{
+		oc3a_fell = sim_cycles;
+		oc3a_width = sim_cycles - oc3a_rose;
+	}
+}
+
+/** This function gives the length of the last pulse on the OC3A pin, which the servo
+ *  model takes as its command. If no pulse has ended within the last 50 ms, or the pin
+ *  isn't an output, the servo isn't getting a signal.
+ *  @return The pulse length in seconds, or 0 if there's no signal
+ */
+double sim_oc3a_pulse (void)
+{
+	if (!(reg_values[SIM_DDRE] & (1 << PIN3)) || oc3a_width == 0
+		|| sim_cycles - oc3a_fell > F_CPU / 20)
+	{
+		return (0.0);
+	}
+	return ((double)oc3a_width / F_CPU);
+}
+
+
+//-------------------------------------------------------------------------------------
+// The USARTs, which are simulated as asynchronous ports only. Each has a transmit data
+// register and a shift register, as on the AVR, so one character can wait while
+// another is sent, and a one character receive buffer
+
+/// The number of USARTs
+#define SIM_NUM_UARTS		2
+
+/// The distance between the same register of USART 0 and of USART 1
+#define SIM_UART_STEP		(SIM_UCSR1A - SIM_UCSR0A)
+
+/** This structure holds the state of one USART's transmitter and receiver.
+ */
+typedef struct
+{
+	bool shifting;							///< True while a character is being sent
+	bool data_full;							///< True if a character waits in UDR
+	uint8_t shifted;						///< The character being sent
+	uint8_t waiting;						///< The character waiting in UDR
+	uint64_t done;							///< When the character being sent is done
+	uint8_t received;						///< The last character received
+} sim_uart;
+
+/// The USARTs
+static sim_uart uarts[SIM_NUM_UARTS] = { { false, false, 0, 0, SIM_NEVER, 0 },
+										 { false, false, 0, 0, SIM_NEVER, 0 } };
+
+/// The function which is given each character sent by a USART, or NULL if there's none
+static void (*p_uart_sink)(uint8_t port, uint8_t data) = NULL;
+
+/** This function works out how long a USART takes to send one character, from its baud
+ *  rate divisor, double speed bit, and frame format.
+ *  @param port The USART's number, 0 or 1
+ *  @return The number of CPU cycles per character
+ */
+static uint32_t uart_frame_cycles (uint8_t port)
+{
+	uint8_t offset = port * SIM_UART_STEP;
+	uint8_t status = reg_values[SIM_UCSR0A + offset];
+	uint8_t format = reg_values[SIM_UCSR0C + offset];
+	uint32_t divisor = (((reg_values[SIM_UBRR0H + offset] & 0x0F) << 8)
+						| reg_values[SIM_UBRR0L + offset]) + 1;
+	uint32_t bit_cycles = divisor * ((status & (1 << U2X0)) ? 8 : 16);
+
+	if (reg_values[SIM_UCSR0B + offset] & (1 << UCSZ02))
+	{
+		sim_warn ("9 bit characters aren't simulated; sending 8 bits\n");
+	}
+	uint8_t bits = 1 + 5 + ((format >> UCSZ00) & 0x03);	// Start and data bits
+	bits += (format & (1 << USBS0)) ? 2 : 1;				// Stop bits
+	bits += (format & ((1 << UPM01) | (1 << UPM00))) ? 1 : 0;	// Parity bit
+	return (bits * bit_cycles);
+}
+
+/** This function starts sending the character in a USART's data register, emptying
+ *  the register so that the program can write the next one.
+ *  @param port The USART's number, 0 or 1
+ *  @param data The character
+ */
+static void uart_start (uint8_t port, uint8_t data)
+{
+	sim_uart& uart = uarts[port];
+	uart.shifting = true;
+	uart.shifted = data;
+	uart.done = sim_cycles + uart_frame_cycles (port);
+	reg_values[SIM_UCSR0A + port * SIM_UART_STEP] |= (1 << UDRE0);
+}
+
+/** This function acts on a write to a USART's data register. If the transmitter is
+ *  idle the character starts out at once; if not, it waits in the data register, and
+ *  the data register empty flag is cleared until it can be sent.
+ *  @param port The USART's number, 0 or 1
+ *  @param data The character written
+ */
+static void uart_write (uint8_t port, uint8_t data)
+{
+	sim_uart& uart = uarts[port];
+	uint8_t offset = port * SIM_UART_STEP;
+
+	if (!(reg_values[SIM_UCSR0B + offset] & (1 << TXEN0)))
+	{
+		sim_warn ("UDR written while the USART's transmitter is off; ignored\n");
+		return;
+	}
+	if (uart.data_full)
+	{
+		sim_warn ("UDR written while it wasn't empty; the character was lost\n");
+		return;
+	}
+	if (!uart.shifting)
+	{
+		uart_start (port, data);
+		return;
+	}
+	uart.data_full = true;
+	uart.waiting = data;
+	reg_values[SIM_UCSR0A + offset] &= ~(1 << UDRE0);
+}
+
+/** This function finishes sending a character. The character goes to the sink, and
+ *  the one waiting in the data register, if there is one, starts out; otherwise the
+ *  transmit complete flag is set.
+ *  @param port The USART's number, 0 or 1
+ */
+static void uart_finish (uint8_t port)
+{
+	sim_uart& uart = uarts[port];
+
+	uart.shifting = false;
+	uart.done = SIM_NEVER;
+	if (p_uart_sink != NULL)
+	{
+		p_uart_sink (port, uart.shifted);
+	}
+	if (uart.data_full)
+	{
+		uart.data_full = false;
+		uart_start (port, uart.waiting);
+	}
+	else
+	{
+		reg_values[SIM_UCSR0A + port * SIM_UART_STEP] |= (1 << TXC0);
+	}
+}
+
+
+//-------------------------------------------------------------------------------------
+// Pins and the plant model
+
+/// The levels at which input pins are driven from outside, one byte per port A - E
+static uint8_t pin_levels[5] = { 0, 0, 0, 0, 0 };
+
+/// Which input pins are driven from outside; the rest read their pull-up setting
+static uint8_t pin_driven[5] = { 0, 0, 0, 0, 0 };
+
+/// The function which steps the plant model, or NULL if there's none
+static void (*p_plant_step)(double dt) = NULL;
+
+static uint64_t plant_period = 0;			///< Cycles between plant steps
+static uint64_t plant_next = SIM_NEVER;		///< When the plant is next stepped
+
+/** This function works out what a port's PIN register reads. Outputs read back what's
+ *  written to them; inputs read the level driven from outside, or if none, their pull-up
+ *  resistor setting.
+ *  @param port The port's number, 0 for A to 4 for E
+ *  @return The value read from the PIN register
+ */
+static uint8_t pin_read (uint8_t port)
+{
+	uint8_t ddr = reg_values[SIM_DDRA + port];
+	uint8_t out = reg_values[SIM_PORTA + port];
+	uint8_t outside = (pin_levels[port] & pin_driven[port]) | (out & ~pin_driven[port]);
+	return ((out & ddr) | (outside & ~ddr));
+}
+
+
+//-------------------------------------------------------------------------------------
+/** This function runs the events which come due at the present time: timer overflows
+ *  and matches, the end of an SPI byte, and a plant step.
+ */
+static void run_events (void)
+{
+	if (timer_due (timer_3, 0))
+	{
+		reg_values[SIM_TIFR3] |= (1 << TOV3);
+	}
+	if (timer_due (timer_3, reg_values[SIM_OCR3A]))
+	{
+		reg_values[SIM_TIFR3] |= (1 << OCF3A);
+		oc3a_match ();
+	}
+	if (timer_due (timer_3, reg_values[SIM_OCR3C]))
+	{
+		reg_values[SIM_TIFR3] |= (1 << OCF3C);
+	}
+	if (timer_due (timer_2, reg_values[SIM_OCR2A]))
+	{
+		reg_values[SIM_TIFR2] |= (1 << OCF2A);
+	}
+	if (timer_due (timer_1, 0))
+	{
+		reg_values[SIM_TIFR1] |= (1 << TOV1);
+	}
+	if (spi_done == sim_cycles)
+	{
+		spi_finish ();
+	}
+	for (uint8_t port = 0; port < SIM_NUM_UARTS; port++)
+	{
+		if (uarts[port].done == sim_cycles)
+		{
+			uart_finish (port);
+		}
+	}
+	if (plant_next == sim_cycles)
+	{
+		plant_next += plant_period;
+		p_plant_step ((double)plant_period / F_CPU);
+	}
+}
+
+/** This function finds the time of the next event.
+ *  @return The cycle at which the next event happens, or SIM_NEVER if none will
+ */
+static uint64_t next_event (void)
+{
+	uint64_t next = plant_next;
+	uint64_t when;
+
+	if ((when = timer_next (timer_3, 0)) < next)						next = when;
+	if ((when = timer_next (timer_3, reg_values[SIM_OCR3A])) < next)	next = when;
+	if ((when = timer_next (timer_3, reg_values[SIM_OCR3C])) < next)	next = when;
+	if ((when = timer_next (timer_2, reg_values[SIM_OCR2A])) < next)	next = when;
+	if ((when = timer_next (timer_1, 0)) < next)						next = when;
+	if (spi_done < next)												next = spi_done;
+	for (uint8_t port = 0; port < SIM_NUM_UARTS; port++)
+	{
+		if (uarts[port].done < next)									next = uarts[port].done;
+	}
+	return (next);
+}
+
+/** This function lets time pass, running each event as it comes due.
+ *  @param target The cycle to which time is advanced
+ */
+static void advance_to (uint64_t target)
+{
+	uint64_t next;
+	while ((next = next_event ()) <= target)
+	{
+		sim_cycles = next;
+		run_events ();
+	}
+	sim_cycles = target;
+}
+
+/** This function finds the most urgent interrupt which is both flagged and enabled.
+ *  @return A pointer to its table entry, or NULL if there's none
+ */
+static const sim_interrupt* pending_interrupt (void)
+{
+	for (uint8_t index = 0; index < SIM_NUM_INTERRUPTS; index++)
+	{
+		const sim_interrupt& intr = interrupts[index];
+		if ((reg_values[intr.flag_reg] & (1 << intr.flag_bit))
+			&& (reg_values[intr.enable_reg] & (1 << intr.enable_bit)))
+		{
+			return (&intr);
+		}
+	}
+	return (NULL);
+}
+
+/** This function runs the service routines of pending interrupts while interrupts are
+ *  enabled. As on the AVR, the flag is cleared and interrupts are disabled while each
+ *  routine runs, so routines don't interrupt each other.
+ */
+static void service_interrupts (void)
+{
+	const sim_interrupt* p_intr;
+	while ((reg_values[SIM_SREG] & SIM_SREG_I) && (p_intr = pending_interrupt ()) != NULL)
+	{
+		if (p_intr->cleared)
+		{
+			reg_values[p_intr->flag_reg] &= ~(1 << p_intr->flag_bit);
+		}
+		reg_values[SIM_SREG] &= ~SIM_SREG_I;
+		p_intr->p_vector ();
+		reg_values[SIM_SREG] |= SIM_SREG_I;
+	}
+}
+
+
+//-------------------------------------------------------------------------------------
+/** This function reads a register for the program being simulated. Time passes by one
+ *  access, the value is read, and then any pending interrupts are serviced.
+ *  @param reg The register, from sim_reg_id
+ *  @return The value read
+ */
+uint16_t sim_read (uint8_t reg)
+{
+	advance_to (sim_cycles + sim_access_cycles);
+	timer_3_report ();
+
+	uint16_t value;
+	switch (reg)
+	{
+		case SIM_TCNT1:
+			value = timer_count (timer_1);
+			break;
+		case SIM_TCNT2:
+			value = timer_count (timer_2);
+			break;
+		case SIM_TCNT3:
+			value = timer_count (timer_3);
+			break;
+		case SIM_PINA: case SIM_PINB: case SIM_PINC: case SIM_PIND: case SIM_PINE:
+			value = pin_read (reg - SIM_PINA);
+			break;
+		case SIM_SPSR:
+			value = reg_values[reg];
+			spif_seen = (value & (1 << SPIF)) != 0;
+			break;
+		case SIM_SPDR:
+			value = spi_received;
+			if (spif_seen)
+			{
+				reg_values[SIM_SPSR] &= ~((1 << SPIF) | (1 << WCOL));
+				spif_seen = false;
+			}
+			break;
+		case SIM_UDR0: case SIM_UDR1:				// Reading takes the character out
+			value = uarts[(reg - SIM_UDR0) / SIM_UART_STEP].received;
+			reg_values[reg - SIM_UDR0 + SIM_UCSR0A] &= ~((1 << RXC0) | (1 << DOR0));
+			break;
+		default:
+			value = reg_values[reg];
+			break;
+	}
+
+	service_interrupts ();
+	return (value);
+}
+
+/** This function writes a register for the program being simulated. Time passes by one
+ *  access, the register is written and whatever it controls is changed, and then any
+ *  pending interrupts are serviced.
+ *  @param reg The register, from sim_reg_id
+ *  @param value The value written
+ */
+void sim_write (uint8_t reg, uint16_t value)
+{
+	advance_to (sim_cycles + sim_access_cycles);
+
+	switch (reg)
+	{
+		case SIM_TIFR1: case SIM_TIFR2: case SIM_TIFR3: case SIM_EIFR: case SIM_PCIFR:
+			reg_values[reg] &= ~value;					// Writing a one clears a flag
+			break;
+		case SIM_SPSR:
+			reg_values[reg] = (reg_values[reg] & ~(1 << SPI2X)) | (value & (1 << SPI2X));
+			break;
+		case SIM_SPDR:
+			if (spif_seen)
+			{
+				reg_values[SIM_SPSR] &= ~((1 << SPIF) | (1 << WCOL));
+				spif_seen = false;
+			}
+			spi_start ((uint8_t)value);
+			break;
+		case SIM_PINA: case SIM_PINB: case SIM_PINC: case SIM_PIND: case SIM_PINE:
+			sim_warn ("Writing a PIN register to toggle outputs isn't simulated\n");
+			break;
+		case SIM_UCSR0A: case SIM_UCSR1A:			// Only TXC, U2X and MPCM are written,
+			reg_values[reg] &= ~(value & (1 << TXC0));	// and writing a one clears TXC
+			reg_values[reg] = (reg_values[reg] & ~((1 << U2X0) | (1 << MPCM0)))
+							  | (value & ((1 << U2X0) | (1 << MPCM0)));
+			break;
+		case SIM_UDR0: case SIM_UDR1:
+			uart_write ((reg - SIM_UDR0) / SIM_UART_STEP, (uint8_t)value);
+			break;
+		case SIM_TCCR1A: case SIM_TCCR1B:
+			reg_values[reg] = value;
+			timer_1_setup (timer_count (timer_1));
+			break;
+		case SIM_TCNT1:
+			timer_1_setup (value);
+			break;
+		case SIM_TCCR2A: case SIM_TCCR2B: case SIM_OCR2A:
+			reg_values[reg] = value;
+			timer_2_setup ();
+			break;
+		case SIM_TCNT2:
+			timer_restart (timer_2, value, timer_2.prescale, timer_2.top);
+			break;
+		case SIM_TCCR3A: case SIM_TCCR3B:
+			reg_values[reg] = value;
+			timer_3_setup (timer_count (timer_3));
+			break;
+		case SIM_TCNT3:
+			timer_3_setup (value);
+			break;
+		default:
+			reg_values[reg] = value;
+			break;
+	}
+	if (reg != SIM_TCCR3A && reg != SIM_TCCR3B)
+	{
+		timer_3_report ();
+	}
+
+	service_interrupts ();
+}
+
+
+//-------------------------------------------------------------------------------------
+/** This function gives the simulated time.
+ *  @return The time since the simulated processor was reset, in seconds
+ */
+double sim_seconds (void)
+{
+	return ((double)sim_cycles / F_CPU);
+}
+
+/** This function enables interrupts. As on the AVR, any which are pending don't run
+ *  until the next instruction, which here means the next register access or sleep.
+ */
+void sim_sei (void)
+{
+	reg_values[SIM_SREG] |= SIM_SREG_I;
+}
+
+/** This function disables interrupts.
+ */
+void sim_cli (void)
+{
+	reg_values[SIM_SREG] &= ~SIM_SREG_I;
+}
+
+/** This function puts the processor to sleep until an enabled interrupt is flagged,
+ *  then runs the service routines. An interrupt which was already pending when sei()
+ *  came just before sleep_cpu() wakes the processor at once, as on the AVR.
+ */
+void sim_sleep (void)
+{
+	if (!(reg_values[SIM_SMCR] & (1 << SE)))
+	{
+		return;
+	}
+	if (!(reg_values[SIM_SREG] & SIM_SREG_I))
+	{
+		sim_warn ("sleep_cpu() with interrupts disabled would never wake up\n");
+		return;
+	}
+	while (pending_interrupt () == NULL)
+	{
+		uint64_t next = next_event ();
+		if (next == SIM_NEVER)
+		{
+			sim_warn ("Asleep with nothing to wake the processor\n");
+			return;
+		}
+		sim_cycles = next;
+		run_events ();
+	}
+	service_interrupts ();
+}
+
+/** This function lets time pass as if the processor were running code which doesn't
+ *  touch any registers, running each event and interrupt as it comes due meanwhile. It
+ *  lets a simulation program charge for work which the simulator doesn't otherwise
+ *  count, such as a task's computations. Interrupts flagged from outside since the
+ *  last register access, as by sim_spi_transfer(), are serviced first. If service
+ *  routines take longer than the time given, time doesn't go back when they're done.
+ *  @param cycles The number of clock cycles which pass
+ */
+void sim_spend (uint32_t cycles)
+{
+	uint64_t target = sim_cycles + cycles;
+	uint64_t next;
+	service_interrupts ();
+	while ((next = next_event ()) <= target)
+	{
+		sim_cycles = next;
+		run_events ();
+		service_interrupts ();
+	}
+	if (sim_cycles < target)
+	{
+		sim_cycles = target;
+	}
+}
+
+/** This function reads a register's stored value without letting time pass or acting
+ *  on the read, for models of the hardware outside the processor.
+ *  @param reg The register, from sim_reg_id
+ *  @return The register's value
+ */
+uint16_t sim_peek (uint8_t reg)
+{
+	if (reg >= SIM_PINA && reg <= SIM_PINE)
+	{
+		return (pin_read (reg - SIM_PINA));
+	}
+	return (reg_values[reg]);
+}
+
+/** This function drives an input pin from outside the processor. If the pin is one of
+ *  the external interrupt pins E4 or E5, the edge is checked against its sense control
+ *  bits in EICRB and its flag is set if the edge matches. A change on a pin of port A
+ *  or C which is set in PCMSK0 or PCMSK2 sets pin change interrupt flag 0 or 2.
+ *  @param reg The pin's PIN register, such as SIM_PINE
+ *  @param bit The pin number, 0 to 7
+ *  @param high True to drive the pin high, false to drive it low
+ */
+void sim_set_pin (uint8_t reg, uint8_t bit, bool high)
+{
+	uint8_t port = reg - SIM_PINA;
+	bool was_high = (pin_read (port) >> bit) & 1;
+
+	pin_driven[port] |= (1 << bit);
+	if (high)
+	{
+		pin_levels[port] |= (1 << bit);
+	}
+	else
+	{
+		pin_levels[port] &= ~(1 << bit);
+	}
+
+	if (was_high != high)
+	{
+		if (reg == SIM_PINA && (reg_values[SIM_PCMSK0] & (1 << bit)))
+		{
+			reg_values[SIM_PCIFR] |= (1 << PCIF0);
+		}
+		else if (reg == SIM_PINC && (reg_values[SIM_PCMSK2] & (1 << bit)))
+		{
+			reg_values[SIM_PCIFR] |= (1 << PCIF2);
+		}
+	}
+	if (reg == SIM_PINE && (bit == 4 || bit == 5) && was_high != high)
+	{
+		uint8_t sense = (reg_values[SIM_EICRB] >> (2 * (bit - 4))) & 0x03;
+		if (sense == 0 && (reg_values[SIM_EIMSK] & (1 << bit)))
+		{
+			sim_warn ("Low level interrupt sensing is simulated as a falling edge\n");
+		}
+		if ((sense == 1) || (sense == 3 && high) || (sense == 2 && !high)
+			|| (sense == 0 && !high && (reg_values[SIM_EIMSK] & (1 << bit))))
+		{
+			reg_values[SIM_EIFR] |= (1 << bit);
+		}
+	}
+}
+
+/** This function connects a model of the SPI slave. It's called as each byte finishes
+ *  shifting, with the byte the master sent, and returns the byte the master receives.
+ *  @param p_slave A pointer to the slave function
+ */
+void sim_set_spi_slave (uint8_t (*p_slave)(uint8_t mosi, bool selected))
+{
+	p_spi_slave = p_slave;
+}
+
+/** This function plays the part of an SPI master talking to the simulated processor
+ *  while its SPI port is an enabled slave, as on the encoder slave board. The byte in
+ *  the processor's shift register goes to the master: that's the byte last written
+ *  to SPDR or, if none has been written since the last transfer, the byte received
+ *  then, as on the AVR. The master's byte can then be read from SPDR, and the transfer
+ *  complete flag is set. The bytes are exchanged at once; the caller lets the time
+ *  which the bits and the gap after them would take pass with sim_spend(), during
+ *  which the interrupt runs.
+ *  @param mosi The byte the master sends
+ *  @return The byte the master receives
+ */
+uint8_t sim_spi_transfer (uint8_t mosi)
+{
+	uint8_t control = reg_values[SIM_SPCR];
+	if (!(control & (1 << SPE)) || (control & (1 << MSTR)))
+	{
+		sim_warn ("SPI byte sent in while the SPI port isn't an enabled slave; ignored\n");
+		return (0xFF);
+	}
+	uint8_t miso = spi_reply;
+	spi_reply = mosi;
+	spi_received = mosi;
+	reg_values[SIM_SPSR] |= (1 << SPIF);
+	return (miso);
+}
+
+/** This function connects a model of the plant, which is stepped at regular intervals
+ *  of simulated time; it reads the outputs with sim_peek() and drives the inputs with
+ *  sim_set_pin().
+ *  @param p_step A pointer to the function which steps the plant, or NULL for none
+ *  @param period The time between steps in seconds
+ */
+void sim_set_plant (void (*p_step)(double dt), double period)
+{
+	p_plant_step = p_step;
+	if (p_step == NULL)
+	{
+		plant_next = SIM_NEVER;
+		return;
+	}
+	plant_period = (uint64_t)(period * F_CPU + 0.5);
+	if (plant_period == 0)
+	{
+		plant_period = 1;
+	}
+	plant_next = sim_cycles + plant_period;
+}
+
+/** This function connects a model of whatever is at the other end of the USARTs'
+ *  transmit lines. It's called as each character finishes being sent.
+ *  @param p_sink A pointer to the function which is given the port number, 0 or 1, and
+ *                the character
+ */
+void sim_set_uart (void (*p_sink)(uint8_t port, uint8_t data))
+{
+	p_uart_sink = p_sink;
+}
+
+/** This function gives a USART a character which has just finished arriving on its
+ *  receive line; the caller sends characters no faster than the baud rate allows. As
+ *  with sim_set_pin(), the interrupt runs at the program's next register access. If
+ *  the last character hasn't been read yet, the new one is lost and the data overrun
+ *  flag is set. Nothing is received while the receiver is off.
+ *  @param port The USART's number, 0 or 1
+ *  @param data The character
+ */
+void sim_uart_receive (uint8_t port, uint8_t data)
+{
+	uint8_t offset = port * SIM_UART_STEP;
+
+	if (!(reg_values[SIM_UCSR0B + offset] & (1 << RXEN0)))
+	{
+		return;
+	}
+	if (reg_values[SIM_UCSR0A + offset] & (1 << RXC0))
+	{
+		reg_values[SIM_UCSR0A + offset] |= (1 << DOR0);
+		return;
+	}
+	uarts[port].received = data;
+	reg_values[SIM_UCSR0A + offset] |= (1 << RXC0);
+}
+
+/** This function prints a warning about something the simulator can't do, or which
+ *  the program probably didn't mean to do. Each warning is printed only the first time.
+ *  @param format A printf() style format for the warning
+ */
+void sim_warn (const char* format, ...)
+{
+	static const char* shown[32];
+	static uint8_t num_shown = 0;
+
+	for (uint8_t index = 0; index < num_shown; index++)
+	{
+		if (shown[index] == format)
+		{
+			return;
+		}
+	}
+	if (num_shown < sizeof (shown) / sizeof (shown[0]))
+	{
+		shown[num_shown++] = format;
+	}
+
+	va_list args;
+	va_start (args, format);
+	fprintf (stderr, "sim: %.6f s: ", sim_seconds ());
+	vfprintf (stderr, format, args);
+	va_end (args);
+}
+
+
+//-------------------------------------------------------------------------------------
+// Number conversions from avr-libc which the PC's C library doesn't have
+
+/** This function writes an unsigned number as text in any base from 2 to 36.
+ *  @param number The number
+ *  @param p_str The buffer into which the text is written
+ *  @param base The base
+ *  @return A pointer to the text
+ */
+extern "C" char* ultoa (unsigned long number, char* p_str, int base)
+{
+	char digits[33];
+	uint8_t count = 0;
+	do
+	{
+		uint8_t digit = number % base;
+		digits[count++] = (digit < 10) ? ('0' + digit) : ('a' + digit - 10);
+		number /= base;
+	}
+	while (number != 0);
+
+	char* p_char = p_str;
+	while (count > 0)
+	{
+		*p_char++ = digits[--count];
+	}
+	*p_char = '\0';
+	return (p_str);
+}
+
+/** This function writes a signed number as text; like avr-libc's, it only puts a minus
+ *  sign on negative numbers in base 10.
+ *  @param number The number
+ *  @param p_str The buffer into which the text is written
+ *  @param base The base
+ *  @return A pointer to the text
+ */
+extern "C" char* ltoa (long number, char* p_str, int base)
+{
+	if (number < 0 && base == 10)
+	{
+		p_str[0] = '-';
+		ultoa (0UL - (unsigned long)number, p_str + 1, base);
+		return (p_str);
+	}
+	return (ultoa ((unsigned long)number, p_str, base));
+}
+
+/// This function writes an unsigned int as text @see ultoa()
+extern "C" char* utoa (unsigned int number, char* p_str, int base)
+{
+	return (ultoa (number, p_str, base));
+}
+
+/// This function writes an int as text @see ltoa()
+extern "C" char* itoa (int number, char* p_str, int base)
+{
+	return (ltoa (number, p_str, base));
+}
+
+/** This function does what avr-libc's internal __ftoa_engine() does for
+ *  base_text_serial: it writes a status byte, then the digits of a number's mantissa
+ *  with one before the decimal point and \c prec after it, and returns the exponent.
+ *  @param val The number
+ *  @param buf The buffer into which the status byte and digits are written
+ *  @param prec The number of digits after the decimal point
+ *  @param maxdgs The most digits which may be written
+ *  @return The power of ten by which the mantissa is multiplied
+ */
+extern "C" int __ftoa_engine (double val, char* buf, unsigned char prec,
+							  unsigned char maxdgs)
+{
+	buf[0] = signbit (val) ? 1 : 0;				// FTOA_MINUS
+	if (isnan (val))
+	{
+		buf[0] |= 8;							// FTOA_NAN
+		buf[1] = '\0';
+		return (0);
+	}
+	if (isinf (val))
+	{
+		buf[0] |= 4;							// FTOA_INF
+		buf[1] = '\0';
+		return (0);
+	}
+	if (val == 0.0)
+	{
+		buf[0] |= 2;							// FTOA_ZERO
+	}
+	if (prec >= maxdgs)
+	{
+		prec = maxdgs - 1;
+	}
+
+	char text[32];
+	snprintf (text, sizeof (text), "%.*e", prec, fabs (val));
+	char* p_out = buf + 1;
+	char* p_in = text;
+	for ( ; *p_in != 'e'; p_in++)
+	{
+		if (*p_in != '.')
+		{
+			*p_out++ = *p_in;
+		}
+	}
+	*p_out = '\0';
+	return (atoi (p_in + 1));
+}
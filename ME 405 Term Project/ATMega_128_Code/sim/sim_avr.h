@@ -0,0 +1,171 @@
+//*************************************************************************************
+/** \file sim_avr.h
+ *    This file declares a simulated ATmega1281 register layer, which lets the plotter's
+ *    AVR code be compiled and run on a Linux PC. Each special function register used
+ *    by the code is an object whose reads and writes are passed to the simulator, so
+ *    that timers count, the SPI port shifts bytes to a simulated slave, pins change,
+ *    and interrupt service routines are called when their flags and enables are set,
+ *    all in simulated time. The headers in sim/avr make the register names refer to
+ *    these objects, so the AVR sources are compiled unchanged.
+ *
+ *    Simulated time is counted in CPU clock cycles. Code doesn't take any time to run
+ *    except for a fixed number of cycles charged for each register access, which is a
+ *    rough stand-in for the code between accesses; sleep_cpu() skips ahead to the next
+ *    interrupt. Only the peripherals which the plotter uses are modelled: Timers 1, 2
+ *    and 3, the SPI port, pin E4 and E5 external interrupts, the outputs which drive
+ *    the motors and pen servo, and the two USARTs, which send and receive characters
+ *    at the baud rate they're set to. So that the encoder slave's code can be run, the
+ *    SPI port can also be a slave, with the program playing the master, and there are
+ *    pin change interrupts on ports A and C as on the slave's ATmega164P. Programs which only need to see what
+ *    the plotter prints can use a base_text_serial which writes to a file instead of
+ *    the rs232 driver (see sim_serial.h).
+ *
+ *  Revisions:
+ *    \li 06-17-2011 Original file
+ *    \li 06-25-2011 sim_spend() charges time for code which doesn't touch registers
+ *    \li 06-29-2011 The USARTs are modelled, so rs232int.cpp can be run
+ *    \li 06-29-2011 Timer 1's count and overflow, and the SPI port as a slave
+ *    \li 06-29-2011 Pin change interrupts on ports A and C, for the encoder slave
+ *
+ *  License:
+ *    This file is released under the Lesser GNU Public License, version 2. This
+ *    program is intended for educational use only, but it is not limited thereto.
+ */
+//*************************************************************************************
+
+/// This define prevents this .h file from being included more than once in a .cc file
+#ifndef _SIM_AVR_H_
+#define _SIM_AVR_H_
+
+#include <stdint.h>
+
+
+//-------------------------------------------------------------------------------------
+/** This enumeration numbers the simulated registers. Each has a sim_register object
+ *  named sim_reg_ followed by the register's name, and a define in avr/io.h.
+ */
+
+enum sim_reg_id
+{
+	SIM_SREG, SIM_SPCR, SIM_SPSR, SIM_SPDR,
+	SIM_DDRA, SIM_DDRB, SIM_DDRC, SIM_DDRD, SIM_DDRE,
+	SIM_PORTA, SIM_PORTB, SIM_PORTC, SIM_PORTD, SIM_PORTE,
+	SIM_PINA, SIM_PINB, SIM_PINC, SIM_PIND, SIM_PINE,
+	SIM_TCCR1A, SIM_TCCR1B, SIM_TCNT1, SIM_OCR1AL, SIM_OCR1BL, SIM_TIMSK1, SIM_TIFR1,
+	SIM_TCCR2A, SIM_TCCR2B, SIM_TCNT2, SIM_OCR2A, SIM_TIMSK2, SIM_TIFR2,
+	SIM_TCCR3A, SIM_TCCR3B, SIM_TCNT3, SIM_OCR3A, SIM_OCR3C, SIM_TIMSK3, SIM_TIFR3,
+	SIM_EIMSK, SIM_EICRB, SIM_EIFR, SIM_PCICR, SIM_PCIFR, SIM_PCMSK0, SIM_PCMSK2, SIM_SMCR,
+	SIM_UCSR0A, SIM_UCSR0B, SIM_UCSR0C, SIM_UBRR0L, SIM_UBRR0H, SIM_UDR0,
+	SIM_UCSR1A, SIM_UCSR1B, SIM_UCSR1C, SIM_UBRR1L, SIM_UBRR1H, SIM_UDR1,
+	SIM_NUM_REGS
+};
+
+// These functions are the simulator's side of a register access
+uint16_t sim_read (uint8_t reg);
+void sim_write (uint8_t reg, uint16_t value);
+
+
+//-------------------------------------------------------------------------------------
+/** This class stands in for one special function register. It holds only the number
+ *  of the register; the value lives in the simulator, which may work it out when it's
+ *  read (as for a timer count) or act on a write (as for the SPI data register). The
+ *  operators are the ones AVR code uses on registers. Taking a register's address
+ *  isn't supported, as a pointer to it couldn't call the simulator.
+ */
+
+template <class regType>
+class sim_register
+{
+	protected:
+		uint8_t which;						///< Which register this is, a sim_reg_id
+
+	public:
+		/** This constructor makes an object for one register.
+		 *  @param reg_id The number of the register, from sim_reg_id
+		 */
+		sim_register (uint8_t reg_id) { which = reg_id; }
+
+		/** Reading a register asks the simulator for its value.
+		 *  @return The value of the register
+		 */
+		operator regType (void) const { return ((regType)sim_read (which)); }
+
+		/** Writing a register gives the simulator the new value. The operators take
+		 *  an int, as bit expressions such as ~(1 << SPIE) are ints, and keep only as
+		 *  many bits as the register has.
+		 *  @param value The value written
+		 *  @return A reference to this register
+		 */
+		sim_register& operator= (unsigned int value)
+		{
+			sim_write (which, (regType)value);
+			return (*this);
+		}
+
+		/** Assigning one register to another copies the value, not the register.
+		 *  @param other The register to be read
+		 *  @return A reference to this register
+		 */
+		sim_register& operator= (const sim_register& other)
+		{
+			sim_write (which, (regType)other);
+			return (*this);
+		}
+
+		/// Read, OR in some bits, and write back @param bits The bits to set
+		sim_register& operator|= (unsigned int bits)
+		{
+			sim_write (which, (regType)(sim_read (which) | bits));
+			return (*this);
+		}
+
+		/// Read, AND with a mask, and write back @param mask The bits to keep
+		sim_register& operator&= (unsigned int mask)
+		{
+			sim_write (which, (regType)(sim_read (which) & mask));
+			return (*this);
+		}
+
+		/// Read, add, and write back, as for moving a compare match @param step The amount
+		sim_register& operator+= (unsigned int step)
+		{
+			sim_write (which, (regType)(sim_read (which) + step));
+			return (*this);
+		}
+
+		/// Read, XOR with some bits, and write back @param bits The bits to flip
+		sim_register& operator^= (unsigned int bits)
+		{
+			sim_write (which, (regType)(sim_read (which) ^ bits));
+			return (*this);
+		}
+};
+
+
+//-------------------------------------------------------------------------------------
+// The simulator's clock and controls, used by sim/avr/*.h and by simulation programs
+
+/// Number of CPU clock cycles since the simulated processor was reset
+extern uint64_t sim_cycles;
+
+/// Number of clock cycles charged for each register access
+extern uint16_t sim_access_cycles;
+
+double sim_seconds (void);					// Simulated time in seconds
+void sim_sei (void);						// Stands in for sei()
+void sim_cli (void);						// Stands in for cli()
+void sim_sleep (void);						// Stands in for sleep_cpu()
+void sim_spend (uint32_t cycles);			// Lets time pass as if code were running
+
+uint16_t sim_peek (uint8_t reg);			// Reads a register with no side effects
+void sim_set_pin (uint8_t reg, uint8_t bit, bool high);	// Drives an input pin
+double sim_oc3a_pulse (void);				// Length of the last pulse on pin OC3A
+
+void sim_set_spi_slave (uint8_t (*p_slave)(uint8_t mosi, bool selected));
+uint8_t sim_spi_transfer (uint8_t mosi);	// A master shifts a byte to the SPI slave
+void sim_set_plant (void (*p_step)(double dt), double period);
+void sim_set_uart (void (*p_sink)(uint8_t port, uint8_t data));
+void sim_uart_receive (uint8_t port, uint8_t data);	// A character arrives at a USART
+void sim_warn (const char* format, ...);	// Prints a warning once per format
+
+#endif // _SIM_AVR_H_
@@ -0,0 +1,231 @@
+//*************************************************************************************
+/** \file sim_link.h
+ *    This file contains a simulated serial line between the plotter and a program on a
+ *    PC which sends it G-code. Characters take as long to cross the line as they would
+ *    at the chosen baud rate, and the plotter's end has a receive buffer which behaves
+ *    as rs232's does, so a sender which overfills it loses characters.
+ *
+ *  Revisions:
+ *    \li 06-22-2011 Original file
+ *
+ *  License:
+ *    This file is released under the Lesser GNU Public License, version 2. This
+ *    program is intended for educational use only, but it is not limited thereto.
+ */
+//*************************************************************************************
+
+/// This define prevents this .h file from being included more than once in a .cc file
+#ifndef _SIM_LINK_H_
+#define _SIM_LINK_H_
+
+#include <stdint.h>
+#include "base_text_serial.h"
+#include "rs232int.h"						// For the size of the receive buffer
+
+/// Bits sent for each character: a start bit, 8 data bits and 2 stop bits, as rs232 sends
+#define SIM_LINK_BITS		11
+
+/// Size of the buffers which hold characters on their way along the line
+#define SIM_LINK_WIRE_SIZE	1024
+
+/// The longest line the PC end can receive
+#define SIM_LINK_LINE_SIZE	128
+
+
+//-------------------------------------------------------------------------------------
+/** This class is a ring buffer of characters, used for the receive buffer and for the
+ *  characters on their way in each direction. If it's full, the oldest character is
+ *  thrown away to make room, as rs232's receive interrupt does.
+ */
+
+template <uint16_t size>
+class sim_char_ring
+{
+	protected:
+		char chars[size];					///< The characters
+		uint16_t head;						///< Index of the oldest character
+		uint16_t count;						///< Number of characters held
+
+	public:
+		/// The constructor makes an empty buffer
+		sim_char_ring (void) { head = 0; count = 0; }
+
+		/** This method puts a character into the buffer.
+		 *  @param ch The character
+		 *  @return False if the buffer was full, so the oldest character was lost
+		 */
+		bool put (char ch)
+		{
+			bool room = (count < size);
+			if (!room)
+			{
+				head = (head + 1) % size;
+				count--;
+			}
+			chars[(head + count) % size] = ch;
+			count++;
+			return (room);
+		}
+
+		/// This method takes the oldest character out of the buffer @return The character
+		char get (void)
+		{
+			char ch = chars[head];
+			head = (head + 1) % size;
+			count--;
+			return (ch);
+		}
+
+		/// This method tells whether the buffer is empty
+		bool is_empty (void) { return (count == 0); }
+};
+
+
+//-------------------------------------------------------------------------------------
+/** This class is the line between the plotter and the PC. The plotter's code uses it as
+ *  it would the rs232 port: what it prints goes to the PC, and characters from the PC
+ *  wait in a buffer of RSINT_BUF_SIZE characters until getchar() takes them. The rs232
+ *  buffer keeps one fewer character than its size, as it's empty when its two indices
+ *  are the same. The PC's end sends with send() and gets whole lines of the plotter's
+ *  answers with get_line(). The step() method moves characters along the line, one for
+ *  each SIM_LINK_BITS bit times in each direction, and is called as simulated time goes
+ *  by.
+ */
+
+class sim_link : public base_text_serial
+{
+	protected:
+		double char_time;					///< Time to send one character, seconds
+		double to_plotter_time;				///< Time left to send the next character
+		double to_pc_time;					///< Time left to answer with the next character
+		sim_char_ring<SIM_LINK_WIRE_SIZE> to_plotter;	///< Sent by the PC, on the way
+		sim_char_ring<RSINT_BUF_SIZE - 1> received;		///< In the plotter's buffer
+		sim_char_ring<SIM_LINK_WIRE_SIZE> to_pc;		///< Sent by the plotter, on the way
+		char pc_line[SIM_LINK_LINE_SIZE];	///< Line the PC has been receiving
+		uint8_t pc_length;					///< Number of characters in that line
+		bool pc_line_done;					///< True once that line has ended
+		uint32_t overruns;					///< Characters lost as the buffer was full
+
+	public:
+		/** This constructor makes an idle line.
+		 *  @param baud The baud rate
+		 */
+		sim_link (uint32_t baud) : base_text_serial ()
+		{
+			set_baud (baud);
+			to_plotter_time = 0.0;
+			to_pc_time = 0.0;
+			pc_length = 0;
+			pc_line_done = false;
+			overruns = 0;
+		}
+
+		/// This method sets the baud rate @param baud The baud rate
+		void set_baud (uint32_t baud) { char_time = (double)SIM_LINK_BITS / baud; }
+
+		/** This method moves characters along the line as time goes by.
+		 *  @param dt The time step, in seconds
+		 */
+		void step (double dt)
+		{
+			to_plotter_time -= dt;
+			while (to_plotter_time <= 0.0 && !to_plotter.is_empty ())
+			{
+				to_plotter_time += char_time;
+				if (!received.put (to_plotter.get ()))
+				{
+					overruns++;
+				}
+			}
+			if (to_plotter.is_empty () && to_plotter_time < 0.0)
+			{
+				to_plotter_time = 0.0;
+			}
+
+			to_pc_time -= dt;
+			while (to_pc_time <= 0.0 && !to_pc.is_empty () && !pc_line_done)
+			{
+				to_pc_time += char_time;
+				char ch = to_pc.get ();
+				if (ch == '\n')
+				{
+					pc_line[pc_length] = '\0';
+					pc_line_done = true;
+				}
+				else if (ch != '\r' && pc_length < SIM_LINK_LINE_SIZE - 1)
+				{
+					pc_line[pc_length++] = ch;
+				}
+			}
+			if (to_pc.is_empty () && to_pc_time < 0.0)
+			{
+				to_pc_time = 0.0;
+			}
+		}
+
+		/** This method sends characters from the PC.
+		 *  @param p_str The characters
+		 */
+		void send (const char* p_str)
+		{
+			while (*p_str)
+			{
+				to_plotter.put (*p_str++);
+			}
+		}
+
+		/** This method gets the next line the plotter has sent to the PC, if it has all
+		 *  arrived. The line ending is left off.
+		 *  @param p_line Where the line is put; it must hold SIM_LINK_LINE_SIZE characters
+		 *  @return True if a line was put in p_line
+		 */
+		bool get_line (char* p_line)
+		{
+			if (!pc_line_done)
+			{
+				return (false);
+			}
+			for (uint8_t index = 0; index <= pc_length; index++)
+			{
+				p_line[index] = pc_line[index];
+			}
+			pc_length = 0;
+			pc_line_done = false;
+			return (true);
+		}
+
+		/// This method returns the number of characters lost as the buffer was full
+		uint32_t get_overruns (void) { return (overruns); }
+
+		/// This method says that the plotter's end is always ready to send
+		bool ready_to_send (void) { return (true); }
+
+		/** This method sends one character from the plotter.
+		 *  @param chout The character
+		 *  @return True, as the character is always sent
+		 */
+		bool putchar (char chout)
+		{
+			to_pc.put (chout);
+			return (true);
+		}
+
+		/** This method sends a string from the plotter.
+		 *  @param p_str The string
+		 */
+		void puts (char const* p_str)
+		{
+			while (*p_str)
+			{
+				putchar (*p_str++);
+			}
+		}
+
+		/// This method tells whether a character is waiting in the plotter's buffer
+		bool check_for_char (void) { return (!received.is_empty ()); }
+
+		/// This method takes a character from the plotter's buffer @return The character
+		char getchar (void) { return (received.is_empty () ? '\0' : received.get ()); }
+};
+
+#endif // _SIM_LINK_H_
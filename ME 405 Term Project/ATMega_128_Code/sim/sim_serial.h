@@ -0,0 +1,69 @@
+//*************************************************************************************
+/** \file sim_serial.h
+ *    This file contains a text serial device for simulations, which writes what the
+ *    plotter's code prints to a file such as the PC's standard output. It's given to
+ *    the simulated objects in place of the rs232 port.
+ *
+ *  Revisions:
+ *    \li 06-17-2011 Original file
+ *
+ *  License:
+ *    This file is released under the Lesser GNU Public License, version 2. This
+ *    program is intended for educational use only, but it is not limited thereto.
+ */
+//*************************************************************************************
+
+/// This define prevents this .h file from being included more than once in a .cc file
+#ifndef _SIM_SERIAL_H_
+#define _SIM_SERIAL_H_
+
+#include <stdio.h>
+#include "base_text_serial.h"
+
+
+//-------------------------------------------------------------------------------------
+/** This class writes text to a file. Carriage returns are dropped, as endl sends both a
+ *  carriage return and a line feed. If the file pointer is NULL, the text is thrown
+ *  away, which keeps a long simulation quiet.
+ */
+
+class sim_serial : public base_text_serial
+{
+	protected:
+		FILE* p_file;						///< The file written to, or NULL for none
+
+	public:
+		/** This constructor sets up a device which writes to the given file.
+		 *  @param p_out The file, such as stdout, or NULL to throw text away
+		 */
+		sim_serial (FILE* p_out) : base_text_serial () { p_file = p_out; }
+
+		/// This method says that the device is always ready to send
+		bool ready_to_send (void) { return (true); }
+
+		/** This method writes one character.
+		 *  @param chout The character
+		 *  @return True, as the character is always sent
+		 */
+		bool putchar (char chout)
+		{
+			if (p_file != NULL && chout != '\r')
+			{
+				fputc (chout, p_file);
+			}
+			return (true);
+		}
+
+		/** This method writes a string.
+		 *  @param p_str The string
+		 */
+		void puts (char const* p_str)
+		{
+			while (*p_str)
+			{
+				putchar (*p_str++);
+			}
+		}
+};
+
+#endif // _SIM_SERIAL_H_
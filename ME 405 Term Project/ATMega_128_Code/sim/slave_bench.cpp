@@ -0,0 +1,512 @@
+//*************************************************************************************
+/** \file slave_bench.cpp
+ *    This program checks the encoder slave's side of the SPI link. The SPI interrupt in
+ *    ../../ATMega_164_Code/Slave_Driver.cpp and the clock in slave_clock.cpp are built
+ *    unchanged and run on the simulated processor in sim_avr.cpp, whose SPI port is
+ *    set up as a slave by Slave_Driver's constructor. The bench plays the master,
+ *    shifting each byte in with sim_spi_transfer() and leaving the time between bytes
+ *    which Master.cpp leaves, so that SPDR reads and writes go through the simulator
+ *    just as they would on the AVR:
+ *    \li Commands 1 and 2 must send the count given to Slave_Driver, least significant
+ *        byte first, and the sum of the command and the bytes; the count mustn't
+ *        change partway through, even if Packet32() is called meanwhile. Commands 3
+ *        and 4 must clear a count and echo the command.
+ *    \li A snapshot must hold both counts and speeds, and a time which agrees with the
+ *        simulated clock, including when Timer 1 overflows just as the snapshot is
+ *        taken. Its CRC-8 must be the one worked out by the master, and after it the
+ *        slave must send nothing more.
+ *    \li Snapshots are corrupted in the ways a noisy link might: every single bit
+ *        error, bursts of up to 8 bits and three bit errors must all be caught by the
+ *        CRC, and almost all bytes swapped with their neighbours, frames slipped by a
+ *        byte, and random garbage, none of which the sum used by commands 1 and 2
+ *        catches when bytes are swapped. A continue byte which reaches the slave as
+ *        something else must spoil the frame, and the slave must then answer the next
+ *        snapshot command as if nothing had happened, as must a frame cut short and
+ *        any unknown command.
+ *
+ *    Usage: slave_bench
+ *
+ *  Revisions:
+ *    \li 06-29-2011 Original file
+ *
+ *  License:
+ *    This file is released under the Lesser GNU Public License, version 2. This
+ *    program is intended for educational use only, but it is not limited thereto.
+ */
+//*************************************************************************************
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <avr/io.h>
+#include <avr/interrupt.h>
+#include "sim_avr.h"
+#include "sim_serial.h"
+#include "encoder_link.h"
+#include "Slave_Driver.h"
+
+
+/// Cycles in which a byte is shifted, as Master.cpp sets SCK to F_CPU / 64
+#define BENCH_BITS_CYCLES	(8 * 64)
+
+/// Cycles between bytes, as Master.cpp leaves MASTER_BYTE_GAP_US of 20 us
+#define BENCH_GAP_CYCLES	(20 * (F_CPU / 1000000UL))
+
+/// Cycles in one full count of Timer 1, which runs at F_CPU / 8
+#define BENCH_TIMER_CYCLES	(65536UL * 8)
+
+/// How far a snapshot's time may be from the simulated clock, in microseconds; the
+/// clock starts a few register accesses before the constructor returns, and the
+/// interrupt reads the timer a few accesses after the byte comes in
+#define BENCH_TIME_SLACK	8
+
+/// Number of snapshots with random contents which are corrupted
+#define BENCH_FRAMES		200
+
+/// Number of random garbage frames tried on each snapshot
+#define BENCH_GARBAGE		500
+
+/// Bytes received by the master in a snapshot after the command: the data and CRC
+#define BENCH_REPLY_BYTES	(LINK_SNAPSHOT_BYTES + 1)
+
+
+/// The counts and speeds which Slave_Driver is given pointers to, as in slave_test.cpp
+static int32_t encoder_1, encoder_2, velocity_1, velocity_2;
+
+/// The cycle at which the slave's clock was started
+static uint64_t clock_start;
+
+
+//-------------------------------------------------------------------------------------
+/** This function shifts one byte between the master and the slave, then lets the time
+ *  pass which the bits and the gap after them take, in which the slave's interrupt
+ *  runs and loads its next reply.
+ *  @param mosi The byte the master sends
+ *  @return The byte the master receives
+ */
+
+static uint8_t transfer (uint8_t mosi)
+{
+	uint8_t miso = sim_spi_transfer (mosi);
+	sim_spend (BENCH_BITS_CYCLES + BENCH_GAP_CYCLES);
+	return (miso);
+}
+
+
+//-------------------------------------------------------------------------------------
+/** This function works out a CRC-8 with polynomial 0x07 over some bytes, one bit at a
+ *  time from the most significant, as the master checks it. It's written separately
+ *  from link_crc8_update() so that the two check each other.
+ *  @param p_data The bytes
+ *  @param length How many bytes there are
+ *  @param crc The CRC of any bytes before these
+ *  @return The CRC including these bytes
+ */
+
+static uint8_t reference_crc (const uint8_t* p_data, uint8_t length, uint8_t crc)
+{
+	for (uint8_t index = 0; index < length; index++)
+	{
+		for (int8_t bit = 7; bit >= 0; bit--)
+		{
+			bool top = ((crc >> 7) ^ (p_data[index] >> bit)) & 1;
+			crc = (uint8_t)(crc << 1) ^ (top ? 0x07 : 0x00);
+		}
+	}
+	return (crc);
+}
+
+
+//-------------------------------------------------------------------------------------
+/** This function tells whether the master would take a snapshot reply as good: the
+ *  CRC of the command, the data, and the CRC sent after them must come out zero.
+ *  @param p_reply The data and CRC the master received
+ *  @return True if the CRC matches
+ */
+
+static bool crc_matches (const uint8_t* p_reply)
+{
+	uint8_t command = LINK_CMD_SNAPSHOT;
+	return (reference_crc (p_reply, BENCH_REPLY_BYTES, reference_crc (&command, 1, 0)) == 0);
+}
+
+
+//-------------------------------------------------------------------------------------
+/** This function reads an encoder count with command 1 or 2, as Master did before it
+ *  had snapshots.
+ *  @param command LINK_CMD_READ_1 or LINK_CMD_READ_2
+ *  @param p_bytes Where the four count bytes and the checksum are put
+ */
+
+static void read_count (uint8_t command, uint8_t* p_bytes)
+{
+	transfer (command);
+	for (uint8_t index = 0; index < 5; index++)
+	{
+		p_bytes[index] = transfer (LINK_CMD_CONTINUE);
+	}
+}
+
+
+//-------------------------------------------------------------------------------------
+/** This function takes a snapshot: it sends the command, then a continue byte for
+ *  each byte of data and the CRC.
+ *  @param p_reply Where the data and CRC are put
+ *  @return The cycle at which the command byte came in
+ */
+
+static uint64_t read_snapshot (uint8_t* p_reply)
+{
+	uint64_t when = sim_cycles;
+	transfer (LINK_CMD_SNAPSHOT);
+	for (uint8_t index = 0; index < BENCH_REPLY_BYTES; index++)
+	{
+		p_reply[index] = transfer (LINK_CMD_CONTINUE);
+	}
+	return (when);
+}
+
+
+//-------------------------------------------------------------------------------------
+/** This function checks a snapshot's contents against the counts and speeds and the
+ *  time at which it was asked for.
+ *  @param p_reply The data and CRC the master received
+ *  @param when The cycle at which the command byte came in
+ *  @param p_late Set to how many microseconds the time was after the command, if any
+ *  @return True if everything is as it should be
+ */
+
+static bool snapshot_good (const uint8_t* p_reply, uint64_t when, int32_t* p_late = NULL)
+{
+	link_snapshot snap;
+	memcpy (&snap, p_reply, sizeof (snap));
+
+	int64_t expected = (int64_t)((when - clock_start) / (F_CPU / 1000000UL));
+	int64_t late = (int64_t)snap.time_us - expected;
+	if (p_late != NULL)
+	{
+		*p_late = (int32_t)late;
+	}
+	return (snap.encoder_1 == encoder_1 && snap.encoder_2 == encoder_2
+			&& snap.velocity_1 == velocity_1 && snap.velocity_2 == velocity_2
+			&& late >= 0 && late <= BENCH_TIME_SLACK && crc_matches (p_reply));
+}
+
+
+//-------------------------------------------------------------------------------------
+/** This function sets the counts and speeds to random numbers of random sizes, so that
+ *  the bytes in a snapshot are varied.
+ */
+
+static void randomize (void)
+{
+	int32_t* p_values[4] = { &encoder_1, &encoder_2, &velocity_1, &velocity_2 };
+	for (uint8_t index = 0; index < 4; index++)
+	{
+		int32_t value = (int32_t)(((uint32_t)rand () << 16) ^ (uint32_t)rand ());
+		*p_values[index] = value >> (rand () % 32);
+	}
+}
+
+
+//-------------------------------------------------------------------------------------
+/** This function prints one line of results.
+ *  @param label What was checked
+ *  @param detail A number or two to show, or an empty string
+ *  @param good True if the check passed
+ *  @return The same as good
+ */
+
+static bool show (const char* label, const char* detail, bool good)
+{
+	printf ("%-48s %-26s %s\n", label, detail, good ? "ok" : "FAILED");
+	return (good);
+}
+
+
+//-------------------------------------------------------------------------------------
+/** The main function sets up the slave and plays the master against it.
+ */
+
+int main (void)
+{
+	sim_serial quiet (NULL);
+	uint8_t bytes[8];
+	uint8_t reply[BENCH_REPLY_BYTES];
+	char detail[64];
+	bool good = true;
+	bool ok;
+
+	Slave_Driver slave (&quiet, &encoder_1, &encoder_2, &velocity_1, &velocity_2);
+	clock_start = sim_cycles;
+	sei ();
+	srand (405);
+
+	// The CRC used by both ends against the standard check value for CRC-8/SMBus
+	uint8_t crc = 0;
+	for (const char* p_char = "123456789"; *p_char; p_char++)
+	{
+		crc = link_crc8_update (crc, *p_char);
+	}
+	good &= show ("link_crc8_update() check value is 0xF4", "", crc == 0xF4);
+
+	// Commands 1 and 2, with the count fixed while it's being sent
+	ok = true;
+	for (uint16_t trial = 0; trial < 200; trial++)
+	{
+		randomize ();
+		slave.Packet32 ();
+		uint8_t command = (trial & 1) ? LINK_CMD_READ_2 : LINK_CMD_READ_1;
+		int32_t count = (command == LINK_CMD_READ_1) ? encoder_1 : encoder_2;
+
+		transfer (command);
+		for (uint8_t index = 0; index < 5; index++)
+		{
+			bytes[index] = transfer (LINK_CMD_CONTINUE);
+			encoder_1++;							// The encoders keep moving, and the
+			encoder_2--;							// main loop keeps calling Packet32()
+			slave.Packet32 ();
+		}
+		uint8_t sum = command;
+		for (uint8_t index = 0; index < 4; index++)
+		{
+			sum += bytes[index];
+		}
+		int32_t sent;
+		memcpy (&sent, bytes, 4);
+		ok &= (sent == count && bytes[4] == sum);
+	}
+	good &= show ("Commands 1 and 2 send the count and its sum", "", ok);
+
+	// Commands 3 and 4 echo themselves and clear a count
+	encoder_1 = 1234;
+	encoder_2 = -5678;
+	transfer (LINK_CMD_CLEAR_1);
+	ok = (transfer (LINK_CMD_CONTINUE) == LINK_CMD_CLEAR_1 && encoder_1 == 0
+		  && encoder_2 == -5678);
+	transfer (LINK_CMD_CLEAR_2);
+	ok &= (transfer (LINK_CMD_CONTINUE) == LINK_CMD_CLEAR_2 && encoder_2 == 0);
+	good &= show ("Commands 3 and 4 clear a count and echo", "", ok);
+
+	// Snapshots, checked against the counts, the clock and the CRC; after the CRC the
+	// slave has nothing more to send, so the master gets back its own continue byte
+	ok = true;
+	int32_t latest = 0;
+	for (uint16_t trial = 0; trial < BENCH_FRAMES; trial++)
+	{
+		randomize ();
+		int32_t late;
+		ok &= snapshot_good (reply, read_snapshot (reply), &late);
+		ok &= (transfer (LINK_CMD_CONTINUE) == LINK_CMD_CONTINUE);
+		latest = (late > latest) ? late : latest;
+		sim_spend (rand () % 20000);
+	}
+	snprintf (detail, sizeof (detail), "time up to %ld us late", (long)latest);
+	good &= show ("Snapshots hold the counts, speeds and time", detail, ok);
+
+	// Snapshots taken at every few cycles around a Timer 1 overflow, so that some
+	// overflow during the interrupt, before the overflow interrupt can run
+	ok = true;
+	uint32_t last_time = 0;
+	for (int32_t offset = -400; offset <= 400; offset += 2)
+	{
+		uint64_t overflow = clock_start + ((sim_cycles + 1000 - clock_start)
+										   / BENCH_TIMER_CYCLES + 1) * BENCH_TIMER_CYCLES;
+		sim_spend ((uint32_t)(overflow + offset - sim_cycles));
+		ok &= snapshot_good (reply, read_snapshot (reply));
+		uint32_t time_us;
+		memcpy (&time_us, reply + 8, 4);
+		ok &= (time_us > last_time);
+		last_time = time_us;
+	}
+	good &= show ("Snapshot times are right across overflows", "", ok);
+
+	// Corruption on the way to the master, tried on snapshots of random numbers
+	uint32_t singles = 0, singles_caught = 0, bursts = 0, bursts_caught = 0;
+	uint32_t triples = 0, triples_caught = 0, swaps = 0, swaps_caught = 0, sums_caught = 0;
+	uint32_t slips = 0, slips_caught = 0, garbage = 0, garbage_caught = 0;
+	uint8_t bad[BENCH_REPLY_BYTES + 1];
+	const uint16_t num_bits = BENCH_REPLY_BYTES * 8;
+	for (uint16_t frame = 0; frame < BENCH_FRAMES; frame++)
+	{
+		randomize ();
+		read_snapshot (reply);
+
+		for (uint16_t bit = 0; bit < num_bits; bit++)
+		{
+			memcpy (bad, reply, BENCH_REPLY_BYTES);
+			bad[bit / 8] ^= (0x80 >> (bit % 8));
+			singles++;
+			singles_caught += !crc_matches (bad);
+
+			// Bursts from 2 to 8 bits long, starting and ending with a flipped bit
+			for (uint8_t length = 2; length <= 8 && bit + length <= num_bits; length++)
+			{
+				memcpy (bad, reply, BENCH_REPLY_BYTES);
+				uint8_t pattern = 0x01 | (1 << (length - 1)) | (rand () & ((1 << length) - 1));
+				for (uint8_t step = 0; step < length; step++)
+				{
+					if (pattern & (1 << step))
+					{
+						bad[(bit + step) / 8] ^= (0x80 >> ((bit + step) % 8));
+					}
+				}
+				bursts++;
+				bursts_caught += !crc_matches (bad);
+			}
+		}
+
+		for (uint16_t trial = 0; trial < 200; trial++)
+		{
+			uint16_t flips[3];
+			flips[0] = rand () % num_bits;
+			do { flips[1] = rand () % num_bits; } while (flips[1] == flips[0]);
+			do { flips[2] = rand () % num_bits; } while (flips[2] == flips[0] || flips[2] == flips[1]);
+			memcpy (bad, reply, BENCH_REPLY_BYTES);
+			for (uint8_t index = 0; index < 3; index++)
+			{
+				bad[flips[index] / 8] ^= (0x80 >> (flips[index] % 8));
+			}
+			triples++;
+			triples_caught += !crc_matches (bad);
+		}
+
+		// Swaps of neighbouring data bytes, which leave a sum of the bytes the same
+		for (uint8_t index = 0; index + 1 < LINK_SNAPSHOT_BYTES; index++)
+		{
+			if (reply[index] != reply[index + 1])
+			{
+				memcpy (bad, reply, BENCH_REPLY_BYTES);
+				bad[index] = reply[index + 1];
+				bad[index + 1] = reply[index];
+				uint8_t sum = 0, bad_sum = 0;
+				for (uint8_t byte = 0; byte < LINK_SNAPSHOT_BYTES; byte++)
+				{
+					sum += reply[byte];
+					bad_sum += bad[byte];
+				}
+				swaps++;
+				swaps_caught += !crc_matches (bad);
+				sums_caught += (sum != bad_sum);
+			}
+		}
+
+		// The master missed the first byte, or saw an extra 0xFF in front
+		memcpy (bad, reply + 1, BENCH_REPLY_BYTES - 1);
+		bad[BENCH_REPLY_BYTES - 1] = 0xFF;
+		slips_caught += !crc_matches (bad);
+		bad[0] = 0xFF;
+		memcpy (bad + 1, reply, BENCH_REPLY_BYTES - 1);
+		slips_caught += !crc_matches (bad);
+		slips += 2;
+
+		for (uint16_t trial = 0; trial < BENCH_GARBAGE; trial++)
+		{
+			for (uint8_t index = 0; index < BENCH_REPLY_BYTES; index++)
+			{
+				bad[index] = rand ();
+			}
+			if (memcmp (bad, reply, BENCH_REPLY_BYTES) != 0)
+			{
+				garbage++;
+				garbage_caught += !crc_matches (bad);
+			}
+		}
+	}
+
+	snprintf (detail, sizeof (detail), "%lu of %lu", (unsigned long)singles_caught,
+			  (unsigned long)singles);
+	good &= show ("Single bit errors caught by the CRC", detail, singles_caught == singles);
+	snprintf (detail, sizeof (detail), "%lu of %lu", (unsigned long)bursts_caught,
+			  (unsigned long)bursts);
+	good &= show ("Bursts of 2 to 8 bits caught", detail, bursts_caught == bursts);
+	snprintf (detail, sizeof (detail), "%lu of %lu", (unsigned long)triples_caught,
+			  (unsigned long)triples);
+	good &= show ("Three bit errors caught", detail, triples_caught == triples);
+	snprintf (detail, sizeof (detail), "CRC %lu, sum %lu, of %lu",
+			  (unsigned long)swaps_caught, (unsigned long)sums_caught, (unsigned long)swaps);
+	good &= show ("Swapped neighbouring bytes caught", detail,
+				  swaps_caught >= swaps * 0.99 && sums_caught == 0);
+	snprintf (detail, sizeof (detail), "%lu of %lu", (unsigned long)slips_caught,
+			  (unsigned long)slips);
+	good &= show ("Frames slipped by a byte caught", detail, slips_caught >= slips * 0.98);
+	snprintf (detail, sizeof (detail), "%.3f%% missed", 100.0 * (garbage - garbage_caught)
+			  / garbage);
+	good &= show ("Random frames caught", detail, garbage_caught >= garbage * 0.99);
+
+	// A continue byte which reaches the slave as something else isn't answered, so the
+	// master gets back that byte in place of data, and every byte after comes one late;
+	// the last one can't do any harm, as the CRC has been loaded by then
+	uint32_t spoiled = 0, spoiled_caught = 0;
+	ok = true;
+	for (uint8_t index = 0; index < BENCH_REPLY_BYTES - 1; index++)
+	{
+		for (uint8_t bit = 0; bit < 8; bit++)
+		{
+			randomize ();
+			transfer (LINK_CMD_SNAPSHOT);
+			for (uint8_t count = 0; count < BENCH_REPLY_BYTES; count++)
+			{
+				uint8_t mosi = (count == index) ? (LINK_CMD_CONTINUE ^ (1 << bit))
+												: LINK_CMD_CONTINUE;
+				if (mosi >= LINK_CMD_READ_1 && mosi <= LINK_CMD_SNAPSHOT)
+				{
+					mosi = 0x7F;						// Keep to bytes which aren't commands
+				}
+				bad[count] = transfer (mosi);
+			}
+			spoiled++;
+			spoiled_caught += !crc_matches (bad);
+
+			// The next snapshot must be good, as the master's retry would be
+			randomize ();
+			ok &= snapshot_good (reply, read_snapshot (reply));
+		}
+	}
+	snprintf (detail, sizeof (detail), "%lu of %lu", (unsigned long)spoiled_caught,
+			  (unsigned long)spoiled);
+	good &= show ("Corrupted continue bytes spoil the frame", detail, spoiled_caught == spoiled);
+	good &= show ("The retry after each one is good", "", ok);
+
+	// Frames cut short at every length, and unknown commands, then a good snapshot
+	ok = true;
+	for (uint8_t length = 0; length < BENCH_REPLY_BYTES; length++)
+	{
+		transfer (LINK_CMD_SNAPSHOT);
+		for (uint8_t count = 0; count < length; count++)
+		{
+			transfer (LINK_CMD_CONTINUE);
+		}
+		randomize ();
+		ok &= snapshot_good (reply, read_snapshot (reply));
+	}
+	for (uint16_t command = 0x00; command < 0xFF; command++)
+	{
+		if (command >= LINK_CMD_READ_1 && command <= LINK_CMD_SNAPSHOT)
+		{
+			continue;
+		}
+		transfer (command);
+		transfer (LINK_CMD_CONTINUE);
+	}
+	randomize ();
+	ok &= snapshot_good (reply, read_snapshot (reply));
+	good &= show ("Short frames and unknown commands are harmless", "", ok);
+
+	// A count read cut short holds the count, until a snapshot lets it go
+	encoder_1 = 100;
+	slave.Packet32 ();
+	transfer (LINK_CMD_READ_1);
+	transfer (LINK_CMD_CONTINUE);
+	randomize ();
+	read_snapshot (reply);
+	encoder_1 = 200;
+	slave.Packet32 ();
+	read_count (LINK_CMD_READ_1, bytes);
+	int32_t sent;
+	memcpy (&sent, bytes, 4);
+	good &= show ("A snapshot frees a count held by a short read", "", sent == 200);
+
+	printf ("\n%s\n", good ? "All checks passed" : "Some checks FAILED");
+	return (good ? 0 : 1);
+}
@@ -0,0 +1,653 @@
+//*************************************************************************************
+/** \file spsc_bench.cpp
+ *    This program stress tests the single producer, single consumer queue in
+ *    spsc_queue.h on a PC. On the AVR one side of the queue is an interrupt service
+ *    routine which may break into the other side between any two instructions. Here a
+ *    timer signal stands in for the interrupt: its handler is called every few
+ *    microseconds, wherever the main program happens to be, just as an interrupt
+ *    would be. In one test the handler is the producer, putting bursts of numbers
+ *    which count up, and the main program is the consumer; in the other the main
+ *    program produces and the handler consumes, as the serial transmit interrupt does
+ *    with rs232's buffer. Each side uses all of its methods in turn, single items,
+ *    bulk copies and working in place with spans, and the consumer checks that every
+ *    number comes out once and in order. Small queues are used, so that the queue is
+ *    often full and often empty, as well as the largest one an 8-bit index allows.
+ *
+ *    The same tests are run on the queue in queue.h which was used before. Its count
+ *    of items is changed by both sides, so the main program's side must turn off
+ *    interrupts around each call. Here a flag stands in for the AVR's interrupt enable
+ *    bit: while it's clear, a timer signal is only noted, and the handler is run when
+ *    the flag is set again, as the AVR runs an interrupt which came while they were
+ *    off. That queue has no bulk methods, so it's used one item at a time.
+ *
+ *    Before the stress tests, the edge cases are checked without interruption, and
+ *    both queues are timed with 32-bit items: queue.h's with the main program's side
+ *    guarded, a call at a time and a burst at a time, and spsc_queue a call at a time
+ *    and with put_n() and get_n(). The main program plays the producer, as with a
+ *    transmit buffer, and the consumer's side is called as an interrupt would call it.
+ *
+ *    Usage: spsc_bench
+ *    The program returns 1 if a check fails.
+ *
+ *  Revisions:
+ *    \li 06-29-2011 Original file
+ *
+ *  License:
+ *    This file is released under the Lesser GNU Public License, version 2. This
+ *    program is intended for educational use only, but it is not limited thereto.
+ */
+//*************************************************************************************
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <signal.h>
+#include <time.h>
+#include <sys/time.h>
+#include "queue.h"
+#include "spsc_queue.h"
+
+
+/// How many seconds each stress test runs
+#define BENCH_SECONDS		1
+
+/// Microseconds between the timer signals which stand in for interrupts
+#define BENCH_SIGNAL_US		20
+
+/// How many items are put and gotten for the timing
+#define BENCH_ITEMS			20000000L
+
+/// The largest burst put or gotten by one call
+#define BENCH_BURST			9
+
+/// How many items are put and gotten at a time for the timing of bursts
+#define BENCH_TIME_BURST	8
+
+
+/// These are counted by both sides of each test; the handler changes them, so they
+/// are volatile
+static volatile uint32_t next_put;			///< Number the producer puts next
+static volatile uint32_t next_get;			///< Number the consumer expects next
+static volatile uint32_t errors;			///< Numbers which came out wrong
+static volatile uint32_t signals;			///< Times the handler was called
+
+/// Results are put here so that the compiler can't leave out the work done for them
+static volatile uint32_t bench_sink;
+
+/// This is the handler which the timer signal calls for the test being run
+static void (*volatile p_handler)(void) = NULL;
+
+/// This is true while the main program has "interrupts" off, so the handler must wait
+static volatile bool masked = false;
+
+/// This is set when a signal came while masked, as an AVR sets an interrupt's flag
+static volatile bool pending = false;
+
+
+//-------------------------------------------------------------------------------------
+/** This function makes a pseudo-random number for choosing methods and burst sizes.
+ *  The handler and the main program each have their own seed, so that neither
+ *  changes the other's.
+ *  @param p_seed A pointer to the seed, which is updated
+ *  @return A number from 0 to 32767
+ */
+
+static unsigned int bench_random (uint32_t* p_seed)
+{
+	*p_seed = *p_seed * 1103515245UL + 12345UL;
+	return ((unsigned int)(*p_seed >> 16) & 0x7FFF);
+}
+
+
+//-------------------------------------------------------------------------------------
+/** This function checks a number taken out of the queue against the one expected.
+ *  @param data The number taken out
+ */
+
+static inline void check_item (uint32_t data)
+{
+	if (data != next_get)
+	{
+		errors = errors + 1;
+		next_get = data;					// Carry on from here, to count each error once
+	}
+	next_get = next_get + 1;
+}
+
+
+//-------------------------------------------------------------------------------------
+/** This function is called by the timer signal. It calls the handler of the test
+ *  being run, as the interrupt vector would call an interrupt service routine.
+ */
+
+static void on_signal (int)
+{
+	signals = signals + 1;
+	if (masked)
+	{
+		pending = true;
+	}
+	else if (p_handler != NULL)
+	{
+		p_handler ();
+	}
+}
+
+
+//-------------------------------------------------------------------------------------
+/** This function turns off "interrupts" as the main program's side of queue.h's queue
+ *  must, like saving SREG and calling cli() on the AVR.
+ *  @return Whether they were off already, to be given to bench_restore()
+ */
+
+static inline bool bench_cli (void)
+{
+	bool was_masked = masked;
+	masked = true;
+	SPSC_BARRIER ();
+	return (was_masked);
+}
+
+
+//-------------------------------------------------------------------------------------
+/** This function puts "interrupts" back as they were, like restoring SREG. If they're
+ *  turned on and a signal came while they were off, the handler is run now, with them
+ *  off again, as the AVR would run the interrupt.
+ *  @param was_masked What bench_cli() returned
+ */
+
+static inline void bench_restore (bool was_masked)
+{
+	SPSC_BARRIER ();
+	masked = was_masked;
+	if (!was_masked && pending)
+	{
+		masked = true;
+		pending = false;
+		if (p_handler != NULL)
+		{
+			p_handler ();
+		}
+		masked = false;
+	}
+}
+
+
+//-------------------------------------------------------------------------------------
+/** This class holds one test: a queue of the given type, the producer's and the
+ *  consumer's code, each using the queue's methods in turn, and the handlers which
+ *  put one side in the timer signal.
+ */
+
+template <class qIndexType, qIndexType qSize>
+class spsc_test
+{
+	public:
+		static spsc_queue<uint32_t, qIndexType, qSize> queue;	///< The queue tested
+		static uint32_t put_seed;			///< Random numbers for the producer
+		static uint32_t get_seed;			///< Random numbers for the consumer
+
+		/// This method puts a burst of numbers using one of the producer's methods
+		static void produce (void)
+		{
+			uint32_t burst[BENCH_BURST];
+			uint32_t* p_space;
+			qIndexType count, limit;
+
+			switch (bench_random (&put_seed) % 3)
+			{
+				case 0:
+					if (!queue.put (next_put))
+					{
+						next_put = next_put + 1;
+					}
+					break;
+
+				case 1:
+					count = (qIndexType)(1 + bench_random (&put_seed) % BENCH_BURST);
+					for (qIndexType index = 0; index < count; index++)
+					{
+						burst[index] = next_put + index;
+					}
+					next_put = next_put + queue.put_n (burst, count);
+					break;
+
+				default:
+					count = queue.write_span (&p_space);
+					limit = (qIndexType)(1 + bench_random (&put_seed) % BENCH_BURST);
+					if (count > limit)
+					{
+						count = limit;
+					}
+					for (qIndexType index = 0; index < count; index++)
+					{
+						p_space[index] = next_put + index;
+					}
+					queue.commit (count);
+					next_put = next_put + count;
+					break;
+			}
+		}
+
+		/// This method takes numbers out using one of the consumer's methods
+		static void consume (void)
+		{
+			uint32_t burst[BENCH_BURST];
+			uint32_t* p_data;
+			qIndexType count, limit;
+
+			switch (bench_random (&get_seed) % 3)
+			{
+				case 0:
+					if (!queue.is_empty ())
+					{
+						check_item (queue.get ());
+					}
+					break;
+
+				case 1:
+					count = (qIndexType)(1 + bench_random (&get_seed) % BENCH_BURST);
+					count = queue.get_n (burst, count);
+					for (qIndexType index = 0; index < count; index++)
+					{
+						check_item (burst[index]);
+					}
+					break;
+
+				default:
+					count = queue.peek_span (&p_data);
+					limit = (qIndexType)(1 + bench_random (&get_seed) % BENCH_BURST);
+					if (count > limit)
+					{
+						count = limit;
+					}
+					for (qIndexType index = 0; index < count; index++)
+					{
+						check_item (p_data[index]);
+					}
+					queue.consume (count);
+					break;
+			}
+		}
+
+		/// This handler produces a few bursts, as a receive interrupt would
+		static void producer_handler (void)
+		{
+			for (int bursts = 1 + bench_random (&put_seed) % 3; bursts > 0; bursts--)
+			{
+				produce ();
+			}
+		}
+
+		/// This handler consumes a few bursts, as a transmit interrupt would
+		static void consumer_handler (void)
+		{
+			for (int bursts = 1 + bench_random (&get_seed) % 3; bursts > 0; bursts--)
+			{
+				consume ();
+			}
+		}
+
+		/** This method runs the test with one side in the handler and the other in
+		 *  the main program, then empties the queue and checks the count.
+		 *  @param handler_produces True if the handler is the producer
+		 *  @return True if every number came out once and in order
+		 */
+		static bool run (bool handler_produces)
+		{
+			queue.flush ();
+			next_put = 0;
+			next_get = 0;
+			errors = 0;
+			signals = 0;
+			put_seed = 1;
+			get_seed = 2;
+
+			p_handler = handler_produces ? producer_handler : consumer_handler;
+			time_t end_time = time (NULL) + BENCH_SECONDS;
+			while (time (NULL) < end_time)
+			{
+				for (int count = 0; count < 1000; count++)
+				{
+					if (handler_produces)
+					{
+						consume ();
+					}
+					else
+					{
+						produce ();
+					}
+				}
+			}
+			p_handler = NULL;
+
+			// Take out what the last interrupts left
+			while (!queue.is_empty ())
+			{
+				consume ();
+			}
+
+			bool good = (errors == 0 && next_get == next_put);
+			printf ("spsc_queue  %-8s  %5u  %-8s  %10lu  %7lu  %6lu  %s\n",
+					(sizeof (qIndexType) == 1) ? "uint8_t" : "uint16_t", (unsigned)qSize,
+					handler_produces ? "producer" : "consumer", (unsigned long)next_get,
+					(unsigned long)signals, (unsigned long)errors, good ? "ok" : "FAILED");
+			return (good);
+		}
+};
+
+template <class qIndexType, qIndexType qSize>
+spsc_queue<uint32_t, qIndexType, qSize> spsc_test<qIndexType, qSize>::queue;
+template <class qIndexType, qIndexType qSize>
+uint32_t spsc_test<qIndexType, qSize>::put_seed;
+template <class qIndexType, qIndexType qSize>
+uint32_t spsc_test<qIndexType, qSize>::get_seed;
+
+
+//-------------------------------------------------------------------------------------
+/** This class holds the same test for the queue in queue.h, which both sides change
+ *  the count of. The handler's side is called with interrupts off, as an ISR is, and
+ *  the main program turns them off around each of its calls.
+ */
+
+template <uint8_t qSize>
+class masked_test
+{
+	public:
+		static queue<uint32_t, uint8_t, qSize> old_queue;	///< The queue tested
+		static uint32_t put_seed;			///< Random numbers for the producer
+		static uint32_t get_seed;			///< Random numbers for the consumer
+
+		/// This method puts a burst of numbers, one at a time, until the queue is full
+		static void produce (void)
+		{
+			for (int count = 1 + bench_random (&put_seed) % BENCH_BURST; count > 0;
+				 count--)
+			{
+				if (old_queue.put (next_put))
+				{
+					break;
+				}
+				next_put = next_put + 1;
+			}
+		}
+
+		/// This method takes a burst of numbers out, one at a time
+		static void consume (void)
+		{
+			for (int count = 1 + bench_random (&get_seed) % BENCH_BURST;
+				 count > 0 && !old_queue.is_empty (); count--)
+			{
+				check_item (old_queue.get ());
+			}
+		}
+
+		/// This handler produces, as a receive interrupt would
+		static void producer_handler (void) { produce (); }
+
+		/// This handler consumes, as a transmit interrupt would
+		static void consumer_handler (void) { consume (); }
+
+		/** This method runs the test with one side in the handler and the other in
+		 *  the main program, which guards each of its calls.
+		 *  @param handler_produces True if the handler is the producer
+		 *  @return True if every number came out once and in order
+		 */
+		static bool run (bool handler_produces)
+		{
+			old_queue.flush ();
+			next_put = 0;
+			next_get = 0;
+			errors = 0;
+			signals = 0;
+			put_seed = 1;
+			get_seed = 2;
+
+			p_handler = handler_produces ? producer_handler : consumer_handler;
+			time_t end_time = time (NULL) + BENCH_SECONDS;
+			while (time (NULL) < end_time)
+			{
+				for (int count = 0; count < 1000; count++)
+				{
+					bool was_masked = bench_cli ();
+					if (handler_produces)
+					{
+						consume ();
+					}
+					else
+					{
+						produce ();
+					}
+					bench_restore (was_masked);
+				}
+			}
+			p_handler = NULL;
+
+			while (!old_queue.is_empty ())
+			{
+				consume ();
+			}
+
+			bool good = (errors == 0 && next_get == next_put);
+			printf ("queue       %-8s  %5u  %-8s  %10lu  %7lu  %6lu  %s\n", "uint8_t",
+					(unsigned)qSize, handler_produces ? "producer" : "consumer",
+					(unsigned long)next_get, (unsigned long)signals,
+					(unsigned long)errors, good ? "ok" : "FAILED");
+			return (good);
+		}
+};
+
+template <uint8_t qSize>
+queue<uint32_t, uint8_t, qSize> masked_test<qSize>::old_queue;
+template <uint8_t qSize>
+uint32_t masked_test<qSize>::put_seed;
+template <uint8_t qSize>
+uint32_t masked_test<qSize>::get_seed;
+
+
+//-------------------------------------------------------------------------------------
+/** This function checks the queue's edge cases without any interruption: empty and
+ *  full queues, spans which stop at the end of the buffer, and indices which wrap.
+ *  @return True if the checks passed
+ */
+
+static bool check_edges (void)
+{
+	spsc_queue<uint32_t, uint8_t, 8> queue;
+	uint32_t data[16];
+	uint32_t* p_span;
+	bool good = true;
+
+	// An empty queue gives nothing and isn't changed by get()
+	good &= queue.is_empty () && queue.num_items () == 0 && queue.num_free () == 8;
+	queue.get ();
+	good &= queue.is_empty () && queue.get_n (data, 4) == 0 && queue.peek_span (&p_span) == 0;
+
+	// A full queue refuses more
+	for (uint32_t count = 0; count < 8; count++)
+	{
+		good &= !queue.put (count);
+	}
+	good &= queue.is_full () && queue.put (99) && queue.put_n (data, 3) == 0;
+	good &= queue.write_span (&p_span) == 0;
+	good &= queue.get () == 0 && queue.num_items () == 7;
+
+	// Go around the buffer many times, so the 8-bit indices wrap too
+	uint32_t next_put = 8, next_get = 1;
+	for (int round = 0; round < 1000; round++)
+	{
+		for (uint32_t index = 0; index < 5; index++)
+		{
+			data[index] = next_put + index;
+		}
+		next_put += queue.put_n (data, 5);
+		uint8_t count = queue.peek_span (&p_span);
+		good &= (count > 0 && count <= 8);
+		for (uint8_t index = 0; index < count; index++)
+		{
+			good &= (p_span[index] == next_get++);
+		}
+		queue.consume (count);
+	}
+	while (!queue.is_empty ())
+	{
+		good &= (queue.get () == next_get++);
+	}
+	good &= (next_get == next_put);
+
+	// Spans stop at the end of the buffer and the rest follows at the start
+	spsc_queue<uint32_t, uint8_t, 8> fresh;
+	for (uint32_t count = 0; count < 6; count++)
+	{
+		fresh.put (count);
+	}
+	fresh.get_n (data, 6);
+	good &= (fresh.write_span (&p_span) == 2);
+	p_span[0] = 10;
+	p_span[1] = 11;
+	fresh.commit (2);
+	good &= (fresh.write_span (&p_span) == 6);
+	good &= (fresh.peek_span (&p_span) == 2 && p_span[0] == 10 && p_span[1] == 11);
+
+	printf ("Edge checks %s\n", good ? "passed" : "FAILED");
+	return (good);
+}
+
+
+//-------------------------------------------------------------------------------------
+/** This function reads a clock in nanoseconds.
+ *  @return The time in nanoseconds
+ */
+
+static double bench_ns (void)
+{
+	struct timespec now;
+	clock_gettime (CLOCK_MONOTONIC, &now);
+	return (now.tv_sec * 1.0E9 + now.tv_nsec);
+}
+
+
+//-------------------------------------------------------------------------------------
+/** This function times both queues of one size with 32-bit items. The main program
+ *  puts items in, guarding queue.h's queue as it must, and takes them out again as an
+ *  interrupt would, unguarded. No signals come while it runs.
+ */
+
+template <uint8_t qSize>
+static void time_queues (void)
+{
+	static queue<uint32_t, uint8_t, qSize> old_queue;
+	static spsc_queue<uint32_t, uint8_t, qSize> new_queue;
+	uint32_t burst[BENCH_TIME_BURST];
+	double ns[4];
+	uint32_t sums[4] = {0, 0, 0, 0};
+
+	// queue.h's queue, with interrupts off around each put
+	double start_ns = bench_ns ();
+	for (long count = 0; count < BENCH_ITEMS; count++)
+	{
+		bool was_masked = bench_cli ();
+		old_queue.put ((uint32_t)count);
+		bench_restore (was_masked);
+		sums[0] += old_queue.get ();
+	}
+	ns[0] = (bench_ns () - start_ns) / BENCH_ITEMS;
+
+	// queue.h's queue, with interrupts off around a burst of puts
+	start_ns = bench_ns ();
+	for (long count = 0; count < BENCH_ITEMS; count += BENCH_TIME_BURST)
+	{
+		bool was_masked = bench_cli ();
+		for (uint8_t index = 0; index < BENCH_TIME_BURST; index++)
+		{
+			old_queue.put ((uint32_t)(count + index));
+		}
+		bench_restore (was_masked);
+		for (uint8_t index = 0; index < BENCH_TIME_BURST; index++)
+		{
+			sums[1] += old_queue.get ();
+		}
+	}
+	ns[1] = (bench_ns () - start_ns) / BENCH_ITEMS;
+
+	// spsc_queue, one item at a time
+	start_ns = bench_ns ();
+	for (long count = 0; count < BENCH_ITEMS; count++)
+	{
+		new_queue.put ((uint32_t)count);
+		sums[2] += new_queue.get ();
+	}
+	ns[2] = (bench_ns () - start_ns) / BENCH_ITEMS;
+
+	// spsc_queue, a burst at a time with put_n() and get_n()
+	start_ns = bench_ns ();
+	for (long count = 0; count < BENCH_ITEMS; count += BENCH_TIME_BURST)
+	{
+		for (uint8_t index = 0; index < BENCH_TIME_BURST; index++)
+		{
+			burst[index] = (uint32_t)(count + index);
+		}
+		new_queue.put_n (burst, BENCH_TIME_BURST);
+		new_queue.get_n (burst, BENCH_TIME_BURST);
+		for (uint8_t index = 0; index < BENCH_TIME_BURST; index++)
+		{
+			sums[3] += burst[index];
+		}
+	}
+	ns[3] = (bench_ns () - start_ns) / BENCH_ITEMS;
+
+	printf ("%5u  %14.2f  %14.2f  %14.2f  %14.2f\n", (unsigned)qSize, ns[0], ns[1],
+			ns[2], ns[3]);
+	bench_sink = sums[0] + sums[1] + sums[2] + sums[3];
+}
+
+
+//-------------------------------------------------------------------------------------
+/** The main function checks the edge cases, times the queues, then runs the stress
+ *  tests with the timer signal standing in for an interrupt.
+ */
+
+int main (void)
+{
+	bool good = check_edges ();
+
+	char per_guard[16];
+	snprintf (per_guard, sizeof (per_guard), "%u per guard", BENCH_TIME_BURST);
+	printf ("\nTime per 32-bit item, ns\n");
+	printf ("%5s  %14s  %14s  %14s  %14s\n", "", "queue.h", "queue.h", "spsc_queue",
+			"spsc_queue");
+	printf ("%5s  %14s  %14s  %14s  %14s\n", "size", "put guarded", per_guard,
+			"put, get", "put_n, get_n");
+	time_queues<16> ();
+	time_queues<128> ();
+	printf ("\n");
+
+	// Start the timer signal
+	struct sigaction action;
+	memset (&action, 0, sizeof (action));
+	action.sa_handler = on_signal;
+	sigaction (SIGALRM, &action, NULL);
+	struct itimerval period = {{0, BENCH_SIGNAL_US}, {0, BENCH_SIGNAL_US}};
+	setitimer (ITIMER_REAL, &period, NULL);
+
+	printf ("queue       index     size  handler        items  signals  errors\n");
+	good &= spsc_test<uint8_t, 4>::run (true);
+	good &= spsc_test<uint8_t, 4>::run (false);
+	good &= spsc_test<uint8_t, 16>::run (true);
+	good &= spsc_test<uint8_t, 16>::run (false);
+	good &= spsc_test<uint8_t, 128>::run (true);
+	good &= spsc_test<uint8_t, 128>::run (false);
+	good &= spsc_test<uint16_t, 1024>::run (true);
+	good &= spsc_test<uint16_t, 1024>::run (false);
+	good &= masked_test<16>::run (true);
+	good &= masked_test<16>::run (false);
+	good &= masked_test<128>::run (true);
+	good &= masked_test<128>::run (false);
+
+	struct itimerval stop = {{0, 0}, {0, 0}};
+	setitimer (ITIMER_REAL, &stop, NULL);
+
+	printf ("\n%s\n", good ? "All checks passed" : "Some checks FAILED");
+	return (good ? 0 : 1);
+}
@@ -0,0 +1,832 @@
+//*************************************************************************************
+/** \file telemetry_bench.cpp
+ *    This program runs the telemetry class in telemetry.cpp through the rs232 driver on
+ *    the simulated processor in sim_avr.cpp, whose USART sends each character in the
+ *    time it would take at 9600 baud, and checks what comes out with the decoder's own
+ *    code from tools/telemetry_frames.h.
+ *
+ *    First, the samples which task_telemetry sends on each run, an encoder record and
+ *    a record for each PID controller, are sent as binary frames with telemetry::send()
+ *    and, holding the same numbers, as lines of text written with the "<<" operators,
+ *    each after a time record. Samples are written as fast as the port takes them to
+ *    find the most samples per second each way can sustain, then at fixed rates as a
+ *    task would write them. A binary frame which doesn't fit in the transmit buffer is
+ *    dropped, and the decoder must see a gap in the sequence for each one; text waits
+ *    in putchar() for room instead, which makes the writing task late.
+ *
+ *    Then frames of many lengths, many of whose bytes are zeros, are sent with text
+ *    between them, and must all come back from the decoder as they were sent. The same
+ *    stream is sent through the decoder again with every other frame damaged, by a bit
+ *    flipped, a byte set to zero, a byte lost or a byte added; no damaged frame may
+ *    get through, each must show up as a lost frame, and all the others must decode.
+ *
+ *    As in rs232_bench, putchar()'s wait loop doesn't touch any registers, so while the
+ *    transmit buffer is full the bench lets time pass in small steps until there's
+ *    room, counting that time as part of the putchar() call.
+ *
+ *    Usage: telemetry_bench
+ *
+ *  Revisions:
+ *    \li 06-30-2011 Original file
+ *
+ *  License:
+ *    This file is released under the Lesser GNU Public License, version 2. This
+ *    program is intended for educational use only, but it is not limited thereto.
+ */
+//*************************************************************************************
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <avr/io.h>
+#include <avr/interrupt.h>
+#include "sim_avr.h"
+#include "rs232int.h"
+#include "telemetry.h"
+#include "telemetry_frames.h"
+
+
+/// The baud rate, as the plotter's port runs at
+#define BENCH_BAUD			9600
+
+/// The serial port used, as in Polar_Plotter.cpp
+#define BENCH_PORT			1
+
+/// Cycles which pass in each step while putchar() waits for room
+#define BENCH_WAIT_STEP		8
+
+/// Time stamp ticks per second, as task_telemetry sends in its time record
+#define BENCH_TICKS_PER_SEC	(F_CPU / 8UL)
+
+/// Samples written in each measurement
+#define BENCH_SAMPLES		100
+
+/// Frames of random lengths and contents sent for the round trip
+#define BENCH_RANDOM_FRAMES	300
+
+/// A line of text is written after this many of the random frames
+#define BENCH_TEXT_EVERY	50
+
+/// The most characters the bench keeps of what the USART sends
+#define BENCH_MAX_SENT		65536UL
+
+/// The most frames the bench keeps track of in one run
+#define BENCH_MAX_FRAMES	1024
+
+/// The longest run of bytes between zeros the bench's decoder holds, as the decoder's
+#define BENCH_SEGMENT_SIZE	512
+
+
+//-------------------------------------------------------------------------------------
+/** This structure holds one sample, the records task_telemetry sends on each run.
+ */
+
+typedef struct
+{
+	tlm_encoders_rec encoders;				///< Both encoder counts
+	tlm_pid_rec pid[2];						///< The state of each PID controller
+} bench_sample;
+
+
+//-------------------------------------------------------------------------------------
+/** This structure holds one frame, as it was sent or as it was decoded.
+ */
+
+typedef struct
+{
+	uint8_t type;							///< The record type
+	uint8_t sequence;						///< The frame's sequence number
+	uint8_t length;							///< Bytes of data in the record
+	uint8_t data[TLM_MAX_PAYLOAD];			///< The record's data
+} bench_frame;
+
+
+//-------------------------------------------------------------------------------------
+/** This structure holds the counts the decoder keeps as it reads a stream.
+ */
+
+typedef struct
+{
+	uint16_t good;							///< Frames which passed their CRC check
+	uint16_t bad;							///< Frames which failed their CRC check
+	uint16_t text;							///< Runs of bytes which weren't frames
+	uint16_t lost;							///< Frames missing from the sequence
+} bench_decoded;
+
+
+/// The characters which the USART has sent
+static uint8_t sent[BENCH_MAX_SENT];
+
+/// How many characters the USART has sent
+static uint32_t num_sent = 0;
+
+/// When the last character finished being sent
+static uint64_t last_sent_at;
+
+/// The frames which telemetry::send() took, in the order they were sent
+static bench_frame expected[BENCH_MAX_FRAMES];
+
+/// How many frames are in expected[]
+static uint16_t num_expected;
+
+/// How many times telemetry::send() has been called, which gives each frame its number
+static uint16_t send_calls;
+
+/// Frames dropped before the last one which was sent, which the decoder can see
+static uint16_t dropped_before_last;
+
+/// The frames which the decoder found
+static bench_frame decoded[BENCH_MAX_FRAMES];
+
+/// The text which should have come out of the port, for the text samples
+static char text_expected[BENCH_MAX_SENT];
+
+/// How many characters are in text_expected[]
+static uint32_t text_length;
+
+/// This counts the checks which have failed
+static int failures = 0;
+
+
+//-------------------------------------------------------------------------------------
+/** This function receives the characters sent by the simulated USARTs, keeping those
+ *  from the port being tested.
+ *  @param port The USART's number
+ *  @param data The character
+ */
+
+static void bench_uart_sink (uint8_t port, uint8_t data)
+{
+	if (port != BENCH_PORT)
+	{
+		return;
+	}
+	last_sent_at = sim_cycles;
+	if (num_sent < BENCH_MAX_SENT)
+	{
+		sent[num_sent++] = data;
+	}
+}
+
+
+//-------------------------------------------------------------------------------------
+/** This class lets time pass while putchar() waits for room in the transmit buffer,
+ *  and gives the bench a look at the buffer.
+ */
+
+class bench_rs232 : public rs232
+{
+	public:
+		/** The constructor sets up the port as rs232's does.
+		 *  @param baud_rate The baud rate
+		 *  @param port_number The USART's number
+		 */
+		bench_rs232 (unsigned int baud_rate, unsigned char port_number)
+			: rs232 (baud_rate, port_number) { }
+
+		/** This method writes one character, letting time pass first until there's
+		 *  room for it, as rs232::putchar() would while it waits.
+		 *  @param chout The character to be sent out
+		 *  @return True if the character was buffered or sent
+		 */
+		bool putchar (char chout)
+		{
+			while ((sim_peek (SIM_SREG) & (1 << SREG_I)) && !ready_to_send ())
+			{
+				sim_spend (BENCH_WAIT_STEP);
+			}
+			return (rs232::putchar (chout));
+		}
+
+		/// This method returns the number of characters waiting in the buffer
+		uint8_t buffered (void) { return (p_tx_buffer->num_items ()); }
+};
+
+
+//-------------------------------------------------------------------------------------
+/** This function lets the simulation run until the port has sent everything.
+ *  @param port The port
+ */
+
+static void drain (bench_rs232& port)
+{
+	while (port.buffered () > 0 || port.is_sending ())
+	{
+		sim_spend (100);
+	}
+}
+
+
+//-------------------------------------------------------------------------------------
+/** This function counts a check if it failed.
+ *  @param passed True if the check passed
+ *  @return The same
+ */
+
+static bool check (bool passed)
+{
+	if (!passed)
+	{
+		failures++;
+	}
+	return (passed);
+}
+
+
+//-------------------------------------------------------------------------------------
+/** This function sends one record with telemetry::send(), keeping a copy of each
+ *  frame which is sent.
+ *  @param tlm The telemetry channel
+ *  @param type The record type
+ *  @param p_data A pointer to the record's data
+ *  @param length The number of bytes of data
+ *  @return True if the frame was sent, false if it was dropped
+ */
+
+static bool send_record (telemetry& tlm, uint8_t type, const void* p_data,
+						 uint8_t length)
+{
+	uint8_t sequence = (uint8_t)send_calls++;
+	if (!tlm.send (type, p_data, length))
+	{
+		return (false);
+	}
+	if (num_expected < BENCH_MAX_FRAMES)
+	{
+		bench_frame& frame = expected[num_expected++];
+		frame.type = type;
+		frame.sequence = sequence;
+		frame.length = length;
+		memcpy (frame.data, p_data, length);
+	}
+	dropped_before_last = tlm.get_frames_dropped ();
+	return (true);
+}
+
+
+//-------------------------------------------------------------------------------------
+/** This function starts a new run: the port's output and the frames kept are cleared
+ *  and a new telemetry channel, whose sequence starts at 0, is to be used.
+ */
+
+static void start_run (void)
+{
+	num_sent = 0;
+	num_expected = 0;
+	send_calls = 0;
+	dropped_before_last = 0;
+	text_length = 0;
+}
+
+
+//-------------------------------------------------------------------------------------
+/** This function fills in a sample, with numbers which change from one sample to the
+ *  next and have different numbers of digits, as a moving plotter's would.
+ *  @param sample The sample to be filled in
+ *  @param index The sample's number
+ */
+
+static void make_sample (bench_sample& sample, uint16_t index)
+{
+	uint32_t now = (uint32_t)(sim_cycles / (F_CPU / BENCH_TICKS_PER_SEC));
+
+	sample.encoders.time = now;
+	sample.encoders.encoder_1 = 1200 + 37L * index;
+	sample.encoders.encoder_2 = 4500 - 113L * index;
+	for (uint8_t motor = 0; motor < 2; motor++)
+	{
+		tlm_pid_rec& pid = sample.pid[motor];
+		pid.time = now;
+		pid.motor = motor + 1;
+		pid.running = 1;
+		pid.encoder = (motor == 0) ? sample.encoders.encoder_1
+								   : sample.encoders.encoder_2;
+		pid.setpoint = pid.encoder + ((index & 1) ? 25 : -9);
+		pid.error_sum = (int32_t)index * 3 - 150;
+		pid.output = (int16_t)((index * 41) % 511 - 255);
+	}
+}
+
+
+//-------------------------------------------------------------------------------------
+/** This function sends a sample as binary frames, as task_telemetry does.
+ *  @param tlm The telemetry channel
+ *  @param sample The sample
+ */
+
+static void send_binary (telemetry& tlm, const bench_sample& sample)
+{
+	send_record (tlm, TLM_REC_ENCODERS, &sample.encoders, sizeof (sample.encoders));
+	send_record (tlm, TLM_REC_PID_STATE, &sample.pid[0], sizeof (sample.pid[0]));
+	send_record (tlm, TLM_REC_PID_STATE, &sample.pid[1], sizeof (sample.pid[1]));
+}
+
+
+//-------------------------------------------------------------------------------------
+/** This function writes a sample as lines of text with the "<<" operators, in the
+ *  form in which the decoder prints records, and keeps a copy of what should come
+ *  out of the port.
+ *  @param port The port
+ *  @param sample The sample
+ */
+
+static void send_text (bench_rs232& port, const bench_sample& sample)
+{
+	port << "enc," << (unsigned long)sample.encoders.time << ","
+		 << (long)sample.encoders.encoder_1 << "," << (long)sample.encoders.encoder_2
+		 << endl;
+	text_length += snprintf (text_expected + text_length, BENCH_MAX_SENT - text_length,
+							 "enc,%lu,%ld,%ld\r\n", (unsigned long)sample.encoders.time,
+							 (long)sample.encoders.encoder_1,
+							 (long)sample.encoders.encoder_2);
+
+	for (uint8_t motor = 0; motor < 2; motor++)
+	{
+		const tlm_pid_rec& pid = sample.pid[motor];
+		port << "pid," << (unsigned long)pid.time << "," << (unsigned int)pid.motor
+			 << "," << (unsigned int)pid.running << "," << (long)pid.setpoint << ","
+			 << (long)pid.encoder << "," << (long)pid.error_sum << ","
+			 << (int)pid.output << endl;
+		text_length += snprintf (text_expected + text_length,
+								 BENCH_MAX_SENT - text_length,
+								 "pid,%lu,%u,%u,%ld,%ld,%ld,%d\r\n",
+								 (unsigned long)pid.time, pid.motor, pid.running,
+								 (long)pid.setpoint, (long)pid.encoder,
+								 (long)pid.error_sum, pid.output);
+	}
+}
+
+
+//-------------------------------------------------------------------------------------
+/** This function sends the time record with which task_telemetry starts, either as a
+ *  frame or as a line of text, and waits until it has gone out.
+ *  @param port The port
+ *  @param p_tlm The telemetry channel, or NULL to write the record as text
+ */
+
+static void send_time (bench_rs232& port, telemetry* p_tlm)
+{
+	tlm_time_rec time_rec;
+	time_rec.time = (uint32_t)(sim_cycles / (F_CPU / BENCH_TICKS_PER_SEC));
+	time_rec.ticks_per_sec = BENCH_TICKS_PER_SEC;
+
+	if (p_tlm != NULL)
+	{
+		send_record (*p_tlm, TLM_REC_TIME, &time_rec, sizeof (time_rec));
+	}
+	else
+	{
+		port << "time," << (unsigned long)time_rec.time << ","
+			 << (unsigned long)time_rec.ticks_per_sec << endl;
+		text_length += snprintf (text_expected + text_length,
+								 BENCH_MAX_SENT - text_length, "time,%lu,%lu\r\n",
+								 (unsigned long)time_rec.time,
+								 (unsigned long)time_rec.ticks_per_sec);
+	}
+	drain (port);
+}
+
+
+//-------------------------------------------------------------------------------------
+/** This function handles one run of bytes found between zero bytes, as the decoder's
+ *  handle_segment() does, keeping each good frame rather than printing it.
+ *  @param segment The bytes between two zeros
+ *  @param size The number of bytes
+ *  @param p_next_sequence The sequence number the decoder expects next
+ *  @param result The decoder's counts
+ */
+
+static void decode_segment (const uint8_t* segment, int size, int* p_next_sequence,
+							bench_decoded& result)
+{
+	uint8_t frame[BENCH_SEGMENT_SIZE];
+
+	if (size == 0)
+	{
+		return;
+	}
+
+	int frame_size = tlm_decode_frame (segment, size, frame);
+	if (frame_size > 0)
+	{
+		result.lost += tlm_count_lost (p_next_sequence, frame[1]);
+		if (result.good < BENCH_MAX_FRAMES)
+		{
+			bench_frame& found = decoded[result.good];
+			found.type = frame[0];
+			found.sequence = frame[1];
+			found.length = frame_size - 4;
+			memcpy (found.data, frame + 2, frame_size - 4);
+		}
+		result.good++;
+	}
+	else if (frame_size < 0)
+	{
+		result.bad++;
+	}
+	else
+	{
+		result.text++;
+	}
+}
+
+
+//-------------------------------------------------------------------------------------
+/** This function splits a stream at its zero bytes and decodes each piece, as the
+ *  decoder's main() does.
+ *  @param p_stream The bytes received
+ *  @param size The number of bytes
+ *  @param result The decoder's counts, which are all set
+ */
+
+static void decode_stream (const uint8_t* p_stream, uint32_t size,
+						   bench_decoded& result)
+{
+	uint8_t segment[BENCH_SEGMENT_SIZE];
+	int seg_size = 0;
+	int next_sequence = -1;
+
+	memset (&result, 0, sizeof (result));
+	for (uint32_t index = 0; index < size; index++)
+	{
+		if (p_stream[index] == 0)
+		{
+			decode_segment (segment, seg_size, &next_sequence, result);
+			seg_size = 0;
+		}
+		else if (seg_size < BENCH_SEGMENT_SIZE)
+		{
+			segment[seg_size++] = p_stream[index];
+		}
+	}
+	decode_segment (segment, seg_size, &next_sequence, result);
+}
+
+
+//-------------------------------------------------------------------------------------
+/** This function checks whether two frames hold the same thing.
+ *  @param first One frame
+ *  @param second The other frame
+ *  @return True if the frames are the same
+ */
+
+static bool same_frame (const bench_frame& first, const bench_frame& second)
+{
+	return (first.type == second.type && first.sequence == second.sequence
+			&& first.length == second.length
+			&& memcmp (first.data, second.data, first.length) == 0);
+}
+
+
+//-------------------------------------------------------------------------------------
+/** This function checks that the decoder found each frame which was sent, as it was
+ *  sent, and nothing else.
+ *  @param result The decoder's counts
+ *  @return True if the frames decoded are those which were sent
+ */
+
+static bool frames_match (const bench_decoded& result)
+{
+	if (result.good != num_expected)
+	{
+		return (false);
+	}
+	for (uint16_t index = 0; index < num_expected; index++)
+	{
+		if (!same_frame (expected[index], decoded[index]))
+		{
+			return (false);
+		}
+	}
+	return (true);
+}
+
+
+//-------------------------------------------------------------------------------------
+/** This function writes samples as fast as the port will take them, waiting before
+ *  each binary sample until it fits in the transmit buffer so that none is dropped,
+ *  and finds how many samples per second got through.
+ *  @param port The port
+ *  @param binary True to send frames, false to write text
+ *  @param p_bytes Set to the number of bytes each sample took
+ *  @return The number of samples per second sent
+ */
+
+static double most_samples (bench_rs232& port, bool binary, double* p_bytes)
+{
+	telemetry tlm (&port);
+	bench_sample sample;
+	const uint8_t sample_bytes = 3 * 3 + sizeof (sample.encoders) + 4
+								 + 2 * (sizeof (sample.pid[0]) + 4);
+
+	start_run ();
+	tlm.enable (true);
+	send_time (port, binary ? &tlm : NULL);
+	uint32_t sent_before = num_sent;
+	uint64_t start = sim_cycles;
+	for (uint16_t index = 0; index < BENCH_SAMPLES; index++)
+	{
+		make_sample (sample, index);
+		if (binary)
+		{
+			while (port.tx_space () < sample_bytes)
+			{
+				sim_spend (BENCH_WAIT_STEP);
+			}
+			send_binary (tlm, sample);
+		}
+		else
+		{
+			send_text (port, sample);
+		}
+	}
+	drain (port);
+
+	*p_bytes = (double)(num_sent - sent_before) / BENCH_SAMPLES;
+	return (BENCH_SAMPLES * (double)F_CPU / (last_sent_at - start));
+}
+
+
+//-------------------------------------------------------------------------------------
+/** This function writes samples at a fixed rate, as a task would, and checks what the
+ *  decoder makes of them. Binary frames which don't fit in the transmit buffer are
+ *  dropped and must show up as lost; text waits for room, and a sample whose writing
+ *  runs on past the time for the next one makes the task late.
+ *  @param port The port
+ *  @param binary True to send frames, false to write text
+ *  @param label A name for the line of results
+ *  @param rate The number of samples per second
+ *  @param should_drop True if frames are expected to be dropped or samples late
+ */
+
+static void fixed_rate (bench_rs232& port, bool binary, const char* label, double rate,
+						bool should_drop)
+{
+	telemetry tlm (&port);
+	bench_sample sample;
+	uint64_t longest = 0;
+	uint16_t late = 0;
+	uint64_t period = (uint64_t)(F_CPU / rate);
+
+	start_run ();
+	tlm.enable (true);
+	send_time (port, binary ? &tlm : NULL);
+	uint64_t next_time = sim_cycles;
+	for (uint16_t index = 0; index < BENCH_SAMPLES; index++)
+	{
+		uint64_t start = sim_cycles;
+		make_sample (sample, index);
+		if (binary)
+		{
+			send_binary (tlm, sample);
+		}
+		else
+		{
+			send_text (port, sample);
+		}
+		if (sim_cycles - start > longest)
+		{
+			longest = sim_cycles - start;
+		}
+		next_time += period;
+		if (sim_cycles > next_time)
+		{
+			late++;
+			next_time = sim_cycles;
+		}
+		sim_spend (next_time - sim_cycles);
+	}
+	drain (port);
+
+	bool ok;
+	bench_decoded result;
+	decode_stream (sent, num_sent, result);
+	if (binary)
+	{
+		// Every frame which was sent decodes, and each one dropped before the last
+		// shows up as lost; dropping a frame never holds up the task
+		ok = frames_match (result) && result.bad == 0 && result.text == 0;
+		ok &= (result.lost == dropped_before_last && late == 0);
+		ok &= (should_drop ? tlm.get_frames_dropped () > 0
+						   : tlm.get_frames_dropped () == 0);
+	}
+	else
+	{
+		// Nothing written as text is lost, but the task may be made late
+		ok = (num_sent == text_length && memcmp (sent, text_expected, num_sent) == 0);
+		ok &= (should_drop ? late > 0 : late == 0);
+	}
+	printf ("  %-26s %7.2f %6u %7u %6u %6u %9.2f  %s\n", label, rate,
+			binary ? num_expected : BENCH_SAMPLES * 3 + 1,
+			binary ? tlm.get_frames_dropped () : 0, result.lost, late,
+			longest * 1000.0 / F_CPU, check (ok) ? "ok" : "FAILED");
+}
+
+
+//-------------------------------------------------------------------------------------
+/** This function sends frames of many lengths, most with a lot of zeros in them, with
+ *  lines of text between some of them, and checks that the decoder gets them all back
+ *  as they were sent.
+ *  @param port The port
+ */
+
+static void round_trip (bench_rs232& port)
+{
+	telemetry tlm (&port);
+	uint8_t data[TLM_MAX_PAYLOAD];
+	uint16_t lines = 0;
+
+	start_run ();
+	tlm.enable (true);
+
+	// Frames of all zeros: the shortest, the longest and one of each record type
+	memset (data, 0, sizeof (data));
+	send_record (tlm, TLM_REC_TIME, data, 0);
+	send_record (tlm, 0x7F, data, TLM_MAX_PAYLOAD);
+	send_record (tlm, TLM_REC_TIME, data, sizeof (tlm_time_rec));
+	send_record (tlm, TLM_REC_ENCODERS, data, sizeof (tlm_encoders_rec));
+	send_record (tlm, TLM_REC_PID_STATE, data, sizeof (tlm_pid_rec));
+
+	// Random frames, about half of whose bytes are zeros, and some with none; these
+	// take the sequence number around past 255
+	srand (405);
+	for (uint16_t count = 0; count < BENCH_RANDOM_FRAMES; count++)
+	{
+		uint8_t length = rand () % (TLM_MAX_PAYLOAD + 1);
+		bool zeros = (count % 4 != 3);
+		for (uint8_t index = 0; index < length; index++)
+		{
+			data[index] = (zeros && (rand () & 1)) ? 0 : 1 + rand () % 255;
+		}
+		while (port.tx_space () < length + 7)
+		{
+			sim_spend (BENCH_WAIT_STEP);
+		}
+		send_record (tlm, 1 + rand () % 3, data, length);
+		if (count % BENCH_TEXT_EVERY == BENCH_TEXT_EVERY - 1)
+		{
+			port << "Status line " << ++lines << endl;
+		}
+	}
+	drain (port);
+
+	bench_decoded result;
+	decode_stream (sent, num_sent, result);
+	bool ok = frames_match (result) && result.bad == 0 && result.lost == 0
+			  && result.text == lines && tlm.get_frames_dropped () == 0;
+	printf ("  %-34s %6u %6u %6u %6u %6u  %s\n", "zero-heavy frames and text",
+			num_expected, result.good, result.bad, result.text, result.lost,
+			check (ok) ? "ok" : "FAILED");
+}
+
+
+//-------------------------------------------------------------------------------------
+/** This function damages every other frame in the stream which round_trip() sent, in
+ *  turn by flipping a bit, setting a byte to zero, losing a byte and adding one, and
+ *  checks that the decoder lets no damaged frame through, counts each as lost, and
+ *  still finds every other frame.
+ */
+
+static void corrupted (void)
+{
+	static uint8_t damaged[BENCH_MAX_SENT + BENCH_MAX_FRAMES];
+	uint8_t frame[BENCH_SEGMENT_SIZE];
+	bool kept[BENCH_MAX_FRAMES];
+	uint32_t size = 0;
+	uint16_t frame_count = 0;
+	uint16_t num_damaged = 0;
+
+	// Copy the stream a run of bytes at a time, damaging every other frame but the last
+	uint32_t index = 0;
+	while (index < num_sent)
+	{
+		if (sent[index] == 0)
+		{
+			damaged[size++] = sent[index++];
+			continue;
+		}
+		uint32_t start = index;
+		while (index < num_sent && sent[index] != 0)
+		{
+			index++;
+		}
+		uint32_t length = index - start;
+		memcpy (damaged + size, sent + start, length);
+
+		if (tlm_decode_frame (sent + start, length, frame) <= 0)
+		{
+			size += length;
+			continue;
+		}
+		bool damage = (frame_count % 2 == 1 && frame_count < num_expected - 1);
+		kept[frame_count++] = !damage;
+		if (!damage)
+		{
+			size += length;
+			continue;
+		}
+
+		uint32_t where = rand () % length;
+		switch (num_damaged++ % 4)
+		{
+			// A bit flipped by noise; if that leaves a zero, the frame is split
+			case 0:
+				damaged[size + where] ^= 1 << (rand () % 8);
+				size += length;
+				break;
+
+			// A byte which came through as zero splits the frame in two
+			case 1:
+				damaged[size + where] = 0;
+				size += length;
+				break;
+
+			// A byte lost by the receiver
+			case 2:
+				memmove (damaged + size + where, damaged + size + where + 1,
+						 length - where - 1);
+				size += length - 1;
+				break;
+
+			// A byte of noise added to the frame
+			default:
+				memmove (damaged + size + where + 1, damaged + size + where,
+						 length - where);
+				damaged[size + where] = 1 + rand () % 255;
+				size += length + 1;
+				break;
+		}
+	}
+
+	// The decoder should find exactly the frames which weren't damaged
+	bench_decoded result;
+	decode_stream (damaged, size, result);
+	bool ok = (frame_count == num_expected && result.lost == num_damaged);
+	uint16_t found = 0;
+	for (uint16_t count = 0; count < frame_count && ok; count++)
+	{
+		if (kept[count])
+		{
+			ok = (found < result.good && same_frame (expected[count], decoded[found]));
+			found++;
+		}
+	}
+	ok &= (found == result.good);
+	printf ("  %-34s %6u %6u %6u %6u %6u  %s\n", "every other frame damaged",
+			num_damaged, result.good, result.bad, result.text, result.lost,
+			check (ok) ? "ok" : "FAILED");
+}
+
+
+//-------------------------------------------------------------------------------------
+/** The main function measures the binary and text samples, then sends frames through
+ *  the decoder whole and damaged, and prints the results.
+ */
+
+int main (void)
+{
+	double binary_bytes, text_bytes;
+
+	sim_set_uart (bench_uart_sink);
+	bench_rs232 port (BENCH_BAUD, BENCH_PORT);
+	sei ();
+
+	// A character takes 10 bits, each 16 clocks times the baud rate divisor
+	double chars_per_sec = (double)F_CPU
+						   / (16UL * (calc_baud_div (BENCH_BAUD) + 1) * 10UL);
+
+	// Samples sent as fast as the port takes them should fill it
+	printf ("Most samples per second at %u baud  bytes/sample  samples/s  limit\n",
+			BENCH_BAUD);
+	double binary_rate = most_samples (port, true, &binary_bytes);
+	double limit = chars_per_sec / binary_bytes;
+	bool ok = (binary_rate > limit * 0.99 && binary_rate < limit * 1.001);
+	printf ("  %-34s %12.1f %10.2f %6.2f  %s\n", "binary, telemetry::send ()",
+			binary_bytes, binary_rate, limit, check (ok) ? "ok" : "FAILED");
+
+	double text_rate = most_samples (port, false, &text_bytes);
+	limit = chars_per_sec / text_bytes;
+	ok = (text_rate > limit * 0.99 && text_rate < limit * 1.001);
+	ok &= (num_sent == text_length && memcmp (sent, text_expected, num_sent) == 0);
+	printf ("  %-34s %12.1f %10.2f %6.2f  %s\n", "text, << operators", text_bytes,
+			text_rate, limit, check (ok) ? "ok" : "FAILED");
+	printf ("  Binary sends %.2f times as many samples per second as text\n",
+			binary_rate / text_rate);
+
+	// Samples written by a task at a fixed rate
+	printf ("\nSamples at a fixed rate        per sec  frames dropped   lost   late"
+			"  write ms\n");
+	fixed_rate (port, true, "binary, 95% of its most", binary_rate * 0.95, false);
+	fixed_rate (port, true, "binary, 125% of its most", binary_rate * 1.25, true);
+	fixed_rate (port, false, "text, 95% of its most", text_rate * 0.95, false);
+	fixed_rate (port, false, "text, binary's 95% rate", binary_rate * 0.95, true);
+
+	// Frames through the decoder, whole and damaged
+	printf ("\nDecoding                             frames   good    bad   text"
+			"   lost\n");
+	round_trip (port);
+	corrupted ();
+
+	printf ("\n%s\n", failures == 0 ? "All checks passed" : "Some checks FAILED");
+	return (failures == 0 ? 0 : 1);
+}
@@ -0,0 +1,360 @@
+//*************************************************************************************
+/** \file timer_bench.cpp
+ *    This program checks that the task timer and the tasks and scheduler which use it
+ *    keep working when the time wraps around, using the simulated processor in
+ *    sim_avr.cpp. The simulated clock is moved forward to just before the points at
+ *    which time stamps and the whole tick count wrap, rather than waiting for them.
+ *
+ *    First the cost of reading the time is measured, as a time stamp and as the whole
+ *    48-bit tick count. Then the time is read many times with interrupts off while the
+ *    hardware counter overflows, and again after the overflow interrupt has run, to
+ *    check that the readings never go backwards or count an overflow twice. Then some
+ *    tasks are run by a task_scheduler for 40 minutes of simulated time, starting 30
+ *    seconds before the 32-bit time stamps wrap around; one task is suspended for 20
+ *    minutes along the way. Each task's runs are counted and the gaps between them are
+ *    measured, and the idle percentage is checked, as well as what the 32-bit idle
+ *    statistics which were used before would have shown. Last, the time stamps are
+ *    checked as the 48-bit count wraps around. A line is printed for each check, and
+ *    the program exits with status 1 if any check fails.
+ *
+ *  Revisions:
+ *    \li 06-27-2011 Original file
+ *
+ *  License:
+ *    This file is released under the Lesser GNU Public License, version 2. This
+ *    program is intended for educational use only, but it is not limited thereto.
+ */
+//*************************************************************************************
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <avr/io.h>
+#include <avr/interrupt.h>
+#include "sim_avr.h"
+#include "sim_serial.h"
+#include "stl_timer.h"
+#include "stl_task.h"
+#include "stl_scheduler.h"
+
+
+/// How many times the time is read for measuring the cost
+#define BENCH_READS			1000000L
+
+/// Timer ticks in one second
+#define TICKS_PER_SEC		(F_CPU / 8UL)
+
+/// Clock cycles in one microsecond of simulated time
+#define CYCLES_PER_US		(F_CPU / 1000000UL)
+
+
+/// This counts the checks which have failed
+static int failures = 0;
+
+
+//-------------------------------------------------------------------------------------
+/** This class is a task which counts its runs and measures the longest gap between
+ *  one run and the next with the timer's whole tick count, which it also checks never
+ *  goes backwards. Each run it lets a given time pass, as if it were working.
+ */
+
+class count_task : public stl_task
+{
+	protected:
+		uint32_t work;						///< Clock cycles spent in each run
+
+	public:
+		uint32_t runs;						///< Number of runs
+		uint64_t last_run;					///< Tick count at the last run
+		uint64_t max_gap;					///< Longest time between runs, in ticks
+		bool backwards;						///< True if the tick count went backwards
+
+		/** The constructor makes a task which hasn't run yet.
+		 *  @param a_timer The task timer
+		 *  @param interval The time between runs
+		 *  @param work_us The time spent working in each run, in microseconds
+		 */
+		count_task (task_timer& a_timer, const time_stamp& interval, uint32_t work_us)
+			: stl_task (a_timer, interval)
+		{
+			work = work_us * CYCLES_PER_US;
+			runs = 0;
+			last_run = 0;
+			max_gap = 0;
+			backwards = false;
+		}
+
+		/** This method measures the time since the last run, then works for a while.
+		 *  @param state The task's state, which isn't used
+		 *  @return STL_NO_TRANSITION, as the task has only one state
+		 */
+		char run (char state)
+		{
+			uint64_t now = the_timer.get_ticks ();
+			if (runs > 0 && now < last_run)
+			{
+				backwards = true;
+			}
+			else if (runs > 0 && now - last_run > max_gap)
+			{
+				max_gap = now - last_run;
+			}
+			last_run = now;
+			runs++;
+			sim_spend (work);
+			return (STL_NO_TRANSITION);
+		}
+};
+
+
+//-------------------------------------------------------------------------------------
+/** This class is a scheduler which shows what its 32-bit idle statistics would have
+ *  been, as they were kept before the timer's whole tick count was used.
+ */
+
+class bench_scheduler : public task_scheduler
+{
+	public:
+		/** The constructor makes an empty scheduler.
+		 *  @param a_timer The task timer
+		 */
+		bench_scheduler (task_timer& a_timer) : task_scheduler (a_timer, SCHED_EDF) { }
+
+		/** This method finds the idle percentage as it was found with 32-bit counts,
+		 *  whose elapsed time wraps around every 2^32 ticks.
+		 *  @return The idle percentage the former statistics would show
+		 */
+		uint8_t former_idle_percent (void)
+		{
+			uint32_t elapsed = (uint32_t)(the_timer.get_ticks () - stats_start);
+			if (elapsed < 100L)
+			{
+				return (0);
+			}
+			return ((uint8_t)((uint32_t)sleep_ticks / (elapsed / 100L)));
+		}
+};
+
+
+//-------------------------------------------------------------------------------------
+/** This function prints the result of one check and counts it if it failed.
+ *  @param passed True if the check passed
+ *  @param p_what A description of what was checked
+ */
+
+static void check (bool passed, const char* p_what)
+{
+	printf ("  %-66s %s\n", p_what, passed ? "ok" : "FAILED");
+	if (!passed)
+	{
+		failures++;
+	}
+}
+
+
+//-------------------------------------------------------------------------------------
+/** This function reads a clock in nanoseconds.
+ *  @return The time in nanoseconds
+ */
+
+static double bench_ns (void)
+{
+	struct timespec now;
+	clock_gettime (CLOCK_MONOTONIC, &now);
+	return (now.tv_sec * 1.0E9 + now.tv_nsec);
+}
+
+
+//-------------------------------------------------------------------------------------
+/** This function runs the scheduler, sleeping when no task is ready, for some time.
+ *  @param scheduler The scheduler
+ *  @param seconds How many seconds of simulated time to run for
+ */
+
+static void run_for (task_scheduler& scheduler, double seconds)
+{
+	double start_seconds = sim_seconds ();
+	while (sim_seconds () - start_seconds < seconds)
+	{
+		if (!scheduler.dispatch ())
+		{
+			scheduler.idle ();
+		}
+	}
+}
+
+
+//-------------------------------------------------------------------------------------
+/** This function checks a task's runs after the long run.
+ *  @param task The task
+ *  @param name The task's name, for printing
+ *  @param interval_ms The task's interval in milliseconds
+ *  @param expected The number of runs the task should have made
+ */
+
+static void check_task (count_task& task, const char* name, uint32_t interval_ms,
+						uint32_t expected)
+{
+	char what[80];
+
+	printf ("  %s: %lu runs, longest gap %.3f ms\n", name, (unsigned long)task.runs,
+			task.max_gap * 1.0E3 / TICKS_PER_SEC);
+	snprintf (what, sizeof (what), "%s ran %lu times, give or take 2", name,
+			  (unsigned long)expected);
+	check (task.runs + 2 >= expected && task.runs <= expected + 2, what);
+	snprintf (what, sizeof (what), "%s never waited more than 1.5 intervals", name);
+	check (task.max_gap <= interval_ms * (TICKS_PER_SEC / 1000UL) * 3 / 2, what);
+	snprintf (what, sizeof (what), "%s never saw the tick count go backwards", name);
+	check (!task.backwards, what);
+}
+
+
+//-------------------------------------------------------------------------------------
+/** The main function runs the checks and measurements.
+ */
+
+int main (int argc, char** argv)
+{
+	sim_serial screen (stdout);
+	task_timer the_timer;
+	sei ();
+
+	// Time many readings of the time in each form
+	double start_ns = bench_ns ();
+	uint64_t start_cycles = sim_cycles;
+	for (long count = 0; count < BENCH_READS; count++)
+	{
+		the_timer.get_time_now ();
+	}
+	double stamp_ns = (bench_ns () - start_ns) / BENCH_READS;
+	double stamp_cycles = (double)(sim_cycles - start_cycles) / BENCH_READS;
+
+	start_ns = bench_ns ();
+	start_cycles = sim_cycles;
+	for (long count = 0; count < BENCH_READS; count++)
+	{
+		the_timer.get_ticks ();
+	}
+	double ticks_ns = (bench_ns () - start_ns) / BENCH_READS;
+	double ticks_cycles = (double)(sim_cycles - start_cycles) / BENCH_READS;
+
+	printf ("Cost per reading          PC ns  register access cycles\n");
+	printf ("get_time_now(), 32 bits  %6.1f  %22.1f\n", stamp_ns, stamp_cycles);
+	printf ("get_ticks(), 48 bits     %6.1f  %22.1f\n", ticks_ns, ticks_cycles);
+	printf ("(each register access is charged %u cycles)\n\n", sim_access_cycles);
+
+	// Read the time with interrupts off while the hardware counter overflows, so the
+	// overflow is only seen by its pending flag, then let the interrupt count it
+	printf ("Reading the time across a hardware counter overflow:\n");
+	time_stamp preset (0x0005FF00UL);
+	the_timer.set_time (preset);
+	bool monotonic = true;
+	bool stamps_agree = true;
+	cli ();
+	uint64_t first = the_timer.get_ticks ();
+	uint64_t previous = first;
+	for (int count = 0; count < 200; count++)
+	{
+		uint64_t ticks = the_timer.get_ticks ();
+		monotonic &= (ticks >= previous);
+		stamps_agree &= (the_timer.get_time_now ().get_raw_time () - (uint32_t)ticks
+						 < 64);
+		previous = ticks;
+	}
+	bool pending = (TMR_OVF_TIFR & (1 << TMR_OVF_FLAG)) != 0;
+	sei ();
+	uint64_t after_isr = the_timer.get_ticks ();
+	check (pending && previous > 0x60000ULL && first < 0x60000ULL,
+		   "the counter overflowed while interrupts were off");
+	check (monotonic, "readings with the overflow pending never went backwards");
+	check (stamps_agree, "time stamps agreed with the low 32 bits of the tick count");
+	check (after_isr >= previous && after_isr - previous < 0x8000ULL,
+		   "the overflow interrupt didn't count the overflow a second time");
+
+	// Start 30 seconds before the time stamps wrap around and run some tasks for 40
+	// minutes, which is longer than a time stamp can measure
+	printf ("\nRunning tasks across the time stamp wrap for 40 minutes:\n");
+	time_stamp interval_fast (0, 2000);
+	time_stamp interval_mid (0, 10000);
+	time_stamp interval_slow (1, 0);
+	count_task fast (the_timer, interval_fast, 200);
+	count_task mid (the_timer, interval_mid, 1000);
+	count_task slow (the_timer, interval_slow, 500);
+
+	bench_scheduler scheduler (the_timer);
+	scheduler.add_task (&fast, 3, interval_fast);
+	scheduler.add_task (&mid, 2, interval_mid);
+	scheduler.add_task (&slow, 0, interval_slow);
+	scheduler.set_tickless (true);
+
+	time_stamp near_wrap (0xFFFFFFFFUL - 30UL * TICKS_PER_SEC);
+	the_timer.set_time (near_wrap);
+	for (uint8_t index = 0; index < scheduler.get_num_tasks (); index++)
+	{
+		scheduler.get_entry (index).p_task->set_next_run_time (the_timer.get_time_now ());
+	}
+	scheduler.clear_stats ();
+	uint64_t start_ticks = the_timer.get_ticks ();
+
+	// After a minute, suspend the slow task for 20 minutes, long enough that its next
+	// run time can no longer be compared with the time now
+	run_for (scheduler, 60.0);
+	slow.suspend ();
+	uint32_t slow_runs = slow.runs;
+	run_for (scheduler, 1200.0);
+	check (slow.runs == slow_runs, "the slow task didn't run while it was suspended");
+
+	// Before, a suspended task kept its next run time, which is now 20 minutes old and
+	// so far back that it compares as being in the future
+	time_stamp stale_time = slow.get_next_run_time ();
+	stale_time += the_timer.get_time_now ();
+	stale_time -= time_stamp (1200, 0);
+	uint32_t former_wait = (stale_time - the_timer.get_time_now ()).get_raw_time ();
+	slow.resume ();
+	run_for (scheduler, 0.5);
+	check (slow.runs == slow_runs + 1, "the slow task ran as soon as it was resumed");
+	slow.max_gap = 0;						// The suspension isn't a late run
+	printf ("  (if it had kept its next run time, it would have waited %.0f s)\n",
+			(double)former_wait / TICKS_PER_SEC);
+	run_for (scheduler, 2400.0 - 1260.5);
+
+	double seconds = (double)(the_timer.get_ticks () - start_ticks) / TICKS_PER_SEC;
+	check_task (fast, "fast task", 2, (uint32_t)(seconds * 500.0 + 0.5));
+	check_task (mid, "mid task", 10, (uint32_t)(seconds * 100.0 + 0.5));
+	check_task (slow, "slow task", 1000, (uint32_t)(seconds - 1200.0 + 0.5));
+
+	uint8_t busy = (uint8_t)((fast.runs * 200.0 + mid.runs * 1000.0 + slow.runs * 500.0)
+							 / (seconds * 1.0E4) + 0.5);
+	uint8_t idle = scheduler.get_idle_percent ();
+	printf ("  idle %u%%, tasks worked %u%% of the time; the former 32-bit statistics "
+			"show idle %u%%\n", idle, busy, scheduler.former_idle_percent ());
+	check (idle + busy <= 100 && idle + busy >= 85,
+		   "idle and working percentages add up to 85% to 100%");
+	check (scheduler.get_entry (0).misses == 0 && scheduler.get_entry (1).misses == 0
+		   && scheduler.get_entry (2).misses == 0, "no task missed a deadline");
+	screen << scheduler;
+	screen << "  Time since the timer started: " << the_timer << " s" << endl;
+	check (the_timer.get_ticks () > 0xFFFFFFFFULL,
+		   "the tick count went past 32 bits without wrapping");
+
+	// Move the clock to just before the whole tick count wraps around, 4.4 years on.
+	// The time stamps, which only hold the low 32 bits, should carry on smoothly
+	printf ("\nReading the time as the 48-bit tick count wraps:\n");
+	cli ();
+	ust_overflows = 0xFFFFFFFFUL;
+	TMR_TCNT_REG = 0xFF00;
+	sei ();
+	time_stamp before = the_timer.get_time_now ();
+	uint64_t ticks_before = the_timer.get_ticks ();
+	sim_spend (1000UL * CYCLES_PER_US);
+	time_stamp after = the_timer.get_time_now ();
+	check (ticks_before > 0xFFFFFFFF0000ULL && the_timer.get_ticks () < 0x10000ULL,
+		   "the tick count wrapped to zero after 2^48 ticks");
+	check (after > before && (after - before).get_raw_time () < TICKS_PER_SEC / 100,
+		   "time stamps carried on across the wrap");
+	printf ("  (the 48-bit tick count wraps every %.2f years)\n",
+			281474976710656.0 / TICKS_PER_SEC / 3600.0 / 24.0 / 365.25);
+
+	printf ("\n%s\n", failures ? "SOME CHECKS FAILED" : "All checks passed");
+	return (failures ? 1 : 0);
+}
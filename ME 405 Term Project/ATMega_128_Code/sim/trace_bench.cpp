@@ -0,0 +1,281 @@
+//*************************************************************************************
+/** \file trace_bench.cpp
+ *    This program measures the state transition trace which STL_TRACE compiles into
+ *    stl_task, using the simulated processor in sim_avr.cpp. First the cost of
+ *    recording one event in the trace ring is measured: many events are recorded, and
+ *    the time taken on the PC and the simulated clock cycles charged for register
+ *    accesses are shown per event. Beside them are the figures for the trace which
+ *    was used before, which printed each transition as a line of text: the time taken
+ *    to format the line, and the time the line takes to send at 9600 baud, which is
+ *    how long a task was held up when the serial port's buffer was full. Then a few
+ *    tasks with state machines like the plotter's are run by a task_scheduler for a
+ *    few seconds of simulated time, and the trace ring is written to a file by
+ *    stl_trace_post_mortem(), as error_stop() would send it, for tools/trace_decode.
+ *
+ *    Usage: trace_bench [block_file]
+ *    The block is written to trace.bin if no file is given.
+ *
+ *  Revisions:
+ *    \li 06-26-2011 Original file
+ *
+ *  License:
+ *    This file is released under the Lesser GNU Public License, version 2. This
+ *    program is intended for educational use only, but it is not limited thereto.
+ */
+//*************************************************************************************
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <avr/io.h>
+#include <avr/interrupt.h>
+#include "sim_avr.h"
+#include "base_text_serial.h"
+#include "stl_timer.h"
+#include "stl_task.h"
+#include "stl_scheduler.h"
+#include "stl_trace.h"
+
+#ifndef STL_TRACE
+	#error trace_bench must be compiled with STL_TRACE defined, as in the Makefile
+#endif
+
+
+/// How many events are recorded for the overhead
+#define BENCH_EVENTS		1000000L
+
+/// How many seconds of simulated time the tasks are run
+#define BENCH_SECONDS		3
+
+/// The baud rate at which the former trace was printed
+#define BENCH_BAUD			9600L
+
+/// Clock cycles in one microsecond of simulated time
+#define CYCLES_PER_US		(F_CPU / 1000000UL)
+
+
+//-------------------------------------------------------------------------------------
+/** This class counts the characters written to it and throws them away. It stands in
+ *  for the serial port to which the former trace was printed.
+ */
+
+class counting_port : public base_text_serial
+{
+	public:
+		uint32_t count;						///< Number of characters written
+
+		/// This constructor makes a port which hasn't had anything written to it
+		counting_port (void) : base_text_serial () { count = 0; }
+
+		/// This method says that the port is always ready to send
+		bool ready_to_send (void) { return (true); }
+
+		/** This method counts one character.
+		 *  @param chout The character, which isn't used
+		 *  @return True, as the character is always taken
+		 */
+		bool putchar (char chout) { count++; return (true); }
+
+		/** This method counts the characters of a string.
+		 *  @param p_str The string
+		 */
+		void puts (char const* p_str) { count += strlen (p_str); }
+};
+
+
+//-------------------------------------------------------------------------------------
+/** This class writes bytes to a file without changing them, for the binary trace.
+ */
+
+class binary_file : public base_text_serial
+{
+	protected:
+		FILE* p_file;						///< The file written to
+
+	public:
+		/** This constructor sets up a device which writes to the given file.
+		 *  @param p_out The file
+		 */
+		binary_file (FILE* p_out) : base_text_serial () { p_file = p_out; }
+
+		/// This method says that the device is always ready to send
+		bool ready_to_send (void) { return (true); }
+
+		/** This method writes one byte.
+		 *  @param chout The byte
+		 *  @return True, as the byte is always written
+		 */
+		bool putchar (char chout) { fputc (chout, p_file); return (true); }
+
+		/** This method writes a string.
+		 *  @param p_str The string
+		 */
+		void puts (char const* p_str) { fputs (p_str, p_file); }
+};
+
+
+//-------------------------------------------------------------------------------------
+/** This class is a task which goes around a cycle of states, staying in each for a
+ *  given number of runs and working for a while in each run by letting simulated time
+ *  pass. The run count in the state is recorded with each transition. It stands in
+ *  for the plotter's tasks, such as task_lines going from waiting to moving along a
+ *  line and back.
+ */
+
+class cycle_task : public stl_task
+{
+	protected:
+		uint8_t num_states;					///< Number of states in the cycle
+		const uint8_t* p_stays;				///< Runs spent in each state
+		uint32_t work;						///< Clock cycles spent in each run
+		uint16_t runs_in_state;				///< Runs so far in the current state
+
+	public:
+		/** The constructor makes a task with the given cycle of states.
+		 *  @param a_timer The task timer
+		 *  @param interval The time between runs
+		 *  @param states The number of states in the cycle
+		 *  @param p_runs An array holding the number of runs spent in each state
+		 *  @param work_us The time spent working in each run, in microseconds
+		 */
+		cycle_task (task_timer& a_timer, const time_stamp& interval, uint8_t states,
+					const uint8_t* p_runs, uint32_t work_us)
+			: stl_task (a_timer, interval)
+		{
+			num_states = states;
+			p_stays = p_runs;
+			work = work_us * CYCLES_PER_US;
+			runs_in_state = 0;
+		}
+
+		/** This method works for a while, then moves to the next state if it has
+		 *  stayed long enough in this one.
+		 *  @param state The task's state
+		 *  @return The next state, or STL_NO_TRANSITION
+		 */
+		char run (char state)
+		{
+			sim_spend (work);
+			if (++runs_in_state < p_stays[(uint8_t)state])
+			{
+				return (STL_NO_TRANSITION);
+			}
+			set_trace_payload (runs_in_state);
+			runs_in_state = 0;
+			return ((char)(((uint8_t)state + 1) % num_states));
+		}
+};
+
+
+//-------------------------------------------------------------------------------------
+/** This function reads a clock in nanoseconds.
+ *  @return The time in nanoseconds
+ */
+
+static double bench_ns (void)
+{
+	struct timespec now;
+	clock_gettime (CLOCK_MONOTONIC, &now);
+	return (now.tv_sec * 1.0E9 + now.tv_nsec);
+}
+
+
+//-------------------------------------------------------------------------------------
+/** The main function measures the cost of recording events, then runs and traces some
+ *  tasks and writes the trace.
+ */
+
+int main (int argc, char** argv)
+{
+	const char* block_name = (argc > 1) ? argv[1] : "trace.bin";
+	task_timer the_timer;
+	sei ();
+
+	// Record many events in the ring
+	double start_ns = bench_ns ();
+	uint64_t start_cycles = sim_cycles;
+	for (long count = 0; count < BENCH_EVENTS; count++)
+	{
+		stl_trace_record (1, (uint8_t)count, (uint8_t)(count + 1), (uint16_t)count);
+	}
+	double ring_ns = (bench_ns () - start_ns) / BENCH_EVENTS;
+	double ring_cycles = (double)(sim_cycles - start_cycles) / BENCH_EVENTS;
+
+	// Format the same events as the former trace did
+	counting_port text_port;
+	start_ns = bench_ns ();
+	for (long count = 0; count < BENCH_EVENTS; count++)
+	{
+		text_port << "T" << (char)1 << ":" << (char)(count & 0x07) << "-"
+				  << (char)((count + 1) & 0x07) << endl;
+	}
+	double text_ns = (bench_ns () - start_ns) / BENCH_EVENTS;
+	double text_chars = (double)text_port.count / BENCH_EVENTS;
+	double wire_us = text_chars * 10.0 * 1.0E6 / BENCH_BAUD;
+
+	printf ("Cost per event     PC ns  register access cycles  bytes  9600 baud time\n");
+	printf ("text trace        %6.1f  %22s  %5.1f  %11.0f us\n", text_ns, "-",
+			text_chars, wire_us);
+	printf ("trace ring        %6.1f  %22.1f  %5u  %14s\n", ring_ns, ring_cycles,
+			(unsigned)sizeof (stl_trace_event), "-");
+	printf ("(each register access is charged %u cycles, and most of the ring's PC time is "
+			"spent\n simulating its 4 register accesses; the ring takes %u bytes of SRAM)\n\n",
+			sim_access_cycles, (unsigned)sizeof (stl_trace_ring));
+
+	// Run some tasks like the plotter's: a fast one which goes through many states,
+	// one which stays a while in each state, and a slow one which seldom moves
+	static const uint8_t motion_stays[] = {3, 10, 40, 10};
+	static const uint8_t pen_stays[] = {25, 2, 25, 2};
+	static const uint8_t home_stays[] = {8, 1};
+	time_stamp interval_fast (0, 2000);
+	time_stamp interval_mid (0, 10000);
+	time_stamp interval_slow (0, 100000);
+	cycle_task motion (the_timer, interval_fast, 4, motion_stays, 300);
+	cycle_task pen (the_timer, interval_mid, 4, pen_stays, 100);
+	cycle_task home (the_timer, interval_slow, 2, home_stays, 2000);
+
+	task_scheduler scheduler (the_timer, SCHED_EDF);
+	scheduler.add_task (&motion, 3, interval_fast);
+	scheduler.add_task (&pen, 2, interval_mid);
+	scheduler.add_task (&home, 0, interval_slow);
+	scheduler.set_tickless (true);
+
+	// The overhead measurement took some simulated time, so start the tasks from now
+	for (uint8_t index = 0; index < scheduler.get_num_tasks (); index++)
+	{
+		scheduler.get_entry (index).p_task->set_next_run_time (the_timer.get_time_now ());
+	}
+	stl_trace_clear ();
+
+	double start_seconds = sim_seconds ();
+	while (sim_seconds () - start_seconds < BENCH_SECONDS)
+	{
+		if (!scheduler.dispatch ())
+		{
+			scheduler.idle ();
+		}
+	}
+	printf ("%u events held of those recorded in %u s; the newest is task %u going "
+			"from state %u to %u\n", stl_trace_wrapped ? STL_TRACE_EVENTS : stl_trace_next,
+			BENCH_SECONDS,
+			stl_trace_ring[(stl_trace_next + STL_TRACE_EVENTS - 1) % STL_TRACE_EVENTS].task,
+			stl_trace_ring[(stl_trace_next + STL_TRACE_EVENTS - 1) % STL_TRACE_EVENTS].from,
+			stl_trace_ring[(stl_trace_next + STL_TRACE_EVENTS - 1) % STL_TRACE_EVENTS].to);
+
+	// Send the ring as error_stop() would, with interrupts off
+	FILE* p_block = fopen (block_name, "wb");
+	if (p_block == NULL)
+	{
+		perror (block_name);
+		return (1);
+	}
+	binary_file block_file (p_block);
+	stl_trace_set_port (&block_file);
+	cli ();
+	stl_trace_post_mortem ();
+	fclose (p_block);
+	printf ("Trace block written to %s\n", block_name);
+
+	return (0);
+}
@@ -2,6 +2,13 @@
 	/** \file task_PID.cpp is a Proportional Integral Differential (PID) controller. It can
 	* 	control two motors currently, but is best used to control one motor per PID object.
 	*
+	*  Revisions:
+	*    \li  06-16-11  Replaced the int64_t gain arithmetic and the clamped error sum with a
+	*                   pid_fixed controller, which has a filtered derivative and anti-windup
+	*    \li  06-18-11  Runs as the outer, position loop over a task_velocity if given one
+	*    \li  06-19-11  Adds the reference's speed to a cascade's output as a feed forward
+	*    \li  06-29-11  The count of runs near the set point starts at zero
+	*
 	*  License:
 	*    This file released under the Lesser GNU Public License. The program is intended
 	*    for educational use only, but its use is not restricted thereto. 
@@ -19,14 +26,23 @@
 	#include "stl_task.h"						// allows task_PID to be scheduled
 	#include "Master.h"							// allows SPI communications to operate
 	#include "da_motor.h"						// allows motor control to occur
+	#include "task_velocity.h"					// inner loop of a cascaded controller
 	#include "task_PID.h"						// include own header file
 	
 	// Define tuning values here for ease fo adjustment, names explain all.
 	#define K_P_DIVISOR 10000 					// Just like it sounds			
 	#define K_I_DIVISOR 1000000  				// Just like it sounds
 	#define K_D_DIVISOR 100 					// Just like it sounds
-	#define INTEGRAL_SATURATE 1000				// Saturate integral error
 	#define DUTY_CYCLE_SATURATE 255				// Saturate duty cycle
+	#define DUTY_CYCLE_SLEW 0					// Largest duty cycle change per run, 0 for none
+	#define D_FILTER_SHIFT 2					// Derivative filter time constant, 2^n runs
+	#define ANTIWINDUP_SHIFT 1					// Back calculation gain, 1 / 2^n
+	
+	// As the outer loop of a cascade, the output is a speed in counts per second
+	#define K_P_CASCADE_DIVISOR 100				// Kp in hundredths of counts/s per count
+	#define K_I_CASCADE_DIVISOR 10000			// Ki in ten thousandths, per run
+	#define K_D_CASCADE_DIVISOR 100				// Kd in hundredths
+	#define SPEED_SATURATE 30000				// Fastest speed asked of the inner loop
 //-----------------------------------------------------------------------------------------
 /** The constructor task_PID creates a new Proportional Integral Differential (PID) controller object.
 		*	@param p_serial_port	Allows screen printouts
@@ -35,15 +51,18 @@
 		*	@param master_object	An SPI master object
 		*	@param motor_object:	A motor object
 		*	@param Which_Channel: 	Gives the newborn PID its motor assignment. For life.
+		*	@param inner_loop:		A velocity loop to run as the inner loop of a cascade, or NULL
 		*/
 
 task_PID::task_PID (base_text_serial* p_serial_port, task_timer& a_timer, time_stamp& t_stamp, Master* master_object, 
-					da_motor* motor_object, uint8_t Which_Channel)  :   stl_task (a_timer, t_stamp)
+					da_motor* motor_object, uint8_t Which_Channel, task_velocity* inner_loop)
+					:   stl_task (a_timer, t_stamp)
 {
 	
 	ptr_2_serial = p_serial_port;				// pointer to a serial port
 	func_READ_ENCODER = master_object;			// pointer to encoder object (used to call encoder methods)
 	func_UPDATE_MOTOR = motor_object;			// pointer to motor object (used to call motor methods)
+	inner = inner_loop;							// velocity loop, if this is a cascade
 	
 	
 	motor_num = Which_Channel;					// When PID object is created, this constant is set, this tells PID object which 
@@ -52,12 +71,25 @@ task_PID::task_PID (base_text_serial* p_serial_port, task_timer& a_timer, time_s
 	K_i = 0;									// initialize K_i
 	K_d = 0;									// initialize K_d
 	Set_Point = 0;								// initialize set point
-	E_sum_old = 0;								// initialize error sum
-	prev_error = 0;								// initialize error archive
+	Feed_Forward = 0;							// initialize set point speed
+	if (inner)
+	{
+		controller.set_output_limits(-SPEED_SATURATE, SPEED_SATURATE);
+	}
+	else
+	{
+		controller.set_output_limits(-DUTY_CYCLE_SATURATE, DUTY_CYCLE_SATURATE);
+		controller.set_slew_limit(DUTY_CYCLE_SLEW);
+	}
+	controller.set_derivative_filter(D_FILTER_SHIFT);
+	controller.set_antiwindup(ANTIWINDUP_SHIFT);
 	duty_cycle = 0;								// initialize duty cycle
+	output = 0;									// initialize signed duty cycle
 	encoder = 0;								// initialize encoder count variable
+	velocity = 0;								// initialize encoder speed variable
 	giddyup = false; 							// initialize giddyup, this makes the motors start stopped
 	are_we_there_yet = false;
+	dummy = 0;									// no runs near the set point yet
 	homing = false;
 	
 	// Say hello
@@ -65,9 +97,10 @@ task_PID::task_PID (base_text_serial* p_serial_port, task_timer& a_timer, time_s
 		
 	
 }
-/** run is a two state PID controller. The first state is simply a non moving state which checks to see if 
-*	movement has been requested. State two incorporates proportional, integral and differential feedback 
-*	into a control loop which updates the duty cycle of a motor (one motor per PID object).
+/** run is a three state PID controller. The first state is simply a non moving state which checks to see if 
+*	movement has been requested. State two asks for the encoder counts, and state three waits for them and 
+*	incorporates proportional, integral and differential feedback into a control loop which updates the duty 
+*	cycle of a motor (one motor per PID object).
 */
 char task_PID::run(char state)
 {
@@ -90,94 +123,133 @@ char task_PID::run(char state)
 			else
 				return (STL_NO_TRANSITION);				// continue to be off
 		break;
-		/** State 1 is the PID task. It gets a current encoder reading (ensuring no transfer error) and then 
-		*	calculates new duty and sets the duty cycle.
+		/** State 1 starts an SPI transfer which reads both encoders, notes which snapshot was the newest before it
+		*	started, and goes to state 2 to wait for a newer one. If the other PID has already started a transfer,
+		*	that transfer is shared rather than a second one being started. In a cascade, the velocity loop keeps
+		*	the encoder counts fresh, so the newest count is used at once.
 		*/
-		case 1: 
-			bool Checksum_Error_flag = 1;				// mock an encoder checksum fault
-			while (Checksum_Error_flag)					// get encoder readings until no checksum fault
+		case 1:
+			if (inner)
 			{
-				func_READ_ENCODER -> Initiate(motor_num);		
-				Checksum_Error_flag = func_READ_ENCODER -> Get_Checksum_flag();
+				encoder = inner->Get_Encoder();
+				velocity = inner->Get_Velocity();
+				update_output();
+				return ((giddyup == false) ? 0 : STL_NO_TRANSITION);
 			}
-			encoder = func_READ_ENCODER -> Get_Encoder();
-			
-			// calculate error and saturate
-			int32_t error_now = (Set_Point - encoder);
-			
-			int32_t proportional_error = (int32_t)(((int64_t)error_now * (int64_t)K_p)/K_P_DIVISOR);
-			
-			int32_t E_sum_now = error_now + E_sum_old;
-
-			// ensure integral portion of feedback loop is within reason
-			if (E_sum_now > INTEGRAL_SATURATE)
-				E_sum_now = INTEGRAL_SATURATE;
-			else if (E_sum_now < (-INTEGRAL_SATURATE))
-				E_sum_now = (-INTEGRAL_SATURATE);
-						
-			int32_t integral_error = (int32_t)(((int64_t)E_sum_now * (int64_t)K_i)/K_I_DIVISOR);
-			
-			
-			//int32_t differential_error = ((error_now - prev_error) * (K_d))/K_D_DIVISOR;
-			
-			//archive data
-			E_sum_old = E_sum_now;
-			prev_error = error_now;
-			
-			int32_t OUTPUT = (proportional_error + integral_error);// + differential_error);
-			
-			// If error_now yields a negative value, set direction as reverse
-			if (OUTPUT < 0)
-			{
-				func_UPDATE_MOTOR->set_mode(motor_num, 2);	// make motor go CCW
-			}
-			// If error_now is positive, make motor go forward 
-			else 
-				func_UPDATE_MOTOR->set_mode(motor_num, 1);
-			
-			// Ensure OUTPUT is positive before updating the duty cycle
-			if (OUTPUT < 0)
+			wait_sequence = func_READ_ENCODER -> get_sequence();
+			func_READ_ENCODER -> start_batch();
+			wait_start = the_timer.get_time_now();
+			run_again_ASAP();
+			return (2);
+		break;
+		/** State 2 is the PID task. It waits for the transfer to finish without blocking, gets a current encoder
+		*	reading from the snapshot and then calculates new duty and sets the duty cycle. If the transfer times
+		*	out or this motor's encoder couldn't be read, the duty cycle is left alone until the next run.
+		*/
+		case 2:
+			if (func_READ_ENCODER -> get_sequence() == wait_sequence)
 			{
-				OUTPUT *= (-1);
+				if ((the_timer.get_time_now() - wait_start) > time_stamp(0, MASTER_TIMEOUT_US))
+				{
+					func_READ_ENCODER -> abort_batch();
+					return (1);
+				}
+				run_again_ASAP();
+				return (STL_NO_TRANSITION);
 			}
-			else 
-			{}
-			
-			// Saturate duty cycle
-			if (OUTPUT > DUTY_CYCLE_SATURATE)
+			encoder_snapshot counts;
+			func_READ_ENCODER -> get_snapshot(counts);
+			if (!(counts.fresh & (1 << (motor_num - 1))))
 			{
-				OUTPUT = DUTY_CYCLE_SATURATE;
+				return (1);
 			}
-			duty_cycle = (uint8_t) OUTPUT;
-			
-			// update speed of motor
-			func_UPDATE_MOTOR->update_duty_cycle(motor_num, duty_cycle);
+			encoder = counts.encoder[motor_num - 1];
+			velocity = counts.velocity[motor_num - 1];
+			update_output();
 		
 			// If somebody pressed the stop button, transition to the stopped state
 			if (giddyup == false)
 			{
 				return (0);
 			}
-			// transition to new set point if appropriate
-			if ( (error_now <= 400) && (error_now >= -400) )
-			{
-				dummy++;
-				if (dummy >= 10L)
-				{
-					are_we_there_yet = true;
-					dummy = 0;
-				}
-			}
-			return (STL_NO_TRANSITION);
+			return (1);
 	}
+	return (STL_NO_TRANSITION);
 }
 
-/** go enables motor control
+/** update_output runs the control law on the newest encoder count. By itself, the PID sets
+*	the motor's direction and duty cycle; in a cascade, it gives the velocity loop a speed.
+*	It also notes when the motor has stayed near the set point long enough to move on.
+*/
+void task_PID::update_output(void)
+{
+	// calculate error, then let the controller work out a duty cycle within +/-255, or a speed
+	int32_t error_now = (Set_Point - encoder);
+	
+	int16_t OUTPUT = controller.update(Set_Point, encoder);
+	
+	if (inner)
+	{
+		int32_t speed = (int32_t)OUTPUT + Feed_Forward;
+		if (speed > SPEED_SATURATE)
+		{
+			speed = SPEED_SATURATE;
+		}
+		else if (speed < -SPEED_SATURATE)
+		{
+			speed = -SPEED_SATURATE;
+		}
+		inner->set_speed(speed);
+	}
+	else
+	{
+		// If error_now yields a negative value, set direction as reverse
+		if (OUTPUT < 0)
+		{
+			func_UPDATE_MOTOR->set_mode(motor_num, 2);	// make motor go CCW
+		}
+		// If error_now is positive, make motor go forward 
+		else 
+			func_UPDATE_MOTOR->set_mode(motor_num, 1);
+		
+		// Ensure OUTPUT is positive before updating the duty cycle
+		bool reverse = (OUTPUT < 0);
+		if (OUTPUT < 0)
+		{
+			OUTPUT *= (-1);
+		}
+		
+		duty_cycle = (uint8_t) OUTPUT;
+		output = reverse ? -(int16_t)duty_cycle : (int16_t)duty_cycle;	// signed copy for telemetry
+		
+		// update speed of motor
+		func_UPDATE_MOTOR->update_duty_cycle(motor_num, duty_cycle);
+	}
+	
+	// transition to new set point if appropriate
+	if ( (error_now <= 400) && (error_now >= -400) )
+	{
+		dummy++;
+		if (dummy >= 10L)
+		{
+			are_we_there_yet = true;
+			dummy = 0;
+		}
+	}
+}
+
+/** go enables motor control. The controller is reset so that nothing left over from before the
+*	motor was stopped, or from homing, bumps the motor when it starts.
 */
 void task_PID::go(void)
 {
+	controller.reset(encoder, Set_Point);
 	giddyup = true;
 	are_we_there_yet = false;
+	if (inner)
+	{
+		inner->go();
+	}
 }
 
 /** stop disables motor control (stops the motors)
@@ -186,13 +258,72 @@ void task_PID::stop(void)
 {
 	giddyup = false;
 	are_we_there_yet = true;
+	if (inner)
+	{
+		inner->stop();
+	}
 }
 /** CLEAR resets PID control variables
 */
 void task_PID::CLEAR(void)
 {
-	E_sum_old = 0;
-	prev_error = 0;
 	encoder = 0;
+	controller.reset(0, Set_Point);
+	velocity = 0;
 	duty_cycle = 0;
-}
\ No newline at end of file
+	output = 0;
+	if (inner)
+	{
+		inner->CLEAR();
+	}
+}
+
+/** Request_Home lets Go_Home drive the motor, or gives it back. The velocity loop of a
+*	cascade steps aside as well.
+*	@param Nice_Shoes set this true to disable PID for homing
+*/
+void task_PID::Request_Home(bool Nice_Shoes)
+{
+	homing = Nice_Shoes;
+	if (inner)
+	{
+		inner->Request_Home(Nice_Shoes);
+	}
+}
+
+/** GET_Output returns the signed duty cycle, negative when the motor runs CCW. In a
+*	cascade, the duty cycle is set by the velocity loop.
+*/
+int16_t task_PID::GET_Output(void)
+{
+	return (inner ? inner->GET_Output() : output);
+}
+
+/** set_kp sets the proportional gain and passes it to the controller as a Q16.16 number
+*	@param kp_val: the value you wish to set the gain to, in ten thousandths, or in a cascade
+*	hundredths of counts per second per count
+*/
+void task_PID::set_kp(uint16_t kp_val)
+{
+	K_p = kp_val;
+	controller.set_kp(pid_fixed<16>::ratio(kp_val, inner ? K_P_CASCADE_DIVISOR : K_P_DIVISOR));
+}
+
+/** set_ki sets the integral gain and passes it to the controller as a Q16.16 number
+*	@param ki_val: the value you wish to set the gain to, in millionths, or in a cascade
+*	ten thousandths of counts per second per count per run
+*/
+void task_PID::set_ki(uint16_t ki_val)
+{
+	K_i = ki_val;
+	controller.set_ki(pid_fixed<16>::ratio(ki_val, inner ? K_I_CASCADE_DIVISOR : K_I_DIVISOR));
+}
+
+/** set_kd sets the differential gain and passes it to the controller as a Q16.16 number
+*	@param kd_val: the value you wish to set the gain to, in hundredths, in either case
+*/
+void task_PID::set_kd(uint16_t kd_val)
+{
+	K_d = kd_val;
+	controller.set_kd(pid_fixed<16>::ratio(kd_val, inner ? K_D_CASCADE_DIVISOR : K_D_DIVISOR));
+}
@@ -2,6 +2,11 @@
 /** \file  task_PID.h
  *	PID.h contains specifications necessary for the Proportional Integral Differential (PID)
  *	controller. Also file scope variables and simple in line methods are defined here.
+ *
+ *  Revisions:
+ *    \li  06-16-11  The control law is now run by a fixed point pid_fixed controller
+ *    \li  06-18-11  Can run as the position loop of a cascade, over a task_velocity
+ *    \li  06-19-11  Takes a moving reference with a speed feed forward from a trajectory
  * 
  *  License:
  *    This file released under the Lesser GNU Public License. The program is intended
@@ -12,12 +17,22 @@
 // This define prevents this .h file from being included more than once in a .cpp file
 #ifndef _task_PID_H_
 #define _task_PID_H_
+
+#include "pid_fixed.h"						// Fixed point PID control law
+
+class task_velocity;						// Inner loop of a cascaded controller
 //-------------------------------------------------------------------------------------
  /** task_PID.cpp is a class for a PID controller. task_PID is able to read the current
  *	 encoder position on a motor, calculate the proportional, integral, and differential
  *	 gains, and update the motor's duty cycle based on the final gain value. It can also
  *	 manipulate certain flags via inline functions to trigger actions, such as telling a
  *	 motor to go or stop, in other objects.
+ *
+ *	 If it's given a task_velocity inner loop, task_PID becomes the outer loop of a
+ *	 cascade: instead of a duty cycle it works out how fast the motor should turn, and
+ *	 the inner loop, which runs much more often, makes it turn that fast. The encoder
+ *	 count then comes from the inner loop's transfers, and the gains are in counts per
+ *	 second per count of error rather than duty cycle.
  */
 class task_PID : public stl_task
 {
@@ -28,35 +43,45 @@ class task_PID : public stl_task
 		Master* func_READ_ENCODER;					
 		/// pointer of type da_motor to a motor object
 		da_motor* func_UPDATE_MOTOR;				
+		/// the velocity loop run under this one, or NULL if this loop drives the motor itself
+		task_velocity* inner;
 		/// tell motor to stop or go
 		bool giddyup;			
 		/// homing allows task Go_Home to take control of motors
 		bool homing;
 		/// a constant for each PID which controls which motor and encoder we use each time the PID is called
 		uint8_t motor_num;							
-		/// A flag which indicates an SPI transfer error				
-		uint8_t Checksum_Error_flag;
+		/// sequence number of the newest encoder snapshot when a transfer was requested
+		uint8_t wait_sequence;
+		/// time at which the transfer was requested, so a hung transfer can be given up on
+		time_stamp wait_start;
 		/// stupid counting variable
 		volatile uint8_t dummy;								
 		/// name pretty well says it
 		uint8_t duty_cycle;							
-		/// proportional gain
+		/// duty cycle with sign showing direction, for telemetry
+		int16_t output;
+		/// proportional gain, in ten thousandths of duty cycle per count
 		uint16_t K_p;								
-		/// integral gain
+		/// integral gain, in millionths of duty cycle per count per run
 		uint16_t K_i;								
-		/// differential gain
+		/// differential gain, in hundredths of duty cycle per count per run
 		uint16_t K_d;								
-		/// used for differential feedback
-		int32_t prev_error;							
-		/// used for integral feedback
-		int32_t E_sum_old;						
+		/// the control law, with the gains above converted to Q16.16 numbers
+		pid_fixed<16> controller;
 		/// encoder reading
 		int32_t encoder;						
+		/// encoder speed measured by the slave, in counts per second
+		int32_t velocity;
 		/// the set point
 		int32_t Set_Point;		
+		/// how fast the set point is moving, in counts per second, added to a cascade's output
+		int32_t Feed_Forward;
 		/// boolean set to true when desired position is reached
 		bool are_we_there_yet;
 		
+		void update_output(void);
+		
 	public:
 		/** The constructor task_PID creates a new PID object.
 		*	@param p_serial_port	Allows screen printouts
@@ -65,12 +90,14 @@ class task_PID : public stl_task
 		*	@param master_object	An SPI master object
 		*	@param motor_object:	A motor object
 		*	@param Which_Channel: 	Gives the newborn PID its motor assignment. For life.
+		*	@param inner_loop:		A velocity loop to run as the inner loop of a cascade, or NULL
 		*/
 		task_PID (base_text_serial* p_serial_port, task_timer& a_timer, time_stamp& t_stamp, Master* master_object, 
-				  da_motor* motor_object, uint8_t which_Channel);
+				  da_motor* motor_object, uint8_t which_Channel, task_velocity* inner_loop = NULL);
 		
-		/** run is a 2 state PID controller. State 0 is an idle state which wits for the go bool giddyup to be true. State 1
-		*	gets an encoder count, does necessary feedback calculations and sets motor duty cycle.
+		/** run is a 3 state PID controller. State 0 is an idle state which wits for the go bool giddyup to be true. State 1
+		*	starts an SPI transfer of the encoder counts. State 2 waits for the transfer without blocking, then does
+		*	necessary feedback calculations and sets motor duty cycle.
 		*	@param state is a state variable controlled by STL_task
 		*/
 		char run(char);
@@ -81,14 +108,13 @@ class task_PID : public stl_task
 		
 		void CLEAR(void);
 		
-		// These three in line methods allow a user to set gains from other tasks.
+		// These three methods allow a user to set gains from other tasks.
 			
-		/// set K_p @param kp_val: the value you wish to set the gain to
-		void set_kp(uint16_t kp_val) { K_p = kp_val; }
-		/// set K_i @param ki_val: the value you wish to set the gain to
-		void set_ki(uint16_t ki_val) { K_i = ki_val; }
-		/// set K_d @param kd_val: the value you wish to set the gain to
-		void set_kd(uint16_t kd_val) { K_d = kd_val; }	
+		void set_kp(uint16_t kp_val);
+		
+		void set_ki(uint16_t ki_val);
+		
+		void set_kd(uint16_t kd_val);
 		
 		// These three in line methods return K values so they can be displayed
 		/// GET_Kp returns K_p 
@@ -101,7 +127,15 @@ class task_PID : public stl_task
 		/** set_setpoint sets the setpoint
 		*	@param s_pt the set point you desire
 		*/
-		void set_setpoint(int32_t s_pt) {Set_Point = s_pt; are_we_there_yet=false;}
+		void set_setpoint(int32_t s_pt) {Set_Point = s_pt; Feed_Forward = 0; are_we_there_yet=false;}
+		
+		/** set_reference moves the setpoint along a trajectory. In a cascade, the speed at
+		*	which the setpoint is moving is passed straight to the velocity loop, so the
+		*	motor keeps up without waiting for an error to build; a single loop ignores it.
+		*	@param s_pt the set point, in encoder counts
+		*	@param speed how fast the set point is moving, in counts per second
+		*/
+		void set_reference(int32_t s_pt, int32_t speed) {Set_Point = s_pt; Feed_Forward = speed; are_we_there_yet=false;}
 		
 		/** GET_setpoint gets the current setpoint so it can be printed
 		*	@param Set_Point the set point you desire
@@ -112,6 +146,21 @@ class task_PID : public stl_task
 		*/
 		int32_t Get_Encoder(void){ return(encoder);	}
 		
+		/// Get_Velocity returns the encoder speed in counts per second, as measured by the slave
+		int32_t Get_Velocity(void) { return(velocity); }
+		
+		/// GET_Output returns the signed duty cycle, negative when the motor runs CCW
+		int16_t GET_Output(void);
+		
+		/// GET_Inner returns the velocity loop under this one, or NULL if there's none
+		task_velocity* GET_Inner(void) { return(inner); }
+		
+		/// GET_Error_Sum returns the integral term of the controller, in duty cycle units
+		int32_t GET_Error_Sum(void) { return(controller.get_integral()); }
+		
+		/// Is_Running tells whether the PID is driving its motor
+		bool Is_Running(void) { return(giddyup); }
+		
 		/** check if we're at the end of the segment
 		*/
 		bool At_Seg_End(void) { return(are_we_there_yet);}
@@ -119,7 +168,7 @@ class task_PID : public stl_task
 		/** disable PID so homing can occur
 		*	@param Nice_Shoes set this true to disable PID for homing
 		*/
-		void Request_Home(bool Nice_Shoes) {homing = Nice_Shoes;}
+		void Request_Home(bool Nice_Shoes);
 };
 	//-------------------------------------------------------------------------------------
 #endif // _PID_H_
\ No newline at end of file
@@ -3,6 +3,9 @@
 	*  Revisions:
 	*    \li  05-10-11  Began tearing and hacking at our lab_4 code.				
 	*	 \li  05-22-11	That was the hardest 12 days of our lives. It aint perfect, but it works
+	*    \li  06-19-11  Lines follow a trajectory with limited speed, acceleration and jerk
+	*    \li  06-20-11  Lines go through a look-ahead planner; the signature is a table of strokes
+	*    \li  06-22-11  Waits for the pen to lift after the last lines too, before going idle
 	*  License:
 	*    This file released under the Lesser GNU Public License. The program is intended
 	*    for educational use only, but its use is not restricted thereto. 
@@ -13,7 +16,6 @@
 	#include <stdlib.h>							// Standard C library
 	#include <avr/io.h>							// Input-output ports, special registers
 	#include <avr/interrupt.h>					// Interrupt handling functions
-	#include <math.h>							// Contains Math Functions
 	
 	// User written headers included with " "
 	#include "rs232int.h"						// Include header for serial port class
@@ -24,12 +26,24 @@
 	#include "task_PID.h"						// allows task_lines to call methods belonging to task_PID
 	#include "servo.h"							// allows pen actuation
 	#include "point.h"							// point is used to move between set points
+	#include "path_planner.h"					// lines waiting to be drawn, with planned speeds
+	#include "trajectory.h"						// times the pen's motion along a line
 	#include "task_lines.h"						// include own header file
 	
 	
-	
+	// The number of strokes in our signature
+	#define SIG_STROKES 4
+
+	// Strokes of our signature as x0, y0, xf, yf. The first ends where the second begins, so
+	// the two are drawn in one go.
+	static const int16_t sig_strokes[SIG_STROKES][4] =
+	{
+		{85, 45, 60, 20},
+		{60, 20, 105, 35},
+		{82, 24, 75, 30},
+		{77, 30, 95, 39}
+	};
 
-	
 		
 //-----------------------------------------------------------------------------------------
 /** The constructor initializes variables, and saves object pointers locally.
@@ -40,10 +54,13 @@
 *	@param motor_2 PID object for motor 2
 *	@param get_there Point object used to move from setpoint to setpoint
 *	@param PEN Servo Object to raise/lower pen
+*	@param a_planner Planner object which holds the lines waiting to be drawn
+*	@param a_path Trajectory object which times the motion along each line
 */
 
 task_lines::task_lines(base_text_serial* p_serial_port, task_timer& a_timer, time_stamp& t_stamp, task_PID* motor_1, 
-					   task_PID* motor_2, point* get_there, servo* PEN) : stl_task (a_timer, t_stamp)
+					   task_PID* motor_2, point* get_there, servo* PEN, path_planner* a_planner, trajectory* a_path)
+					   : stl_task (a_timer, t_stamp)
 {
 	// save object pointers locally
 	ptr_2_serial = p_serial_port;
@@ -51,113 +68,84 @@ task_lines::task_lines(base_text_serial* p_serial_port, task_timer& a_timer, tim
 	PID_2 = motor_2;
 	Initial_Point = get_there;
 	operate_pen = PEN;
+	planner = a_planner;
+	path = a_path;
 	
 	// initialize variables
 	x0 = 0;
 	y0 = 0; 
 	xf = 0;
 	yf = 0;
-	divide_lines = false;
 	moving = false;
 	signature = false; 							// signature is set to true if printing our signature
 	send_home = false;							// send_home is set to true if the arm and carrige need to go home
-	sig_count = 0;								
 }
 
-/** run is the main method in task_lines. It takes care of the math involved in cutting a line into segments. It 
-*	first takes the initial and final x&y coordinates, uses the pythagorean theorem to find the length of the
-*	actual line, determins how many segments to break the line up into based on it's overall length, calculates
-*	the slope of the line, and then uses the slope along with the change in the x&y coordinates to determine
-*	if the line passes through the origin (type 1), is vertical (type 2), is horizontal (type 4), or general
-*	and none of the above (type 3). The reason for categorizing what type of line you're drawing is because
-*	the algorithm is slightly different for each line type and certain lines can be drawn much faster by using
-*	a different algorithm, especially lines which pass through the origin. task_lines then breaks the line into
-*	smaller segments, keeps track of what segment the polar plotter is currently on, increments setpoints as 
-*	each one is reached, and uses the point object to physically move the pen to the next setpoint. All of this
-*	is accomplished using a switch-case structure and flags which are raised and lowered depending on what needs
-*	to happen.
+/** go queues the line last given to set_coords in the planner, to be drawn after the lines already waiting.
+*	@return True if the line was queued, false if the planner was full
+*/
+bool task_lines::go(void)
+{
+	return (planner->add_line(x0, y0, xf, yf));
+}
+
+/** Is_Idle tells whether every line has been drawn and the pen is up, clear of the paper.
+*	@return True if there's nothing left to draw
+*/
+bool task_lines::Is_Idle(void)
+{
+	return (get_current_state() == 0 && planner->Is_Empty() && !signature && !send_home);
+}
+
+/** run is the main method in task_lines. When lines are waiting in the planner, the point object moves the pen to
+*	the start of the first one and the pen is lowered. Each time task_lines runs after that, it asks the trajectory
+*	where the pen should be now and hands both PID's the setpoints and speeds for that spot, so the motors follow a
+*	smoothly moving reference. The trajectory carries straight on into each line which starts where the one before
+*	it ended, at the corner speed the planner worked out, so the pen only stops at the end of a run of connected
+*	lines. Once both motors have settled there, the pen is raised and, once it's clear of the paper, the next run,
+*	if any, is started. All of this
+*	is accomplished using a switch-case structure and flags which are raised and lowered depending on what needs to
+*	happen.
 * 	@param state This method uses STL_task to transition its state
 */
 char task_lines::run(char state)
 {
 	switch (state)
 	{
-		/// State 0 is a wait state. Is a new line requested?
+		/// State 0 is a wait state. Are there lines to draw?
 		case 0:
-			// start a new line
-			if (divide_lines == true)
+			// home before the signature
+			if (signature == true)
 			{
-				current_segment = 0;
-				divide_lines = false; 
-				if (signature == true)
-				{
-					send_home = true;
-					return(9);
-				}
-				else
-				{
-					return(1);
-				}
+				send_home = true;
+				return(9);
 			}
-			// do nothing
-			else
+			// start on the waiting lines
+			if (!planner->Is_Empty())
 			{
-				return (STL_NO_TRANSITION);
+				return(2);
 			}
+			// do nothing
+			return (STL_NO_TRANSITION);
 		break;
 		
-		/// State 1 does some initial x-y to r-theta calculations
+		/// State 1 waits for the pen to lift before moving on to the next lines, if any
 		case 1:
-			// calculate total change in x and y
-			SUMdx = ((int32_t)(xf - x0));
-			SUMdy = ((int32_t)(yf - y0));
-			
-			// prepare for pythagorean theorum
-			SUMx_squared = pow((float)SUMdx, 2L);
-			SUMy_squared = pow((float)SUMdy, 2L);
-			
-			//length of line in tenths of inches
-			Seg_Total = (uint16_t)sqrt(SUMx_squared + SUMy_squared);  
-
-			// calculate segment lengths
-			dx = ((1000*SUMdx)/Seg_Total)/400;
-			dy = ((1000*SUMdy)/Seg_Total)/400;
-			
-			// calculate slope
-			if (SUMdx == 0)
-			{
-				//line is vertical, slope undefined (infinity)
-				line_type = 2;
-			}
-			else 
+			counter++;
+			if (counter >= 50UL)
 			{
-				slope = (float)SUMdy/SUMdx;
-			
-				// does this line go through the origin?
-				float intercept = y0 - (slope*x0);
-				
-				if ((intercept < 1L) && (intercept > -1L))
-				{
-					// this line passes through the origin and has a positive slope
-					line_type = 1;
-				}
-				else if (SUMdy == 0)
+				if (!planner->Is_Empty())
 				{
-					// horizontal line 
-					line_type = 4;
-				}
-				else
-				{
-					// a general line that does not pass through the origin and is not vertical or horizontal
-					line_type = 3;
+					return(2);
 				}
+				return(0);
 			}
-			return(2);
+			return (STL_NO_TRANSITION);
 		break;
 		
-		/// State 2 starts movement towards initial point
+		/// State 2 starts movement towards the start of the first waiting line
 		case 2:
-			Initial_Point->Get_There(x0,y0);
+			Initial_Point->Get_There(planner->current()->x_start, planner->current()->y_start);
 			return(3);
 		break;
 		
@@ -175,221 +163,62 @@ char task_lines::run(char state)
 				}
 			}
 			
-			//waiting counter allows time for pen to get down, then starts motor initialization
+			//waiting counter allows time for pen to get down, then starts the pen along the lines
 			if ((counter >= 50UL) && moving)
 			{
 				moving = false;
-				// set line type
-				switch (line_type)
-				{
-					// line through origin
-					case 1:
-						return (4);
-					break;
-					
-					// vertical line
-					case 2:
-						SUMdy = y0 + dy;
-						current_segment = 0;
-						return(5);
-					break;
-					
-					// normal line
-					case 3:
-						SUMdx = ((int32_t)x0) + ((int32_t)dx);
-						SUMdy = ((int32_t)y0) + ((int32_t)dy);
-						current_segment = 0;
-						return(6);
-					break;
-					
-					//  horizontal line 
-					case 4:
-						SUMdx = x0 + dx;
-						current_segment = 0;
-						return(7);
-					break;
-				}
+				path->start(the_timer.get_time_now());
+				PID_1->set_reference(path->Get_R(), 0);
+				PID_2->set_reference(path->Get_Theta(), 0);
+				PID_1->go();
+				PID_2->go();
+				return (4);
 			}
 			return (STL_NO_TRANSITION);
 		break;
 		
-		/// state 4 draws line which would pass through origin
+		/// State 4 moves the setpoints along the lines, then waits for the motors to settle at the end
 		case 4:
-			if (moving == false)
+			// on the way: the setpoints and their speeds come from the trajectory
+			if (path->update(the_timer.get_time_now()))
 			{
-				moving = true;
-				Initial_Point->Get_There(xf, yf);
+				PID_1->set_reference(path->Get_R(), path->Get_R_Speed());
+				PID_2->set_reference(path->Get_Theta(), path->Get_Theta_Speed());
 				return (STL_NO_TRANSITION);
 			}
-			else if ( Initial_Point->Are_We_There() )
+			// at the end: hold the setpoints there once, so the PID's can tell when they've arrived
+			if (moving == false)
 			{
-				moving = false;
-				operate_pen->Pen_Up();
-				divide_lines = false;
-				if (signature == true)
-				{
-					send_home = true;
-					return(9);
-				}
-				else
-					return(0);
-			}
-			else
+				moving = true;
+				PID_1->set_setpoint(path->Get_R());
+				PID_2->set_setpoint(path->Get_Theta());
 				return (STL_NO_TRANSITION);
-		break;
-		
-		/// state 5 draws vertical lines
-		case 5:
-			// if segments are all drawn, raise pen and go to wait state
-			if (current_segment >= Seg_Total)
-			{
-				
-				divide_lines = false;
-				PID_1->stop();
-				PID_2->stop();
-				operate_pen->Pen_Up();
-				if (signature == true)
-				{
-					send_home = true;
-					return(9);
-				}
-				return(0);
-			}
-			// line is not done
-			else
-			{
-				// if line segment is not started, start it
-				if (moving == false)
-				{
-					moving = true;
-					Initial_Point->Get_There(x0, (int16_t)SUMdy);
-					return (STL_NO_TRANSITION);
-				}
-				// if at end of segment, increment seg count and setpoint value, lower moving flag
-				else if ( Initial_Point->Are_We_There() )
-				{
-					SUMdy += dy;
-					current_segment++;
-					moving = false;
-					return (STL_NO_TRANSITION);
-				}
-			}
-		return(STL_NO_TRANSITION);
-		break;
-		
-		/// state 6 draws general lines
-		case 6:
-			// if segments are all drawn, raise pen and go to wait state
-			if (current_segment >= Seg_Total)
-			{
-				PID_1->stop();
-				PID_2->stop();
-				divide_lines = false;
-				operate_pen->Pen_Up();
-				if (signature == true)
-				{
-					send_home = true;
-					return(9);
-				}
-				return(0);
-			}
-			// line is not done
-			else
-			{
-				// if line segment not started, ...
-				if (moving == false)
-				{
-					moving = true;
-					SUMdx_16 = ((uint16_t)(SUMdx));
-					SUMdy_16 = ((uint16_t)(SUMdy));
-					Initial_Point->Get_There(SUMdx_16, SUMdy_16);
-					return (STL_NO_TRANSITION);
-				}
-				// if at segment end, ...
-				else if ( Initial_Point->Are_We_There() )
-				{
-					SUMdx += dx;
-					SUMdy += dy;
-					current_segment++;
-					moving = false;
-					return (STL_NO_TRANSITION);
-				}
 			}
-		return (STL_NO_TRANSITION);
-		break;
-		
-		/// state 7 draws horizontal lines
-		case 7:
-			// if segments are all drawn, raise pen and go to wait state
-			if (current_segment >= Seg_Total)
+			// once both motors have settled, raise pen and wait for it to lift
+			if ( (PID_1->At_Seg_End()) && (PID_2->At_Seg_End()) )
 			{
+				moving = false;
 				PID_1->stop();
 				PID_2->stop();
-				divide_lines = false;
 				operate_pen->Pen_Up();
-				if (signature == true)
-				{
-					send_home = true;
-					return(9);
-				}
-				return(0);
-			}
-			// line not done
-			else
-			{
-				// if line segment not started, ..
-				if (moving == false)
-				{
-					moving = true;
-					Initial_Point->Get_There((int16_t)SUMdx, y0);
-					return(STL_NO_TRANSITION);
-				}
-				// if at a segment end, ...
-				else if ( Initial_Point->Are_We_There() )
-				{
-					SUMdx += dx;
-					current_segment++;
-					moving = false;
-					return (STL_NO_TRANSITION);
-				}
+				counter = 0;
+				return(1);
 			}
-		return(STL_NO_TRANSITION);
+			return (STL_NO_TRANSITION);
 		break;
 		
-		/// State 8 draws our signature!
+		/// State 8 draws our signature! Its strokes are queued in the planner like any other lines.
 		case 8: 
-			
-			if (sig_count == 0)
-			{
-				sig_count ++; // increment the signature counter to 1
-				set_coords(60, 20, 85, 45); // load up the coordinates for the first line of the signature
-				return(1); // go to state 1 to start drawing the line
-			}
-			
-			else if (sig_count == 1)
+			signature = false; // makes sure the signature printing sequence stops at the end
+			for (uint8_t stroke = 0; stroke < SIG_STROKES; stroke++)
 			{
-				sig_count ++; // increment the signature counter to 2
-				set_coords(60, 20, 105, 35); // load up the coordinates for the first line of the signature
-				return(1); // go to state 1 to start drawing the line
-			}
-			
-			else if (sig_count == 2)
-			{
-				sig_count ++; // increment the signature counter to 3
-				set_coords(82, 24, 75, 30); // load up the coordinates for the first line of the signature
-				return(1); // go to state 1 to start drawing the line
-			}
-			
-			else if (sig_count == 3)
-			{
-				sig_count = 0; // re-initialize sig_count to 0, more checks to sign
-				set_coords(77, 30, 95, 39); // load up the coordinates for the first line of the signature
-				signature = false; // makes sure the signature printing sequence stops at the end
-				return(1); // go to state 1 to start drawing the last line
+				planner->add_line(sig_strokes[stroke][0], sig_strokes[stroke][1], 
+								  sig_strokes[stroke][2], sig_strokes[stroke][3]);
 			}
+			return(2);
 		break;
 		
-		/// State 9 sends the plotter home after each line in our signature
+		/// State 9 sends the plotter home before our signature
 		case 9:
 			// if Go_Home hasn't raised the I'm home flag, wait for it.
 			if (send_home)
@@ -398,4 +227,5 @@ char task_lines::run(char state)
 				return(8);
 		break;
 	}
+	return (STL_NO_TRANSITION);
 }
@@ -1,35 +1,81 @@
-/** task_print is a state machine which handles the screen printout portion of the user 
-*	interface for the polar plotter. State 0 checks to see if any prompts, errors or
-*	menus need to be printed. If so, the strings are copied to a buffer. State 1 prints the 
-*	buffer one character at a time so as to be cooperative. When the string end is reached,
-*	an endline is printed and State is returned to 0. The exception to this rule is the case 
-*	of the help menu. Because the menu is so long, it is divided into two strings. State two
-*	detects the end of the first half of the menu, copies the second half to the buffer and 
-*	then continues to print one character at a time. Normal string end procedures are then followed.
+/** task_print is a state machine which handles the screen printout portion of the user
+*	interface for the polar plotter. The messages, prompts and menus are kept in a catalogue
+*	in program memory and are asked for by number through print_mode. Each time the task runs
+*	it sends the next few characters of the message straight from flash to the serial port,
+*	as long as the port can take them without waiting, so a long menu never holds up the
+*	other tasks and no copy of it is kept in SRAM. A % in a message is replaced by the next
+*	of the numbers given to print(), and %% prints a %. When the message ends, an endline
+*	is printed and print_mode is set back to PRINT_NOTHING.
 */
 
 #include <stdlib.h>							// Include standard library header files
+#include <string.h>							// for copying the endline
 #include <avr/io.h>							// You'll need this for SFR and bit names
 #include <avr/pgmspace.h>					// allows strings to be stored in flash memory
 #include "rs232int.h"						// Include header for serial port class
+#include "num_format.h"						// fast conversion of numbers to decimal
 #include "da_motor.h"						// Include header for the da_motor class
 #include "task_print.h"						// include own header file
 
 
+// Versions of avr-libc before 1.8.1 have no pgm_read_ptr(); a pointer on the AVR is one word
+#ifndef pgm_read_ptr
+	#define pgm_read_ptr(addr)		((const void*)pgm_read_word (addr))
+#endif
+
+
 //-------------------------------------------------------------------------------------
-// Messages and prompts to display
-char Msg3[] = "Please enter 10^6*K_i [0 to 32667]";
-char Msg4[] = "Please enter 10^4*K_p [0 to 32667]";
-char Msg5[] = "Please enter 100*K_d [0 to 32667]";
-char Msg6[] = "\nCommands:\nSPACE: Emergency Stop\nM: Point Entry Mode\nC: Coordinate Entry Mode\nG: Go\nO: Home\nR: ";
-char Msg7[] = "Invalid entry";
-char Msg8[] = "Apply gain to which motor? [1 or 2]";
-char Msg9[] = "Raise pen\nL: Lower pen\nX: signature\nZ: Reset\nP: Set K_p\nI: Set K_i\nD: Set K_d\nH,?: Display help";
-char Msg10[] = "enter X final [0 - 34.0]\n";
-char Msg11[] = "enter Y final [0 - 22.0]\n";
-char Msg12[] = "enter X initial [0 - 34.0]\n";
-char Msg13[] = "enter Y initial [0 - 22.0]\n";
-char Msg14[] = "Drawing Signature\n";
+// Messages and prompts to display. They stay in program memory and are read from there
+// as they're printed.
+const char Msg_Ki_Prompt[] PROGMEM = "Please enter 10^6*K_i [0 to 32667]";
+const char Msg_Kp_Prompt[] PROGMEM = "Please enter 10^4*K_p [0 to 32667]";
+const char Msg_Kd_Prompt[] PROGMEM = "Please enter 100*K_d [0 to 32667]";
+#ifdef STL_PROFILE
+	#define MSG_HELP_PROFILE	"F: Send task profile\n"
+#else
+	#define MSG_HELP_PROFILE	""
+#endif
+#ifdef STL_TRACE
+	#define MSG_HELP_TRACE		"E: Send state transition trace\n"
+#else
+	#define MSG_HELP_TRACE		""
+#endif
+const char Msg_Help[] PROGMEM = "\nCommands:\nSPACE: Emergency Stop\nM: Point Entry Mode\n"
+								"C: Coordinate Entry Mode\nG: Go\nS: Stop\nO: Home\nR: Raise pen\n"
+								"L: Lower pen\nX: signature\nZ: Reset\nP: Set K_p\nI: Set K_i\n"
+								"D: Set K_d\nQ: Show gains and set points\nT: Telemetry on/off\n"
+								MSG_HELP_PROFILE MSG_HELP_TRACE "%%: Take a G-code program\nH,?: Display help";
+const char Msg_Invalid[] PROGMEM = "Invalid entry";
+const char Msg_Which_Motor[] PROGMEM = "Apply gain to which motor? [1 or 2]";
+const char Msg_X_Final[] PROGMEM = "enter X final [0 - 34.0]\n";
+const char Msg_Y_Final[] PROGMEM = "enter Y final [0 - 22.0]\n";
+const char Msg_X_Initial[] PROGMEM = "enter X initial [0 - 34.0]\n";
+const char Msg_Y_Initial[] PROGMEM = "enter Y initial [0 - 22.0]\n";
+const char Msg_Signature[] PROGMEM = "Drawing Signature\n";
+const char Msg_Ki_Set[] PROGMEM = "K_i of motor % set to %";
+const char Msg_Kp_Set[] PROGMEM = "K_p of motor % set to %";
+const char Msg_Kd_Set[] PROGMEM = "K_d of motor % set to %";
+
+/// The catalogue of messages, in the order of print_message, also in program memory
+const char* const Messages[PRINT_MESSAGES] PROGMEM =
+{
+	NULL,									// PRINT_NOTHING isn't printed
+	Msg_Ki_Prompt,
+	Msg_Kp_Prompt,
+	Msg_Kd_Prompt,
+	Msg_Help,
+	Msg_Invalid,
+	Msg_Which_Motor,
+	Msg_X_Final,
+	Msg_Y_Final,
+	Msg_X_Initial,
+	Msg_Y_Initial,
+	Msg_Signature,
+	Msg_Ki_Set,
+	Msg_Kp_Set,
+	Msg_Kd_Set
+};
+
 //-------------------------------------------------------------------------------------
 /** The constructor creates a task_print object.
 *	@param p_serial_port:	A serial port object allows printing to the screen
@@ -41,209 +87,101 @@ task_print::task_print(base_text_serial* p_serial_port, uint8_t* p_print_mode)
 	ptr_2_serial = p_serial_port;			// serial object to print to screen here
 	ptr_2_Which_Msg = p_print_mode;			//print_mode (in main) tells task_print what to print to screen
 											//print_mode also allows task_read to continue in user input operations
-	
+
 	// say hello
 	*ptr_2_serial << "task_print is online" << endl;
 	// initialize variables
-	print_state = 0;
+	message = PRINT_NOTHING;
+	pending_index = 0xFF;
+	args[0] = 0;
+	args[1] = 0;
+}
+
+/**	print asks for a message to be printed with numbers put in for the %'s in it. The numbers
+*	are kept until the message has been printed.
+*	@param which:	The message, one of print_message
+*	@param arg_0:	The number for the first %
+*	@param arg_1:	The number for the second %
+*/
+void task_print::print(uint8_t which, int32_t arg_0, int32_t arg_1)
+{
+	args[0] = arg_0;
+	args[1] = arg_1;
+	*ptr_2_Which_Msg = which;
 }
 
 /** the run task handles all printing to screen. If another task requests a print by changing print_mode in
-*	main, run moves the appropriate message from program memory to a buffer in data memory and then prints
-*	the message one character per task call.
+*	main, run looks the message up in the catalogue and sends it from program memory a few characters per
+*	task call, without waiting for the serial port.
 */
 void task_print::run(void)
 {
-	switch (print_state)
+	// If nothing is being printed, check to see if interface wants anything printed to screen
+	if (message == PRINT_NOTHING)
 	{
-		/** State 0 is a hub state. It checks to see if interface wants anything printed to screen. If so,
-		*	the appropriate message is moved to a local buffer.
-		*/
-		case 0:
-			switch (*ptr_2_Which_Msg)
-			{	
-				// CASE 0 means do nothing
-				// case 1 was an x entry prompt - no longer used
-				// case 2 was a y entry prompt - no longer used
- 				// CASES 3 - 14 each initialize a message
-				
-				/// Message 3 is a K_i entry prompt
-				case 3:
-					print_state = 1;
-					index = 0;
-					while (Msg3[index])
-					{
-						buffer[index] = Msg3[index];
-						index++;
-					}
-					buffer[index] = 0;
-					index = 0;
-				break;
-				/// Message 3 is a K_p entry prompt
-				case 4:
-				print_state = 1;
-					index = 0;
-					while (Msg4[index])
-					{
-						buffer[index] = Msg4[index];
-						index++;
-					}
-					buffer[index] = 0;
-					index = 0;
-				break;
-				/// Message 3 is a K_d entry prompt
-				case 5:
-				print_state = 1;
-					index = 0;
-					while (Msg5[index])
-					{
-						buffer[index] = Msg5[index];
-						index++;
-					}
-					buffer[index] = 0;
-					index = 0;
-				break;
-				/// Message 6 is the first half of the help menu
-				case 6:
-					print_state = 1;
-					index = 0;
-					while (Msg6[index])
-					{
-						buffer[index] = Msg6[index];
-						index++;
-					}
-					buffer[index] = 0;
-					index = 0;
-					
-				break;
-				/// Message 7 is an invalid input error
-				case 7:
-					print_state = 1;
-					index = 0;
-					while (Msg7[index])
-					{
-						buffer[index] = Msg7[index];
-						index++;
-					}
-					buffer[index] = 0;
-					index = 0;
-				break;
-				/// Message 8 is a prompt asking which motor to apply an entered gain to
-				case 8:
-					print_state = 1;
-					index = 0;
-					while (Msg8[index])
-					{
-						buffer[index] = Msg8[index];
-						index++;
-					}
-					buffer[index] = 0;
-					index = 0;
-				break;
-				
-				/// case 9 is left out as a reminder that msg9 is the second part of help
-				
-				// case 10 -13 coordinate prompts
-				/// Message 10
-				case 10:
-					print_state = 1;
-					index = 0;
-					while (Msg10[index])
-					{
-						buffer[index] = Msg10[index];
-						index++;
-					}
-					buffer[index] = 0;
-					index = 0;
-				break;
-				
-				/// Message 11
-				case 11:
-					print_state = 1;
-					index = 0;
-					while (Msg11[index])
-					{
-						buffer[index] = Msg11[index];
-						index++;
-					}
-					buffer[index] = 0;
-					index = 0;
-				break;
-				
-				/// Message 12
-				case 12:
-					print_state = 1;
-					index = 0;
-					while (Msg12[index])
-					{
-						buffer[index] = Msg12[index];
-						index++;
-					}
-					buffer[index] = 0;
-					index = 0;
-				break;
-				
-				/// Message 13
-				case 13:
-					print_state = 1;
-					index = 0;
-					while (Msg13[index])
-					{
-						buffer[index] = Msg13[index];
-						index++;
-					}
-					buffer[index] = 0;
-					index = 0;
-				break;
-				
-				case 14:
-					print_state = 1;
-					index = 0;
-					while (Msg14[index])
-					{
-						buffer[index] = Msg14[index];
-						index++;
-					}
-					buffer[index] = 0;
-					index = 0;
-				break;
- 			}
-		break;
-		
-		/** State 1 is the actual print state. it keeps track of its progress via index and prints until a nul
-		*	character is encountered. The exception to this rule is in printing the help menu. Because of it's 
-		*	length, the menu is divided into halves. When the first string ends, this state automatically 
-		*	transitions to the second half of the menu. At the end of any message or menu an endline is printed 
-		*	before returning to state 0.
-		*/
-		case 1:
-		
-			// if next char is not nul, continue
-			if (buffer[index] != 0)
-			{
-				*ptr_2_serial << ascii<< buffer[index];			// print next char
-				index++;										// increment index
-			}
-			// if finishing printing first half of help menu, transition to second half
-			else if (*ptr_2_Which_Msg == 6)
+		uint8_t which = *ptr_2_Which_Msg;
+		// main() prints the status, profile and trace itself
+		if (which == PRINT_NOTHING || which == PRINT_STATUS || which == PRINT_PROFILE
+			|| which == PRINT_TRACE)
+		{
+			return;
+		}
+		if (which >= PRINT_MESSAGES)
+		{
+			*ptr_2_Which_Msg = PRINT_NOTHING;
+			return;
+		}
+		message = which;
+		p_next = (const char*)pgm_read_ptr (&Messages[which]);
+		next_arg = 0;
+	}
+
+	// Send characters until the burst is done or the serial port would make us wait
+	for (uint8_t count = 0; count < TASK_PRINT_BURST && ptr_2_serial->ready_to_send (); count++)
+	{
+		// Digits of a number, or the endline, go before the rest of the message
+		if (pending_index != 0xFF)
+		{
+			ptr_2_serial->putchar (pending[pending_index++]);
+			if (pending[pending_index] == '\0')
 			{
-				index = 0;
-				while (Msg9[index])
-					{
-						buffer[index] = Msg9[index];
-						index++;
-					}
-				buffer[index] = 0;
-				index = 0;
-				*ptr_2_Which_Msg = 9;
+				pending_index = 0xFF;
 			}
-			// printing done
-			else if (buffer[index] == 0)
+			continue;
+		}
+
+		// Once the endline has gone, the message is done. If no other message has been asked
+		// for meanwhile, lower the print flag
+		if (p_next == NULL)
+		{
+			if (*ptr_2_Which_Msg == message)
 			{
-				*ptr_2_serial << endl;							// end line
-				*ptr_2_Which_Msg = 0;							// lower print flag
-				print_state = 0;
+				*ptr_2_Which_Msg = PRINT_NOTHING;
 			}
-		break;
+			message = PRINT_NOTHING;
+			return;
+		}
+
+		char ch = pgm_read_byte_near (p_next++);
+		if (ch == '\0')
+		{
+			strcpy (pending, ENDL_STYLE);
+			pending_index = 0;
+			p_next = NULL;
+		}
+		else if (ch == '%' && pgm_read_byte_near (p_next) == '%')
+		{
+			ptr_2_serial->putchar (ch);
+			p_next++;
+		}
+		else if (ch == '%' && next_arg < TASK_PRINT_ARGS)
+		{
+			int32_to_dec (args[next_arg++], pending);
+			pending_index = 0;
+		}
+		else
+		{
+			ptr_2_serial->putchar (ch);
+		}
 	}
-}
\ No newline at end of file
+}
@@ -1,11 +1,11 @@
-/** task_print is a state machine which handles the screen printout portion of the user 
-*	interface for the polar plotter. State 0 checks to see if any prompts, errors or
-*	menus need to be printed. If so, the strings are copied to a buffer. State 1 prints the 
-*	buffer one character at a time so as to be cooperative. When the string end is reached,
-*	an endline is printed and State is returned to 0. The exception to this rule is the case 
-*	of the help menu. Because the menu is so long, it is divided into two strings. State two
-*	detects the end of the first half of the menu, copies the second half to the buffer and 
-*	then continues to print one character at a time. Normal string end procedures are then followed.
+/** task_print is a state machine which handles the screen printout portion of the user
+*	interface for the polar plotter. The messages, prompts and menus are kept in a catalogue
+*	in program memory and are asked for by number through print_mode. Each time the task runs
+*	it sends the next few characters of the message straight from flash to the serial port,
+*	as long as the port can take them without waiting, so a long menu never holds up the
+*	other tasks and no copy of it is kept in SRAM. A % in a message is replaced by the next
+*	of the numbers given to print(), and %% prints a %. When the message ends, an endline
+*	is printed and print_mode is set back to PRINT_NOTHING.
 */
 //-------------------------------------------------------------------------------------
 
@@ -13,21 +13,59 @@
 #ifndef _task_print_H_
 #define _task_print_H_
 
+/// The most characters sent each time the task runs, so that it runs for only a short time
+#define TASK_PRINT_BURST		16
+
+/// The most numbers which can be put into one message
+#define TASK_PRINT_ARGS			2
+
+
+/// These are the messages in the catalogue, which are put in print_mode to print them
+typedef enum
+{
+	PRINT_NOTHING,								///< Nothing is being printed
+	PRINT_KI_PROMPT,							///< Asks for a K_i gain
+	PRINT_KP_PROMPT,							///< Asks for a K_p gain
+	PRINT_KD_PROMPT,							///< Asks for a K_d gain
+	PRINT_HELP,									///< The help menu
+	PRINT_INVALID,								///< An entry which couldn't be used
+	PRINT_WHICH_MOTOR,							///< Asks which motor a gain is for
+	PRINT_X_FINAL,								///< Asks for the x coordinate of a point or line's end
+	PRINT_Y_FINAL,								///< Asks for the y coordinate of a point or line's end
+	PRINT_X_INITIAL,							///< Asks for the x coordinate of a line's start
+	PRINT_Y_INITIAL,							///< Asks for the y coordinate of a line's start
+	PRINT_SIGNATURE,							///< Says the signature is being drawn
+	PRINT_KI_SET,								///< K_i of motor (number 1) set to (number 2)
+	PRINT_KP_SET,								///< K_p of motor (number 1) set to (number 2)
+	PRINT_KD_SET,								///< K_d of motor (number 1) set to (number 2)
+	PRINT_MESSAGES,								///< The number of messages in the catalogue
+	PRINT_TRACE = 0xFD,							///< The state transition trace, written by main()
+	PRINT_PROFILE = 0xFE,						///< The task profile, written by main()
+	PRINT_STATUS = 0xFF							///< Gains and set points, printed by main()
+} print_message;
+
 
 //-------------------------------------------------------------------------------------
 class task_print
 {
 	protected:
-		/// The encoder driver class needs a pointer to the serial port used to output to the terminal.  
-		base_text_serial* ptr_2_serial;			
+		/// The encoder driver class needs a pointer to the serial port used to output to the terminal.
+		base_text_serial* ptr_2_serial;
 		/// pointer to variable indicating what to print
-		uint8_t* ptr_2_Which_Msg;				
-		/// state variable for task_print
-		uint8_t print_state;					
-		/// buffer for currently printing message
-		char buffer[100];						
-		/// keeps track of location in a string
-		uint8_t index;							
+		uint8_t* ptr_2_Which_Msg;
+		/// the message being printed, or PRINT_NOTHING
+		uint8_t message;
+		/// the next character of the message, in program memory
+		const char* p_next;
+		/// numbers which take the place of each % in the message
+		int32_t args[TASK_PRINT_ARGS];
+		/// which of the numbers is put in for the next %
+		uint8_t next_arg;
+		/// characters waiting to be sent: the digits of a number (at most 11 and a nul for an
+		/// int32_t) or the endline at the end of the message
+		char pending[12];
+		/// the next of the pending characters to be sent, or 0xFF if there are none
+		uint8_t pending_index;
 
 	public:
 		/** The constructor creates a task_print object.
@@ -36,17 +74,22 @@ class task_print
 		*							tells task_read when the printing has been completed.
 		*/
 		task_print(base_text_serial* p_serial_port, uint8_t* p_print_mode);
-		
-		/**	run is task_print's only method. It performs all screen printing of menus, prompts
-		*	and errors. Printing is done one character at a time using a two state format. State 
-		*	0 checks to see if any prompts, errors or menus need to be printed. If so, the strings are 
-		*	copied to a buffer. State 1 prints the buffer one character at a time so as to be
-		*	cooperative. When the string end is reached, an endline is printed and State is returned
-		*	to 0. The exception to this rule is the case of the help menu. Because the menu is so long,
-		*	it is divided into two strings. State two detects the end of the first half of the menu,
-		*	copies the second half to the buffer and then continues to print one character at a time.
-		*	Normal string end procedures are then followed.
+
+		/**	print asks for a message to be printed with numbers put in for the %'s in it. The
+		*	numbers are kept until the message has been printed.
+		*	@param which:	The message, one of print_message
+		*	@param arg_0:	The number for the first %
+		*	@param arg_1:	The number for the second %
+		*/
+		void print(uint8_t which, int32_t arg_0 = 0, int32_t arg_1 = 0);
+
+		/**	run performs all screen printing of menus, prompts and errors. If nothing is being
+		*	printed and print_mode asks for a message, the task starts on it. Then as many as
+		*	TASK_PRINT_BURST characters are sent, stopping early if the serial port can't take
+		*	another character without waiting. At the end of the message an endline is printed
+		*	and print_mode is set back to PRINT_NOTHING, unless another message has been asked
+		*	for in the meantime, which is then printed next.
 		*/
-		void run(void);	
+		void run(void);
 };
-#endif // _task_print_H_
\ No newline at end of file
+#endif // _task_print_H_
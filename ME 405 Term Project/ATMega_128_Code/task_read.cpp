@@ -15,6 +15,10 @@
 *						[q,Q]		print current values of gains, encoders and set points
 *						[z,Z]		reset PID controller (on both boards)
 *						[x,X]		Make signiture
+*						[t,T]		turn binary telemetry on or off
+*						[f,F]		send the task profile as a binary block, if compiled with STL_PROFILE
+*						[e,E]		send the state transition trace as a binary block, if compiled with STL_TRACE
+*						[%]			start taking a G-code program, which runs until a line with just %
 *	COORDINATE INPUT MODES: Allows a user to enter values from 0 to 99.9 and accept one decimal place if desired
 *	GAIN ENTRY MODE: Allows a user to enter a number up to 5 digits. User is then promted on which motor to update.
 *					 no enter key is required on this last step.
@@ -32,12 +36,15 @@
 #include "point.h"							// point is used to make dots
 #include "task_lines.h"						// header file for task_lines
 #include "Go_Home.h"						// so user can home the plotter
+#include "telemetry.h"						// so user can turn telemetry on and off
+#include "gcode.h"							// so a PC can send G-code
+#include "task_print.h"						// so messages can be printed with numbers in them
 #include "task_read.h"						// header file for this class
 
 //-------------------------------------------------------------------------------------
 /**	The constructor creates a task_read object which handles user inputs as described above. It takes
 *	in pointers to necessary objects and variables, saves them locally and initializes necessary variables.
-*	Of note, read_state and print_mode are initialized to 3 and 6 respectively so that the help menu will 
+*	Of note, read_state and print_mode are initialized to 3 and PRINT_HELP respectively so that the help menu will 
 *	print out as soon as all constructors run.
 *	@param	p_serial_port:	A pointer to the serial port for printing purposes
 *	@param	motor_1:		A pointer to a PID object
@@ -48,11 +55,15 @@
 *	@param	Tom_Servo		A servo object so pen can be raised/lowered
 *	@param	Home_Slice		A Go_Home object so homing can be initiated
 *	@param	POINTY			A point object so make a point command can be initiated
+*	@param	TLM				A telemetry object so binary telemetry can be turned on and off
+*	@param	G_CODE			A G-code interpreter so programs can be sent from a PC
+*	@param	PRINTER			The task_print object, so messages can be printed with numbers in them
 */
 
 task_read::task_read(base_text_serial* p_serial_port, task_PID* motor_1, task_PID* motor_2, uint8_t* p_print_mode,
 						Master* Master_Object, task_lines* LINES, servo* Tom_Servo,
-						Go_Home* Home_Slice, point* POINTY)
+						Go_Home* Home_Slice, point* POINTY, telemetry* TLM, gcode* G_CODE,
+						task_print* PRINTER)
 {
 	// save pointers locally
 	ptr_2_serial = p_serial_port;			// serial object to print to screen here
@@ -64,10 +75,13 @@ task_read::task_read(base_text_serial* p_serial_port, task_PID* motor_1, task_PI
 	You_Just_Got_Servoed = Tom_Servo;
 	Plotter_Home = Home_Slice;
 	Make_Point = POINTY;
+	Telemetry = TLM;
+	Interpreter = G_CODE;
+	Printer = PRINTER;
 	
 	// initialize variables
 	read_state = 3;							// initialize read state to 3 (print help menu state)
-	*ptr_2_print_mode = 6;					// print out help menu at the start
+	*ptr_2_print_mode = PRINT_HELP;			// print out help menu at the start
 	read_mode = 0;							// read_mode tells input states where to save to
 	
 	// print a hello message
@@ -85,6 +99,7 @@ task_read::task_read(base_text_serial* p_serial_port, task_PID* motor_1, task_PI
 *							6) Wait for gain value prompt
 *							7) Wait for prompt asking which motor to apply gain to
 *							8) Apply entered to gain to correct memory location
+*							13) G-code program: every character goes to the interpreter until it ends
 */
 void task_read::run(void)
 {	
@@ -112,7 +127,7 @@ void task_read::run(void)
 					// K_i entry command
 					case 'i':
 					case 'I':
-						*ptr_2_print_mode = 3;					// print prompt
+						*ptr_2_print_mode = PRINT_KI_PROMPT;	// print prompt
 						read_state = 6;							// change state
 						read_mode = 3;							// save to correct spot
 						K = 0;
@@ -122,7 +137,7 @@ void task_read::run(void)
 					// K_d entry command
 					case 'd':
 					case 'D':
-						*ptr_2_print_mode = 5;					// print prompt
+						*ptr_2_print_mode = PRINT_KD_PROMPT;	// print prompt
 						read_state = 6;							// change state
 						read_mode = 5;							// save to correct spot
 						K = 0;
@@ -132,7 +147,7 @@ void task_read::run(void)
 					// K_p entry command
 					case 'p':
 					case 'P':
-						*ptr_2_print_mode = 4;					// print prompt
+						*ptr_2_print_mode = PRINT_KP_PROMPT;	// print prompt
 						read_state = 6;							// change state
 						read_mode = 4;							// save to correct spot
 						K = 0;
@@ -175,7 +190,7 @@ void task_read::run(void)
 					case 'h':
 					case 'H':
 					case '?':
-						*ptr_2_print_mode = 6;					// print help menu
+						*ptr_2_print_mode = PRINT_HELP;			// print help menu
 						read_state = 3;												
 					break;
 					
@@ -192,9 +207,25 @@ void task_read::run(void)
 					// de-bug printouts
 					case 'q':
 					case 'Q':
-						*ptr_2_print_mode = 0xFF;
+						*ptr_2_print_mode = PRINT_STATUS;
 					break;
 					
+					#ifdef STL_PROFILE
+					// task run times and jitter, for tools/profile_report
+					case 'f':
+					case 'F':
+						*ptr_2_print_mode = PRINT_PROFILE;
+					break;
+					#endif
+					
+					#ifdef STL_TRACE
+					// recent state transitions, for tools/trace_decode
+					case 'e':
+					case 'E':
+						*ptr_2_print_mode = PRINT_TRACE;
+					break;
+					#endif
+					
 					//make a point
 					case 'M':
 					case 'm':
@@ -202,7 +233,7 @@ void task_read::run(void)
 						read_state = 11;
 						point_request = true;
 						index = 1; 
-						*ptr_2_print_mode = 10;					// print prompt
+						*ptr_2_print_mode = PRINT_X_FINAL;		// print prompt
 						coordinate = 0;							// re-initialize temp coordinate memory
 					break;
 					
@@ -213,14 +244,26 @@ void task_read::run(void)
 						read_state = 11;
 						coord_request = true;
 						index = 1; 
-						*ptr_2_print_mode = 12;					// print prompt
+						*ptr_2_print_mode = PRINT_X_INITIAL;	// print prompt
 						coordinate = 0;							// re-initialize temp coordinate memory
 					break;	
 					
 					case 'x':
 					case 'X':
 						read_state = 12;
-						*ptr_2_print_mode = 14;
+						*ptr_2_print_mode = PRINT_SIGNATURE;
+					break;
+					
+					// toggle binary telemetry
+					case 't':
+					case 'T':
+						Telemetry->enable(!Telemetry->is_enabled());
+					break;
+					
+					// take a G-code program from a PC
+					case '%':
+						read_state = 13;
+					break;
 				}
 			}
 		break;
@@ -249,7 +292,7 @@ void task_read::run(void)
 						// CASE 1, no numbers entered, don't save anything
 						case 1:
 							read_mode = 0;
-							*ptr_2_print_mode = 7;				// invalid input error
+							*ptr_2_print_mode = PRINT_INVALID;	// invalid input error
 						break;
 						
 						// CASE 2, one digit entered
@@ -276,7 +319,7 @@ void task_read::run(void)
 							if (dec_flag == 0)
 							{
 								read_mode = 0;
-								*ptr_2_print_mode = 7;			// invalid input error
+								*ptr_2_print_mode = PRINT_INVALID;	// invalid input error
 							}
 						break;
 					}
@@ -306,7 +349,7 @@ void task_read::run(void)
 							X_f = coordinate;
 							coord_num--;
 							read_state = 11;
-							*ptr_2_print_mode = 11;				// print prompt
+							*ptr_2_print_mode = PRINT_Y_FINAL;	// print prompt
 							index = 1;
 							coordinate = 0;						// re-initialize temp coordinate memory
 						break;
@@ -315,7 +358,7 @@ void task_read::run(void)
 							Y0 = coordinate;
 							coord_num--;
 							read_state = 11;
-							*ptr_2_print_mode = 10;				// print prompt
+							*ptr_2_print_mode = PRINT_X_FINAL;	// print prompt
 							index = 1;
 							coordinate = 0;						// re-initialize temp coordinate memory
 						break;
@@ -324,7 +367,7 @@ void task_read::run(void)
 							X0 = coordinate;
 							coord_num--;
 							read_state = 11;
-							*ptr_2_print_mode = 13;				// print prompt
+							*ptr_2_print_mode = PRINT_Y_INITIAL;	// print prompt
 							index = 1;
 							coordinate = 0;						// re-initialize temp coordinate memory
 						break;
@@ -373,7 +416,7 @@ void task_read::run(void)
 					// new line
 					*ptr_2_serial << endl;
 					read_state = 7;
-					*ptr_2_print_mode = 8;						// ask which motor
+					*ptr_2_print_mode = PRINT_WHICH_MOTOR;		// ask which motor
 					
 				}
 				// is (0 > input_char > 9) ? [ie something we dont care about] 
@@ -398,7 +441,7 @@ void task_read::run(void)
 		/**	State 3 prints the help menu. Since that takes a bit the task waits until print out is done
 		*/
 		case 3:
-			if (*ptr_2_print_mode == 0)
+			if (*ptr_2_print_mode == PRINT_NOTHING)
 			{
 				read_state = 0;
 			}
@@ -422,7 +465,7 @@ void task_read::run(void)
 		/** State 5 allows task_print enough time to get a prompt up before coordinate entry task is entered
 		*/
 		case 5:
-			if (*ptr_2_print_mode == 0)
+			if (*ptr_2_print_mode == PRINT_NOTHING)
 			{
 				read_state = 1;
 			}
@@ -431,7 +474,7 @@ void task_read::run(void)
 		/** State 6 allows task_print enough time to get a prompt up before gain entry task is entered
 		*/
 		case 6:
-			if (*ptr_2_print_mode == 0)
+			if (*ptr_2_print_mode == PRINT_NOTHING)
 			{
 				read_state = 2;
 			}
@@ -440,7 +483,7 @@ void task_read::run(void)
 		/** State 7 allows task_print enough time to ask which motor needs its gains adjusted before data is saved
 		*/
 		case 7:
-			if (*ptr_2_print_mode == 0)
+			if (*ptr_2_print_mode == PRINT_NOTHING)
 			{
 				read_state = 8;
 			}
@@ -464,14 +507,17 @@ void task_read::run(void)
 							// CASE 3 means write to K_i
 							case 3:
 								PID_1 -> set_ki((uint16_t) K);
+								Printer -> print(PRINT_KI_SET, 1, (uint16_t) K);
 							break;
 							// CASE 4 means write to K_p
 							case 4:
 								PID_1 -> set_kp((uint16_t) K);
+								Printer -> print(PRINT_KP_SET, 1, (uint16_t) K);
 							break;
 							// CASE 5 means write to K_d
 							case 5:
 								PID_1 -> set_kd((uint16_t) K);
+								Printer -> print(PRINT_KD_SET, 1, (uint16_t) K);
 							break;
 						}
 					break;
@@ -485,14 +531,17 @@ void task_read::run(void)
 							// CASE 3 means write to K_i
 							case 3:
 								PID_2 -> set_ki((uint16_t) K);
+								Printer -> print(PRINT_KI_SET, 2, (uint16_t) K);
 							break;
 							// CASE 4 means write to K_p
 							case 4:
 								PID_2 -> set_kp((uint16_t) K);
+								Printer -> print(PRINT_KP_SET, 2, (uint16_t) K);
 							break;
 							// CASE 5 means write to K_d
 							case 5:
 								PID_2 -> set_kd((uint16_t) K);
+								Printer -> print(PRINT_KD_SET, 2, (uint16_t) K);
 							break;
 						}
 					break;
@@ -521,19 +570,27 @@ void task_read::run(void)
 
 		/// State 11 handles prompt printing wait times for coord entry
 		case 11:
-			if (*ptr_2_print_mode == 0)
+			if (*ptr_2_print_mode == PRINT_NOTHING)
 			{
 				read_state = 1;
 			}
 		break;
 		/// State 12 initiates a command to draw our custom signature
 		case 12:
-			if (*ptr_2_print_mode == 0)
+			if (*ptr_2_print_mode == PRINT_NOTHING)
 			{
 				MAKE_PATH->draw_signature();
 				read_state = 0;
 			}
 		break;
+		
+		/// State 13 hands the serial port to the G-code interpreter until the program ends
+		case 13:
+			if (!Interpreter->run())
+			{
+				read_state = 0;
+			}
+		break;
 	}
 	
 }
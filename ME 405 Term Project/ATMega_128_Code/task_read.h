@@ -15,6 +15,10 @@
 *						[q,Q]		print current values of gains, encoders and set points
 *						[z,Z]		reset PID controller (on both boards)
 *						[x,X]		Make signiture
+*						[t,T]		turn binary telemetry on or off
+*						[f,F]		send the task profile as a binary block, if compiled with STL_PROFILE
+*						[e,E]		send the state transition trace as a binary block, if compiled with STL_TRACE
+*						[%]			start taking a G-code program, which runs until a line with just %
 *	COORDINATE INPUT MODES: Allows a user to enter values from 0 to 99.9 and accept one decimal place if desired
 *	GAIN ENTRY MODE: Allows a user to enter a number up to 5 digits. User is then promted on which motor to update.
 *					 no enter key is required on this last step.
@@ -50,6 +54,12 @@ class task_read
 		Go_Home* Plotter_Home;
 		/// point object so make point operation can be initialized
 		point* Make_Point;
+		/// telemetry channel which the user can turn on and off
+		telemetry* Telemetry;
+		/// G-code interpreter which takes over the serial port while a program is sent
+		gcode* Interpreter;
+		/// task_print, which is given the numbers to put in messages such as a gain's new value
+		task_print* Printer;
 		
 		
 		/// sets coordinate inpute mode to take 4 coords
@@ -86,7 +96,7 @@ class task_read
 	
 		/**	The constructor creates a task_read object which handles user inputs as described above. It takes
 		*	in pointers to necessary objects and variables, saves them locally and initializes necessary variables.			
-		*	Of note, read_state and print_mode are initialized to 3 and 6 respectively so that the help menu will 
+		*	Of note, read_state and print_mode are initialized to 3 and PRINT_HELP respectively so that the help menu will 
 		*	print out as soon as all constructors run.
 		*	@param	p_serial_port:	A pointer to the serial port for printing purposes
 		*	@param	motor_1:		A pointer to a PID object
@@ -97,9 +107,13 @@ class task_read
 		*	@param	Tom_Servo		A servo object so pen can be raised/lowered
 		*	@param	Home_Slice		A Go_Home object so homing can be initiated
 		*	@param	POINTY			A point object so make a point command can be initiated
+		*	@param	TLM				A telemetry object so binary telemetry can be turned on and off
+		*	@param	G_CODE			A G-code interpreter so programs can be sent from a PC
+		*	@param	PRINTER			The task_print object, so messages can be printed with numbers in them
 		*/
 		task_read (base_text_serial* p_serial_port, task_PID* motor_1, task_PID* motor_2, uint8_t* p_print_mode,
-					 Master* SPI, task_lines* LINES, servo* Tom_Servo, Go_Home* Home_Slice, point* POINTY);
+					 Master* SPI, task_lines* LINES, servo* Tom_Servo, Go_Home* Home_Slice, point* POINTY,
+					 telemetry* TLM, gcode* G_CODE, task_print* PRINTER);
 			   
 		/**	the run method handles all user inputs. In easy cases, actions are taken here. in longer cases, states are used
 		*	and flags indicate to another task, task_print, that a message should be printed to screen. 
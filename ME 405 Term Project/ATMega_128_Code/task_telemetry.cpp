@@ -0,0 +1,96 @@
+//======================================================================================
+/** \file  task_telemetry.cpp is a task which sends binary records about the PID
+ *	controllers through the serial port, for decoding by tools/telemetry_decode.
+ *
+ *  License:
+ *    This file released under the Lesser GNU Public License. The program is intended
+ *    for educational use only, but its use is not restricted thereto. 
+ */
+//======================================================================================
+
+#include <stdlib.h>							// Include standard library header files
+#include <avr/io.h>							// You'll need this for SFR and bit names
+#include "rs232int.h"						// Include header for serial port class
+#include "stl_timer.h"						// allows task_telemetry to be scheduled
+#include "stl_task.h"						// allows task_telemetry to be scheduled
+#include "telemetry.h"						// binary telemetry channel
+#include "Master.h"							// so task_PID doesn't get mad
+#include "da_motor.h"						// so task_PID doesn't get mad
+#include "task_PID.h"						// the controllers being watched
+#include "task_telemetry.h"					// include own header file
+
+//-------------------------------------------------------------------------------------
+/** The constructor saves object pointers locally.
+*	@param p_telemetry:		The telemetry channel to send records through
+*	@param a_timer:			Assists in sceduling
+*	@param t_stamp:			Time between samples
+*	@param motor_1:			PID controller for motor 1
+*	@param motor_2:			PID controller for motor 2
+*/
+task_telemetry::task_telemetry(telemetry* p_telemetry, task_timer& a_timer, time_stamp& t_stamp,
+							   task_PID* motor_1, task_PID* motor_2) : stl_task (a_timer, t_stamp)
+{
+	ptr_2_telemetry = p_telemetry;
+	PID_1 = motor_1;
+	PID_2 = motor_2;
+}
+
+//-------------------------------------------------------------------------------------
+/** run sends telemetry records while telemetry is turned on.
+*	@param state is a state variable controlled by STL_task
+*/
+char task_telemetry::run(char state)
+{
+	uint32_t now = the_timer.get_time_now().get_raw_time();
+	
+	switch (state)
+	{
+		/// State 0 waits for telemetry to be turned on, then sends the time base
+		case 0:
+			if (ptr_2_telemetry->is_enabled())
+			{
+				tlm_time_rec time_rec;
+				time_rec.time = now;
+				time_rec.ticks_per_sec = F_CPU / 8UL;
+				ptr_2_telemetry->send(TLM_REC_TIME, &time_rec, sizeof (time_rec));
+				return (1);
+			}
+		break;
+		
+		/// State 1 sends both encoder counts and both controllers' states
+		case 1:
+			if (!ptr_2_telemetry->is_enabled())
+			{
+				return (0);
+			}
+			tlm_encoders_rec enc_rec;
+			enc_rec.time = now;
+			enc_rec.encoder_1 = PID_1->Get_Encoder();
+			enc_rec.encoder_2 = PID_2->Get_Encoder();
+			ptr_2_telemetry->send(TLM_REC_ENCODERS, &enc_rec, sizeof (enc_rec));
+			
+			send_PID(PID_1, 1, now);
+			send_PID(PID_2, 2, now);
+		break;
+	}
+	return (STL_NO_TRANSITION);
+}
+
+//-------------------------------------------------------------------------------------
+/** send_PID fills in a PID state record for one controller and sends it.
+*	@param p_PID:	The controller whose state is sent
+*	@param motor:	Which motor the controller runs
+*	@param now:		Raw time at which the sample is taken
+*/
+void task_telemetry::send_PID(task_PID* p_PID, uint8_t motor, uint32_t now)
+{
+	tlm_pid_rec pid_rec;
+	pid_rec.time = now;
+	pid_rec.motor = motor;
+	pid_rec.running = p_PID->Is_Running();
+	pid_rec.setpoint = p_PID->GET_setpoint();
+	pid_rec.encoder = p_PID->Get_Encoder();
+	pid_rec.error_sum = p_PID->GET_Error_Sum();
+	pid_rec.output = p_PID->GET_Output();
+	ptr_2_telemetry->send(TLM_REC_PID_STATE, &pid_rec, sizeof (pid_rec));
+}
@@ -0,0 +1,53 @@
+//======================================================================================
+/** \file  task_telemetry.h
+ *	task_telemetry.h contains the specification of a task which sends binary telemetry
+ *	records about the PID controllers through the serial port.
+ * 
+ *  License:
+ *    This file released under the Lesser GNU Public License. The program is intended
+ *    for educational use only, but its use is not restricted thereto. 
+ */
+//======================================================================================
+
+// This define prevents this .h file from being included more than once in a .cpp file
+#ifndef _task_telemetry_H_
+#define _task_telemetry_H_
+
+//-------------------------------------------------------------------------------------
+/** task_telemetry is a task which samples both PID controllers every time it runs and
+ *	sends their state as binary records through a telemetry object. It does nothing
+ *	while telemetry is turned off. When telemetry is turned on it first sends a time 
+ *	record, which tells the decoder how to turn raw time stamps into seconds.
+ */
+class task_telemetry : public stl_task
+{
+	protected:
+		/// telemetry channel through which records are sent
+		telemetry* ptr_2_telemetry;
+		/// PID controller for motor 1 (cart)
+		task_PID* PID_1;
+		/// PID controller for motor 2 (arm)
+		task_PID* PID_2;
+		
+		// fill in and send a PID state record
+		void send_PID(task_PID* p_PID, uint8_t motor, uint32_t now);
+		
+	public:
+		/** The constructor creates a telemetry task.
+		*	@param p_telemetry:		The telemetry channel to send records through
+		*	@param a_timer:			Assists in sceduling
+		*	@param t_stamp:			Time between samples
+		*	@param motor_1:			PID controller for motor 1
+		*	@param motor_2:			PID controller for motor 2
+		*/
+		task_telemetry(telemetry* p_telemetry, task_timer& a_timer, time_stamp& t_stamp,
+					   task_PID* motor_1, task_PID* motor_2);
+		
+		/** run is a 2 state task. State 0 waits for telemetry to be turned on, then sends
+		*	a time record. State 1 sends encoder and PID records each time it runs.
+		*	@param state is a state variable controlled by STL_task
+		*/
+		char run(char state);
+};
+
+#endif // _task_telemetry_H_
@@ -0,0 +1,207 @@
+	//======================================================================================
+	/** \file task_velocity.cpp is the inner, velocity loop of a cascaded motor controller.
+	*	One object controls one motor; a task_PID position loop sets the speed it aims for.
+	*
+	*  Revisions:
+	*    \li  06-18-11  Original file
+	*
+	*  License:
+	*    This file released under the Lesser GNU Public License. The program is intended
+	*    for educational use only, but its use is not restricted thereto.
+	*/
+	//======================================================================================
+
+	// System headers included with < >
+	#include <stdlib.h>							// Standard C library
+	#include <avr/io.h>							// Input-output ports, special registers
+	#include <avr/interrupt.h>					// Interrupt handling functions
+
+	// User written headers included with " "
+	#include "rs232int.h"						// Include header for serial port class
+	#include "stl_timer.h"						// allows task_velocity to be scheduled
+	#include "stl_task.h"						// allows task_velocity to be scheduled
+	#include "Master.h"							// allows SPI communications to operate
+	#include "da_motor.h"						// allows motor control to occur
+	#include "task_velocity.h"					// include own header file
+
+	// Gain scaling and limits; speeds are in encoder counts per second
+	#define K_P_DIVISOR 100000L					// Kp is in hundred thousandths
+	#define K_I_DIVISOR 10000000L				// Ki is in ten millionths
+	#define K_D_DIVISOR 1000					// Kd is in thousandths
+	#define DUTY_CYCLE_SATURATE 255				// Saturate duty cycle
+	#define D_FILTER_SHIFT 3					// Derivative filter time constant, 2^n runs
+	#define ANTIWINDUP_SHIFT 1					// Back calculation gain, 1 / 2^n
+//-----------------------------------------------------------------------------------------
+/** The constructor task_velocity creates a velocity loop for one motor. It starts out stopped
+*	with all gains zero.
+*	@param p_serial_port	Allows screen printouts
+*	@param a_timer:			Assists in sceduling
+*	@param t_stamp:			How often the loop runs; 1 to 2 ms works well
+*	@param master_object	An SPI master object
+*	@param motor_object:	A motor object
+*	@param Which_Channel: 	Which motor and encoder, 1 or 2
+*/
+
+task_velocity::task_velocity (base_text_serial* p_serial_port, task_timer& a_timer, time_stamp& t_stamp,
+							  Master* master_object, da_motor* motor_object, uint8_t Which_Channel)
+							  :   stl_task (a_timer, t_stamp)
+{
+	ptr_2_serial = p_serial_port;				// pointer to a serial port
+	func_READ_ENCODER = master_object;			// pointer to encoder object
+	func_UPDATE_MOTOR = motor_object;			// pointer to motor object
+	motor_num = Which_Channel;
+
+	K_p = 0;
+	K_i = 0;
+	K_d = 0;
+	Set_Speed = 0;
+	controller.set_output_limits(-DUTY_CYCLE_SATURATE, DUTY_CYCLE_SATURATE);
+	controller.set_derivative_filter(D_FILTER_SHIFT);
+	controller.set_antiwindup(ANTIWINDUP_SHIFT);
+	output = 0;
+	encoder = 0;
+	velocity = 0;
+	giddyup = false;							// start with the motor stopped
+	homing = false;
+
+	// Say hello
+	*ptr_2_serial << "Velocity loop #"<< motor_num << endl;
+}
+
+/** run is a three state velocity controller. State 0 keeps the motor stopped, state 1 asks
+*	for the encoder counts and speeds, and state 2 waits for them and sets the duty cycle.
+*	Whenever Go_Home takes over the motor, the loop goes back to state 0 and leaves it alone.
+*/
+char task_velocity::run(char state)
+{
+	switch (state)
+	{
+		/** State 0 is a non moving state.
+		*/
+		case 0:
+			if (homing)
+			{
+				return (STL_NO_TRANSITION);
+			}
+
+			func_UPDATE_MOTOR->update_duty_cycle(motor_num, 0);
+			if (giddyup == true)
+			{
+				return (1);
+			}
+			return (STL_NO_TRANSITION);
+
+		/** State 1 starts an SPI transfer which reads both encoders, unless the other velocity
+		*	loop has already started one, in which case that one is shared.
+		*/
+		case 1:
+			if (homing || !giddyup)
+			{
+				return (0);
+			}
+			wait_sequence = func_READ_ENCODER -> get_sequence();
+			func_READ_ENCODER -> start_batch();
+			wait_start = the_timer.get_time_now();
+			run_again_ASAP();
+			return (2);
+
+		/** State 2 waits for the transfer without blocking, then works out a new duty cycle
+		*	from the speed error. If the transfer times out or this motor's encoder couldn't be
+		*	read, the duty cycle is left alone until the next run.
+		*/
+		case 2:
+		{
+			if (func_READ_ENCODER -> get_sequence() == wait_sequence)
+			{
+				if ((the_timer.get_time_now() - wait_start) > time_stamp(0, MASTER_TIMEOUT_US))
+				{
+					func_READ_ENCODER -> abort_batch();
+					return (1);
+				}
+				run_again_ASAP();
+				return (STL_NO_TRANSITION);
+			}
+			if (homing || !giddyup)
+			{
+				return (0);
+			}
+			encoder_snapshot counts;
+			func_READ_ENCODER -> get_snapshot(counts);
+			if (!(counts.fresh & (1 << (motor_num - 1))))
+			{
+				return (1);
+			}
+			encoder = counts.encoder[motor_num - 1];
+			velocity = counts.velocity[motor_num - 1];
+
+			output = controller.update(Set_Speed, velocity);
+			if (output < 0)
+			{
+				func_UPDATE_MOTOR->set_mode(motor_num, 2);	// make motor go CCW
+				func_UPDATE_MOTOR->update_duty_cycle(motor_num, (uint8_t)(-output));
+			}
+			else
+			{
+				func_UPDATE_MOTOR->set_mode(motor_num, 1);
+				func_UPDATE_MOTOR->update_duty_cycle(motor_num, (uint8_t)output);
+			}
+			return (1);
+		}
+	}
+	return (STL_NO_TRANSITION);
+}
+
+/** go enables motor control, starting from a clean controller and zero speed.
+*/
+void task_velocity::go(void)
+{
+	Set_Speed = 0;
+	controller.reset(velocity, 0);
+	giddyup = true;
+}
+
+/** stop disables motor control; the motor is stopped at the loop's next run
+*/
+void task_velocity::stop(void)
+{
+	giddyup = false;
+	Set_Speed = 0;
+}
+
+/** CLEAR resets the loop's state after the encoders have been zeroed
+*/
+void task_velocity::CLEAR(void)
+{
+	encoder = 0;
+	velocity = 0;
+	Set_Speed = 0;
+	output = 0;
+	controller.reset(0, 0);
+}
+
+/** set_kp sets the proportional gain
+*	@param kp_val: the gain in hundred thousandths of duty cycle per count per second
+*/
+void task_velocity::set_kp(uint16_t kp_val)
+{
+	K_p = kp_val;
+	controller.set_kp(pid_fixed<16>::ratio(kp_val, K_P_DIVISOR));
+}
+
+/** set_ki sets the integral gain
+*	@param ki_val: the gain in ten millionths of duty cycle per count per second per run
+*/
+void task_velocity::set_ki(uint16_t ki_val)
+{
+	K_i = ki_val;
+	controller.set_ki(pid_fixed<16>::ratio(ki_val, K_I_DIVISOR));
+}
+
+/** set_kd sets the differential gain
+*	@param kd_val: the gain in thousandths of duty cycle per count per second per run
+*/
+void task_velocity::set_kd(uint16_t kd_val)
+{
+	K_d = kd_val;
+	controller.set_kd(pid_fixed<16>::ratio(kd_val, K_D_DIVISOR));
+}
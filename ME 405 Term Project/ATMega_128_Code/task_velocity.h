@@ -0,0 +1,121 @@
+//======================================================================================
+/** \file  task_velocity.h
+ *	task_velocity.h contains the specifications for the inner, velocity loop of the
+ *	cascaded motor controllers. A task_PID position loop runs on top of it, working out
+ *	how fast the motor should go; this task makes the motor go that fast.
+ *
+ *  Revisions:
+ *    \li  06-18-11  Original file
+ *
+ *  License:
+ *    This file released under the Lesser GNU Public License. The program is intended
+ *    for educational use only, but its use is not restricted thereto.
+ */
+//======================================================================================
+
+// This define prevents this .h file from being included more than once in a .cpp file
+#ifndef _task_velocity_H_
+#define _task_velocity_H_
+
+#include "pid_fixed.h"						// Fixed point PID control law
+//-------------------------------------------------------------------------------------
+ /** task_velocity is the inner loop of a cascaded motor controller. Each time it runs it
+ *	 reads the encoder speed which the slave measures, compares it with the speed asked
+ *	 for by the position loop, and sets the motor's duty cycle. It runs much more often
+ *	 than the position loop, so it can catch the motor's speed up quickly and soak up
+ *	 friction before the position loop ever sees an error. Both velocity loops share
+ *	 each SPI batch, as the single loop PIDs did.
+ */
+class task_velocity : public stl_task
+{
+	protected:
+		/// pointer to a serial port object for printing purposes
+		base_text_serial* ptr_2_serial;
+		/// pointer of type Master to an SPI object
+		Master* func_READ_ENCODER;
+		/// pointer of type da_motor to a motor object
+		da_motor* func_UPDATE_MOTOR;
+		/// tell motor to stop or go
+		bool giddyup;
+		/// homing allows task Go_Home to take control of motors
+		bool homing;
+		/// which motor and encoder this loop controls, 1 or 2
+		uint8_t motor_num;
+		/// sequence number of the newest encoder snapshot when a transfer was requested
+		uint8_t wait_sequence;
+		/// time at which the transfer was requested, so a hung transfer can be given up on
+		time_stamp wait_start;
+		/// duty cycle with sign showing direction
+		int16_t output;
+		/// proportional gain, in hundred thousandths of duty cycle per count per second
+		uint16_t K_p;
+		/// integral gain, in ten millionths of duty cycle per count per second per run
+		uint16_t K_i;
+		/// differential gain, in thousandths of duty cycle per count per second per run
+		uint16_t K_d;
+		/// the control law, with the gains above converted to Q16.16 numbers
+		pid_fixed<16> controller;
+		/// encoder reading
+		int32_t encoder;
+		/// encoder speed measured by the slave, in counts per second
+		int32_t velocity;
+		/// speed asked for by the position loop, in counts per second
+		int32_t Set_Speed;
+
+	public:
+		task_velocity (base_text_serial* p_serial_port, task_timer& a_timer, time_stamp& t_stamp,
+					   Master* master_object, da_motor* motor_object, uint8_t which_Channel);
+
+		/** run is a 3 state velocity controller. State 0 holds the motor stopped until it's
+		*	told to go. State 1 starts an SPI transfer of the encoder counts and speeds. State 2
+		*	waits for the transfer without blocking, then sets the motor's duty cycle.
+		*	@param state is a state variable controlled by STL_task
+		*/
+		char run(char);
+
+		void go(void);
+
+		void stop(void);
+
+		void CLEAR(void);
+
+		void set_kp(uint16_t kp_val);
+
+		void set_ki(uint16_t ki_val);
+
+		void set_kd(uint16_t kd_val);
+
+		/// GET_Kp returns K_p
+		uint16_t GET_Kp(void) {return K_p;}
+		/// GET_Ki returns K_i
+		uint16_t GET_Ki(void) {return K_i;}
+		/// GET_Kd returns K_d
+		uint16_t GET_Kd(void) {return K_d;}
+
+		/** set_speed sets the speed the motor should turn at; the position loop calls this
+		*	@param speed the speed in encoder counts per second
+		*/
+		void set_speed(int32_t speed) {Set_Speed = speed;}
+
+		/// GET_Speed returns the speed which has been asked for, in counts per second
+		int32_t GET_Speed(void) { return(Set_Speed); }
+
+		/// Get_Encoder returns the encoder count from the newest snapshot
+		int32_t Get_Encoder(void) { return(encoder); }
+
+		/// Get_Velocity returns the encoder speed in counts per second, as measured by the slave
+		int32_t Get_Velocity(void) { return(velocity); }
+
+		/// GET_Output returns the signed duty cycle, negative when the motor runs CCW
+		int16_t GET_Output(void) { return(output); }
+
+		/// GET_Error_Sum returns the integral term of the controller, in duty cycle units
+		int32_t GET_Error_Sum(void) { return(controller.get_integral()); }
+
+		/** disable the loop so homing can occur
+		*	@param Nice_Shoes set this true to let Go_Home drive the motor
+		*/
+		void Request_Home(bool Nice_Shoes) {homing = Nice_Shoes;}
+};
+	//-------------------------------------------------------------------------------------
+#endif // _task_velocity_H_
@@ -0,0 +1,314 @@
+//*************************************************************************************
+/** \file gcode_send.cpp
+ *    This program runs on a PC. It sends a G-code file to the plotter through its
+ *    serial port, for the plotter's gcode interpreter to draw. A % is sent first, which
+ *    the plotter's keyboard task takes as the start of a program; once the plotter has
+ *    answered it, the file is streamed. As GRBL's senders do, the program counts the
+ *    characters of the lines which haven't been answered yet, and sends the next line
+ *    only if they will all still fit in the plotter's receive buffer. The buffer never
+ *    overflows, and the plotter always has the next lines waiting while it draws. Lines
+ *    which are just a % are left out, and a % is sent at the end to finish the program.
+ *    Errors are shown with the number of the line in the file which caused them, and
+ *    whatever else the plotter prints, such as its count of lines, errors and underruns
+ *    at the end of the program, is passed through.
+ *
+ *  Usage:
+ *    gcode_send device file [baud_rate]
+ *    The device, such as /dev/ttyUSB0, is set up for raw input and output at the given
+ *    baud rate (default 9600). The plotter must be showing its menu, not waiting for a
+ *    coordinate or gain to be typed in.
+ *
+ *  Revisions:
+ *    \li 06-22-2011 Original file
+ *
+ *  License:
+ *    This file is released under the Lesser GNU Public License, version 2. This
+ *    program is intended for educational use only, but it is not limited thereto.
+ */
+//*************************************************************************************
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <termios.h>
+#include <sys/select.h>
+#include <sys/time.h>
+
+
+/// Characters which may be on their way; one less than RSINT_BUF_SIZE in rs232int.h,
+/// as the plotter's receive buffer holds one fewer character than its size
+#define STREAM_WINDOW		127
+
+/// The longest line which can be read from the file or from the plotter
+#define LINE_SIZE			256
+
+/// Seconds to wait for the plotter to answer the % which starts the program
+#define START_TIMEOUT		5
+
+
+/// These are the lengths and line numbers of the lines on their way, oldest first
+static int lengths[STREAM_WINDOW], numbers[STREAM_WINDOW];
+
+/// This is the index of the oldest line on its way, and the number of lines on their way
+static int oldest = 0, waiting = 0;
+
+/// This is the number of characters on their way
+static int characters = 0;
+
+/// These count the lines sent and the lines answered with an error
+static unsigned long lines_sent = 0, errors = 0;
+
+
+//-------------------------------------------------------------------------------------
+/** This function sets up a serial device for raw input and output at the given baud
+ *  rate.
+ *  @param fd The file descriptor of the open serial device
+ *  @param baud The baud rate, which must be one of the standard rates
+ *  @return True if the port was set up, false if it isn't a serial device
+ */
+
+static bool setup_port (int fd, long baud)
+{
+	struct termios tio;
+	speed_t speed;
+
+	if (tcgetattr (fd, &tio) != 0)
+	{
+		return (false);
+	}
+	switch (baud)
+	{
+		case 19200:  speed = B19200;  break;
+		case 38400:  speed = B38400;  break;
+		case 57600:  speed = B57600;  break;
+		case 115200: speed = B115200; break;
+		default:     speed = B9600;   break;
+	}
+	cfmakeraw (&tio);
+	cfsetispeed (&tio, speed);
+	cfsetospeed (&tio, speed);
+	tio.c_cflag |= CLOCAL | CREAD;
+	tcsetattr (fd, TCSANOW, &tio);
+	return (true);
+}
+
+
+//-------------------------------------------------------------------------------------
+/** This function sends a line to the plotter and remembers it until it's answered.
+ *  @param fd The serial device
+ *  @param line The line, with its line feed
+ *  @param number The line's number in the file, or 0 for the % sent by this program
+ *  @return True if it was sent, false if the device couldn't be written
+ */
+
+static bool send_line (int fd, const char* line, int number)
+{
+	int length = strlen (line);
+	if (write (fd, line, length) != length)
+	{
+		return (false);
+	}
+	int slot = (oldest + waiting) % STREAM_WINDOW;
+	lengths[slot] = length;
+	numbers[slot] = number;
+	waiting++;
+	characters += length;
+	lines_sent++;
+	return (true);
+}
+
+
+//-------------------------------------------------------------------------------------
+/** This function handles one line received from the plotter. An "ok" or "error"
+ *  answers the oldest line on its way; anything else is printed as it is.
+ *  @param reply The line, without its line ending
+ */
+
+static void handle_reply (const char* reply)
+{
+	bool is_ok = (strncmp (reply, "ok", 2) == 0);
+	bool is_error = (strncmp (reply, "error", 5) == 0);
+
+	if (!is_ok && !is_error)
+	{
+		if (*reply != '\0')
+		{
+			printf ("%s\n", reply);
+		}
+		return;
+	}
+	if (waiting == 0)
+	{
+		printf ("Unexpected answer: %s\n", reply);
+		return;
+	}
+	if (is_error)
+	{
+		errors++;
+		printf ("Line %d: %s\n", numbers[oldest], reply);
+	}
+	characters -= lengths[oldest];
+	oldest = (oldest + 1) % STREAM_WINDOW;
+	waiting--;
+}
+
+
+//-------------------------------------------------------------------------------------
+/** This function reads the next line to be sent from the file. Trailing spaces and the
+ *  line ending are replaced by a single line feed, and lines which are just a % are
+ *  skipped. A line too long to fit in the plotter's receive buffer is reported and
+ *  skipped.
+ *  @param p_file The G-code file
+ *  @param line Where the line is put; it must hold LINE_SIZE characters
+ *  @param number The number of the last line read, which is advanced
+ *  @return True if a line was read, false at the end of the file
+ */
+
+static bool read_line (FILE* p_file, char* line, int& number)
+{
+	while (fgets (line, LINE_SIZE - 1, p_file) != NULL)
+	{
+		number++;
+		char* p_end = line + strlen (line);
+		bool whole = (p_end > line && p_end[-1] == '\n') || feof (p_file);
+		while (p_end > line && (p_end[-1] == '\n' || p_end[-1] == '\r' || p_end[-1] == ' '
+								|| p_end[-1] == '\t'))
+		{
+			*--p_end = '\0';
+		}
+		if (!whole || p_end - line + 1 > STREAM_WINDOW)
+		{
+			fprintf (stderr, "Line %d is too long to send; skipped\n", number);
+			while (!whole && fgets (line, LINE_SIZE - 1, p_file) != NULL)
+			{
+				whole = (line[strlen (line) - 1] == '\n');
+			}
+			continue;
+		}
+		if (strcmp (line, "%") == 0)
+		{
+			continue;
+		}
+		strcat (line, "\n");
+		return (true);
+	}
+	return (false);
+}
+
+
+//-------------------------------------------------------------------------------------
+/** The main function opens the serial device and the file, starts the program, streams
+ *  the file, and finishes the program.
+ */
+
+int main (int argc, char** argv)
+{
+	char next[LINE_SIZE];					// The next line to be sent
+	bool have_next = false;					// True if next holds a line
+	int number = 0;							// Number of the last line read from the file
+	bool started = false;					// True once the plotter has answered the %
+	bool end_sent = false;					// True once the closing % has been sent
+	char reply[LINE_SIZE];					// Line being received from the plotter
+	int reply_size = 0;						// Number of characters in reply
+	char in_buf[256];						// Characters read from the plotter
+	struct timeval start_time, end_time;
+
+	if (argc < 3)
+	{
+		fprintf (stderr, "Usage: %s device file [baud_rate]\n", argv[0]);
+		return (1);
+	}
+	FILE* p_file = fopen (argv[2], "r");
+	if (p_file == NULL)
+	{
+		perror (argv[2]);
+		return (1);
+	}
+	int fd = open (argv[1], O_RDWR | O_NOCTTY);
+	if (fd < 0)
+	{
+		perror (argv[1]);
+		return (1);
+	}
+	setup_port (fd, (argc > 3) ? atol (argv[3]) : 9600L);
+	tcflush (fd, TCIOFLUSH);
+	gettimeofday (&start_time, NULL);
+
+	// Until the plotter answers the %, anything else sent would be taken as keystrokes
+	if (!send_line (fd, "%\n", 0))
+	{
+		perror (argv[1]);
+		return (1);
+	}
+
+	while (!end_sent || waiting > 0)
+	{
+		// Send as many lines as will fit
+		while (started && !end_sent)
+		{
+			if (!have_next)
+			{
+				have_next = read_line (p_file, next, number);
+				if (!have_next)
+				{
+					strcpy (next, "%\n");
+				}
+			}
+			if (characters + (int)strlen (next) > STREAM_WINDOW)
+			{
+				break;
+			}
+			if (!send_line (fd, next, have_next ? number : 0))
+			{
+				perror (argv[1]);
+				return (1);
+			}
+			end_sent = !have_next;
+			have_next = false;
+		}
+
+		// Wait for the plotter to answer
+		fd_set readable;
+		FD_ZERO (&readable);
+		FD_SET (fd, &readable);
+		struct timeval timeout = { START_TIMEOUT, 0 };
+		int ready = select (fd + 1, &readable, NULL, NULL, started ? NULL : &timeout);
+		if (ready == 0)
+		{
+			fprintf (stderr, "The plotter didn't answer; is it showing its menu?\n");
+			return (1);
+		}
+		ssize_t got = read (fd, in_buf, sizeof (in_buf));
+		if (got <= 0)
+		{
+			perror (argv[1]);
+			return (1);
+		}
+		for (ssize_t index = 0; index < got; index++)
+		{
+			char ch = in_buf[index];
+			if (ch == '\n')
+			{
+				reply[reply_size] = '\0';
+				handle_reply (reply);
+				reply_size = 0;
+				started = started || (waiting == 0);
+			}
+			else if (ch != '\r' && reply_size < LINE_SIZE - 1)
+			{
+				reply[reply_size++] = ch;
+			}
+		}
+		fflush (stdout);
+	}
+
+	gettimeofday (&end_time, NULL);
+	double seconds = (end_time.tv_sec - start_time.tv_sec)
+					 + (end_time.tv_usec - start_time.tv_usec) / 1.0E6;
+	fprintf (stderr, "%lu lines sent in %.1f s, %lu errors\n", lines_sent, seconds, errors);
+	fclose (p_file);
+	close (fd);
+	return ((errors > 0) ? 1 : 0);
+}
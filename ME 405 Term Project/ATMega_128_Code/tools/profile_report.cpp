@@ -0,0 +1,307 @@
+//*************************************************************************************
+/** \file profile_report.cpp
+ *    This program runs on a PC. It finds the binary task profile blocks which the
+ *    plotter writes when it's compiled with STL_PROFILE (see lib/stl_profile.h) in a
+ *    stream of bytes, checks them, and prints a report for each task: its number of
+ *    runs and overruns, its shortest, average and longest run times and largest
+ *    jitter, and its run time and jitter histograms drawn as bars. Text which the
+ *    plotter prints around the blocks is skipped.
+ *
+ *  Usage:
+ *    profile_report [device_or_file [baud_rate]]
+ *    If a serial device such as /dev/ttyUSB0 is given, it is set up for raw input and
+ *    output at the given baud rate (default 9600), an F is sent to ask the plotter for
+ *    its profile, and the program ends when the profile has been reported or nothing
+ *    has come for a few seconds. If a regular file is given, for example one captured
+ *    from the serial port or written to an SD card, every block in it is reported.
+ *    With no arguments, standard input is read.
+ *
+ *  Revisions:
+ *    \li 06-25-2011 Original file
+ *
+ *  License:
+ *    This file is released under the Lesser GNU Public License, version 2. This
+ *    program is intended for educational use only, but it is not limited thereto.
+ */
+//*************************************************************************************
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <termios.h>
+#include <sys/select.h>
+#include <sys/time.h>
+#include "telemetry_records.h"				// The CRC which protects the blocks
+#include "stl_profile.h"					// Block layout shared with the AVR
+
+
+/// This is the most bytes which are held while looking for a block; the biggest block,
+/// with 255 tasks, fits
+#define BUFFER_SIZE			32768
+
+/// This is the width of the longest bar in a histogram
+#define BAR_WIDTH			24
+
+/// Seconds to wait for the plotter to send its profile
+#define REPLY_TIMEOUT		5
+
+
+/// These count the blocks reported and the blocks which failed their CRC check
+static unsigned long good_blocks = 0, bad_blocks = 0;
+
+
+//-------------------------------------------------------------------------------------
+/** This function sets up a serial device for raw input and output at the given baud
+ *  rate.
+ *  @param fd The file descriptor of the open serial device
+ *  @param baud The baud rate, which must be one of the standard rates
+ *  @return True if the port was set up, false if it isn't a serial device
+ */
+
+static bool setup_port (int fd, long baud)
+{
+	struct termios tio;
+	speed_t speed;
+
+	if (tcgetattr (fd, &tio) != 0)
+	{
+		return (false);
+	}
+	switch (baud)
+	{
+		case 19200:  speed = B19200;  break;
+		case 38400:  speed = B38400;  break;
+		case 57600:  speed = B57600;  break;
+		case 115200: speed = B115200; break;
+		default:     speed = B9600;   break;
+	}
+	cfmakeraw (&tio);
+	cfsetispeed (&tio, speed);
+	cfsetospeed (&tio, speed);
+	tio.c_cflag |= CLOCAL | CREAD;
+	tcsetattr (fd, TCSANOW, &tio);
+	return (true);
+}
+
+
+//-------------------------------------------------------------------------------------
+/** This function prints a number of timer ticks in microseconds.
+ *  @param ticks The number of ticks
+ *  @param ticks_per_sec The number of timer ticks per second
+ */
+
+static void print_us (double ticks, double ticks_per_sec)
+{
+	printf ("%9.1f us", ticks * 1.0E6 / ticks_per_sec);
+}
+
+
+//-------------------------------------------------------------------------------------
+/** This function prints one bar of a histogram, with the count after it.
+ *  @param count The number of times counted in the bin
+ *  @param most The largest count in the histogram, which gets the longest bar
+ */
+
+static void print_bar (uint16_t count, uint16_t most)
+{
+	int length = (most > 0) ? (count * BAR_WIDTH + most - 1) / most : 0;
+	for (int column = 0; column < BAR_WIDTH; column++)
+	{
+		putchar ((column < length) ? '#' : ' ');
+	}
+	printf (" %6u", count);
+}
+
+
+//-------------------------------------------------------------------------------------
+/** This function prints the report for one task.
+ *  @param rec The task's profile record
+ *  @param ticks_per_sec The number of timer ticks per second
+ */
+
+static void report_task (const stl_prof_rec& rec, double ticks_per_sec)
+{
+	printf ("Task %u: interval%s", rec.task, (rec.interval == 0xFFFF) ? " over" : "");
+	print_us (rec.interval, ticks_per_sec);
+	printf (", %lu runs, %u overruns\n", (unsigned long)rec.runs, rec.overruns);
+	if (rec.runs == 0)
+	{
+		return;
+	}
+
+	printf ("  run time: min");
+	print_us (rec.min_run, ticks_per_sec);
+	printf ("  avg");
+	print_us ((double)rec.run_sum / rec.runs, ticks_per_sec);
+	printf ("  max");
+	print_us (rec.max_run, ticks_per_sec);
+	printf ("\n  jitter:   max");
+	print_us (rec.max_jitter, ticks_per_sec);
+	putchar ('\n');
+	if (rec.halvings > 0)
+	{
+		printf ("  (histogram counts have been halved %u times)\n", rec.halvings);
+	}
+
+	// Only the rows from the first to the last bin used in either histogram are shown
+	int first = STL_PROF_BINS, last = -1;
+	uint16_t most_run = 0, most_jitter = 0;
+	for (int bin = 0; bin < STL_PROF_BINS; bin++)
+	{
+		if (rec.run_hist[bin] != 0 || rec.jitter_hist[bin] != 0)
+		{
+			first = (bin < first) ? bin : first;
+			last = bin;
+		}
+		most_run = (rec.run_hist[bin] > most_run) ? rec.run_hist[bin] : most_run;
+		most_jitter = (rec.jitter_hist[bin] > most_jitter)
+					  ? rec.jitter_hist[bin] : most_jitter;
+	}
+	printf ("  %-25s %-31s %s\n", "from", "run time", "jitter");
+	for (int bin = first; bin <= last; bin++)
+	{
+		printf ("  ");
+		print_us ((bin == 0) ? 0 : (1L << bin), ticks_per_sec);
+		printf ("            ");
+		print_bar (rec.run_hist[bin], most_run);
+		printf ("  ");
+		print_bar (rec.jitter_hist[bin], most_jitter);
+		putchar ('\n');
+	}
+}
+
+
+//-------------------------------------------------------------------------------------
+/** This function looks for complete profile blocks in the bytes received so far and
+ *  reports those which pass their CRC check. Bytes which have been looked at are
+ *  thrown away, but a block which has started and isn't finished yet is kept.
+ *  @param buffer The bytes received
+ *  @param p_filled A pointer to the number of bytes in the buffer, which is updated
+ *  @return The number of blocks reported
+ */
+
+static int find_blocks (uint8_t* buffer, int* p_filled)
+{
+	int index = 0;
+	int found = 0;
+
+	while (index + (int)sizeof (stl_prof_header) <= *p_filled)
+	{
+		stl_prof_header header;
+		memcpy (&header, buffer + index, sizeof (header));
+		if (header.magic[0] != STL_PROF_MAGIC_0 || header.magic[1] != STL_PROF_MAGIC_1
+			|| header.version != STL_PROF_VERSION)
+		{
+			index++;
+			continue;
+		}
+
+		// Wait for the rest of the block, unless it could never fit
+		int size = sizeof (header) + header.tasks * sizeof (stl_prof_rec) + 2;
+		if (index + size > *p_filled)
+		{
+			if (index == 0 && *p_filled == BUFFER_SIZE)
+			{
+				index++;
+				continue;
+			}
+			break;
+		}
+
+		uint16_t crc = 0xFFFF;
+		for (int byte = 0; byte < size - 2; byte++)
+		{
+			crc = tlm_crc16_update (crc, buffer[index + byte]);
+		}
+		if (crc != (buffer[index + size - 2] | (buffer[index + size - 1] << 8)))
+		{
+			bad_blocks++;
+			index++;
+			continue;
+		}
+
+		double ticks_per_sec = header.ticks_per_sec ? header.ticks_per_sec : 2000000.0;
+		printf ("Profile %lu: %u tasks, %lu timer ticks per second\n", good_blocks + 1,
+				header.tasks, (unsigned long)header.ticks_per_sec);
+		for (int task = 0; task < header.tasks; task++)
+		{
+			stl_prof_rec rec;
+			memcpy (&rec, buffer + index + sizeof (header) + task * sizeof (rec),
+					sizeof (rec));
+			report_task (rec, ticks_per_sec);
+		}
+		putchar ('\n');
+		good_blocks++;
+		found++;
+		index += size;
+	}
+
+	memmove (buffer, buffer + index, *p_filled - index);
+	*p_filled -= index;
+	return (found);
+}
+
+
+//-------------------------------------------------------------------------------------
+/** The main function opens the input, asks a plotter for its profile if the input is
+ *  a serial device, and reports the profile blocks which come in.
+ */
+
+int main (int argc, char** argv)
+{
+	static uint8_t buffer[BUFFER_SIZE];		// Bytes which haven't been looked at yet
+	int filled = 0;							// Number of bytes in the buffer
+	int fd = 0;								// Standard input unless a file is given
+	bool is_port = false;					// True if a plotter is asked for a profile
+
+	if (argc > 1)
+	{
+		fd = open (argv[1], O_RDWR | O_NOCTTY);
+		if (fd < 0)
+		{
+			fd = open (argv[1], O_RDONLY);
+		}
+		if (fd < 0)
+		{
+			perror (argv[1]);
+			return (1);
+		}
+		is_port = setup_port (fd, (argc > 2) ? atol (argv[2]) : 9600L);
+	}
+	if (is_port && write (fd, "F", 1) != 1)
+	{
+		perror (argv[1]);
+		return (1);
+	}
+
+	while (true)
+	{
+		// A plotter which doesn't answer would leave us waiting forever
+		if (is_port)
+		{
+			fd_set readable;
+			struct timeval timeout = {REPLY_TIMEOUT, 0};
+			FD_ZERO (&readable);
+			FD_SET (fd, &readable);
+			if (select (fd + 1, &readable, NULL, NULL, &timeout) <= 0)
+			{
+				break;
+			}
+		}
+		ssize_t got = read (fd, buffer + filled, BUFFER_SIZE - filled);
+		if (got <= 0)
+		{
+			break;
+		}
+		filled += got;
+		if (find_blocks (buffer, &filled) > 0 && is_port)
+		{
+			break;
+		}
+	}
+
+	fprintf (stderr, "%lu profile(s) reported, %lu bad\n", good_blocks, bad_blocks);
+	return (good_blocks > 0 ? 0 : 1);
+}
@@ -0,0 +1,269 @@
+//*************************************************************************************
+/** \file telemetry_decode.cpp
+ *    This program runs on a PC. It reads the byte stream from the plotter's serial
+ *    port, picks out the binary telemetry frames sent by the telemetry class, checks
+ *    them, and prints each record as one line of comma separated text which can be
+ *    loaded into a spreadsheet or plotting program. Text which the plotter prints
+ *    between frames is passed through with a '#' in front of it, and frames which
+ *    fail their CRC check or are missing from the sequence are reported.
+ *
+ *  Usage:
+ *    telemetry_decode [device_or_file [baud_rate]]
+ *    If a serial device such as /dev/ttyUSB0 is given, it is set up for raw input at
+ *    the given baud rate (default 9600). If a regular file is given, for example one
+ *    captured earlier, it is decoded. With no arguments, standard input is read.
+ *
+ *  Revisions:
+ *    \li 06-07-2011 Original file
+ *    \li 06-27-2011 Times keep counting up when the plotter's 32-bit time wraps around
+ *    \li 06-30-2011 Frames are found and checked by telemetry_frames.h
+ *
+ *  License:
+ *    This file is released under the Lesser GNU Public License, version 2. This
+ *    program is intended for educational use only, but it is not limited thereto.
+ */
+//*************************************************************************************
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <termios.h>
+#include "telemetry_records.h"				// Record layouts shared with the AVR
+#include "telemetry_frames.h"				// Finding and checking frames
+
+
+/// This is the longest run of bytes between zeros which the decoder will hold
+#define SEGMENT_SIZE		512
+
+
+/// This is the number of time stamp ticks per second, from the last time record
+static double ticks_per_sec = 2000000.0;
+
+/// These hold the last time received and the ticks added for each time it wrapped
+static uint32_t last_time = 0;
+static uint64_t time_base = 0;
+
+/// This is the sequence number expected in the next frame
+static int next_sequence = -1;
+
+/// These count good frames, frames with bad CRC's, and frames missing from the stream
+static unsigned long good_frames = 0, bad_frames = 0, lost_frames = 0;
+
+
+//-------------------------------------------------------------------------------------
+/** This function sets up a serial device for raw input at the given baud rate.
+ *  @param fd The file descriptor of the open serial device
+ *  @param baud The baud rate, which must be one of the standard rates
+ *  @return True if the port was set up, false if it isn't a serial device
+ */
+
+static bool setup_port (int fd, long baud)
+{
+	struct termios tio;
+	speed_t speed;
+
+	if (tcgetattr (fd, &tio) != 0)
+	{
+		return (false);
+	}
+	switch (baud)
+	{
+		case 19200:  speed = B19200;  break;
+		case 38400:  speed = B38400;  break;
+		case 57600:  speed = B57600;  break;
+		case 115200: speed = B115200; break;
+		default:     speed = B9600;   break;
+	}
+	cfmakeraw (&tio);
+	cfsetispeed (&tio, speed);
+	cfsetospeed (&tio, speed);
+	tio.c_cflag |= CLOCAL | CREAD;
+	tcsetattr (fd, TCSANOW, &tio);
+	return (true);
+}
+
+
+//-------------------------------------------------------------------------------------
+/** This function turns a record's time into seconds. The plotter's time stamps hold
+ *  32 bits of the timer's tick count, which wrap around every 35.8 minutes at 16 MHz;
+ *  when a time is far below the one before it, the count has wrapped, so 2^32 ticks 
+ *  are added to it and to all the times after it. 
+ *  @param time The raw time from a record
+ *  @return The time in seconds since the plotter's timer started
+ */
+
+static double unwrap_time (uint32_t time)
+{
+	if (time < last_time && last_time - time > 0x80000000UL)
+	{
+		time_base += 0x100000000ULL;
+	}
+	last_time = time;
+	return ((time_base + time) / ticks_per_sec);
+}
+
+
+//-------------------------------------------------------------------------------------
+/** This function prints one record which has passed its CRC check.
+ *  @param type The record type from the first byte of the frame
+ *  @param data A pointer to the record's data
+ *  @param size The number of bytes of data
+ */
+
+static void print_record (uint8_t type, const uint8_t* data, int size)
+{
+	switch (type)
+	{
+		case TLM_REC_TIME:
+			if (size == sizeof (tlm_time_rec))
+			{
+				tlm_time_rec rec;
+				memcpy (&rec, data, sizeof (rec));
+				if (rec.ticks_per_sec != 0)
+				{
+					ticks_per_sec = rec.ticks_per_sec;
+				}
+				printf ("time,%.6f,%lu\n", unwrap_time (rec.time),
+					(unsigned long)rec.ticks_per_sec);
+				return;
+			}
+			break;
+
+		case TLM_REC_ENCODERS:
+			if (size == sizeof (tlm_encoders_rec))
+			{
+				tlm_encoders_rec rec;
+				memcpy (&rec, data, sizeof (rec));
+				printf ("enc,%.6f,%ld,%ld\n", unwrap_time (rec.time),
+					(long)rec.encoder_1, (long)rec.encoder_2);
+				return;
+			}
+			break;
+
+		case TLM_REC_PID_STATE:
+			if (size == sizeof (tlm_pid_rec))
+			{
+				tlm_pid_rec rec;
+				memcpy (&rec, data, sizeof (rec));
+				printf ("pid,%.6f,%u,%u,%ld,%ld,%ld,%d\n", unwrap_time (rec.time),
+					rec.motor, rec.running, (long)rec.setpoint, (long)rec.encoder,
+					(long)rec.error_sum, rec.output);
+				return;
+			}
+			break;
+	}
+	printf ("# unknown record type %u, %d bytes\n", type, size);
+}
+
+
+//-------------------------------------------------------------------------------------
+/** This function handles one run of bytes found between zero bytes in the stream. If
+ *  it decodes to a frame with a good CRC, the record in it is printed; otherwise it is
+ *  assumed to be text (or a damaged frame) and printed as such.
+ *  @param segment The bytes between two zeros
+ *  @param size The number of bytes
+ */
+
+static void handle_segment (const uint8_t* segment, int size)
+{
+	uint8_t frame[SEGMENT_SIZE];
+	int frame_size;
+
+	if (size == 0)
+	{
+		return;
+	}
+
+	frame_size = tlm_decode_frame (segment, size, frame);
+	if (frame_size > 0)
+	{
+		int missing = tlm_count_lost (&next_sequence, frame[1]);
+		if (missing != 0)
+		{
+			lost_frames += missing;
+			printf ("# %d frame(s) lost\n", missing);
+		}
+		good_frames++;
+		print_record (frame[0], frame + 2, frame_size - 4);
+		return;
+	}
+	if (frame_size < 0)
+	{
+		bad_frames++;
+	}
+
+	// It's not a good frame, so show it as text, one line at a time
+	bool line_start = true;
+	for (int index = 0; index < size; index++)
+	{
+		uint8_t ch = segment[index];
+		if (line_start)
+		{
+			fputs ("# ", stdout);
+			line_start = false;
+		}
+		if (ch == '\n')
+		{
+			putchar ('\n');
+			line_start = true;
+		}
+		else if (ch >= ' ' && ch < 0x7F)
+		{
+			putchar (ch);
+		}
+	}
+	if (!line_start)
+	{
+		putchar ('\n');
+	}
+}
+
+
+//-------------------------------------------------------------------------------------
+/** The main function opens the input, splits the stream at zero bytes, and decodes 
+ *  each piece until the input ends.
+ */
+
+int main (int argc, char** argv)
+{
+	int fd = 0;								// Standard input unless a file is given
+	uint8_t segment[SEGMENT_SIZE];			// Bytes received since the last zero
+	int seg_size = 0;						// Number of bytes in segment
+	uint8_t in_buf[256];					// Bytes read from the input
+	ssize_t got;
+
+	if (argc > 1)
+	{
+		fd = open (argv[1], O_RDONLY | O_NOCTTY);
+		if (fd < 0)
+		{
+			perror (argv[1]);
+			return (1);
+		}
+		setup_port (fd, (argc > 2) ? atol (argv[2]) : 9600L);
+	}
+
+	while ((got = read (fd, in_buf, sizeof (in_buf))) > 0)
+	{
+		for (ssize_t index = 0; index < got; index++)
+		{
+			if (in_buf[index] == 0)
+			{
+				handle_segment (segment, seg_size);
+				seg_size = 0;
+			}
+			else if (seg_size < SEGMENT_SIZE)
+			{
+				segment[seg_size++] = in_buf[index];
+			}
+		}
+		fflush (stdout);
+	}
+	handle_segment (segment, seg_size);
+
+	fprintf (stderr, "%lu good frames, %lu bad, %lu lost\n", good_frames, bad_frames,
+		lost_frames);
+	return (0);
+}
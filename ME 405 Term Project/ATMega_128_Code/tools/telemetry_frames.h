@@ -0,0 +1,115 @@
+//*************************************************************************************
+/** \file telemetry_frames.h
+ *    This file holds the part of the telemetry decoder which picks frames out of the
+ *    byte stream from the plotter: it undoes the COBS encoding of the bytes found
+ *    between two zeros, checks the frame's length and CRC, and counts the frames which
+ *    are missing from the sequence. The frame format is described in
+ *    telemetry_records.h. These functions are kept apart from telemetry_decode.cpp so
+ *    that sim/telemetry_bench.cpp can check what the telemetry class sends with the
+ *    same code the decoder uses.
+ *
+ *  Revisions:
+ *    \li 06-30-2011 Original file, taken out of telemetry_decode.cpp
+ *
+ *  License:
+ *    This file is released under the Lesser GNU Public License, version 2. This
+ *    program is intended for educational use only, but it is not limited thereto.
+ */
+//*************************************************************************************
+
+/// This define prevents this .h file from being included more than once in a .cc file
+#ifndef _TELEMETRY_FRAMES_H_
+#define _TELEMETRY_FRAMES_H_
+
+#include <stdint.h>
+#include "telemetry_records.h"				// Frame sizes and the CRC
+
+
+//-------------------------------------------------------------------------------------
+/** This function decodes one COBS encoded block of bytes.
+ *  @param in The encoded bytes, which contain no zeros
+ *  @param in_size The number of encoded bytes
+ *  @param out A place to put the decoded bytes, at least in_size bytes long
+ *  @return The number of decoded bytes, or -1 if the encoding is invalid
+ */
+
+static inline int tlm_cobs_decode (const uint8_t* in, int in_size, uint8_t* out)
+{
+	int in_index = 0;
+	int out_size = 0;
+
+	while (in_index < in_size)
+	{
+		int code = in[in_index++];
+		if (in_index + code - 1 > in_size)
+		{
+			return (-1);
+		}
+		for (int count = 1; count < code; count++)
+		{
+			out[out_size++] = in[in_index++];
+		}
+		if (code < 0xFF && in_index < in_size)
+		{
+			out[out_size++] = 0;
+		}
+	}
+	return (out_size);
+}
+
+
+//-------------------------------------------------------------------------------------
+/** This function decodes the bytes found between two zeros in the stream and checks
+ *  whether they hold a frame. A run of bytes which decodes to something the size of a
+ *  frame but whose CRC doesn't match is a damaged frame; anything else is taken to be
+ *  text which was written between frames.
+ *  @param segment The bytes between two zeros
+ *  @param size The number of bytes
+ *  @param frame A place to put the decoded frame, at least size bytes long
+ *  @return The number of bytes in the frame if it's good, 0 if the bytes aren't a
+ *          frame, or -1 if they're a frame which failed its CRC check
+ */
+
+static inline int tlm_decode_frame (const uint8_t* segment, int size, uint8_t* frame)
+{
+	int frame_size = tlm_cobs_decode (segment, size, frame);
+	if (frame_size < 4 || frame_size > TLM_MAX_FRAME)
+	{
+		return (0);
+	}
+
+	uint16_t crc = 0xFFFF;
+	for (int index = 0; index < frame_size - 2; index++)
+	{
+		crc = tlm_crc16_update (crc, frame[index]);
+	}
+	if (crc != (frame[frame_size - 2] | (frame[frame_size - 1] << 8)))
+	{
+		return (-1);
+	}
+	return (frame_size);
+}
+
+
+//-------------------------------------------------------------------------------------
+/** This function counts the frames missing from the sequence before a good frame. The
+ *  sender gives every frame a sequence number, even those it has to drop, so the
+ *  difference from the number expected is the count of frames which were lost.
+ *  @param p_next_sequence The sequence number expected next, or -1 before the first
+ *                         frame; it's set to the number which should follow this one
+ *  @param sequence The sequence number of the frame which was received
+ *  @return The number of frames lost since the one before
+ */
+
+static inline int tlm_count_lost (int* p_next_sequence, uint8_t sequence)
+{
+	int missing = 0;
+	if (*p_next_sequence >= 0)
+	{
+		missing = (sequence - *p_next_sequence) & 0xFF;
+	}
+	*p_next_sequence = (sequence + 1) & 0xFF;
+	return (missing);
+}
+
+#endif // _TELEMETRY_FRAMES_H_
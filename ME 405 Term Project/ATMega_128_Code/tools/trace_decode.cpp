@@ -0,0 +1,326 @@
+//*************************************************************************************
+/** \file trace_decode.cpp
+ *    This program runs on a PC. It finds the binary trace blocks which the plotter
+ *    writes when it's compiled with STL_TRACE (see lib/stl_trace_records.h) in a stream
+ *    of bytes, checks them, and prints the events in each one. Then it puts together a
+ *    time line for each task, showing which state the task was in and for how long,
+ *    and the total time each task spent in each of its states while it was traced.
+ *    Text which the plotter prints around the blocks is skipped.
+ *
+ *  Usage:
+ *    trace_decode [device_or_file [baud_rate]]
+ *    If a serial device such as /dev/ttyUSB0 is given, it is set up for raw input and
+ *    output at the given baud rate (default 9600), an E is sent to ask the plotter for
+ *    its trace, and the program ends when the trace has been decoded or nothing has
+ *    come for a few seconds. If a regular file is given, for example one captured from
+ *    the serial port after a task stopped with an error, every block in it is decoded.
+ *    With no arguments, standard input is read.
+ *
+ *  Revisions:
+ *    \li 06-26-2011 Original file
+ *
+ *  License:
+ *    This file is released under the Lesser GNU Public License, version 2. This
+ *    program is intended for educational use only, but it is not limited thereto.
+ */
+//*************************************************************************************
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <termios.h>
+#include <sys/select.h>
+#include <sys/time.h>
+#include "telemetry_records.h"				// The CRC which protects the blocks
+#include "stl_trace_records.h"				// Block layout shared with the AVR
+
+
+/// This is the most bytes which are held while looking for a block; the biggest block,
+/// with 255 events, fits
+#define BUFFER_SIZE			4096
+
+/// Seconds to wait for the plotter to send its trace
+#define REPLY_TIMEOUT		5
+
+/// Event times are kept in 24 bits, the timer's 16-bit count and 8 bits of overflows
+#define TIME_MASK			0xFFFFFFL
+
+/// This is the number of task serial numbers and states which can be told apart
+#define MAX_CODES			256
+
+
+/// These count the blocks decoded and the blocks which failed their CRC check
+static unsigned long good_blocks = 0, bad_blocks = 0;
+
+
+//-------------------------------------------------------------------------------------
+/** This function sets up a serial device for raw input and output at the given baud
+ *  rate.
+ *  @param fd The file descriptor of the open serial device
+ *  @param baud The baud rate, which must be one of the standard rates
+ *  @return True if the port was set up, false if it isn't a serial device
+ */
+
+static bool setup_port (int fd, long baud)
+{
+	struct termios tio;
+	speed_t speed;
+
+	if (tcgetattr (fd, &tio) != 0)
+	{
+		return (false);
+	}
+	switch (baud)
+	{
+		case 19200:  speed = B19200;  break;
+		case 38400:  speed = B38400;  break;
+		case 57600:  speed = B57600;  break;
+		case 115200: speed = B115200; break;
+		default:     speed = B9600;   break;
+	}
+	cfmakeraw (&tio);
+	cfsetispeed (&tio, speed);
+	cfsetospeed (&tio, speed);
+	tio.c_cflag |= CLOCAL | CREAD;
+	tcsetattr (fd, TCSANOW, &tio);
+	return (true);
+}
+
+
+//-------------------------------------------------------------------------------------
+/** This function prints a number of timer ticks in milliseconds.
+ *  @param ticks The number of ticks
+ *  @param ticks_per_sec The number of timer ticks per second
+ */
+
+static void print_ms (double ticks, double ticks_per_sec)
+{
+	printf ("%10.3f ms", ticks * 1.0E3 / ticks_per_sec);
+}
+
+
+//-------------------------------------------------------------------------------------
+/** This function decodes the events of one block. Each event's 24-bit time is put on
+ *  a time line which starts at the oldest event, assuming that less than 2^24 ticks
+ *  passed from each event to the next. The events are listed, then each task's time
+ *  line and time in each state.
+ *  @param p_events A pointer to the events, oldest first
+ *  @param count The number of events
+ *  @param ticks_per_sec The number of timer ticks per second
+ */
+
+static void decode_events (const stl_trace_event* p_events, int count,
+						   double ticks_per_sec)
+{
+	long* times = new long[count];
+	long last_raw = 0;
+
+	printf ("  %-13s  %4s  %5s    %5s  %7s\n", "time", "task", "from", "to", "payload");
+	for (int index = 0; index < count; index++)
+	{
+		const stl_trace_event& event = p_events[index];
+		long raw = ((long)event.overflows << 16) | event.ticks;
+		times[index] = (index == 0) ? 0 : times[index - 1] + ((raw - last_raw) & TIME_MASK);
+		last_raw = raw;
+		printf ("  ");
+		print_ms (times[index], ticks_per_sec);
+		printf ("  %4u  %5u -> %5u  %7u\n", event.task, event.from, event.to,
+				event.payload);
+	}
+	long end_time = (count > 0) ? times[count - 1] : 0;
+
+	// Each task's time line runs from its first transition to the end of the trace;
+	// how long it had been in its first state before that isn't known
+	for (int task = 0; task < MAX_CODES; task++)
+	{
+		double in_state[MAX_CODES] = {0};
+		bool seen = false;
+		long since = 0;
+		uint8_t state = 0;
+
+		for (int index = 0; index < count; index++)
+		{
+			const stl_trace_event& event = p_events[index];
+			if (event.task != task)
+			{
+				continue;
+			}
+			if (!seen)
+			{
+				printf ("\n  Task %u:\n", task);
+				printf ("    state %5u  until ", event.from);
+				print_ms (times[index], ticks_per_sec);
+				printf ("  (entered before the trace began)\n");
+				seen = true;
+			}
+			else
+			{
+				if (event.from != state)
+				{
+					printf ("    (an event was lost: state %u went to %u unseen)\n",
+							state, event.from);
+				}
+				printf ("    state %5u  from  ", state);
+				print_ms (since, ticks_per_sec);
+				printf ("  for ");
+				print_ms (times[index] - since, ticks_per_sec);
+				putchar ('\n');
+				in_state[state] += times[index] - since;
+			}
+			state = event.to;
+			since = times[index];
+		}
+		if (!seen)
+		{
+			continue;
+		}
+		printf ("    state %5u  from  ", state);
+		print_ms (since, ticks_per_sec);
+		printf ("  for ");
+		print_ms (end_time - since, ticks_per_sec);
+		printf ("  (still in it at the end of the trace)\n");
+		in_state[state] += end_time - since;
+
+		printf ("    time in each state:");
+		for (int code = 0; code < MAX_CODES; code++)
+		{
+			if (in_state[code] > 0)
+			{
+				printf ("  %u:", code);
+				print_ms (in_state[code], ticks_per_sec);
+			}
+		}
+		putchar ('\n');
+	}
+	delete[] times;
+}
+
+
+//-------------------------------------------------------------------------------------
+/** This function looks for complete trace blocks in the bytes received so far and
+ *  decodes those which pass their CRC check. Bytes which have been looked at are
+ *  thrown away, but a block which has started and isn't finished yet is kept.
+ *  @param buffer The bytes received
+ *  @param p_filled A pointer to the number of bytes in the buffer, which is updated
+ *  @return The number of blocks decoded
+ */
+
+static int find_blocks (uint8_t* buffer, int* p_filled)
+{
+	int index = 0;
+	int found = 0;
+
+	while (index + (int)sizeof (stl_trace_header) <= *p_filled)
+	{
+		stl_trace_header header;
+		memcpy (&header, buffer + index, sizeof (header));
+		if (header.magic[0] != STL_TRACE_MAGIC_0 || header.magic[1] != STL_TRACE_MAGIC_1
+			|| header.version != STL_TRACE_VERSION)
+		{
+			index++;
+			continue;
+		}
+
+		// Wait for the rest of the block
+		int size = sizeof (header) + header.events * sizeof (stl_trace_event) + 2;
+		if (index + size > *p_filled)
+		{
+			break;
+		}
+
+		uint16_t crc = 0xFFFF;
+		for (int byte = 0; byte < size - 2; byte++)
+		{
+			crc = tlm_crc16_update (crc, buffer[index + byte]);
+		}
+		if (crc != (buffer[index + size - 2] | (buffer[index + size - 1] << 8)))
+		{
+			bad_blocks++;
+			index++;
+			continue;
+		}
+
+		double ticks_per_sec = header.ticks_per_sec ? header.ticks_per_sec : 2000000.0;
+		printf ("Trace %lu: %u events%s, %lu timer ticks per second\n", good_blocks + 1,
+				header.events, header.wrapped ? " (older ones were written over)" : "",
+				(unsigned long)header.ticks_per_sec);
+		stl_trace_event* p_events = new stl_trace_event[header.events + 1];
+		memcpy (p_events, buffer + index + sizeof (header),
+				header.events * sizeof (stl_trace_event));
+		decode_events (p_events, header.events, ticks_per_sec);
+		delete[] p_events;
+		putchar ('\n');
+		good_blocks++;
+		found++;
+		index += size;
+	}
+
+	memmove (buffer, buffer + index, *p_filled - index);
+	*p_filled -= index;
+	return (found);
+}
+
+
+//-------------------------------------------------------------------------------------
+/** The main function opens the input, asks a plotter for its trace if the input is a
+ *  serial device, and decodes the trace blocks which come in.
+ */
+
+int main (int argc, char** argv)
+{
+	static uint8_t buffer[BUFFER_SIZE];		// Bytes which haven't been looked at yet
+	int filled = 0;							// Number of bytes in the buffer
+	int fd = 0;								// Standard input unless a file is given
+	bool is_port = false;					// True if a plotter is asked for a trace
+
+	if (argc > 1)
+	{
+		fd = open (argv[1], O_RDWR | O_NOCTTY);
+		if (fd < 0)
+		{
+			fd = open (argv[1], O_RDONLY);
+		}
+		if (fd < 0)
+		{
+			perror (argv[1]);
+			return (1);
+		}
+		is_port = setup_port (fd, (argc > 2) ? atol (argv[2]) : 9600L);
+	}
+	if (is_port && write (fd, "E", 1) != 1)
+	{
+		perror (argv[1]);
+		return (1);
+	}
+
+	while (true)
+	{
+		// A plotter which doesn't answer would leave us waiting forever
+		if (is_port)
+		{
+			fd_set readable;
+			struct timeval timeout = {REPLY_TIMEOUT, 0};
+			FD_ZERO (&readable);
+			FD_SET (fd, &readable);
+			if (select (fd + 1, &readable, NULL, NULL, &timeout) <= 0)
+			{
+				break;
+			}
+		}
+		ssize_t got = read (fd, buffer + filled, BUFFER_SIZE - filled);
+		if (got <= 0)
+		{
+			break;
+		}
+		filled += got;
+		if (find_blocks (buffer, &filled) > 0 && is_port)
+		{
+			break;
+		}
+	}
+
+	fprintf (stderr, "%lu trace(s) decoded, %lu bad\n", good_blocks, bad_blocks);
+	return (good_blocks > 0 ? 0 : 1);
+}
@@ -0,0 +1,207 @@
+//======================================================================================
+/** \file trajectory.cpp is a trajectory generator which moves the pen along straight
+*	lines with limited speed, acceleration and jerk on both motors.
+*
+*  Revisions:
+*    \li  06-19-11  Original file
+*    \li  06-20-11  Draws lines from a path_planner, with entry and exit speeds
+*    \li  06-21-11  Motor counts and speeds from the fixed point kinematics
+*
+*  License:
+*    This file released under the Lesser GNU Public License. The program is intended
+*    for educational use only, but its use is not restricted thereto.
+*/
+//======================================================================================
+
+	// System headers included with < >
+	#include <stdlib.h>							// Standard C library
+	#include <avr/io.h>							// Input-output ports, special registers
+
+	// User written headers included with " "
+	#include "rs232int.h"						// Include header for serial port class
+	#include "stl_timer.h"						// time stamps for timing the line
+	#include "kinematics.h"						// x and y to encoder counts
+	#include "path_planner.h"					// lines to be drawn, with planned speeds
+	#include "trajectory.h"						// include own header file
+
+	// Timer ticks per second, as counted by the task timer
+	#define TICKS_PER_SECOND (F_CPU / 8UL)
+	// Bisection steps used to find the cruising speed of a short line
+	#define CRUISE_STEPS 20
+
+//-----------------------------------------------------------------------------------------
+/** The constructor sets up a trajectory with nothing to draw yet.
+*	@param a_planner The planner from which lines are taken to be drawn
+*/
+trajectory::trajectory(path_planner* a_planner)
+{
+	planner = a_planner;
+	for (uint8_t phase = 0; phase < TRAJ_PHASES; phase++)
+	{
+		phase_time[phase] = 0.0;
+		phase_jerk[phase] = 0.0;
+	}
+	block.x_start = 0;
+	block.y_start = 0;
+	block.x_unit = 0.0;
+	block.y_unit = 0.0;
+	block.length = 0.0;
+	block.entry = 0.0;
+	block.exit = 0.0;
+	duration = 0.0;
+	running = false;
+	r_count = 0;
+	theta_count = 0;
+	r_speed = 0;
+	theta_speed = 0;
+}
+
+/** plan_block works out the S curve for the line in block, from its entry speed up to a
+*	cruising speed and down to its exit speed. If the line is too short to reach its
+*	fastest speed, a lower cruising speed is found by bisection.
+*/
+void trajectory::plan_block(void)
+{
+	float accel = block.accel;
+	float jerk = block.jerk;
+	float lowest = (block.entry > block.exit) ? block.entry : block.exit;
+	float cruise = (block.speed > lowest) ? block.speed : lowest;
+
+	if (path_planner::change_distance(block.entry, cruise, accel, jerk)
+		+ path_planner::change_distance(cruise, block.exit, accel, jerk) > block.length)
+	{
+		float low = lowest;
+		float high = cruise;
+		for (uint8_t step = 0; step < CRUISE_STEPS; step++)
+		{
+			cruise = (low + high) / 2.0;
+			if (path_planner::change_distance(block.entry, cruise, accel, jerk)
+				+ path_planner::change_distance(cruise, block.exit, accel, jerk) > block.length)
+			{
+				high = cruise;
+			}
+			else
+			{
+				low = cruise;
+			}
+		}
+		cruise = low;
+	}
+
+	float up_jerk, up_accel, down_jerk, down_accel;
+	path_planner::change_time(cruise - block.entry, accel, jerk, up_jerk, up_accel);
+	path_planner::change_time(cruise - block.exit, accel, jerk, down_jerk, down_accel);
+	float cruise_length = block.length
+						  - path_planner::change_distance(block.entry, cruise, accel, jerk)
+						  - path_planner::change_distance(cruise, block.exit, accel, jerk);
+
+	phase_time[0] = up_jerk;		phase_jerk[0] = jerk;
+	phase_time[1] = up_accel;		phase_jerk[1] = 0.0;
+	phase_time[2] = up_jerk;		phase_jerk[2] = -jerk;
+	phase_time[3] = (cruise > 0.0 && cruise_length > 0.0) ? cruise_length / cruise : 0.0;
+	phase_jerk[3] = 0.0;
+	phase_time[4] = down_jerk;		phase_jerk[4] = -jerk;
+	phase_time[5] = down_accel;		phase_jerk[5] = 0.0;
+	phase_time[6] = down_jerk;		phase_jerk[6] = jerk;
+
+	duration = 0.0;
+	for (uint8_t phase = 0; phase < TRAJ_PHASES; phase++)
+	{
+		duration += phase_time[phase];
+	}
+}
+
+/** start sets the pen moving along the oldest line in the planner, which the pen must
+*	already be at.
+*	@param now The time at which the pen is at the start of the line
+*/
+void trajectory::start(const time_stamp& now)
+{
+	path_block* p_block = planner->current();
+	if (p_block == NULL)
+	{
+		running = false;
+		return;
+	}
+	planner->start_current();
+	block = *p_block;
+	plan_block();
+	start_time = now;
+	set_outputs(0.0, block.entry);
+	running = true;
+}
+
+/** update works out where the pen should be at the given time and how fast it should be
+*	going, and converts them to encoder counts and speeds for both motors. When a line
+*	ends, it's taken out of the planner; if the next line carries on from it, that one is
+*	started from the moment the first ended. Once the end of the last connected line is
+*	reached, the setpoints stay there with no speed.
+*	@param now The time now
+*	@return True if the pen is still on its way, false once the end has been reached
+*/
+bool trajectory::update(const time_stamp& now)
+{
+	if (!running)
+	{
+		return (false);
+	}
+
+	while (true)
+	{
+		time_stamp elapsed = now;
+		elapsed -= start_time;
+		float time = elapsed.get_raw_time() / (float)TICKS_PER_SECOND;
+
+		if (time < duration)
+		{
+			// Add up the phases which are over, then the part of the phase we're in
+			float distance = 0.0;
+			float speed = block.entry;
+			float accel = 0.0;
+			for (uint8_t phase = 0; phase < TRAJ_PHASES; phase++)
+			{
+				float step = (time < phase_time[phase]) ? time : phase_time[phase];
+				float jerk = phase_jerk[phase];
+				distance += step * (speed + step * (accel / 2.0 + step * jerk / 6.0));
+				speed += step * (accel + step * jerk / 2.0);
+				accel += step * jerk;
+				time -= step;
+				if (time <= 0.0)
+				{
+					break;
+				}
+			}
+			set_outputs(distance, speed);
+			return (true);
+		}
+
+		// This line is done; go straight on to the next one if it starts here
+		planner->finish_current();
+		path_block* p_next = planner->current();
+		if (p_next == NULL || !p_next->connected)
+		{
+			set_outputs(block.length, 0.0);
+			running = false;
+			return (false);
+		}
+		start_time += time_stamp((uint32_t)(duration * TICKS_PER_SECOND + 0.5));
+		planner->start_current();
+		block = *p_next;
+		plan_block();
+	}
+}
+
+/** set_outputs works out the motors' setpoints and speeds for a point on the line. The
+*	point and velocity are turned into fixed point numbers for the kinematics, so the
+*	square root and arctangent are done without floating point arithmetic.
+*	@param distance How far along the line the pen is, in tenths of an inch
+*	@param speed How fast the pen is moving along the line, in tenths per second
+*/
+void trajectory::set_outputs(float distance, float speed)
+{
+	int32_t x = (int32_t)((block.x_start + block.x_unit * distance) * KIN_ONE);
+	int32_t y = (int32_t)((block.y_start + block.y_unit * distance) * KIN_ONE);
+	int32_t x_speed = (int32_t)(block.x_unit * speed * KIN_ONE);
+	int32_t y_speed = (int32_t)(block.y_unit * speed * KIN_ONE);
+	kinematics::to_counts(x, y, x_speed, y_speed, r_count, theta_count, r_speed, theta_speed);
+}
@@ -0,0 +1,98 @@
+//======================================================================================
+/** \file  trajectory.h
+ *	trajectory.h contains the specifications for a trajectory generator which moves the
+ *	pen along straight lines with a smooth, S shaped speed profile. The lines are worked
+ *	out in x and y, then turned into setpoints for the radius and angle motors by the
+ *	kinematics class each time the position loops run.
+ *
+ *  Revisions:
+ *    \li  06-19-11  Original file
+ *    \li  06-20-11  Draws the lines in a path_planner, going through corners at speed
+ *    \li  06-21-11  Setpoints and speeds come from the fixed point kinematics
+ *
+ *  License:
+ *    This file released under the Lesser GNU Public License. The program is intended
+ *    for educational use only, but its use is not restricted thereto.
+ */
+//======================================================================================
+
+// This define prevents this .h file from being included more than once in a .cpp file
+#ifndef _trajectory_H_
+#define _trajectory_H_
+
+#include "path_planner.h"					// Lines to be drawn, with planned speeds
+
+/// The number of phases in an S curve: jerk up, hold, jerk down, cruise, and the mirror
+#define TRAJ_PHASES				7
+
+
+//-------------------------------------------------------------------------------------
+/** trajectory makes time parameterized setpoints for drawing the lines in a path_planner.
+ *	Each line is given a seven phase S curve which changes speed from the entry speed
+ *	planned for it up to a cruising speed and back down to its exit speed, within the
+ *	line's limits on speed, acceleration and jerk. Each time update() is called, the
+ *	distance along the line at that time is turned into encoder counts and speeds for
+ *	both motors, which the position loops then track. When a line ends and the next one
+ *	carries on from it, the next one is started right away, timed from the moment the
+ *	first ended, so the pen goes through the corner without stopping.
+ */
+class trajectory
+{
+	protected:
+		/// the planner which holds the lines to be drawn
+		path_planner* planner;
+		/// a copy of the line being drawn
+		path_block block;
+		/// how long each phase of the S curve lasts, in seconds
+		float phase_time[TRAJ_PHASES];
+		/// jerk along the line during each phase, in tenths of an inch per second cubed
+		float phase_jerk[TRAJ_PHASES];
+		/// total time for the line, in seconds
+		float duration;
+		/// time at which the pen started along the line
+		time_stamp start_time;
+		/// true from start() until the end of the last connected line has been reached
+		bool running;
+		/// radius setpoint, in encoder counts
+		int32_t r_count;
+		/// angle setpoint, in encoder counts
+		int32_t theta_count;
+		/// radius speed, in encoder counts per second
+		int32_t r_speed;
+		/// angle speed, in encoder counts per second
+		int32_t theta_speed;
+
+		void plan_block(void);
+
+		void set_outputs(float distance, float speed);
+
+	public:
+		trajectory(path_planner* a_planner);
+
+		void start(const time_stamp& now);
+
+		bool update(const time_stamp& now);
+
+		/// get_duration returns the time the line being drawn takes, in seconds
+		float get_duration(void) { return (duration); }
+
+		/// Get_Block returns the line being drawn, or the last one drawn
+		const path_block& Get_Block(void) { return (block); }
+
+		/// Is_Running tells whether the pen is still on its way along the lines
+		bool Is_Running(void) { return (running); }
+
+		/// Get_R returns the radius setpoint in encoder counts
+		int32_t Get_R(void) { return (r_count); }
+
+		/// Get_Theta returns the angle setpoint in encoder counts
+		int32_t Get_Theta(void) { return (theta_count); }
+
+		/// Get_R_Speed returns the radius speed in encoder counts per second
+		int32_t Get_R_Speed(void) { return (r_speed); }
+
+		/// Get_Theta_Speed returns the angle speed in encoder counts per second
+		int32_t Get_Theta_Speed(void) { return (theta_speed); }
+};
+
+#endif // _trajectory_H_
@@ -2,7 +2,8 @@
 /** \file  Slave_Driver.cpp
  *  Revisions:
  *            \li  04-26-11  Began tearing and hacking at our lab_4 code.
- *    
+ *            \li  06-13-11  Added command 5, a snapshot of both encoders and the time
+ *            \li  06-15-11  The snapshot also holds both encoders' speeds
  *
  *  License:
  *    This file released under the Lesser GNU Public License. The program is intended
@@ -13,6 +14,8 @@
 #include <stdlib.h>							//!< Include standard library header files
 #include <avr/io.h>							//!< You'll need this for SFR and bit names
 #include "rs232int.h"						//!< Include header for serial port class
+#include "encoder_link.h"					//!< Commands and frame shared with Master
+#include "slave_clock.h"					//!< Microsecond clock for snapshot times
 #include "Slave_Driver.h"
 
 bool busy_1 = 0;							//!< keep encoder 1 from updating during transmission
@@ -22,6 +25,8 @@ uint8_t check_sum_1 = 0; 					//!< check sum for encoder 1
 uint8_t check_sum_2 = 0; 					//!< check sum for encoder 2
 int32_t* ptr_data_1;						//!< pointer to encoder 1
 int32_t* ptr_data_2;						//!< pointer to encoder 2
+int32_t* ptr_speed_1;						//!< pointer to encoder 1's speed
+int32_t* ptr_speed_2;						//!< pointer to encoder 2's speed
 uint8_t encoder_number = 0;					//!< helps determine where to save data
 uint8_t command = 0;						//!< command is the first item sent by master.
 /// Commands for slave are as follows:
@@ -29,6 +34,7 @@ uint8_t command = 0;						//!< command is the first item sent by master.
 /// Command 2: 		initiate transmission of encoder 2 data
 /// Command 3: 		clear encoder data for encoder 1
 /// Command 4: 		clear encoder data for encoder 2
+/// Command 5: 		latch both encoders, their speeds and the time, then send them with a CRC-8
 /// Command 0xFF: 	continue transmission and checksum of previously started data transmission
 
 union packet1								//!< union to assist in partitioning encoder 1 data
@@ -41,18 +47,29 @@ union packet2								//!< union to assist in partitioning encoder 2 data
 		int32_t whole_2;					//!< whole_2 is a 32bit encoder count from motor 2
 		int8_t parts_2[4];					//!< parts_2 is an array chars unioned with whole_2
 	} encoder_buffer2;
+union packet5								//!< union to assist in partitioning a snapshot
+	{
+		link_snapshot data;					//!< data holds both counts and the time of the latch
+		uint8_t bytes[LINK_SNAPSHOT_BYTES];	//!< bytes is an array of chars unioned with data
+	} snapshot_buffer;
+uint8_t snapshot_crc = 0;					//!< CRC-8 of the command and snapshot bytes sent so far
 //-------------------------------------------------------------------------------------
 /** This constructor sets up a slave driver. SPI communication and interrupts are enabled.
 *   @param p_serial_port A pointer to the serial port which writes debugging info. 
 *	@param p_data_1 the address where the encoder counts for motor 1 live in main
 *	@param p_data_2 the address where the encoder counts for motor 2 live in main
+*	@param p_speed_1 the address where the speed of motor 1 lives in main
+*	@param p_speed_2 the address where the speed of motor 2 lives in main
 */
 
-Slave_Driver::Slave_Driver (base_text_serial* p_serial_port,int32_t* p_data_1, int32_t* p_data_2)
+Slave_Driver::Slave_Driver (base_text_serial* p_serial_port,int32_t* p_data_1, int32_t* p_data_2,
+							int32_t* p_speed_1, int32_t* p_speed_2)
 {
 	ptr_to_serial = p_serial_port;          // Store the serial port pointer locally
 	ptr_data_1 = p_data_1;
 	ptr_data_2 = p_data_2;
+	ptr_speed_1 = p_speed_1;
+	ptr_speed_2 = p_speed_2;
 	
 	// Note that when the serial port pointer is used to send a message, it must be
 	// dereferenced with a "*", meaning "what is pointed to by ptr_to_serial" 
@@ -67,6 +84,7 @@ Slave_Driver::Slave_Driver (base_text_serial* p_serial_port,int32_t* p_data_1, i
 	PORTB |= (1<<PIN4)|(1<<PIN5)|(1<<PIN7); 	//pull-up resistors
 	SPCR |= (1<<SPE)|(1<<SPIE);					//enable SPI communication
 	
+	slave_clock_init ();						//start the clock used to time snapshots
 }
 
 /** Packet32 is a method which splits a 32 byte number into 4 packets stored in file scope 
@@ -131,8 +149,43 @@ ISR(SPI_STC_vect)
 			*ptr_data_2 = 0;													// clear encoder 2 data
 		break;
 		
+		/// Case 5 latches both encoders, their speeds and the time at once. Other interrupts can't run in here,
+		/// so the counts can't change between being copied
+		case LINK_CMD_SNAPSHOT:
+			busy_1 = 0;
+			busy_2 = 0;
+			snapshot_buffer.data.encoder_1 = *ptr_data_1;
+			snapshot_buffer.data.encoder_2 = *ptr_data_2;
+			snapshot_buffer.data.time_us = slave_clock_us ();
+			snapshot_buffer.data.velocity_1 = *ptr_speed_1;
+			snapshot_buffer.data.velocity_2 = *ptr_speed_2;
+			encoder_number = command;
+			SPDR = snapshot_buffer.bytes[0];									//Loads the first byte into SPDR
+			snapshot_crc = link_crc8_update (link_crc8_update (0, command), snapshot_buffer.bytes[0]);
+			INTERRUPTING_COW = 1;
+		break;
+		
 		/// case 0xFF continues data transfer already in progress
 		case 0xFF: 
+			if (encoder_number == LINK_CMD_SNAPSHOT)
+			{
+				if (INTERRUPTING_COW < LINK_SNAPSHOT_BYTES)
+				{
+					SPDR = snapshot_buffer.bytes[INTERRUPTING_COW];				//Load the rest of the bytes
+					snapshot_crc = link_crc8_update (snapshot_crc, snapshot_buffer.bytes[INTERRUPTING_COW]);
+					INTERRUPTING_COW++;
+				}
+				else if (INTERRUPTING_COW == LINK_SNAPSHOT_BYTES)
+				{
+					SPDR = snapshot_crc;										//Load the CRC into SPDR
+					INTERRUPTING_COW++;
+				}
+				else
+				{
+					encoder_number = 0;
+				}
+				break;
+			}
 			if(INTERRUPTING_COW <= 3)
 			{
 				if (encoder_number == 0x01)
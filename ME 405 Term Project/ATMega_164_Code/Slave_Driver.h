@@ -6,6 +6,7 @@
  *  Revisions:
  *    \li  04-26-11  Began tearing and hacking at our lab_4 code.
  *	  \li  05-05-11  This file is done.
+ *	  \li  06-15-11  Also given pointers to the encoder speeds, for snapshots
  *
  *  License:
  *    This file released under the Lesser GNU Public License. The program is intended
@@ -33,9 +34,11 @@ class Slave_Driver
 
 	public:
 		/** The constructor says hello using the serial port which is specified in the pointer given to
-		*	it. It is also passed pointers to two variables in main which count encoder ticks
+		*	it. It is also passed pointers to two variables in main which count encoder ticks and two
+		*	which hold the encoder speeds
 		*/
-		Slave_Driver(base_text_serial*, int32_t* p_encoder_1, int32_t* p_encoder_2);	
+		Slave_Driver(base_text_serial*, int32_t* p_encoder_1, int32_t* p_encoder_2, int32_t* p_speed_1,
+					 int32_t* p_speed_2);	
 		/** Packet32 is a method which places encoder data into a buffer which is easily accesible
 		*	for the ISR to pass the data in packets [via union] to the master via SPI
 		*/
@@ -10,6 +10,8 @@
  *            \li  04-18-11  Began tearing and hacking at our lab_3 code.
  *	          \li  04-25-11  Final iteration. (for now)
  *			  \li  05-05-11  Gutted version of encoder to be paired with slave_driver    
+ *            \li  06-14-11  Decoding done with a lookup table; double steps counted as errors
+ *            \li  06-15-11  Edges are timestamped and used to estimate velocity
  *
  *  License:
  *    This file released under the Lesser GNU Public License. The program is intended
@@ -19,24 +21,54 @@
 
 #include <stdlib.h>							//!< Include standard library header files
 #include <avr/io.h>							//!< You'll need this for SFR and bit names
+#include <avr/interrupt.h>					//!< For cli() around shared variables
 #include "rs232int.h"						//!< Include header for serial port class
+#include "slave_clock.h"					//!< Microsecond clock for edge times
 #include "da_encoder.h"						//!< Include header for the A/D class
 /// total # of ticks seen in a revolution by encoder 1
 #define QUAD1  4000		
 /// total # of ticks seen in a revolution by encoder 2
 #define QUAD2  4000	
 
-/** This object utilizes 5 file scope variables for each encoder. This allows motor movement to 
-*   be determined using interrupts. Also, errors and revolutions are counted.
+/** This structure is one entry in the quadrature decoding table. The table is indexed by the
+*	decoder state, which holds the last direction of motion in bit 4 and the last A & B levels in
+*	bits 3 and 2, together with the new A & B levels in bits 1 and 0.
 */
-uint8_t new_1;								//!< Stores channel A & B status for motor 1
-uint8_t old_1 = 0;							//!< Archives channel A & B status for comparison
-uint8_t new_2;								//!< Stores channel A & B status for motor 2
-uint8_t old_2 = 0;							//!< Archives channel A & B status for comparison
+typedef struct
+{
+	int8_t step;							//!< Change in count; +2 or -2 means a step was missed
+	uint8_t next;							//!< Decoder state after this change
+} quad_entry;
+
+/** This table decodes every possible change of the A & B levels. Forward motion runs through the
+*	levels 00, 10, 11, 01 and back to 00. A change of both levels at once means the interrupt was
+*	too late to see a step; the encoder has then moved two steps, most likely in the direction it
+*	was last moving, so the count is moved by two that way and an error is counted. Both encoders
+*	use the same table, which is kept in SRAM since it's read faster from there than from flash.
+*/
+static const quad_entry quad_table[32] =
+{
+	{ 0, 0x00},	{-1, 0x14},	{ 1, 0x08},	{ 2, 0x0C},	// Moving forward, was 00
+	{ 1, 0x00},	{ 0, 0x04},	{ 2, 0x08},	{-1, 0x1C},	// Moving forward, was 01
+	{-1, 0x10},	{ 2, 0x04},	{ 0, 0x08},	{ 1, 0x0C},	// Moving forward, was 10
+	{ 2, 0x00},	{ 1, 0x04},	{-1, 0x18},	{ 0, 0x0C},	// Moving forward, was 11
+	{ 0, 0x10},	{-1, 0x14},	{ 1, 0x08},	{-2, 0x1C},	// Moving backward, was 00
+	{ 1, 0x00},	{ 0, 0x14},	{-2, 0x18},	{-1, 0x1C},	// Moving backward, was 01
+	{-1, 0x10},	{-2, 0x14},	{ 0, 0x18},	{ 1, 0x0C},	// Moving backward, was 10
+	{-2, 0x10},	{ 1, 0x04},	{-1, 0x18},	{ 0, 0x1C}	// Moving backward, was 11
+};
+
+/** This object utilizes 4 file scope variables for each encoder. This allows motor movement to 
+*   be determined using interrupts. Also, errors are counted.
+*/
+uint8_t state_1 = 0;						//!< Decoder state for motor 1, an index into quad_table
+uint8_t state_2 = 0;						//!< Decoder state for motor 2, an index into quad_table
 uint16_t* ptr_to_error_1 = 0;				//!< Counts number of errors encountered on encoder 1
 uint16_t* ptr_to_error_2 = 0;				//!< Counts number of errors encountered on encoder 2
 int32_t* ptr_encoder_1;						//!< counts encoder ticks on motor 1
 int32_t* ptr_encoder_2;						//!< counts encoder ticks on motor 2
+volatile uint32_t edge_time_1 = 0;			//!< time of the last edge on encoder 1
+volatile uint32_t edge_time_2 = 0;			//!< time of the last edge on encoder 2
 
 //-------------------------------------------------------------------------------------
 /** This constructor sets up an encoder driver. Pin Change Interrupts are enabled on ports A & C
@@ -47,16 +79,28 @@ int32_t* ptr_encoder_2;						//!< counts encoder ticks on motor 2
 *	@param p_encoder_2 A pointer to a variable in main which tabulates encoder ticks for channel 2
 *	@param p_error_1 A pointer to a variable in main which tabulates encoder errors for channel 1
 *	@param p_error_2 A pointer to a variable in main which tabulates encoder errors for channel 2
+*	@param p_velocity_1 A pointer to a variable in main which holds the speed of channel 1
+*	@param p_velocity_2 A pointer to a variable in main which holds the speed of channel 2
 */
 
 da_encoder::da_encoder (base_text_serial* p_serial_port, int32_t* p_encoder_1, int32_t* p_encoder_2,
-						uint16_t* p_error_1, uint16_t* p_error_2)
+						uint16_t* p_error_1, uint16_t* p_error_2, int32_t* p_velocity_1, 
+						int32_t* p_velocity_2)
 {
 	ptr_to_serial = p_serial_port;          // Store the serial port pointer locally
 	ptr_encoder_1 = p_encoder_1;			// Store the other pointers locally too
 	ptr_encoder_2 = p_encoder_2;
 	ptr_to_error_1 = p_error_1;
 	ptr_to_error_2 = p_error_2;
+	ptr_velocity[0] = p_velocity_1;
+	ptr_velocity[1] = p_velocity_2;
+	for (uint8_t axis = 0; axis < 2; axis++)
+	{
+		*ptr_velocity[axis] = 0;
+		last_count[axis] = 0;
+		last_edge[axis] = 0;
+	}
+	last_run = 0;
 	
 	// Note that when the serial port pointer is used to send a message, it must be
 	// dereferenced with a "*", meaning "what is pointed to by ptr_to_serial" 
@@ -73,56 +117,136 @@ da_encoder::da_encoder (base_text_serial* p_serial_port, int32_t* p_encoder_1, i
 	PCICR |= (1<<PCIE0)|(1<<PCIE2);			// Enable PC interrupts on PORTS A & D
 	PCMSK0 |= (1<<PCINT0)|(1<<PCINT1); 		// Enable interrupts: PORTA pins 0 & 1
 	PCMSK2 |= (1<<PCINT16)|(1<<PCINT17);		// Enable interrupts: PORTD pins 24 & 25
+	
+	state_1 = (PINA & 0x03) << 2;			// Start the decoders from the present levels
+	state_2 = (PINC & 0x03) << 2;
 	sei();									// Enable interrupts
 }
 
 //-------------------------------------------------------------------------------------
-/**	Interrupt Service for Motor 1 encoder on PORT A pins 0 and 1. Comparitive statements
-*	determine whether motor has rotated forward, backward, or has errored. Any time the
-*	ISR has been called and encoder ticks have been missed by either encoder channel an error
-* 	is logged. Lastly, current encoder status is archived for comparison on next interrupt.
+/**	Interrupt Service for Motor 1 encoder on PORT A pins 0 and 1. The old state and the new A & B
+*	levels pick an entry from the decoding table, which gives the change in count and the next
+*	state. A missed step is logged as an error, and the time of each edge which moves the count is
+*	saved for the velocity estimate.
 */
 ISR(PCINT0_vect)
 {
+	const quad_entry* p_entry = &quad_table[state_1 | (PINA & 0x03)];
+	int8_t step = p_entry->step;
 	
-	new_1 = ((PINA & 0b00000001)|(PINA & 0b00000010));
-	uint8_t crap_var=new_1+old_1+old_1;
-	if (new_1 + old_1 ==3)
-	{
-		(*ptr_encoder_1)++;
-	}
-	else if ((crap_var == 2)||(crap_var == 7))
+	state_1 = p_entry->next;
+	if (step != 0)
 	{
-		(*ptr_encoder_1)++;
+		*ptr_encoder_1 += step;
+		edge_time_1 = slave_clock_us ();
+		if ((uint8_t)(step + 1) > 2)		// True only for +2 and -2
+		{
+			(*ptr_to_error_1)++;
+		}
 	}
-	else
-	{
-		(*ptr_encoder_1)--;
-	}
-	old_1 = new_1;
 }
 //-------------------------------------------------------------------------------------
-/**	Interrupt Service for Motor 2 encoder on PORT C pins 0 and 1. Comparitive statements
-*	determine whether motor has rotated forward, backward, or has errored. Any time the
-*	ISR has been called and encoder ticks have been missed by either encoder channel an error
-* 	is logged. Lastly, current encoder status is archived for comparison on next interrupt.
+/**	Interrupt Service for Motor 2 encoder on PORT C pins 0 and 1. It works the same way as the
+*	one for motor 1.
 */
 ISR(PCINT2_vect)
 {
+	const quad_entry* p_entry = &quad_table[state_2 | (PINC & 0x03)];
+	int8_t step = p_entry->step;
 	
-	new_2 = ((PINC & 0b00000001)|(PINC & 0b00000010));
-	uint8_t crap_var=new_2+old_2+old_2;
-	if (new_2 + old_2 ==3)
+	state_2 = p_entry->next;
+	if (step != 0)
+	{
+		*ptr_encoder_2 += step;
+		edge_time_2 = slave_clock_us ();
+		if ((uint8_t)(step + 1) > 2)		// True only for +2 and -2
+		{
+			(*ptr_to_error_2)++;
+		}
+	}
+}
+//-------------------------------------------------------------------------------------
+/** update_velocity checks whether it's time for new speed estimates and if so makes them.
+*/
+void da_encoder::update_velocity (void)
+{
+	uint8_t temp_sreg = SREG;				// The clock, counts and edge times are changed
+	cli ();									// by interrupts, so read them with those off
+	uint32_t now = slave_clock_us ();
+	int32_t count_1 = *ptr_encoder_1;
+	uint32_t edge_1 = edge_time_1;
+	int32_t count_2 = *ptr_encoder_2;
+	uint32_t edge_2 = edge_time_2;
+	SREG = temp_sreg;
+
+	if ((now - last_run) < VEL_WINDOW_US)
 	{
-		(*ptr_encoder_2)++;
+		return;
 	}
-	else if ((crap_var == 2)||(crap_var == 7))
+	last_run = now;
+
+	estimate (0, count_1, edge_1, now);
+	estimate (1, count_2, edge_2, now);
+}
+
+//-------------------------------------------------------------------------------------
+/** estimate works out one axis' speed, in counts per second, from the counts moved since the last
+*	estimate and the time between the edges at either end of that movement. The division is slow
+*	(tens of microseconds), which is why it's done here in the main loop and not in the interrupts.
+*	@param axis The axis, 0 for encoder 1 or 1 for encoder 2
+*	@param count The axis' count now
+*	@param edge The time of the axis' latest edge
+*	@param now The time now
+*/
+void da_encoder::estimate (uint8_t axis, int32_t count, uint32_t edge, uint32_t now)
+{
+	int32_t moved = count - last_count[axis];
+	int32_t velocity = *ptr_velocity[axis];
+	uint32_t speed;
+
+	if (moved != 0)
 	{
-		(*ptr_encoder_2)++;
+		uint32_t span = edge - last_edge[axis];
+		uint32_t distance = (moved < 0) ? -moved : moved;
+		if (span == 0)
+		{
+			span = 1;
+		}
+		if (distance < 4000UL)				// Keep distance * 10^6 within 32 bits
+		{
+			speed = (distance * 1000000UL) / span;
+		}
+		else
+		{
+			speed = ((distance * 1000UL) / span) * 1000UL;
+		}
+		velocity = (moved < 0) ? -(int32_t)speed : (int32_t)speed;
+		last_count[axis] = count;
+		last_edge[axis] = edge;
 	}
 	else
 	{
-		(*ptr_encoder_2)--;
+		uint32_t idle = now - last_edge[axis];
+		if (idle >= VEL_STOP_US)
+		{
+			velocity = 0;
+		}
+		else
+		{
+			speed = 1000000UL / idle;		// Fastest speed which could have shown no edge
+			if (velocity > (int32_t)speed)
+			{
+				velocity = speed;
+			}
+			else if (velocity < -(int32_t)speed)
+			{
+				velocity = -(int32_t)speed;
+			}
+		}
 	}
-	old_2 = new_2;
-}
\ No newline at end of file
+
+	uint8_t temp_sreg = SREG;				// The SPI interrupt reads the velocity
+	cli ();
+	*ptr_velocity[axis] = velocity;
+	SREG = temp_sreg;
+}
@@ -9,6 +9,7 @@
  *	  \li  04-25-11  I lied. Doxygen comments added today.
  *	  \li  05-04-11  began integrating into slave draver
  *	  \li  05-05-11  this gutted version of encoder does all lab5 requires and nothing more
+ *	  \li  06-15-11  Added velocity estimation from edge times
  *
  *  License:
  *    This file released under the Lesser GNU Public License. The program is intended
@@ -20,22 +21,51 @@
 #ifndef _da_encoder_H_
 #define _da_encoder_H_
 
+/// Time in microseconds between velocity estimates
+#define VEL_WINDOW_US		2000UL
+
+/// If no edge has been seen for this many microseconds, an axis is taken to be stopped
+#define VEL_STOP_US			200000UL
+
 
 //-------------------------------------------------------------------------------------
 /**  Following are the headers of the constructor and methods contained in da_encoder.cpp.
+*
+*	 The encoder interrupts stamp each edge with the time from slave_clock.h. Every VEL_WINDOW_US,
+*	 update_velocity() divides the counts moved since the last estimate by the time between the
+*	 first and last edges which bound them. When moving slowly, that is one count over the time
+*	 between two edges (the 1/T method); when moving fast, it is many counts over nearly the whole
+*	 window, but timed exactly from edge to edge rather than by the window. When no edge comes in a
+*	 window, the speed can't be more than one count over the time since the last edge, so the
+*	 estimate is cut down to that, reaching zero after VEL_STOP_US.
 */
 class da_encoder
 {
 	protected:
 		/// The encoder driver class needs a pointer to the serial port used to output to the terminal.  
 		base_text_serial* ptr_to_serial;
+		/// pointers to variables in main which hold each axis' speed in counts per second
+		int32_t* ptr_velocity[2];
+		/// count on each axis at the last velocity estimate
+		int32_t last_count[2];
+		/// time of the last edge on each axis before the last velocity estimate
+		uint32_t last_edge[2];
+		/// time at which the last velocity estimate was made
+		uint32_t last_run;
+		
+		void estimate (uint8_t, int32_t, uint32_t, uint32_t);
 
 	public:
 		/** The constructor says hello using the serial port which is specified in the pointer given to 
-		*	it. It is also given pointers to two variables in main which count encoder ticks and two
-		*	which count the number of encoder errors.
+		*	it. It is also given pointers to two variables in main which count encoder ticks, two
+		*	which count the number of encoder errors, and two which hold the speeds.
+		*/
+		da_encoder(base_text_serial*, int32_t* , int32_t* ,uint16_t* , uint16_t*, int32_t*, int32_t*);
+		
+		/** update_velocity makes new speed estimates for both axes if VEL_WINDOW_US has gone by since
+		*	the last ones. It should be called from the main loop as often as possible.
 		*/
-		da_encoder(base_text_serial*, int32_t* , int32_t* ,uint16_t* , uint16_t* );
+		void update_velocity (void);
 };
 	//-------------------------------------------------------------------------------------
 #endif // _da_encoder_H_
\ No newline at end of file
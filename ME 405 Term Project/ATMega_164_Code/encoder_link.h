@@ -0,0 +1,101 @@
+//======================================================================================
+/** \file  encoder_link.h
+ *   encoder_link.h describes the SPI link between the encoder slave (the 164, running
+ *   Slave_Driver) and the master (the 1281, running Master). The same file is kept in
+ *   both the ATMega_128_Code and ATMega_164_Code directories; if one is changed, the
+ *   other must be changed to match.
+ *
+ *   Every transfer starts with a command byte from the master. For commands which
+ *   return data, the master then sends LINK_CMD_CONTINUE once for each byte it wants
+ *   back, and the slave loads each reply byte into its SPI data register in its
+ *   transfer complete interrupt, so the master must leave a gap between bytes. All
+ *   multi-byte numbers are sent least significant byte first.
+ *
+ *   The snapshot command latches both encoder counts, their speeds, and the slave's
+ *   microsecond clock in the same interrupt, so the two axes are sampled at one
+ *   instant and the master knows when that was. The speeds are estimated by the slave
+ *   from the times of encoder edges (see da_encoder.h), which is much less noisy than
+ *   differencing counts taken at the master's task intervals. The frame is protected
+ *   by a CRC-8 rather than a sum, which catches the swapped and shifted bytes which a
+ *   sum misses.
+ *
+ *  Revisions:
+ *    \li  06-13-11  Original file, with the snapshot command
+ *    \li  06-15-11  Added encoder speeds to the snapshot
+ *
+ *  License:
+ *    This file released under the Lesser GNU Public License. The program is intended
+ *    for educational use only, but its use is not restricted thereto.
+ */
+//======================================================================================
+
+// This define prevents this .h file from being included more than once in a .cpp file
+#ifndef _ENCODER_LINK_H_
+#define _ENCODER_LINK_H_
+
+#include <stdint.h>
+
+/// Command 1: send encoder 1's count as 4 bytes and an additive checksum
+#define LINK_CMD_READ_1			0x01
+/// Command 2: send encoder 2's count as 4 bytes and an additive checksum
+#define LINK_CMD_READ_2			0x02
+/// Command 3: clear encoder 1; the slave echoes the command in the next byte
+#define LINK_CMD_CLEAR_1		0x03
+/// Command 4: clear encoder 2; the slave echoes the command in the next byte
+#define LINK_CMD_CLEAR_2		0x04
+/// Command 5: latch counts, speeds and the time, then send a link_snapshot and a CRC-8
+#define LINK_CMD_SNAPSHOT		0x05
+/// Sent by the master to clock out the next byte of a reply
+#define LINK_CMD_CONTINUE		0xFF
+
+
+//-------------------------------------------------------------------------------------
+/** This structure is the data sent in reply to LINK_CMD_SNAPSHOT. It is sent byte by
+ *  byte from its in-memory layout, which is the same on both processors.
+ */
+
+typedef struct
+{
+	int32_t encoder_1;					///< Count from the first (radius) encoder
+	int32_t encoder_2;					///< Count from the second (angle) encoder
+	uint32_t time_us;					///< Slave clock, in microseconds, at the latch
+	int32_t velocity_1;					///< Speed of the first encoder, counts per second
+	int32_t velocity_2;					///< Speed of the second encoder, counts per second
+} link_snapshot;
+
+/// Number of data bytes in a snapshot
+#define LINK_SNAPSHOT_BYTES		20
+
+/// Bytes in a whole snapshot transfer: the command, the data, and the CRC-8
+#define LINK_SNAPSHOT_FRAME		(LINK_SNAPSHOT_BYTES + 2)
+
+
+//-------------------------------------------------------------------------------------
+/** This function updates a CRC-8 with one byte. The polynomial is 0x07 (the one used
+ *  by ATM headers and SMBus), and the CRC should be started at zero. The CRC covers the
+ *  command byte and the snapshot data. A bitwise loop is used to save program memory;
+ *  it takes about 3 us at 16 MHz, so the slave can work it out one byte at a time
+ *  within the gap between bytes.
+ *  @param crc The CRC of the bytes before this one
+ *  @param data The next byte
+ *  @return The CRC including the new byte
+ */
+
+static inline uint8_t link_crc8_update (uint8_t crc, uint8_t data)
+{
+	crc ^= data;
+	for (uint8_t bit = 0; bit < 8; bit++)
+	{
+		if (crc & 0x80)
+		{
+			crc = (crc << 1) ^ 0x07;
+		}
+		else
+		{
+			crc <<= 1;
+		}
+	}
+	return (crc);
+}
+
+#endif // _ENCODER_LINK_H_
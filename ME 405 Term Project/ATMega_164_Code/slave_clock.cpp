@@ -0,0 +1,47 @@
+//======================================================================================
+/** \file  slave_clock.cpp
+ *   slave_clock.cpp runs the free-running microsecond clock described in slave_clock.h.
+ *
+ *  Revisions:
+ *    \li  06-13-11  Original file
+ *
+ *  License:
+ *    This file released under the Lesser GNU Public License. The program is intended
+ *    for educational use only, but its use is not restricted thereto.
+ */
+//======================================================================================
+
+#include <stdlib.h>							//!< Include standard library header files
+#include <avr/io.h>							//!< You'll need this for SFR and bit names
+#include <avr/interrupt.h>					//!< For the Timer 1 overflow interrupt
+#include "slave_clock.h"					//!< Include header for the clock
+
+volatile uint32_t clock_high_us = 0;		//!< microseconds counted by Timer 1 overflows
+
+
+//-------------------------------------------------------------------------------------
+/** slave_clock_init sets Timer 1 counting freely at the CPU clock over 8 and turns on
+*	its overflow interrupt. Interrupts must be enabled globally for the clock to run
+*	for more than one timer cycle.
+*/
+
+void slave_clock_init (void)
+{
+	TCCR1A = 0x00;							// Normal 16-bit counting mode
+	TCCR1B = (1 << CS11);					// Prescaler set to main clock / 8
+	TCNT1 = 0;
+	clock_high_us = 0;
+	TIFR1 = (1 << TOV1);					// Clear any old overflow
+	TIMSK1 |= (1 << TOIE1);					// Enable Timer 1 overflow interrupt
+}
+
+
+//-------------------------------------------------------------------------------------
+/**	Interrupt Service for Timer 1 overflow. Each overflow means one more full cycle of
+*	the timer has gone by.
+*/
+
+ISR(TIMER1_OVF_vect)
+{
+	clock_high_us += CLOCK_OVERFLOW_US;
+}
@@ -0,0 +1,58 @@
+//======================================================================================
+/** \file  slave_clock.h
+ *   slave_clock.h declares a free-running microsecond clock for the encoder slave. It
+ *   uses Timer 1, counting at the CPU clock over 8, with an overflow interrupt which
+ *   adds the length of one timer cycle to a 32-bit count of microseconds. The clock
+ *   wraps around after about 71 minutes; differences between two readings are right
+ *   across the wrap so long as they are less than that apart.
+ *
+ *   Timer 1 is also used by task_timer in stl_timer.cpp, so the two can't be used in
+ *   the same program.
+ *
+ *  Revisions:
+ *    \li  06-13-11  Original file
+ *
+ *  License:
+ *    This file released under the Lesser GNU Public License. The program is intended
+ *    for educational use only, but its use is not restricted thereto.
+ */
+//======================================================================================
+
+// This define prevents this .h file from being included more than once in a .cpp file
+#ifndef _SLAVE_CLOCK_H_
+#define _SLAVE_CLOCK_H_
+
+/// Number of Timer 1 counts in one microsecond
+#define CLOCK_TICKS_PER_US		(F_CPU / 8000000UL)
+
+/// Number of microseconds in one full cycle of Timer 1
+#define CLOCK_OVERFLOW_US		(65536UL / CLOCK_TICKS_PER_US)
+
+/// Microseconds counted by all the Timer 1 overflows so far
+extern volatile uint32_t clock_high_us;
+
+// This function starts the clock
+void slave_clock_init (void);
+
+
+//-------------------------------------------------------------------------------------
+/** slave_clock_us reads the clock. It must be called with interrupts disabled, as it
+*	is from inside interrupt service routines; that way the overflow count can't
+*	change while it's being read. If the timer has overflowed but the overflow
+*	interrupt hasn't run yet, the missed cycle is added here.
+*	@return The time in microseconds since the clock was started
+*/
+
+static inline uint32_t slave_clock_us (void)
+{
+	uint16_t count = TCNT1;
+	uint32_t high = clock_high_us;
+
+	if ((TIFR1 & (1 << TOV1)) && count < 0x8000)
+	{
+		high += CLOCK_OVERFLOW_US;
+	}
+	return (high + count / CLOCK_TICKS_PER_US);
+}
+
+#endif // _SLAVE_CLOCK_H_
@@ -4,6 +4,7 @@
  *  Revisions:
  *    \li  04-26-11  Began tearing and hacking at our lab_4 code.
  *	  \li  05-05-11  Finished modifying for lab5 
+ *	  \li  06-15-11  Encoder speeds are estimated in the main loop and sent to Master
  *
  *  License:
  *    This file released under the Lesser GNU Public License. The program is intended
@@ -33,6 +34,8 @@ int main ()
 	int32_t encoder_2 = 0;					//!< count of encoder ticks seen by encoder 2
 	uint16_t error_encoder_1 = 0;			//!< counts encoder errors on channel 1
 	uint16_t error_encoder_2 = 0;			//!< counts encoder errors on channel 2
+	int32_t velocity_1 = 0;					//!< speed of encoder 1 in counts per second
+	int32_t velocity_2 = 0;					//!< speed of encoder 2 in counts per second
 	volatile unsigned long dummy;       	//!< counter which controls screen print out rate
 	
 	// Create a serial port object. Test voltages will be printed to this port, which
@@ -44,15 +47,16 @@ int main ()
 
 	// Create a Slave_Driver object, "transmit". This object must be given a
 	// pointer to the serial port object so that it can print debugging information.
-	// Pointers to encoder_1 and encoder_2 are also given so that the slave_driver object can 
-	// pass those values to Master.
-	Slave_Driver transmit(&the_serial_port, &encoder_1, &encoder_2);
+	// Pointers to encoder_1 and encoder_2 and their speeds are also given so that the slave_driver 
+	// object can pass those values to Master.
+	Slave_Driver transmit(&the_serial_port, &encoder_1, &encoder_2, &velocity_1, &velocity_2);
 	
 	// Create an encoder object, "read_encoder". This object must be given a
 	// pointer to the serial port object so that it can print debugging information
-	// Pointers to encoder and encoder_error variables are also given so that the 
+	// Pointers to encoder, encoder_error and velocity variables are also given so that the 
 	// encoder object can update those values.
-	da_encoder read_encoder (&the_serial_port, &encoder_1, &encoder_2, &error_encoder_1, &error_encoder_2);
+	da_encoder read_encoder (&the_serial_port, &encoder_1, &encoder_2, &error_encoder_1, &error_encoder_2,
+							 &velocity_1, &velocity_2);
 	
 	sei();
 	// Enter infinite main loop
@@ -71,6 +75,7 @@ int main ()
 		}
 		*/
 		transmit.Packet32();
+		read_encoder.update_velocity();
 	
 	}
 	return (0);